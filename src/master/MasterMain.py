@@ -318,6 +318,11 @@ class CmdGui:
                 status_str += "  Axes confidence: [{:.1f}%, {:.1f}%, {:.1f}%]\n".format(
                     status_dict['localization_confidence_x']*100,status_dict['localization_confidence_y']*100,status_dict['localization_confidence_a']*100)
                 status_str += "Localization position uncertainty: {:.2f}\n".format(status_dict['last_position_uncertainty'])
+                status_str += "  Rejected readings: {} ({} in a row, {} reacquired)\n".format(
+                    status_dict['mm_rejected'], status_dict['mm_rejected_in_row'], status_dict['mm_reacquisitions'])
+                status_str += "Last localize wait: {} ({})\n".format(
+                    "{:.1f} s".format(status_dict['localize_wait_s']) if status_dict['localize_wait_s'] >= 0 else "not reached",
+                    "active" if status_dict['localize_wait_active'] else "passive")
                 status_str += "Controller timing: {} ms\n".format(status_dict['controller_loop_ms'])
                 status_str += "Position timing:   {} ms\n".format(status_dict['position_loop_ms'])
                 status_str += "Camera timing:   {} ms\n".format(status_dict['cam_loop_ms'])
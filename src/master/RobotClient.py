@@ -7,19 +7,47 @@ import json
 import time
 import logging
 import copy
+import struct
+import collections
 
 PORT = 8123
+UDP_PORT = 8124
+# Binary message id of a position on the UDP side channel, see RobotServer.h
+UDP_POSITION_ID = 9
 NET_TIMEOUT = 0.1 # seconds
+# Command ids of the steps a field plan can hold, the COMMAND values in constants.h
+FIELD_PLAN_STEP_IDS = {'move': 1, 'move_fine': 3, 'move_vision': 5, 'place': 6, 'load': 7, 'init': 8,
+                       'wait_for_loc': 13, 'move_fine_stop_vision': 19}
+# Most steps per upload message, FIELD_PLAN_CHUNK_STEPS in FieldPlan.h
+FIELD_PLAN_CHUNK_STEPS = 16
 START_CHAR = "<"
 END_CHAR = ">"
+# Leading byte of a length delimited binary frame, BINARY_START_CHAR in MessageFramer.h
+BINARY_START_BYTE = 0xA5
+# How long a reconnect waits for the session reply
+SESSION_TIMEOUT = 0.5 # seconds
 
 class TcpClient:
 
     def __init__(self, ip, port, timeout):
         self.socket = socket.create_connection((ip, port), timeout)
         self.socket.setblocking(False)
+        # Commands are small and latency matters more than packet count
+        self.socket.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
         if not socket:
             return None
+        self.rx_buffer = b''
+        self.frames = collections.deque()
+        # Frames received in the current session, counted the same way as the robot does. Until the session
+        # reply arrives nothing is kept, on a reconnect the robot sends again whatever it hadn't been told about.
+        self.rx_frames = 0
+        self.awaiting_session = False
+
+    def close(self):
+        try:
+            self.socket.close()
+        except socket.error:
+            pass
 
     def send(self, msg, print_debug=True):
         totalsent = 0
@@ -37,58 +65,121 @@ class TcpClient:
                 raise RuntimeError("socket connection broken")
             totalsent = totalsent + sent
 
-    def recieve(self, timeout=0.1, print_debug=True):
-
-        # logging.info("Checking socket ready")
-        # socket_ready, _, _ = select.select([self.socket], [], [])
-        # if not socket_ready:
-        #     logging.info("Socket not ready")
-        #     return ""
+    def _parse_frames(self):
+        """ Moves every complete frame out of rx_buffer, text frames go on the frames queue """
+        while self.rx_buffer:
+            if self.rx_buffer[0] == BINARY_START_BYTE:
+                # Only ever replies to binary messages, which this client doesn't send, but they still count
+                if len(self.rx_buffer) < 3:
+                    return
+                frame_len = 3 + (self.rx_buffer[1] | (self.rx_buffer[2] << 8))
+                if len(self.rx_buffer) < frame_len:
+                    return
+                self.rx_buffer = self.rx_buffer[frame_len:]
+                if not self.awaiting_session:
+                    self.rx_frames += 1
+            elif self.rx_buffer[0] == ord(START_CHAR):
+                end_idx = self.rx_buffer.find(END_CHAR.encode())
+                if end_idx == -1:
+                    return
+                msg = self.rx_buffer[1:end_idx].decode(encoding='UTF-8', errors='replace')
+                self.rx_buffer = self.rx_buffer[end_idx+1:]
+                if msg.startswith('{"type":"session"'):
+                    # Not counted, and tells us what the next frame will be counted as
+                    self.rx_frames = json.loads(msg)['data']['tx']
+                    self.awaiting_session = False
+                elif self.awaiting_session:
+                    continue
+                else:
+                    self.rx_frames += 1
+                self.frames.append(msg)
+            else:
+                # Skip to the start of the next frame
+                next_idx = [i for i in (self.rx_buffer.find(START_CHAR.encode()), self.rx_buffer.find(bytes([BINARY_START_BYTE]))) if i != -1]
+                self.rx_buffer = self.rx_buffer[min(next_idx):] if next_idx else b''
 
-        new_msg = ""
-        new_msg_ready = False
+    def recieve(self, timeout=0.1, print_debug=True):
+        """ Returns the next text frame, or an empty string if none arrives before timeout """
         start_time = time.time()
-        while not new_msg_ready and time.time() - start_time < timeout:
-            # Get new data
+        while not self.frames and time.time() - start_time < timeout:
             try:
                 data = self.socket.recv(2048)
             except socket.error:
                 continue
             if data == b'':
                 raise RuntimeError("socket connection broken")
+            self.rx_buffer += data
+            self._parse_frames()
 
-            # Decode data and parse into message
-            new_str = data.decode(encoding='UTF-8',errors='strict')
-
-            start_idx = new_str.find(START_CHAR)
-            end_idx = new_str.find(END_CHAR)
-
-            if start_idx != -1 and end_idx != -1:
-                new_msg = new_str[start_idx+1:end_idx]
-                new_msg_ready = True
-            elif start_idx != -1:
-                new_msg += new_str[start_idx+1:]
-                msg_rcv_in_progress = True
-            elif end_idx != -1:
-                new_msg += new_str[:end_idx]
-                new_msg_ready = True
-            else:
-                new_msg += new_str
-
-        if print_debug and new_msg:
+        if not self.frames:
+            return ""
+        new_msg = self.frames.popleft()
+        if print_debug:
             logging.info("RX: " + new_msg)
-        if not new_msg_ready:
-            #logging.info("Socket timeout")
-            new_msg = ""
-
         return new_msg
 
+class UdpClient:
+    """
+    Fire and forget datagrams for traffic where only the newest value matters, so a lost packet
+    never holds up the TCP commands behind it. Each datagram is tagged with an increasing sequence
+    number and the robot drops anything older than what it has already seen.
+    """
+
+    def __init__(self, ip, port):
+        self.addr = (ip, port)
+        self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.socket.setblocking(False)
+        self.seq = 0
+
+    def send(self, msg_id, payload=b''):
+        self.seq = (self.seq + 1) & 0xFFFFFFFF
+        try:
+            self.socket.sendto(struct.pack('<IB', self.seq, msg_id) + payload, self.addr)
+        except socket.error as e:
+            logging.warning("UDP send failed: {}".format(e))
+
+class ClockSync:
+    """
+    NTP style estimate of the offset from master time.monotonic() to the robot clock. Each exchange gives
+    an offset that is only wrong by the asymmetry of its round trip, so the sample with the shortest
+    round trip out of the last few is used.
+    """
+
+    def __init__(self, num_samples=8):
+        self.num_samples = num_samples
+        self.samples = []
+
+    def add_sample(self, t0, t1, t2, t3):
+        """ t0/t3 are master send and receive times, t1/t2 robot receive and send times """
+        rtt = (t3 - t0) - (t2 - t1)
+        offset = ((t1 - t0) + (t2 - t3)) / 2.0
+        self.samples.append((rtt, offset))
+        self.samples = self.samples[-self.num_samples:]
+
+    def is_synced(self):
+        return len(self.samples) > 0
+
+    def offset(self):
+        return min(self.samples)[1]
+
+    def round_trip(self):
+        return min(self.samples)[0]
+
+    def to_robot_time(self, master_time):
+        return master_time + self.offset()
+
+
 class ClientBase:
 
     def __init__(self, ip): 
+        self.ip = ip
         self.client = TcpClient(ip, PORT, NET_TIMEOUT)
         # Queue is used to help handle out of order messages recieved
         self.incoming_queue = []
+        # Robot session this client is in, 0 until one is opened
+        self.session_id = 0
+        # Type of the command still waiting for its ack, None once it arrives
+        self.awaiting_ack_type = None
 
     def wait_for_server_response(self, expected_msg_type, timeout=0.1, print_debug=True):
         """
@@ -138,6 +229,7 @@ class ClientBase:
         Logs a warning if ack is not recieved or incorrect ack is recieved
         """
 
+        self.awaiting_ack_type = msg['type']
         self.client.send(json.dumps(msg,separators=(',',':')), print_debug=print_debug) # Make sure json dump is compact for transmission
         num_wait_checks = 3
         counter = 0
@@ -160,10 +252,79 @@ class ClientBase:
             resp_ok = True
 
         if resp_ok:           
+            self.awaiting_ack_type = None
             return resp
         else:
             raise ValueError("Bad/no response")
 
+    def open_session(self, timeout=SESSION_TIMEOUT):
+        """
+        Starts a session, or carries on the current one on a new connection. Returns the session reply data,
+        which also has the running command state, or None if there was no reply
+        """
+        msg = {'type': 'session', 'data': {'id': self.session_id, 'rx': self.client.rx_frames}}
+        self.client.awaiting_session = True
+        self.client.send(json.dumps(msg, separators=(',',':')), print_debug=False)
+        resp = self.wait_for_server_response(expected_msg_type='session', timeout=timeout, print_debug=False)
+        if not resp:
+            logging.warning("Did not recieve session reply")
+            return None
+        self.session_id = resp['data']['id']
+        return resp['data']
+
+    def reconnect(self):
+        """
+        Replaces the connection after it broke or went quiet. The robot drops the old connection as soon as the
+        new one arrives and replays whatever replies were lost with it. Returns the session reply data, with
+        'delivered' set if the command that was waiting for its ack when the connection broke turned out to
+        reach the robot. Raises RuntimeError if it can't reconnect
+        """
+        rx_frames = self.client.rx_frames
+        self.client.close()
+        # Already counted, so they won't be replayed
+        for msg in self.client.frames:
+            try:
+                new_msg = json.loads(msg)
+            except ValueError:
+                continue
+            if 'type' in new_msg:
+                self.incoming_queue.append(new_msg)
+        try:
+            self.client = TcpClient(self.ip, PORT, NET_TIMEOUT)
+        except socket.error as e:
+            raise RuntimeError("reconnect failed: {}".format(e))
+        self.client.rx_frames = rx_frames
+        data = self.open_session()
+        if data is None:
+            raise RuntimeError("no session reply after reconnect")
+        if data['resumed']:
+            logging.info("Resumed session {}, {} replies replayed".format(data['id'], data['replayed']))
+        else:
+            logging.warning("Could not resume session, started {}".format(data['id']))
+
+        # The replayed replies follow the session reply, the ack for a command in flight is among them if it arrived
+        for _ in range(data['replayed']):
+            msg = self.client.recieve(timeout=SESSION_TIMEOUT, print_debug=False)
+            if not msg:
+                break
+            try:
+                new_msg = json.loads(msg)
+            except ValueError:
+                continue
+            if 'type' in new_msg:
+                self.incoming_queue.append(new_msg)
+        data['delivered'] = self.awaiting_ack_type is None or self._take_ack(self.awaiting_ack_type)
+        self.awaiting_ack_type = None
+        return data
+
+    def _take_ack(self, msg_type):
+        """ Removes an ack for msg_type from the incoming queue, returns whether there was one """
+        for ix in range(len(self.incoming_queue)):
+            if self.incoming_queue[ix]['type'] == 'ack' and self.incoming_queue[ix].get('data') == msg_type:
+                del self.incoming_queue[ix]
+                return True
+        return False
+
     def net_status(self):
         """ Check if the network connection is ok"""
         msg = {'type': 'check'}
@@ -198,7 +359,11 @@ class RobotClient(ClientBase):
         super().__init__(cfg.ip_map[robot_id])
 
         self.robot_id = robot_id
+        self.clock_sync = ClockSync()
         self.cfg = cfg
+        self.udp = UdpClient(cfg.ip_map[robot_id], UDP_PORT)
+        self.last_ping_rtt = None
+        self.open_session()
 
     def move(self, x, y, a):
         """ Tell robot to move to specific location """
@@ -230,6 +395,16 @@ class RobotClient(ClientBase):
         msg = {'type': 'move_vision', 'data': {'x': x, 'y': y, 'a': a}}
         self.send_msg_and_wait_for_ack(msg)
 
+    def update_goal(self, x, y, a):
+        """ Send the running move or move_vision somewhere else without stopping, in the frame it was started in """
+        msg = {'type': 'update_goal', 'data': {'x': x, 'y': y, 'a': a}}
+        self.send_msg_and_wait_for_ack(msg)
+
+    def move_path(self, points):
+        """ Tell robot to move through a list of (x, y, a) global positions without stopping at each one """
+        msg = {'type': 'move_path', 'data': {'points': [[x, y, a] for (x, y, a) in points]}}
+        self.send_msg_and_wait_for_ack(msg)
+
     def move_const_vel(self, vx, vy, va, t):
         """ Tell robot to move at constant velocity for a specific amount of time"""
         msg = {'type': 'move_const_vel', 'data': {'vx': vx, 'vy': vy, 'va': va, 't': t}}
@@ -275,6 +450,11 @@ class RobotClient(ClientBase):
         msg = {'type': 'toggle_vision_debug'}
         self.send_msg_and_wait_for_ack(msg)
 
+    def dump_trace(self):
+        """ Tell robot to write its recent timing trace to disk for chrome://tracing"""
+        msg = {'type': 'dump_trace'}
+        self.send_msg_and_wait_for_ack(msg)
+
     def start_cameras(self):
         """ Tell robot to start the cameras"""
         msg = {'type': 'start_cameras'}
@@ -285,6 +465,137 @@ class RobotClient(ClientBase):
         msg = {'type': 'stop_cameras'}
         self.send_msg_and_wait_for_ack(msg)
 
+    def calibrate_cameras(self):
+        """ Tell robot to run the camera extrinsic calibration in front of the vision target"""
+        msg = {'type': 'calibrate_cameras'}
+        self.send_msg_and_wait_for_ack(msg)
+
+    def sync_clock(self, num_exchanges=5):
+        """ Runs a few time_sync exchanges to update the offset to the robot clock, returns True if any succeeded """
+        ok = False
+        for _ in range(num_exchanges):
+            t0 = time.monotonic()
+            self.client.send(json.dumps({'type': 'time_sync', 'data': {'t0': t0}}), print_debug=False)
+            resp = self.wait_for_server_response(expected_msg_type='time_sync', print_debug=False)
+            t3 = time.monotonic()
+            if not resp or abs(resp['data']['t0'] - t0) > 1e-3:
+                logging.warning("Did not recieve time_sync response")
+                continue
+            self.clock_sync.add_sample(t0, resp['data']['t1'], resp['data']['t2'], t3)
+            ok = True
+        if ok:
+            logging.info("Robot clock offset {:.4f} s, round trip {:.1f} ms".format(
+                self.clock_sync.offset(), self.clock_sync.round_trip() * 1000))
+        return ok
+
+    def ping(self):
+        """ Measures the round trip to the robot and back through its command loop, returns it in seconds or None
+        if there was no reply. The last measured round trip goes along with each ping so it shows up in the
+        robot status as socket_ping_rtt_ms. """
+        data = {'t': time.monotonic()}
+        if self.last_ping_rtt is not None:
+            data['rtt'] = self.last_ping_rtt * 1000
+        self.client.send(json.dumps({'type': 'ping', 'data': data}), print_debug=False)
+        resp = self.wait_for_server_response(expected_msg_type='pong', print_debug=False)
+        if not resp or abs(resp['data']['t'] - data['t']) > 1e-3:
+            logging.warning("Did not recieve pong")
+            return None
+        self.last_ping_rtt = time.monotonic() - data['t']
+        return self.last_ping_rtt
+
+    def plan(self, move_type, x=0, y=0, a=0, points=None, start=None, samples=0):
+        """ Plans move_type (e.g. 'move', 'move_rel', 'move_path') without running it. Plans from start ([x, y, a])
+        if given, otherwise from where the robot is now. Returns the plan data with ok, duration, the peak wheel
+        speeds and the switch times of point to point moves, or None if there was no reply. With samples set it
+        also has that many [t, x, y, a] points along the move, up to 120. """
+        data = {'move': move_type, 'x': x, 'y': y, 'a': a}
+        if points is not None:
+            data['points'] = points
+        if start is not None:
+            data['start'] = start
+        if samples:
+            data['samples'] = samples
+        self.client.send(json.dumps({'type': 'plan', 'data': data}), print_debug=False)
+        resp = self.wait_for_server_response(expected_msg_type='plan', print_debug=False)
+        if not resp:
+            logging.warning("Did not recieve plan")
+            return None
+        return resp['data']
+
+    def set_param(self, name, value):
+        """ Tunes the robot config setting at path name (e.g. 'motion.translation.gains.kp') without a restart.
+        The robot checks the value and then applies it from the next move on. Returns the reply data with ok,
+        value and pending, or an error, or None if there was no reply. """
+        self.client.send(json.dumps({'type': 'set_param', 'data': {'name': name, 'value': value}}))
+        resp = self.wait_for_server_response(expected_msg_type='param')
+        if not resp:
+            logging.warning("Did not recieve param")
+            return None
+        return resp['data']
+
+    def get_param(self, name):
+        """ Reads back a tunable setting, value includes changes still waiting for the next move """
+        self.client.send(json.dumps({'type': 'get_param', 'data': {'name': name}}), print_debug=False)
+        resp = self.wait_for_server_response(expected_msg_type='param', print_debug=False)
+        if not resp:
+            logging.warning("Did not recieve param")
+            return None
+        return resp['data']
+
+    def send_position(self, x, y, a, measured_time=None):
+        """ Send an external position reading. measured_time is the time.monotonic() the reading was taken at,
+        it is sent on the robot clock once sync_clock has succeeded so the robot can apply it with delay compensation """
+        data = {'x': x, 'y': y, 'a': a}
+        if measured_time is not None and self.clock_sync.is_synced():
+            data['t'] = self.clock_sync.to_robot_time(measured_time)
+        msg = {'type': 'p', 'data': data}
+        self.send_msg_and_wait_for_ack(msg)
+
+    def stream_position(self, x, y, a, measured_time=None):
+        """ Same as send_position but over the UDP side channel, nothing is acked so a lost reading is just
+        replaced by the next one instead of delaying commands on the TCP connection """
+        payload = struct.pack('<fff', x, y, a)
+        if measured_time is not None and self.clock_sync.is_synced():
+            payload += struct.pack('<d', self.clock_sync.to_robot_time(measured_time))
+        self.udp.send(UDP_POSITION_ID, payload)
+
+    def enqueue(self, msg, seq):
+        """ Add a motion or tray command msg to the robot command queue, tagged with sequence id seq.
+        The robot starts it as soon as everything queued before it finishes. """
+        queued_msg = dict(msg)
+        queued_msg['queue'] = True
+        queued_msg['seq'] = seq
+        self.send_msg_and_wait_for_ack(queued_msg)
+
+    def upload_field_plan(self, plan_id, steps):
+        """ Stores steps, a list of (type, x, y, a) with the type of a move or tray command, on the robot as
+        plan plan_id. Tray steps ignore x, y, a. The plan is kept in a journal on the robot and only runs once
+        run_field_plan is sent. Returns whether the robot reports having all of it. """
+        for first in range(0, len(steps), FIELD_PLAN_CHUNK_STEPS):
+            flat = []
+            for (step_type, x, y, a) in steps[first:first + FIELD_PLAN_CHUNK_STEPS]:
+                flat += [FIELD_PLAN_STEP_IDS[step_type], x, y, a]
+            msg = {'type': 'field_plan_upload', 'data': {'id': plan_id, 'first': first, 'total': len(steps), 'steps': flat}}
+            self.send_msg_and_wait_for_ack(msg)
+        status = self.request_status()
+        return bool(status) and status.get('field_plan_id') == plan_id and status.get('field_plan_steps') == len(steps)
+
+    def run_field_plan(self):
+        """ Starts the uploaded plan, or carries on with a paused one from the step it stopped at. The robot then
+        works through it on its own, field_plan_state and field_plan_step in the status show how far it got. """
+        msg = {'type': 'field_plan_run'}
+        self.send_msg_and_wait_for_ack(msg)
+
+    def pause_field_plan(self):
+        """ Stops the plan once the step it is on finishes """
+        msg = {'type': 'field_plan_pause'}
+        self.send_msg_and_wait_for_ack(msg)
+
+    def abort_field_plan(self):
+        """ Drops the plan, a step already running still finishes """
+        msg = {'type': 'field_plan_abort'}
+        self.send_msg_and_wait_for_ack(msg)
+
 class BaseStationClient(ClientBase):
     
     def __init__(self, cfg):
@@ -316,9 +627,54 @@ class MockRobotClient:
     def move_fine(self, x, y, a):
         pass
 
+    def move_path(self, points):
+        pass
+
+    def update_goal(self, x, y, a):
+        pass
+
+    def enqueue(self, msg, seq):
+        pass
+
+    def upload_field_plan(self, plan_id, steps):
+        return True
+
+    def run_field_plan(self):
+        pass
+
+    def pause_field_plan(self):
+        pass
+
+    def abort_field_plan(self):
+        pass
+
+    def sync_clock(self, num_exchanges=5):
+        return True
+
+    def ping(self):
+        return 0
+
+    def plan(self, move_type, x=0, y=0, a=0, points=None, start=None, samples=0):
+        return {'move': move_type, 'ok': True, 'duration': 0}
+
+    def set_param(self, name, value):
+        return {'name': name, 'ok': True, 'value': value, 'pending': True}
+
+    def get_param(self, name):
+        return {'name': name, 'ok': True, 'value': 0, 'pending': False}
+
+    def send_position(self, x, y, a, measured_time=None):
+        pass
+
+    def stream_position(self, x, y, a, measured_time=None):
+        pass
+
     def place(self):
         pass
 
+    def reconnect(self):
+        return {'id': 1, 'resumed': True, 'replayed': 0, 'delivered': True}
+
     def net_status(self):
         return True
 
@@ -337,6 +693,9 @@ class MockRobotClient:
     def wait_for_localization(self):
         pass
 
+    def calibrate_cameras(self):
+        pass
+
     def toggle_distance(self):
         pass
 
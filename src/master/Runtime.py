@@ -15,6 +15,11 @@ from RobotClient import RobotClient, BaseStationClient, MockRobotClient, MockBas
 from FieldPlanner import ActionTypes, Action, TestPlan, RunFieldPlanning
 from Utils import write_file, NonBlockingTimer, ActionValidator
 
+# Seconds without a status reply before the connection is replaced. Status is polled every robot_status_wait_time,
+# so this is several polls and well clear of Wi-Fi round trip jitter. It has to stay below session.idle_timeout_ms
+# on the robot, which drops a client that goes quiet for longer than that.
+STATUS_SILENCE_BEFORE_RECONNECT = 1.0
+
 class RobotInterface:
     def __init__(self, config, robot_id):
         self.comms_online = False
@@ -29,6 +34,7 @@ class RobotInterface:
         self.current_action_timer = None
         self.wait_timer = None
         self.waiting_active = False
+        self.last_status_ok_time = 0
 
     def bring_online(self, use_mock=False):
         self._bring_comms_online(use_mock)
@@ -57,6 +63,7 @@ class RobotInterface:
             ActionTypes.TOGGLE_VISION_DEBUG: self.robot_client.toggle_vision_debug,
             ActionTypes.START_CAMERAS: self.robot_client.start_cameras,
             ActionTypes.STOP_CAMERAS: self.robot_client.stop_cameras,
+            ActionTypes.CALIBRATE_CAMERAS: self.robot_client.calibrate_cameras,
         }
 
     def _bring_comms_online(self, use_mock=False):
@@ -70,15 +77,37 @@ class RobotInterface:
 
             if self.robot_client.net_status():
                 self.comms_online = True
+                self.last_status_ok_time = time.time()
                 self._setup_action_map()
                 logging.info("Connected to {} over wifi".format(self.robot_id))
         except Exception as e:
             logging.info("Couldn't connect to {} over wifi".format(self.robot_id))
             return 
 
+    def _reconnect(self):
+        """
+        Swaps in a new connection that resumes the session, goes offline if that fails. Returns the session reply
+        data, or None when offline
+        """
+        logging.info("Network connection with {} lost, reconnecting".format(self.robot_id))
+        self.last_status_ok_time = time.time()
+        try:
+            return self.robot_client.reconnect()
+        except RuntimeError as e:
+            logging.info("Couldn't reconnect to {}: {}".format(self.robot_id, e))
+            self.comms_online = False
+            self.last_status = "{} offline".format(self.robot_id)
+            return None
+
     def _get_status_from_robot(self):
         self.last_status = self.robot_client.request_status()
         self.last_status_time = time.time()
+        if self.last_status is None:
+            # A quiet link is usually a Wi-Fi drop that TCP would take much longer to give up on
+            if time.time() - self.last_status_ok_time > STATUS_SILENCE_BEFORE_RECONNECT:
+                self._reconnect()
+            return
+        self.last_status_ok_time = time.time()
         
         # Reset current action and move data if the robot finished an action
         if self.current_action != ActionTypes.NONE and self.last_status is not None and \
@@ -96,9 +125,7 @@ class RobotInterface:
                 try:
                     self._get_status_from_robot()
                 except RuntimeError:
-                    logging.info("Network connection with {} lost".format(self.robot_id))
-                    self.comms_online = False
-                    self.last_status = "{} offline".format(self.robot_id)
+                    self._reconnect()
 
             if self.waiting_active:
                 if self.wait_timer.check():
@@ -112,45 +139,56 @@ class RobotInterface:
 
         logging.info("Running {} on {}".format(action.action_type, self.robot_id))
 
-        try:
-            if action.action_type is not None:
-                self.current_action = action.action_type
-            
-            if action.action_type == ActionTypes.MOVE_COARSE:
-                self.robot_client.move(action.x, action.y, action.a)
-                self.current_move_data = [action.x, action.y, action.getAngleDegrees()]
-            elif action.action_type == ActionTypes.MOVE_REL:
-                self.robot_client.move_rel(action.x, action.y, action.a)
-            elif action.action_type == ActionTypes.MOVE_REL_SLOW:
-                self.robot_client.move_rel_slow(action.x, action.y, action.a)
-            elif action.action_type == ActionTypes.MOVE_FINE:
-                self.robot_client.move_fine(action.x, action.y, action.a)
-                self.current_move_data = [action.x, action.y, action.getAngleDegrees()]
-            elif action.action_type == ActionTypes.MOVE_FINE_STOP_VISION:
-                self.robot_client.move_fine_stop_vision(action.x, action.y, action.a)
-                self.current_move_data = [action.x, action.y, action.getAngleDegrees()]
-            elif action.action_type == ActionTypes.MOVE_WITH_VISION:
-                self.robot_client.move_with_vision(action.x, action.y, action.a)
-            elif action.action_type == ActionTypes.MOVE_CONST_VEL:
-                self.robot_client.move_const_vel(action.vx, action.vy, action.va, action.t)
-            elif action.action_type == ActionTypes.SET_POSE:
-                self.robot_client.set_pose(action.x, action.y, action.a)
-            elif action.action_type == ActionTypes.NET:
-                status = self.robot_client.net_status()
-                logging.info("Robot {} network status is: {}".format(self.robot_id, status))
-            elif action.action_type == ActionTypes.WAIT:
-                self.wait_timer = NonBlockingTimer(action.time)
-                self.waiting_active = True
-            elif action.action_type in self.simple_action_map.keys():
-                self.simple_action_map[action.action_type]()
-            else:
-                logging.info("Unknown action: {}".format(action.action_type))
+        if action.action_type is not None:
+            self.current_action = action.action_type
+        # Set before sending so status checks always have it, even if the send fails part way
+        self.current_action_timer = NonBlockingTimer(self.config.robot_next_action_wait_time)
 
-            self.current_action_timer = NonBlockingTimer(self.config.robot_next_action_wait_time)
+        try:
+            self._send_action(action)
         except RuntimeError:
-            logging.info("Network connection with {} lost".format(self.robot_id))
-            self.comms_online = False
-            self.last_status = "{} offline".format(self.robot_id)
+            # The action may or may not have reached the robot, the resumed session replays its ack if it did
+            session = self._reconnect()
+            if session is None or session['delivered']:
+                return
+            logging.info("Resending {} to {}".format(action.action_type, self.robot_id))
+            self.current_action_timer = NonBlockingTimer(self.config.robot_next_action_wait_time)
+            try:
+                self._send_action(action)
+            except RuntimeError:
+                logging.warning("Could not resend {} to {}".format(action.action_type, self.robot_id))
+                self._reconnect()
+
+    def _send_action(self, action):
+        if action.action_type == ActionTypes.MOVE_COARSE:
+            self.robot_client.move(action.x, action.y, action.a)
+            self.current_move_data = [action.x, action.y, action.getAngleDegrees()]
+        elif action.action_type == ActionTypes.MOVE_REL:
+            self.robot_client.move_rel(action.x, action.y, action.a)
+        elif action.action_type == ActionTypes.MOVE_REL_SLOW:
+            self.robot_client.move_rel_slow(action.x, action.y, action.a)
+        elif action.action_type == ActionTypes.MOVE_FINE:
+            self.robot_client.move_fine(action.x, action.y, action.a)
+            self.current_move_data = [action.x, action.y, action.getAngleDegrees()]
+        elif action.action_type == ActionTypes.MOVE_FINE_STOP_VISION:
+            self.robot_client.move_fine_stop_vision(action.x, action.y, action.a)
+            self.current_move_data = [action.x, action.y, action.getAngleDegrees()]
+        elif action.action_type == ActionTypes.MOVE_WITH_VISION:
+            self.robot_client.move_with_vision(action.x, action.y, action.a)
+        elif action.action_type == ActionTypes.MOVE_CONST_VEL:
+            self.robot_client.move_const_vel(action.vx, action.vy, action.va, action.t)
+        elif action.action_type == ActionTypes.SET_POSE:
+            self.robot_client.set_pose(action.x, action.y, action.a)
+        elif action.action_type == ActionTypes.NET:
+            status = self.robot_client.net_status()
+            logging.info("Robot {} network status is: {}".format(self.robot_id, status))
+        elif action.action_type == ActionTypes.WAIT:
+            self.wait_timer = NonBlockingTimer(action.time)
+            self.waiting_active = True
+        elif action.action_type in self.simple_action_map.keys():
+            self.simple_action_map[action.action_type]()
+        else:
+            logging.info("Unknown action: {}".format(action.action_type))
 
 
 
@@ -26,6 +26,7 @@ class ActionTypes(enum.Enum):
     WAIT = 19,
     MOVE_FINE_STOP_VISION = 20,
     PAUSE_PLAN = 21,
+    CALIBRATE_CAMERAS = 22,
 
 class NonBlockingTimer:
 
@@ -0,0 +1,70 @@
+"""
+Reader for the flight recorder ring written by the robot (src/robot/src/FlightRecorder.h).
+
+Works on the live ring in /dev/shm, on the copy of the previous run kept at startup and on the dumps written
+when the recorder freezes. Records come back oldest first, a record whose seq doesn't match its index was cut
+short by a crash or overwritten and is dropped.
+"""
+
+import struct
+import numpy as np
+
+MAGIC = b"DRFLIGHT"
+VERSION = 1
+HEADER_FORMAT = "<8sIIIIQQQdQ"
+NUM_VALUES = 10
+RECORD_DTYPE = np.dtype([
+    ("seq", "<u8"),
+    ("stamp", "<f8"),
+    ("type", "u1"),
+    ("flags", "u1"),
+    ("aux16", "<u2"),
+    ("aux", "<u4"),
+    ("v", "<f4", (NUM_VALUES,)),
+])
+
+RECORD_TYPES = {1: "control", 2: "motor_command", 3: "position", 4: "camera", 5: "loop", 6: "event"}
+EVENTS = {1: "command_received", 2: "freeze"}
+FREEZE_REASONS = {0: "none", 1: "error", 2: "estop", 3: "vision_timeout"}
+
+
+def read_flight_records(path):
+    """ Returns (header dict, structured numpy array of records oldest first) """
+    with open(path, "rb") as f:
+        raw = f.read()
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    magic, version, record_size, capacity, freeze_reason, head, stop_index, freeze_index, freeze_stamp, _ = \
+        struct.unpack_from(HEADER_FORMAT, raw, 0)
+    if magic != MAGIC or version != VERSION or record_size != RECORD_DTYPE.itemsize:
+        raise ValueError("{} is not a flight recorder file".format(path))
+    header = {
+        "capacity": capacity,
+        "freeze_reason": FREEZE_REASONS.get(freeze_reason, freeze_reason),
+        "head": head,
+        "freeze_index": freeze_index,
+        "freeze_stamp": freeze_stamp,
+    }
+
+    slots = np.frombuffer(raw, dtype=RECORD_DTYPE, count=capacity, offset=header_size)
+    indices = np.arange(max(head - capacity, 0), head, dtype=np.uint64)
+    records = slots[indices % capacity]
+    return header, records[records["seq"] == indices + 1]
+
+
+def records_of_type(records, name):
+    """ Records of one type by its name in RECORD_TYPES """
+    code = [k for k, v in RECORD_TYPES.items() if v == name][0]
+    return records[records["type"] == code]
+
+
+if __name__ == '__main__':
+    import sys
+    header, records = read_flight_records(sys.argv[1])
+    print(header)
+    for rec in records[-40:]:
+        kind = RECORD_TYPES.get(int(rec["type"]), str(rec["type"]))
+        if kind == "event":
+            kind = "event:" + EVENTS.get(int(rec["aux16"]), str(rec["aux16"]))
+        print("{:10.3f} {:22s} flags={} aux16={} aux={} {}".format(
+            rec["stamp"], kind, rec["flags"], rec["aux16"], rec["aux"], np.round(rec["v"], 3)))
@@ -6,6 +6,7 @@ import config
 import csv
 import numpy as np
 import datetime
+import telemetry_reader
 
 possible_rows = [
     'time',
@@ -26,12 +27,12 @@ possible_rows = [
     'control_vel_a'
 ]
 
-def scp_last_motion_log(ip, remote_path, local_path):
+def scp_last_motion_log(ip, remote_path, local_path, recursive=False):
     ssh_client = paramiko.SSHClient()
     ssh_client.load_system_host_keys()
     ssh_client.connect(ip, username="pi", password='dominobot')
     with SCPClient(ssh_client.get_transport()) as scp:
-        scp.get(remote_path, local_path)
+        scp.get(remote_path, local_path, recursive=recursive)
     if not os.path.exists(local_path):
         raise ValueError("SCP image did not complete successfully")
 
@@ -56,6 +57,16 @@ def parse_log_file(path):
 
     return data
 
+def parse_telemetry(path, move_id=-1):
+    """ Same output as parse_log_file, from the binary telemetry of one move (the last one by default) """
+    data = init_data()
+    columns = telemetry_reader.read_telemetry(path, move_id)
+    for name in possible_rows:
+        data[name] = list(columns.get(name, []))
+    if len(columns.get('move_id', [])) > 0:
+        data['title'] = "Move {}".format(columns['move_id'][0])
+    return data
+
 def parse_row(row, data):
     entry_data = row[-1].replace('"','').split(",")
     entry_name = entry_data[0]
@@ -101,16 +112,24 @@ if __name__ == '__main__':
     cfg = config.Config()
 
     GET_FILE = True
+    USE_TELEMETRY = False
     EXISTING_LOCAL_FILENAME = "WiggleVision.csv"
 
-    if GET_FILE:
-        robot_ip = cfg.ip_map['robot1']
-        remote_file = "/home/pi/DominoRobot/src/robot/log/last_motion_log.csv"
-        local_file = os.path.join(cfg.log_folder, "last_motion_log.csv")
-        scp_last_motion_log(robot_ip, remote_file, local_file)
+    robot_ip = cfg.ip_map['robot1']
+    if USE_TELEMETRY:
+        # Binary telemetry keeps every move, this plots the last one
+        if GET_FILE:
+            remote_dir = "/home/pi/DominoRobot/src/robot/log/telemetry"
+            scp_last_motion_log(robot_ip, remote_dir, cfg.log_folder, recursive=True)
+        parsed_data = parse_telemetry(os.path.join(cfg.log_folder, "telemetry"))
     else:
-        local_file = os.path.join(cfg.log_folder, EXISTING_LOCAL_FILENAME)
+        if GET_FILE:
+            remote_file = "/home/pi/DominoRobot/src/robot/log/last_motion_log.csv"
+            local_file = os.path.join(cfg.log_folder, "last_motion_log.csv")
+            scp_last_motion_log(robot_ip, remote_file, local_file)
+        else:
+            local_file = os.path.join(cfg.log_folder, EXISTING_LOCAL_FILENAME)
+        parsed_data = parse_log_file(local_file)
 
-    parsed_data = parse_log_file(local_file)
     # plot_data(parsed_data, rows_to_plot=['control_vel_x','control_vel_y','control_vel_a'])
-    plot_rows_axes(parsed_data, ['pos','vel','target_pos','target_vel','control_vel'], ['a'])
\ No newline at end of file
+    plot_rows_axes(parsed_data, ['pos','vel','target_pos','target_vel','control_vel'], ['a'])
@@ -0,0 +1,71 @@
+"""
+Reader for the binary control cycle telemetry written by the robot (src/robot/src/Telemetry.h).
+
+Each chunk file has a header, a table of column descriptors and then one contiguous array per column,
+so every column is read straight into numpy without parsing. Only the first record_count values of a
+column are valid, which also makes it safe to read a chunk the robot is still writing.
+"""
+
+import glob
+import os
+import struct
+import numpy as np
+
+MAGIC = b"DRTELEM\0"
+VERSION = 1
+HEADER_FORMAT = "<8sIIIIQ32s"
+COLUMN_FORMAT = "<24sII"
+DTYPES = {0: np.float32, 1: np.float64, 2: np.uint32}
+
+
+def read_chunk(path):
+    """ Returns a dict of column name to numpy array for one chunk file """
+    with open(path, "rb") as f:
+        raw = f.read()
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    magic, version, num_columns, capacity, chunk_index, record_count, _ = struct.unpack_from(HEADER_FORMAT, raw, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("{} is not a telemetry chunk".format(path))
+    count = min(record_count, capacity)
+
+    columns = {}
+    column_size = struct.calcsize(COLUMN_FORMAT)
+    for i in range(num_columns):
+        name, dtype, offset = struct.unpack_from(COLUMN_FORMAT, raw, header_size + i * column_size)
+        name = name.split(b"\0", 1)[0].decode()
+        columns[name] = np.frombuffer(raw, dtype=DTYPES[dtype], count=count, offset=offset)
+    return columns
+
+
+def chunk_paths(path):
+    """ Chunk files of a telemetry directory in the order they were written, or just path if it is a file """
+    if os.path.isdir(path):
+        return sorted(glob.glob(os.path.join(path, "telemetry_*.bin")))
+    return [path]
+
+
+def read_telemetry(path, move_id=None):
+    """
+    Reads a chunk file or a whole telemetry directory into one dict of column arrays.
+    With move_id set only that move is returned, move_id=-1 picks the last move in the data.
+    """
+    chunks = [read_chunk(p) for p in chunk_paths(path)]
+    chunks = [c for c in chunks if len(c["time"]) > 0]
+    if not chunks:
+        return {}
+    data = {name: np.concatenate([c[name] for c in chunks]) for name in chunks[0]}
+
+    if move_id is not None:
+        if move_id == -1:
+            move_id = data["move_id"][-1]
+        mask = data["move_id"] == move_id
+        data = {name: values[mask] for name, values in data.items()}
+    return data
+
+
+if __name__ == '__main__':
+    import sys
+    data = read_telemetry(sys.argv[1])
+    for name, values in data.items():
+        print("{:16s} {}".format(name, values[-5:]))
@@ -0,0 +1,21 @@
+#include "Bench.h"
+
+#include "ApproachMpc.h"
+
+BENCHMARK_GROUP(approach_mpc)
+{
+    const ApproachMpcParams params = {true, 0.6, 0.1, 100, 20, 10, 1, 1, 20};
+    const DynamicLimits trans_limits = {0.1, 0.15, 1.0};
+    const DynamicLimits rot_limits = {0.3, 0.5, 1.0};
+    const WheelLimits wheels = {false, 0.3, 0.12, 0.2};
+    ApproachMpc mpc;
+    // Once per fine or vision move
+    ctx.run("approach_mpc_configure", [&]() { mpc.configure(params, trans_limits, rot_limits, wheels); });
+
+    // Once per control cycle while the approach is active
+    const Velocity error = {0.03, -0.01, 0.05};
+    const Velocity velocity = {0.02, 0, 0};
+    Velocity cmd;
+    ctx.run("approach_mpc_solve", [&]() { cmd = mpc.solve(error, velocity, 0.01); });
+    doNotOptimize(cmd);
+}
@@ -0,0 +1,104 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+namespace
+{
+    // Shortest sample, well above steady_clock resolution and call overhead
+    const double MIN_SAMPLE_NS = 20000;
+    const int MIN_SAMPLES = 10;
+
+    double nowNs()
+    {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(idx, sorted.size() - 1)];
+    }
+
+    BenchResult summarize(const std::string& name, const std::vector<double>& sorted)
+    {
+        BenchResult result;
+        result.name = name;
+        result.iterations = static_cast<long>(sorted.size());
+        result.mean_ns = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+        result.median_ns = percentile(sorted, 0.5);
+        result.p90_ns = percentile(sorted, 0.9);
+        result.p99_ns = percentile(sorted, 0.99);
+        result.min_ns = sorted.front();
+        result.max_ns = sorted.back();
+        return result;
+    }
+}
+
+std::vector<BenchGroup>& benchGroups()
+{
+    static std::vector<BenchGroup> groups;
+    return groups;
+}
+
+BenchRegistrar::BenchRegistrar(const char* group, BenchFunction fn)
+{
+    benchGroups().push_back({group, fn});
+}
+
+BenchContext::BenchContext(const std::string& filter, double min_time_ms)
+: filter_(filter),
+  min_time_ms_(min_time_ms),
+  results_()
+{}
+
+bool BenchContext::enabled(const std::string& name) const
+{
+    return filter_.empty() || name.find(filter_) != std::string::npos;
+}
+
+void BenchContext::run(const std::string& name, const std::function<void()>& fn)
+{
+    if(!enabled(name)) return;
+
+    // Warm up caches and find a batch size that makes each sample long enough
+    long batch = 1;
+    while(true)
+    {
+        double start = nowNs();
+        for (long i = 0; i < batch; i++) fn();
+        double elapsed = nowNs() - start;
+        if(elapsed >= MIN_SAMPLE_NS || batch >= (1 << 20)) break;
+        batch *= 2;
+    }
+
+    std::vector<double> samples;
+    const double end_ns = nowNs() + min_time_ms_ * 1e6;
+    while(nowNs() < end_ns || static_cast<int>(samples.size()) < MIN_SAMPLES)
+    {
+        double start = nowNs();
+        for (long i = 0; i < batch; i++) fn();
+        samples.push_back((nowNs() - start) / batch);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result = summarize(name, samples);
+    result.iterations = batch * static_cast<long>(samples.size());
+    report(result);
+}
+
+void BenchContext::reportSamples(const std::string& name, std::vector<double> samples_ns)
+{
+    if(samples_ns.empty()) return;
+    std::sort(samples_ns.begin(), samples_ns.end());
+    report(summarize(name, samples_ns));
+}
+
+void BenchContext::report(const BenchResult& result)
+{
+    if(!enabled(result.name)) return;
+    if(result.median_ns >= 0) printf("%-40s median %12.1f ns  p90 %12.1f ns  (%ld iterations)\n", result.name.c_str(), result.median_ns, result.p90_ns, result.iterations);
+    else printf("%-40s %12.3f %s  (%ld samples)\n", result.name.c_str(), result.value, result.unit.c_str(), result.iterations);
+    results_.push_back(result);
+}
@@ -0,0 +1,81 @@
+#ifndef Bench_h
+#define Bench_h
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Minimal benchmark harness for bench-main. Benchmarks are plain functions registered with BENCHMARK_GROUP,
+// each group can time any number of named operations with BenchContext::run.
+
+struct BenchResult
+{
+    std::string name;
+    long iterations = 0;
+    // Per operation, negative when not measured
+    double mean_ns = -1;
+    double median_ns = -1;
+    double p90_ns = -1;
+    double p99_ns = -1;
+    double min_ns = -1;
+    double max_ns = -1;
+    // Non timing measurement such as an accuracy, negative when not measured
+    double value = -1;
+    std::string unit;
+};
+
+// Keeps the compiler from optimizing away a result that is otherwise unused
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+class BenchContext
+{
+  public:
+    BenchContext(const std::string& filter, double min_time_ms);
+
+    // Times fn, batching calls so every sample is long enough to measure, until min_time_ms has passed
+    void run(const std::string& name, const std::function<void()>& fn);
+
+    // For operations timed elsewhere, e.g. pipeline stages from the tracer
+    void report(const BenchResult& result);
+
+    // For latencies measured one event at a time, reports the distribution of the samples
+    void reportSamples(const std::string& name, std::vector<double> samples_ns);
+
+    bool enabled(const std::string& name) const;
+
+    double minTimeMs() const { return min_time_ms_; }
+
+    const std::vector<BenchResult>& results() const { return results_; }
+
+  private:
+    std::string filter_;
+    double min_time_ms_;
+    std::vector<BenchResult> results_;
+};
+
+using BenchFunction = void (*)(BenchContext&);
+
+struct BenchRegistrar
+{
+    BenchRegistrar(const char* group, BenchFunction fn);
+};
+
+struct BenchGroup
+{
+    const char* name;
+    BenchFunction fn;
+};
+
+std::vector<BenchGroup>& benchGroups();
+
+#define BENCHMARK_GROUP(name) \
+    static void name(BenchContext& ctx); \
+    static BenchRegistrar name##_registrar(#name, name); \
+    static void name(BenchContext& ctx)
+
+#endif //Bench_h
@@ -0,0 +1,192 @@
+#include "Bench.h"
+
+#include "camera_tracker/CameraPipeline.h"
+#include "Trace.h"
+#include <cstdio>
+#include "../test/test-utils.h"
+
+namespace
+{
+    const std::string IMAGE_DIR = "/home/pi/DominoRobot/src/robot/test/testdata/new_images/";
+
+    // Stage timings come from the tracer histograms, so they are bucket edges rather than exact samples
+    void reportStage(BenchContext& ctx, const std::string& name, const TraceStats& stats, TRACE_POINT point)
+    {
+        const int p = static_cast<int>(point);
+        if(stats.count[p] == 0) return;
+        BenchResult result;
+        result.name = name;
+        result.iterations = stats.count[p];
+        result.median_ns = stats.p50_us[p] * 1000.0;
+        result.p99_ns = stats.p99_us[p] * 1000.0;
+        result.max_ns = stats.max_us[p] * 1000.0;
+        ctx.report(result);
+    }
+
+    // CameraPipeline can't recover from missing calibration, so benches leave cameras without it out rather than abort the run
+    bool haveCalibration(const std::string& prefix, CAMERA_ID id)
+    {
+        std::string calibration_path = cfg.lookup("vision_tracker." + CameraPipeline::cameraIdToString(id) + ".calibration_file");
+        cv::FileStorage fs(calibration_path, cv::FileStorage::READ);
+        if(fs["K"].isNone() || fs["D"].isNone())
+        {
+            printf("Skipping %s, no calibration at %s\n", prefix.c_str(), calibration_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void benchImage(BenchContext& ctx, const std::string& prefix, const std::string& image, CAMERA_ID id, bool roi,
+                    const std::string& undistort_mode = "remap", bool pyramid = false)
+    {
+        if(!haveCalibration(prefix, id)) return;
+
+        SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+        SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", IMAGE_DIR + image);
+        SafeConfigModifier<std::string> config_modifier_3("vision_tracker.rear.debug_image", IMAGE_DIR + image);
+        SafeConfigModifier<bool> config_modifier_4("vision_tracker.detection.roi.enabled", roi);
+        SafeConfigModifier<std::string> config_modifier_5("vision_tracker.detection.undistort_mode", undistort_mode);
+        SafeConfigModifier<bool> config_modifier_6("vision_tracker.detection.pyramid.enabled", pyramid);
+
+        CameraPipeline c(id, /*start_thread=*/ false);
+        c.oneLoop();
+
+        Tracer::clear();
+        Tracer::setEnabled(true);
+        ctx.run(prefix, [&]() { c.oneLoop(); });
+        Tracer::setEnabled(false);
+
+        TraceStats stats = Tracer::getStats(true);
+        reportStage(ctx, prefix + "_undistort", stats, TRACE_POINT::CAMERA_UNDISTORT);
+        reportStage(ctx, prefix + "_threshold", stats, TRACE_POINT::CAMERA_THRESHOLD);
+        reportStage(ctx, prefix + "_detect", stats, TRACE_POINT::CAMERA_DETECT);
+        reportStage(ctx, prefix + "_coarse", stats, TRACE_POINT::CAMERA_COARSE);
+        reportStage(ctx, prefix + "_refine", stats, TRACE_POINT::CAMERA_REFINE);
+    }
+
+    // Runs fn on a pipeline reading image_path. scale shrinks the image and the calibration and blob limits
+    // with it, as if the camera were run at that fraction of its resolution.
+    void withScaledPipeline(const std::string& image_path, CAMERA_ID id, float scale, bool subpixel, const std::function<void(CameraPipeline&)>& fn)
+    {
+        const std::string camera = "vision_tracker." + CameraPipeline::cameraIdToString(id);
+        std::string path = image_path;
+        if(scale != 1.0f)
+        {
+            cv::Mat full = cv::imread(image_path);
+            cv::Mat scaled;
+            cv::resize(full, scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+            path = "/tmp/subpixel_bench_img.png";
+            cv::imwrite(path, scaled);
+        }
+        float scale_x = cfg.lookup(camera + ".resolution_scale_x");
+        float scale_y = cfg.lookup(camera + ".resolution_scale_y");
+        float min_area = cfg.lookup("vision_tracker.detection.blob.min_area");
+        float max_area = cfg.lookup("vision_tracker.detection.blob.max_area");
+        SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+        SafeConfigModifier<std::string> config_modifier_2(camera + ".debug_image", path);
+        SafeConfigModifier<bool> config_modifier_3("vision_tracker.detection.roi.enabled", false);
+        SafeConfigModifier<bool> config_modifier_4("vision_tracker.detection.subpixel.enabled", subpixel);
+        SafeConfigModifier<float> config_modifier_5(camera + ".resolution_scale_x", scale_x * scale);
+        SafeConfigModifier<float> config_modifier_6(camera + ".resolution_scale_y", scale_y * scale);
+        SafeConfigModifier<float> config_modifier_7("vision_tracker.detection.blob.min_area", min_area * scale * scale);
+        SafeConfigModifier<float> config_modifier_8("vision_tracker.detection.blob.max_area", max_area * scale * scale);
+
+        CameraPipeline c(id, /*start_thread=*/ false);
+        fn(c);
+    }
+
+    CameraPipelineOutput detect(const std::string& image_path, CAMERA_ID id, float scale, bool subpixel)
+    {
+        CameraPipelineOutput output;
+        withScaledPipeline(image_path, id, scale, subpixel, [&](CameraPipeline& c)
+        {
+            c.oneLoop();
+            output = c.getData();
+        });
+        return output;
+    }
+
+    // Ground position error against refined full resolution detections, to see how far the resolution can
+    // drop before the refinement stops making up for it
+    void benchSubpixelAccuracy(BenchContext& ctx)
+    {
+        const std::vector<std::pair<std::string, CAMERA_ID>> images = {
+            {"20210712175430_side_img_raw.jpg", CAMERA_ID::SIDE},
+            {"20210712175436_rear_img_raw.jpg", CAMERA_ID::REAR},
+            {"20210712175519_side_img_raw.jpg", CAMERA_ID::SIDE},
+            {"20210712175525_rear_img_raw.jpg", CAMERA_ID::REAR},
+            {"20210712175942_rear_img_raw.jpg", CAMERA_ID::REAR},
+            {"20210712180047_rear_img_raw.jpg", CAMERA_ID::REAR},
+            {"20210712180208_side_img_raw.jpg", CAMERA_ID::SIDE},
+            {"20210712180322_side_img_raw.jpg", CAMERA_ID::SIDE},
+            {"20210712180446_side_img_raw.jpg", CAMERA_ID::SIDE},
+            {"20210712180528_side_img_raw.jpg", CAMERA_ID::SIDE},
+            {"20210712182429_side_img_raw.jpg", CAMERA_ID::SIDE},
+        };
+        struct Case
+        {
+            std::string name;       // Suffix of the result names
+            float scale;
+            bool subpixel;
+            double error_sum_mm;
+            double error_max_mm;
+            int count;
+        };
+        std::vector<Case> cases = {
+            {"full_keypoint", 1.0f, false, 0, 0, 0},
+            {"half_keypoint", 0.5f, false, 0, 0, 0},
+            {"half_refined", 0.5f, true, 0, 0, 0},
+        };
+
+        for (const auto& item : images)
+        {
+            if(!haveCalibration("camera_subpixel_error", item.second)) continue;
+            CameraPipelineOutput reference = detect(IMAGE_DIR + item.first, item.second, 1.0f, true);
+            if(!reference.ok) continue;
+            for (Case& c : cases)
+            {
+                CameraPipelineOutput output = detect(IMAGE_DIR + item.first, item.second, c.scale, c.subpixel);
+                if(!output.ok) continue;
+                double error_mm = 1000.0 * (output.point - reference.point).norm();
+                c.error_sum_mm += error_mm;
+                c.error_max_mm = std::max(c.error_max_mm, error_mm);
+                c.count++;
+            }
+        }
+
+        for (const Case& c : cases)
+        {
+            if(c.count == 0) continue;
+            BenchResult mean;
+            mean.name = "camera_subpixel_error_" + c.name + "_mean";
+            mean.iterations = c.count;
+            mean.value = c.error_sum_mm / c.count;
+            mean.unit = "mm";
+            ctx.report(mean);
+            BenchResult max = mean;
+            max.name = "camera_subpixel_error_" + c.name + "_max";
+            max.value = c.error_max_mm;
+            ctx.report(max);
+        }
+
+        // What the lower resolution buys
+        if(!haveCalibration("camera_subpixel_loop", images.front().second)) return;
+        for (const Case& c : cases)
+        {
+            withScaledPipeline(IMAGE_DIR + images.front().first, images.front().second, c.scale, c.subpixel, [&](CameraPipeline& pipeline)
+            {
+                ctx.run("camera_subpixel_loop_" + c.name, [&]() { pipeline.oneLoop(); });
+            });
+        }
+    }
+}
+
+BENCHMARK_GROUP(camera_pipeline)
+{
+    benchImage(ctx, "camera_side_full_frame", "20210712175430_side_img_raw.jpg", CAMERA_ID::SIDE, false);
+    benchImage(ctx, "camera_side_roi", "20210712175430_side_img_raw.jpg", CAMERA_ID::SIDE, true);
+    benchImage(ctx, "camera_side_full_frame_lut", "20210712175430_side_img_raw.jpg", CAMERA_ID::SIDE, false, "lut");
+    benchImage(ctx, "camera_side_pyramid", "20210712175430_side_img_raw.jpg", CAMERA_ID::SIDE, false, "lut", true);
+    benchImage(ctx, "camera_rear_full_frame", "20210712175436_rear_img_raw.jpg", CAMERA_ID::REAR, false);
+    benchSubpixelAccuracy(ctx);
+}
@@ -0,0 +1,324 @@
+#include "Bench.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "robot.h"
+#include "camera_tracker/CameraTrackerFactory.h"
+#include "camera_tracker/CameraTrackerMock.h"
+#include "../test/test-utils.h"
+
+// Loopback latency from a message arriving on the mock socket, or a pose from the mock camera tracker, to the
+// first base velocity the robot writes to the mock serial port. The robot runs on the mock clock and jumps to its
+// next deadline like the simulator, so every path is reported twice: the wall time the loops in between took to
+// run (name), and the robot time it had to wait for them to be scheduled (name_sched).
+
+namespace
+{
+    // Background load each path is measured under, select one with --filter <path>_<load>
+    struct EndToEndLoad
+    {
+        const char* name;
+        float status_hz;        // Status requests from the master, in robot time
+        bool camera_threads;    // Stand in camera pipelines running on the real clock
+    };
+
+    const EndToEndLoad LOADS[] = {
+        {"idle",                  0,   false},
+        {"status_10hz",           10,  false},
+        {"status_100hz",          100, false},
+        {"cameras",               0,   true},
+        {"status_100hz_cameras",  100, true},
+    };
+
+    const int MIN_EVENTS = 20;
+    // Loops to wait for a velocity before the event counts as lost
+    const int MAX_LOOPS = 1000;
+
+    double wallNs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+        return std::chrono::duration<double, std::nano>(to - from).count();
+    }
+
+    double robotNs(ClockTimePoint from, ClockTimePoint to)
+    {
+        return std::chrono::duration<double, std::nano>(to - from).count();
+    }
+
+    // One thread per configured camera doing the detection work of a pipeline on a synthetic frame at the
+    // vision profile frame rate, so the robot loop competes for the CPU like it does during a vision move
+    class CameraLoad
+    {
+      public:
+        explicit CameraLoad(bool enabled)
+        : running_(true),
+          threads_()
+        {
+            if(!enabled) return;
+            const int num_cameras = cfg.lookup("vision_tracker.cameras").getLength();
+            const int fps = cfg.lookup("vision_tracker.profiles.vision.fps");
+            for (int i = 0; i < num_cameras; i++)
+            {
+                threads_.emplace_back(&CameraLoad::loop, this, std::chrono::microseconds(1000000 / fps));
+            }
+        }
+
+        ~CameraLoad()
+        {
+            running_ = false;
+            for (std::thread& t : threads_) t.join();
+        }
+
+      private:
+
+        void loop(std::chrono::microseconds period)
+        {
+            // Onboard resolution with a few marker sized blobs
+            cv::Mat frame(240, 320, CV_8UC1, cv::Scalar(20));
+            for (int i = 0; i < 4; i++) cv::circle(frame, {60 + 60 * i, 80 + 20 * i}, 4, cv::Scalar(255), -1);
+            cv::SimpleBlobDetector::Params params;
+            params.filterByColor = true;
+            params.blobColor = 255;
+            cv::Ptr<cv::SimpleBlobDetector> detector = cv::SimpleBlobDetector::create(params);
+            const int threshold = cfg.lookup("vision_tracker.detection.threshold");
+
+            cv::Mat thresholded;
+            std::vector<cv::KeyPoint> keypoints;
+            std::chrono::steady_clock::time_point next_frame = std::chrono::steady_clock::now();
+            while(running_)
+            {
+                cv::threshold(frame, thresholded, threshold, 255, cv::THRESH_BINARY);
+                detector->detect(thresholded, keypoints);
+                doNotOptimize(keypoints);
+                next_frame += period;
+                std::this_thread::sleep_until(next_frame);
+            }
+        }
+
+        std::atomic<bool> running_;
+        std::vector<std::thread> threads_;
+    };
+
+    class EndToEndHarness
+    {
+      public:
+        explicit EndToEndHarness(float status_hz)
+        : clock_(get_mock_clock_and_reset()),
+          socket_(build_and_get_mock_socket()),
+          serial_(build_and_get_mock_serial(CLEARCORE_USB)),
+          camera_(dynamic_cast<CameraTrackerMock*>(CameraTrackerFactory::getFactoryInstance()->get_camera_tracker())),
+          robot_(),
+          status_period_(status_hz > 0 ? std::chrono::microseconds(static_cast<long>(1e6 / status_hz)) : std::chrono::microseconds(0)),
+          next_status_(clock_->now())
+        {}
+
+        ~EndToEndHarness()
+        {
+            socket_->purge_data();
+            serial_->purge_data();
+            camera_->mock_set_output({{0, 0, 0}, false, clock_->now(), false});
+        }
+
+        // Wall and robot time from the message to the first non zero velocity, false if none came
+        bool commandToVelocity(const std::string& msg, double* wall_ns, double* robot_ns)
+        {
+            drainVelocities();
+            const ClockTimePoint robot_start = clock_->now();
+            const std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+            socket_->sendMockData(msg);
+            return waitForVelocity(true, wall_start, robot_start, wall_ns, robot_ns);
+        }
+
+        // Same from a new camera pose to the velocity corrected with it
+        bool poseToVelocity(Point pose, double* wall_ns, double* robot_ns)
+        {
+            drainVelocities();
+            const ClockTimePoint robot_start = clock_->now();
+            const std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+            camera_->mock_set_output({pose, true, robot_start, true});
+            return waitForVelocity(false, wall_start, robot_start, wall_ns, robot_ns);
+        }
+
+        void send(const std::string& msg) { socket_->sendMockData(msg); }
+
+        void setPose(Point pose) { camera_->mock_set_output({pose, true, clock_->now(), true}); }
+
+        // Runs the robot until the clock reaches time
+        void runUntil(ClockTimePoint time)
+        {
+            while(clock_->now() < time) step(time);
+        }
+
+        void runFor(int ms) { runUntil(clock_->now() + std::chrono::milliseconds(ms)); }
+
+        COMMAND currentCommand() { return robot_.getCurrentCommand(); }
+
+        ClockTimePoint now() { return clock_->now(); }
+
+      private:
+
+        bool waitForVelocity(bool nonzero, std::chrono::steady_clock::time_point wall_start, ClockTimePoint robot_start,
+                             double* wall_ns, double* robot_ns)
+        {
+            for (int i = 0; i < MAX_LOOPS; i++)
+            {
+                const ClockTimePoint loop_time = clock_->now();
+                step(ClockTimePoint::max());
+                std::chrono::steady_clock::time_point sent_time;
+                for(std::string msg = serial_->mock_rcv_base(&sent_time); !msg.empty(); msg = serial_->mock_rcv_base(&sent_time))
+                {
+                    if(!isVelocity(msg, nonzero)) continue;
+                    *wall_ns = wallNs(wall_start, sent_time);
+                    *robot_ns = robotNs(robot_start, loop_time);
+                    drainVelocities();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // One robot loop with the status requests that are due, then on to the next deadline but not past limit
+        void step(ClockTimePoint limit)
+        {
+            const ClockTimePoint now = clock_->now();
+            if(status_period_.count() > 0 && now >= next_status_)
+            {
+                socket_->sendMockData("<{'type':'status'}>");
+                next_status_ += status_period_;
+            }
+            robot_.runOnce();
+            while(!socket_->getMockData().empty()) {}
+
+            ClockTimePoint next_time = std::min(robot_.getNextDeadline(), limit);
+            if(status_period_.count() > 0) next_time = std::min(next_time, next_status_);
+            clock_->set(std::max(next_time, now + std::chrono::microseconds(100)));
+        }
+
+        // Power commands go out on the same channel
+        bool isVelocity(const std::string& msg, bool nonzero)
+        {
+            std::vector<std::string> fields = parseCommaDelimitedString(msg);
+            if(fields.size() != 3) return false;
+            if(!nonzero) return true;
+            for (const std::string& field : fields)
+            {
+                if(std::stof(field) != 0) return true;
+            }
+            return false;
+        }
+
+        void drainVelocities()
+        {
+            while(!serial_->mock_rcv_base().empty()) {}
+        }
+
+        MockClockWrapper* clock_;
+        MockSocketMultiThreadWrapper* socket_;
+        MockSerialComms* serial_;
+        CameraTrackerMock* camera_;
+        Robot robot_;
+        std::chrono::microseconds status_period_;
+        ClockTimePoint next_status_;
+    };
+
+    bool timeLeft(std::chrono::steady_clock::time_point end, const std::vector<double>& samples)
+    {
+        return std::chrono::steady_clock::now() < end || static_cast<int>(samples.size()) < MIN_EVENTS;
+    }
+
+    // A move frame through the server, command start and trajectory planning to the first velocity
+    void benchMove(BenchContext& ctx, const EndToEndLoad& load)
+    {
+        const std::string name = std::string("e2e_move_") + load.name;
+        if(!ctx.enabled(name)) return;
+        CameraLoad camera_load(load.camera_threads);
+        EndToEndHarness harness(load.status_hz);
+        harness.runFor(100);
+
+        std::vector<double> wall_samples;
+        std::vector<double> robot_samples;
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<long>(ctx.minTimeMs() * 1000));
+        while(timeLeft(end, wall_samples))
+        {
+            double wall_ns, robot_ns;
+            if(!harness.commandToVelocity("<{'type':'move','data':{'x':1.0,'y':0.5,'a':0.2}}>", &wall_ns, &robot_ns))
+            {
+                printf("%s: no velocity after a move, stopping\n", name.c_str());
+                break;
+            }
+            wall_samples.push_back(wall_ns);
+            robot_samples.push_back(robot_ns);
+            // Nothing reports odometry so the robot never gets anywhere, stop it and start the next one from the same
+            // place, at a different point of the controller cycle
+            harness.send("<{'type':'estop'}>");
+            harness.runFor(50 + wall_samples.size() % 25);
+        }
+        ctx.reportSamples(name, wall_samples);
+        ctx.reportSamples(name + "_sched", robot_samples);
+    }
+
+    // A camera pose during a vision move to the velocity corrected with it, at the vision frame rate
+    void benchCamera(BenchContext& ctx, const EndToEndLoad& load)
+    {
+        const std::string name = std::string("e2e_camera_") + load.name;
+        if(!ctx.enabled(name)) return;
+        CameraLoad camera_load(load.camera_threads);
+        EndToEndHarness harness(load.status_hz);
+        harness.runFor(100);
+
+        const std::chrono::microseconds frame_period(1000000 / static_cast<int>(cfg.lookup("vision_tracker.profiles.vision.fps")));
+        std::vector<double> wall_samples;
+        std::vector<double> robot_samples;
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<long>(ctx.minTimeMs() * 1000));
+        int frame = 0;
+        while(timeLeft(end, wall_samples))
+        {
+            if(harness.currentCommand() != COMMAND::MOVE_WITH_VISION)
+            {
+                harness.setPose({0, 0, 0});
+                harness.send("<{'type':'move_vision','data':{'x':0.05,'y':0.02,'a':0.0}}>");
+                harness.runFor(50);
+                if(harness.currentCommand() != COMMAND::MOVE_WITH_VISION)
+                {
+                    printf("%s: vision move didn't start, stopping\n", name.c_str());
+                    break;
+                }
+            }
+
+            // Alternate a millimeter either way so every pose moves the estimate
+            const float offset = (frame++ % 2) ? 0.001 : -0.001;
+            double wall_ns, robot_ns;
+            if(!harness.poseToVelocity({offset, 0, 0}, &wall_ns, &robot_ns))
+            {
+                printf("%s: no velocity after a camera pose, stopping\n", name.c_str());
+                break;
+            }
+            wall_samples.push_back(wall_ns);
+            robot_samples.push_back(robot_ns);
+            harness.runUntil(harness.now() + frame_period);
+        }
+        harness.send("<{'type':'estop'}>");
+        harness.runFor(50);
+        ctx.reportSamples(name, wall_samples);
+        ctx.reportSamples(name + "_sched", robot_samples);
+    }
+}
+
+BENCHMARK_GROUP(end_to_end)
+{
+    // Real scheduling, the test constants run the controller every loop
+    SafeConfigModifier<bool> rate_modifier("motion.rate_always_ready", false);
+    SafeConfigModifier<bool> motion_modifier("motion.fake_perfect_motion", false);
+
+    for (const EndToEndLoad& load : LOADS)
+    {
+        benchMove(ctx, load);
+        benchCamera(ctx, load);
+    }
+}
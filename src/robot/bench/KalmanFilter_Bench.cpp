@@ -0,0 +1,22 @@
+#include "Bench.h"
+
+#include "KalmanFilter.h"
+
+BENCHMARK_GROUP(kalman_filter)
+{
+    Eigen::Matrix3f I3 = Eigen::Matrix3f::Identity();
+    KalmanFilter3 fixed_kf(I3, I3, I3, 0.01 * I3, 0.1 * I3);
+    const Eigen::Vector3f u3 = {0.01, -0.02, 0.005};
+    const Eigen::Vector3f y3 = {0.1, -0.3, 0.02};
+    ctx.run("kalman_fixed_predict", [&]() { fixed_kf.predict(u3); });
+    ctx.run("kalman_fixed_update", [&]() { fixed_kf.update(y3); });
+    doNotOptimize(fixed_kf.state());
+
+    Eigen::MatrixXf I = Eigen::MatrixXf::Identity(3,3);
+    KalmanFilter dynamic_kf(I, I, I, 0.01 * I, 0.1 * I);
+    const Eigen::VectorXf u = u3;
+    const Eigen::VectorXf y = y3;
+    ctx.run("kalman_dynamic_predict", [&]() { dynamic_kf.predict(u); });
+    ctx.run("kalman_dynamic_update", [&]() { dynamic_kf.update(y); });
+    doNotOptimize(dynamic_kf.state());
+}
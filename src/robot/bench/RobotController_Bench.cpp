@@ -0,0 +1,55 @@
+#include "Bench.h"
+
+#include <memory>
+
+#include "RobotController.h"
+#include "StatusUpdater.h"
+#include "../test/test-utils.h"
+
+BENCHMARK_GROUP(robot_controller)
+{
+    StatusUpdater status;
+
+    // What every move used to pay before modes were kept between moves
+    ctx.run("mode_construct_stop_fast", [&]()
+    {
+        doNotOptimize(std::make_unique<RobotControllerModeStopFast>(false));
+    });
+    RobotControllerModeStopFast stop_fast(false);
+    ctx.run("mode_reset_stop_fast", [&]()
+    {
+        stop_fast.reset();
+        doNotOptimize(stop_fast);
+    });
+    ctx.run("mode_construct_position", [&]()
+    {
+        doNotOptimize(std::make_unique<RobotControllerModePosition>(false));
+    });
+    RobotControllerModePosition position(false);
+    ctx.run("mode_reset_position", [&]()
+    {
+        position.reset();
+        doNotOptimize(position);
+    });
+
+    // Camera stop trigger to the first stop command on the serial port, from the middle of a move
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    RobotController controller(status);
+    controller.moveToPosition(2, 0, 0);
+    for (int i = 0; i < 200; i++)
+    {
+        controller.updateOnce();
+        std::string cmd_vel = mock_serial->mock_rcv_base();
+        mock_serial->mock_send("base:" + cmd_vel);
+        mock_clock->advance_ms(25);
+    }
+    ctx.run("controller_stop_fast_to_first_command", [&]()
+    {
+        controller.stopFast();
+        controller.updateOnce();
+        mock_serial->purge_data();
+    });
+    controller.estop();
+    mock_serial->purge_data();
+}
@@ -0,0 +1,36 @@
+#include "Bench.h"
+
+#include "RobotServer.h"
+#include "StatusUpdater.h"
+#include "../test/test-utils.h"
+
+namespace
+{
+    // One message in, parsed and acked, ack drained so the mock doesn't grow
+    void serveOne(RobotServer& server, MockSocketMultiThreadWrapper* socket, const std::string& msg)
+    {
+        socket->sendMockData(msg);
+        doNotOptimize(server.oneLoop());
+        doNotOptimize(socket->getMockData());
+    }
+}
+
+BENCHMARK_GROUP(robot_server)
+{
+    StatusUpdater status;
+    RobotServer server(status);
+    MockSocketMultiThreadWrapper* socket = build_and_get_mock_socket();
+
+    const std::string move = "<{'type':'move','data':{'x':1.25,'y':-2.5,'a':0.75}}>";
+    ctx.run("server_parse_move", [&]() { serveOne(server, socket, move); });
+
+    const std::string position = "<{'type':'p','data':{'x':1.25,'y':-2.5,'a':0.75}}>";
+    ctx.run("server_parse_position", [&]() { serveOne(server, socket, position); });
+
+    const std::string path = "<{'type':'move_path','data':{'points':[[1,0,0],[2,1,0],[2,2,0.5],[1,3,1],[0,3,1.5]]}}>";
+    ctx.run("server_parse_move_path", [&]() { serveOne(server, socket, path); });
+
+    const std::string status_request = "<{'type':'status'}>";
+    ctx.run("server_status_request", [&]() { serveOne(server, socket, status_request); });
+    socket->purge_data();
+}
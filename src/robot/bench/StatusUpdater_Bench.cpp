@@ -0,0 +1,35 @@
+#include "Bench.h"
+
+#include "StatusUpdater.h"
+
+BENCHMARK_GROUP(status)
+{
+    StatusUpdater s;
+    float x = 0;
+
+    // Typical robot loop, only the pose group changes between messages
+    ctx.run("status_json_pose_changed", [&]()
+    {
+        x += 0.001f;
+        s.updatePosition(x, 2, 0.5);
+        doNotOptimize(s.getStatusJsonString());
+    });
+    ctx.run("status_json_unchanged", [&]()
+    {
+        doNotOptimize(s.getStatusJsonString());
+    });
+    ctx.run("status_json_uncached", [&]()
+    {
+        doNotOptimize(s.getStatus().toJsonString());
+    });
+    ctx.run("status_binary", [&]()
+    {
+        doNotOptimize(s.getStatusBinaryString());
+    });
+    ctx.run("status_delta_pose_changed", [&]()
+    {
+        x += 0.001f;
+        s.updatePosition(x, 2, 0.5);
+        doNotOptimize(s.getStatusDeltaJsonString(STATUS_GROUP_ALL));
+    });
+}
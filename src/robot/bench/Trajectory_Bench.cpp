@@ -0,0 +1,70 @@
+#include "Bench.h"
+
+#include "SmoothTrajectoryGenerator.h"
+#include "TrajectoryCache.h"
+#include "../test/test-utils.h"
+
+BENCHMARK_GROUP(trajectory)
+{
+    SmoothTrajectoryGenerator generator;
+    ctx.run("trajectory_generate_coarse", [&]()
+    {
+        doNotOptimize(generator.generatePointToPointTrajectory({0, 0, 0}, {1.5, 0.7, 0.4}, LIMITS_MODE::COARSE));
+    });
+    ctx.run("trajectory_generate_fine", [&]()
+    {
+        doNotOptimize(generator.generatePointToPointTrajectory({0, 0, 0}, {0.05, -0.02, 0.03}, LIMITS_MODE::FINE));
+    });
+
+    // Same relative move every time, so everything after the first call is a cache hit
+    TrajectoryCache cache;
+    SmoothTrajectoryGenerator cached_generator(&cache);
+    ctx.run("trajectory_generate_cached", [&]()
+    {
+        doNotOptimize(cached_generator.generatePointToPointTrajectory({1, 2, 0}, {1.3, 2, 0.5}, LIMITS_MODE::COARSE));
+    });
+
+    const std::vector<Point> waypoints = {{1, 0, 0}, {2, 1, 0}, {2, 2, 0}, {1, 3, 0}, {0, 3, 0}};
+    ctx.run("trajectory_generate_path", [&]()
+    {
+        doNotOptimize(generator.generatePathTrajectory({0, 0, 0}, waypoints, LIMITS_MODE::COARSE));
+    });
+
+    // Lookups sweep the whole trajectory like the controller does
+    generator.generatePointToPointTrajectory({0, 0, 0}, {1.5, 0.7, 0.4}, LIMITS_MODE::COARSE);
+    float t = 0;
+    ctx.run("trajectory_lookup", [&]()
+    {
+        doNotOptimize(generator.lookup(t));
+        t += 0.01f;
+        if(t > 10) t = 0;
+    });
+
+    // A whole trajectory preview at the controller rate, one lookup per sample against the batch lookup
+    std::vector<float> times;
+    for (float sample_t = 0; sample_t < 10; sample_t += 0.01f) times.push_back(sample_t);
+    ctx.run("trajectory_preview_lookup", [&]()
+    {
+        for (float sample_t : times) doNotOptimize(generator.lookup(sample_t));
+    });
+    TrajectorySamples samples;
+    ctx.run("trajectory_preview_batch", [&]()
+    {
+        generator.lookupBatch(times.data(), times.size(), &samples);
+        doNotOptimize(samples.x[0]);
+    });
+    const WheelLimits wheel_limits = {false, 0.405, 1.49, 0.388};
+    ctx.run("trajectory_wheel_check", [&]()
+    {
+        doNotOptimize(generator.checkWheelFeasibility(wheel_limits, 0.02).ok);
+    });
+
+    generator.generatePathTrajectory({0, 0, 0}, waypoints, LIMITS_MODE::COARSE);
+    t = 0;
+    ctx.run("trajectory_lookup_path", [&]()
+    {
+        doNotOptimize(generator.lookup(t));
+        t += 0.01f;
+        if(t > 20) t = 0;
+    });
+}
@@ -0,0 +1,46 @@
+#include "Bench.h"
+
+#include "Se2.h"
+#include "utils.h"
+
+BENCHMARK_GROUP(utils)
+{
+    // Windowed mean and stddev the old way, copying the window out of a CircularBuffer
+    CircularBuffer<float> buffer(100);
+    float value = 0;
+    ctx.run("stats_circular_buffer_copy", [&]()
+    {
+        value += 0.5f;
+        buffer.insert(value);
+        std::vector<float> contents = buffer.get_contents();
+        float mean = vectorMean(contents);
+        doNotOptimize(vectorStddev(contents, mean));
+    });
+
+    WindowedStats<float, 128> stats(100, 0, 1000);
+    ctx.run("stats_windowed_add", [&]()
+    {
+        value += 0.5f;
+        stats.add(value);
+        doNotOptimize(stats.stddev());
+    });
+    ctx.run("stats_windowed_quantile", [&]()
+    {
+        doNotOptimize(stats.quantile(0.99));
+    });
+}
+
+BENCHMARK_GROUP(se2)
+{
+    float a = 0;
+    ctx.run("wrap_angle_large", [&]()
+    {
+        a += 0.37f;
+        doNotOptimize(wrap_angle(a + 100.0f));
+    });
+    ctx.run("rotation_to_local", [&]()
+    {
+        a += 0.37f;
+        doNotOptimize(Rotation2D(a).toLocal(Velocity(0.3, 0.2, 0.1)));
+    });
+}
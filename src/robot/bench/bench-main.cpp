@@ -0,0 +1,123 @@
+#include <plog/Log.h> 
+#include <plog/Init.h>
+#include <plog/Formatters/TxtFormatter.h>
+#include <plog/Appenders/ColorConsoleAppender.h>
+#include <ArduinoJson/ArduinoJson.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "Bench.h"
+#include "constants.h"
+#include "ConfigSnapshot.h"
+#include "serial/SerialCommsFactory.h"
+#include "sockets/SocketMultiThreadWrapperFactory.h"
+#include "camera_tracker/CameraTrackerFactory.h"
+#include "utils.h"
+
+// Runs the benchmarks against the same mocks and constants as the tests and writes the results as JSON
+// so they can be compared across releases and robots.
+//   bench-main [--filter <substring>] [--min-time-ms <ms>] [--tag <label>] [--out <path>]
+
+libconfig::Config cfg = libconfig::Config();
+
+namespace
+{
+    void configure_logger()
+    {
+        // Only warnings from the code under test, per command info logs would swamp the timings
+        static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+        plog::init(plog::warning, &consoleAppender);
+    }
+
+    void setJsonValue(JsonObject& obj, const char* key, double value)
+    {
+        if(value >= 0) obj[key] = value;
+    }
+
+    bool writeResults(const std::string& path, const std::string& tag, double min_time_ms, const std::vector<BenchResult>& results)
+    {
+        char hostname[64] = {0};
+        gethostname(hostname, sizeof(hostname) - 1);
+        const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        char time_str[32];
+        std::strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        const size_t capacity = JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(results.size()) + 
+            results.size() * (JSON_OBJECT_SIZE(10) + 64) + 256;
+        DynamicJsonDocument doc(capacity);
+        doc["version"] = 1;
+        doc["host"] = std::string(hostname);
+        doc["timestamp"] = std::string(time_str);
+        doc["tag"] = tag;
+        doc["min_time_ms"] = min_time_ms;
+        JsonArray out = doc.createNestedArray("results");
+        for (const BenchResult& r : results)
+        {
+            JsonObject obj = out.createNestedObject();
+            obj["name"] = r.name;
+            obj["iterations"] = r.iterations;
+            setJsonValue(obj, "mean_ns", r.mean_ns);
+            setJsonValue(obj, "median_ns", r.median_ns);
+            setJsonValue(obj, "p90_ns", r.p90_ns);
+            setJsonValue(obj, "p99_ns", r.p99_ns);
+            setJsonValue(obj, "min_ns", r.min_ns);
+            setJsonValue(obj, "max_ns", r.max_ns);
+            setJsonValue(obj, "value", r.value);
+            if(!r.unit.empty()) obj["unit"] = r.unit;
+        }
+
+        std::string msg;
+        serializeJson(doc, msg);
+        FILE* file = fopen(path.c_str(), "w");
+        if(!file) return false;
+        fputs(msg.c_str(), file);
+        fputc('\n', file);
+        return fclose(file) == 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string filter;
+    std::string tag;
+    std::string out_path = "bench_results.json";
+    double min_time_ms = 500;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if(strcmp(argv[i], "--filter") == 0) filter = argv[i+1];
+        else if(strcmp(argv[i], "--min-time-ms") == 0) min_time_ms = atof(argv[i+1]);
+        else if(strcmp(argv[i], "--tag") == 0) tag = argv[i+1];
+        else if(strcmp(argv[i], "--out") == 0) out_path = argv[i+1];
+        else
+        {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    cfg.readFile(TEST_CONSTANTS_FILE);
+    ConfigSnapshot::reload();
+    configure_logger();
+    SerialCommsFactory::getFactoryInstance()->set_mode(SERIAL_FACTORY_MODE::MOCK);
+    SocketMultiThreadWrapperFactory::getFactoryInstance()->set_mode(SOCKET_FACTORY_MODE::MOCK);
+    ClockFactory::getFactoryInstance()->set_mode(CLOCK_FACTORY_MODE::MOCK);
+    CameraTrackerFactory::getFactoryInstance()->set_mode(CAMERA_TRACKER_FACTORY_MODE::MOCK);
+
+    BenchContext ctx(filter, min_time_ms);
+    for (const BenchGroup& group : benchGroups())
+    {
+        printf("Running %s\n", group.name);
+        group.fn(ctx);
+    }
+
+    if(!writeResults(out_path, tag, min_time_ms, ctx.results()))
+    {
+        PLOGE.printf("Failed to write results to %s", out_path.c_str());
+        return 1;
+    }
+    printf("Wrote %zu results to %s\n", ctx.results().size(), out_path.c_str());
+    return 0;
+}
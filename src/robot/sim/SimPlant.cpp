@@ -0,0 +1,195 @@
+#include "SimPlant.h"
+
+#include <algorithm>
+#include <cmath>
+#include <plog/Log.h>
+
+#include "constants.h"
+#include "Se2.h"
+
+namespace
+{
+    float approach(float current, float target, float tau, float max_delta, float dt)
+    {
+        float delta = tau > 0 ? (target - current) * std::min(1.0f, dt / tau) : target - current;
+        return current + std::max(-max_delta, std::min(max_delta, delta));
+    }
+
+    int64_t micros(ClockTimePoint time)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    }
+}
+
+SimPlant::SimPlant(MockSerialComms* serial, CameraTrackerMock* camera_tracker)
+: serial_(serial),
+  camera_tracker_(camera_tracker),
+  binary_serial_(cfg.lookup("motion.binary_serial")),
+  powered_(false),
+  pose_(0,0,0),
+  cmd_vel_(0,0,0),
+  vel_(0,0,0),
+  distance_(0),
+  time_constant_(cfg.lookup("sim.base.time_constant")),
+  max_trans_acc_(cfg.lookup("sim.base.max_trans_acc")),
+  max_rot_acc_(cfg.lookup("sim.base.max_rot_acc")),
+  max_step_s_(0.001),
+  last_update_time_(ClockFactory::getFactoryInstance()->get_clock()->now()),
+  odom_period_us_(1000 * static_cast<int>(cfg.lookup("sim.base.odom_period_ms"))),
+  next_odom_time_(last_update_time_),
+  odom_seq_(0),
+  lifter_busy_(false),
+  lifter_step_(),
+  lifter_done_time_(),
+  lifter_pos_(0),
+  lifter_steps_per_s_(cfg.lookup("sim.lifter.steps_per_s")),
+  latch_ms_(cfg.lookup("sim.lifter.latch_ms")),
+  home_ms_(cfg.lookup("sim.lifter.home_ms")),
+  camera_period_us_(1000 * static_cast<int>(cfg.lookup("sim.camera.period_ms"))),
+  camera_latency_us_(1000 * static_cast<int>(cfg.lookup("sim.camera.latency_ms"))),
+  next_camera_time_(last_update_time_)
+{
+}
+
+void SimPlant::update()
+{
+    readBaseCommands();
+    readLifterCommands();
+
+    // The robot only sees the plant through odometry, so each report is computed at its own timestamp
+    // even when the main loop skipped ahead past several of them
+    const ClockTimePoint now = ClockFactory::getFactoryInstance()->get_clock()->now();
+    while (next_odom_time_ <= now)
+    {
+        integrate(std::chrono::duration<float>(next_odom_time_ - last_update_time_).count());
+        last_update_time_ = next_odom_time_;
+        sendOdometry(next_odom_time_);
+        next_odom_time_ += std::chrono::microseconds(odom_period_us_);
+    }
+    integrate(std::chrono::duration<float>(now - last_update_time_).count());
+    last_update_time_ = now;
+
+    if(lifter_busy_ && lifter_done_time_ <= now)
+    {
+        lifter_busy_ = false;
+        serial_->mock_send("lift:done:" + lifter_step_);
+    }
+
+    if(camera_tracker_ && next_camera_time_ <= now)
+    {
+        // Marker frame is the same as the global frame, so vision targets in a script are field coordinates
+        camera_tracker_->mock_set_output({pose_, true, now - std::chrono::microseconds(camera_latency_us_), true});
+        next_camera_time_ = now + std::chrono::microseconds(camera_period_us_);
+    }
+}
+
+void SimPlant::readBaseCommands()
+{
+    if(binary_serial_)
+    {
+        SerialVelocity vel;
+        while(serial_->mock_rcv_base_velocity(&vel))
+        {
+            cmd_vel_ = {vel.vx, vel.vy, vel.va};
+        }
+    }
+
+    // Power messages are text in both protocols
+    for(std::string msg = serial_->mock_rcv_base(); !msg.empty(); msg = serial_->mock_rcv_base())
+    {
+        if(msg == "Power:ON")
+        {
+            powered_ = true;
+            continue;
+        }
+        if(msg == "Power:OFF")
+        {
+            powered_ = false;
+            continue;
+        }
+        std::vector<std::string> fields = parseCommaDelimitedString(msg);
+        if(fields.size() != 3)
+        {
+            PLOGW << "Sim plant ignoring base message: " << msg;
+            continue;
+        }
+        cmd_vel_ = {std::stof(fields[0]), std::stof(fields[1]), std::stof(fields[2])};
+    }
+}
+
+void SimPlant::readLifterCommands()
+{
+    for(std::string msg = serial_->mock_rcv_lift(); !msg.empty(); msg = serial_->mock_rcv_lift())
+    {
+        // The plant moves at one speed, so a profiled move takes as long as a plain one
+        if(msg.rfind("pos:", 0) == 0 || msg.rfind("scurve:", 0) == 0)
+        {
+            int target = std::stoi(msg.substr(msg.find(':') + 1));
+            startLifterStep("pos", static_cast<int>(1000 * std::abs(target - lifter_pos_) / lifter_steps_per_s_));
+            lifter_pos_ = target;
+        }
+        else if(msg == "home")
+        {
+            startLifterStep("home", home_ms_ + static_cast<int>(1000 * lifter_pos_ / lifter_steps_per_s_));
+            lifter_pos_ = 0;
+        }
+        else if(msg == "open" || msg == "close")
+        {
+            startLifterStep(msg, latch_ms_);
+        }
+        else if(msg == "status_req")
+        {
+            if(!lifter_busy_) serial_->mock_send("lift:none");
+        }
+        else if(msg == "stop")
+        {
+            lifter_busy_ = false;
+        }
+        else
+        {
+            PLOGW << "Sim plant ignoring lifter message: " << msg;
+        }
+    }
+}
+
+void SimPlant::startLifterStep(const std::string& step, int duration_ms)
+{
+    if(lifter_busy_) PLOGW << "Sim lifter got " << step << " while still running " << lifter_step_;
+    lifter_busy_ = true;
+    lifter_step_ = step;
+    lifter_done_time_ = ClockFactory::getFactoryInstance()->get_clock()->now() + std::chrono::milliseconds(duration_ms);
+}
+
+void SimPlant::integrate(float dt)
+{
+    // Substeps keep the lag stable when the main loop jumps ahead by several milliseconds
+    while (dt > 0)
+    {
+        const float step = std::min(dt, max_step_s_);
+        const Velocity target = powered_ ? cmd_vel_ : Velocity(0,0,0);
+        vel_.vx = approach(vel_.vx, target.vx, time_constant_, max_trans_acc_ * step, step);
+        vel_.vy = approach(vel_.vy, target.vy, time_constant_, max_trans_acc_ * step, step);
+        vel_.va = approach(vel_.va, target.va, time_constant_, max_rot_acc_ * step, step);
+
+        const Velocity global = Rotation2D(pose_.a).toGlobal(vel_);
+        pose_.x += global.vx * step;
+        pose_.y += global.vy * step;
+        pose_.a = wrap_angle(pose_.a + global.va * step);
+        distance_ += std::sqrt(global.vx * global.vx + global.vy * global.vy) * step;
+        dt -= step;
+    }
+}
+
+void SimPlant::sendOdometry(ClockTimePoint time)
+{
+    const uint32_t timestamp_us = static_cast<uint32_t>(micros(time));
+    odom_seq_++;
+    if(binary_serial_)
+    {
+        serial_->mock_send_base_odometry({{vel_.vx, vel_.vy, vel_.va}, timestamp_us, odom_seq_});
+        return;
+    }
+    char buff[100];
+    sprintf(buff, "base:%.4f,%.4f,%.4f,%u,%u", vel_.vx, vel_.vy, vel_.va, timestamp_us, static_cast<unsigned>(odom_seq_));
+    serial_->mock_send(buff);
+}
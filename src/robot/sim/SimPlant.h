@@ -0,0 +1,77 @@
+#ifndef SimPlant_h
+#define SimPlant_h
+
+#include <string>
+
+#include "utils.h"
+#include "camera_tracker/CameraTrackerMock.h"
+#include "serial/MockSerialComms.h"
+
+// Stands in for the clearcore and the cameras in sim-main. Reads whatever the robot sent to the mock
+// serial port, moves a simple kinematic base and lifter in virtual time and writes back the odometry and
+// lifter replies the real drivers would. Parameters come from the sim group in the config.
+class SimPlant
+{
+  public:
+
+    SimPlant(MockSerialComms* serial, CameraTrackerMock* camera_tracker);
+
+    // Handles messages from the robot and advances the plant to the current mock clock time
+    void update();
+
+    // True pose of the base, the robot only sees it through odometry and the camera mock
+    Point getPose() const { return pose_; }
+
+    bool isLifterMoving() const { return lifter_busy_; }
+
+    // Distance travelled by the base, for the run summary
+    float getDistance() const { return distance_; }
+
+  private:
+
+    void readBaseCommands();
+
+    void readLifterCommands();
+
+    void startLifterStep(const std::string& step, int duration_ms);
+
+    // Moves the base velocity towards the command with a first order lag and the acceleration limits
+    void integrate(float dt);
+
+    void sendOdometry(ClockTimePoint time);
+
+    MockSerialComms* serial_;
+    CameraTrackerMock* camera_tracker_;
+    bool binary_serial_;
+    bool powered_;
+
+    // Base, velocities are in the robot frame like the motor driver uses
+    Point pose_;
+    Velocity cmd_vel_;
+    Velocity vel_;
+    float distance_;
+    float time_constant_;
+    float max_trans_acc_;
+    float max_rot_acc_;
+    float max_step_s_;
+    ClockTimePoint last_update_time_;
+    int odom_period_us_;
+    ClockTimePoint next_odom_time_;
+    uint16_t odom_seq_;
+
+    // Lifter, positions in motor steps from home
+    bool lifter_busy_;
+    std::string lifter_step_;
+    ClockTimePoint lifter_done_time_;
+    int lifter_pos_;
+    float lifter_steps_per_s_;
+    int latch_ms_;
+    int home_ms_;
+
+    // Camera
+    int camera_period_us_;
+    int camera_latency_us_;
+    ClockTimePoint next_camera_time_;
+};
+
+#endif
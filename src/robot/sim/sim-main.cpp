@@ -0,0 +1,380 @@
+#include <plog/Log.h>
+#include <plog/Init.h>
+#include <plog/Formatters/TxtFormatter.h>
+#include <plog/Appenders/ColorConsoleAppender.h>
+#include <ArduinoJson/ArduinoJson.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+
+#include "SimPlant.h"
+#include "robot.h"
+#include "InputRecorder.h"
+#include "constants.h"
+#include "ConfigSnapshot.h"
+#include "serial/SerialCommsFactory.h"
+#include "sockets/SocketMultiThreadWrapperFactory.h"
+#include "sockets/MockSocketMultiThreadWrapper.h"
+#include "sockets/MockUdpChannel.h"
+#include "camera_tracker/CameraTrackerFactory.h"
+
+// Runs the whole robot loop against SimPlant with the mock clock, so a plan runs as fast as the CPU allows
+// instead of in real time. The script is the commands master would send, one per line:
+//   {'type':'move','data':{'x':1.0,'y':0.5,'a':0.0}}    a command, <> and seq are added if missing
+//   2000                                               wait this many ms of simulated time
+//   # comment
+// A motion, tray or wait_for_loc command is only sent once the previous one has finished unless it has
+// 'queue':true. Everything else, e.g. lc after a load, goes out as soon as the lines before it have.
+//
+// With --replay the robot is fed a log from InputRecorder instead, one recorded cycle per loop with the clock
+// held at the time the cycle started, so problems seen on the robot can be rerun and profiled.
+//   sim-main --script <path> | --replay <path> [--config <path>] [--max-time-s <s>] [--log-level <level>]
+
+libconfig::Config cfg = libconfig::Config();
+
+namespace
+{
+    const std::set<std::string> tray_types = {"place", "load", "init"};
+    const std::set<std::string> blocking_types = {"move", "move_rel", "move_rel_slow", "move_fine", "move_fine_stop_vision",
+        "move_vision", "move_path", "move_const_vel", "place", "load", "init", "wait_for_loc"};
+
+    // Shortest simulated step, keeps the loop moving if a rate controller is already overdue
+    const auto min_step = std::chrono::microseconds(100);
+
+    struct ScriptLine
+    {
+        int line_num;
+        std::string type;
+        std::string msg;      // Framed message for the socket, empty for a delay
+        int delay_ms;
+        bool blocking;
+        bool timed;           // Motion, tray or wait command whose duration is reported
+        bool tray;
+        uint32_t seq;
+        ClockTimePoint sent_time;
+        ClockTimePoint done_time;
+        bool done;
+    };
+
+    void configure_logger(const std::string& log_level)
+    {
+        static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+        plog::init(plog::severityFromString(log_level.c_str()), &consoleAppender);
+    }
+
+    // Real hardware paths the robot config would otherwise turn on
+    void configure_for_sim()
+    {
+        cfg.lookup("motion.fake_perfect_motion") = false;
+        cfg.lookup("motion.rate_always_ready") = false;
+        cfg.lookup("motion.control_thread.enabled") = false;
+        cfg.lookup("motion.driver_trajectory.enabled") = false;
+        // Plans finish in wall time, which would make virtual time runs differ from one run to the next
+        cfg.lookup("motion.async_planning.enabled") = false;
+        cfg.lookup("tray.fake_tray_motions") = false;
+        // A simulated run shouldn't pick up or overwrite the field plan of the real robot
+        cfg.lookup("field_plan.journal_path") = "";
+        ConfigSnapshot::reload();
+    }
+
+    bool loadScript(const std::string& path, std::vector<ScriptLine>* lines)
+    {
+        std::ifstream file(path);
+        if(!file.is_open())
+        {
+            fprintf(stderr, "Unable to open script %s\n", path.c_str());
+            return false;
+        }
+
+        uint32_t seq = 1;
+        int line_num = 0;
+        std::string text;
+        while(std::getline(file, text))
+        {
+            line_num++;
+            text.erase(0, text.find_first_not_of(" \t"));
+            text.erase(text.find_last_not_of(" \t\r") + 1);
+            if(text.empty() || text[0] == '#') continue;
+
+            ScriptLine line = {line_num, "", "", 0, false, false, false, 0, ClockTimePoint(), ClockTimePoint(), false};
+            if(std::all_of(text.begin(), text.end(), ::isdigit))
+            {
+                line.type = "delay";
+                line.delay_ms = std::stoi(text);
+                lines->push_back(line);
+                continue;
+            }
+
+            if(text.front() == '<' && text.back() == '>') text = text.substr(1, text.size() - 2);
+            StaticJsonDocument<1024> doc;
+            DeserializationError err = deserializeJson(doc, text);
+            if(err || !doc.containsKey("type"))
+            {
+                fprintf(stderr, "%s:%d: not a command: %s\n", path.c_str(), line_num, text.c_str());
+                return false;
+            }
+            line.type = doc["type"].as<std::string>();
+            line.timed = blocking_types.count(line.type) > 0;
+            line.tray = tray_types.count(line.type) > 0;
+            line.blocking = line.timed && !doc["queue"].as<bool>();
+            // The server only reads up to the first closing brace, so seq goes in front of any data
+            line.seq = doc.containsKey("seq") ? doc["seq"].as<uint32_t>() : seq;
+            if(!doc.containsKey("seq")) text = "{'seq':" + std::to_string(seq) + "," + text.substr(1);
+            seq = std::max(seq, line.seq) + 1;
+            line.msg = "<" + text + ">";
+            lines->push_back(line);
+        }
+        return true;
+    }
+
+    float secondsBetween(ClockTimePoint start, ClockTimePoint end)
+    {
+        return std::chrono::duration<float>(end - start).count();
+    }
+
+    // Throws away what the robot sent to the drivers, returns the number of base velocity commands
+    int drainSerialOutput(MockSerialComms* serial)
+    {
+        int velocity_commands = 0;
+        SerialVelocity vel;
+        while(serial->mock_rcv_base_velocity(&vel)) velocity_commands++;
+        for(std::string msg = serial->mock_rcv_base(); !msg.empty(); msg = serial->mock_rcv_base())
+        {
+            if(msg.rfind("Power", 0) != 0) velocity_commands++;
+        }
+        while(!serial->mock_rcv_lift().empty()) {}
+        while(!serial->mock_rcv_distance().empty()) {}
+        SERIAL_BINARY_CHANNEL channel;
+        std::string payload;
+        while(serial->mock_rcv_frame(&channel, &payload)) {}
+        return velocity_commands;
+    }
+
+    void replayInput(const InputRecord& record, Robot& robot, MockSocketMultiThreadWrapper* socket, MockUdpChannel* udp,
+                     MockSerialComms* serial, CameraTrackerMock* camera_tracker)
+    {
+        switch (record.type)
+        {
+            case INPUT_RECORD::SOCKET:
+                socket->add_mock_data(record.payload);
+                break;
+            case INPUT_RECORD::SERIAL_BASE:
+                serial->mock_send("base:" + record.payload);
+                break;
+            case INPUT_RECORD::SERIAL_LIFT:
+                serial->mock_send("lift:" + record.payload);
+                break;
+            case INPUT_RECORD::SERIAL_DISTANCE:
+                serial->mock_send("dist:" + record.payload);
+                break;
+            case INPUT_RECORD::SERIAL_ODOMETRY:
+                serial->mock_send_base_odometry(record.odometry());
+                break;
+            case INPUT_RECORD::MARVELMIND:
+                robot.getMarvelmind().inject(record.marvelmind());
+                break;
+            case INPUT_RECORD::CAMERA:
+                camera_tracker->mock_set_output(record.camera());
+                break;
+            case INPUT_RECORD::UDP:
+                udp->mock_add_datagram(record.payload);
+                break;
+            default:
+                PLOGW.printf("Skipping unknown input record type %d", static_cast<int>(record.type));
+                break;
+        }
+    }
+
+    int runReplay(const std::string& path, MockClockWrapper* clock, MockSocketMultiThreadWrapper* socket, MockSerialComms* serial,
+                  CameraTrackerMock* camera_tracker)
+    {
+        InputLogReader reader;
+        if(!reader.open(path))
+        {
+            fprintf(stderr, "Unable to read input log %s\n", path.c_str());
+            return 1;
+        }
+        InputRecord record;
+        bool have_record = reader.next(&record);
+        while(have_record && record.type != INPUT_RECORD::LOOP) have_record = reader.next(&record);
+        if(!have_record)
+        {
+            fprintf(stderr, "No robot loops recorded in %s\n", path.c_str());
+            return 1;
+        }
+
+        MockUdpChannel* udp = dynamic_cast<MockUdpChannel*>(SocketMultiThreadWrapperFactory::getFactoryInstance()->get_udp_channel());
+        const auto wall_start = std::chrono::steady_clock::now();
+        const ClockTimePoint log_start = record.loopTime();
+        clock->set(log_start);
+        Robot robot;
+
+        uint64_t loops = 0;
+        uint64_t inputs = 0;
+        uint64_t velocity_commands = 0;
+        while(have_record)
+        {
+            clock->set(record.loopTime());
+            while((have_record = reader.next(&record)) && record.type != INPUT_RECORD::LOOP)
+            {
+                replayInput(record, robot, socket, udp, serial, camera_tracker);
+                inputs++;
+            }
+            robot.runOnce();
+            loops++;
+            while(!socket->getMockData().empty()) {}
+            while(!udp->mock_get_sent().empty()) {}
+            velocity_commands += drainSerialOutput(serial);
+        }
+
+        const float wall_s = std::chrono::duration<float>(std::chrono::steady_clock::now() - wall_start).count();
+        const float log_s = secondsBetween(log_start, clock->now());
+        const StatusUpdater::Status status = robot.getStatus();
+        printf("Replayed %lu loops and %lu inputs, %lu base velocity commands sent\n", static_cast<unsigned long>(loops),
+               static_cast<unsigned long>(inputs), static_cast<unsigned long>(velocity_commands));
+        printf("Final pose: [%.3f, %.3f, %.3f], error %d, last done seq %u\n", status.pos_x, status.pos_y, status.pos_a,
+               status.error_status, status.cmd_done_seq);
+        printf("Replayed %.3f s in %.3f s wall time (%.0fx real time)\n", log_s, wall_s, wall_s > 0 ? log_s / wall_s : 0);
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string script_path;
+    std::string replay_path;
+    std::string config_path = CONSTANTS_FILE;
+    std::string log_level = "warning";
+    float max_time_s = 3600;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if(strcmp(argv[i], "--script") == 0) script_path = argv[i+1];
+        else if(strcmp(argv[i], "--replay") == 0) replay_path = argv[i+1];
+        else if(strcmp(argv[i], "--config") == 0) config_path = argv[i+1];
+        else if(strcmp(argv[i], "--max-time-s") == 0) max_time_s = atof(argv[i+1]);
+        else if(strcmp(argv[i], "--log-level") == 0) log_level = argv[i+1];
+        else
+        {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if(script_path.empty() == replay_path.empty())
+    {
+        fprintf(stderr, "Usage: sim-main --script <path> | --replay <path> [--config <path>] [--max-time-s <s>] [--log-level <level>]\n");
+        return 1;
+    }
+
+    cfg.readFile(config_path.c_str());
+    configure_for_sim();
+    configure_logger(log_level);
+    std::vector<ScriptLine> lines;
+    if(!script_path.empty() && !loadScript(script_path, &lines)) return 1;
+
+    SerialCommsFactory::getFactoryInstance()->set_mode(SERIAL_FACTORY_MODE::MOCK);
+    SocketMultiThreadWrapperFactory::getFactoryInstance()->set_mode(SOCKET_FACTORY_MODE::MOCK);
+    ClockFactory::getFactoryInstance()->set_mode(CLOCK_FACTORY_MODE::MOCK);
+    CameraTrackerFactory::getFactoryInstance()->set_mode(CAMERA_TRACKER_FACTORY_MODE::MOCK);
+    MockClockWrapper* clock = dynamic_cast<MockClockWrapper*>(ClockFactory::getFactoryInstance()->get_clock());
+    MockSocketMultiThreadWrapper* socket = dynamic_cast<MockSocketMultiThreadWrapper*>(SocketMultiThreadWrapperFactory::getFactoryInstance()->get_socket());
+    MockSerialComms* serial = dynamic_cast<MockSerialComms*>(SerialCommsFactory::getFactoryInstance()->get_serial_comms(CLEARCORE_USB));
+    CameraTrackerMock* camera_tracker = dynamic_cast<CameraTrackerMock*>(CameraTrackerFactory::getFactoryInstance()->get_camera_tracker());
+    if(!replay_path.empty()) return runReplay(replay_path, clock, socket, serial, camera_tracker);
+    clock->set_now();
+
+    const auto wall_start = std::chrono::steady_clock::now();
+    Robot robot;
+    SimPlant plant(serial, camera_tracker);
+    const ClockTimePoint sim_start = clock->now();
+
+    size_t next_line = 0;
+    ClockTimePoint next_send_time = sim_start;
+    // The robot reports the last command to finish, which goes backwards when a tray command finishes behind a move
+    uint32_t done_seq = 0;
+    uint32_t tray_done_seq = 0;
+    ScriptLine* waiting_for = nullptr;
+    bool failed = false;
+    uint64_t loops = 0;
+    while(true)
+    {
+        plant.update();
+        const ClockTimePoint now = clock->now();
+        StatusUpdater::Status status = robot.getStatus();
+        done_seq = std::max(done_seq, status.cmd_done_seq);
+        tray_done_seq = std::max(tray_done_seq, status.tray_done_seq);
+        for (ScriptLine& line : lines)
+        {
+            if(line.timed && !line.done && line.sent_time != ClockTimePoint() && line.seq <= (line.tray ? tray_done_seq : done_seq))
+            {
+                line.done = true;
+                line.done_time = now;
+            }
+        }
+        // Anything queued behind it, or a tray command it left finishing in the background, has to be done too
+        if(waiting_for && waiting_for->done && !status.in_progress && status.cmd_queue_depth == 0) waiting_for = nullptr;
+
+        if(status.error_status)
+        {
+            fprintf(stderr, "Robot reported an error at %.3f s\n", secondsBetween(sim_start, now));
+            failed = true;
+            break;
+        }
+        if(secondsBetween(sim_start, now) > max_time_s)
+        {
+            fprintf(stderr, "Script did not finish within %.0f s of simulated time\n", max_time_s);
+            failed = true;
+            break;
+        }
+
+        // Send every line that is due, stopping at a blocking command until the one before it is done
+        while(next_line < lines.size() && now >= next_send_time)
+        {
+            ScriptLine& line = lines[next_line];
+            if(line.blocking && waiting_for) break;
+            line.sent_time = now;
+            next_line++;
+            if(line.type == "delay")
+            {
+                next_send_time = now + std::chrono::milliseconds(line.delay_ms);
+                continue;
+            }
+            socket->sendMockData(line.msg);
+            if(line.blocking) waiting_for = &line;
+        }
+        bool all_done = next_line == lines.size() && !waiting_for && !status.in_progress && status.cmd_queue_depth == 0;
+        if(all_done && now >= next_send_time) break;
+
+        robot.runOnce();
+        loops++;
+        while(!socket->getMockData().empty()) {}
+
+        // Jump to whenever the robot loop would next wake up, or the next scripted line is due
+        ClockTimePoint next_time = robot.getNextDeadline();
+        if(next_line < lines.size() && next_send_time > now) next_time = std::min(next_time, next_send_time);
+        next_time = std::max(next_time, clock->now() + min_step);
+        clock->set(next_time);
+    }
+
+    const ClockTimePoint sim_end = clock->now();
+    const float wall_s = std::chrono::duration<float>(std::chrono::steady_clock::now() - wall_start).count();
+    const float sim_s = secondsBetween(sim_start, sim_end);
+
+    printf("%-6s %-22s %10s %10s\n", "line", "command", "start_s", "duration_s");
+    for (const ScriptLine& line : lines)
+    {
+        if(!line.timed) continue;
+        if(line.done) printf("%-6d %-22s %10.3f %10.3f\n", line.line_num, line.type.c_str(), secondsBetween(sim_start, line.sent_time), secondsBetween(line.sent_time, line.done_time));
+        else printf("%-6d %-22s %10s %10s\n", line.line_num, line.type.c_str(), "-", "-");
+    }
+    const Point true_pose = plant.getPose();
+    const StatusUpdater::Status status = robot.getStatus();
+    printf("Final pose: true [%.3f, %.3f, %.3f] estimated [%.3f, %.3f, %.3f], distance %.2f m\n", true_pose.x, true_pose.y, true_pose.a,
+           status.pos_x, status.pos_y, status.pos_a, plant.getDistance());
+    printf("Simulated %.3f s in %.3f s wall time (%.0fx real time, %lu loops)\n", sim_s, wall_s, wall_s > 0 ? sim_s / wall_s : 0,
+           static_cast<unsigned long>(loops));
+    printf("Heap allocations: %u in the loops, at most %u in one loop over the last second\n", status.main_allocs_total, status.main_allocs_max);
+    return failed ? 1 : 0;
+}
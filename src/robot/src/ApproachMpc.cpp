@@ -0,0 +1,171 @@
+#include "ApproachMpc.h"
+
+#include <cmath>
+
+namespace
+{
+    const int N = APPROACH_MPC_HORIZON;
+    const int VARS = APPROACH_MPC_VARS;
+
+    // Keeps the linear system positive definite when a weight is zero
+    const float SIGMA = 1e-6f;
+    // Over-relaxation of the ADMM steps, the usual value for QPs
+    const float ALPHA = 1.6f;
+
+    // Moves a warm start one step along, the last step is repeated
+    template <typename Vector>
+    void shiftBlocks(Vector* v, int offset)
+    {
+        v->segment(offset, VARS - 3) = v->segment(offset + 3, VARS - 3).eval();
+    }
+}
+
+ApproachMpc::ApproachMpc()
+: A_(decltype(A_)::Zero()),
+  K_(decltype(K_)::Identity()),
+  q_error_(decltype(q_error_)::Zero()),
+  q_velocity_(decltype(q_velocity_)::Zero()),
+  wheels_(Eigen::Matrix3f::Zero()),
+  bound_(RowVector::Zero()),
+  axis_acc_(Eigen::Vector3f::Zero()),
+  wheel_acc_(0),
+  x_(VarVector::Zero()),
+  z_(RowVector::Zero()),
+  y_(RowVector::Zero()),
+  warm_(false),
+  rho_(1),
+  iterations_(0),
+  primal_residual_(0)
+{}
+
+void ApproachMpc::configure(const ApproachMpcParams& params, const DynamicLimits& trans_limits, const DynamicLimits& rot_limits,
+                            const WheelLimits& wheels)
+{
+    const float dt = params.dt;
+    rho_ = params.rho;
+    iterations_ = params.iterations;
+
+    // Rim speed of each wheel, same signs as doIK and checkWheelLimits
+    const float half_sq3 = std::sqrt(3.0f) / 2;
+    const float r = wheels.base_radius;
+    wheels_ << -half_sq3, 0.5f, r,
+                half_sq3, 0.5f, r,
+                0, -1, r;
+
+    // Position at the end of step k is dt times the sum of the commands up to it, its error costs
+    // w_k (p_k - e)' Q (p_k - e). The change in command into step k costs (u_k - u_k-1)' R (u_k - u_k-1),
+    // with u_-1 the current velocity.
+    const Eigen::Vector3f Q = {params.trans_weight, params.trans_weight, params.rot_weight};
+    Eigen::Matrix<float, VARS, VARS> P = Eigen::Matrix<float, VARS, VARS>::Zero();
+    q_error_.setZero();
+    for (int k = 0; k < N; k++)
+    {
+        const float w = k == N - 1 ? params.terminal_weight : 1.0f;
+        for (int i = 0; i <= k; i++)
+        {
+            for (int j = 0; j <= k; j++)
+            {
+                P.block<3,3>(3 * i, 3 * j).diagonal() += 2 * w * dt * dt * Q;
+            }
+            q_error_.block<3,3>(3 * i, 0).diagonal() += 2 * w * dt * Q;
+        }
+    }
+    Eigen::Matrix<float, VARS, VARS> D = Eigen::Matrix<float, VARS, VARS>::Identity();
+    for (int k = 1; k < N; k++)
+    {
+        D.block<3,3>(3 * k, 3 * (k - 1)) = -Eigen::Matrix3f::Identity();
+    }
+    const float smooth = params.smooth_weight;
+    P += 2 * smooth * D.transpose() * D;
+    q_velocity_ = 2 * smooth * D.transpose().leftCols<3>();
+
+    // Axis velocities, wheel velocities, axis velocity changes and wheel velocity changes
+    Eigen::Matrix<float, VARS, VARS> W = Eigen::Matrix<float, VARS, VARS>::Zero();
+    for (int k = 0; k < N; k++)
+    {
+        W.block<3,3>(3 * k, 3 * k) = wheels_;
+    }
+    A_.middleRows<VARS>(0) = Eigen::Matrix<float, VARS, VARS>::Identity();
+    A_.middleRows<VARS>(VARS) = W;
+    A_.middleRows<VARS>(2 * VARS) = D;
+    A_.middleRows<VARS>(3 * VARS) = W * D;
+
+    axis_acc_ = {trans_limits.max_acc, trans_limits.max_acc, rot_limits.max_acc};
+    wheel_acc_ = wheels.max_acc;
+    for (int k = 0; k < N; k++)
+    {
+        bound_.segment<3>(3 * k) = Eigen::Vector3f(trans_limits.max_vel, trans_limits.max_vel, rot_limits.max_vel);
+        bound_.segment<3>(VARS + 3 * k).setConstant(wheels.max_vel);
+        bound_.segment<3>(2 * VARS + 3 * k) = axis_acc_ * dt;
+        bound_.segment<3>(3 * VARS + 3 * k).setConstant(wheel_acc_ * dt);
+    }
+
+    const Eigen::Matrix<float, VARS, VARS> M = P + SIGMA * Eigen::Matrix<float, VARS, VARS>::Identity() + rho_ * A_.transpose() * A_;
+    K_ = M.llt().solve(Eigen::Matrix<float, VARS, VARS>::Identity());
+    restart();
+}
+
+void ApproachMpc::restart()
+{
+    warm_ = false;
+    x_.setZero();
+    z_.setZero();
+    y_.setZero();
+    primal_residual_ = 0;
+}
+
+Velocity ApproachMpc::solve(const Velocity& error, const Velocity& velocity, float cycle_dt)
+{
+    const Eigen::Vector3f e = {error.vx, error.vy, error.va};
+    const Eigen::Vector3f v = {velocity.vx, velocity.vy, velocity.va};
+    const VarVector q = -(q_error_ * e + q_velocity_ * v);
+
+    // Only the first step's velocity changes depend on where the robot is now
+    RowVector lower = -bound_;
+    RowVector upper = bound_;
+    lower.segment<3>(2 * VARS) += v;
+    upper.segment<3>(2 * VARS) += v;
+    const Eigen::Vector3f wheel_v = wheels_ * v;
+    lower.segment<3>(3 * VARS) += wheel_v;
+    upper.segment<3>(3 * VARS) += wheel_v;
+
+    if(warm_)
+    {
+        // Last cycle's plan, one step on
+        shiftBlocks(&x_, 0);
+        for (int group = 0; group < 4; group++)
+        {
+            shiftBlocks(&y_, group * VARS);
+        }
+        z_ = (A_ * x_).cwiseMax(lower).cwiseMin(upper);
+    }
+    else
+    {
+        x_.setZero();
+        y_.setZero();
+        z_ = RowVector::Zero().cwiseMax(lower).cwiseMin(upper);
+        warm_ = true;
+    }
+
+    for (int i = 0; i < iterations_; i++)
+    {
+        const VarVector x_tilde = K_ * (SIGMA * x_ - q + A_.transpose() * (rho_ * z_ - y_));
+        const RowVector z_relaxed = ALPHA * (A_ * x_tilde) + (1 - ALPHA) * z_;
+        x_ = ALPHA * x_tilde + (1 - ALPHA) * x_;
+        const RowVector z_next = (z_relaxed + y_ / rho_).cwiseMax(lower).cwiseMin(upper);
+        y_ += rho_ * (z_relaxed - z_next);
+        z_ = z_next;
+    }
+
+    const RowVector Ax = A_ * x_;
+    primal_residual_ = (Ax - Ax.cwiseMax(lower).cwiseMin(upper)).cwiseAbs().maxCoeff();
+
+    // The iterations stop wherever they got to, and the first step is longer than a control cycle. The command
+    // that goes out is held to the velocity limits and to the acceleration limits over one cycle.
+    Eigen::Vector3f u = x_.head<3>().cwiseMax(lower.head<3>()).cwiseMin(upper.head<3>());
+    u = u.cwiseMax(v - axis_acc_ * cycle_dt).cwiseMin(v + axis_acc_ * cycle_dt);
+    const Eigen::Vector3f wheel_step = wheels_ * (u - v);
+    const float wheel_scale = wheel_step.cwiseAbs().maxCoeff() / (wheel_acc_ * cycle_dt);
+    if(wheel_scale > 1) u = v + (u - v) / wheel_scale;
+    return {u(0), u(1), u(2)};
+}
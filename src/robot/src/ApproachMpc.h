@@ -0,0 +1,82 @@
+#ifndef ApproachMpc_h
+#define ApproachMpc_h
+
+#include <Eigen/Dense>
+
+#include "SmoothTrajectoryGenerator.h"
+#include "utils.h"
+
+// Steps of the prediction horizon, each motion.approach_mpc.dt long
+#define APPROACH_MPC_HORIZON 10
+// A local velocity command per step
+#define APPROACH_MPC_VARS (3 * APPROACH_MPC_HORIZON)
+// Bounds on the axis velocities, wheel velocities, axis accelerations and wheel accelerations at every step
+#define APPROACH_MPC_ROWS (4 * APPROACH_MPC_VARS)
+
+struct ApproachMpcParams
+{
+    bool enabled;
+    float window;            // s of trajectory left when the approach takes over a fine or vision move
+    float dt;                // s per horizon step
+    float trans_weight;      // Cost of the translation error at each step, per m^2
+    float rot_weight;        // Cost of the heading error, per rad^2
+    float terminal_weight;   // Multiplier on the error cost at the end of the horizon
+    float smooth_weight;     // Cost of the command changing from one step to the next, per (m/s)^2 or (rad/s)^2
+    float rho;               // ADMM penalty
+    int iterations;          // ADMM iterations per solve, bounds the solve time
+};
+
+// Model predictive controller for the last stretch of a move. Instead of tracking the rest of the s-curve, the
+// robot is steered straight onto the goal as fast as the axis and omni wheel velocity and acceleration limits
+// allow, with the command kept smooth by a cost on its change. The base is modeled as the commanded velocity
+// integrating into position, in the robot frame at the start of the horizon.
+//
+// The problem is a QP over the commands of every step. Its matrices only depend on the params and limits, so
+// configure builds and factors them once per move. Each solve then runs a fixed number of ADMM iterations,
+// warm started from the previous cycle, all on fixed size Eigen types. That keeps the time per cycle bounded
+// and means nothing is allocated in the control loop.
+class ApproachMpc
+{
+  public:
+
+    ApproachMpc();
+
+    // Limits are those of the move's LIMITS_MODE, wheels only uses base_radius, max_vel and max_acc
+    void configure(const ApproachMpcParams& params, const DynamicLimits& trans_limits, const DynamicLimits& rot_limits,
+                   const WheelLimits& wheels);
+
+    // Forgets the warm start, for the first solve of a move
+    void restart();
+
+    // error is the goal relative to the robot, and velocity its current velocity, both in the robot frame.
+    // Returns the robot frame velocity to command for the next cycle_dt, which stays within the acceleration
+    // limits over that time even though the horizon steps are longer.
+    Velocity solve(const Velocity& error, const Velocity& velocity, float cycle_dt);
+
+    // Largest constraint violation of the last solve's commands, shows how far the iterations got
+    float getPrimalResidual() const { return primal_residual_; };
+
+  private:
+
+    typedef Eigen::Matrix<float, APPROACH_MPC_VARS, 1> VarVector;
+    typedef Eigen::Matrix<float, APPROACH_MPC_ROWS, 1> RowVector;
+
+    Eigen::Matrix<float, APPROACH_MPC_ROWS, APPROACH_MPC_VARS> A_;
+    Eigen::Matrix<float, APPROACH_MPC_VARS, APPROACH_MPC_VARS> K_;      // (P + sigma I + rho A'A)^-1
+    Eigen::Matrix<float, APPROACH_MPC_VARS, 3> q_error_;                // q = -q_error_ * error - q_velocity_ * velocity
+    Eigen::Matrix<float, APPROACH_MPC_VARS, 3> q_velocity_;
+    Eigen::Matrix3f wheels_;                                            // Robot velocity to wheel rim speeds
+    RowVector bound_;                                                   // |A x| <= bound_, before the first step's accelerations are offset
+    Eigen::Vector3f axis_acc_;
+    float wheel_acc_;
+
+    VarVector x_;
+    RowVector z_;
+    RowVector y_;
+    bool warm_;
+    float rho_;
+    int iterations_;
+    float primal_residual_;
+};
+
+#endif //ApproachMpc_h
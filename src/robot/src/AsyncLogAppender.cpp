@@ -0,0 +1,302 @@
+#include "AsyncLogAppender.h"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+namespace
+{
+    // How long the writer sleeps when there is nothing to write, bounds how stale the file can be
+    const int POLL_INTERVAL_MS = 10;
+    // Write out partial batches once they get this big
+    const size_t MAX_BATCH_BYTES = 32 * 1024;
+
+    size_t roundUpPow2(size_t v)
+    {
+        size_t p = 1;
+        while (p < v) p <<= 1;
+        return p;
+    }
+
+    void copyTruncated(char* dst, const char* src, size_t size)
+    {
+        if (!src) src = "";
+        size_t len = strnlen(src, size - 1);
+        memcpy(dst, src, len);
+        dst[len] = '\0';
+    }
+}
+
+AsyncLogAppender::AsyncLogAppender(const std::string& path, LOG_FORMAT format, size_t queue_size,
+                                   size_t max_file_size, int max_files, bool start_thread)
+: path_(path),
+  format_(format),
+  max_file_size_(max_file_size),
+  max_files_(max_files),
+  capacity_(roundUpPow2(queue_size < 2 ? 2 : queue_size)),
+  slots_(new Slot[capacity_]),
+  enqueue_pos_(0),
+  dequeue_pos_(0),
+  flushed_pos_(0),
+  rotate_request_(0),
+  written_(0),
+  dropped_(0),
+  batches_(0),
+  rotations_(0),
+  reported_drops_(0),
+  file_(nullptr),
+  file_size_(0),
+  buffer_(),
+  thread_running_(false),
+  thread_()
+{
+    for (size_t i = 0; i < capacity_; i++)
+    {
+        slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    buffer_.reserve(MAX_BATCH_BYTES + ASYNC_LOG_MESSAGE_SIZE + 128);
+    if (start_thread) start();
+}
+
+AsyncLogAppender::~AsyncLogAppender()
+{
+    stop();
+    drain();
+    if (file_) fclose(file_);
+}
+
+void AsyncLogAppender::write(const plog::Record& record)
+{
+    push(record.getSeverity(), record.getTime(), record.getTid(), record.getFunc(), record.getLine(), record.getMessage());
+}
+
+bool AsyncLogAppender::push(plog::Severity severity, const plog::util::Time& time, unsigned int tid, const char* func, size_t line, const char* message)
+{
+    uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true)
+    {
+        slot = &slots_[pos & (capacity_ - 1)];
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+        if (diff == 0)
+        {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0)
+        {
+            // Full, the writer hasn't caught up
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    Entry& entry = slot->entry;
+    entry.severity = severity;
+    entry.time = time;
+    entry.tid = tid;
+    entry.line = line;
+    copyTruncated(entry.func, func, ASYNC_LOG_FUNC_SIZE);
+    copyTruncated(entry.message, message, ASYNC_LOG_MESSAGE_SIZE);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+void AsyncLogAppender::rotate()
+{
+    rotate_request_.store(enqueue_pos_.load(std::memory_order_acquire) + 1, std::memory_order_release);
+}
+
+void AsyncLogAppender::flush()
+{
+    if (!thread_running_)
+    {
+        drain();
+        return;
+    }
+    const uint64_t target = enqueue_pos_.load(std::memory_order_acquire);
+    while (flushed_pos_.load(std::memory_order_acquire) < target || rotate_request_.load(std::memory_order_acquire) != 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void AsyncLogAppender::start()
+{
+    if (!thread_running_)
+    {
+        thread_running_ = true;
+        thread_ = std::thread(&AsyncLogAppender::threadLoop, this);
+    }
+}
+
+void AsyncLogAppender::stop()
+{
+    if (thread_running_)
+    {
+        thread_running_ = false;
+        thread_.join();
+    }
+}
+
+AsyncLogStats AsyncLogAppender::getStats() const
+{
+    AsyncLogStats stats;
+    stats.written = written_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.rotations = rotations_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void AsyncLogAppender::threadLoop()
+{
+    while (thread_running_)
+    {
+        if (drain() == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+        }
+    }
+    drain();
+}
+
+size_t AsyncLogAppender::drain()
+{
+    size_t count = 0;
+    while (true)
+    {
+        uint64_t request = rotate_request_.load(std::memory_order_acquire);
+        if (request != 0 && dequeue_pos_ + 1 >= request)
+        {
+            writeBuffer();
+            openFile(/*truncate=*/ true);
+            rotations_.fetch_add(1, std::memory_order_relaxed);
+            // A newer request keeps waiting for its own position
+            rotate_request_.compare_exchange_strong(request, 0, std::memory_order_acq_rel);
+            continue;
+        }
+
+        Slot& slot = slots_[dequeue_pos_ & (capacity_ - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1) break;
+        format(slot.entry, buffer_);
+        slot.seq.store(dequeue_pos_ + capacity_, std::memory_order_release);
+        dequeue_pos_++;
+        count++;
+        if (buffer_.size() > MAX_BATCH_BYTES) writeBuffer();
+    }
+
+    const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported_drops_)
+    {
+        writeDropNotice(dropped - reported_drops_, buffer_);
+        reported_drops_ = dropped;
+    }
+    writeBuffer();
+    written_.fetch_add(count, std::memory_order_relaxed);
+    flushed_pos_.store(dequeue_pos_, std::memory_order_release);
+    return count;
+}
+
+void AsyncLogAppender::writeBuffer()
+{
+    if (buffer_.empty()) return;
+    if (!file_) openFile(/*truncate=*/ false);
+    if (file_)
+    {
+        fwrite(buffer_.data(), 1, buffer_.size(), file_);
+        fflush(file_);
+        file_size_ += buffer_.size();
+        batches_.fetch_add(1, std::memory_order_relaxed);
+    }
+    buffer_.clear();
+    if (max_file_size_ > 0 && file_size_ >= max_file_size_) rollFiles();
+}
+
+void AsyncLogAppender::format(const Entry& entry, std::string& out) const
+{
+    struct tm t;
+    time_t time = entry.time.time;
+    localtime_r(&time, &t);
+    char prefix[128];
+    if (format_ == LOG_FORMAT::CSV)
+    {
+        snprintf(prefix, sizeof(prefix), "%04d/%02d/%02d;%02d:%02d:%02d.%03u;%s;%u;0;%s@%zu;\"",
+            t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, static_cast<unsigned>(entry.time.millitm),
+            plog::severityToString(entry.severity), entry.tid, entry.func, entry.line);
+        out += prefix;
+        // Quotes inside the message are doubled
+        for (const char* c = entry.message; *c; c++)
+        {
+            if (*c == '"') out += '"';
+            out += *c;
+        }
+        out += "\"\n";
+    }
+    else
+    {
+        snprintf(prefix, sizeof(prefix), "%04d-%02d-%02d %02d:%02d:%02d.%03u %-5s [%u] [%s@%zu] ",
+            t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, static_cast<unsigned>(entry.time.millitm),
+            plog::severityToString(entry.severity), entry.tid, entry.func, entry.line);
+        out += prefix;
+        out += entry.message;
+        out += '\n';
+    }
+}
+
+void AsyncLogAppender::writeDropNotice(uint64_t dropped, std::string& out) const
+{
+    Entry entry;
+    entry.severity = plog::warning;
+    entry.time.time = ::time(nullptr);
+    entry.time.millitm = 0;
+    entry.tid = 0;
+    entry.line = 0;
+    copyTruncated(entry.func, "AsyncLogAppender", ASYNC_LOG_FUNC_SIZE);
+    snprintf(entry.message, sizeof(entry.message), "Log queue full, dropped %llu messages", static_cast<unsigned long long>(dropped));
+    format(entry, out);
+}
+
+void AsyncLogAppender::openFile(bool truncate)
+{
+    if (file_) fclose(file_);
+    file_ = fopen(path_.c_str(), truncate ? "w" : "a");
+    if (!file_) return;
+    fseek(file_, 0, SEEK_END);
+    file_size_ = ftell(file_);
+    if (file_size_ == 0 && format_ == LOG_FORMAT::CSV)
+    {
+        const char* header = "Date;Time;Severity;TID;This;Function;Message\n";
+        fputs(header, file_);
+        file_size_ += strlen(header);
+    }
+}
+
+void AsyncLogAppender::rollFiles()
+{
+    if (file_) fclose(file_);
+    file_ = nullptr;
+    for (int i = max_files_ - 1; i > 1; i--)
+    {
+        std::rename(rolledFileName(i - 1).c_str(), rolledFileName(i).c_str());
+    }
+    if (max_files_ > 1) std::rename(path_.c_str(), rolledFileName(1).c_str());
+    openFile(/*truncate=*/ true);
+    rotations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string AsyncLogAppender::rolledFileName(int index) const
+{
+    // log/robot_log.txt -> log/robot_log.1.txt
+    size_t slash = path_.find_last_of('/');
+    size_t dot = path_.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return path_ + "." + std::to_string(index);
+    }
+    return path_.substr(0, dot) + "." + std::to_string(index) + path_.substr(dot);
+}
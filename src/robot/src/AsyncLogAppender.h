@@ -0,0 +1,129 @@
+#ifndef AsyncLogAppender_h
+#define AsyncLogAppender_h
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <plog/Log.h>
+#include <plog/Record.h>
+#include <plog/Appenders/IAppender.h>
+
+// Longer messages are truncated
+#define ASYNC_LOG_MESSAGE_SIZE 448
+#define ASYNC_LOG_FUNC_SIZE 64
+
+// Layouts match plog's TxtFormatter and CsvFormatter so existing log tooling keeps working
+enum class LOG_FORMAT
+{
+    TXT,
+    CSV,
+};
+
+struct AsyncLogStats
+{
+    uint64_t written;     // Messages that made it to the file
+    uint64_t dropped;     // Messages discarded because the queue was full
+    uint64_t batches;     // fwrite calls, each covers everything that was queued at the time
+    uint64_t rotations;   // Files started, either from size limits or rotate()
+};
+
+// plog appender that never touches the file on the logging thread. write() only copies the record into a bounded
+// lock-free queue, any number of threads can log at once. A background thread formats the queued records and
+// writes them in batches. When the queue is full new messages are dropped and counted, and a line saying how many
+// were lost is written once there is room again.
+class AsyncLogAppender : public plog::IAppender
+{
+  public:
+
+    // max_file_size of 0 never rolls over by size, otherwise files are rolled to name.1.ext ... name.<max_files-1>.ext
+    // like RollingFileAppender does. queue_size is rounded up to a power of 2.
+    AsyncLogAppender(const std::string& path, LOG_FORMAT format, size_t queue_size,
+                     size_t max_file_size = 0, int max_files = 0, bool start_thread = true);
+
+    // Writes out everything still queued
+    virtual ~AsyncLogAppender();
+
+    virtual void write(const plog::Record& record) override;
+
+    // Same as write, for callers that don't have a plog record. Returns false if the message was dropped.
+    bool push(plog::Severity severity, const plog::util::Time& time, unsigned int tid, const char* func, size_t line, const char* message);
+
+    // Truncates the file and starts it over. This happens on the writer thread, messages logged before this call
+    // still go to the old contents and messages logged after it go to the new file.
+    void rotate();
+
+    // Blocks until everything logged before this call has been written, only meant for tests and shutdown
+    void flush();
+
+    void start();
+
+    void stop();
+
+    AsyncLogStats getStats() const;
+
+  private:
+
+    struct Entry
+    {
+        plog::Severity severity;
+        plog::util::Time time;
+        unsigned int tid;
+        size_t line;
+        char func[ASYNC_LOG_FUNC_SIZE];
+        char message[ASYNC_LOG_MESSAGE_SIZE];
+    };
+
+    // Bounded MPSC queue cell, seq tells producers and the consumer whose turn it is (Vyukov's bounded queue)
+    struct Slot
+    {
+        std::atomic<uint64_t> seq;
+        Entry entry;
+    };
+
+    void threadLoop();
+
+    // Formats and writes everything currently queued. Returns the number of messages written.
+    size_t drain();
+
+    void format(const Entry& entry, std::string& out) const;
+
+    void writeDropNotice(uint64_t dropped, std::string& out) const;
+
+    void writeBuffer();
+
+    void openFile(bool truncate);
+
+    void rollFiles();
+
+    std::string rolledFileName(int index) const;
+
+    const std::string path_;
+    const LOG_FORMAT format_;
+    const size_t max_file_size_;
+    const int max_files_;
+
+    const size_t capacity_;
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> enqueue_pos_;
+    uint64_t dequeue_pos_;                    // Writer thread only
+    std::atomic<uint64_t> flushed_pos_;       // Everything before this is in the file
+    // Queue position + 1 at which a requested rotation takes effect, 0 if none is pending
+    std::atomic<uint64_t> rotate_request_;
+
+    std::atomic<uint64_t> written_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> batches_;
+    std::atomic<uint64_t> rotations_;
+    uint64_t reported_drops_;                 // Writer thread only
+
+    FILE* file_;
+    size_t file_size_;
+    std::string buffer_;
+
+    std::atomic<bool> thread_running_;
+    std::thread thread_;
+};
+
+#endif //AsyncLogAppender_h
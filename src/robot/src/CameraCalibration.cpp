@@ -0,0 +1,440 @@
+#include "CameraCalibration.h"
+
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <plog/Log.h>
+
+#include "constants.h"
+#include "Se2.h"
+
+// Levenberg-Marquardt over the 3 offsets, a 3 dof rotation correction and the 2 dof marker position
+#define EXTRINSICS_PARAMS 8
+#define EXTRINSICS_MAX_ITERATIONS 100
+// Below this ratio of the smallest to the largest curvature some direction of the fit isn't seen by the data
+#define EXTRINSICS_MIN_CONDITION 1e-9
+
+namespace
+{
+    using Params = Eigen::Matrix<double, EXTRINSICS_PARAMS, 1>;
+
+    // [r1 r2 t] of the camera, maps a homogeneous ground point in the robot frame to a normalized image point.
+    // Built the same way as CameraPipeline::initCamera so the fit matches what the pipelines compute.
+    Eigen::Matrix3d groundToNormalized(const Eigen::Matrix3d& rotation, const Eigen::Vector3d& offset)
+    {
+        const Eigen::Matrix3d R = rotation.transpose();
+        const Eigen::Vector3d t = -1 * rotation * offset;
+        Eigen::Matrix3d M;
+        M << R.col(0), R.col(1), t;
+        return M;
+    }
+
+    Eigen::Matrix3d paramsRotation(const Eigen::Matrix3d& initial, const Params& p)
+    {
+        const Eigen::Vector3d w = p.segment<3>(3);
+        const double angle = w.norm();
+        if(angle < 1e-12) return initial;
+        return Eigen::AngleAxisd(angle, w / angle).toRotationMatrix() * initial;
+    }
+
+    struct Fit
+    {
+        const Eigen::Matrix3d& initial_rotation;
+        const std::vector<Eigen::Vector2d>& seen;     // Normalized image points
+        const std::vector<CalibrationObservation>& observations;
+
+        // Stacked seen minus predicted image points, false if a marker lands behind the camera
+        bool residuals(const Params& p, Eigen::VectorXd* r) const
+        {
+            const Eigen::Matrix3d M = groundToNormalized(paramsRotation(initial_rotation, p), p.head<3>());
+            r->resize(2 * observations.size());
+            for (size_t i = 0; i < observations.size(); i++)
+            {
+                const Point& pose = observations[i].robot_pose;
+                const double c = std::cos(pose.a);
+                const double s = std::sin(pose.a);
+                const double dx = p[6] - pose.x;
+                const double dy = p[7] - pose.y;
+                const Eigen::Vector3d h = M * Eigen::Vector3d(c * dx + s * dy, -s * dx + c * dy, 1);
+                if(h[2] <= 1e-6) return false;
+                (*r)[2 * i] = seen[i][0] - h[0] / h[2];
+                (*r)[2 * i + 1] = seen[i][1] - h[1] / h[2];
+            }
+            return true;
+        }
+    };
+
+    std::string dateString()
+    {
+        char buf[32];
+        time_t now = time(nullptr);
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
+        return std::string(buf);
+    }
+}
+
+CameraExtrinsics readCameraExtrinsics(const std::string& name)
+{
+    const std::string physical = "vision_tracker.physical." + name;
+    CameraExtrinsics extrinsics;
+    const float x = cfg.lookup(physical + ".x_offset");
+    const float y = cfg.lookup(physical + ".y_offset");
+    const float z = cfg.lookup(physical + ".z_offset");
+    extrinsics.offset = {x, y, z};
+    extrinsics.rotation = Eigen::Matrix3f::Identity();
+    const libconfig::Setting& rotation = cfg.lookup(physical + ".rotation");
+    for (int i = 0; i < std::min(rotation.getLength(), 9); i++)
+    {
+        extrinsics.rotation(i / 3, i % 3) = rotation[i];
+    }
+    return extrinsics;
+}
+
+bool solveCameraExtrinsics(const CameraExtrinsics& current, const std::vector<CalibrationObservation>& observations,
+                           ExtrinsicsSolution* solution)
+{
+    if(observations.size() < 4) return false;
+
+    // What each camera saw, recovered from the points it reported
+    const Eigen::Matrix3d initial_rotation = current.rotation.cast<double>();
+    const Eigen::Matrix3d current_M = groundToNormalized(initial_rotation, current.offset.cast<double>());
+    std::vector<Eigen::Vector2d> seen;
+    Eigen::Vector2d marker_sum = {0, 0};
+    for (const CalibrationObservation& obs : observations)
+    {
+        const Eigen::Vector3d h = current_M * Eigen::Vector3d(obs.point[0], obs.point[1], 1);
+        if(std::abs(h[2]) < 1e-9) return false;
+        seen.push_back({h[0] / h[2], h[1] / h[2]});
+        Rotation2D rotation(obs.robot_pose.a);
+        float gx, gy;
+        rotation.toGlobal(obs.point[0], obs.point[1], &gx, &gy);
+        marker_sum += Eigen::Vector2d(obs.robot_pose.x + gx, obs.robot_pose.y + gy);
+    }
+    const Fit fit = {initial_rotation, seen, observations};
+
+    // Starts from the current extrinsics, with the marker where they put it on average
+    Params p;
+    p << current.offset.cast<double>(), 0, 0, 0, marker_sum / observations.size();
+    Eigen::VectorXd r;
+    if(!fit.residuals(p, &r)) return false;
+    double cost = r.squaredNorm();
+    double lambda = 1e-3;
+    Eigen::Matrix<double, EXTRINSICS_PARAMS, EXTRINSICS_PARAMS> JtJ;
+    int iteration = 0;
+    for (; iteration < EXTRINSICS_MAX_ITERATIONS; iteration++)
+    {
+        // Central differences, the model is small enough that an analytic jacobian isn't worth it
+        Eigen::MatrixXd J(r.size(), EXTRINSICS_PARAMS);
+        for (int j = 0; j < EXTRINSICS_PARAMS; j++)
+        {
+            const double h = 1e-6;
+            Params plus = p;
+            Params minus = p;
+            plus[j] += h;
+            minus[j] -= h;
+            Eigen::VectorXd r_plus, r_minus;
+            if(!fit.residuals(plus, &r_plus) || !fit.residuals(minus, &r_minus)) return false;
+            // Of the prediction, which goes into r with a minus sign
+            J.col(j) = (r_minus - r_plus) / (2 * h);
+        }
+        JtJ = J.transpose() * J;
+        const Params g = J.transpose() * r;
+
+        bool improved = false;
+        Params step = Params::Zero();
+        while(lambda < 1e10)
+        {
+            Eigen::Matrix<double, EXTRINSICS_PARAMS, EXTRINSICS_PARAMS> A = JtJ;
+            A.diagonal() += lambda * JtJ.diagonal().cwiseMax(1e-12);
+            step = A.ldlt().solve(g);
+            Eigen::VectorXd r_new;
+            if(fit.residuals(p + step, &r_new) && r_new.squaredNorm() < cost)
+            {
+                p += step;
+                r = r_new;
+                cost = r.squaredNorm();
+                lambda = std::max(lambda / 10, 1e-9);
+                improved = true;
+                break;
+            }
+            lambda *= 10;
+        }
+        if(!improved || step.norm() < 1e-10) break;
+    }
+
+    // Translating without turning can't tell the camera offset from the marker position, and so on
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, EXTRINSICS_PARAMS, EXTRINSICS_PARAMS>> eigen(JtJ);
+    const double max_curvature = eigen.eigenvalues().maxCoeff();
+    if(max_curvature <= 0 || eigen.eigenvalues().minCoeff() / max_curvature < EXTRINSICS_MIN_CONDITION)
+    {
+        return false;
+    }
+
+    solution->extrinsics.offset = p.head<3>().cast<float>();
+    solution->extrinsics.rotation = paramsRotation(initial_rotation, p).cast<float>();
+    solution->marker = p.tail<2>().cast<float>();
+    solution->rms_mrad = static_cast<float>(1000 * std::sqrt(cost / observations.size()));
+    solution->iterations = iteration;
+    return true;
+}
+
+bool applyCameraExtrinsicsFile(const std::string& path)
+{
+    if(!std::filesystem::exists(path)) return false;
+    libconfig::Config calibration;
+    try
+    {
+        calibration.readFile(path.c_str());
+    }
+    catch (const libconfig::ParseException& e)
+    {
+        PLOGE.printf("Could not parse camera extrinsics in %s line %i: %s", path.c_str(), e.getLine(), e.getError());
+        return false;
+    }
+    catch (const libconfig::FileIOException& e)
+    {
+        PLOGE.printf("Could not read camera extrinsics in %s", path.c_str());
+        return false;
+    }
+
+    const libconfig::Setting& cameras = calibration.getRoot();
+    for (int i = 0; i < cameras.getLength(); i++)
+    {
+        const libconfig::Setting& camera = cameras[i];
+        const std::string physical = std::string("vision_tracker.physical.") + camera.getName();
+        if(!cfg.exists(physical) || !camera.exists("rotation") || camera["rotation"].getLength() != 9)
+        {
+            PLOGW.printf("Skipping %s in %s, no such camera or no rotation", camera.getName(), path.c_str());
+            continue;
+        }
+        for (const char* name : {"x_offset", "y_offset", "z_offset"})
+        {
+            cfg.lookup(physical + "." + name) = static_cast<float>(camera[name]);
+        }
+        libconfig::Setting& rotation = cfg.lookup(physical + ".rotation");
+        for (int j = 0; j < 9; j++)
+        {
+            rotation[j] = static_cast<float>(camera["rotation"][j]);
+        }
+        PLOGI.printf("Using calibrated extrinsics for %s camera from %s", camera.getName(), path.c_str());
+    }
+    return true;
+}
+
+CameraCalibrator::CameraCalibrator(ControlLoop& controller, CameraTrackerBase* camera_tracker)
+: controller_(controller),
+  camera_tracker_(camera_tracker),
+  state_(STATE::IDLE),
+  succeeded_(false),
+  station_(0),
+  state_timer_(),
+  pattern_(),
+  settle_ms_(cfg.lookup("camera_calibration.settle_ms")),
+  samples_(cfg.lookup("camera_calibration.samples")),
+  station_timeout_ms_(cfg.lookup("camera_calibration.station_timeout_ms")),
+  max_rms_mrad_(cfg.lookup("camera_calibration.max_rms_mrad")),
+  max_offset_change_(cfg.lookup("camera_calibration.max_offset_change")),
+  output_path_(static_cast<const char*>(cfg.lookup("camera_calibration.output_path"))),
+  names_(),
+  station_samples_(),
+  pose_sum_(0, 0, 0),
+  pose_ref_a_(0),
+  pose_count_(0),
+  observations_()
+{
+    const libconfig::Setting& pattern = cfg.lookup("camera_calibration.pattern");
+    for (int i = 0; i + 2 < pattern.getLength(); i += 3)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            pattern_.push_back(pattern[i + j]);
+        }
+    }
+    const libconfig::Setting& camera_names = cfg.lookup("vision_tracker.cameras");
+    for (int i = 0; i < std::min(camera_names.getLength(), MAX_CAMERAS); i++)
+    {
+        names_.push_back(static_cast<const char*>(camera_names[i]));
+    }
+}
+
+bool CameraCalibrator::start()
+{
+    if(!camera_tracker_->running())
+    {
+        PLOGW << "Cannot calibrate the cameras if the camera tracker isn't running";
+        return false;
+    }
+    PLOGI.printf("Starting camera calibration, %zu moves", pattern_.size() / 3);
+    succeeded_ = false;
+    observations_.assign(names_.size(), {});
+    station_ = 0;
+    startStation();
+    return true;
+}
+
+void CameraCalibrator::abort()
+{
+    if(state_ == STATE::IDLE) return;
+    PLOGW.printf("Camera calibration aborted at stop %i", station_);
+    state_ = STATE::IDLE;
+}
+
+void CameraCalibrator::startStation()
+{
+    state_timer_.reset();
+    if(station_ == 0)
+    {
+        state_ = STATE::SETTLING;
+        return;
+    }
+    const float* move = &pattern_[3 * (station_ - 1)];
+    controller_.moveToPositionRelativeSlow(move[0], move[1], move[2]);
+    state_ = STATE::MOVING;
+}
+
+void CameraCalibrator::update()
+{
+    switch (state_)
+    {
+        case STATE::IDLE:
+            return;
+        case STATE::MOVING:
+            if(controller_.isTrajectoryRunning()) return;
+            state_ = STATE::SETTLING;
+            state_timer_.reset();
+            return;
+        case STATE::SETTLING:
+        {
+            if(state_timer_.dt_ms() < settle_ms_) return;
+            // Only poses solved from here on count
+            const CameraDebug debug = camera_tracker_->getCameraDebug();
+            for (size_t i = 0; i < names_.size(); i++)
+            {
+                station_samples_[i] = {{0, 0}, 0, debug.cameras[i].poses};
+            }
+            pose_sum_ = {0, 0, 0};
+            pose_ref_a_ = controller_.getCurrentPosition().a;
+            pose_count_ = 0;
+            state_ = STATE::SAMPLING;
+            state_timer_.reset();
+            return;
+        }
+        case STATE::SAMPLING:
+            break;
+    }
+
+    const Point pose = controller_.getCurrentPosition();
+    pose_sum_ += Eigen::Vector3f(pose.x, pose.y, angle_diff(pose.a, pose_ref_a_));
+    pose_count_++;
+
+    // The marker points come from the camera poses, so every camera needs its marker in view
+    const CameraDebug debug = camera_tracker_->getCameraDebug();
+    bool all_sampled = true;
+    for (size_t i = 0; i < names_.size(); i++)
+    {
+        const CameraHealth& health = debug.cameras[i];
+        StationSamples& samples = station_samples_[i];
+        if(health.poses != samples.last_poses && health.used)
+        {
+            samples.point_sum += Eigen::Vector2f(health.x, health.y);
+            samples.count++;
+        }
+        samples.last_poses = health.poses;
+        all_sampled = all_sampled && samples.count >= samples_;
+    }
+    if(all_sampled || state_timer_.dt_ms() > station_timeout_ms_)
+    {
+        finishStation();
+    }
+}
+
+void CameraCalibrator::finishStation()
+{
+    const Eigen::Vector3f mean_pose = pose_sum_ / std::max(pose_count_, 1);
+    const Point robot_pose = {mean_pose[0], mean_pose[1], wrapAngle(pose_ref_a_ + mean_pose[2])};
+    for (size_t i = 0; i < names_.size(); i++)
+    {
+        const StationSamples& samples = station_samples_[i];
+        // A camera that barely saw its marker here is left out of this stop rather than fitting a bad average
+        if(samples.count < std::max(1, samples_ / 2))
+        {
+            PLOGW.printf("Camera calibration stop %i: %s camera only has %i samples", station_, names_[i].c_str(), samples.count);
+            continue;
+        }
+        observations_[i].push_back({robot_pose, samples.point_sum / samples.count});
+    }
+    PLOGI.printf("Camera calibration stop %i sampled at %s", station_, robot_pose.toString().c_str());
+
+    station_++;
+    if(static_cast<size_t>(3 * station_) > pattern_.size())
+    {
+        finish();
+        return;
+    }
+    startStation();
+}
+
+void CameraCalibrator::finish()
+{
+    state_ = STATE::IDLE;
+    std::vector<ExtrinsicsSolution> solutions(names_.size());
+    bool ok = true;
+    for (size_t i = 0; i < names_.size(); i++)
+    {
+        const std::string& name = names_[i];
+        const CameraExtrinsics current = readCameraExtrinsics(name);
+        ExtrinsicsSolution& solution = solutions[i];
+        if(!solveCameraExtrinsics(current, observations_[i], &solution))
+        {
+            PLOGE.printf("Could not solve %s camera extrinsics from %zu stops", name.c_str(), observations_[i].size());
+            ok = false;
+            continue;
+        }
+        const Eigen::Vector3f& offset = solution.extrinsics.offset;
+        const float offset_change = (offset - current.offset).norm();
+        const float rotation_change = Eigen::AngleAxisf(solution.extrinsics.rotation * current.rotation.transpose()).angle();
+        PLOGI.printf("%s camera: offset [%.4f, %.4f, %.4f] moved %.4f m, rotated %.2f deg, marker at [%.4f, %.4f], rms %.2f mrad, %i iterations",
+                     name.c_str(), offset[0], offset[1], offset[2], offset_change, rotation_change * 180 / M_PI,
+                     solution.marker[0], solution.marker[1], solution.rms_mrad, solution.iterations);
+        if(solution.rms_mrad > max_rms_mrad_ || offset_change > max_offset_change_)
+        {
+            PLOGE.printf("Rejecting %s camera calibration, limits are %.2f mrad and %.3f m", name.c_str(), max_rms_mrad_, max_offset_change_);
+            ok = false;
+        }
+    }
+    succeeded_ = ok && writeResult(solutions);
+}
+
+bool CameraCalibrator::writeResult(const std::vector<ExtrinsicsSolution>& solutions)
+{
+    std::error_code ec;
+    const std::filesystem::path dir = std::filesystem::path(output_path_).parent_path();
+    if(!dir.empty()) std::filesystem::create_directories(dir, ec);
+    // Written next to it and renamed so a crash can't leave a half written file to be applied at startup
+    const std::string tmp_path = output_path_ + ".tmp";
+    std::ofstream out(tmp_path);
+    out << "// Camera extrinsics from calibrate_cameras on " << dateString() << ", applied over vision_tracker.physical at startup\n";
+    for (size_t i = 0; i < names_.size(); i++)
+    {
+        const ExtrinsicsSolution& solution = solutions[i];
+        const CameraExtrinsics& extrinsics = solution.extrinsics;
+        char buf[512];
+        snprintf(buf, sizeof(buf), "%s = {\n  x_offset = %.5f;\n  y_offset = %.5f;\n  z_offset = %.5f;\n"
+                 "  rotation = [%.6f, %.6f, %.6f,  %.6f, %.6f, %.6f,  %.6f, %.6f, %.6f];\n  rms_mrad = %.3f;\n};\n",
+                 names_[i].c_str(), extrinsics.offset[0], extrinsics.offset[1], extrinsics.offset[2],
+                 extrinsics.rotation(0, 0), extrinsics.rotation(0, 1), extrinsics.rotation(0, 2),
+                 extrinsics.rotation(1, 0), extrinsics.rotation(1, 1), extrinsics.rotation(1, 2),
+                 extrinsics.rotation(2, 0), extrinsics.rotation(2, 1), extrinsics.rotation(2, 2), solution.rms_mrad);
+        out << buf;
+    }
+    out.close();
+    if(out) std::filesystem::rename(tmp_path, output_path_, ec);
+    if(!out || ec)
+    {
+        PLOGE.printf("Could not write camera extrinsics to %s", output_path_.c_str());
+        return false;
+    }
+    PLOGI.printf("Wrote camera extrinsics to %s, they are used from the next start", output_path_.c_str());
+    return true;
+}
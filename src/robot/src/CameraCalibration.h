@@ -0,0 +1,122 @@
+#ifndef CameraCalibration_h
+#define CameraCalibration_h
+
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+
+#include "ControlLoop.h"
+#include "camera_tracker/CameraTrackerBase.h"
+#include "utils.h"
+
+// In-field extrinsic calibration of the cameras. The base is driven through a short pattern of small slow moves
+// in front of the vision target, and at each stop the marker point every camera reports is averaged along with
+// the robot pose. The markers don't move, so a least squares fit over the stops gives each camera's offset and
+// rotation along with where its marker is. Intrinsics are left alone, they come from the calibration files.
+//
+// The reported marker points went through the extrinsics the pipelines were built with, and mapping them back
+// through those same extrinsics gives the normalized image point each camera actually saw, so the camera matrix
+// cancels out and the fit doesn't need it.
+
+// Position and rotation of one camera, as in vision_tracker.physical.<name>
+struct CameraExtrinsics
+{
+    Eigen::Vector3f offset;       // x_offset, y_offset, z_offset
+    Eigen::Matrix3f rotation;     // rotation, the camera to robot frame rotation
+};
+
+// One stop of the pattern for one camera
+struct CalibrationObservation
+{
+    Point robot_pose;             // Global pose the marker was seen from
+    Eigen::Vector2f point;        // Marker point in the robot frame, as reported through the current extrinsics
+};
+
+struct ExtrinsicsSolution
+{
+    CameraExtrinsics extrinsics;
+    Eigen::Vector2f marker = {0, 0};    // Global position of the marker
+    float rms_mrad = 0;                 // Residual as the angle between seen and predicted rays
+    int iterations = 0;
+};
+
+// Reads vision_tracker.physical.<name>
+CameraExtrinsics readCameraExtrinsics(const std::string& name);
+
+// Fits extrinsics that explain the observations, starting from current, which the points were reported through.
+// Needs at least 4 observations from different headings, returns false if they don't pin the camera down.
+bool solveCameraExtrinsics(const CameraExtrinsics& current, const std::vector<CalibrationObservation>& observations,
+                           ExtrinsicsSolution* solution);
+
+// Copies the extrinsics in a file written by CameraCalibrator over the ones in cfg. Cameras are built from cfg,
+// so this has to run before the camera tracker exists. Returns false if the file is missing or unreadable.
+bool applyCameraExtrinsicsFile(const std::string& path);
+
+// Runs the calibration as a long running command, see camera_calibration in the config. The new extrinsics are
+// written to camera_calibration.output_path, and both the robot and the vision process pick them up from there
+// the next time they start.
+class CameraCalibrator
+{
+  public:
+
+    CameraCalibrator(ControlLoop& controller, CameraTrackerBase* camera_tracker);
+
+    // Starts the pattern from wherever the robot is. Returns false if the cameras aren't running.
+    bool start();
+
+    // Steps through the pattern, called every main loop
+    void update();
+
+    // Stops where it is without moving the base any further. Nothing is written.
+    void abort();
+
+    bool isRunning() const { return state_ != STATE::IDLE; };
+
+    // Whether the last run that finished solved every camera and wrote the result
+    bool succeeded() const { return succeeded_; };
+
+  private:
+
+    enum class STATE
+    {
+        IDLE,
+        MOVING,
+        SETTLING,
+        SAMPLING,
+    };
+
+    // Sums of one camera's samples at the current stop
+    struct StationSamples
+    {
+        Eigen::Vector2f point_sum;
+        int count;
+        uint32_t last_poses;
+    };
+
+    void startStation();
+    void finishStation();
+    void finish();
+    bool writeResult(const std::vector<ExtrinsicsSolution>& solutions);
+
+    ControlLoop& controller_;
+    CameraTrackerBase* camera_tracker_;
+    STATE state_;
+    bool succeeded_;
+    int station_;                 // Stop being sampled, 0 is where the robot started
+    Timer state_timer_;
+    std::vector<float> pattern_;  // dx, dy, da of each move in the robot frame
+    int settle_ms_;
+    int samples_;
+    int station_timeout_ms_;
+    float max_rms_mrad_;
+    float max_offset_change_;
+    std::string output_path_;
+    std::vector<std::string> names_;
+    StationSamples station_samples_[MAX_CAMERAS];
+    Eigen::Vector3f pose_sum_;    // Robot pose over the samples, heading relative to pose_ref_a_
+    float pose_ref_a_;
+    int pose_count_;
+    std::vector<std::vector<CalibrationObservation>> observations_;
+};
+
+#endif //CameraCalibration_h
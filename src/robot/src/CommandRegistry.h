@@ -0,0 +1,217 @@
+#ifndef CommandRegistry_h
+#define CommandRegistry_h
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "constants.h"
+
+// Every message type master can send, in one table that RobotServer parses and acks from and Robot
+// dispatches from. Text messages are found by their type string through a perfect hash built at compile
+// time, binary messages use the COMMAND value as their id so those values must never be renumbered.
+
+// What the data field (or binary payload) holds and where RobotServer puts it
+enum class CMD_PAYLOAD
+{
+    NONE,
+    TARGET,             // x, y, a goal for a move, see RobotServer::getMoveData
+    POSITION,           // x, y, a external position with an optional measurement time t
+    POSE,               // x, y, a the pose estimate is reset to
+    VELOCITY,           // vx, vy, va, t
+    PATH,               // Up to MAX_PATH_WAYPOINTS [x, y, a] points
+    FIELD_PLAN,         // Up to FIELD_PLAN_CHUNK_STEPS steps of a field plan, see RobotServer::FieldPlanChunk
+    // Answered by the server itself, these never reach the robot
+    STATUS_REQ,
+    TIME_SYNC,
+    STATUS_SUBSCRIBE,
+    PING,               // t echoed back in a pong, optional rtt of the previous ping in ms
+    PLAN,               // A move to plan without running it, see RobotServer::sendPlan
+    SET_PARAM,          // name (config path) and value to stage, see ConfigSnapshot::setParam
+    GET_PARAM,          // name (config path) to read back
+    SESSION,            // id and rx frame count of the session to resume, see RobotServer::openSession
+};
+
+// How Robot knows a command is finished. Anything but IMMEDIATE runs until its controller says it is done,
+// needs the robot to not be busy with anything else to start, and can go on the command queue. IMMEDIATE
+// commands act as they arrive without interrupting whatever is running.
+enum class CMD_DONE
+{
+    IMMEDIATE,
+    TRAJECTORY,
+    TRAY,
+    LOCALIZATION,
+    CALIBRATION,        // CameraCalibrator
+};
+
+struct CommandSpec
+{
+    const char* type;
+    COMMAND cmd;        // NONE for messages only the server handles
+    CMD_PAYLOAD payload;
+    CMD_DONE done;
+    bool ack;           // Replied to with an ack of the type, the others send their own reply
+    bool log;           // Printed when received, off for the high rate ones
+};
+
+inline constexpr CommandSpec COMMAND_TABLE[] =
+{
+    // type                     cmd                              payload                        done                    ack    log
+    {"move",                    COMMAND::MOVE,                   CMD_PAYLOAD::TARGET,           CMD_DONE::TRAJECTORY,   true,  true},
+    {"move_rel",                COMMAND::MOVE_REL,               CMD_PAYLOAD::TARGET,           CMD_DONE::TRAJECTORY,   true,  true},
+    {"move_rel_slow",           COMMAND::MOVE_REL_SLOW,          CMD_PAYLOAD::TARGET,           CMD_DONE::TRAJECTORY,   true,  true},
+    {"move_fine",               COMMAND::MOVE_FINE,              CMD_PAYLOAD::TARGET,           CMD_DONE::TRAJECTORY,   true,  true},
+    {"move_fine_stop_vision",   COMMAND::MOVE_FINE_STOP_VISION,  CMD_PAYLOAD::TARGET,           CMD_DONE::TRAJECTORY,   true,  true},
+    {"move_vision",             COMMAND::MOVE_WITH_VISION,       CMD_PAYLOAD::TARGET,           CMD_DONE::TRAJECTORY,   true,  true},
+    {"move_path",               COMMAND::MOVE_PATH,              CMD_PAYLOAD::PATH,             CMD_DONE::TRAJECTORY,   true,  true},
+    {"update_goal",             COMMAND::UPDATE_GOAL,            CMD_PAYLOAD::TARGET,           CMD_DONE::IMMEDIATE,    true,  true},
+    {"move_const_vel",          COMMAND::MOVE_CONST_VEL,         CMD_PAYLOAD::VELOCITY,         CMD_DONE::TRAJECTORY,   true,  true},
+    {"place",                   COMMAND::PLACE_TRAY,             CMD_PAYLOAD::NONE,             CMD_DONE::TRAY,         true,  true},
+    {"load",                    COMMAND::LOAD_TRAY,              CMD_PAYLOAD::NONE,             CMD_DONE::TRAY,         true,  true},
+    {"init",                    COMMAND::INITIALIZE_TRAY,        CMD_PAYLOAD::NONE,             CMD_DONE::TRAY,         true,  true},
+    {"wait_for_loc",            COMMAND::WAIT_FOR_LOCALIZATION,  CMD_PAYLOAD::NONE,             CMD_DONE::LOCALIZATION, true,  false},
+    {"calibrate_cameras",       COMMAND::CALIBRATE_CAMERAS,      CMD_PAYLOAD::NONE,             CMD_DONE::CALIBRATION,  true,  true},
+    {"p",                       COMMAND::POSITION,               CMD_PAYLOAD::POSITION,         CMD_DONE::IMMEDIATE,    true,  false},
+    {"set_pose",                COMMAND::SET_POSE,               CMD_PAYLOAD::POSE,             CMD_DONE::IMMEDIATE,    true,  false},
+    {"estop",                   COMMAND::ESTOP,                  CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  true},
+    {"lc",                      COMMAND::LOAD_COMPLETE,          CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  true},
+    {"clear_error",             COMMAND::CLEAR_ERROR,            CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  false},
+    {"toggle_vision_debug",     COMMAND::TOGGLE_VISION_DEBUG,    CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  false},
+    {"dump_trace",              COMMAND::DUMP_TRACE,             CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  false},
+    {"start_cameras",           COMMAND::START_CAMERAS,          CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  false},
+    {"stop_cameras",            COMMAND::STOP_CAMERAS,           CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  false},
+    {"field_plan_upload",       COMMAND::FIELD_PLAN_UPLOAD,      CMD_PAYLOAD::FIELD_PLAN,       CMD_DONE::IMMEDIATE,    true,  false},
+    {"field_plan_run",          COMMAND::FIELD_PLAN_RUN,         CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  true},
+    {"field_plan_pause",        COMMAND::FIELD_PLAN_PAUSE,       CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  true},
+    {"field_plan_abort",        COMMAND::FIELD_PLAN_ABORT,       CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  true},
+    {"check",                   COMMAND::NONE,                   CMD_PAYLOAD::NONE,             CMD_DONE::IMMEDIATE,    true,  false},
+    {"status",                  COMMAND::NONE,                   CMD_PAYLOAD::STATUS_REQ,       CMD_DONE::IMMEDIATE,    false, false},
+    {"status_subscribe",        COMMAND::NONE,                   CMD_PAYLOAD::STATUS_SUBSCRIBE, CMD_DONE::IMMEDIATE,    true,  true},
+    {"time_sync",               COMMAND::NONE,                   CMD_PAYLOAD::TIME_SYNC,        CMD_DONE::IMMEDIATE,    false, false},
+    {"ping",                    COMMAND::NONE,                   CMD_PAYLOAD::PING,             CMD_DONE::IMMEDIATE,    false, false},
+    {"plan",                    COMMAND::NONE,                   CMD_PAYLOAD::PLAN,             CMD_DONE::IMMEDIATE,    false, true},
+    {"set_param",               COMMAND::NONE,                   CMD_PAYLOAD::SET_PARAM,        CMD_DONE::IMMEDIATE,    false, true},
+    {"get_param",               COMMAND::NONE,                   CMD_PAYLOAD::GET_PARAM,        CMD_DONE::IMMEDIATE,    false, false},
+    {"session",                 COMMAND::NONE,                   CMD_PAYLOAD::SESSION,          CMD_DONE::IMMEDIATE,    false, true},
+};
+
+inline constexpr size_t NUM_COMMAND_SPECS = sizeof(COMMAND_TABLE) / sizeof(COMMAND_TABLE[0]);
+
+// Binary ids at or above this belong to BINARY_MSG
+#define COMMAND_ID_LIMIT 0x80
+// Power of two, big enough that a collision free seed is quick to find
+#define COMMAND_HASH_SIZE 128
+
+namespace command_registry
+{
+    // FNV-1a started from a seed so one can be picked that puts every type in its own slot. The low bits of
+    // FNV only depend on the low bits of the input, so the high bits are folded in before the slot is taken.
+    constexpr uint32_t hashType(std::string_view type, uint32_t seed)
+    {
+        uint32_t hash = 2166136261u ^ seed;
+        for (char c : type)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 16777619u;
+        }
+        hash ^= hash >> 16;
+        hash *= 0x45d9f3bu;
+        return hash ^ (hash >> 16);
+    }
+
+    constexpr bool seedIsPerfect(uint32_t seed)
+    {
+        bool used[COMMAND_HASH_SIZE] = {};
+        for (size_t i = 0; i < NUM_COMMAND_SPECS; i++)
+        {
+            const uint32_t slot = hashType(COMMAND_TABLE[i].type, seed) % COMMAND_HASH_SIZE;
+            if (used[slot]) return false;
+            used[slot] = true;
+        }
+        return true;
+    }
+
+    constexpr uint32_t findSeed()
+    {
+        for (uint32_t seed = 0; seed < 20000; seed++)
+        {
+            if (seedIsPerfect(seed)) return seed;
+        }
+        return UINT32_MAX;
+    }
+
+    inline constexpr uint32_t HASH_SEED = findSeed();
+    static_assert(HASH_SEED != UINT32_MAX, "No perfect hash seed for COMMAND_TABLE, increase COMMAND_HASH_SIZE");
+
+    // Table index for each hash slot, -1 for empty slots
+    constexpr std::array<int8_t, COMMAND_HASH_SIZE> buildHashSlots()
+    {
+        std::array<int8_t, COMMAND_HASH_SIZE> slots = {};
+        for (auto& slot : slots) slot = -1;
+        for (size_t i = 0; i < NUM_COMMAND_SPECS; i++)
+        {
+            slots[hashType(COMMAND_TABLE[i].type, HASH_SEED) % COMMAND_HASH_SIZE] = static_cast<int8_t>(i);
+        }
+        return slots;
+    }
+
+    // Table index for each COMMAND value, -1 for ones that aren't in the table
+    constexpr std::array<int8_t, COMMAND_ID_LIMIT> buildIdSlots()
+    {
+        std::array<int8_t, COMMAND_ID_LIMIT> slots = {};
+        for (auto& slot : slots) slot = -1;
+        for (size_t i = 0; i < NUM_COMMAND_SPECS; i++)
+        {
+            if (COMMAND_TABLE[i].cmd != COMMAND::NONE) slots[static_cast<size_t>(COMMAND_TABLE[i].cmd)] = static_cast<int8_t>(i);
+        }
+        return slots;
+    }
+
+    constexpr bool idsAreUnique()
+    {
+        for (size_t i = 0; i < NUM_COMMAND_SPECS; i++)
+        {
+            if (static_cast<size_t>(COMMAND_TABLE[i].cmd) >= COMMAND_ID_LIMIT) return false;
+            for (size_t j = i + 1; j < NUM_COMMAND_SPECS; j++)
+            {
+                if (COMMAND_TABLE[i].cmd != COMMAND::NONE && COMMAND_TABLE[i].cmd == COMMAND_TABLE[j].cmd) return false;
+            }
+        }
+        return true;
+    }
+    static_assert(idsAreUnique(), "Each COMMAND can only be in COMMAND_TABLE once, and must fit below the BINARY_MSG ids");
+
+    inline constexpr std::array<int8_t, COMMAND_HASH_SIZE> HASH_SLOTS = buildHashSlots();
+    inline constexpr std::array<int8_t, COMMAND_ID_LIMIT> ID_SLOTS = buildIdSlots();
+}
+
+// Spec for a text message type, null if there is no such type
+constexpr const CommandSpec* findCommand(std::string_view type)
+{
+    const int8_t idx = command_registry::HASH_SLOTS[command_registry::hashType(type, command_registry::HASH_SEED) % COMMAND_HASH_SIZE];
+    return idx >= 0 && type == COMMAND_TABLE[idx].type ? &COMMAND_TABLE[idx] : nullptr;
+}
+
+// Spec for a command or binary id, null for NONE and anything else not in the table
+constexpr const CommandSpec* findCommand(COMMAND cmd)
+{
+    const size_t id = static_cast<size_t>(cmd);
+    if (id >= COMMAND_ID_LIMIT) return nullptr;
+    const int8_t idx = command_registry::ID_SLOTS[id];
+    return idx >= 0 ? &COMMAND_TABLE[idx] : nullptr;
+}
+
+// Whether cmd runs until done rather than acting immediately, see CMD_DONE
+constexpr bool isLongRunningCmd(COMMAND cmd)
+{
+    const CommandSpec* spec = findCommand(cmd);
+    return spec && spec->done != CMD_DONE::IMMEDIATE;
+}
+
+constexpr bool isTrayCmd(COMMAND cmd)
+{
+    const CommandSpec* spec = findCommand(cmd);
+    return spec && spec->done == CMD_DONE::TRAY;
+}
+
+#endif //CommandRegistry_h
@@ -0,0 +1,360 @@
+#include "ConfigSnapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <plog/Log.h>
+#include "constants.h"
+
+namespace
+{
+    std::shared_ptr<const ConfigSnapshot> g_snapshot;
+    std::atomic<uint32_t> g_generation(0);
+
+    // A setting staged by setParam, with its value from before the first change since the last apply
+    struct StagedParam
+    {
+        std::string path;
+        double applied_value;
+        double value;
+    };
+
+    // Guards everything below, setParam and applyPendingParams can come from different threads
+    std::mutex g_param_mutex;
+    std::shared_ptr<const ConfigSnapshot> g_pending;
+    std::vector<StagedParam> g_staged;
+    // Paths fromConfig reads, which are the ones that can be tuned
+    std::set<std::string> g_tunable_paths;
+    thread_local std::set<std::string>* g_recorded_paths = nullptr;
+
+    libconfig::Setting& lookup(const std::string& path)
+    {
+        if(g_recorded_paths) g_recorded_paths->insert(path);
+        return cfg.lookup(path);
+    }
+
+    double settingValue(const libconfig::Setting& setting)
+    {
+        switch(setting.getType())
+        {
+            case libconfig::Setting::TypeInt: return static_cast<int>(setting);
+            case libconfig::Setting::TypeBoolean: return static_cast<bool>(setting) ? 1 : 0;
+            default: return static_cast<double>(setting);
+        }
+    }
+
+    // False if value doesn't fit the type the setting already has, only ints, floats and booleans are tunable
+    bool setSettingValue(libconfig::Setting& setting, double value)
+    {
+        switch(setting.getType())
+        {
+            case libconfig::Setting::TypeInt:
+                if(value != std::floor(value) || fabs(value) > INT32_MAX) return false;
+                setting = static_cast<int>(value);
+                return true;
+            case libconfig::Setting::TypeBoolean:
+                if(value != 0 && value != 1) return false;
+                setting = value == 1;
+                return true;
+            case libconfig::Setting::TypeFloat:
+                if(!std::isfinite(value)) return false;
+                setting = value;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool checkPositive(float value, const char* name, std::string* error)
+    {
+        if(value > 0) return true;
+        *error = std::string(name) + " must be positive";
+        return false;
+    }
+
+    bool checkLimits(const DynamicLimits& limits, const char* name, std::string* error)
+    {
+        return checkPositive(limits.max_vel, name, error) && checkPositive(limits.max_acc, name, error) &&
+               checkPositive(limits.max_jerk, name, error);
+    }
+
+    bool checkAxis(const AxisConfig& axis, std::string* error)
+    {
+        return checkLimits(axis.coarse, "coarse limits", error) && checkLimits(axis.fine, "fine limits", error) &&
+               checkLimits(axis.vision, "vision limits", error);
+    }
+
+    bool isTunable(const std::string& path)
+    {
+        if(g_tunable_paths.empty())
+        {
+            g_recorded_paths = &g_tunable_paths;
+            ConfigSnapshot::fromConfig();
+            g_recorded_paths = nullptr;
+        }
+        return g_tunable_paths.count(path) > 0;
+    }
+
+    DynamicLimits readLimits(const std::string& axis, const std::string& mode)
+    {
+        DynamicLimits limits;
+        limits.max_vel = lookup(axis + ".max_vel." + mode);
+        limits.max_acc = lookup(axis + ".max_acc." + mode);
+        limits.max_jerk = lookup(axis + ".max_jerk." + mode);
+        return limits;
+    }
+
+    PositionController::Gains readGains(const std::string& path)
+    {
+        PositionController::Gains gains;
+        gains.kp = lookup(path + ".kp");
+        gains.ki = lookup(path + ".ki");
+        gains.kd = lookup(path + ".kd");
+        gains.ka = lookup(path + ".ka");
+        gains.max_integral = lookup(path + ".max_integral");
+        gains.scale_accel = lookup(path + ".schedule.accel");
+        gains.scale_cruise = lookup(path + ".schedule.cruise");
+        gains.scale_decel = lookup(path + ".schedule.decel");
+        gains.scale_settle = lookup(path + ".schedule.settle");
+        return gains;
+    }
+
+    AxisConfig readAxis(const std::string& axis)
+    {
+        AxisConfig config;
+        config.coarse = readLimits(axis, "coarse");
+        config.fine = readLimits(axis, "fine");
+        config.vision = readLimits(axis, "vision");
+        config.gains = readGains(axis + ".gains");
+        config.gains_vision = readGains(axis + ".gains_vision");
+        config.position_threshold_coarse = lookup(axis + ".position_threshold.coarse");
+        config.position_threshold_fine = lookup(axis + ".position_threshold.fine");
+        config.position_threshold_vision = lookup(axis + ".position_threshold.vision");
+        config.velocity_threshold_coarse = lookup(axis + ".velocity_threshold.coarse");
+        config.velocity_threshold_fine = lookup(axis + ".velocity_threshold.fine");
+        config.velocity_threshold_vision = lookup(axis + ".velocity_threshold.vision");
+        return config;
+    }
+}
+
+const DynamicLimits& AxisConfig::limits(LIMITS_MODE mode) const
+{
+    switch (mode)
+    {
+        case LIMITS_MODE::VISION:
+            return vision;
+        case LIMITS_MODE::FINE:
+        case LIMITS_MODE::SLOW:
+            return fine;
+        default:
+            return coarse;
+    }
+}
+
+SettleDetector::Params SettleConfig::params(LIMITS_MODE mode) const
+{
+    switch (mode)
+    {
+        case LIMITS_MODE::VISION:
+            return {dwell_vision, confident_dwell_vision, confidence_sigma};
+        case LIMITS_MODE::FINE:
+        case LIMITS_MODE::SLOW:
+            return {dwell_fine, confident_dwell_fine, confidence_sigma};
+        default:
+            return {dwell_coarse, confident_dwell_coarse, confidence_sigma};
+    }
+}
+
+ConfigSnapshot ConfigSnapshot::fromConfig()
+{
+    ConfigSnapshot config;
+    config.translation = readAxis("motion.translation");
+    config.rotation = readAxis("motion.rotation");
+    config.limit_max_fraction = lookup("motion.limit_max_fraction");
+    config.controller_frequency = lookup("motion.controller_frequency");
+    config.driver_correction_period_s = 1.0f / static_cast<float>(lookup("motion.driver_trajectory.correction_frequency"));
+    config.log_motion_csv = lookup("logging.motion_csv");
+    config.stop_fast_planned = lookup("motion.stop_fast.planned");
+    config.settle.dwell_coarse = lookup("motion.settle.dwell.coarse");
+    config.settle.dwell_fine = lookup("motion.settle.dwell.fine");
+    config.settle.dwell_vision = lookup("motion.settle.dwell.vision");
+    config.settle.confident_dwell_coarse = lookup("motion.settle.confident_dwell.coarse");
+    config.settle.confident_dwell_fine = lookup("motion.settle.confident_dwell.fine");
+    config.settle.confident_dwell_vision = lookup("motion.settle.confident_dwell.vision");
+    config.settle.confidence_sigma = lookup("motion.settle.confidence_sigma");
+    config.approach_mpc.enabled = lookup("motion.approach_mpc.enabled");
+    config.approach_mpc.window = lookup("motion.approach_mpc.window");
+    config.approach_mpc.dt = lookup("motion.approach_mpc.dt");
+    config.approach_mpc.trans_weight = lookup("motion.approach_mpc.trans_weight");
+    config.approach_mpc.rot_weight = lookup("motion.approach_mpc.rot_weight");
+    config.approach_mpc.terminal_weight = lookup("motion.approach_mpc.terminal_weight");
+    config.approach_mpc.smooth_weight = lookup("motion.approach_mpc.smooth_weight");
+    config.approach_mpc.rho = lookup("motion.approach_mpc.rho");
+    config.approach_mpc.iterations = lookup("motion.approach_mpc.iterations");
+
+    config.solver.num_loops = lookup("trajectory_generation.solver_max_loops");
+    config.solver.beta_decay = lookup("trajectory_generation.solver_beta_decay");
+    config.solver.alpha_decay = lookup("trajectory_generation.solver_alpha_decay");
+    config.solver.exponent_decay = lookup("trajectory_generation.solver_exponent_decay");
+    std::string solver_mode = lookup("trajectory_generation.solver_mode");
+    if (solver_mode == "analytic")
+    {
+        config.solver.mode = SOLVER_MODE::ANALYTIC;
+    }
+    else
+    {
+        if (solver_mode != "iterative") PLOGW << "Unknown trajectory solver mode " << solver_mode << ", using iterative";
+        config.solver.mode = SOLVER_MODE::ITERATIVE;
+    }
+    config.blend.check_dt = lookup("trajectory_generation.path.blend_check_dt");
+    config.blend.max_iterations = lookup("trajectory_generation.path.blend_iterations");
+    config.min_dist_limit = lookup("trajectory_generation.min_dist_limit");
+    config.wheel_limits.enabled = lookup("trajectory_generation.coupled.enabled");
+    config.wheel_limits.base_radius = lookup("trajectory_generation.coupled.base_radius");
+    config.wheel_limits.max_vel = lookup("trajectory_generation.coupled.wheel_max_vel");
+    config.wheel_limits.max_acc = lookup("trajectory_generation.coupled.wheel_max_acc");
+    config.wheel_check_dt = lookup("trajectory_generation.coupled.wheel_check_dt");
+
+    config.vision_kf.predict_trans_cov = lookup("vision_tracker.kf.predict_trans_cov");
+    config.vision_kf.predict_angle_cov = lookup("vision_tracker.kf.predict_angle_cov");
+    config.vision_kf.meas_trans_cov = lookup("vision_tracker.kf.meas_trans_cov");
+    config.vision_kf.meas_angle_cov = lookup("vision_tracker.kf.meas_angle_cov");
+    config.vision_kf.delay_compensation = lookup("vision_tracker.kf.delay_compensation");
+    config.vision_kf.history_length = lookup("vision_tracker.kf.history_length");
+    config.distance_fusion.enabled = lookup("distance_sensor.fusion.enabled");
+    config.distance_fusion.max_range = lookup("distance_sensor.fusion.max_range");
+    config.distance_fusion.axis = lookup("distance_sensor.fusion.axis");
+    config.distance_fusion.origin = lookup("distance_sensor.fusion.origin");
+    config.distance_fusion.sign = lookup("distance_sensor.fusion.sign");
+    config.distance_fusion.meas_cov = lookup("distance_sensor.fusion.meas_cov");
+    config.generation = 0;
+    return config;
+}
+
+std::shared_ptr<const ConfigSnapshot> ConfigSnapshot::current()
+{
+    std::shared_ptr<const ConfigSnapshot> snapshot = std::atomic_load(&g_snapshot);
+    if (!snapshot)
+    {
+        reload();
+        snapshot = std::atomic_load(&g_snapshot);
+    }
+    return snapshot;
+}
+
+void ConfigSnapshot::reload()
+{
+    // Staged params are already in cfg, so they go in with everything else
+    {
+        std::lock_guard<std::mutex> lock(g_param_mutex);
+        g_pending.reset();
+        g_staged.clear();
+    }
+    ConfigSnapshot config = fromConfig();
+    config.generation = ++g_generation;
+    std::shared_ptr<const ConfigSnapshot> snapshot = std::make_shared<const ConfigSnapshot>(config);
+    std::atomic_store(&g_snapshot, snapshot);
+}
+
+bool ConfigSnapshot::validate(std::string* error) const
+{
+    if(!checkAxis(translation, error) || !checkAxis(rotation, error)) return false;
+    if(limit_max_fraction <= 0 || limit_max_fraction > 1)
+    {
+        *error = "limit_max_fraction must be in (0, 1]";
+        return false;
+    }
+    return checkPositive(controller_frequency, "controller_frequency", error) &&
+           checkPositive(driver_correction_period_s, "correction_frequency", error) &&
+           checkPositive(min_dist_limit, "min_dist_limit", error) &&
+           checkPositive(static_cast<float>(solver.num_loops), "solver_max_loops", error) &&
+           checkPositive(static_cast<float>(vision_kf.history_length), "history_length", error) &&
+           (!approach_mpc.enabled || (checkPositive(approach_mpc.dt, "approach_mpc.dt", error) &&
+                                      checkPositive(approach_mpc.rho, "approach_mpc.rho", error) &&
+                                      checkPositive(static_cast<float>(approach_mpc.iterations), "approach_mpc.iterations", error))) &&
+           // The approach MPC bounds the wheels with these whether or not coupled planning is on
+           (!(wheel_limits.enabled || approach_mpc.enabled) || (checkPositive(wheel_limits.base_radius, "base_radius", error) &&
+                                                                checkPositive(wheel_limits.max_vel, "wheel_max_vel", error) &&
+                                                                checkPositive(wheel_limits.max_acc, "wheel_max_acc", error)));
+}
+
+bool ConfigSnapshot::setParam(const std::string& path, double value, std::string* error)
+{
+    std::lock_guard<std::mutex> lock(g_param_mutex);
+    if(!isTunable(path))
+    {
+        *error = "not_tunable";
+        return false;
+    }
+    libconfig::Setting& setting = cfg.lookup(path);
+    const double old_value = settingValue(setting);
+    if(!setSettingValue(setting, value))
+    {
+        *error = "bad_value";
+        return false;
+    }
+
+    // The whole snapshot is checked, not just this setting, since some limits only make sense together
+    std::shared_ptr<const ConfigSnapshot> pending;
+    std::string reason;
+    try
+    {
+        ConfigSnapshot config = fromConfig();
+        if(config.validate(&reason)) pending = std::make_shared<const ConfigSnapshot>(config);
+    }
+    catch (const libconfig::SettingException& e)
+    {
+        reason = e.what();
+    }
+    if(!pending)
+    {
+        setSettingValue(setting, old_value);
+        PLOGW << "Rejected " << path << " = " << value << ": " << reason;
+        *error = "invalid";
+        return false;
+    }
+
+    auto staged = std::find_if(g_staged.begin(), g_staged.end(), [&path](const StagedParam& p) { return p.path == path; });
+    if(staged == g_staged.end()) g_staged.push_back({path, old_value, value});
+    else staged->value = value;
+    g_pending = pending;
+    PLOGI << "Staged " << path << " = " << value << ", applied at the next move";
+    return true;
+}
+
+bool ConfigSnapshot::getParam(const std::string& path, double* value, bool* pending)
+{
+    std::lock_guard<std::mutex> lock(g_param_mutex);
+    if(!isTunable(path)) return false;
+    *value = settingValue(cfg.lookup(path));
+    *pending = std::any_of(g_staged.begin(), g_staged.end(), [&path](const StagedParam& p) { return p.path == path; });
+    return true;
+}
+
+bool ConfigSnapshot::hasPendingParams()
+{
+    std::lock_guard<std::mutex> lock(g_param_mutex);
+    return g_pending != nullptr;
+}
+
+void ConfigSnapshot::applyPendingParams()
+{
+    std::lock_guard<std::mutex> lock(g_param_mutex);
+    if(!g_pending) return;
+    std::shared_ptr<ConfigSnapshot> snapshot = std::make_shared<ConfigSnapshot>(*g_pending);
+    snapshot->generation = ++g_generation;
+    std::atomic_store(&g_snapshot, std::shared_ptr<const ConfigSnapshot>(snapshot));
+
+    std::string diff;
+    for (const StagedParam& param : g_staged)
+    {
+        if(param.value == param.applied_value) continue;
+        diff += "\n    " + param.path + ": " + std::to_string(param.applied_value) + " -> " + std::to_string(param.value);
+    }
+    PLOGI << "Applied tuned config, generation " << snapshot->generation << (diff.empty() ? " (no changes)" : diff);
+    g_pending.reset();
+    g_staged.clear();
+}
@@ -0,0 +1,127 @@
+#ifndef ConfigSnapshot_h
+#define ConfigSnapshot_h
+
+#include <memory>
+#include <string>
+#include "ApproachMpc.h"
+#include "SmoothTrajectoryGenerator.h"
+#include "utils.h"
+
+// Typed copy of the config values read every time a move starts. Walking the libconfig tree with string
+// paths was a noticeable part of motion start latency, so these are parsed once into plain fields and
+// shared as an immutable snapshot. reload() builds a new snapshot and swaps it in atomically, holders of
+// the old one keep a consistent view until they ask for the current one again.
+//
+// Anything read only once at startup should keep using cfg.lookup directly.
+
+struct AxisConfig
+{
+    DynamicLimits coarse;
+    DynamicLimits fine;
+    DynamicLimits vision;
+    PositionController::Gains gains;
+    PositionController::Gains gains_vision;
+    float position_threshold_coarse;
+    float position_threshold_fine;
+    float position_threshold_vision;
+    float velocity_threshold_coarse;
+    float velocity_threshold_fine;
+    float velocity_threshold_vision;
+
+    // FINE and SLOW share the fine limits
+    const DynamicLimits& limits(LIMITS_MODE mode) const;
+};
+
+// Per LIMITS_MODE dwell before a move counts as done, see SettleDetector
+struct SettleConfig
+{
+    float dwell_coarse;
+    float dwell_fine;
+    float dwell_vision;
+    float confident_dwell_coarse;
+    float confident_dwell_fine;
+    float confident_dwell_vision;
+    float confidence_sigma;
+
+    // FINE and SLOW share the fine dwells
+    SettleDetector::Params params(LIMITS_MODE mode) const;
+};
+
+struct VisionFilterConfig
+{
+    float predict_trans_cov;
+    float predict_angle_cov;
+    float meas_trans_cov;
+    float meas_angle_cov;
+    bool delay_compensation;
+    int history_length;
+};
+
+// How vision moves use the range sensor, see distance_sensor in the config
+struct DistanceFusionConfig
+{
+    bool enabled;
+    float max_range;    // Only readings closer than this are fused
+    int axis;           // Vision pose axis the sensor looks along, 0 for x and 1 for y
+    float origin;       // That coordinate of the robot when the range is zero
+    float sign;         // +1 if the coordinate grows with the range, -1 if it shrinks
+    float meas_cov;
+};
+
+struct ConfigSnapshot
+{
+    AxisConfig translation;
+    AxisConfig rotation;
+    float limit_max_fraction;
+    int controller_frequency;
+    float driver_correction_period_s;
+    bool stop_fast_planned;
+    bool log_motion_csv;
+    SettleConfig settle;
+    ApproachMpcParams approach_mpc;
+
+    SolverParameters solver;
+    PathBlendParameters blend;
+    float min_dist_limit;
+    // Unscaled by limit_max_fraction
+    WheelLimits wheel_limits;
+    float wheel_check_dt;
+
+    // Only coarse moves are planned coupled, the slower modes are limited by how well they track rather than
+    // by the wheels
+    bool coupledPlanning(LIMITS_MODE mode) const { return wheel_limits.enabled && mode == LIMITS_MODE::COARSE; };
+
+    VisionFilterConfig vision_kf;
+    DistanceFusionConfig distance_fusion;
+
+    // Increments with every reload, lets caches of anything derived from these values notice a change
+    uint32_t generation;
+
+    // Parses the global cfg, throws the libconfig exception if a setting is missing
+    static ConfigSnapshot fromConfig();
+
+    // Snapshot in use, parsed from cfg on first use if reload() hasn't been called yet
+    static std::shared_ptr<const ConfigSnapshot> current();
+
+    // Re-parses cfg and swaps the result in, safe to call while other threads hold or fetch snapshots
+    static void reload();
+
+    // False with the reason in error if a value can't work, like a zero limit or frequency
+    bool validate(std::string* error) const;
+
+    // Live tuning, for set_param and get_param. Only settings the snapshot is parsed from can be set. setParam
+    // writes value to cfg and builds the snapshot it would give, and if that doesn't validate the setting is put
+    // back and error says why. Staged changes take effect together when applyPendingParams is called, which the
+    // robot does between moves so a move never sees its limits or gains change part way through.
+    static bool setParam(const std::string& path, double value, std::string* error);
+
+    // Value in cfg including staged changes, pending says whether it is staged. False if path isn't tunable.
+    static bool getParam(const std::string& path, double* value, bool* pending);
+
+    static bool hasPendingParams();
+
+    // Swaps in the snapshot from the staged changes and logs what changed
+    static void applyPendingParams();
+};
+
+#endif //ConfigSnapshot_h
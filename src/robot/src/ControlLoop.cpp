@@ -0,0 +1,420 @@
+#include "ControlLoop.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <plog/Log.h>
+
+#include "constants.h"
+#include "RealtimeMemory.h"
+#include "SystemHealth.h"
+#include "Trace.h"
+#include "camera_tracker/CameraTrackerFactory.h"
+
+namespace
+{
+    // Upper bounds in us of all but the last wake up lateness bucket
+    const int JITTER_BUCKET_BOUNDS_US[CONTROL_JITTER_NUM_BUCKETS - 1] = {50, 100, 250, 500, 1000};
+
+    void addNs(struct timespec* ts, long ns)
+    {
+        ts->tv_nsec += ns;
+        while (ts->tv_nsec >= 1000000000L)
+        {
+            ts->tv_nsec -= 1000000000L;
+            ts->tv_sec++;
+        }
+    }
+
+    int64_t diffUs(const struct timespec& a, const struct timespec& b)
+    {
+        return (static_cast<int64_t>(a.tv_sec) - b.tv_sec) * 1000000 + (a.tv_nsec - b.tv_nsec) / 1000;
+    }
+}
+
+ControlLoop::ControlLoop(StatusUpdater& statusUpdater)
+: statusUpdater_(statusUpdater),
+  controlStatus_(),
+  threaded_(cfg.lookup("motion.control_thread.enabled")),
+  controller_(threaded_ ? controlStatus_ : statusUpdater_),
+  period_ns_(1000000000L / static_cast<int>(cfg.lookup("motion.controller_frequency"))),
+  cpu_(cfg.lookup("motion.control_thread.cpu")),
+  priority_(cfg.lookup("motion.control_thread.priority")),
+  stack_prefault_bytes_(cfg.lookup("memory.lock") ? 1024 * static_cast<int>(cfg.lookup("memory.stack_prefault_kb")) : 0),
+  posted_cmd_seq_(0),
+  last_motion_cmd_seq_(0),
+  last_error_count_(0),
+  state_(),
+  applied_cmd_seq_(0),
+  error_count_(0),
+  cycle_(0),
+  jitter_sum_us_(0),
+  jitter_samples_(0),
+  stats_(),
+  pending_path_(),
+  pose_ready_fd_(threaded_ ? CameraTrackerFactory::getFactoryInstance()->get_camera_tracker()->poseReadyFd() : -1),
+  cmd_queue_(),
+  state_mailbox_(),
+  running_(false),
+  thread_()
+{
+    pending_path_.reserve(MAX_PATH_WAYPOINTS);
+    if(threaded_)
+    {
+        stats_.active = true;
+        publishState();
+        running_ = true;
+        thread_ = std::thread(&ControlLoop::threadLoop, this);
+        PLOGI.printf("Started control thread at %i Hz", static_cast<int>(1000000000L / period_ns_));
+    }
+}
+
+ControlLoop::~ControlLoop()
+{
+    running_ = false;
+    if(thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void ControlLoop::moveToPosition(float x, float y, float a)
+{
+    if(!threaded_) controller_.moveToPosition(x, y, a);
+    else postMotion(ControlCommand::TYPE::MOVE, x, y, a);
+}
+
+void ControlLoop::moveToPositionRelative(float dx_local, float dy_local, float da_local)
+{
+    if(!threaded_) controller_.moveToPositionRelative(dx_local, dy_local, da_local);
+    else postMotion(ControlCommand::TYPE::MOVE_REL, dx_local, dy_local, da_local);
+}
+
+void ControlLoop::moveToPositionRelativeSlow(float dx_local, float dy_local, float da_local)
+{
+    if(!threaded_) controller_.moveToPositionRelativeSlow(dx_local, dy_local, da_local);
+    else postMotion(ControlCommand::TYPE::MOVE_REL_SLOW, dx_local, dy_local, da_local);
+}
+
+void ControlLoop::moveToPositionFine(float x, float y, float a)
+{
+    if(!threaded_) controller_.moveToPositionFine(x, y, a);
+    else postMotion(ControlCommand::TYPE::MOVE_FINE, x, y, a);
+}
+
+void ControlLoop::moveConstVel(float vx , float vy, float va, float t)
+{
+    if(!threaded_) controller_.moveConstVel(vx, vy, va, t);
+    else postMotion(ControlCommand::TYPE::MOVE_CONST_VEL, vx, vy, va, t);
+}
+
+void ControlLoop::moveWithVision(float x, float y, float a)
+{
+    if(!threaded_) controller_.moveWithVision(x, y, a);
+    else postMotion(ControlCommand::TYPE::MOVE_WITH_VISION, x, y, a);
+}
+
+void ControlLoop::moveAlongPath(const std::vector<Point>& waypoints)
+{
+    if(!threaded_)
+    {
+        controller_.moveAlongPath(waypoints);
+        return;
+    }
+    // Commands are fixed size, so the path goes over one waypoint at a time
+    for(const Point& waypoint : waypoints)
+    {
+        post(ControlCommand::TYPE::PATH_WAYPOINT, waypoint.x, waypoint.y, waypoint.a);
+    }
+    postMotion(ControlCommand::TYPE::MOVE_PATH, waypoints.size(), 0, 0);
+}
+
+void ControlLoop::updateGoal(float x, float y, float a)
+{
+    // Doesn't start a move, so the running flag is left alone
+    if(!threaded_) controller_.updateGoal(x, y, a);
+    else post(ControlCommand::TYPE::UPDATE_GOAL, x, y, a);
+}
+
+void ControlLoop::stopFast()
+{
+    if(!threaded_) controller_.stopFast();
+    else postMotion(ControlCommand::TYPE::STOP_FAST, 0, 0, 0);
+}
+
+void ControlLoop::estop()
+{
+    if(!threaded_) controller_.estop();
+    else post(ControlCommand::TYPE::ESTOP, 0, 0, 0);
+}
+
+void ControlLoop::inputPosition(float x, float y, float a)
+{
+    inputPosition(x, y, a, ClockFactory::getFactoryInstance()->get_clock()->now());
+}
+
+void ControlLoop::inputPosition(float x, float y, float a, ClockTimePoint measured_time, float trans_cov, float angle_cov)
+{
+    if(!threaded_) controller_.inputPosition(x, y, a, measured_time, trans_cov, angle_cov);
+    else post(ControlCommand::TYPE::INPUT_POSITION, x, y, a, 0, measured_time, trans_cov, angle_cov);
+}
+
+void ControlLoop::forceSetPosition(float x, float y, float a)
+{
+    if(!threaded_) controller_.forceSetPosition(x, y, a);
+    else post(ControlCommand::TYPE::FORCE_SET_POSITION, x, y, a);
+}
+
+bool ControlLoop::isTrajectoryRunning()
+{
+    if(!threaded_) return controller_.isTrajectoryRunning();
+    // A motion command that hasn't been picked up yet counts as running
+    return state_.traj_running || state_.applied_cmd_seq < last_motion_cmd_seq_;
+}
+
+Point ControlLoop::getCurrentPosition()
+{
+    if(!threaded_) return controller_.getCurrentPosition();
+    return state_.position;
+}
+
+void ControlLoop::post(ControlCommand::TYPE type, float x, float y, float a, float t, ClockTimePoint time,
+                       float trans_cov, float angle_cov)
+{
+    ControlCommand cmd = {type, ++posted_cmd_seq_, x, y, a, t, time, trans_cov, angle_cov};
+    if(!cmd_queue_.push(cmd))
+    {
+        PLOGE.printf("Control command queue full, dropping command %i", static_cast<int>(type));
+    }
+}
+
+void ControlLoop::postMotion(ControlCommand::TYPE type, float x, float y, float a, float t)
+{
+    post(type, x, y, a, t);
+    last_motion_cmd_seq_ = posted_cmd_seq_;
+}
+
+void ControlLoop::update()
+{
+    if(!threaded_)
+    {
+        TRACE_SCOPE(TRACE_POINT::CONTROLLER);
+        controller_.update();
+        return;
+    }
+
+    ControlState new_state = state_mailbox_.read();
+    if(new_state.cycle == state_.cycle) { return; }
+    state_ = new_state;
+
+    if(state_.error_count != last_error_count_)
+    {
+        last_error_count_ = state_.error_count;
+        statusUpdater_.setErrorStatus();
+    }
+
+    const StatusUpdater::Status& s = state_.status;
+    statusUpdater_.updatePosition(s.pos_x, s.pos_y, s.pos_a);
+    statusUpdater_.updateVelocity(s.vel_x, s.vel_y, s.vel_a);
+    statusUpdater_.updateControlLoopTime(s.controller_loop_ms);
+    statusUpdater_.updateDriverLoopTime(s.driver_loop_mean_us, s.driver_loop_max_us);
+    statusUpdater_.updateLocalizationMetrics(s.localization_metrics);
+    statusUpdater_.updateVisionControllerPose({s.vision_x, s.vision_y, s.vision_a});
+    statusUpdater_.updateLastMarvelmindPose({s.last_mm_x, s.last_mm_y, s.last_mm_a}, s.last_mm_used);
+    statusUpdater_.updateControlThreadStats(state_.stats);
+    statusUpdater_.updateTrajectoryCacheStats(s.trajectory_cache_stats);
+    statusUpdater_.updateTrajTimeRemaining(s.traj_time_remaining);
+    statusUpdater_.updateSettleTime(s.settle_time);
+    statusUpdater_.updatePlanTiming(s.plan_wait_ms, s.plan_time_ms);
+}
+
+void ControlLoop::threadLoop()
+{
+    configureRealtime();
+    SystemHealthMonitor::registerThread(SYSTEM_THREAD::CONTROL);
+    AllocationCounter allocs;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while(running_)
+    {
+        addNs(&deadline, period_ns_);
+        bool woken_for_pose = waitForCycle(deadline);
+
+        // A camera pose runs the cycle early and the following cycles are timed from it
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(woken_for_pose) deadline = now;
+        else recordWakeLatency(diffUs(now, deadline));
+
+        ControlCommand cmd;
+        while(cmd_queue_.pop(&cmd))
+        {
+            applyCommand(cmd);
+        }
+        // The controller picks up a retuned frequency when a move starts, the cycle follows it from the next deadline
+        period_ns_ = 1000000000L / controller_.getControllerFrequency();
+        {
+            TRACE_SCOPE(TRACE_POINT::CONTROLLER);
+            controller_.updateOnce();
+        }
+        allocs.markLoop();
+        stats_.allocs_max = allocs.windowMax();
+        stats_.allocs_total = static_cast<uint32_t>(allocs.total());
+        publishState();
+
+        // If the cycle ran past the next deadline, skip the missed cycles instead of trying to catch up
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(diffUs(now, deadline) * 1000 > period_ns_)
+        {
+            stats_.overruns++;
+            deadline = now;
+        }
+    }
+}
+
+bool ControlLoop::waitForCycle(const struct timespec& deadline)
+{
+    if(pose_ready_fd_ < 0)
+    {
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {}
+        return false;
+    }
+
+    pollfd pfd = {pose_ready_fd_, POLLIN, 0};
+    while(true)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t remaining_us = diffUs(deadline, now);
+        if(remaining_us <= 0) return false;
+        struct timespec timeout;
+        timeout.tv_sec = remaining_us / 1000000;
+        timeout.tv_nsec = (remaining_us % 1000000) * 1000;
+        if(ppoll(&pfd, 1, &timeout, NULL) > 0)
+        {
+            uint64_t count;
+            ssize_t n = read(pose_ready_fd_, &count, sizeof(count));
+            (void) n;
+            // Poses also arrive outside of vision moves, those wait for the regular cycle
+            if(controller_.visionMeasurementPending()) return true;
+        }
+    }
+}
+
+void ControlLoop::configureRealtime()
+{
+    if(cpu_ >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu_, &cpuset);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if(rc != 0) PLOGW.printf("Could not pin control thread to cpu %i: %s", cpu_, strerror(rc));
+    }
+    if(priority_ > 0)
+    {
+        struct sched_param param;
+        param.sched_priority = priority_;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(rc != 0) PLOGW.printf("Could not set SCHED_FIFO priority %i for control thread: %s", priority_, strerror(rc));
+    }
+    // With the process memory locked the stack stays resident once touched, so no cycle has to fault it in
+    if(stack_prefault_bytes_ > 0) RealtimeMemory::prefaultStack(stack_prefault_bytes_);
+}
+
+void ControlLoop::applyCommand(const ControlCommand& cmd)
+{
+    switch (cmd.type)
+    {
+        case ControlCommand::TYPE::MOVE:
+            controller_.moveToPosition(cmd.x, cmd.y, cmd.a);
+            break;
+        case ControlCommand::TYPE::MOVE_REL:
+            controller_.moveToPositionRelative(cmd.x, cmd.y, cmd.a);
+            break;
+        case ControlCommand::TYPE::MOVE_REL_SLOW:
+            controller_.moveToPositionRelativeSlow(cmd.x, cmd.y, cmd.a);
+            break;
+        case ControlCommand::TYPE::MOVE_FINE:
+            controller_.moveToPositionFine(cmd.x, cmd.y, cmd.a);
+            break;
+        case ControlCommand::TYPE::MOVE_CONST_VEL:
+            controller_.moveConstVel(cmd.x, cmd.y, cmd.a, cmd.t);
+            break;
+        case ControlCommand::TYPE::MOVE_WITH_VISION:
+            controller_.moveWithVision(cmd.x, cmd.y, cmd.a);
+            break;
+        case ControlCommand::TYPE::UPDATE_GOAL:
+            controller_.updateGoal(cmd.x, cmd.y, cmd.a);
+            break;
+        case ControlCommand::TYPE::STOP_FAST:
+            controller_.stopFast();
+            break;
+        case ControlCommand::TYPE::ESTOP:
+            controller_.estop();
+            break;
+        case ControlCommand::TYPE::INPUT_POSITION:
+            controller_.inputPosition(cmd.x, cmd.y, cmd.a, cmd.time, cmd.trans_cov, cmd.angle_cov);
+            break;
+        case ControlCommand::TYPE::FORCE_SET_POSITION:
+            controller_.forceSetPosition(cmd.x, cmd.y, cmd.a);
+            break;
+        case ControlCommand::TYPE::PATH_WAYPOINT:
+            if(pending_path_.size() < MAX_PATH_WAYPOINTS) pending_path_.push_back({cmd.x, cmd.y, cmd.a});
+            break;
+        case ControlCommand::TYPE::MOVE_PATH:
+            // A dropped waypoint would silently change the path, so refuse to run it
+            if(pending_path_.size() == static_cast<size_t>(cmd.x))
+            {
+                controller_.moveAlongPath(pending_path_);
+            }
+            else
+            {
+                PLOGE.printf("Expected %i path waypoints but got %zu", static_cast<int>(cmd.x), pending_path_.size());
+                controlStatus_.setErrorStatus();
+            }
+            pending_path_.clear();
+            break;
+    }
+    applied_cmd_seq_ = cmd.seq;
+}
+
+void ControlLoop::recordWakeLatency(int64_t late_us)
+{
+    if(late_us < 0) late_us = 0;
+    int bucket = 0;
+    while(bucket < CONTROL_JITTER_NUM_BUCKETS - 1 && late_us >= JITTER_BUCKET_BOUNDS_US[bucket])
+    {
+        bucket++;
+    }
+    stats_.jitter_hist[bucket]++;
+    if(late_us > stats_.jitter_max_us) stats_.jitter_max_us = static_cast<int>(late_us);
+    jitter_sum_us_ += late_us;
+    jitter_samples_++;
+    stats_.jitter_avg_us = static_cast<int>(jitter_sum_us_ / jitter_samples_);
+}
+
+void ControlLoop::publishState()
+{
+    // Errors are latched in the shared status by the main loop, so just count them here
+    if(controlStatus_.getErrorStatus())
+    {
+        controlStatus_.clearErrorStatus();
+        error_count_++;
+    }
+
+    ControlState state;
+    state.cycle = ++cycle_;
+    state.applied_cmd_seq = applied_cmd_seq_;
+    state.error_count = error_count_;
+    state.traj_running = controller_.isTrajectoryRunning();
+    state.position = controller_.getCurrentPosition();
+    state.status = controlStatus_.getStatus();
+    state.stats = stats_;
+    state_mailbox_.write(state);
+}
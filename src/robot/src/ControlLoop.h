@@ -0,0 +1,146 @@
+#ifndef ControlLoop_h
+#define ControlLoop_h
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Mailbox.h"
+#include "RobotController.h"
+#include "StatusUpdater.h"
+#include "utils.h"
+
+#define CONTROL_COMMAND_QUEUE_SIZE 32
+
+// Command passed from the main loop to the control thread
+struct ControlCommand
+{
+    enum class TYPE : uint8_t
+    {
+        MOVE,
+        MOVE_REL,
+        MOVE_REL_SLOW,
+        MOVE_FINE,
+        MOVE_CONST_VEL,
+        MOVE_WITH_VISION,
+        STOP_FAST,
+        ESTOP,
+        INPUT_POSITION,
+        FORCE_SET_POSITION,
+        PATH_WAYPOINT,      // Appends x, y, a to the pending path
+        MOVE_PATH,          // Starts the pending path, x holds the number of waypoints expected
+        UPDATE_GOAL,
+    };
+
+    TYPE type;
+    uint32_t seq;
+    float x;
+    float y;
+    float a;
+    float t;
+    ClockTimePoint time;    // Measurement time for INPUT_POSITION
+    float trans_cov;        // Measurement covariance for INPUT_POSITION
+    float angle_cov;
+};
+
+// Snapshot published by the control thread at the end of every cycle
+struct ControlState
+{
+    uint32_t cycle = 0;             // Incremented every cycle so readers can tell if anything changed
+    uint32_t applied_cmd_seq = 0;   // Sequence number of the last command applied to the controller
+    uint32_t error_count = 0;       // Incremented each time the controller reports an error
+    bool traj_running = false;
+    Point position;
+    StatusUpdater::Status status;   // Status fields written by the controller
+    ControlThreadStats stats;
+};
+
+// Owns the RobotController and runs it either inline from the main loop (the default) or on a
+// dedicated real-time thread so that networking, logging and vision work in the main loop can't
+// add jitter to the motor commands. In threaded mode the thread owns the controller, odometry and
+// motor serial I/O. Commands reach it through a lock-free queue and its state comes back through a
+// seqlocked mailbox that the main loop copies into the shared StatusUpdater.
+class ControlLoop
+{
+  public:
+
+    ControlLoop(StatusUpdater& statusUpdater);
+
+    ~ControlLoop();
+
+    // Same interface as RobotController. In threaded mode these are queued and applied by the control thread.
+    void moveToPosition(float x, float y, float a);
+    void moveToPositionRelative(float dx_local, float dy_local, float da_local);
+    void moveToPositionRelativeSlow(float dx_local, float dy_local, float da_local);
+    void moveToPositionFine(float x, float y, float a);
+    void moveConstVel(float vx , float vy, float va, float t);
+    void moveWithVision(float x, float y, float a);
+    void moveAlongPath(const std::vector<Point>& waypoints);
+    void updateGoal(float x, float y, float a);
+    void stopFast();
+    void estop();
+    void inputPosition(float x, float y, float a);
+    void inputPosition(float x, float y, float a, ClockTimePoint measured_time, float trans_cov = 0, float angle_cov = 0);
+    void forceSetPosition(float x, float y, float a);
+
+    // Called from the main loop. Runs the controller inline, or pulls the latest state from the control thread.
+    void update();
+
+    // In threaded mode this stays true until the control thread has applied the last motion command
+    bool isTrajectoryRunning();
+
+    Point getCurrentPosition();
+
+    bool isThreaded() const { return threaded_; };
+
+    // Rate limiter the main loop needs to wake up for, or nullptr if the controller runs on its own thread
+    RateController* getControllerRate() { return threaded_ ? nullptr : controller_.getControllerRate(); };
+
+  private:
+
+    void post(ControlCommand::TYPE type, float x, float y, float a, float t = 0, ClockTimePoint time = ClockTimePoint(),
+              float trans_cov = 0, float angle_cov = 0);
+    void postMotion(ControlCommand::TYPE type, float x, float y, float a, float t = 0);
+
+    // Control thread methods
+    void threadLoop();
+    void configureRealtime();
+    // Sleeps until deadline, or until the camera tracker has a pose a vision move hasn't used yet. Returns
+    // true if woken for a pose.
+    bool waitForCycle(const struct timespec& deadline);
+    void applyCommand(const ControlCommand& cmd);
+    void recordWakeLatency(int64_t late_us);
+    void publishState();
+
+    StatusUpdater& statusUpdater_;         // Shared status updater, only touched from the main loop
+    StatusUpdater controlStatus_;          // Status updater written by the controller in threaded mode
+    bool threaded_;
+    RobotController controller_;
+    long period_ns_;
+    int cpu_;
+    int priority_;
+    size_t stack_prefault_bytes_;         // Touched by the control thread before its first cycle, 0 to skip
+
+    // Main loop side
+    uint32_t posted_cmd_seq_;
+    uint32_t last_motion_cmd_seq_;
+    uint32_t last_error_count_;
+    ControlState state_;
+
+    // Control thread side
+    uint32_t applied_cmd_seq_;
+    uint32_t error_count_;
+    uint32_t cycle_;
+    uint64_t jitter_sum_us_;
+    uint64_t jitter_samples_;
+    ControlThreadStats stats_;
+    std::vector<Point> pending_path_;     // Waypoints received since the last MOVE_PATH
+    int pose_ready_fd_;                   // Camera tracker pose notification, -1 if the control thread shouldn't wait on it
+
+    SpscQueue<ControlCommand, CONTROL_COMMAND_QUEUE_SIZE> cmd_queue_;
+    LatestValueMailbox<ControlState> state_mailbox_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "DelayCompensatedFilter.h"
+
+DelayCompensatedFilter::DelayCompensatedFilter(const KalmanFilter3& kf, int history_length, bool predict_zero_input)
+: kf_(kf),
+  Q_(kf.processCovariance()),
+  history_(std::max(history_length, 1)),
+  head_(0),
+  count_(0),
+  last_replay_count_(0),
+  predict_zero_input_(predict_zero_input)
+{}
+
+void DelayCompensatedFilter::reset(const KalmanFilter3& kf, int history_length)
+{
+    kf_ = kf;
+    Q_ = kf.processCovariance();
+    history_.resize(std::max(history_length, 1));
+    head_ = 0;
+    count_ = 0;
+    last_replay_count_ = 0;
+}
+
+void DelayCompensatedFilter::applyPrediction(const Eigen::Vector3f& u, const Eigen::Matrix3f& Q)
+{
+    if(predict_zero_input_ || u.norm() > 0) kf_.predict(u, Q);
+}
+
+void DelayCompensatedFilter::setCovariance(const Eigen::Matrix3f& P)
+{
+    kf_.update_covariance(P);
+    if(count_ > 0) entry(count_ - 1).P = P;
+}
+
+void DelayCompensatedFilter::predict(const Eigen::Vector3f& u, ClockTimePoint time)
+{
+    predict(u, Q_, time);
+}
+
+void DelayCompensatedFilter::predict(const Eigen::Vector3f& u, const Eigen::Matrix3f& Q, ClockTimePoint time)
+{
+    applyPrediction(u, Q);
+
+    if(count_ == static_cast<int>(history_.size()))
+    {
+        head_ = (head_ + 1) % history_.size();
+        count_--;
+    }
+    HistoryEntry& e = entry(count_);
+    e.time = time;
+    e.u = u;
+    e.Q = Q;
+    e.x = kf_.state();
+    e.P = kf_.covariance();
+    count_++;
+}
+
+bool DelayCompensatedFilter::update(const Eigen::Vector3f& y, ClockTimePoint time)
+{
+    return applyUpdate(y, nullptr, time);
+}
+
+bool DelayCompensatedFilter::update(const Eigen::Vector3f& y, const Eigen::Matrix3f& R, ClockTimePoint time)
+{
+    return applyUpdate(y, &R, time);
+}
+
+int DelayCompensatedFilter::findBase(ClockTimePoint time) const
+{
+    int base = count_ - 1;
+    while(base >= 0 && entry(base).time > time)
+    {
+        base--;
+    }
+    return base;
+}
+
+float DelayCompensatedFilter::innovationNis(const Eigen::Vector3f& y, const Eigen::Matrix3f& R, ClockTimePoint time) const
+{
+    // Measurements are of the pose itself, so the innovation covariance is just P + R
+    const int base = findBase(time);
+    const bool current = base < 0 || base == count_ - 1;
+    const Eigen::Vector3f innovation = y - (current ? kf_.state() : entry(base).x);
+    const Eigen::Matrix3f S = (current ? kf_.covariance() : entry(base).P) + R;
+    return innovation.dot(S.inverse() * innovation);
+}
+
+bool DelayCompensatedFilter::applyUpdate(const Eigen::Vector3f& y, const Eigen::Matrix3f* R, ClockTimePoint time)
+{
+    last_replay_count_ = 0;
+    auto kfUpdate = [&]() { if(R) kf_.update(y, *R); else kf_.update(y); };
+
+    // Find the newest prediction at or before the measurement
+    const int base = findBase(time);
+    if(base < 0 && count_ > 0)
+    {
+        kfUpdate();
+        return false;
+    }
+    if(base == count_ - 1 || count_ == 0)
+    {
+        // Measurement is newer than every prediction, nothing to replay
+        kfUpdate();
+        if(count_ > 0)
+        {
+            entry(count_ - 1).x = kf_.state();
+            entry(count_ - 1).P = kf_.covariance();
+        }
+        return true;
+    }
+
+    // Rewind, apply the measurement where it belongs, then replay the newer predictions
+    kf_.update_state(entry(base).x);
+    kf_.update_covariance(entry(base).P);
+    kfUpdate();
+    entry(base).x = kf_.state();
+    entry(base).P = kf_.covariance();
+    for(int i = base + 1; i < count_; i++)
+    {
+        HistoryEntry& e = entry(i);
+        applyPrediction(e.u, e.Q);
+        e.x = kf_.state();
+        e.P = kf_.covariance();
+        last_replay_count_++;
+    }
+    return true;
+}
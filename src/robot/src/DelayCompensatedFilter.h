@@ -0,0 +1,82 @@
+#ifndef DelayCompensatedFilter_h
+#define DelayCompensatedFilter_h
+
+#include "KalmanFilter.h"
+#include "utils.h"
+#include <vector>
+
+// Wraps a pose KalmanFilter3 to apply measurements at the time they were taken instead of when they arrive.
+// Every prediction is kept in a short history with the filter state after it. A delayed measurement rewinds
+// the filter to the last prediction at or before the measurement time, applies the update there, and then
+// replays the newer predictions on top.
+class DelayCompensatedFilter
+{
+  public:
+
+    // With predict_zero_input false, zero inputs are recorded but don't change the filter, so the covariance
+    // doesn't grow while standing still
+    DelayCompensatedFilter(const KalmanFilter3& kf, int history_length, bool predict_zero_input = false);
+
+    // Starts over from kf with an empty history, only allocates if history_length grew
+    void reset(const KalmanFilter3& kf, int history_length);
+
+    // Prediction step with input u at time
+    void predict(const Eigen::Vector3f& u, ClockTimePoint time);
+
+    // Same with a process covariance just for this step, kept so replays after a delayed update use it too
+    void predict(const Eigen::Vector3f& u, const Eigen::Matrix3f& Q, ClockTimePoint time);
+
+    // Update with measurement y taken at time. If time is older than the whole history the measurement
+    // is applied to the current state and false is returned.
+    bool update(const Eigen::Vector3f& y, ClockTimePoint time);
+
+    // Same with a measurement covariance just for this update
+    bool update(const Eigen::Vector3f& y, const Eigen::Matrix3f& R, ClockTimePoint time);
+
+    // Normalized innovation squared (squared Mahalanobis distance) of measurement y taken at time, against the
+    // estimate the update would be applied to. Chi-square distributed with 3 degrees of freedom for readings
+    // that agree with the filter. Doesn't change the filter.
+    float innovationNis(const Eigen::Vector3f& y, const Eigen::Matrix3f& R, ClockTimePoint time) const;
+
+    const Eigen::Vector3f& state() const { return kf_.state(); };
+
+    const Eigen::Matrix3f& covariance() const { return kf_.covariance(); };
+
+    // Overrides the current covariance, older history entries keep theirs
+    void setCovariance(const Eigen::Matrix3f& P);
+
+    // Number of predictions replayed by the last update
+    int lastReplayCount() const { return last_replay_count_; };
+
+  private:
+
+    struct HistoryEntry
+    {
+        ClockTimePoint time;
+        Eigen::Vector3f u;
+        Eigen::Matrix3f Q;
+        Eigen::Vector3f x;     // State after this prediction
+        Eigen::Matrix3f P;     // Covariance after this prediction
+    };
+
+    HistoryEntry& entry(int i) { return history_[(head_ + i) % history_.size()]; };
+    const HistoryEntry& entry(int i) const { return history_[(head_ + i) % history_.size()]; };
+
+    // Newest prediction at or before time, -1 if there is none
+    int findBase(ClockTimePoint time) const;
+
+    void applyPrediction(const Eigen::Vector3f& u, const Eigen::Matrix3f& Q);
+
+    // R of null uses the filter's own measurement covariance
+    bool applyUpdate(const Eigen::Vector3f& y, const Eigen::Matrix3f* R, ClockTimePoint time);
+
+    KalmanFilter3 kf_;
+    Eigen::Matrix3f Q_;        // Process covariance of kf, for predictions that don't bring their own
+    std::vector<HistoryEntry> history_;
+    int head_;                 // Oldest entry
+    int count_;
+    int last_replay_count_;
+    bool predict_zero_input_;
+};
+
+#endif //DelayCompensatedFilter_h
@@ -0,0 +1,86 @@
+#include "DistanceSensor.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <plog/Log.h>
+
+#include "serial/SerialCommsFactory.h"
+
+bool parseDistanceMsg(const std::string& msg, float* range)
+{
+    const char* start = msg.c_str();
+    char* end;
+    float value = strtof(start, &end);
+    if(end == start || *end != '\0') return false;
+    *range = value;
+    return true;
+}
+
+DistanceSensor::DistanceSensor()
+: serial_(SerialCommsFactory::getFactoryInstance()->get_serial_comms(CLEARCORE_USB)),
+  min_range_(cfg.lookup("distance_sensor.min_range")),
+  max_range_(cfg.lookup("distance_sensor.max_range")),
+  latency_s_(cfg.lookup("distance_sensor.latency")),
+  timeout_s_(cfg.lookup("distance_sensor.timeout")),
+  window_(),
+  window_size_(std::clamp(static_cast<int>(cfg.lookup("distance_sensor.median_window")), 1, DISTANCE_MEDIAN_MAX_WINDOW)),
+  next_(0),
+  count_(0),
+  reading_({0, ClockTimePoint(), false}),
+  bad_msgs_(0)
+{
+}
+
+void DistanceSensor::update()
+{
+    const ClockTimePoint now = ClockFactory::getFactoryInstance()->get_clock()->now();
+    const ClockTimePoint measured = now - std::chrono::duration_cast<ClockTimePoint::duration>(std::chrono::duration<float>(latency_s_));
+    for(std::string msg = serial_->rcv_distance(); !msg.empty(); msg = serial_->rcv_distance())
+    {
+        float range;
+        if(!parseDistanceMsg(msg, &range))
+        {
+            // Only the first few, a sensor sending garbage would flood the log
+            if(bad_msgs_++ < 10) PLOGW << "Ignoring distance message: " << msg;
+            continue;
+        }
+        addSample(range, measured);
+    }
+}
+
+void DistanceSensor::addSample(float range, ClockTimePoint time)
+{
+    if(range < min_range_ || range > max_range_)
+    {
+        reset();
+        return;
+    }
+
+    window_[next_] = {range, time};
+    next_ = (next_ + 1) % window_size_;
+    count_ = std::min(count_ + 1, window_size_);
+    if(count_ < window_size_) return;
+
+    // The window is only a handful of samples, partitioning a copy is cheaper than keeping it ordered
+    Sample sorted[DISTANCE_MEDIAN_MAX_WINDOW];
+    std::copy(window_, window_ + window_size_, sorted);
+    Sample* median = sorted + window_size_ / 2;
+    std::nth_element(sorted, median, sorted + window_size_, [](const Sample& a, const Sample& b) { return a.range < b.range; });
+    reading_ = {median->range, median->time, true};
+}
+
+DistanceReading DistanceSensor::getReading() const
+{
+    DistanceReading reading = reading_;
+    const ClockTimePoint now = ClockFactory::getFactoryInstance()->get_clock()->now();
+    const ClockTimePoint newest = window_[(next_ + window_size_ - 1) % window_size_].time;
+    if(count_ == 0 || std::chrono::duration<float>(now - newest).count() > timeout_s_) reading.ok = false;
+    return reading;
+}
+
+void DistanceSensor::reset()
+{
+    next_ = 0;
+    count_ = 0;
+    reading_.ok = false;
+}
@@ -0,0 +1,65 @@
+#ifndef DistanceSensor_h
+#define DistanceSensor_h
+
+#include <string>
+
+#include "constants.h"
+#include "utils.h"
+#include "serial/SerialCommsBase.h"
+
+// Filtered range from the sensor looking at the tiles in front of the robot
+struct DistanceReading
+{
+    float range;            // m
+    ClockTimePoint time;    // Estimated measurement time on the robot clock
+    bool ok;
+};
+
+// Parses the data of a "dist:<range in m>" message, returns false if it isn't a number
+bool parseDistanceMsg(const std::string& msg, float* range);
+
+// Reads the range sensor messages the motor driver forwards on the "dist:" serial channel. Ranges go
+// through a short median filter, which drops the single sample spikes these sensors give off edges and
+// dark surfaces. Readings outside the sensor's range mean nothing is in view and start the filter over,
+// so a reading is only ok once the whole window has seen the same surface.
+class DistanceSensor
+{
+  public:
+
+    DistanceSensor();
+
+    // Reads every message that arrived since the last call
+    void update();
+
+    // Latest filtered range, stamped with the time of the sample the median picked. Not ok before the
+    // window has filled or once the newest sample is older than the timeout.
+    DistanceReading getReading() const;
+
+    // Forgets all samples
+    void reset();
+
+    // Adds a range measured at time, used by update and for testing
+    void addSample(float range, ClockTimePoint time);
+
+  private:
+
+    struct Sample
+    {
+        float range;
+        ClockTimePoint time;
+    };
+
+    SerialCommsBase* serial_;
+    float min_range_;
+    float max_range_;
+    float latency_s_;           // From the sensor measuring to the message being read
+    float timeout_s_;
+    Sample window_[DISTANCE_MEDIAN_MAX_WINDOW];
+    int window_size_;
+    int next_;                  // Where the next sample goes
+    int count_;                 // Valid samples in the window
+    DistanceReading reading_;
+    uint32_t bad_msgs_;
+};
+
+#endif //DistanceSensor_h
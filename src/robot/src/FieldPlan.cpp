@@ -0,0 +1,228 @@
+#include "FieldPlan.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <plog/Log.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const uint32_t JOURNAL_MAGIC = 0x4E4C5046;    // "FPLN"
+
+    uint32_t checksumSteps(const FieldPlanStep* steps, int num_steps)
+    {
+        // FNV-1a, only there to catch a journal that was never completely written
+        uint32_t hash = 2166136261u;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(steps);
+        for (size_t i = 0; i < num_steps * sizeof(FieldPlanStep); i++)
+        {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    FieldPlanJournalData* mapJournal(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+        if(fd < 0)
+        {
+            PLOGE << "Could not open field plan journal " << path << ": " << strerror(errno);
+            return nullptr;
+        }
+        struct stat st;
+        if(fstat(fd, &st) < 0 || (static_cast<size_t>(st.st_size) != sizeof(FieldPlanJournalData) && ftruncate(fd, sizeof(FieldPlanJournalData)) < 0))
+        {
+            PLOGE << "Could not size field plan journal " << path << ": " << strerror(errno);
+            close(fd);
+            return nullptr;
+        }
+        void* addr = mmap(nullptr, sizeof(FieldPlanJournalData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(addr == MAP_FAILED)
+        {
+            PLOGE << "Could not map field plan journal " << path << ": " << strerror(errno);
+            return nullptr;
+        }
+        return static_cast<FieldPlanJournalData*>(addr);
+    }
+}
+
+bool isFieldPlanCmd(COMMAND cmd)
+{
+    switch (cmd)
+    {
+        case COMMAND::MOVE:
+        case COMMAND::MOVE_FINE:
+        case COMMAND::MOVE_FINE_STOP_VISION:
+        case COMMAND::MOVE_WITH_VISION:
+        case COMMAND::PLACE_TRAY:
+        case COMMAND::LOAD_TRAY:
+        case COMMAND::INITIALIZE_TRAY:
+        case COMMAND::WAIT_FOR_LOCALIZATION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+FieldPlanJournal::FieldPlanJournal(const std::string& path)
+: data_(nullptr),
+  persistent_(false)
+{
+    if(!path.empty())
+    {
+        data_ = mapJournal(path);
+        persistent_ = data_ != nullptr;
+    }
+    if(!data_)
+    {
+        // Zero filled, which reads as no journal
+        data_ = new FieldPlanJournalData();
+    }
+
+    if(!validate())
+    {
+        reset();
+        return;
+    }
+    if(getState() == FIELD_PLAN_STATE::UPLOADING)
+    {
+        // The rest of an upload cut short by a restart isn't coming
+        PLOGW.printf("Dropping field plan %u, only %u of %u steps were uploaded", data_->plan_id, data_->received, data_->num_steps);
+        reset();
+        return;
+    }
+    if(getState() != FIELD_PLAN_STATE::EMPTY)
+    {
+        PLOGI.printf("Field plan %u in the journal with %u of %u steps done, state %d", data_->plan_id, data_->next_step,
+                     data_->num_steps, static_cast<int>(data_->state));
+    }
+}
+
+FieldPlanJournal::~FieldPlanJournal()
+{
+    if(persistent_) munmap(data_, sizeof(FieldPlanJournalData));
+    else delete data_;
+}
+
+bool FieldPlanJournal::validate() const
+{
+    if(data_->magic != JOURNAL_MAGIC || data_->version != FIELD_PLAN_JOURNAL_VERSION) return false;
+    if(data_->num_steps > FIELD_PLAN_MAX_STEPS || data_->received > data_->num_steps) return false;
+    if(data_->state > static_cast<uint8_t>(FIELD_PLAN_STATE::DONE)) return false;
+    if(getState() == FIELD_PLAN_STATE::EMPTY || getState() == FIELD_PLAN_STATE::UPLOADING) return true;
+    return data_->received == data_->num_steps && data_->next_step <= data_->num_steps &&
+           data_->checksum == checksumSteps(data_->steps, data_->num_steps);
+}
+
+void FieldPlanJournal::reset()
+{
+    data_->magic = JOURNAL_MAGIC;
+    data_->version = FIELD_PLAN_JOURNAL_VERSION;
+    data_->plan_id = 0;
+    data_->num_steps = 0;
+    data_->received = 0;
+    data_->checksum = 0;
+    data_->next_step = 0;
+    data_->state = static_cast<uint8_t>(FIELD_PLAN_STATE::EMPTY);
+    sync(false);
+}
+
+void FieldPlanJournal::setState(FIELD_PLAN_STATE state)
+{
+    data_->state = static_cast<uint8_t>(state);
+    sync(false);
+}
+
+void FieldPlanJournal::sync(bool whole)
+{
+    if(!persistent_) return;
+    const size_t length = whole ? sizeof(FieldPlanJournalData) : offsetof(FieldPlanJournalData, steps);
+    if(msync(data_, length, MS_SYNC) < 0) PLOGW << "Could not sync field plan journal: " << strerror(errno);
+}
+
+bool FieldPlanJournal::addChunk(uint32_t id, int first, int total, const FieldPlanStep* steps, int num_steps)
+{
+    if(getState() == FIELD_PLAN_STATE::RUNNING)
+    {
+        PLOGW.printf("Field plan %u is running, pause or abort it before uploading another", data_->plan_id);
+        return false;
+    }
+    if(total <= 0 || total > FIELD_PLAN_MAX_STEPS || num_steps <= 0 || first < 0 || first + num_steps > total)
+    {
+        PLOGW.printf("Field plan chunk of %d steps from %d doesn't fit a plan of %d", num_steps, first, total);
+        return false;
+    }
+    if(first > 0 && (getState() != FIELD_PLAN_STATE::UPLOADING || id != data_->plan_id ||
+                     static_cast<uint32_t>(total) != data_->num_steps || static_cast<uint32_t>(first) != data_->received))
+    {
+        PLOGW.printf("Field plan %u chunk from step %d doesn't follow plan %u with %u steps received", id, first,
+                     data_->plan_id, data_->received);
+        return false;
+    }
+
+    if(first == 0)
+    {
+        // The header goes first so a crash part way through leaves an upload that is dropped on restart
+        data_->plan_id = id;
+        data_->num_steps = total;
+        data_->received = 0;
+        data_->checksum = 0;
+        data_->next_step = 0;
+        data_->state = static_cast<uint8_t>(FIELD_PLAN_STATE::UPLOADING);
+        sync(false);
+    }
+    std::memcpy(&data_->steps[first], steps, num_steps * sizeof(FieldPlanStep));
+    data_->received = first + num_steps;
+    if(data_->received < data_->num_steps) return true;
+
+    // Steps are on disk before the checksum and state that make them count
+    sync(true);
+    data_->checksum = checksumSteps(data_->steps, data_->num_steps);
+    setState(FIELD_PLAN_STATE::READY);
+    PLOGI.printf("Field plan %u uploaded with %u steps", data_->plan_id, data_->num_steps);
+    return true;
+}
+
+bool FieldPlanJournal::run()
+{
+    if(getState() != FIELD_PLAN_STATE::READY && getState() != FIELD_PLAN_STATE::PAUSED)
+    {
+        PLOGW.printf("Field plan %u can't run in state %d", data_->plan_id, static_cast<int>(data_->state));
+        return false;
+    }
+    PLOGI.printf("Running field plan %u from step %u of %u", data_->plan_id, data_->next_step, data_->num_steps);
+    setState(FIELD_PLAN_STATE::RUNNING);
+    return true;
+}
+
+bool FieldPlanJournal::pause()
+{
+    if(getState() != FIELD_PLAN_STATE::RUNNING) return false;
+    PLOGI.printf("Pausing field plan %u at step %u of %u", data_->plan_id, data_->next_step, data_->num_steps);
+    setState(FIELD_PLAN_STATE::PAUSED);
+    return true;
+}
+
+void FieldPlanJournal::abort()
+{
+    if(getState() != FIELD_PLAN_STATE::EMPTY) PLOGI.printf("Aborting field plan %u at step %u", data_->plan_id, data_->next_step);
+    reset();
+}
+
+void FieldPlanJournal::commitStep()
+{
+    // Written on its own and synced before anything else happens, this is what a restart carries on from
+    data_->next_step++;
+    sync(false);
+    if(data_->next_step >= data_->num_steps)
+    {
+        PLOGI.printf("Field plan %u done", data_->plan_id);
+        setState(FIELD_PLAN_STATE::DONE);
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef FieldPlan_h
+#define FieldPlan_h
+
+#include <cstdint>
+#include <string>
+
+#include "constants.h"
+
+// Most steps one field plan can hold
+#define FIELD_PLAN_MAX_STEPS 1024
+// Most steps in one field_plan_upload message, the JSON command buffer in RobotServer is sized for a full chunk
+#define FIELD_PLAN_CHUNK_STEPS 16
+// Bumped when FieldPlanJournalData changes, a journal from another version is dropped
+#define FIELD_PLAN_JOURNAL_VERSION 1
+
+enum class FIELD_PLAN_STATE : uint8_t
+{
+    EMPTY = 0,       // No plan, or the last one was aborted
+    UPLOADING = 1,   // Some of the plan has arrived
+    READY = 2,       // All of it has arrived, waiting for field_plan_run
+    RUNNING = 3,
+    PAUSED = 4,      // Waiting for field_plan_run between steps, after a pause, estop, error or restart
+    DONE = 5,
+};
+
+// One command of the plan, with the target of the moves in x, y, a
+struct FieldPlanStep
+{
+    uint8_t cmd;         // COMMAND value
+    uint8_t pad[3];
+    float x;
+    float y;
+    float a;
+};
+
+// Commands a plan can be made of. A step the robot went down in the middle of is run again from its start, so
+// only moves to an absolute target and tray actions are allowed, a relative move would end up somewhere else.
+bool isFieldPlanCmd(COMMAND cmd);
+
+// File layout of the journal, in the robot's native byte order
+struct FieldPlanJournalData
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t plan_id;
+    uint32_t num_steps;      // Steps in the whole plan
+    uint32_t received;       // Steps uploaded so far
+    uint32_t checksum;       // Of the steps, written once they have all arrived
+    uint32_t next_step;      // Steps done, only ever written on its own so a crash can't tear it
+    uint8_t state;           // FIELD_PLAN_STATE
+    uint8_t pad[3];
+    FieldPlanStep steps[FIELD_PLAN_MAX_STEPS];
+};
+
+// A field plan and how far the robot has got through it, kept in a memory mapped file so it survives a restart.
+// The steps are synced to the file before the plan counts as uploaded, and next_step is synced every time a
+// step finishes, so after a crash the plan carries on with the step that was running. Syncs wait on the disk,
+// which only happens on an upload, a state change or the end of a step.
+class FieldPlanJournal
+{
+  public:
+
+    // Maps path, creating it if needed, and picks up a complete plan left in it. An empty path keeps the
+    // journal in memory only.
+    explicit FieldPlanJournal(const std::string& path);
+    ~FieldPlanJournal();
+
+    FieldPlanJournal(const FieldPlanJournal&) = delete;
+    FieldPlanJournal& operator=(const FieldPlanJournal&) = delete;
+
+    // Part of plan id. A chunk starting at step 0 replaces whatever plan was there, the others have to carry on
+    // from the last one. Returns false, leaving the journal as it was, for a chunk that doesn't follow or doesn't
+    // fit in total, or while the plan is running.
+    bool addChunk(uint32_t id, int first, int total, const FieldPlanStep* steps, int num_steps);
+
+    // READY or PAUSED to RUNNING
+    bool run();
+
+    // RUNNING to PAUSED, the step that was running is run again by the next run()
+    bool pause();
+
+    // Drops the plan
+    void abort();
+
+    // The next step to run, only valid while the plan isn't EMPTY, UPLOADING or DONE
+    const FieldPlanStep& currentStep() const { return data_->steps[data_->next_step]; };
+
+    // Marks the current step done, DONE after the last one
+    void commitStep();
+
+    FIELD_PLAN_STATE getState() const { return static_cast<FIELD_PLAN_STATE>(data_->state); };
+    uint32_t getPlanId() const { return data_->plan_id; };
+    int getNextStep() const { return static_cast<int>(data_->next_step); };
+    int getNumSteps() const { return static_cast<int>(data_->num_steps); };
+    int getReceived() const { return static_cast<int>(data_->received); };
+
+    // False when the journal only lives in memory
+    bool isPersistent() const { return persistent_; };
+
+  private:
+
+    bool validate() const;
+    void reset();
+    void setState(FIELD_PLAN_STATE state);
+    // Writes the header, or the whole journal, through to the file
+    void sync(bool whole);
+
+    FieldPlanJournalData* data_;
+    bool persistent_;
+};
+
+#endif //FieldPlan_h
@@ -0,0 +1,275 @@
+#include "FlightRecorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <plog/Log.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+#include "utils.h"
+
+// A frozen ring that stops getting records, say because the control thread died, is dumped after this long anyway
+#define FLIGHT_RECORDER_FREEZE_WAIT_S 2.0
+
+namespace
+{
+    // Null while recording is off. Only open and close change the ring, before and after anything records.
+    std::atomic<FlightRecorderHeader*> ring_header(nullptr);
+    FlightRecord* ring_records = nullptr;
+    size_t ring_size = 0;
+    int ring_fd = -1;
+    uint32_t ring_post_freeze = 0;
+
+    // Writes the last dump off the main loop, a megabyte or so to the SD card can take a while. Joined on
+    // exit too, main never closes the recorder.
+    struct DumpThread
+    {
+        std::thread thread;
+        ~DumpThread() { if(thread.joinable()) thread.join(); }
+    } dump_thread;
+    std::atomic<bool> dump_writing(false);
+    bool dump_ok = true;
+
+    void writeDump(std::vector<char> snapshot, std::string path, FLIGHT_FREEZE reason)
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write(snapshot.data(), snapshot.size());
+        out.close();
+        dump_ok = static_cast<bool>(out);
+        if(!dump_ok) PLOGE.printf("Could not write flight recorder dump %s", path.c_str());
+        else PLOGW.printf("Flight recorder frozen by %s, dumped to %s", flightFreezeName(reason), path.c_str());
+        dump_writing.store(false, std::memory_order_release);
+    }
+
+    double nowSeconds()
+    {
+        return clockToSeconds(ClockFactory::getFactoryInstance()->get_clock()->now());
+    }
+
+    std::string dateString()
+    {
+        char buf[32];
+        time_t now = time(nullptr);
+        strftime(buf, sizeof(buf), "%Y%m%d_%H%M%S", localtime(&now));
+        return std::string(buf);
+    }
+}
+
+const char* flightFreezeName(FLIGHT_FREEZE reason)
+{
+    switch(reason)
+    {
+        case FLIGHT_FREEZE::NONE: return "none";
+        case FLIGHT_FREEZE::ERROR: return "error";
+        case FLIGHT_FREEZE::ESTOP: return "estop";
+        case FLIGHT_FREEZE::VISION_TIMEOUT: return "vision_timeout";
+    }
+    return "unknown";
+}
+
+bool FlightRecorder::open(const std::string& path, uint32_t capacity, uint32_t post_freeze_records, const std::string& previous_path)
+{
+    close();
+
+    uint32_t rounded = 1;
+    while(rounded < capacity) rounded <<= 1;
+
+    FlightRecorderHeader previous;
+    std::vector<FlightRecord> previous_records;
+    if(!previous_path.empty() && readFlightRecords(path, &previous, &previous_records) && !previous_records.empty())
+    {
+        std::error_code ec;
+        const std::filesystem::path previous_dir = std::filesystem::path(previous_path).parent_path();
+        if(!previous_dir.empty()) std::filesystem::create_directories(previous_dir, ec);
+        std::filesystem::copy_file(path, previous_path, std::filesystem::copy_options::overwrite_existing, ec);
+        if(ec) PLOGW.printf("Could not keep the previous flight records in %s: %s", previous_path.c_str(), ec.message().c_str());
+        else PLOGI.printf("Kept %zu flight records of the previous run in %s", previous_records.size(), previous_path.c_str());
+    }
+
+    const size_t size = sizeof(FlightRecorderHeader) + static_cast<size_t>(rounded) * sizeof(FlightRecord);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        PLOGE.printf("Could not create flight recorder file %s", path.c_str());
+        return false;
+    }
+    // Same as telemetry, writing through the mapping into a sparse file that can't grow would SIGBUS
+    if(posix_fallocate(fd, 0, size) != 0)
+    {
+        PLOGE.printf("Could not allocate %zu bytes for flight recorder file %s", size, path.c_str());
+        ::close(fd);
+        return false;
+    }
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if(mem == MAP_FAILED)
+    {
+        PLOGE.printf("Could not map flight recorder file %s", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    FlightRecorderHeader* header = static_cast<FlightRecorderHeader*>(mem);
+    memset(header, 0, sizeof(FlightRecorderHeader));
+    memcpy(header->magic, FLIGHT_RECORDER_MAGIC, sizeof(header->magic));
+    header->version = FLIGHT_RECORDER_VERSION;
+    header->record_size = sizeof(FlightRecord);
+    header->capacity = rounded;
+    header->stop_index = UINT64_MAX;
+
+    ring_records = reinterpret_cast<FlightRecord*>(header + 1);
+    ring_size = size;
+    ring_fd = fd;
+    ring_post_freeze = post_freeze_records;
+    ring_header.store(header, std::memory_order_release);
+    PLOGI.printf("Flight recorder keeping %u records in %s", rounded, path.c_str());
+    return true;
+}
+
+void FlightRecorder::close()
+{
+    waitForDump();
+    FlightRecorderHeader* header = ring_header.exchange(nullptr, std::memory_order_acq_rel);
+    if(header)
+    {
+        msync(header, ring_size, MS_ASYNC);
+        munmap(header, ring_size);
+    }
+    if(ring_fd >= 0)
+    {
+        ::close(ring_fd);
+    }
+    ring_records = nullptr;
+    ring_size = 0;
+    ring_fd = -1;
+}
+
+bool FlightRecorder::isEnabled()
+{
+    return ring_header.load(std::memory_order_relaxed) != nullptr;
+}
+
+void FlightRecorder::record(FLIGHT_RECORD type, uint8_t flags, uint16_t aux16, uint32_t aux, std::initializer_list<float> values)
+{
+    FlightRecorderHeader* header = ring_header.load(std::memory_order_acquire);
+    if(!header || __atomic_load_n(&header->head, __ATOMIC_RELAXED) >= __atomic_load_n(&header->stop_index, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    const uint64_t index = __atomic_fetch_add(&header->head, 1, __ATOMIC_RELAXED);
+    FlightRecord& rec = ring_records[index & (header->capacity - 1)];
+    // Invalidate the slot before touching anything else in it, see readFlightRecords
+    __atomic_store_n(&rec.seq, 0, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+    rec.stamp = nowSeconds();
+    rec.type = static_cast<uint8_t>(type);
+    rec.flags = flags;
+    rec.aux16 = aux16;
+    rec.aux = aux;
+    size_t i = 0;
+    for(float value : values)
+    {
+        if(i == FLIGHT_RECORD_VALUES) break;
+        rec.v[i++] = value;
+    }
+    std::fill(rec.v + i, rec.v + FLIGHT_RECORD_VALUES, 0.0f);
+    __atomic_store_n(&rec.seq, index + 1, __ATOMIC_RELEASE);
+}
+
+void FlightRecorder::freeze(FLIGHT_FREEZE reason)
+{
+    FlightRecorderHeader* header = ring_header.load(std::memory_order_acquire);
+    uint32_t armed = static_cast<uint32_t>(FLIGHT_FREEZE::NONE);
+    if(!header || !__atomic_compare_exchange_n(&header->freeze_reason, &armed, static_cast<uint32_t>(reason), false,
+                                               __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+    const uint64_t head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    header->freeze_index = head;
+    header->freeze_stamp = nowSeconds();
+    record(FLIGHT_RECORD::EVENT, 0, static_cast<uint16_t>(FLIGHT_EVENT::FREEZE), static_cast<uint32_t>(reason), {});
+    __atomic_store_n(&header->stop_index, head + 1 + ring_post_freeze, __ATOMIC_RELEASE);
+}
+
+FLIGHT_FREEZE FlightRecorder::getFreezeReason()
+{
+    FlightRecorderHeader* header = ring_header.load(std::memory_order_acquire);
+    if(!header) return FLIGHT_FREEZE::NONE;
+    return static_cast<FLIGHT_FREEZE>(__atomic_load_n(&header->freeze_reason, __ATOMIC_ACQUIRE));
+}
+
+std::string FlightRecorder::dumpIfFrozen(const std::string& dir)
+{
+    FlightRecorderHeader* header = ring_header.load(std::memory_order_acquire);
+    if(!header) return "";
+    const FLIGHT_FREEZE reason = static_cast<FLIGHT_FREEZE>(__atomic_load_n(&header->freeze_reason, __ATOMIC_ACQUIRE));
+    if(reason == FLIGHT_FREEZE::NONE) return "";
+    // stop_index is set last, until then the freeze is still being set up
+    const uint64_t stop = __atomic_load_n(&header->stop_index, __ATOMIC_ACQUIRE);
+    const uint64_t head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    if(stop == UINT64_MAX || (head < stop && nowSeconds() - header->freeze_stamp < FLIGHT_RECORDER_FREEZE_WAIT_S) ||
+       dump_writing.load(std::memory_order_acquire))
+    {
+        return "";
+    }
+    if(dump_thread.thread.joinable()) dump_thread.thread.join();
+    // Nothing new goes in while it is copied, if waiting timed out there may still be writers
+    __atomic_store_n(&header->stop_index, head, __ATOMIC_RELEASE);
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    const std::string path = dir + "/flight_" + dateString() + "_" + flightFreezeName(reason) + "_" +
+                             std::to_string(header->freeze_index) + ".bin";
+    const char* ring = reinterpret_cast<const char*>(header);
+    std::vector<char> snapshot(ring, ring + ring_size);
+
+    // Opened up again before the next freeze is let in, so that one can't be undone
+    __atomic_store_n(&header->stop_index, UINT64_MAX, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->freeze_reason, static_cast<uint32_t>(FLIGHT_FREEZE::NONE), __ATOMIC_RELEASE);
+
+    dump_writing.store(true, std::memory_order_release);
+    dump_thread.thread = std::thread(writeDump, std::move(snapshot), path, reason);
+    return path;
+}
+
+bool FlightRecorder::waitForDump()
+{
+    if(dump_thread.thread.joinable()) dump_thread.thread.join();
+    return dump_ok;
+}
+
+bool readFlightRecords(const std::string& path, FlightRecorderHeader* header, std::vector<FlightRecord>* records)
+{
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return false;
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if(data.size() < sizeof(FlightRecorderHeader)) return false;
+    memcpy(header, data.data(), sizeof(FlightRecorderHeader));
+    if(memcmp(header->magic, FLIGHT_RECORDER_MAGIC, sizeof(header->magic)) != 0 || header->version != FLIGHT_RECORDER_VERSION ||
+       header->record_size != sizeof(FlightRecord) || header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0 ||
+       data.size() < sizeof(FlightRecorderHeader) + static_cast<size_t>(header->capacity) * sizeof(FlightRecord))
+    {
+        return false;
+    }
+
+    records->clear();
+    const uint64_t end = header->head;
+    const uint64_t start = end > header->capacity ? end - header->capacity : 0;
+    const char* slots = data.data() + sizeof(FlightRecorderHeader);
+    for(uint64_t index = start; index < end; index++)
+    {
+        FlightRecord rec;
+        memcpy(&rec, slots + (index & (header->capacity - 1)) * sizeof(FlightRecord), sizeof(FlightRecord));
+        // Anything else was still being written, or already overwritten by a later record
+        if(rec.seq == index + 1) records->push_back(rec);
+    }
+    return true;
+}
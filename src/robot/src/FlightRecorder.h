@@ -0,0 +1,120 @@
+#ifndef FlightRecorder_h
+#define FlightRecorder_h
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// Black box of the last minute or so of control cycles, motor commands, position and camera inputs and loop
+// timings, cheap enough to leave on all the time. Records go into a ring in a memory mapped file, by default
+// in /dev/shm, so the last records of a run that crashed are still there to read after it. A fault freezes the
+// ring a few records later so what led up to it isn't overwritten, and the main loop then snapshots it,
+// starts recording again and leaves writing the dump file to a background thread.
+//
+// Any thread can record. Writers claim a slot with one atomic add and nothing is locked or allocated. A slot
+// only becomes valid once its seq is stored, so a record cut short by a crash is skipped by the readers.
+//
+// File layout, all little endian:
+//   FlightRecorderHeader at offset 0
+//   FlightRecord[capacity] right after it, record i of the run is in slot i % capacity
+
+#define FLIGHT_RECORDER_MAGIC "DRFLIGHT"
+#define FLIGHT_RECORDER_VERSION 1
+#define FLIGHT_RECORD_VALUES 10
+
+enum class FLIGHT_RECORD : uint8_t
+{
+    CONTROL = 1,        // One controller cycle. v: pos x, y, a, vel x, y, a, commanded global vel x, y, a, controller
+                        // loop ms. flags: 1 if a move is running. aux16: LIMITS_MODE, aux: move id
+    MOTOR_COMMAND,      // Velocity sent to the motor driver. v: local vel x, y, a. flags: 1 if sent as a binary frame
+    POSITION,           // Position reading given to localization. v: x, y, a, trans cov, angle cov, age s.
+                        // flags: 1 if the filter used it
+    CAMERA,             // Camera pose used by a vision move. v: x, y, a, age s. flags: 1 if it was in the filter history
+    LOOP,               // Main loop timing. v: average loop ms, longest loop ms since the last LOOP, position loop ms.
+                        // aux16: running COMMAND, aux: queued commands
+    EVENT,              // aux16: FLIGHT_EVENT, aux: COMMAND for COMMAND_RECEIVED with its sequence id in v[0],
+                        // FLIGHT_FREEZE for FREEZE
+};
+
+enum class FLIGHT_EVENT : uint16_t
+{
+    COMMAND_RECEIVED = 1,
+    FREEZE,
+};
+
+enum class FLIGHT_FREEZE : uint32_t
+{
+    NONE = 0,
+    ERROR,              // StatusUpdater error status set
+    ESTOP,
+    VISION_TIMEOUT,     // A vision move went too long without a camera pose
+};
+
+const char* flightFreezeName(FLIGHT_FREEZE reason);
+
+struct FlightRecorderHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;          // Power of 2
+    uint32_t freeze_reason;     // FLIGHT_FREEZE of the pending freeze, NONE while recording normally
+    uint64_t head;              // Records claimed so far
+    uint64_t stop_index;        // Records from here on are dropped, UINT64_MAX while recording normally
+    uint64_t freeze_index;      // head when the freeze was asked for
+    double freeze_stamp;        // Robot clock seconds of the freeze
+    uint64_t reserved;
+};
+
+struct FlightRecord
+{
+    uint64_t seq;               // Record index + 1, 0 while the record is being written
+    double stamp;               // Robot clock seconds
+    uint8_t type;               // FLIGHT_RECORD
+    uint8_t flags;
+    uint16_t aux16;
+    uint32_t aux;
+    float v[FLIGHT_RECORD_VALUES];
+};
+
+static_assert(sizeof(FlightRecorderHeader) == 64, "Flight recorder header layout changed");
+static_assert(sizeof(FlightRecord) == 64, "Flight record layout changed");
+
+namespace FlightRecorder
+{
+    // Maps path, replacing whatever is there after copying it to previous_path so the last records of a run
+    // that crashed survive a restart. capacity is rounded up to a power of 2. Returns false if the file
+    // couldn't be mapped, recording is then a no-op.
+    bool open(const std::string& path, uint32_t capacity, uint32_t post_freeze_records, const std::string& previous_path);
+
+    // Unmaps the ring, the file stays behind, after waiting for a dump being written. Only meant for shutdown
+    // and tests, nothing may record during it.
+    void close();
+
+    bool isEnabled();
+
+    // Stamped with the robot clock. Values past FLIGHT_RECORD_VALUES are ignored, missing ones are 0.
+    void record(FLIGHT_RECORD type, uint8_t flags, uint16_t aux16, uint32_t aux, std::initializer_list<float> values);
+
+    // Stops the ring post_freeze_records records from now. Only the first freeze counts until the ring has
+    // been dumped. Safe from any thread.
+    void freeze(FLIGHT_FREEZE reason);
+
+    FLIGHT_FREEZE getFreezeReason();
+
+    // Once a frozen ring has its post freeze records, snapshots it, starts recording again and writes the
+    // snapshot to dir on a background thread. A freeze that comes while the last dump is still being written
+    // waits for it. Main thread only. Returns the path the dump goes to, or an empty string if there was
+    // nothing to dump.
+    std::string dumpIfFrozen(const std::string& dir);
+
+    // Blocks until the dump started by dumpIfFrozen is on disk. Returns false if writing it failed.
+    bool waitForDump();
+}
+
+// Reads a ring or a dump of one, oldest record first. Records that were cut short or overwritten while
+// being read are left out. Returns false if the file is missing or isn't a flight recorder file.
+bool readFlightRecords(const std::string& path, FlightRecorderHeader* header, std::vector<FlightRecord>* records);
+
+#endif //FlightRecorder_h
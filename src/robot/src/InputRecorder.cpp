@@ -0,0 +1,322 @@
+#include "InputRecorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <plog/Log.h>
+
+namespace
+{
+    // Anything recorded while this much is already waiting for the writer is dropped
+    const size_t MAX_PENDING_BYTES = 16 * 1024 * 1024;
+    // How often the writer thread empties the buffer
+    const int WRITE_INTERVAL_MS = 20;
+
+    struct RecorderState
+    {
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::string pending;
+        FILE* file = nullptr;
+        bool running = false;
+        std::thread thread;
+        InputRecorderStats stats = {0, 0, 0};
+        bool have_camera = false;
+        CameraTrackerOutput last_camera = {{0,0,0}, false, ClockTimePoint(), false};
+    };
+
+    std::atomic<bool> recording(false);
+
+    RecorderState& state()
+    {
+        static RecorderState s;
+        return s;
+    }
+
+    template <typename T>
+    void append(std::string& buffer, const T& value)
+    {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    T extract(const std::string& payload, size_t* offset)
+    {
+        T value{};
+        if(*offset + sizeof(T) <= payload.size()) memcpy(&value, payload.data() + *offset, sizeof(T));
+        *offset += sizeof(T);
+        return value;
+    }
+
+    int64_t toNs(ClockTimePoint time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    ClockTimePoint fromNs(int64_t ns)
+    {
+        return ClockTimePoint(std::chrono::duration_cast<ClockTimePoint::duration>(std::chrono::nanoseconds(ns)));
+    }
+
+    // Caller holds the lock
+    void appendEntry(RecorderState& s, INPUT_RECORD type, const char* data, size_t len)
+    {
+        if(s.pending.size() + len + 3 > MAX_PENDING_BYTES)
+        {
+            s.stats.dropped++;
+            return;
+        }
+        s.pending.push_back(static_cast<char>(type));
+        append(s.pending, static_cast<uint16_t>(len));
+        s.pending.append(data, len);
+        s.stats.entries++;
+    }
+
+    void record(INPUT_RECORD type, const std::string& payload)
+    {
+        if(!recording.load(std::memory_order_relaxed)) return;
+        RecorderState& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        appendEntry(s, type, payload.data(), payload.size());
+    }
+
+    // Caller holds the lock, nothing else touches the file while the thread runs
+    void writePending(RecorderState& s, std::unique_lock<std::mutex>& lock)
+    {
+        std::string batch;
+        batch.swap(s.pending);
+        lock.unlock();
+        size_t written = batch.empty() ? 0 : fwrite(batch.data(), 1, batch.size(), s.file);
+        lock.lock();
+        s.stats.bytes += written;
+    }
+
+    void writerLoop()
+    {
+        RecorderState& s = state();
+        std::unique_lock<std::mutex> lock(s.mutex);
+        while(s.running)
+        {
+            s.wake.wait_for(lock, std::chrono::milliseconds(WRITE_INTERVAL_MS), [&s]() { return !s.running; });
+            writePending(s, lock);
+        }
+    }
+}
+
+namespace InputRecorder
+{
+    bool start(const std::string& path)
+    {
+        stop();
+        RecorderState& s = state();
+        FILE* file = fopen(path.c_str(), "wb");
+        if(!file)
+        {
+            PLOGE.printf("Unable to open input log %s", path.c_str());
+            return false;
+        }
+        const uint16_t version = INPUT_LOG_VERSION;
+        fwrite(INPUT_LOG_MAGIC, 1, 4, file);
+        fwrite(&version, sizeof(version), 1, file);
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.file = file;
+        s.pending.clear();
+        s.stats = {0, 0, 0};
+        s.have_camera = false;
+        s.running = true;
+        s.thread = std::thread(writerLoop);
+        recording = true;
+        PLOGI.printf("Recording inputs to %s", path.c_str());
+        return true;
+    }
+
+    void stop()
+    {
+        RecorderState& s = state();
+        recording = false;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if(!s.running) return;
+            s.running = false;
+        }
+        s.wake.notify_all();
+        s.thread.join();
+
+        std::unique_lock<std::mutex> lock(s.mutex);
+        writePending(s, lock);
+        fclose(s.file);
+        s.file = nullptr;
+        if(s.stats.dropped) PLOGW.printf("Input log dropped %llu entries", static_cast<unsigned long long>(s.stats.dropped));
+    }
+
+    bool isEnabled()
+    {
+        return recording.load(std::memory_order_relaxed);
+    }
+
+    void recordLoop(ClockTimePoint time)
+    {
+        if(!isEnabled()) return;
+        std::string payload;
+        append(payload, toNs(time));
+        record(INPUT_RECORD::LOOP, payload);
+    }
+
+    void recordSocket(const std::string& data)
+    {
+        if(!isEnabled()) return;
+        for (size_t offset = 0; offset < data.size(); offset += INPUT_LOG_MAX_PAYLOAD)
+        {
+            record(INPUT_RECORD::SOCKET, data.substr(offset, INPUT_LOG_MAX_PAYLOAD));
+        }
+    }
+
+    void recordSerial(INPUT_RECORD type, const std::string& msg)
+    {
+        if(!isEnabled() || msg.empty()) return;
+        record(type, msg.substr(0, INPUT_LOG_MAX_PAYLOAD));
+    }
+
+    void recordUdp(const std::string& datagram)
+    {
+        if(!isEnabled()) return;
+        record(INPUT_RECORD::UDP, datagram.substr(0, INPUT_LOG_MAX_PAYLOAD));
+    }
+
+    void recordOdometry(const SerialOdometry& odom)
+    {
+        if(!isEnabled()) return;
+        uint8_t payload[SERIAL_ODOMETRY_PAYLOAD_SIZE];
+        encodeOdometryPayload(odom, payload);
+        record(INPUT_RECORD::SERIAL_ODOMETRY, std::string(reinterpret_cast<const char*>(payload), SERIAL_ODOMETRY_PAYLOAD_SIZE));
+    }
+
+    void recordMarvelmind(const MarvelmindReading& reading)
+    {
+        if(!isEnabled()) return;
+        std::string payload;
+        append(payload, reading.x);
+        append(payload, reading.y);
+        append(payload, reading.a);
+        append(payload, toNs(reading.time));
+        append(payload, reading.hedge_timestamp);
+        append(payload, reading.seq);
+        append(payload, static_cast<uint8_t>(reading.dual));
+        append(payload, reading.trans_cov);
+        append(payload, reading.angle_cov);
+        record(INPUT_RECORD::MARVELMIND, payload);
+    }
+
+    void recordCamera(const CameraTrackerOutput& output)
+    {
+        if(!isEnabled()) return;
+        std::string payload;
+        append(payload, output.pose.x);
+        append(payload, output.pose.y);
+        append(payload, output.pose.a);
+        append(payload, static_cast<uint8_t>(output.ok));
+        append(payload, toNs(output.timestamp));
+        append(payload, static_cast<uint8_t>(output.raw_detection));
+
+        RecorderState& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if(s.have_camera && s.last_camera.ok == output.ok && s.last_camera.timestamp == output.timestamp) return;
+        s.have_camera = true;
+        s.last_camera = output;
+        appendEntry(s, INPUT_RECORD::CAMERA, payload.data(), payload.size());
+    }
+
+    InputRecorderStats getStats()
+    {
+        RecorderState& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        return s.stats;
+    }
+}
+
+ClockTimePoint InputRecord::loopTime() const
+{
+    size_t offset = 0;
+    return fromNs(extract<int64_t>(payload, &offset));
+}
+
+SerialOdometry InputRecord::odometry() const
+{
+    uint8_t buffer[SERIAL_ODOMETRY_PAYLOAD_SIZE] = {0};
+    memcpy(buffer, payload.data(), std::min(payload.size(), sizeof(buffer)));
+    return decodeOdometryPayload(buffer);
+}
+
+MarvelmindReading InputRecord::marvelmind() const
+{
+    size_t offset = 0;
+    MarvelmindReading reading;
+    reading.x = extract<float>(payload, &offset);
+    reading.y = extract<float>(payload, &offset);
+    reading.a = extract<float>(payload, &offset);
+    reading.time = fromNs(extract<int64_t>(payload, &offset));
+    reading.hedge_timestamp = extract<uint32_t>(payload, &offset);
+    reading.seq = extract<uint32_t>(payload, &offset);
+    reading.dual = extract<uint8_t>(payload, &offset);
+    reading.trans_cov = extract<float>(payload, &offset);
+    reading.angle_cov = extract<float>(payload, &offset);
+    return reading;
+}
+
+CameraTrackerOutput InputRecord::camera() const
+{
+    size_t offset = 0;
+    CameraTrackerOutput output;
+    output.pose.x = extract<float>(payload, &offset);
+    output.pose.y = extract<float>(payload, &offset);
+    output.pose.a = extract<float>(payload, &offset);
+    output.ok = extract<uint8_t>(payload, &offset);
+    output.timestamp = fromNs(extract<int64_t>(payload, &offset));
+    output.raw_detection = extract<uint8_t>(payload, &offset);
+    return output;
+}
+
+InputLogReader::InputLogReader()
+: file_(nullptr)
+{
+}
+
+InputLogReader::~InputLogReader()
+{
+    if(file_) fclose(file_);
+}
+
+bool InputLogReader::open(const std::string& path)
+{
+    if(file_) fclose(file_);
+    file_ = fopen(path.c_str(), "rb");
+    if(!file_) return false;
+
+    char magic[4];
+    uint16_t version = 0;
+    if(fread(magic, 1, 4, file_) != 4 || memcmp(magic, INPUT_LOG_MAGIC, 4) != 0 ||
+       fread(&version, sizeof(version), 1, file_) != 1 || version != INPUT_LOG_VERSION)
+    {
+        PLOGE.printf("%s is not a version %d input log", path.c_str(), INPUT_LOG_VERSION);
+        fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool InputLogReader::next(InputRecord* record)
+{
+    if(!file_) return false;
+    uint8_t type;
+    uint16_t len;
+    if(fread(&type, 1, 1, file_) != 1 || fread(&len, sizeof(len), 1, file_) != 1) return false;
+    record->type = static_cast<INPUT_RECORD>(type);
+    record->payload.resize(len);
+    return len == 0 || fread(&record->payload[0], 1, len, file_) == len;
+}
@@ -0,0 +1,105 @@
+#ifndef InputRecorder_h
+#define InputRecorder_h
+
+#include <cstdio>
+#include <string>
+
+#include "utils.h"
+#include "MarvelmindWrapper.h"
+#include "camera_tracker/CameraTrackerBase.h"
+#include "serial/SerialBinaryProtocol.h"
+
+// Records every input the robot loop consumes, at the point it is consumed, so a run can be replayed
+// through the mocks (see sim-main --replay). The main loop records a LOOP entry with the clock at the start
+// of every cycle, and everything recorded after it until the next LOOP was read during that cycle.
+//
+// The log is a 4 byte magic and a version, then entries of a type byte, a 2 byte payload length and the
+// payload. Recording only copies into a buffer under a lock, a background thread does the file writes.
+
+#define INPUT_LOG_MAGIC "DRIN"
+#define INPUT_LOG_VERSION 1
+// Longer socket reads are split over several entries
+#define INPUT_LOG_MAX_PAYLOAD 0xFFFF
+
+enum class INPUT_RECORD : uint8_t
+{
+    LOOP = 1,           // int64 clock ns, the time every clock read during the cycle is replayed as
+    SOCKET,             // Bytes returned by the socket wrapper
+    SERIAL_BASE,        // Text messages from the clearcore, one per entry
+    SERIAL_LIFT,
+    SERIAL_DISTANCE,
+    SERIAL_ODOMETRY,    // Binary odometry payload
+    MARVELMIND,         // MarvelmindReading
+    CAMERA,             // CameraTrackerOutput, only recorded when it changes
+    UDP,                // One datagram from the UDP side channel
+};
+
+struct InputRecorderStats
+{
+    uint64_t entries;     // Recorded since start
+    uint64_t bytes;       // Written to the file
+    uint64_t dropped;     // Entries discarded because the writer couldn't keep up
+};
+
+namespace InputRecorder
+{
+    // Starts recording to path, truncating it. Returns false if it couldn't be opened.
+    bool start(const std::string& path);
+
+    // Writes out everything recorded so far and closes the file
+    void stop();
+
+    bool isEnabled();
+
+    void recordLoop(ClockTimePoint time);
+
+    // Empty data isn't recorded
+    void recordSocket(const std::string& data);
+
+    void recordSerial(INPUT_RECORD type, const std::string& msg);
+
+    void recordUdp(const std::string& datagram);
+
+    void recordOdometry(const SerialOdometry& odom);
+
+    void recordMarvelmind(const MarvelmindReading& reading);
+
+    // Skipped if it is the same output as the last one recorded, the tracker is polled far more often than it updates
+    void recordCamera(const CameraTrackerOutput& output);
+
+    InputRecorderStats getStats();
+}
+
+struct InputRecord
+{
+    INPUT_RECORD type;
+    std::string payload;
+
+    // Decoders for the payload, only valid for the matching type
+    ClockTimePoint loopTime() const;
+    SerialOdometry odometry() const;
+    MarvelmindReading marvelmind() const;
+    CameraTrackerOutput camera() const;
+};
+
+// Reads back a log written by InputRecorder
+class InputLogReader
+{
+  public:
+
+    InputLogReader();
+
+    ~InputLogReader();
+
+    // Returns false if the file can't be opened or isn't an input log
+    bool open(const std::string& path);
+
+    // Returns false at the end of the log, a truncated last entry is ignored
+    bool next(InputRecord* record);
+
+  private:
+
+    FILE* file_;
+};
+
+#endif //InputRecorder_h
@@ -10,34 +10,89 @@
 
 #include <Eigen/Dense>
 
-class KalmanFilter 
+// N is the state (and input) dimension, M the measurement dimension. With fixed sizes all matrices live
+// inline and predict/update don't allocate; Eigen inverts fixed size matrices up to 4x4 in closed form.
+// Eigen::Dynamic for both gives the original heap allocated behavior, sized by the (n, m) constructor.
+template <int N, int M>
+class KalmanFilterT
 {
 
   public:
 
-    KalmanFilter(
-        Eigen::MatrixXf A,
-        Eigen::MatrixXf B,
-        Eigen::MatrixXf C,
-        Eigen::MatrixXf Q,
-        Eigen::MatrixXf R
-    );
+    using StateVector = Eigen::Matrix<float, N, 1>;
+    using StateMatrix = Eigen::Matrix<float, N, N>;
+    using MeasVector = Eigen::Matrix<float, M, 1>;
+    using MeasMatrix = Eigen::Matrix<float, M, M>;
+    using OutputMatrix = Eigen::Matrix<float, M, N>;
+    using GainMatrix = Eigen::Matrix<float, N, M>;
+
+    KalmanFilterT(
+        const StateMatrix& A,
+        const StateMatrix& B,
+        const OutputMatrix& C,
+        const StateMatrix& Q,
+        const MeasMatrix& R
+    )
+    : KalmanFilterT(A.rows(), C.rows())
+    {
+        A_ = A;
+        B_ = B;
+        C_ = C;
+        Q_ = Q;
+        R_ = R;
+    }
 
     // Size only simplify initializing in a class
-    KalmanFilter(int n, int m);
+    KalmanFilterT(int n = N, int m = M)
+    : n_(n),
+      m_(m),
+      A_(StateMatrix::Identity(n,n)),
+      B_(StateMatrix::Zero(n,n)),
+      C_(OutputMatrix::Zero(m,n)),
+      I_(StateMatrix::Identity(n,n)),
+      K_(GainMatrix::Zero(n,m)),
+      P_(StateMatrix::Identity(n,n)),
+      Q_(StateMatrix::Identity(n,n)),
+      R_(MeasMatrix::Identity(m,m)),
+      S_(MeasMatrix::Identity(m,m)),
+      x_hat_(StateVector::Zero(n))
+    {}
 
     // Prediction step with input u
-    void predict(const Eigen::VectorXf& u);
+    void predict(const StateVector& u)
+    {
+        predict(u, Q_);
+    }
+
+    // Same with a process covariance just for this step, the filter's own Q is left alone
+    void predict(const StateVector& u, const StateMatrix& Q)
+    {
+        x_hat_ = A_ * x_hat_ + B_ * u;
+        P_ = A_ * P_ * A_.transpose() + Q;
+    }
 
     // Update the estimated state based on measured values.
-    void update(const Eigen::VectorXf& y);
-    void update(const Eigen::VectorXf& y, Eigen::MatrixXf R);
+    void update(const MeasVector& y)
+    {
+        S_ = C_ * P_ * C_.transpose() + R_;
+        K_ = P_ * C_.transpose() * S_.inverse();
+        x_hat_ = x_hat_ + K_ * (y - C_ * x_hat_);
+        P_ = (I_ - K_ * C_) * P_;
+    }
+
+    void update(const MeasVector& y, const MeasMatrix& R)
+    {
+        R_ = R;
+        update(y);
+    }
 
     // Get current state estimate
-    Eigen::VectorXf state() { return x_hat_; };
-    Eigen::MatrixXf covariance() { return P_; };
+    const StateVector& state() const { return x_hat_; };
+    const StateMatrix& covariance() const { return P_; };
+    const StateMatrix& processCovariance() const { return Q_; };
 
-    void update_covariance(Eigen::MatrixXf P) {P_ = P;}
+    void update_covariance(const StateMatrix& P) {P_ = P;}
+    void update_state(const StateVector& x) {x_hat_ = x;}
 
   private:
 
@@ -46,18 +101,24 @@ class KalmanFilter
     int m_;
 
     // Matrices for computation
-    Eigen::MatrixXf A_;
-    Eigen::MatrixXf B_;
-    Eigen::MatrixXf C_;
-    Eigen::MatrixXf I_;
-    Eigen::MatrixXf K_;
-    Eigen::MatrixXf P_;
-    Eigen::MatrixXf Q_;
-    Eigen::MatrixXf R_;
-    Eigen::MatrixXf S_;
+    StateMatrix A_;
+    StateMatrix B_;
+    OutputMatrix C_;
+    StateMatrix I_;
+    GainMatrix K_;
+    StateMatrix P_;
+    StateMatrix Q_;
+    MeasMatrix R_;
+    MeasMatrix S_;
 
     // Estimated state
-    Eigen::VectorXf x_hat_;
+    StateVector x_hat_;
 };
 
-#endif //KalmanFilter_h
\ No newline at end of file
+// Original dynamically sized filter
+using KalmanFilter = KalmanFilterT<Eigen::Dynamic, Eigen::Dynamic>;
+
+// Pose (x, y, a) filter with direct pose measurements, as used by localization and vision
+using KalmanFilter3 = KalmanFilterT<3, 3>;
+
+#endif //KalmanFilter_h
@@ -4,6 +4,7 @@
 #include <algorithm> 
 #include <plog/Log.h>
 #include "constants.h"
+#include "Se2.h"
 
 Localization::Localization()
 : pos_(0,0,0),
@@ -19,32 +20,115 @@ Localization::Localization()
   vel_uncertainty_slope_(cfg.lookup("localization.vel_uncertainty_slope")),
   max_vel_uncetainty_(cfg.lookup("localization.max_vel_uncetainty")),
   vel_uncertainty_decay_time_(cfg.lookup("localization.vel_uncertainty_decay_time")),
+  delay_compensation_(cfg.lookup("localization.delay_compensation")),
+  odom_integration_(ODOM_INTEGRATION::EULER),
+  scale_noise_(cfg.lookup("localization.odometry.scale_noise")),
+  trans_noise_per_s_(cfg.lookup("localization.odometry.trans_noise_per_s")),
+  angle_noise_per_s_(cfg.lookup("localization.odometry.angle_noise_per_s")),
+  trans_noise_per_m_(cfg.lookup("localization.odometry.trans_noise_per_m")),
+  angle_noise_per_rad_(cfg.lookup("localization.odometry.angle_noise_per_rad")),
+  gating_enabled_(cfg.lookup("localization.gating.enabled")),
+  gate_threshold_(cfg.lookup("localization.gating.chi2_threshold")),
+  reacquire_after_(static_cast<int>(cfg.lookup("localization.gating.reacquire_after"))),
+  have_fix_(false),
   metrics_(),
   time_since_last_motion_(),
-  kf_(3,3)
+  kf_(KalmanFilter3(), 1, true),
+  camera_kf_(KalmanFilter3(), 1),
+  camera_R_(Eigen::Matrix3f::Identity()),
+  camera_delay_compensation_(false),
+  have_camera_fix_(false),
+  distance_fusion_(),
+  last_range_time_()
 {
-    Eigen::MatrixXf A = Eigen::MatrixXf::Identity(3,3);
-    Eigen::MatrixXf B = Eigen::MatrixXf::Identity(3,3);
-    Eigen::MatrixXf C = Eigen::MatrixXf::Identity(3,3);
-    Eigen::MatrixXf Q(3,3);
+    Eigen::Matrix3f A = Eigen::Matrix3f::Identity();
+    Eigen::Matrix3f B = Eigen::Matrix3f::Identity();
+    Eigen::Matrix3f C = Eigen::Matrix3f::Identity();
+    Eigen::Matrix3f Q;
     float predict_trans_cov = cfg.lookup("localization.kf_predict_trans_cov");
     float predict_angle_cov = cfg.lookup("localization.kf_predict_angle_cov");
     Q << predict_trans_cov,0,0, 
          0,predict_trans_cov,0,
          0,0,predict_angle_cov;
-    Eigen::MatrixXf R(3,3);
+    Eigen::Matrix3f R;
     R << meas_trans_cov_,0,0, 
          0,meas_trans_cov_,0,
          0,0,meas_angle_cov_;
-    kf_ = KalmanFilter(A,B,C,Q,R);
+    kf_.reset(KalmanFilter3(A,B,C,Q,R), cfg.lookup("localization.history_length"));
+
+    std::string integration = cfg.lookup("localization.odometry.integration");
+    if (integration == "exact") odom_integration_ = ODOM_INTEGRATION::EXACT;
+    else if (integration == "midpoint") odom_integration_ = ODOM_INTEGRATION::MIDPOINT;
+    else if (integration != "euler") PLOGW << "Unknown odometry integration " << integration << ", using euler";
+
+    resetCameraFrame();
+}
+
+void Localization::resetCameraFrame()
+{
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    camera_delay_compensation_ = config->vision_kf.delay_compensation;
+    distance_fusion_ = config->distance_fusion;
+    have_camera_fix_ = false;
+    last_range_time_ = ClockTimePoint();
+
+    Eigen::Matrix3f A = Eigen::Matrix3f::Identity();
+    Eigen::Matrix3f B = Eigen::Matrix3f::Identity();
+    Eigen::Matrix3f C = Eigen::Matrix3f::Identity();
+    Eigen::Matrix3f Q;
+    Q << config->vision_kf.predict_trans_cov,0,0, 
+         0,config->vision_kf.predict_trans_cov,0,
+         0,0,config->vision_kf.predict_angle_cov;
+    camera_R_ << config->vision_kf.meas_trans_cov,0,0, 
+                 0,config->vision_kf.meas_trans_cov,0,
+                 0,0,config->vision_kf.meas_angle_cov;
+    camera_kf_.reset(KalmanFilter3(A,B,C,Q,camera_R_), config->vision_kf.history_length);
 }
 
-void Localization::updatePositionReading(Point global_position)
+bool Localization::updateCameraReading(Point camera_pose, ClockTimePoint time)
+{
+    // The tracker timestamp is when the frames were captured, so with delay compensation the filter is rewound
+    // to that time and the odometry since then is replayed on top of the measurement
+    if (!camera_delay_compensation_) time = ClockFactory::getFactoryInstance()->get_clock()->now();
+    have_camera_fix_ = true;
+    return camera_kf_.update({camera_pose.x, camera_pose.y, camera_pose.a}, camera_R_, time);
+}
+
+bool Localization::updateRangeReading(const DistanceReading& reading)
+{
+    // The frame has to be started from a camera pose, the range only fixes one axis
+    if (!distance_fusion_.enabled || !have_camera_fix_) return false;
+    if (!reading.ok || reading.time <= last_range_time_ || reading.range > distance_fusion_.max_range) return false;
+
+    // The range measures a single axis of the pose. The other two are given the current estimate with a
+    // covariance large enough that they don't move, so the same pose filter and its history take it.
+    const int axis = distance_fusion_.axis;
+    Eigen::Vector3f y = camera_kf_.state();
+    y[axis] = distance_fusion_.origin + distance_fusion_.sign * reading.range;
+    Eigen::Matrix3f R = Eigen::Matrix3f::Identity() * 1.0e6f;
+    R(axis, axis) = distance_fusion_.meas_cov;
+    camera_kf_.update(y, R, camera_delay_compensation_ ? reading.time : ClockFactory::getFactoryInstance()->get_clock()->now());
+    last_range_time_ = reading.time;
+    return true;
+}
+
+Point Localization::getCameraPose() const
+{
+    const Eigen::Vector3f& state = camera_kf_.state();
+    return {state[0], state[1], state[2]};
+}
+
+bool Localization::updatePositionReading(Point global_position)
+{
+    return updatePositionReading(global_position, ClockFactory::getFactoryInstance()->get_clock()->now());
+}
+
+bool Localization::updatePositionReading(Point global_position, ClockTimePoint measured_time, float trans_cov, float angle_cov)
 {
     if (fabs(global_position.a) > 3.2) 
     {
         PLOGE << "INVALID ANGLE - should be in radians between +/- pi";
-        return;
+        return false;
     }
     
     // The x,y,a here is from the center of the marvlemind pair, so we need to transform it to the actual center of the
@@ -55,20 +139,30 @@ void Localization::updatePositionReading(Point global_position)
     // Generate an uncertainty based on the current velocity and time since motion since we know the beacons are less accurate when moving
     const float position_uncertainty = computePositionUncertainty();
     metrics_.last_position_uncertainty = position_uncertainty;
-    Eigen::MatrixXf R(3,3);
-    R << meas_trans_cov_ + position_uncertainty*localization_uncertainty_scale_,0,0, 
-         0,meas_trans_cov_+ position_uncertainty*localization_uncertainty_scale_,0,
-         0,0,meas_angle_cov_+ position_uncertainty*localization_uncertainty_scale_;
+    if (trans_cov <= 0) trans_cov = meas_trans_cov_;
+    if (angle_cov <= 0) angle_cov = meas_angle_cov_;
+    Eigen::Matrix3f R;
+    R << trans_cov + position_uncertainty*localization_uncertainty_scale_,0,0, 
+         0,trans_cov + position_uncertainty*localization_uncertainty_scale_,0,
+         0,0,angle_cov + position_uncertainty*localization_uncertainty_scale_;
 
     // PLOGI << "position_uncertainty: " << position_uncertainty;
     // PLOGI << "R: " << R;
     // PLOGI << "cov1: " << kf_.covariance();
 
-    kf_.update(adjusted_measured_position, R);
-    Eigen::VectorXf est = kf_.state();
-    pos_.x = est[0];
-    pos_.y = est[1];
-    pos_.a = wrap_angle(est[2]);
+    if (!delay_compensation_) measured_time = ClockFactory::getFactoryInstance()->get_clock()->now();
+    // Take the measured angle on the same turn as the estimate so neither the gate nor the update sees a
+    // reading across +/- pi as a full turn away
+    adjusted_measured_position(2) = kf_.state()[2] + wrap_angle(adjusted_measured_position(2) - kf_.state()[2]);
+    if (!gateReading(adjusted_measured_position, R, &measured_time))
+    {
+        return false;
+    }
+    if (!kf_.update(adjusted_measured_position, R, measured_time))
+    {
+        PLOGW_(LOCALIZATION_LOG_ID) << "Position reading is older than the odometry history, applied as current";
+    }
+    updateFromFilter();
     
     // PLOGI << "cov2: " << kf_.covariance();
 
@@ -78,33 +172,40 @@ void Localization::updatePositionReading(Point global_position)
     PLOGI_(LOCALIZATION_LOG_ID).printf("  Adjusted input: [%4.3f, %4.3f, %4.3f]", 
         adjusted_measured_position(0), adjusted_measured_position(1), adjusted_measured_position(2));
     PLOGI_(LOCALIZATION_LOG_ID).printf("  position_uncertainty: %4.3f", position_uncertainty);
+    PLOGI_(LOCALIZATION_LOG_ID).printf("  Replayed predictions: %i", kf_.lastReplayCount());
     PLOGI_(LOCALIZATION_LOG_ID).printf("  Current position: %s\n", pos_.toString().c_str());
+    return true;
 }
 
 void Localization::updateVelocityReading(Velocity local_cart_vel, float dt)
 {
-    // Convert local cartesian velocity to global cartesian velocity using the last estimated angle
-    float cA = cos(pos_.a);
-    float sA = sin(pos_.a);
-    vel_.vx = cA * local_cart_vel.vx - sA * local_cart_vel.vy;
-    vel_.vy = sA * local_cart_vel.vx + cA * local_cart_vel.vy;
-    vel_.va = local_cart_vel.va;
-
-    // Apply prediction step with velocity to get estimated position
-    Eigen::Vector3f u = {vel_.vx, vel_.vy, vel_.va};
-    Eigen::Vector3f udt = dt*u;
-    kf_.predict(udt);
+    updateVelocityReading(local_cart_vel, dt, ClockFactory::getFactoryInstance()->get_clock()->now());
+}
+
+void Localization::updateVelocityReading(Velocity local_cart_vel, float dt, ClockTimePoint time)
+{
+    // Convert local cartesian velocity to global cartesian velocity. Euler steps use the last estimated angle,
+    // which leaves the robot off to one side of its arc whenever it turns while driving.
+    const float mid_angle = odom_integration_ == ODOM_INTEGRATION::EULER ? pos_.a : pos_.a + 0.5f * local_cart_vel.va * dt;
+    vel_ = Rotation2D(mid_angle).toGlobal(local_cart_vel);
+
+    // Apply prediction step with the pose change to get estimated position
+    Eigen::Vector3f udt = {vel_.vx * dt, vel_.vy * dt, vel_.va * dt};
+    if (odom_integration_ == ODOM_INTEGRATION::EXACT)
+    {
+        integrateLocalVelocity(Rotation2D(pos_.a), local_cart_vel, dt, &udt[0], &udt[1]);
+    }
+    if (scale_noise_) kf_.predict(udt, processNoise(udt, dt), time);
+    else kf_.predict(udt, time);
+    // Same report moves the camera frame, which takes the pose change in the robot's own axes
+    camera_kf_.predict({local_cart_vel.vx * dt, local_cart_vel.vy * dt, local_cart_vel.va * dt}, time);
     // PLOGI << "cov3: " << kf_.covariance();
     time_since_last_motion_.reset();
-
-    Eigen::VectorXf est = kf_.state();
-    pos_.x = est[0];
-    pos_.y = est[1];
-    pos_.a = wrap_angle(est[2]);
+    updateFromFilter();
 
     // Using the covariance matrix from kf, using those values to estimate a fractional 'confidence'
     // in our positioning relative to some reference amout.
-    Eigen::MatrixXf cov = kf_.covariance();
+    const Eigen::Matrix3f& cov = kf_.covariance();
 
     // Compute inverse confidence. As long as the variance isn't larger than the reference values
     // these will be between 0-1 with 0 being more confident in the positioning
@@ -114,21 +215,62 @@ void Localization::updateVelocityReading(Velocity local_cart_vel, float dt)
     metrics_.total_confidence = (metrics_.confidence_x + metrics_.confidence_y + metrics_.confidence_a)/3;
 }
 
+Eigen::Matrix3f Localization::processNoise(const Eigen::Vector3f& udt, float dt) const
+{
+    const float trans_cov = trans_noise_per_s_ * dt + trans_noise_per_m_ * std::hypot(udt[0], udt[1]);
+    const float angle_cov = angle_noise_per_s_ * dt + angle_noise_per_rad_ * std::fabs(udt[2]);
+    return Eigen::Vector3f(trans_cov, trans_cov, angle_cov).asDiagonal();
+}
+
+bool Localization::gateReading(const Eigen::Vector3f& y, const Eigen::Matrix3f& R, ClockTimePoint* time)
+{
+    metrics_.last_nis = kf_.innovationNis(y, R, *time);
+    if (!gating_enabled_ || !have_fix_ || metrics_.last_nis <= gate_threshold_)
+    {
+        have_fix_ = true;
+        metrics_.consecutive_rejections = 0;
+        return true;
+    }
+
+    metrics_.rejected_readings++;
+    metrics_.consecutive_rejections++;
+    if (metrics_.consecutive_rejections < reacquire_after_)
+    {
+        PLOGW_(LOCALIZATION_LOG_ID).printf("Rejected position reading [%4.3f, %4.3f, %4.3f], innovation distance %.1f",
+            y(0), y(1), y(2), metrics_.last_nis);
+        return false;
+    }
+
+    // Readings that keep disagreeing mean it is the estimate that is off, e.g. after the robot was pushed
+    PLOGW.printf("Reacquiring localization after %u rejected position readings", metrics_.consecutive_rejections);
+    Eigen::Matrix3f P;
+    P << variance_ref_trans_,0,0,
+         0,variance_ref_trans_,0,
+         0,0,variance_ref_angle_;
+    kf_.setCovariance(P);
+    *time = ClockFactory::getFactoryInstance()->get_clock()->now();
+    metrics_.reacquisitions++;
+    metrics_.consecutive_rejections = 0;
+    return true;
+}
+
+void Localization::updateFromFilter()
+{
+    const Eigen::Vector3f& est = kf_.state();
+    pos_.x = est[0];
+    pos_.y = est[1];
+    pos_.a = wrap_angle(est[2]);
+}
+
 Eigen::Vector3f Localization::marvelmindToRobotCenter(Eigen::Vector3f mm_global_position) 
 {
-    Eigen::Vector3f local_offset = {mm_x_offset_/1000.0f, mm_y_offset_/1000.0f, 0.0f};
-    float cA = cos(mm_global_position(2));
-    float sA = sin(mm_global_position(2));
-    Eigen::Matrix3f rotation;
-    rotation << cA, -sA, 0.0f, 
-                sA, cA, 0.0f,
-                0.0f, 0.0f, 1.0f;
-    Eigen::Vector3f adjusted_position = mm_global_position - rotation * local_offset;
+    float dx_global;
+    float dy_global;
+    Rotation2D(mm_global_position(2)).toGlobal(mm_x_offset_/1000.0f, mm_y_offset_/1000.0f, &dx_global, &dy_global);
+    Eigen::Vector3f adjusted_position = {mm_global_position(0) - dx_global, mm_global_position(1) - dy_global, mm_global_position(2)};
 
     // PLOGD_(LOCALIZATION_LOG_ID).printf("\nMM to robot frame:");
     // PLOGD_(LOCALIZATION_LOG_ID).printf("  mm position: [%4.3f, %4.3f, %4.3f]", mm_global_position(0), mm_global_position(1), mm_global_position(2));
-    // PLOGD_(LOCALIZATION_LOG_ID).printf("  R: \n[%4.3f, %4.3f, %4.3f]\n[%4.3f, %4.3f, %4.3f]\n[%4.3f, %4.3f, %4.3f]", 
-    //  rotation(0,0), rotation(0,1), rotation(0,2), rotation(1,0), rotation(1,1), rotation(1,2), rotation(2,0), rotation(2,1), rotation(2,2));
     // PLOGD_(LOCALIZATION_LOG_ID).printf("  new position: [%4.3f, %4.3f, %4.3f]", adjusted_position(0), adjusted_position(1), adjusted_position(2));
 
     return adjusted_position;
@@ -153,11 +295,4 @@ float Localization::computePositionUncertainty()
     PLOGD_(LOCALIZATION_LOG_ID).printf("  Total v: %4.3f, time since motion: %4.3f, position_uncertainty: %4.3f", total_v, time_since_last_motion_.dt_s(), position_uncertainty);
 
     return position_uncertainty;
-}
-
-void Localization::resetAngleCovariance() 
-{
-    Eigen::MatrixXf covariance = kf_.covariance();
-    covariance(2,2) = variance_ref_angle_;
-    kf_.update_covariance(covariance);
 }
\ No newline at end of file
@@ -3,17 +3,50 @@
 
 #include "utils.h"
 #include <Eigen/Dense>
-#include "KalmanFilter.h"
+#include "DelayCompensatedFilter.h"
+#include "DistanceSensor.h"
+#include "ConfigSnapshot.h"
 
+// How one odometry report is turned into a pose change
+enum class ODOM_INTEGRATION
+{
+    EULER,          // Straight line along the heading at the start of the report
+    MIDPOINT,       // Straight line along the heading halfway through the report
+    EXACT,          // Arc driven holding the reported body velocity, see integrateLocalVelocity
+};
+
+// The one motion estimate every controller mode reads. Odometry predicts two pose filters at once: the field
+// frame the Marvelmind readings are in, and the camera frame of the target a vision move is working towards,
+// which camera poses and close in ranges update. Both keep running whatever the mode, so switching in or out
+// of a vision move doesn't have to wait for either to converge again.
 class Localization
 {
   public:
     Localization();
 
-    void updatePositionReading(Point global_position);
+    bool updatePositionReading(Point global_position);
+
+    // Position measured at measured_time, applied against the odometry buffered since then. Covariances
+    // of 0 use the configured marvelmind measurement covariance. Returns false if the gate dropped it.
+    bool updatePositionReading(Point global_position, ClockTimePoint measured_time, float trans_cov = 0, float angle_cov = 0);
+
+    // Camera pose captured at time. The first one after resetCameraFrame initializes the camera frame. Returns
+    // false if it was older than the odometry history and applied as current.
+    bool updateCameraReading(Point camera_pose, ClockTimePoint time);
+
+    // Fuses a range reading into its axis of the camera frame if the cameras started the frame, it is newer
+    // than the last one and close enough to be trusted over the cameras. Returns true if it was fused.
+    bool updateRangeReading(const DistanceReading& reading);
+
+    // Starts the camera frame over for a new target with vision_tracker.kf and distance_sensor.fusion from
+    // the current ConfigSnapshot
+    void resetCameraFrame();
 
     void updateVelocityReading(Velocity local_cart_vel, float dt);
 
+    // Odometry covering the dt leading up to time
+    void updateVelocityReading(Velocity local_cart_vel, float dt, ClockTimePoint time);
+
     Point getPosition() {return pos_; };
 
     Velocity getVelocity() {return vel_; };
@@ -25,16 +58,36 @@ class Localization
 
     LocalizationMetrics getLocalizationMetrics() { return metrics_; };
 
-    void resetAngleCovariance();
+    Eigen::Vector3f getCovarianceDiagonal() const { return kf_.covariance().diagonal(); };
+
+    // Pose in the camera frame, only meaningful once hasCameraFix
+    Point getCameraPose() const;
+
+    bool hasCameraFix() const { return have_camera_fix_; };
+
+    Eigen::Vector3f getCameraCovarianceDiagonal() const { return camera_kf_.covariance().diagonal(); };
+
+    // Number of predictions replayed by the last camera frame update
+    int getCameraReplayCount() const { return camera_kf_.lastReplayCount(); };
 
   private:
 
     // Convert position reading from marvelmind frame to robot frame
     Eigen::Vector3f marvelmindToRobotCenter(Eigen::Vector3f mm_global_position);
 
+    void updateFromFilter();
+
     // Compute a multiplier based on the current velocity that informs how trustworthy the current reading might be
     float computePositionUncertainty();
 
+    // Prediction covariance for a pose change of udt over dt, grows with both time and distance
+    Eigen::Matrix3f processNoise(const Eigen::Vector3f& udt, float dt) const;
+
+    // Chi-square gate on a position reading y with covariance R. Returns false to drop it. After
+    // reacquire_after readings in a row are dropped the estimate is reset to trust the next one, which is
+    // then applied as current and time set to now.
+    bool gateReading(const Eigen::Vector3f& y, const Eigen::Matrix3f& R, ClockTimePoint* time);
+
     
     // Current position and velocity
     Point pos_;
@@ -52,10 +105,29 @@ class Localization
     float vel_uncertainty_slope_;
     float max_vel_uncetainty_;
     float vel_uncertainty_decay_time_;
+    bool delay_compensation_;
+    ODOM_INTEGRATION odom_integration_;
+    bool scale_noise_;
+    float trans_noise_per_s_;
+    float angle_noise_per_s_;
+    float trans_noise_per_m_;
+    float angle_noise_per_rad_;
+    bool gating_enabled_;
+    float gate_threshold_;
+    uint32_t reacquire_after_;
+    bool have_fix_;                 // A reading has been accepted, until then there is nothing to gate against
 
     LocalizationMetrics metrics_;
     Timer time_since_last_motion_; 
-    KalmanFilter kf_;
+    DelayCompensatedFilter kf_;
+
+    // Camera frame, odometry moves it in the robot's local axes since the target is always close to straight ahead
+    DelayCompensatedFilter camera_kf_;
+    Eigen::Matrix3f camera_R_;              // Passed with every camera update since range updates bring their own
+    bool camera_delay_compensation_;        // Apply camera and range readings at their capture time
+    bool have_camera_fix_;
+    DistanceFusionConfig distance_fusion_;
+    ClockTimePoint last_range_time_;
 };
 
 #endif //Localization_h
\ No newline at end of file
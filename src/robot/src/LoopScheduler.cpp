@@ -0,0 +1,105 @@
+#include "LoopScheduler.h"
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <plog/Log.h>
+
+#include "constants.h"
+
+LoopScheduler::LoopScheduler()
+: tasks_(),
+  wake_fds_(),
+  max_sleep_us_(1000 * static_cast<int>(cfg.lookup("main_loop.max_sleep_ms"))),
+  report_rate_(1)
+{}
+
+void LoopScheduler::addTask(const std::string& name, RateController* rate)
+{
+    tasks_.push_back({name, rate, 0});
+}
+
+void LoopScheduler::addWakeFd(int fd)
+{
+    if(fd >= 0) wake_fds_.push_back({fd, POLLIN, 0});
+}
+
+ClockTimePoint LoopScheduler::getNextDeadline()
+{
+    ClockTimePoint deadline = ClockFactory::getFactoryInstance()->get_clock()->now() + std::chrono::microseconds(max_sleep_us_);
+    for (auto& task : tasks_)
+    {
+        ClockTimePoint task_deadline = task.rate->nextReadyTime();
+        if (task_deadline < deadline)
+        {
+            deadline = task_deadline;
+        }
+    }
+    return deadline;
+}
+
+void LoopScheduler::sleepUntilNextDeadline()
+{
+    if (report_rate_.ready())
+    {
+        reportOverruns();
+    }
+
+    ClockTimePoint deadline = getNextDeadline();
+    ClockTimePoint now = ClockFactory::getFactoryInstance()->get_clock()->now();
+    if (deadline <= now)
+    {
+        return;
+    }
+
+    if (!wake_fds_.empty())
+    {
+        auto timeout_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ns / 1000000000;
+        timeout.tv_nsec = timeout_ns % 1000000000;
+        if (ppoll(wake_fds_.data(), wake_fds_.size(), &timeout, NULL) > 0)
+        {
+            for (const pollfd& pfd : wake_fds_)
+            {
+                if (!(pfd.revents & POLLIN)) continue;
+                uint64_t count;
+                ssize_t n = read(pfd.fd, &count, sizeof(count));
+                (void) n;
+            }
+        }
+        return;
+    }
+
+    // steady_clock is CLOCK_MONOTONIC, so the time point can be used directly as an absolute deadline
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+uint32_t LoopScheduler::getOverruns(const std::string& name) const
+{
+    for (const auto& task : tasks_)
+    {
+        if (task.name == name)
+        {
+            return task.rate->getOverruns();
+        }
+    }
+    return 0;
+}
+
+void LoopScheduler::reportOverruns()
+{
+    for (auto& task : tasks_)
+    {
+        uint32_t overruns = task.rate->getOverruns();
+        if (overruns != task.reported_overruns)
+        {
+            PLOGW.printf("%s missed %u cycles (%u total)", task.name.c_str(), overruns - task.reported_overruns, overruns);
+            task.reported_overruns = overruns;
+        }
+    }
+}
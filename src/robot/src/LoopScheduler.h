@@ -0,0 +1,51 @@
+#ifndef LoopScheduler_h
+#define LoopScheduler_h
+
+#include <poll.h>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+// Sleeps the main loop until the next module is due instead of spinning on the clock. Each module
+// registers the RateController that gates it, so the deadlines here always line up with when the
+// module will actually run.
+class LoopScheduler
+{
+  public:
+    LoopScheduler();
+
+    // The rate controller must outlive the scheduler
+    void addTask(const std::string& name, RateController* rate);
+
+    // Descriptor that ends the sleep early when it polls readable, e.g. a new camera pose. It is drained on
+    // waking. Negative descriptors are ignored.
+    void addWakeFd(int fd);
+
+    // Earliest time any registered task is due, capped at max_sleep_ms from now
+    ClockTimePoint getNextDeadline();
+
+    // Sleeps with clock_nanosleep(TIMER_ABSTIME) until getNextDeadline(), or polls the wake descriptors
+    // until then if there are any, and logs any new overruns
+    void sleepUntilNextDeadline();
+
+    uint32_t getOverruns(const std::string& name) const;
+
+  private:
+
+    struct Task
+    {
+        std::string name;
+        RateController* rate;
+        uint32_t reported_overruns;
+    };
+
+    void reportOverruns();
+
+    std::vector<Task> tasks_;
+    std::vector<pollfd> wake_fds_;
+    int max_sleep_us_;
+    RateController report_rate_;
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef Mailbox_h
+#define Mailbox_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Lock-free mailboxes for passing data between threads without blocking either side.
+
+// Fixed capacity single-producer/single-consumer queue of trivially copyable values
+template <class T, size_t N>
+class SpscQueue
+{
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of 2");
+  static_assert(std::is_trivially_copyable<T>::value, "SpscQueue values must be trivially copyable");
+
+  public:
+    SpscQueue()
+    : head_(0),
+      tail_(0)
+    {}
+
+    // Producer side. Returns false if the queue is full.
+    bool push(const T& value)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if(head - tail_.load(std::memory_order_acquire) == N)
+        {
+            return false;
+        }
+        data_[head & (N - 1)] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool pop(T* value)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail == head_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        *value = data_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Copies the oldest value without removing it, returns false if the queue is empty.
+    bool peek(T* value) const
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail == head_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        *value = data_[tail & (N - 1)];
+        return true;
+    }
+
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+    // Exact when called from either side while the other is idle, otherwise a snapshot
+    size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+
+  private:
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+    T data_[N];
+};
+
+// Single writer latest-value mailbox implemented as a seqlock. The writer never waits, readers retry
+// if they raced with a write so they always get a consistent copy of the most recent value.
+template <class T>
+class LatestValueMailbox
+{
+  static_assert(std::is_trivially_copyable<T>::value, "LatestValueMailbox values must be trivially copyable");
+
+  public:
+    LatestValueMailbox()
+    : seq_(0),
+      value_()
+    {}
+
+    void write(const T& value)
+    {
+        const uint32_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&value_, &value, sizeof(T));
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    T read() const
+    {
+        T out;
+        uint32_t before;
+        uint32_t after;
+        do
+        {
+            before = seq_.load(std::memory_order_acquire);
+            std::memcpy(&out, &value_, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = seq_.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        return out;
+    }
+
+  private:
+    std::atomic<uint32_t> seq_;
+    T value_;
+};
+
+// Single writer seqlock around a struct the writer updates in place a few fields at a time. The writer
+// never waits and, being the only writer, can read its own copy directly. Readers retry like
+// LatestValueMailbox so they never see a half applied update.
+template <class T>
+class SeqlockedSection
+{
+  static_assert(std::is_trivially_copyable<T>::value, "SeqlockedSection values must be trivially copyable");
+
+  public:
+    SeqlockedSection()
+    : seq_(0),
+      value_()
+    {}
+
+    // Writer side. Calls f with a reference to the value to modify.
+    template <class F>
+    void write(F&& f)
+    {
+        const uint32_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        f(value_);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    // Writer side only
+    const T& writerView() const { return value_; }
+
+    T read() const
+    {
+        T out;
+        uint32_t before;
+        uint32_t after;
+        do
+        {
+            before = seq_.load(std::memory_order_acquire);
+            std::memcpy(&out, &value_, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = seq_.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        return out;
+    }
+
+  private:
+    std::atomic<uint32_t> seq_;
+    T value_;
+};
+
+#endif
@@ -1,81 +1,261 @@
 #include "MarvelmindWrapper.h"
 #include "constants.h"
+#include "InputRecorder.h"
 #include "plog/Log.h"
 #include <filesystem>
+#include <algorithm>
 
 
-MarvelmindWrapper::MarvelmindWrapper()
-: hedge_(createMarvelmindHedge()),
-  ready_(false)
+MarvelmindClockMapper::MarvelmindClockMapper(float latency_ms, float drift_ppm, float reset_ms)
+: latency_ms_(latency_ms),
+  drift_ppm_(drift_ppm),
+  reset_ms_(reset_ms),
+  have_offset_(false),
+  last_hedge_timestamp_(0),
+  hedge_time_ms_(0),
+  offset_ms_(0),
+  last_arrival_()
 {
-    // I expect to 2 devices connected, but because of the fun of linux and udev rules, I don't know 
-    // which of the three possible names the devices could have. I could later change this to first 
-    // do an `ls /dev/ | grep marvelmind` and find the right ports, but this should work fine too.
-    if(std::filesystem::exists(MARVELMIND_USB_0))
+}
+
+ClockTimePoint MarvelmindClockMapper::map(uint32_t hedge_timestamp, ClockTimePoint arrival)
+{
+    const double arrival_ms = std::chrono::duration<double, std::milli>(arrival.time_since_epoch()).count();
+
+    // Hedge timestamps are 32 bit ms and wrap, so accumulate differences instead
+    if (!have_offset_) hedge_time_ms_ = hedge_timestamp;
+    else hedge_time_ms_ += static_cast<int32_t>(hedge_timestamp - last_hedge_timestamp_);
+    last_hedge_timestamp_ = hedge_timestamp;
+
+    const double sample_ms = arrival_ms - hedge_time_ms_;
+    if (!have_offset_ || fabs(sample_ms - offset_ms_) > reset_ms_)
+    {
+        if (have_offset_) PLOGW.printf("Marvelmind clock offset jumped by %.1f ms, restarting estimate", sample_ms - offset_ms_);
+        offset_ms_ = sample_ms;
+        have_offset_ = true;
+    }
+    else if (sample_ms < offset_ms_)
     {
-        hedge_->ttyFileName = MARVELMIND_USB_0;
-        PLOGI << "Found device " << MARVELMIND_USB_0;
+        offset_ms_ = sample_ms;
     }
-    else if(std::filesystem::exists(MARVELMIND_USB_1))
+    else
     {
-        hedge_->ttyFileName = MARVELMIND_USB_1;
-        PLOGI << "Found device " << MARVELMIND_USB_1;
+        const double elapsed_ms = std::chrono::duration<double, std::milli>(arrival - last_arrival_).count();
+        offset_ms_ = std::min(sample_ms, offset_ms_ + drift_ppm_ * 1e-6 * elapsed_ms);
     }
-    else if(std::filesystem::exists(MARVELMIND_USB_2))
+    last_arrival_ = arrival;
+
+    const double measured_ms = hedge_time_ms_ + offset_ms_ - latency_ms_;
+    return ClockTimePoint(std::chrono::duration_cast<ClockTimePoint::duration>(std::chrono::duration<double, std::milli>(measured_ms)));
+}
+
+
+MarvelmindWrapper::MarvelmindWrapper(bool start_thread)
+: hedges_(),
+  ready_(false),
+  dual_(cfg.lookup("localization.mm_dual.enabled")),
+  poll_period_ms_(cfg.lookup("localization.mm_poll_period_ms")),
+  baseline_angle_(cfg.lookup("localization.mm_dual.baseline_angle")),
+  baseline_length_(cfg.lookup("localization.mm_dual.baseline_length")),
+  baseline_tolerance_(cfg.lookup("localization.mm_dual.baseline_tolerance")),
+  max_skew_ms_(cfg.lookup("localization.mm_dual.max_skew_ms")),
+  hedge_trans_cov_(cfg.lookup("localization.mm_dual.hedge_trans_cov")),
+  hedge_states_(),
+  published_seq_(0),
+  read_seq_(0),
+  mailbox_(),
+  running_(false),
+  thread_()
+{
+    const size_t num_hedges = dual_ ? 2 : 1;
+    for (size_t i = 0; i < num_hedges; i++)
     {
-        hedge_->ttyFileName = MARVELMIND_USB_2;
-        PLOGI << "Found device " << MARVELMIND_USB_2;
+        MarvelmindClockMapper clock_mapper(cfg.lookup("localization.mm_latency_ms"), cfg.lookup("localization.mm_clock_drift_ppm"),
+                                           cfg.lookup("localization.mm_clock_reset_ms"));
+        hedge_states_.push_back({clock_mapper, false, PositionValue(), false, ClockTimePoint()});
     }
-    else
+
+    // I expect to 2 devices connected, but because of the fun of linux and udev rules, I don't know 
+    // which of the three possible names the devices could have. I could later change this to first 
+    // do an `ls /dev/ | grep marvelmind` and find the right ports, but this should work fine too.
+    for (const char* tty_file_name : {MARVELMIND_USB_0, MARVELMIND_USB_1, MARVELMIND_USB_2})
+    {
+        if (hedges_.size() < num_hedges && std::filesystem::exists(tty_file_name))
+        {
+            openHedge(tty_file_name);
+        }
+    }
+    if (hedges_.empty())
     {
         PLOGW << "No marvelmind devices connected";
         return;
     }
+    if (dual_ && hedges_.size() < 2)
+    {
+        PLOGW << "Only one marvelmind device connected, using single hedge positions";
+        dual_ = false;
+    }
 
-    // Now actually try to connect
-    hedge_->verbose = true;
-    startMarvelmindHedge(hedge_);
     ready_ = true;
+    if (start_thread) start();
+}
+
+void MarvelmindWrapper::openHedge(const char* tty_file_name)
+{
+    MarvelmindHedge* hedge = createMarvelmindHedge();
+    hedge->ttyFileName = tty_file_name;
+    hedge->verbose = true;
+    PLOGI << "Found device " << tty_file_name;
+
+    // Now actually try to connect
+    startMarvelmindHedge(hedge);
+    hedges_.push_back(hedge);
+}
+
+void MarvelmindWrapper::start()
+{
+    if (!ready_ || running_) return;
+    running_ = true;
+    thread_ = std::thread(&MarvelmindWrapper::threadLoop, this);
 }
 
-std::vector<float> MarvelmindWrapper::getPositions()
+void MarvelmindWrapper::stop()
 {
-    PositionValue position_data;
-    std::vector<float> output;
-    
-    if (!ready_)
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+}
+
+void MarvelmindWrapper::threadLoop()
+{
+    while (running_)
     {
-        return output;
+        for (MarvelmindHedge* hedge : hedges_)
+        {
+            PositionValue position_data;
+            if (getPositionFromMarvelmindHedge(hedge, &position_data))
+            {
+                ingest(position_data, ClockFactory::getFactoryInstance()->get_clock()->now());
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(poll_period_ms_));
     }
+}
+
+int MarvelmindWrapper::hedgeIndex(const PositionValue& data) const
+{
+    if (!dual_) return 0;
+    if (data.address == MARVELMIND_DEVICE_ID0) return 0;
+    if (data.address == MARVELMIND_DEVICE_ID1) return 1;
+    return -1;
+}
 
-    bool ok = getPositionFromMarvelmindHedge(hedge_, &position_data);
+void MarvelmindWrapper::ingest(const PositionValue& data, ClockTimePoint arrival)
+{
+    //PLOGI.printf("Position data - ready: %i, addr: %i, ts: %i, x: %i, y: %i, a:%f", data.ready, data.address, data.timestamp, data.x, data.y, data.angle);
+    if (!data.ready) return;
+    const int index = hedgeIndex(data);
+    if (index < 0) return;
+    HedgeState& state = hedge_states_[index];
 
-    if (ok)
+    // The library keeps handing back the last position until a new one arrives
+    if (state.have_last_data && data.timestamp == state.last_data.timestamp && data.x == state.last_data.x &&
+        data.y == state.last_data.y && data.angle == state.last_data.angle)
     {
-        //PLOGI.printf("Position data - ready: %i, addr: %i, ts: %i, x: %i, y: %i, a:%f", position_data.ready, position_data.address, position_data.timestamp, position_data.x, position_data.y, position_data.angle);
+        return;
+    }
+    state.have_last_data = true;
+    state.last_data = data;
+    state.time = state.clock_mapper.map(data.timestamp, arrival);
 
-        if (position_data.ready)
-        {
-            output.push_back(position_data.x/1000.0);
-            output.push_back(position_data.y/1000.0);
-            output.push_back(position_data.angle);
-        }
+    if (dual_)
+    {
+        state.fresh = true;
+        publishDual();
+        return;
+    }
+
+    MarvelmindReading reading;
+    reading.x = data.x / 1000.0f;
+    reading.y = data.y / 1000.0f;
+    reading.a = wrap_angle(data.angle * M_PI / 180.0);
+    reading.time = state.time;
+    reading.hedge_timestamp = data.timestamp;
+    reading.dual = false;
+    reading.trans_cov = 0;
+    reading.angle_cov = 0;
+    publish(reading);
+}
+
+void MarvelmindWrapper::publishDual()
+{
+    HedgeState& first = hedge_states_[0];
+    HedgeState& second = hedge_states_[1];
+    if (!first.fresh || !second.fresh) return;
+
+    // Wait for a newer reading of whichever hedge is too far behind the other
+    const float skew_ms = std::chrono::duration<float, std::milli>(second.time - first.time).count();
+    if (fabs(skew_ms) > max_skew_ms_)
+    {
+        if (skew_ms > 0) first.fresh = false;
+        else second.fresh = false;
+        return;
+    }
+    first.fresh = false;
+    second.fresh = false;
+
+    const float x0 = first.last_data.x / 1000.0f;
+    const float y0 = first.last_data.y / 1000.0f;
+    const float dx = second.last_data.x / 1000.0f - x0;
+    const float dy = second.last_data.y / 1000.0f - y0;
+    const float length = sqrt(dx*dx + dy*dy);
+    if (fabs(length - baseline_length_) > baseline_tolerance_)
+    {
+        PLOGW.printf("Marvelmind baseline is %.3f m, expected %.3f m, dropping reading", length, baseline_length_);
+        return;
     }
 
-    return output;
+    // Averaging two independent hedges halves the position variance, the heading variance follows from
+    // the perpendicular error of both ends over the baseline length
+    MarvelmindReading reading;
+    reading.x = x0 + 0.5f * dx;
+    reading.y = y0 + 0.5f * dy;
+    reading.a = wrap_angle(atan2(dy, dx) - baseline_angle_);
+    reading.time = first.time + (second.time - first.time) / 2;
+    reading.hedge_timestamp = std::max(first.last_data.timestamp, second.last_data.timestamp);
+    reading.dual = true;
+    reading.trans_cov = 0.5f * hedge_trans_cov_;
+    reading.angle_cov = 2.0f * hedge_trans_cov_ / (length * length);
+    publish(reading);
+}
+
+void MarvelmindWrapper::publish(MarvelmindReading reading)
+{
+    reading.seq = ++published_seq_;
+    mailbox_.write(reading);
+}
+
+bool MarvelmindWrapper::getLatest(MarvelmindReading* reading)
+{
+    MarvelmindReading latest = mailbox_.read();
+    if (latest.seq == read_seq_) return false;
+    read_seq_ = latest.seq;
+    *reading = latest;
+    InputRecorder::recordMarvelmind(latest);
+    return true;
 }
 
 
 MarvelmindWrapper::~MarvelmindWrapper()
 {
-    if(ready_){
-        stopMarvelmindHedge (hedge_);
+    stop();
+    for (MarvelmindHedge* hedge : hedges_)
+    {
+        stopMarvelmindHedge (hedge);
+        destroyMarvelmindHedge (hedge);
     }
-    destroyMarvelmindHedge (hedge_);
 }
 
 
-
 // MarvelmindWrapper::MarvelmindWrapper()
 // {
 //     marvelmindAPILoad();
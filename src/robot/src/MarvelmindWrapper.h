@@ -1,23 +1,123 @@
 #ifndef MarvelmindWrapper_h
 #define MarvelmindWrapper_h
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
+#include "Mailbox.h"
+#include "utils.h"
+
 extern "C" {
     #include <marvelmind/marvelmind.h>
 }
 
+// Position reading from the hedge pair, stamped with the robot clock time it was measured at
+struct MarvelmindReading
+{
+    float x;                    // m
+    float y;                    // m
+    float a;                    // rad, wrapped to +/- pi
+    ClockTimePoint time;        // Estimated measurement time on the robot clock
+    uint32_t hedge_timestamp;   // Raw timestamp from the hedge (ms)
+    uint32_t seq;               // Incremented for every new reading
+    bool dual;                  // Combined from both hedges, heading from the baseline between them
+    float trans_cov;            // Measurement covariance for dual readings, 0 uses the localization defaults
+    float angle_cov;
+};
+
+// Maps hedge timestamps onto the robot clock. The offset between the two clocks is estimated as the
+// smallest (arrival - hedge time) seen, which is the reading that got through with the least delay.
+// The estimate is allowed to creep up slowly so clock drift is tracked, and restarts if the offset
+// jumps (e.g. the hedge rebooted). latency_ms is the fixed delay that even the fastest reading had.
+class MarvelmindClockMapper
+{
+  public:
+    MarvelmindClockMapper(float latency_ms, float drift_ppm, float reset_ms);
+
+    ClockTimePoint map(uint32_t hedge_timestamp, ClockTimePoint arrival);
+
+    void reset() { have_offset_ = false; };
+
+  private:
+    float latency_ms_;
+    float drift_ppm_;
+    float reset_ms_;
+    bool have_offset_;
+    uint32_t last_hedge_timestamp_;
+    int64_t hedge_time_ms_;             // Unwrapped hedge time
+    double offset_ms_;                  // Robot clock ms minus hedge time
+    ClockTimePoint last_arrival_;
+};
+
+// Polls the hedge on its own thread and publishes the newest reading through a lock-free mailbox,
+// so the main loop never blocks on the marvelmind library and knows how old each reading is.
+//
+// In dual mode both hedges are opened and each reports its own position. Readings of the two that
+// were measured close enough together are combined into one pose at the midpoint, with the heading
+// taken from the baseline between them, which is much less noisy than the angle a single hedge reports.
 class MarvelmindWrapper
 {
   public:
-    MarvelmindWrapper();
+    MarvelmindWrapper(bool start_thread = true);
     ~MarvelmindWrapper();
-    std::vector<float> getPositions();
+
+    void start();
+    void stop();
+
+    // Copies the newest reading into reading, returns false if there is nothing new since the last call
+    bool getLatest(MarvelmindReading* reading);
+
+    // Publishes raw hedge data that arrived at arrival. Called from the poll thread, public for testing.
+    void ingest(const PositionValue& data, ClockTimePoint arrival);
+
+    // Publishes an already combined reading as if it came from the hedges, used to replay recorded inputs
+    void inject(MarvelmindReading reading) { publish(reading); };
+
+    bool isDual() const { return dual_; };
 
   private:
-    MarvelmindHedge* hedge_;
+
+    struct HedgeState
+    {
+        MarvelmindClockMapper clock_mapper;
+        bool have_last_data;
+        PositionValue last_data;
+        bool fresh;                     // Not yet used in a dual reading
+        ClockTimePoint time;
+    };
+
+    void threadLoop();
+    void openHedge(const char* tty_file_name);
+
+    // Index of the hedge state data belongs to, or -1 if it is from an unknown device
+    int hedgeIndex(const PositionValue& data) const;
+
+    void publishDual();
+    void publish(MarvelmindReading reading);
+
+    std::vector<MarvelmindHedge*> hedges_;
     bool ready_;
+    bool dual_;
+    int poll_period_ms_;
+
+    // Dual mode parameters
+    float baseline_angle_;
+    float baseline_length_;
+    float baseline_tolerance_;
+    float max_skew_ms_;
+    float hedge_trans_cov_;
+
+    // Poll thread side
+    std::vector<HedgeState> hedge_states_;
+    uint32_t published_seq_;
+
+    // Reader side
+    uint32_t read_seq_;
 
+    LatestValueMailbox<MarvelmindReading> mailbox_;
+    std::atomic<bool> running_;
+    std::thread thread_;
 };
 
 
@@ -0,0 +1,115 @@
+#include "RealtimeMemory.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <new>
+#include <sys/mman.h>
+#include <plog/Log.h>
+
+namespace
+{
+    thread_local uint64_t thread_allocations = 0;
+}
+
+// Replaces the global allocation functions so allocations can be counted. The nothrow forms call these,
+// and the aligned forms are left to the library.
+void* operator new(size_t size)
+{
+    thread_allocations++;
+    void* p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace RealtimeMemory
+{
+    bool lockAndPrefault(size_t heap_bytes, size_t stack_bytes)
+    {
+        // Freed memory stays in the heap, and large blocks come from it too instead of fresh mmaps that
+        // would fault on first use and be unmapped again when freed
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+
+        bool locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+        if(!locked) PLOGW.printf("Could not lock memory: %s", strerror(errno));
+
+        prefaultStack(stack_bytes);
+        if(heap_bytes > 0)
+        {
+            // Writing every page makes the kernel back it, freeing leaves it at the top of the heap for reuse
+            char* heap = static_cast<char*>(malloc(heap_bytes));
+            if(heap)
+            {
+                for (size_t i = 0; i < heap_bytes; i += 4096) heap[i] = 0;
+                free(heap);
+            }
+        }
+        PLOGI.printf("Prefaulted %zu kB of heap and %zu kB of stack%s", heap_bytes / 1024, stack_bytes / 1024,
+                     locked ? ", memory locked" : "");
+        return locked;
+    }
+
+    // Not inlined so the buffer really is a new frame below the caller
+    __attribute__((noinline)) void prefaultStack(size_t stack_bytes)
+    {
+        volatile char* stack = static_cast<volatile char*>(alloca(stack_bytes));
+        for (size_t i = 0; i < stack_bytes; i += 4096) stack[i] = 0;
+    }
+
+    uint64_t threadAllocations()
+    {
+        return thread_allocations;
+    }
+}
+
+AllocationCounter::AllocationCounter(float window_s)
+: window_s_(window_s),
+  window_timer_(),
+  last_(RealtimeMemory::threadAllocations()),
+  total_(0),
+  current_max_(0),
+  window_max_(0)
+{
+}
+
+void AllocationCounter::markLoop()
+{
+    const uint64_t now = RealtimeMemory::threadAllocations();
+    const uint32_t count = static_cast<uint32_t>(now - last_);
+    last_ = now;
+    total_ += count;
+    current_max_ = std::max(current_max_, count);
+    if(window_timer_.dt_s() >= window_s_)
+    {
+        window_max_ = current_max_;
+        current_max_ = 0;
+        window_timer_.reset();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef RealtimeMemory_h
+#define RealtimeMemory_h
+
+#include <cstddef>
+#include <cstdint>
+
+#include "utils.h"
+
+// Keeps page faults and heap growth off the control path. lockAndPrefault locks everything mapped now and
+// later into RAM and faults in a heap and stack reserve up front. glibc is told to keep freed memory instead
+// of handing it back to the kernel, so later allocations reuse pages that are already resident.
+//
+// Every operator new is counted per thread, which is how the loops report allocations per cycle. Direct
+// malloc calls (OpenCV image buffers, libconfig) aren't counted.
+namespace RealtimeMemory
+{
+    // Returns false if the memory couldn't be locked, the reserves are faulted in either way. Locking needs
+    // CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK.
+    bool lockAndPrefault(size_t heap_bytes, size_t stack_bytes);
+
+    // Touches stack_bytes below the caller's frame so a thread's stack is resident before its loop starts
+    void prefaultStack(size_t stack_bytes);
+
+    // operator new calls made by the calling thread so far
+    uint64_t threadAllocations();
+}
+
+// Counts the allocations a loop makes on its thread, for the per loop counts in the status
+class AllocationCounter
+{
+  public:
+
+    AllocationCounter(float window_s = 1.0);
+
+    // Called at the end of every loop, from the thread running the loop
+    void markLoop();
+
+    // Most allocations made in one loop during the last full window
+    uint32_t windowMax() const { return window_max_; };
+
+    // Allocations by all the loops since construction
+    uint64_t total() const { return total_; };
+
+  private:
+
+    float window_s_;
+    Timer window_timer_;
+    uint64_t last_;
+    uint64_t total_;
+    uint32_t current_max_;      // Of the window still running
+    uint32_t window_max_;
+};
+
+#endif //RealtimeMemory_h
@@ -1,14 +1,15 @@
 #include "RobotController.h"
 
+#include <algorithm>
+#include <chrono>
 #include <math.h>
 #include <plog/Log.h>
 #include <Eigen/Dense>
 
 #include "constants.h"
+#include "ConfigSnapshot.h"
+#include "FlightRecorder.h"
 #include "serial/SerialCommsFactory.h"
-#include "robot_controller_modes/RobotControllerModePosition.h"
-#include "robot_controller_modes/RobotControllerModeVision.h"
-#include "robot_controller_modes/RobotControllerModeStopFast.h"
 
 
 RobotController::RobotController(StatusUpdater& statusUpdater)
@@ -16,107 +17,204 @@ RobotController::RobotController(StatusUpdater& statusUpdater)
   serial_to_motor_driver_(SerialCommsFactory::getFactoryInstance()->get_serial_comms(CLEARCORE_USB)),
   localization_(),
   prevOdomLoopTimer_(),
+  have_driver_time_(false),
+  last_driver_time_us_(0),
+  last_driver_seq_(0),
+  max_driver_dt_(cfg.lookup("motion.max_odom_dt")),
+  lost_odom_reports_(0),
+  driver_rx_dropped_(0),
   cartPos_(),
   cartVel_(),
   trajRunning_(false),
   limits_mode_(LIMITS_MODE::FINE),
-  controller_rate_(cfg.lookup("motion.controller_frequency")),
+  controller_frequency_(cfg.lookup("motion.controller_frequency")),
+  controller_rate_(controller_frequency_),
   logging_rate_(cfg.lookup("motion.log_frequency")),
   log_this_cycle_(false),
   fake_perfect_motion_(cfg.lookup("motion.fake_perfect_motion")),
+  binary_serial_(cfg.lookup("motion.binary_serial")),
+  driver_trajectory_(cfg.lookup("motion.driver_trajectory.enabled")),
+  odometry_stream_(cfg.lookup("motion.odometry_stream.enabled")),
+  report_times_(cfg.lookup("localization.odometry.report_times")),
+  stream_config_({static_cast<uint32_t>(1000000 / static_cast<int>(cfg.lookup("motion.odometry_stream.frequency"))),
+                  static_cast<uint16_t>(std::min(1000 * static_cast<float>(cfg.lookup("motion.odometry_stream.command_timeout")),
+                                                 static_cast<float>(UINT16_MAX)))}),
+  command_keepalive_s_(1.0f / static_cast<int>(cfg.lookup("motion.odometry_stream.command_frequency"))),
+  command_keepalive_timer_(),
+  last_sent_vel_valid_(false),
+  last_sent_vel_({0,0,0}),
   fake_local_cart_vel_(0,0,0),
   max_cart_vel_limit_({cfg.lookup("motion.translation.max_vel.coarse"),
                        cfg.lookup("motion.translation.max_vel.coarse"),
                        cfg.lookup("motion.rotation.max_vel.coarse")}),
-  loop_time_averager_(20)
+  loop_time_averager_(20),
+  trajectory_cache_(),
+  planner_(cfg.lookup("motion.async_planning.enabled") ? new TrajectoryPlanner() : nullptr),
+  pending_plan_(),
+  planning_(false),
+  pending_goal_(),
+  pending_limits_mode_(LIMITS_MODE::FINE),
+  planner_cache_stats_(),
+  telemetry_(cfg.lookup("telemetry.enabled") ?
+             new TelemetryWriter(static_cast<const char*>(cfg.lookup("telemetry.dir")),
+                                 static_cast<int>(cfg.lookup("telemetry.records_per_chunk"))) :
+             nullptr),
+  telemetry_move_id_(0),
+  distance_sensor_(),
+  position_mode_(fake_perfect_motion_, &trajectory_cache_),
+  vision_mode_(fake_perfect_motion_, statusUpdater_, distance_sensor_, localization_),
+  stop_fast_mode_(fake_perfect_motion_),
+  controller_mode_(nullptr)
 {    
     if(fake_perfect_motion_) PLOGW << "Fake robot motion enabled";
+    if(driver_trajectory_ && (!binary_serial_ || fake_perfect_motion_))
+    {
+        PLOGW << "Motor driver trajectories need binary serial and real motion, streaming velocities instead";
+        driver_trajectory_ = false;
+    }
+    if(odometry_stream_ && (!binary_serial_ || fake_perfect_motion_))
+    {
+        PLOGW << "Odometry streaming needs binary serial and real motion, using a report per command instead";
+        odometry_stream_ = false;
+    }
+    if(odometry_stream_ && command_keepalive_s_ * 1000 >= stream_config_.command_timeout_ms)
+    {
+        PLOGW.printf("Command keepalive of %.3f s is longer than the %u ms motor driver timeout", command_keepalive_s_, stream_config_.command_timeout_ms);
+    }
 }
 
 void RobotController::moveToPosition(float x, float y, float a)
 {
-    reset_last_motion_logger();
+    resetMotionLogs();
     limits_mode_ = LIMITS_MODE::COARSE;
     setCartVelLimits(limits_mode_);
     Point goal_pos = Point(x,y,a);
     PLOGI_(MOTION_CSV_LOG_ID).printf("MoveToPosition: %s",goal_pos.toString().c_str());
 
-    auto position_mode = std::make_unique<RobotControllerModePosition>(fake_perfect_motion_);
-    bool ok = position_mode->startMove(cartPos_, goal_pos, limits_mode_);
-   
-    if (ok) 
-    { 
-        startTraj(); 
-        controller_mode_ = std::move(position_mode);
-    }
-    else { statusUpdater_.setErrorStatus(); }
+    startPositionMove(goal_pos);
 }
 
 void RobotController::moveToPositionRelative(float dx_local, float dy_local, float da_local)
 {
-    reset_last_motion_logger();
+    resetMotionLogs();
     limits_mode_ = LIMITS_MODE::COARSE;
     setCartVelLimits(limits_mode_);
 
-    float dx_global =  cos(cartPos_.a) * dx_local - sin(cartPos_.a) * dy_local;
-    float dy_global =  sin(cartPos_.a) * dx_local + cos(cartPos_.a) * dy_local;
-    float da_global = da_local;
-    Point goal_pos = Point(cartPos_.x + dx_global, cartPos_.y + dy_global, wrap_angle(cartPos_.a + da_global));
+    Point goal_pos = composePose(cartPos_, Rotation2D(cartPos_.a), Point(dx_local, dy_local, da_local));
     PLOGI_(MOTION_CSV_LOG_ID).printf("MoveToPositionRelative: %s",goal_pos.toString().c_str());
 
-    auto position_mode = std::make_unique<RobotControllerModePosition>(fake_perfect_motion_);
-    bool ok = position_mode->startMove(cartPos_, goal_pos, limits_mode_);
-   
-    if (ok) 
-    { 
-        startTraj(); 
-        controller_mode_ = std::move(position_mode);
-    }
-    else { statusUpdater_.setErrorStatus(); }
+    startPositionMove(goal_pos);
 }
 
 void RobotController::moveToPositionRelativeSlow(float dx_local, float dy_local, float da_local)
 {
-    reset_last_motion_logger();
+    resetMotionLogs();
     limits_mode_ = LIMITS_MODE::SLOW;
     setCartVelLimits(limits_mode_);
 
-    float dx_global =  cos(cartPos_.a) * dx_local - sin(cartPos_.a) * dy_local;
-    float dy_global =  sin(cartPos_.a) * dx_local + cos(cartPos_.a) * dy_local;
-    float da_global = da_local;
-    Point goal_pos = Point(cartPos_.x + dx_global, cartPos_.y + dy_global, wrap_angle(cartPos_.a + da_global));
+    Point goal_pos = composePose(cartPos_, Rotation2D(cartPos_.a), Point(dx_local, dy_local, da_local));
     PLOGI_(MOTION_CSV_LOG_ID).printf("MoveToPositionRelativeSlow: %s",goal_pos.toString().c_str());
 
-    auto position_mode = std::make_unique<RobotControllerModePosition>(fake_perfect_motion_);
-    bool ok = position_mode->startMove(cartPos_, goal_pos, limits_mode_);
-   
-    if (ok) 
-    { 
-        startTraj(); 
-        controller_mode_ = std::move(position_mode);
-    }
-    else { statusUpdater_.setErrorStatus(); }
+    startPositionMove(goal_pos);
 }
 
 void RobotController::moveToPositionFine(float x, float y, float a)
 {
-    reset_last_motion_logger();
+    resetMotionLogs();
     limits_mode_ = LIMITS_MODE::FINE;
     setCartVelLimits(limits_mode_);
     Point goal_pos = Point(x,y,a);
     PLOGI_(MOTION_CSV_LOG_ID).printf("MoveToPositionFine: %s",goal_pos.toString().c_str());
 
-    auto position_mode = std::make_unique<RobotControllerModePosition>(fake_perfect_motion_);
-    bool ok = position_mode->startMove(cartPos_, goal_pos, limits_mode_);
-   
+    startPositionMove(goal_pos);
+}
+
+void RobotController::resetMotionLogs()
+{
+    // Every new move replaces one that is still being planned
+    planning_ = false;
+    reset_last_motion_logger();
+    telemetry_move_id_++;
+}
+
+void RobotController::logTelemetry()
+{
+    TelemetryRecord record;
+    if(!controller_mode_->takeCycleRecord(&record) || !telemetry_) return;
+    record.move_id = telemetry_move_id_;
+    record.mode = static_cast<uint32_t>(limits_mode_);
+    // Modes without their own filter are driven by the localization estimate
+    if(std::isnan(record.kf_cov[0]))
+    {
+        const Eigen::Vector3f cov = localization_.getCovarianceDiagonal();
+        for (int i = 0; i < 3; i++) record.kf_cov[i] = cov[i];
+    }
+    telemetry_->append(record);
+}
+
+void RobotController::startPositionMove(Point goal_pos)
+{
+    // A move that replaces a running one is planned on the spot. The running trajectory would carry the
+    // robot on while the planner works, away from the pose the new one was planned from.
+    if(planner_ && !trajRunning_)
+    {
+        // The motors hold the robot where it is until the trajectory from here comes back
+        PLOGI.printf("Planning trajectory from %s to %s", cartPos_.toString().c_str(), goal_pos.toString().c_str());
+        pending_plan_ = planner_->submit(buildMotionPlanningProblem(cartPos_, goal_pos, limits_mode_, ConfigSnapshot::current()->solver), limits_mode_);
+        pending_goal_ = goal_pos;
+        pending_limits_mode_ = limits_mode_;
+        planning_ = true;
+        enableAllMotors();
+        return;
+    }
+
+    position_mode_.reset();
+    if(driver_trajectory_) position_mode_.enableDriverTrajectory(serial_to_motor_driver_);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool ok = position_mode_.startMove(cartPos_, goal_pos, limits_mode_);
+    statusUpdater_.updatePlanTiming(0, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+    finishPositionMove(ok);
+}
+
+void RobotController::checkPendingPlan()
+{
+    if(pending_plan_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+    planning_ = false;
+    const PlannedTrajectory plan = pending_plan_.get();
+    PLOGI.printf("Planned trajectory in %.3f ms after waiting %.3f ms", plan.plan_ms, plan.wait_ms);
+    statusUpdater_.updatePlanTiming(plan.wait_ms, plan.plan_ms);
+    planner_cache_stats_ = plan.cache_stats;
+
+    // Holding position put the controller back on the fine limits
+    limits_mode_ = pending_limits_mode_;
+    setCartVelLimits(limits_mode_);
+    position_mode_.reset();
+    if(driver_trajectory_) position_mode_.enableDriverTrajectory(serial_to_motor_driver_);
+    const bool ok = position_mode_.startPlannedMove(pending_goal_, plan.trajectory, limits_mode_);
+    if(!ok) disableAllMotors();
+    finishPositionMove(ok);
+}
+
+void RobotController::finishPositionMove(bool ok)
+{
+    statusUpdater_.updateTrajectoryCacheStats(getCacheStats());
+
     if (ok) 
     { 
         startTraj(); 
-        controller_mode_ = std::move(position_mode);
+        controller_mode_ = &position_mode_;
     }
     else { statusUpdater_.setErrorStatus(); }
 }
 
+TrajectoryCacheStats RobotController::getCacheStats() const
+{
+    TrajectoryCacheStats stats = trajectory_cache_.getStats();
+    stats.hits += planner_cache_stats_.hits;
+    stats.misses += planner_cache_stats_.misses;
+    return stats;
+}
+
 void RobotController::moveConstVel(float vx , float vy, float va, float t)
 {
     (void) vx;
@@ -128,38 +226,80 @@ void RobotController::moveConstVel(float vx , float vy, float va, float t)
 
 void RobotController::moveWithVision(float x, float y, float a)
 {
-    reset_last_motion_logger();
+    resetMotionLogs();
     limits_mode_ = LIMITS_MODE::VISION;
     setCartVelLimits(limits_mode_);
     Point goal = Point(x,y,a);
     PLOGI_(MOTION_CSV_LOG_ID).printf("MoveWithVision: %s",goal.toString().c_str());
-    auto vision_mode = std::make_unique<RobotControllerModeVision>(fake_perfect_motion_, statusUpdater_);
-    bool ok = vision_mode->startMove(goal);
+    vision_mode_.reset();
+    bool ok = vision_mode_.startMove(goal);
    
     if (ok) 
     { 
         startTraj(); 
-        controller_mode_ = std::move(vision_mode);
+        controller_mode_ = &vision_mode_;
+    }
+    else { statusUpdater_.setErrorStatus(); }
+}
+
+void RobotController::updateGoal(float x, float y, float a)
+{
+    Point goal = Point(x,y,a);
+    if(!trajRunning_ || !controller_mode_ || !controller_mode_->updateGoal(goal))
+    {
+        PLOGW.printf("Unable to update goal to %s, no position or vision move running", goal.toString().c_str());
+        return;
+    }
+    PLOGI_(MOTION_CSV_LOG_ID).printf("UpdateGoal: %s",goal.toString().c_str());
+}
+
+void RobotController::moveAlongPath(const std::vector<Point>& waypoints)
+{
+    resetMotionLogs();
+    limits_mode_ = LIMITS_MODE::COARSE;
+    setCartVelLimits(limits_mode_);
+    PLOGI_(MOTION_CSV_LOG_ID).printf("MoveAlongPath: %zu waypoints", waypoints.size());
+    for (const Point& waypoint : waypoints)
+    {
+        PLOGI_(MOTION_CSV_LOG_ID).printf("Waypoint: %s", waypoint.toString().c_str());
+    }
+
+    position_mode_.reset();
+    bool ok = position_mode_.startPath(cartPos_, waypoints, limits_mode_);
+    statusUpdater_.updateTrajectoryCacheStats(getCacheStats());
+
+    if (ok) 
+    { 
+        startTraj(); 
+        controller_mode_ = &position_mode_;
     }
     else { statusUpdater_.setErrorStatus(); }
 }
 
 void RobotController::stopFast()
 {
-    reset_last_motion_logger();
+    resetMotionLogs();
     limits_mode_ = LIMITS_MODE::FINE;
     setCartVelLimits(limits_mode_);
     PLOGI_(MOTION_CSV_LOG_ID).printf("Stop Fast");
 
-    auto stop_fast_mode = std::make_unique<RobotControllerModeStopFast>(fake_perfect_motion_);
-    stop_fast_mode->startMove(cartPos_, cartVel_);
+    stop_fast_mode_.reset();
+    stop_fast_mode_.startMove(cartPos_, cartVel_);
     startTraj(); 
-    controller_mode_ = std::move(stop_fast_mode);
+    controller_mode_ = &stop_fast_mode_;
 }
 
 
 void RobotController::startTraj()
 {
+    // A retuned controller_frequency only takes effect between moves
+    const int frequency = ConfigSnapshot::current()->controller_frequency;
+    if(frequency != controller_frequency_)
+    {
+        PLOGI.printf("Controller frequency %i -> %i Hz", controller_frequency_, frequency);
+        controller_frequency_ = frequency;
+        controller_rate_.setRate(frequency);
+    }
     trajRunning_ = true;
     enableAllMotors();
     PLOGI.printf("Starting move");
@@ -170,36 +310,54 @@ void RobotController::estop()
     PLOGW.printf("Estopping robot control");
     PLOGD_(MOTION_LOG_ID) << "\n====ESTOP====\n";
     trajRunning_ = false;
+    planning_ = false;
     limits_mode_ = LIMITS_MODE::FINE;
     disableAllMotors();
 }
 
 void RobotController::update()
 {    
-    // Ensures controller runs at approximately constant rate
-    if (!controller_rate_.ready()) { return; }
+    // Ensures controller runs at approximately constant rate. A new camera pose during a vision move is used
+    // straight away instead of waiting out the period, which then starts over from this cycle.
+    if(visionMeasurementPending()) { controller_rate_.restart(); }
+    else if (!controller_rate_.ready()) { return; }
+    updateOnce();
+}
+
+bool RobotController::visionMeasurementPending()
+{
+    return trajRunning_ && controller_mode_ == &vision_mode_ && vision_mode_.measurementPending();
+}
+
+void RobotController::updateOnce()
+{
     // Ensures logging doesn't get out of hand
     log_this_cycle_ = logging_rate_.ready();
     
+    // Shared by the mode and the velocity command, cartPos_ only changes again in computeOdometry
+    const Rotation2D cart_rotation(cartPos_.a);
+
+    // Read every cycle so the readings are fresh whenever a vision move starts using them
+    distance_sensor_.update();
+
+    if(planning_) checkPendingPlan();
+
     // Create a command based on the trajectory or not moving
     Velocity target_vel;
     if(trajRunning_)
     {
-        target_vel = controller_mode_->computeTargetVelocity(cartPos_, cartVel_, log_this_cycle_);
+        target_vel = controller_mode_->computeTargetVelocity(cartPos_, cartVel_, cart_rotation, log_this_cycle_);
+        logTelemetry();
         // Check if we are finished with the trajectory
         if (controller_mode_->checkForMoveComplete(cartPos_, cartVel_))
         {
-            PLOGI.printf("Reached goal");
+            const float settle_time = controller_mode_->getSettleTime();
+            PLOGI.printf("Reached goal, settled in %.3f s", settle_time);
             PLOGD_(MOTION_LOG_ID) << "Trajectory complete";
+            statusUpdater_.updateSettleTime(settle_time);
             target_vel = {0,0,0};
             disableAllMotors();
             trajRunning_ = false;
-            // Bit of a hack for reseting angle covariance after vision motion
-            // This avoids weird rotations from error accumlated in the kalman filter
-            if (limits_mode_ == LIMITS_MODE::VISION)
-            {
-                localization_.resetAngleCovariance();
-            }
             // Re-enable fine mode at the end of a trajectory
             limits_mode_ = LIMITS_MODE::FINE;
         }
@@ -216,9 +374,19 @@ void RobotController::update()
         limits_mode_ = LIMITS_MODE::FINE;
     }
 
-    // Run controller and odometry update
-    setCartVelCommand(target_vel);
+    // Run controller and odometry update. While the driver follows the trajectory it only gets corrections
+    // from the mode, a velocity command would make it drop the trajectory.
+    if(!trajRunning_ || !controller_mode_->followedByMotorDriver())
+    {
+        setCartVelCommand(target_vel, cart_rotation);
+    }
+    else
+    {
+        // The driver's own trajectory replaces the last command, so the next one has to go out
+        last_sent_vel_valid_ = false;
+    }
     computeOdometry();
+    readDriverStats();
 
     // Update status 
     statusUpdater_.updatePosition(cartPos_.x, cartPos_.y, cartPos_.a);
@@ -226,6 +394,10 @@ void RobotController::update()
     loop_time_averager_.mark_point();
     statusUpdater_.updateControlLoopTime(loop_time_averager_.get_ms());
     statusUpdater_.updateLocalizationMetrics(localization_.getLocalizationMetrics());
+    statusUpdater_.updateTrajTimeRemaining(trajRunning_ ? controller_mode_->getTimeRemaining() : 0);
+    FlightRecorder::record(FLIGHT_RECORD::CONTROL, trajRunning_ ? 1 : 0, static_cast<uint16_t>(limits_mode_), telemetry_move_id_,
+                           {cartPos_.x, cartPos_.y, cartPos_.a, cartVel_.vx, cartVel_.vy, cartVel_.va,
+                            target_vel.vx, target_vel.vy, target_vel.va, static_cast<float>(loop_time_averager_.get_ms())});
 }
 
 
@@ -233,6 +405,14 @@ void RobotController::enableAllMotors()
 {
     if (serial_to_motor_driver_->isConnected())
     {
+        if(odometry_stream_)
+        {
+            // Sent every time so a driver that reset in between picks it up again
+            uint8_t payload[SERIAL_STREAM_CONFIG_PAYLOAD_SIZE];
+            encodeStreamConfigPayload(stream_config_, payload);
+            serial_to_motor_driver_->send_frame(SERIAL_BINARY_CHANNEL::STREAM_CONFIG, payload, SERIAL_STREAM_CONFIG_PAYLOAD_SIZE);
+            last_sent_vel_valid_ = false;
+        }
         serial_to_motor_driver_->send("base:Power:ON");
         PLOGI << "Motors enabled";
         PLOGD_(MOTION_LOG_ID) << "Motors enabled";
@@ -259,13 +439,17 @@ void RobotController::disableAllMotors()
 
 void RobotController::inputPosition(float x, float y, float a)
 {
-    bool last_mm_used = false;
-    if(limits_mode_ == LIMITS_MODE::FINE || limits_mode_ == LIMITS_MODE::COARSE)
-    {
-        localization_.updatePositionReading({x,y,a});
-        cartPos_ = localization_.getPosition();
-        last_mm_used = true;
-    }
+    inputPosition(x, y, a, ClockFactory::getFactoryInstance()->get_clock()->now());
+}
+
+void RobotController::inputPosition(float x, float y, float a, ClockTimePoint measured_time, float trans_cov, float angle_cov)
+{
+    // Vision moves steer by the camera frame, so the field estimate keeps taking readings through them and is
+    // still converged when the next position move starts
+    bool last_mm_used = localization_.updatePositionReading({x,y,a}, measured_time, trans_cov, angle_cov);
+    const float age = clockToSeconds(ClockFactory::getFactoryInstance()->get_clock()->now()) - clockToSeconds(measured_time);
+    FlightRecorder::record(FLIGHT_RECORD::POSITION, last_mm_used ? 1 : 0, 0, 0, {x, y, a, trans_cov, angle_cov, age});
+    cartPos_ = localization_.getPosition();
     statusUpdater_.updateLastMarvelmindPose({x,y,a}, last_mm_used);
 }
 
@@ -277,85 +461,182 @@ void RobotController::forceSetPosition(float x, float y, float a)
 
 void RobotController::setCartVelLimits(LIMITS_MODE limits_mode)
 {
-    if(limits_mode == LIMITS_MODE::VISION)
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    float trans_max_vel = config->translation.limits(limits_mode).max_vel;
+    float rot_max_vel = config->rotation.limits(limits_mode).max_vel;
+    if(config->coupledPlanning(limits_mode))
     {
-        max_cart_vel_limit_ = { cfg.lookup("motion.translation.max_vel.vision"), 
-                                cfg.lookup("motion.translation.max_vel.vision"), 
-                                cfg.lookup("motion.rotation.max_vel.vision")};
+        // Same velocity limits the coupled planner used
+        trans_max_vel = config->wheel_limits.max_vel;
+        rot_max_vel = config->wheel_limits.max_vel / config->wheel_limits.base_radius;
     }
-    else if(limits_mode == LIMITS_MODE::FINE || limits_mode == LIMITS_MODE::SLOW)
+    max_cart_vel_limit_ = {trans_max_vel, trans_max_vel, rot_max_vel};
+}
+
+bool RobotController::readMsgFromMotorDriver(Velocity* decodedVelocity, float* dt)
+{
+    if (!serial_to_motor_driver_->isConnected())
     {
-        max_cart_vel_limit_ = { cfg.lookup("motion.translation.max_vel.fine"), 
-                                cfg.lookup("motion.translation.max_vel.fine"), 
-                                cfg.lookup("motion.rotation.max_vel.fine")};
+        return false;
     }
-    else
+
+    if (binary_serial_)
     {
-        max_cart_vel_limit_ = { cfg.lookup("motion.translation.max_vel.coarse"), 
-                                cfg.lookup("motion.translation.max_vel.coarse"), 
-                                cfg.lookup("motion.rotation.max_vel.coarse")};
+        SerialOdometry odom;
+        if(!serial_to_motor_driver_->rcv_base_odometry(&odom))
+        {
+            return false;
+        }
+        *decodedVelocity = {odom.vel.vx, odom.vel.vy, odom.vel.va};
+        *dt = odometryDt(true, odom.timestamp_us, odom.seq);
+        return true;
     }
-}
 
-bool RobotController::readMsgFromMotorDriver(Velocity* decodedVelocity)
-{
-    std::string msg = "";
-    std::vector<float> tmpVelocity = {0,0,0};
-    if (serial_to_motor_driver_->isConnected())
+    // Text reports are "vx,vy,va,timestamp_us,seq", older firmware only sends the velocities
+    for(std::string msg = serial_to_motor_driver_->rcv_base(); !msg.empty(); msg = serial_to_motor_driver_->rcv_base())
     {
-        int count = 0;
-        while(msg.empty() && count++ < 10)
+        std::vector<std::string> fields = parseCommaDelimitedString(msg);
+        if(fields.size() != 3 && fields.size() != 5)
+        {
+            PLOGW.printf("Decode failed");
+            continue;
+        }
+        decodedVelocity->vx = std::stof(fields[0]);
+        decodedVelocity->vy = std::stof(fields[1]);
+        decodedVelocity->va = std::stof(fields[2]);
+        if(fields.size() == 5)
+        {
+            *dt = odometryDt(true, static_cast<uint32_t>(std::stoul(fields[3])), static_cast<uint16_t>(std::stoul(fields[4])));
+        }
+        else
         {
-            msg = serial_to_motor_driver_->rcv_base();
+            *dt = odometryDt(false, 0, 0);
         }
+        return true;
     }
+    return false;
+}
 
-    if (msg.empty())
+void RobotController::sendBaseVelocity(SerialVelocity vel)
+{
+    // Odometry doesn't depend on commands while streaming, so an unchanged one only has to beat the driver timeout
+    if(odometry_stream_ && last_sent_vel_valid_ && sameFixedVelocity(vel, last_sent_vel_) &&
+       command_keepalive_timer_.dt_s() < command_keepalive_s_)
     {
-        return false;
+        return;
     }
-    else
+    serial_to_motor_driver_->send_base_velocity(vel);
+    FlightRecorder::record(FLIGHT_RECORD::MOTOR_COMMAND, 1, 0, 0, {vel.vx, vel.vy, vel.va});
+    last_sent_vel_ = vel;
+    last_sent_vel_valid_ = true;
+    command_keepalive_timer_.reset();
+}
+
+void RobotController::readDriverStats()
+{
+    SerialDriverStats stats;
+    while(serial_to_motor_driver_->rcv_driver_stats(&stats))
     {
-        tmpVelocity = parseCommaDelimitedStringToFloat(msg);
-        if(tmpVelocity.size() != 3)
+        if(stats.rx_dropped != driver_rx_dropped_)
         {
-            PLOGW.printf("Decode failed");
-            return false;
+            PLOGW.printf("Motor driver dropped %u oversized messages, %u total",
+                static_cast<uint16_t>(stats.rx_dropped - driver_rx_dropped_), stats.rx_dropped);
+            driver_rx_dropped_ = stats.rx_dropped;
         }
+        statusUpdater_.updateDriverLoopTime(stats.loop_mean_us, stats.loop_max_us);
     }
-    decodedVelocity->vx = tmpVelocity[0];
-    decodedVelocity->vy = tmpVelocity[1];
-    decodedVelocity->va = tmpVelocity[2];
-    return true;
+}
+
+float RobotController::odometryDt(bool has_timestamp, uint32_t timestamp_us, uint16_t seq)
+{
+    // The pi clock is kept running either way for the fallback
+    float pi_dt = prevOdomLoopTimer_.dt_s();
+    prevOdomLoopTimer_.reset();
+    if(!has_timestamp)
+    {
+        have_driver_time_ = false;
+        return pi_dt;
+    }
+
+    bool had_driver_time = have_driver_time_;
+    // Unsigned subtraction handles micros() and seq wrapping
+    uint32_t driver_dt_us = timestamp_us - last_driver_time_us_;
+    uint16_t lost = static_cast<uint16_t>(seq - last_driver_seq_ - 1);
+    have_driver_time_ = true;
+    last_driver_time_us_ = timestamp_us;
+    last_driver_seq_ = seq;
+    if(!had_driver_time)
+    {
+        return pi_dt;
+    }
+
+    float driver_dt = driver_dt_us / 1000000.0f;
+    if(driver_dt_us == 0 || driver_dt > max_driver_dt_)
+    {
+        PLOGW.printf("Motor driver timestamp jumped by %.3f s, using pi clock for odometry", driver_dt);
+        return pi_dt;
+    }
+    if(lost != 0)
+    {
+        // The velocity in this report is assumed to hold over the gap
+        lost_odom_reports_ += lost;
+        PLOGW.printf("Lost %u motor driver velocity reports, %u total", lost, lost_odom_reports_);
+    }
+    return driver_dt;
 }
 
 void RobotController::computeOdometry()
 {  
     Velocity local_cart_vel = {0,0,0};
+    float dt = 0;
     if(fake_perfect_motion_)
     {
         local_cart_vel = fake_local_cart_vel_;
+        dt = odometryDt(false, 0, 0);
+        localization_.updateVelocityReading(local_cart_vel, dt);
     }
-    else if(!readMsgFromMotorDriver(&local_cart_vel)) { return; }
-    
-    Velocity zero = {0,0,0};
-    if(trajRunning_ || !(local_cart_vel == zero))
+    else
     {
-        PLOGD_IF_(MOTION_LOG_ID, log_this_cycle_).printf("Decoded velocity: %.3f, %.3f, %.3f\n", local_cart_vel.vx, local_cart_vel.vy, local_cart_vel.va);
+        // Every report is integrated over the interval it covers, even if several arrived since the last loop.
+        // Anything past MAX_ODOM_REPORTS_PER_CYCLE waits in the serial queue for the next cycle.
+        Velocity velocities[MAX_ODOM_REPORTS_PER_CYCLE];
+        float dts[MAX_ODOM_REPORTS_PER_CYCLE];
+        int num_reports = 0;
+        while(num_reports < MAX_ODOM_REPORTS_PER_CYCLE && readMsgFromMotorDriver(&local_cart_vel, &dt))
+        {
+            Velocity zero = {0,0,0};
+            if(trajRunning_ || !(local_cart_vel == zero))
+            {
+                PLOGD_IF_(MOTION_LOG_ID, log_this_cycle_).printf("Decoded velocity: %.3f, %.3f, %.3f, dt: %.4f\n", local_cart_vel.vx, local_cart_vel.vy, local_cart_vel.va, dt);
+            }
+            velocities[num_reports] = local_cart_vel;
+            dts[num_reports] = dt;
+            num_reports++;
+        }
+
+        // The newest report is taken as ending now and the older ones end a driver dt apart before it, so a
+        // delayed position reading lands between the reports it was measured between
+        const ClockTimePoint now = ClockFactory::getFactoryInstance()->get_clock()->now();
+        float later_s = 0;
+        ClockTimePoint times[MAX_ODOM_REPORTS_PER_CYCLE];
+        for (int i = num_reports - 1; i >= 0; i--)
+        {
+            times[i] = report_times_ ? now - std::chrono::duration_cast<ClockTimePoint::duration>(std::chrono::duration<float>(later_s)) : now;
+            later_s += dts[i];
+        }
+        for (int i = 0; i < num_reports; i++)
+        {
+            localization_.updateVelocityReading(velocities[i], dts[i], times[i]);
+        }
     }
     // Bypassing motor feedback and just using fake_local_cart_vel_ here may give better performance, but its hard to tell.
 
-    // Compute time since last odom update
-    float dt = prevOdomLoopTimer_.dt_s();
-    prevOdomLoopTimer_.reset();
-
-    localization_.updateVelocityReading(local_cart_vel, dt);
     cartPos_ = localization_.getPosition();
     cartVel_ = localization_.getVelocity();
 
 }
 
-void RobotController::setCartVelCommand(Velocity target_vel)
+void RobotController::setCartVelCommand(Velocity target_vel, const Rotation2D& cart_rotation)
 {
     if (trajRunning_) 
     {
@@ -363,12 +644,7 @@ void RobotController::setCartVelCommand(Velocity target_vel)
     }
 
     // Convert input global velocities to local velocities
-    Velocity local_cart_vel;
-    float cA = cos(cartPos_.a);
-    float sA = sin(cartPos_.a);
-    local_cart_vel.vx =  cA * target_vel.vx + sA * target_vel.vy;
-    local_cart_vel.vy = -sA * target_vel.vx + cA * target_vel.vy;
-    local_cart_vel.va = target_vel.va;
+    Velocity local_cart_vel = cart_rotation.toLocal(target_vel);
 
     // Cap velocity for safety
     if(fabs(local_cart_vel.vx) > max_cart_vel_limit_.vx) 
@@ -393,22 +669,25 @@ void RobotController::setCartVelCommand(Velocity target_vel)
         local_cart_vel.va = clamped_vel;
     }
 
-    // Prep velocity data to send to motor driver
-    char buff[100];
-    sprintf(buff, "base:%.4f,%.4f,%.4f",local_cart_vel.vx, local_cart_vel.vy, local_cart_vel.va);
-    std::string s = buff;
-
     if (local_cart_vel.vx != 0 || local_cart_vel.vy != 0 || local_cart_vel.va != 0 )
     {
-        PLOGD_IF_(MOTION_LOG_ID, log_this_cycle_).printf("Sending to motors: [%s]", s.c_str());
+        PLOGD_IF_(MOTION_LOG_ID, log_this_cycle_).printf("Sending to motors: [%.4f,%.4f,%.4f]", local_cart_vel.vx, local_cart_vel.vy, local_cart_vel.va);
     }
 
     if(fake_perfect_motion_)
     {
         fake_local_cart_vel_ = local_cart_vel;
     }
+    else if (serial_to_motor_driver_->isConnected() && binary_serial_)
+    {
+        sendBaseVelocity({local_cart_vel.vx, local_cart_vel.vy, local_cart_vel.va});
+    }
     else if (serial_to_motor_driver_->isConnected())
     {
-        serial_to_motor_driver_->send(s);
+        // Prep velocity data to send to motor driver
+        char buff[100];
+        sprintf(buff, "base:%.4f,%.4f,%.4f",local_cart_vel.vx, local_cart_vel.vy, local_cart_vel.va);
+        serial_to_motor_driver_->send(buff);
+        FlightRecorder::record(FLIGHT_RECORD::MOTOR_COMMAND, 0, 0, 0, {local_cart_vel.vx, local_cart_vel.vy, local_cart_vel.va});
     }
 }
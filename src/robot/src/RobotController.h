@@ -1,12 +1,22 @@
 #ifndef RobotController_h
 #define RobotController_h
 
+#include "Se2.h"
 #include "SmoothTrajectoryGenerator.h"
+#include "TrajectoryCache.h"
+#include "TrajectoryPlanner.h"
 #include "StatusUpdater.h"
 #include "serial/SerialComms.h"
 #include "utils.h"
 #include "Localization.h"
-#include "robot_controller_modes/RobotControllerModeBase.h"
+#include "DistanceSensor.h"
+#include "Telemetry.h"
+#include "robot_controller_modes/RobotControllerModePosition.h"
+#include "robot_controller_modes/RobotControllerModeVision.h"
+#include "robot_controller_modes/RobotControllerModeStopFast.h"
+
+// Most motor driver odometry reports integrated in one cycle
+#define MAX_ODOM_REPORTS_PER_CYCLE 16
 
 class RobotController
 {
@@ -15,6 +25,10 @@ class RobotController
     // Constructor
     RobotController(StatusUpdater& statusUpdater);
 
+    // The modes point back into the controller
+    RobotController(const RobotController&) = delete;
+    RobotController& operator=(const RobotController&) = delete;
+
     // Command robot to move a specific position with low accuracy
     void moveToPosition(float x, float y, float a);
 
@@ -32,11 +46,23 @@ class RobotController
 
     void moveWithVision(float x, float y, float a);
 
+    // Command robot to move through a series of global positions without stopping at each one
+    void moveAlongPath(const std::vector<Point>& waypoints);
+
+    // Sends the running position or vision move to a new goal, in the frame the move was started in, without
+    // stopping first. Limits, tolerances and the move's completion stay as they were. Only warns if nothing
+    // that can be retargeted is running.
+    void updateGoal(float x, float y, float a);
+
     void stopFast();
 
     // Main update loop. Should be called as fast as possible
     void update();
 
+    // Runs a single control cycle immediately, bypassing the rate limiter. Used by ControlLoop when the
+    // controller has its own thread and timing.
+    void updateOnce();
+
     // Enable all motors at once
     void enableAllMotors();
 
@@ -46,53 +72,122 @@ class RobotController
     // Provide a position reading from the MarvelMind sensors
     void inputPosition(float x, float y, float a);
 
+    // Same for a reading measured at measured_time, which is applied against the odometry since then.
+    // Covariances of 0 use the configured marvelmind measurement covariance.
+    void inputPosition(float x, float y, float a, ClockTimePoint measured_time, float trans_cov = 0, float angle_cov = 0);
+
     // Force the position to a specific value, bypassing localization algorithms (used for testing/debugging)
     void forceSetPosition(float x, float y, float a);
 
-    // Indicates if a trajectory is currently active
-    bool isTrajectoryRunning() { return trajRunning_; };
+    // Indicates if a trajectory is currently active, or being planned
+    bool isTrajectoryRunning() { return trajRunning_ || planning_; };
+
+    // True during a vision move when the camera tracker has a pose the controller hasn't used yet
+    bool visionMeasurementPending();
 
     // Stops the currently running motion
     void estop();
 
     Point getCurrentPosition() { return cartPos_; };
 
+    // Rate limiter for update(), used by the main loop scheduler
+    RateController* getControllerRate() { return &controller_rate_; };
+
+    // Follows motion.controller_frequency in the config snapshot, which is picked up as each move starts
+    int getControllerFrequency() const { return controller_frequency_; };
+
   private:
 
     //Internal methods
     // Set the global cartesian velocity command
-    void setCartVelCommand(Velocity target_vel);
+    void setCartVelCommand(Velocity target_vel, const Rotation2D& cart_rotation);
     // Update loop for motor objects
     void updateMotors();
     // Calculate wheel odometry
     void computeOdometry();
     // Sets up everything to start the trajectory running
     void startTraj();
-    // Reads an incoming message from the motor driver and fills the decoded
-    // velocity in the pointer, if available. Returns true if velocity is filled, false otherwise
-    bool readMsgFromMotorDriver(Velocity* decodedVelocity);
+    // Reads the oldest velocity report from the motor driver and fills the decoded velocity and the
+    // time it covers, if available. Returns true if velocity and dt are filled, false otherwise
+    bool readMsgFromMotorDriver(Velocity* decodedVelocity, float* dt);
+    // Integration dt for a report. Uses the motor driver clock so serial and pi scheduling latency
+    // don't leak into odometry, falling back to the pi clock when the report isn't stamped.
+    float odometryDt(bool has_timestamp, uint32_t timestamp_us, uint16_t seq);
+    // Passes any loop time reports from the motor driver on to the status
+    void readDriverStats();
+    // Sends a binary velocity command, skipping ones the driver is already running while it streams odometry
+    void sendBaseVelocity(SerialVelocity vel);
 
     void setCartVelLimits(LIMITS_MODE limits_mode);
 
+    // Starts the motion logs over for a new move
+    void resetMotionLogs();
+
+    // Adds the record of the last controller cycle to the binary telemetry
+    void logTelemetry();
+
+    // Shared setup for all the position mode moves
+    void startPositionMove(Point goal_pos);
+
+    // Starts the move once the planner has its trajectory, called every cycle while planning_
+    void checkPendingPlan();
+
+    // Common end of starting a position mode move
+    void finishPositionMove(bool ok);
+
+    // Both trajectory caches together
+    TrajectoryCacheStats getCacheStats() const;
+
     // Member variables
     StatusUpdater& statusUpdater_;         // Reference to status updater object to input status info about the controller
     SerialCommsBase* serial_to_motor_driver_;   // Serial connection to motor driver
-    Localization localization_;            // Object that handles localization
+    Localization localization_;            // Field and camera frame estimates every mode reads
     Timer prevOdomLoopTimer_;              // Timer for odom loop
+    bool have_driver_time_;                // If last_driver_time_us_ and last_driver_seq_ are from a previous report
+    uint32_t last_driver_time_us_;         // Motor driver timestamp of the last velocity report
+    uint16_t last_driver_seq_;             // Sequence number of the last velocity report
+    float max_driver_dt_;                  // Driver timestamps further apart than this are treated as a driver reset
+    uint32_t lost_odom_reports_;           // Velocity reports missing from the sequence
+    uint16_t driver_rx_dropped_;           // Text messages the motor driver has reported dropping
     Point cartPos_;                        // Current cartesian position
     Velocity cartVel_;                     // Current cartesian velocity
     bool trajRunning_;                     // If a trajectory is currently active
     LIMITS_MODE limits_mode_;              // Which limits mode is being used.
+    int controller_frequency_;             // Hz controller_rate_ is set to
     RateController controller_rate_;       // Rate limit controller loops
     RateController logging_rate_ ;         // Rate limit logging to file
     bool log_this_cycle_;                  // Trigger for logging this cycle
     bool fake_perfect_motion_;             // Flag used for testing to enable perfect motion without clearcore
+    bool binary_serial_;                   // Exchange velocities with the motor driver as binary frames instead of text
+    bool driver_trajectory_;               // Upload point to point trajectories for the motor driver to follow
+    bool odometry_stream_;                 // Motor driver streams odometry on its own, unchanged commands only go out as a keepalive
+    bool report_times_;                    // Time each odometry report read in a cycle by the driver dts
+    SerialStreamConfig stream_config_;     // Sent to the driver whenever the motors are enabled
+    float command_keepalive_s_;            // Longest an unchanged command goes without being resent while streaming
+    Timer command_keepalive_timer_;        // Time since the last velocity command went to the driver
+    bool last_sent_vel_valid_;             // If last_sent_vel_ is what the driver is running
+    SerialVelocity last_sent_vel_;         // Last velocity command sent to the driver
     Velocity fake_local_cart_vel_;         // Commanded local cartesian velocity used to fake perfect motion
     Velocity max_cart_vel_limit_;          // Maximum velocity allowed, used to limit commanded velocity
 
     TimeRunningAverage loop_time_averager_;        // Handles keeping average of the loop timing
-
-    std::unique_ptr<RobotControllerModeBase> controller_mode_;
+    TrajectoryCache trajectory_cache_;             // Solved trajectories shared by all position moves
+    std::unique_ptr<TrajectoryPlanner> planner_;   // Plans point to point moves off this thread, null when disabled
+    std::future<PlannedTrajectory> pending_plan_;  // Plan the controller is holding position for
+    bool planning_;                                // If pending_plan_ is still wanted
+    Point pending_goal_;                           // Goal and limits of the move pending_plan_ is for
+    LIMITS_MODE pending_limits_mode_;
+    TrajectoryCacheStats planner_cache_stats_;     // planner_'s cache, as of the last plan
+    std::unique_ptr<TelemetryWriter> telemetry_;   // Binary control cycle log, null when disabled
+    uint32_t telemetry_move_id_;                   // Move counter stamped on the telemetry records
+    DistanceSensor distance_sensor_;               // Range to the tiles ahead, used by vision moves
+
+    // One instance of each mode is kept and reset for every move, so starting one, and especially a stop
+    // fast from the camera trigger, never has to build a trajectory generator or filter
+    RobotControllerModePosition position_mode_;
+    RobotControllerModeVision vision_mode_;
+    RobotControllerModeStopFast stop_fast_mode_;
+    RobotControllerModeBase* controller_mode_;     // Mode of the running or last move, null before the first
 
 };
 
@@ -3,195 +3,410 @@
 #include <ArduinoJson/ArduinoJson.h>
 #include <plog/Log.h>
 
+#include "ConfigSnapshot.h"
+#include "Se2.h"
 #include "sockets/SocketMultiThreadWrapperFactory.h"
 
 #include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <random>
+
+namespace
+{
+    // JSON commands are parsed from a read only buffer, so ArduinoJson copies the keys and string values into the
+    // document too. This is more than the strings of any one command add up to.
+    constexpr size_t COMMAND_JSON_STRINGS = 128;
+
+    // A queued move_path with MAX_PATH_WAYPOINTS points
+    constexpr size_t MOVE_PATH_JSON_SIZE = JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(1) +
+                                           JSON_ARRAY_SIZE(MAX_PATH_WAYPOINTS) + MAX_PATH_WAYPOINTS * JSON_ARRAY_SIZE(3);
+
+    // A queued field_plan_upload with FIELD_PLAN_CHUNK_STEPS steps, each flattened to four values
+    constexpr size_t FIELD_PLAN_JSON_SIZE = JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(4 * FIELD_PLAN_CHUNK_STEPS);
+
+    constexpr size_t COMMAND_JSON_SIZE = std::max(MOVE_PATH_JSON_SIZE, FIELD_PLAN_JSON_SIZE) + COMMAND_JSON_STRINGS;
+
+    // Unpacks num_floats little endian floats from a binary payload, returns false if the size is wrong
+    bool unpackFloats(std::string_view payload, float* out, size_t num_floats)
+    {
+        if(payload.size() != num_floats * sizeof(float))
+        {
+            return false;
+        }
+        std::memcpy(out, payload.data(), payload.size());
+        return true;
+    }
+
+    // POSITION and SET_POSE payload, three floats optionally followed by a double measurement time when allow_time is set
+    bool unpackPosition(std::string_view payload, bool allow_time, RobotServer::PositionData* pos, bool* time_valid,
+                        ClockTimePoint* time)
+    {
+        float data[3];
+        const size_t pos_size = 3 * sizeof(float);
+        *time_valid = allow_time && payload.size() == pos_size + sizeof(double);
+        if(!unpackFloats(payload.substr(0, pos_size), data, 3) || !(*time_valid || payload.size() == pos_size))
+        {
+            *time_valid = false;
+            return false;
+        }
+        *pos = {data[0], data[1], data[2]};
+        if(*time_valid)
+        {
+            double t;
+            std::memcpy(&t, payload.data() + pos_size, sizeof(t));
+            *time = secondsToClock(t);
+        }
+        return true;
+    }
+
+    // Whether the chunk could be part of a plan, the journal checks it follows on from what it already has
+    bool checkFieldPlanChunk(const RobotServer::FieldPlanChunk& chunk)
+    {
+        if(chunk.num_steps <= 0 || chunk.num_steps > FIELD_PLAN_CHUNK_STEPS || chunk.total > FIELD_PLAN_MAX_STEPS ||
+           chunk.first < 0 || chunk.first + chunk.num_steps > chunk.total)
+        {
+            return false;
+        }
+        for(int i = 0; i < chunk.num_steps; i++)
+        {
+            if(!isFieldPlanCmd(static_cast<COMMAND>(chunk.steps[i].cmd))) return false;
+        }
+        return true;
+    }
+}
 
 RobotServer::RobotServer(StatusUpdater& statusUpdater)
 : moveData_(),
+  pathData_(),
+  fieldPlanChunk_(),
   positionData_(),
+  positionPending_(false),
+  positionTimeValid_(false),
+  positionTime_(),
   velocityData_(),
+  queueRequested_(false),
+  commandSeq_(0),
   statusUpdater_(statusUpdater),
-  recvInProgress_(false),
-  recvIdx_(0),
-  buffer_(""),
-  socket_(SocketMultiThreadWrapperFactory::getFactoryInstance()->get_socket())
+  statusPushHz_(0),
+  statusPushMask_(STATUS_GROUP_ALL),
+  statusPushRate_(1),
+  udp_(nullptr),
+  udpHaveSeq_(false),
+  udpLastSeq_(0),
+  udpPositionPending_(false),
+  udpPosition_(),
+  udpPositionTimeValid_(false),
+  udpPositionTime_(),
+  udpPeerTimer_(),
+  udpPeerTimeoutMs_(cfg.lookup("udp.peer_timeout_ms")),
+  udpStatusHz_(cfg.lookup("udp.status_hz")),
+  udpStatusRate_(std::max(1, udpStatusHz_)),
+  udpStatusSeq_(0),
+  monitor_(nullptr),
+  monitorRate_(cfg.lookup("monitor.status_hz")),
+  lastPingRttMs_(0),
+  planner_(),
+  framer_(),
+  outbox_(),
+  outboxFrameEnds_(),
+  socket_(SocketMultiThreadWrapperFactory::getFactoryInstance()->get_socket()),
+  connectionId_(0),
+  sessionId_(0),
+  txFrames_(0),
+  replay_(),
+  replayBytes_(0),
+  replayLimit_(static_cast<int>(cfg.lookup("session.replay_bytes"))),
+  replayFrom_(0)
 {
+    if(cfg.lookup("udp.enabled"))
+    {
+        udp_ = SocketMultiThreadWrapperFactory::getFactoryInstance()->get_udp_channel();
+    }
+    if(cfg.lookup("monitor.enabled"))
+    {
+        monitor_ = SocketMultiThreadWrapperFactory::getFactoryInstance()->get_monitor_server();
+    }
 }
 
-COMMAND RobotServer::getCommand(std::string message)
+COMMAND RobotServer::getCommand(std::string_view message)
 {
-    COMMAND cmd = COMMAND::NONE;
-    StaticJsonDocument<256> doc;
-    DeserializationError err = deserializeJson(doc, message);
-
+    StaticJsonDocument<COMMAND_JSON_SIZE> doc;
+    DeserializationError err = deserializeJson(doc, message.data(), message.size());
     if(err)
     {
         printIncomingCommand(message);
-        PLOGI.printf("Error parsing JSON: ");
-        PLOGI.printf(err.c_str());   
+        PLOGI.printf("Error parsing JSON: %s", err.c_str());
         sendErr("bad_json");
+        return COMMAND::NONE;
     }
-    else
+
+    const char* type_field = doc["type"].as<const char*>();
+    const std::string_view type = type_field ? type_field : "";
+    const CommandSpec* spec = findCommand(type);
+    if(!spec)
     {
-        std::string type = doc["type"];
-        if(type == "move")
-        {
-            cmd = COMMAND::MOVE;
-            moveData_.x = doc["data"]["x"];
-            moveData_.y = doc["data"]["y"];
-            moveData_.a = doc["data"]["a"];
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "move_rel")
-        {
-            cmd = COMMAND::MOVE_REL;
-            moveData_.x = doc["data"]["x"];
-            moveData_.y = doc["data"]["y"];
-            moveData_.a = doc["data"]["a"];
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "move_rel_slow")
-        {
-            cmd = COMMAND::MOVE_REL_SLOW;
-            moveData_.x = doc["data"]["x"];
-            moveData_.y = doc["data"]["y"];
-            moveData_.a = doc["data"]["a"];
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "move_fine")
-        {
-            cmd = COMMAND::MOVE_FINE;
-            moveData_.x = doc["data"]["x"];
-            moveData_.y = doc["data"]["y"];
-            moveData_.a = doc["data"]["a"];
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "move_fine_stop_vision")
-        {
-            cmd = COMMAND::MOVE_FINE_STOP_VISION;
-            moveData_.x = doc["data"]["x"];
-            moveData_.y = doc["data"]["y"];
-            moveData_.a = doc["data"]["a"];
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "move_vision")
-        {
-            cmd = COMMAND::MOVE_WITH_VISION;
-            moveData_.x = doc["data"]["x"];
-            moveData_.y = doc["data"]["y"];
-            moveData_.a = doc["data"]["a"];
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "move_const_vel")
-        {
-            cmd = COMMAND::MOVE_CONST_VEL;
-            velocityData_.vx = doc["data"]["vx"];
-            velocityData_.vy = doc["data"]["vy"];
-            velocityData_.va = doc["data"]["va"];
-            velocityData_.t = doc["data"]["t"];
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "place")
-        {
-            cmd = COMMAND::PLACE_TRAY;
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "load")
-        {
-            cmd = COMMAND::LOAD_TRAY;
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "init")
-        {
-            cmd = COMMAND::INITIALIZE_TRAY;
-            printIncomingCommand(message);
-            sendAck(type);
-        }
-        else if(type == "p")
-        {
-            cmd = COMMAND::POSITION;
-            positionData_.x = doc["data"]["x"];
-            positionData_.y = doc["data"]["y"];
-            positionData_.a = doc["data"]["a"];
-            sendAck(type);
-        }
-        else if(type == "set_pose")
-        {
-            cmd = COMMAND::SET_POSE;
-            positionData_.x = doc["data"]["x"];
-            positionData_.y = doc["data"]["y"];
-            positionData_.a = doc["data"]["a"];
-            sendAck(type);
-        }
-        else if(type == "estop")
+        printIncomingCommand(message);
+        PLOGI.printf(type.empty() ? "ERROR: Type field empty or not specified " : "ERROR: Unkown type field ");
+        sendErr(type.empty() ? "no_type" : "unkown_type");
+        return COMMAND::NONE;
+    }
+
+    // Optional for any command, only long running commands are actually queued
+    queueRequested_ = doc.containsKey("queue") && doc["queue"].as<bool>();
+    commandSeq_ = doc.containsKey("seq") ? doc["seq"].as<uint32_t>() : 0;
+    if(spec->log)
+    {
+        printIncomingCommand(message);
+    }
+
+    JsonVariant data = doc["data"];
+    switch(spec->payload)
+    {
+        case CMD_PAYLOAD::TARGET:
+            moveData_ = {data["x"], data["y"], data["a"]};
+            break;
+        case CMD_PAYLOAD::POSITION:
+            positionData_ = {data["x"], data["y"], data["a"]};
+            // Optional measurement time in robot clock seconds, from the offset found with time_sync
+            positionTimeValid_ = data.containsKey("t");
+            if(positionTimeValid_) positionTime_ = secondsToClock(data["t"].as<double>());
+            break;
+        case CMD_PAYLOAD::POSE:
+            positionData_ = {data["x"], data["y"], data["a"]};
+            break;
+        case CMD_PAYLOAD::VELOCITY:
+            velocityData_ = {data["vx"], data["vy"], data["va"], data["t"]};
+            break;
+        case CMD_PAYLOAD::PATH:
         {
-            cmd = COMMAND::ESTOP;
-            printIncomingCommand(message);
-            sendAck(type);
+            // data.points is a list of [x, y, a] global positions
+            JsonVariant points = data["points"];
+            size_t num_points = points.size();
+            if(num_points == 0 || num_points > MAX_PATH_WAYPOINTS)
+            {
+                PLOGI.printf("ERROR: move_path needs between 1 and %d points, got %zu", MAX_PATH_WAYPOINTS, num_points);
+                sendErr("bad_path");
+                return COMMAND::NONE;
+            }
+            pathData_.clear();
+            for(size_t i = 0; i < num_points; i++)
+            {
+                pathData_.push_back({points[i][0].as<float>(), points[i][1].as<float>(), points[i][2].as<float>()});
+            }
+            break;
         }
-        else if(type == "lc")
+        case CMD_PAYLOAD::FIELD_PLAN:
         {
-            cmd = COMMAND::LOAD_COMPLETE;
-            printIncomingCommand(message);
-            sendAck(type);
+            // data.steps is flat, COMMAND, x, y, a for each step
+            JsonVariant steps = data["steps"];
+            fieldPlanChunk_.id = data["id"].as<uint32_t>();
+            fieldPlanChunk_.first = data["first"].as<int>();
+            fieldPlanChunk_.total = data["total"].as<int>();
+            fieldPlanChunk_.num_steps = steps.size() % 4 == 0 ? static_cast<int>(steps.size() / 4) : 0;
+            for(int i = 0; i < fieldPlanChunk_.num_steps && i < FIELD_PLAN_CHUNK_STEPS; i++)
+            {
+                fieldPlanChunk_.steps[i] = {steps[4*i].as<uint8_t>(), {0, 0, 0}, steps[4*i + 1].as<float>(),
+                                            steps[4*i + 2].as<float>(), steps[4*i + 3].as<float>()};
+            }
+            if(!checkFieldPlanChunk(fieldPlanChunk_))
+            {
+                PLOGI.printf("ERROR: field_plan_upload needs between 1 and %d plan steps, got %zu values", FIELD_PLAN_CHUNK_STEPS, steps.size());
+                sendErr("bad_plan");
+                return COMMAND::NONE;
+            }
+            break;
         }
-        else if(type == "status")
-        {
+        case CMD_PAYLOAD::STATUS_REQ:
             sendStatus();
-        }
-        else if (type == "check")
+            break;
+        case CMD_PAYLOAD::TIME_SYNC:
         {
-            sendAck(type);
+            // NTP style exchange, master works out the clock offset from its send and receive times
+            double t1 = clockToSeconds(ClockFactory::getFactoryInstance()->get_clock()->now());
+            sendTimeSync(data["t0"].as<double>(), t1);
+            break;
         }
-        else if (type == "clear_error")
+        case CMD_PAYLOAD::PLAN:
+            sendPlan(data);
+            break;
+        case CMD_PAYLOAD::SET_PARAM:
+        case CMD_PAYLOAD::GET_PARAM:
+            sendParam(data, spec->payload == CMD_PAYLOAD::SET_PARAM);
+            break;
+        case CMD_PAYLOAD::SESSION:
+            openSession(data);
+            break;
+        case CMD_PAYLOAD::PING:
+            if(data.containsKey("rtt")) lastPingRttMs_ = data["rtt"].as<float>();
+            sendPong(data["t"].as<double>());
+            break;
+        case CMD_PAYLOAD::STATUS_SUBSCRIBE:
+            // A rate of 0 cancels the subscription
+            statusPushHz_ = std::max(0, data["rate"].as<int>());
+            statusPushMask_ = data.containsKey("mask") ? data["mask"].as<uint32_t>() : STATUS_GROUP_ALL;
+            if(statusPushHz_ > 0)
+            {
+                statusPushRate_ = RateController(statusPushHz_);
+                statusUpdater_.resetStatusDelta();
+            }
+            break;
+        case CMD_PAYLOAD::NONE:
+            break;
+    }
+
+    if(spec->ack)
+    {
+        sendAck(spec->type);
+    }
+    return spec->cmd;
+}
+
+COMMAND RobotServer::getBinaryCommand(std::string_view message)
+{
+    uint8_t id = static_cast<uint8_t>(message[0]);
+    std::string_view payload = message.substr(1);
+
+    if(id == static_cast<uint8_t>(BINARY_MSG::STATUS_REQ))
+    {
+        sendBinaryStatus();
+        return COMMAND::NONE;
+    }
+    if(id == static_cast<uint8_t>(BINARY_MSG::CHECK))
+    {
+        sendBinaryAck(id);
+        return COMMAND::NONE;
+    }
+    if(id == static_cast<uint8_t>(BINARY_MSG::QUEUE))
+    {
+        uint32_t seq;
+        if(payload.size() <= sizeof(seq))
         {
-            statusUpdater_.clearErrorStatus();
-            sendAck(type);
+            PLOGI.printf("ERROR: Bad payload size %zu for binary message id %u", payload.size(), id);
+            sendBinaryErr(BINARY_ERR::BAD_PAYLOAD);
+            return COMMAND::NONE;
         }
-        else if (type == "wait_for_loc")
+        std::memcpy(&seq, payload.data(), sizeof(seq));
+        // The wrapped command is parsed and acked as if it was sent on its own
+        COMMAND cmd = getBinaryCommand(payload.substr(sizeof(seq)));
+        queueRequested_ = true;
+        commandSeq_ = seq;
+        return cmd;
+    }
+    if(id == static_cast<uint8_t>(BINARY_MSG::PING))
+    {
+        double t;
+        float rtt;
+        if(payload.size() != sizeof(t) && payload.size() != sizeof(t) + sizeof(rtt))
         {
-            sendAck(type);
-            cmd = COMMAND::WAIT_FOR_LOCALIZATION;
+            PLOGI.printf("ERROR: Bad payload size %zu for binary message id %u", payload.size(), id);
+            sendBinaryErr(BINARY_ERR::BAD_PAYLOAD);
+            return COMMAND::NONE;
         }
-        else if (type == "toggle_vision_debug")
+        std::memcpy(&t, payload.data(), sizeof(t));
+        if(payload.size() > sizeof(t))
         {
-            sendAck(type);
-            cmd = COMMAND::TOGGLE_VISION_DEBUG;
+            std::memcpy(&rtt, payload.data() + sizeof(t), sizeof(rtt));
+            lastPingRttMs_ = rtt;
         }
-        else if (type == "start_cameras")
+        sendBinaryMsg(BINARY_MSG::PONG, std::string(payload.data(), sizeof(t)), false);
+        return COMMAND::NONE;
+    }
+    queueRequested_ = false;
+    commandSeq_ = 0;
+
+    const CommandSpec* spec = findCommand(static_cast<COMMAND>(id));
+    if(!spec)
+    {
+        PLOGI.printf("ERROR: Unknown binary message id %u", id);
+        sendBinaryErr(BINARY_ERR::UNKNOWN_ID);
+        return COMMAND::NONE;
+    }
+
+    bool payload_ok = true;
+    switch(spec->payload)
+    {
+        case CMD_PAYLOAD::TARGET:
         {
-            sendAck(type);
-            cmd = COMMAND::START_CAMERAS;
+            float data[3];
+            payload_ok = unpackFloats(payload, data, 3);
+            moveData_ = {data[0], data[1], data[2]};
+            break;
         }
-        else if (type == "stop_cameras")
+        case CMD_PAYLOAD::PATH:
         {
-            sendAck(type);
-            cmd = COMMAND::STOP_CAMERAS;
+            // Any number of x, y, a triplets up to MAX_PATH_WAYPOINTS
+            const size_t point_size = 3 * sizeof(float);
+            size_t num_points = payload.size() / point_size;
+            payload_ok = num_points > 0 && num_points <= MAX_PATH_WAYPOINTS && payload.size() % point_size == 0;
+            if(payload_ok)
+            {
+                float data[3 * MAX_PATH_WAYPOINTS];
+                unpackFloats(payload, data, 3 * num_points);
+                pathData_.clear();
+                for(size_t i = 0; i < num_points; i++)
+                {
+                    pathData_.push_back({data[3*i], data[3*i + 1], data[3*i + 2]});
+                }
+            }
+            break;
         }
-        else if(type == "")
+        case CMD_PAYLOAD::FIELD_PLAN:
         {
-            printIncomingCommand(message);
-            PLOGI.printf("ERROR: Type field empty or not specified ");
-            sendErr("no_type");
+            const size_t steps_size = payload.size() - std::min(payload.size(), static_cast<size_t>(FIELD_PLAN_CHUNK_HEADER_SIZE));
+            payload_ok = payload.size() > FIELD_PLAN_CHUNK_HEADER_SIZE && steps_size % FIELD_PLAN_BINARY_STEP_SIZE == 0 &&
+                         steps_size / FIELD_PLAN_BINARY_STEP_SIZE <= FIELD_PLAN_CHUNK_STEPS;
+            if(payload_ok)
+            {
+                uint16_t first;
+                uint16_t total;
+                std::memcpy(&fieldPlanChunk_.id, payload.data(), sizeof(uint32_t));
+                std::memcpy(&first, payload.data() + 4, sizeof(first));
+                std::memcpy(&total, payload.data() + 6, sizeof(total));
+                fieldPlanChunk_.first = first;
+                fieldPlanChunk_.total = total;
+                fieldPlanChunk_.num_steps = static_cast<int>(steps_size / FIELD_PLAN_BINARY_STEP_SIZE);
+                for(int i = 0; i < fieldPlanChunk_.num_steps; i++)
+                {
+                    const char* step = payload.data() + FIELD_PLAN_CHUNK_HEADER_SIZE + i * FIELD_PLAN_BINARY_STEP_SIZE;
+                    float target[3];
+                    unpackFloats(std::string_view(step + 1, 3 * sizeof(float)), target, 3);
+                    fieldPlanChunk_.steps[i] = {static_cast<uint8_t>(step[0]), {0, 0, 0}, target[0], target[1], target[2]};
+                }
+                payload_ok = checkFieldPlanChunk(fieldPlanChunk_);
+            }
+            break;
         }
-        else
+        case CMD_PAYLOAD::POSITION:
+        case CMD_PAYLOAD::POSE:
+            // Positions can be followed by a double measurement time, same as the t field of the json message
+            payload_ok = unpackPosition(payload, spec->payload == CMD_PAYLOAD::POSITION, &positionData_, &positionTimeValid_, &positionTime_);
+            break;
+        case CMD_PAYLOAD::VELOCITY:
         {
-            printIncomingCommand(message);
-            PLOGI.printf("ERROR: Unkown type field ");
-            sendErr("unkown_type");
+            float data[4];
+            payload_ok = unpackFloats(payload, data, 4);
+            velocityData_ = {data[0], data[1], data[2], data[3]};
+            break;
         }
+        default:
+            payload_ok = payload.empty();
+            break;
     }
-    return cmd;    
+
+    if(!payload_ok)
+    {
+        PLOGI.printf("ERROR: Bad payload size %zu for binary message id %u", payload.size(), id);
+        sendBinaryErr(BINARY_ERR::BAD_PAYLOAD);
+        return COMMAND::NONE;
+    }
+
+    if(spec->log)
+    {
+        PLOGI.printf("Binary command id %u", id);
+    }
+    sendBinaryAck(id);
+    return spec->cmd;
 }
 
 RobotServer::PositionData RobotServer::getMoveData()
@@ -204,81 +419,326 @@ RobotServer::PositionData RobotServer::getPositionData()
     return positionData_;
 }
 
+bool RobotServer::getPositionTime(ClockTimePoint* time) const
+{
+    if(positionTimeValid_) *time = positionTime_;
+    return positionTimeValid_;
+}
+
 RobotServer::VelocityData RobotServer::getVelocityData()
 {
     return velocityData_;
 }
 
+const std::vector<RobotServer::PositionData>& RobotServer::getPathData()
+{
+    return pathData_;
+}
+
+RobotServer::CommandData RobotServer::getCommandData(COMMAND cmd)
+{
+    CommandData data;
+    data.cmd = cmd;
+    data.seq = commandSeq_;
+    data.move = moveData_;
+    data.velocity = velocityData_;
+    data.num_path_points = 0;
+    if(cmd == COMMAND::MOVE_PATH)
+    {
+        data.num_path_points = static_cast<int>(pathData_.size());
+        std::copy(pathData_.begin(), pathData_.end(), data.path);
+    }
+    return data;
+}
+
+void RobotServer::updateSocketStats()
+{
+    SocketBufferStats stats = socket_->getBufferStats();
+    stats.ping_rtt_ms = lastPingRttMs_;
+    statusUpdater_.updateSocketBufferStats(stats);
+}
+
 void RobotServer::sendStatus()
 {
+    updateSocketStats();
     std::string msg = statusUpdater_.getStatusJsonString();
-    sendMsg(msg, false);
+    sendMsg(msg, false, false);
+}
+
+void RobotServer::sendStatusDelta()
+{
+    updateSocketStats();
+    std::string msg = statusUpdater_.getStatusDeltaJsonString(statusPushMask_);
+    if(!msg.empty())
+    {
+        sendMsg(msg, false, false);
+    }
+}
+
+void RobotServer::sendBinaryStatus()
+{
+    updateSocketStats();
+    sendBinaryMsg(BINARY_MSG::STATUS, statusUpdater_.getStatusBinaryString(), false);
+}
+
+void RobotServer::checkConnection()
+{
+    const uint32_t id = socket_->getConnectionId();
+    if(id == connectionId_)
+    {
+        return;
+    }
+    // Whatever is left from the old client is either half a frame or a command it has given up on, it
+    // resends anything it still wants after resuming the session
+    while (socket_->dataAvailableToRead())
+    {
+        socket_->getData();
+    }
+    framer_.reset();
+    outbox_.clear();
+    outboxFrameEnds_.clear();
+    // Status subscriptions carry over, starting again from a full status
+    statusUpdater_.resetStatusDelta();
+    connectionId_ = id;
+    socket_->acceptConnection(id);
+    PLOGI.printf("Client connection %u, session %u has sent %u frames", id, sessionId_, txFrames_);
+}
+
+void RobotServer::openSession(JsonVariant data)
+{
+    const uint32_t id = data["id"].as<uint32_t>();
+    const uint32_t rx = data["rx"].as<uint32_t>();
+    const bool resumed = id != 0 && id == sessionId_ && rx >= replayFrom_ && rx <= txFrames_;
+    if(!resumed)
+    {
+        if(id != 0)
+        {
+            PLOGW.printf("Can't resume session %u from frame %u, have %u to %u of session %u", id, rx, replayFrom_, txFrames_, sessionId_);
+        }
+        std::random_device rd;
+        do
+        {
+            sessionId_ = rd();
+        } while(sessionId_ == 0);
+        txFrames_ = 0;
+        replayFrom_ = 0;
+        replay_.clear();
+        replayBytes_ = 0;
+    }
+
+    // Nothing queued before this is counted on the client side any more, it is replayed below instead
+    outbox_.clear();
+    outboxFrameEnds_.clear();
+    std::vector<std::string> missed;
+    for(const SentFrame& frame : replay_)
+    {
+        if(frame.seq >= rx) missed.push_back(frame.bytes);
+    }
+
+    StatusUpdater::Status status = statusUpdater_.getStatus();
+    StaticJsonDocument<384> doc;
+    doc["type"] = "session";
+    doc["data"]["id"] = sessionId_;
+    doc["data"]["resumed"] = resumed;
+    doc["data"]["tx"] = txFrames_;
+    doc["data"]["replayed"] = missed.size();
+    doc["data"]["in_progress"] = status.in_progress;
+    doc["data"]["error_status"] = status.error_status;
+    doc["data"]["cmd_seq"] = status.cmd_seq;
+    doc["data"]["cmd_done_seq"] = status.cmd_done_seq;
+    doc["data"]["tray_in_progress"] = status.tray_in_progress;
+    doc["data"]["tray_done_seq"] = status.tray_done_seq;
+    doc["data"]["field_plan_id"] = status.field_plan_id;
+    doc["data"]["field_plan_state"] = status.field_plan_state;
+    doc["data"]["field_plan_step"] = status.field_plan_step;
+    std::string msg;
+    serializeJson(doc, msg);
+    PLOGI.printf("Session %u %s, replaying %zu frames", sessionId_, resumed ? "resumed" : "opened", missed.size());
+    outbox_ += START_CHAR;
+    outbox_ += msg;
+    outbox_ += END_CHAR;
+    outboxFrameEnds_.push_back(outbox_.size());
+
+    // Sent again as new frames, so the client keeps counting from tx and can resume from among them too
+    for(std::string& frame : missed)
+    {
+        queueFrame(std::move(frame), true);
+    }
 }
 
 COMMAND RobotServer::oneLoop()
 {
+    checkConnection();
+
     COMMAND cmd = COMMAND::NONE;
-    std::string newMsg = getAnyIncomingMessage();
+    while (socket_->dataAvailableToRead())
+    {
+        framer_.append(socket_->getData());
+    }
+
+    MessageFramer::Frame frame;
+    while (cmd == COMMAND::NONE && framer_.next(&frame))
+    {
+        if(frame.binary)
+        {
+            cmd = getBinaryCommand(frame.body);
+        }
+        else
+        {
+            PLOGD.printf("RX: %.*s", static_cast<int>(frame.body.size()), frame.body.data());
+            cmd = getCommand(cleanString(frame.body));
+        }
+
+        if(cmd == COMMAND::POSITION)
+        {
+            positionPending_ = true;
+            cmd = COMMAND::NONE;
+        }
+        else if(cmd == COMMAND::SET_POSE)
+        {
+            // Anything received before the pose was reset is relative to the old pose
+            positionPending_ = false;
+        }
+    }
 
-    if(newMsg.length() != 0)
-    {    
-        PLOGD.printf("RX: %s", newMsg.c_str());
-        cmd = getCommand(cleanString(newMsg));
+    if(statusPushHz_ > 0 && statusPushRate_.ready())
+    {
+        sendStatusDelta();
     }
+
+    if(udp_)
+    {
+        readUdp();
+        if(cmd == COMMAND::SET_POSE)
+        {
+            udpPositionPending_ = false;
+        }
+        else if(udpPositionPending_)
+        {
+            positionData_ = udpPosition_;
+            positionTimeValid_ = udpPositionTimeValid_;
+            positionTime_ = udpPositionTime_;
+            positionPending_ = true;
+            udpPositionPending_ = false;
+        }
+        if(udpStatusHz_ > 0 && udp_->hasPeer() && udpPeerTimer_.dt_ms() < udpPeerTimeoutMs_ && udpStatusRate_.ready())
+        {
+            sendUdpStatus();
+        }
+    }
+
+    if(monitor_ && monitor_->hasClients() && monitorRate_.ready())
+    {
+        // Same cached serialization as the status replies, one copy shared by every client
+        monitor_->publish(START_CHAR + statusUpdater_.getStatusJsonString() + END_CHAR);
+    }
+
+    // Only the newest position received since the last one was handed over is used
+    if(cmd == COMMAND::NONE && positionPending_)
+    {
+        cmd = COMMAND::POSITION;
+        positionPending_ = false;
+    }
+    flushOutbox();
     return cmd;
 }
 
-std::string RobotServer::cleanString(std::string message)
+void RobotServer::flushOutbox()
 {
-  int idx_start = message.find("{");
-  int idx_end = message.find("}") + 1;
-  int len = idx_end - idx_start + 1;
-  if(idx_start == -1 || idx_end == 0)
-  {
-      PLOGW.printf("Could not find brackets in message");
-      return message;
-  }
-  return message.substr(idx_start, len);
+    if(outbox_.empty())
+    {
+        return;
+    }
+    // All in one go normally. If that doesn't fit, one frame that is too big mustn't take the acks with it.
+    if(!socket_->sendData(outbox_) && outboxFrameEnds_.size() > 1)
+    {
+        size_t start = 0;
+        for(size_t end : outboxFrameEnds_)
+        {
+            socket_->sendData(outbox_.substr(start, end - start));
+            start = end;
+        }
+    }
+    outbox_.clear();
+    outboxFrameEnds_.clear();
 }
 
-std::string RobotServer::getAnyIncomingMessage()
+void RobotServer::readUdp()
 {
-    bool newData = false;
-    std::string new_msg = "";
+    if(udpHaveSeq_ && udpPeerTimer_.dt_ms() > udpPeerTimeoutMs_)
+    {
+        // A peer that went quiet may have restarted with its sequence back at 0
+        udpHaveSeq_ = false;
+    }
 
-    while (socket_->dataAvailableToRead() && newData == false) 
+    std::string datagram;
+    while(udp_->receive(&datagram))
     {
-        std::string data = socket_->getData();
-        for (auto c : data)
+        if(datagram.size() <= UDP_SEQ_SIZE)
         {
-            if (recvInProgress_ == true) 
-            {
-                if (c == START_CHAR)
-                {
-                    buffer_ = "";
-                }
-                else if (c != END_CHAR) 
-                {
-                    buffer_ += c;
-                }
-                else 
-                {
-                    recvInProgress_ = false;
-                    newData = true;
-                    new_msg = buffer_;
-                    buffer_ = "";
-                }
-            }
-            else if (c == START_CHAR) 
+            PLOGW.printf("Dropping UDP datagram of %zu bytes", datagram.size());
+            continue;
+        }
+        uint32_t seq;
+        std::memcpy(&seq, datagram.data(), UDP_SEQ_SIZE);
+        // Signed difference so the comparison still works once the sequence wraps around
+        if(udpHaveSeq_ && static_cast<int32_t>(seq - udpLastSeq_) <= 0)
+        {
+            continue;
+        }
+
+        uint8_t id = static_cast<uint8_t>(datagram[UDP_SEQ_SIZE]);
+        std::string payload = datagram.substr(UDP_SEQ_SIZE + 1);
+        if(id == static_cast<uint8_t>(COMMAND::POSITION))
+        {
+            PositionData pos;
+            bool time_valid;
+            ClockTimePoint time;
+            if(!unpackPosition(payload, true, &pos, &time_valid, &time))
             {
-                recvInProgress_ = true;
+                PLOGW.printf("Bad UDP position payload size %zu", payload.size());
+                continue;
             }
+            udpPosition_ = pos;
+            udpPositionTimeValid_ = time_valid;
+            udpPositionTime_ = time;
+            udpPositionPending_ = true;
+        }
+        else if(id != static_cast<uint8_t>(BINARY_MSG::CHECK))
+        {
+            PLOGW.printf("Unexpected UDP message id %u", id);
+            continue;
         }
+        udpHaveSeq_ = true;
+        udpLastSeq_ = seq;
+        udpPeerTimer_.reset();
+    }
+}
+
+void RobotServer::sendUdpStatus()
+{
+    updateSocketStats();
+    udpStatusSeq_++;
+    std::string datagram(reinterpret_cast<const char*>(&udpStatusSeq_), UDP_SEQ_SIZE);
+    datagram += static_cast<char>(BINARY_MSG::STATUS);
+    datagram += statusUpdater_.getStatusBinaryString();
+    udp_->send(datagram);
+}
+
+std::string_view RobotServer::cleanString(std::string_view message)
+{
+    // Anything after the closing bracket of the outer object is ignored by the parser anyway
+    size_t idx_start = message.find('{');
+    size_t idx_end = message.rfind('}');
+    if(idx_start == std::string_view::npos || idx_end == std::string_view::npos || idx_end < idx_start)
+    {
+        PLOGW.printf("Could not find brackets in message");
+        return message;
     }
-    return new_msg;
+    return message.substr(idx_start, idx_end - idx_start + 1);
 }
 
-void RobotServer::sendMsg(std::string msg, bool print_debug)
+void RobotServer::sendMsg(std::string msg, bool print_debug, bool replay)
 {
     if (msg.length() == 0 && print_debug)
     {
@@ -291,14 +751,32 @@ void RobotServer::sendMsg(std::string msg, bool print_debug)
             PLOGD.printf("TX: %s", msg.c_str());
         }
 
-        std::string send_msg = START_CHAR + msg + END_CHAR;
-        socket_->sendData(send_msg);
+        queueFrame(START_CHAR + msg + END_CHAR, replay);
+    }
+}
+
+void RobotServer::queueFrame(std::string frame, bool replay)
+{
+    outbox_ += frame;
+    outboxFrameEnds_.push_back(outbox_.size());
+    const uint32_t seq = txFrames_++;
+    if(!replay || replayLimit_ == 0)
+    {
+        return;
+    }
+    replayBytes_ += frame.size();
+    replay_.push_back({seq, std::move(frame)});
+    while(replayBytes_ > replayLimit_)
+    {
+        replayBytes_ -= replay_.front().bytes.size();
+        replayFrom_ = replay_.front().seq + 1;
+        replay_.pop_front();
     }
 }
 
-void RobotServer::printIncomingCommand(std::string message)
+void RobotServer::printIncomingCommand(std::string_view message)
 {
-    PLOGI.printf(message.c_str());
+    PLOGI.printf("%.*s", static_cast<int>(message.size()), message.data());
 }
 
 void RobotServer::sendAck(std::string data)
@@ -311,6 +789,177 @@ void RobotServer::sendAck(std::string data)
     sendMsg(msg);
 }
 
+void RobotServer::sendTimeSync(double t0, double t1)
+{
+    StaticJsonDocument<128> doc;
+    doc["type"] = "time_sync";
+    doc["data"]["t0"] = t0;
+    doc["data"]["t1"] = t1;
+    doc["data"]["t2"] = clockToSeconds(ClockFactory::getFactoryInstance()->get_clock()->now());
+    std::string msg;
+    serializeJson(doc, msg);
+    sendMsg(msg, false, false);
+}
+
+void RobotServer::sendPong(double t)
+{
+    StaticJsonDocument<64> doc;
+    doc["type"] = "pong";
+    doc["data"]["t"] = t;
+    std::string msg;
+    serializeJson(doc, msg);
+    sendMsg(msg, false, false);
+}
+
+void RobotServer::sendPlan(JsonVariant data)
+{
+    // data.move is the type of the move to plan, with the same fields it would be sent with. It is planned from
+    // data.start ([x, y, a]) if given, otherwise from the current position. data.samples asks for that many
+    // [t, x, y, a] points along the move.
+    const char* move_field = data["move"].as<const char*>();
+    const CommandSpec* move = findCommand(std::string_view(move_field ? move_field : ""));
+    Point start = statusUpdater_.getPosition();
+    if(data.containsKey("start"))
+    {
+        start = {data["start"][0].as<float>(), data["start"][1].as<float>(), data["start"][2].as<float>()};
+    }
+    const Point target = {data["x"].as<float>(), data["y"].as<float>(), data["a"].as<float>()};
+
+    bool ok = false;
+    bool supported = true;
+    planner_.refreshConfig();
+    switch(move ? move->cmd : COMMAND::NONE)
+    {
+        case COMMAND::MOVE:
+            ok = planner_.generatePointToPointTrajectory(start, target, LIMITS_MODE::COARSE);
+            break;
+        case COMMAND::MOVE_REL:
+            ok = planner_.generatePointToPointTrajectory(start, composePose(start, Rotation2D(start.a), target), LIMITS_MODE::COARSE);
+            break;
+        case COMMAND::MOVE_REL_SLOW:
+            ok = planner_.generatePointToPointTrajectory(start, composePose(start, Rotation2D(start.a), target), LIMITS_MODE::SLOW);
+            break;
+        case COMMAND::MOVE_FINE:
+        case COMMAND::MOVE_FINE_STOP_VISION:
+            ok = planner_.generatePointToPointTrajectory(start, target, LIMITS_MODE::FINE);
+            break;
+        case COMMAND::MOVE_PATH:
+        {
+            JsonVariant points = data["points"];
+            std::vector<Point> waypoints;
+            // One past the limit is enough for the generator to reject it
+            for(size_t i = 0; i < points.size() && i <= MAX_PATH_WAYPOINTS; i++)
+            {
+                waypoints.push_back({points[i][0].as<float>(), points[i][1].as<float>(), points[i][2].as<float>()});
+            }
+            ok = planner_.generatePathTrajectory(start, waypoints, LIMITS_MODE::COARSE);
+            break;
+        }
+        default:
+            // Vision moves replan as the camera updates so there is nothing to plan up front
+            supported = false;
+            break;
+    }
+
+    // Optionally sampled evenly in time from start to end so master can draw or check the whole move
+    const int num_samples = ok ? std::min(std::max(data["samples"].as<int>(), 0), PLAN_MAX_SAMPLES) : 0;
+    DynamicJsonDocument doc(512 + JSON_ARRAY_SIZE(num_samples) + num_samples * JSON_ARRAY_SIZE(4));
+    doc["type"] = "plan";
+    doc["data"]["move"] = move_field;
+    doc["data"]["ok"] = ok;
+    if(!supported)
+    {
+        doc["data"]["error"] = "unsupported";
+    }
+    else if(ok)
+    {
+        doc["data"]["duration"] = planner_.getDuration();
+        if(!planner_.isPathTrajectory())
+        {
+            const Trajectory& traj = planner_.getTrajectory();
+            JsonArray trans_switch = doc["data"].createNestedArray("trans_switch");
+            JsonArray rot_switch = doc["data"].createNestedArray("rot_switch");
+            for(int i = 0; i < 8; i++)
+            {
+                trans_switch.add(traj.trans_params.switch_points[i].t);
+                rot_switch.add(traj.rot_params.switch_points[i].t);
+            }
+        }
+
+        std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+        const float wheel_check_dt = config->wheel_check_dt > 0 ? config->wheel_check_dt : 0.02f;
+        WheelFeasibility wheels = planner_.checkWheelFeasibility(config->wheel_limits, wheel_check_dt);
+        JsonObject wheel_data = doc["data"].createNestedObject("wheels");
+        wheel_data["ok"] = wheels.ok;
+        wheel_data["max_vel"] = wheels.max_vel;
+        wheel_data["max_acc"] = wheels.max_acc;
+
+        if(num_samples > 0)
+        {
+            std::vector<float> times(num_samples);
+            const float dt = num_samples > 1 ? planner_.getDuration() / (num_samples - 1) : 0;
+            for(int i = 0; i < num_samples; i++) times[i] = i * dt;
+            TrajectorySamples samples;
+            planner_.lookupBatch(times.data(), num_samples, &samples);
+            JsonArray points = doc["data"].createNestedArray("samples");
+            for(int i = 0; i < num_samples; i++)
+            {
+                JsonArray point = points.createNestedArray();
+                point.add(times[i]);
+                point.add(samples.x[i]);
+                point.add(samples.y[i]);
+                point.add(samples.a[i]);
+            }
+        }
+    }
+    std::string msg;
+    serializeJson(doc, msg);
+    sendMsg(msg);
+}
+
+void RobotServer::sendParam(JsonVariant data, bool set)
+{
+    // Replied to with the value the setting will have from the next move on, or ok false and an error
+    const char* name_field = data["name"].as<const char*>();
+    const std::string name = name_field ? name_field : "";
+    std::string error;
+    bool ok = true;
+    if(set)
+    {
+        JsonVariant value = data["value"];
+        if(!value.is<double>() && !value.is<bool>())
+        {
+            ok = false;
+            error = "bad_value";
+        }
+        else
+        {
+            ok = ConfigSnapshot::setParam(name, value.is<bool>() ? (value.as<bool>() ? 1 : 0) : value.as<double>(), &error);
+        }
+    }
+
+    StaticJsonDocument<256> doc;
+    doc["type"] = "param";
+    doc["data"]["name"] = name;
+    double current = 0;
+    bool pending = false;
+    if(ok && ConfigSnapshot::getParam(name, &current, &pending))
+    {
+        doc["data"]["value"] = current;
+        doc["data"]["pending"] = pending;
+    }
+    else if(ok)
+    {
+        ok = false;
+        error = "not_tunable";
+    }
+    doc["data"]["ok"] = ok;
+    if(!ok) doc["data"]["error"] = error;
+    std::string msg;
+    serializeJson(doc, msg);
+    sendMsg(msg);
+}
+
 void RobotServer::sendErr(std::string data)
 {
     StaticJsonDocument<64> doc;
@@ -319,4 +968,27 @@ void RobotServer::sendErr(std::string data)
     std::string msg;
     serializeJson(doc, msg);
     sendMsg(msg);
-}
\ No newline at end of file
+}
+
+void RobotServer::sendBinaryMsg(BINARY_MSG id, const std::string& payload, bool replay)
+{
+    size_t body_len = payload.size() + 1;
+    std::string frame;
+    frame.reserve(body_len + 3);
+    frame += BINARY_START_CHAR;
+    frame += static_cast<char>(body_len & 0xFF);
+    frame += static_cast<char>((body_len >> 8) & 0xFF);
+    frame += static_cast<char>(id);
+    frame += payload;
+    queueFrame(std::move(frame), replay);
+}
+
+void RobotServer::sendBinaryAck(uint8_t id)
+{
+    sendBinaryMsg(BINARY_MSG::ACK, std::string(1, static_cast<char>(id)));
+}
+
+void RobotServer::sendBinaryErr(BINARY_ERR err)
+{
+    sendBinaryMsg(BINARY_MSG::ERR, std::string(1, static_cast<char>(err)));
+}
@@ -6,15 +6,65 @@
 #ifndef RobotServer_h
 #define RobotServer_h
 
+#include <deque>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <vector>
 
+#include "CommandRegistry.h"
 #include "constants.h"
+#include "FieldPlan.h"
+#include "sockets/MessageFramer.h"
 #include "sockets/SocketMultiThreadWrapperBase.h"
+#include "sockets/UdpChannelBase.h"
+#include "sockets/MonitorServerBase.h"
+#include "SmoothTrajectoryGenerator.h"
 #include "StatusUpdater.h"
+#include "utils.h"
 
-#define START_CHAR '<'
-#define END_CHAR '>'
+// Binary message ids. Commands sent from master use the value of the COMMAND enum directly
+// as the id, these cover everything else.
+enum class BINARY_MSG : uint8_t
+{
+    STATUS_REQ = 0x80,
+    CHECK = 0x81,
+    QUEUE = 0x82,     // uint32 sequence id followed by a complete command body, which is queued instead of rejected while busy
+    PING = 0x83,      // double t, optionally followed by a float round trip of the previous ping in ms
+    ACK = 0xC0,
+    ERR = 0xC1,
+    STATUS = 0xC2,
+    PONG = 0xC3,      // The double t from the ping
+};
+
+// UDP datagrams are a little endian uint32 sequence number followed by a body in the same format as a binary
+// frame body. Only POSITION and CHECK are accepted, neither is acked. Each direction counts its own sequence
+// and a position that isn't newer than the last one accepted is dropped, so reordering can't move the robot
+// back to an old position. CHECK registers the sender for the STATUS stream.
+#define UDP_SEQ_SIZE 4
+
+// Most points a plan reply will sample along the move. A sample is at most 58 bytes of JSON with every float at full
+// length, and the rest of the reply well under 1 KB, so the reply always fits in one frame.
+#define PLAN_MAX_SAMPLES 120
+static_assert(1024 + 58 * PLAN_MAX_SAMPLES <= MAX_SEND_FRAME_SIZE, "Plan reply has to fit in one frame");
+
+// A binary field_plan_upload is a uint32 plan id, uint16 index of its first step and uint16 steps in the whole
+// plan, then each step as a uint8 COMMAND and float x, y, a
+#define FIELD_PLAN_CHUNK_HEADER_SIZE 8
+#define FIELD_PLAN_BINARY_STEP_SIZE 13
+
+// Sessions let master pick up where it left off after a reconnect. Every frame sent on the TCP link counts
+// towards the session, except the session reply itself. Master opens a session with {"type": "session",
+// "data": {"id": 0}} and resumes it on a new connection with the id from the reply and the number of frames it
+// has received since the reply told it "tx". The robot then sends everything since that frame again, apart
+// from status and pongs which are stale by then, after a reply with the running command state.
+
+// Payload of a BINARY_MSG::ERR frame
+enum class BINARY_ERR : uint8_t
+{
+    BAD_PAYLOAD = 1,
+    UNKNOWN_ID = 2,
+};
 
 class RobotServer
 {
@@ -34,36 +84,144 @@ class RobotServer
       float va;
       float t;
     };
+
+    // Everything needed to start a command, copied when it arrives so queued commands keep their own data
+    struct CommandData
+    {
+      COMMAND cmd;
+      uint32_t seq;
+      PositionData move;
+      VelocityData velocity;
+      int num_path_points;
+      PositionData path[MAX_PATH_WAYPOINTS];
+    };
+
+    // Part of a field plan, see FieldPlanJournal::addChunk
+    struct FieldPlanChunk
+    {
+      uint32_t id;
+      int first;
+      int total;
+      int num_steps;
+      FieldPlanStep steps[FIELD_PLAN_CHUNK_STEPS];
+    };
     
     RobotServer(StatusUpdater& statusUpdater);
 
+    // Handles everything that has arrived, stopping early only at a command so it can be started before
+    // the next one is read. Positions are latest value wins, a burst of them is returned as one POSITION
+    // once there is no other command to return. Everything sent in response goes to the socket in a single
+    // write at the end.
     COMMAND oneLoop();
 
     RobotServer::PositionData getMoveData();
 
     RobotServer::PositionData getPositionData();
 
+    // Measurement time sent with the last position on the robot clock, returns false if it had none
+    bool getPositionTime(ClockTimePoint* time) const;
+
     RobotServer::VelocityData getVelocityData();
 
+    const std::vector<RobotServer::PositionData>& getPathData();
+
+    RobotServer::CommandData getCommandData(COMMAND cmd);
+
+    const RobotServer::FieldPlanChunk& getFieldPlanChunk() const { return fieldPlanChunk_; };
+
+    // Whether the last command asked to go on the command queue rather than start immediately
+    bool isQueueRequested() const { return queueRequested_; };
+
   private:
     PositionData moveData_;
+    std::vector<PositionData> pathData_;
+    FieldPlanChunk fieldPlanChunk_;
     PositionData positionData_;
+    bool positionPending_;
+    bool positionTimeValid_;
+    ClockTimePoint positionTime_;
     VelocityData velocityData_;
+    bool queueRequested_;
+    uint32_t commandSeq_;
     StatusUpdater& statusUpdater_;
 
-    bool recvInProgress_;
-    int recvIdx_;
-    std::string buffer_;
+    // Status push subscription, disabled when statusPushHz_ is 0
+    int statusPushHz_;
+    uint32_t statusPushMask_;
+    RateController statusPushRate_;
+
+    // UDP side channel, null when udp.enabled is false
+    UdpChannelBase* udp_;
+    bool udpHaveSeq_;
+    uint32_t udpLastSeq_;
+    bool udpPositionPending_;
+    PositionData udpPosition_;
+    bool udpPositionTimeValid_;
+    ClockTimePoint udpPositionTime_;
+    Timer udpPeerTimer_;
+    int udpPeerTimeoutMs_;
+    int udpStatusHz_;
+    RateController udpStatusRate_;
+    uint32_t udpStatusSeq_;
+
+    // Status fan out to monitor clients, null when monitor.enabled is false
+    MonitorServerBase* monitor_;
+    RateController monitorRate_;
+
+    // Round trip master measured for its last ping, reported back in the next one
+    float lastPingRttMs_;
+
+    // Only used to answer plan requests, the controller has its own
+    SmoothTrajectoryGenerator planner_;
+
+    MessageFramer framer_;
+    // Frames waiting to be sent at the end of the loop
+    std::string outbox_;
+    std::vector<size_t> outboxFrameEnds_;   // Where each frame in outbox_ ends, to send them one by one if need be
     SocketMultiThreadWrapperBase* socket_;
 
-    COMMAND getCommand(std::string message);
-    void sendMsg(std::string msg, bool print_debug=true);
+    // Client connection the buffered data belongs to, see SocketMultiThreadWrapperBase::getConnectionId
+    uint32_t connectionId_;
+
+    // Frames sent in this session, with the ones worth sending again to a resuming client
+    struct SentFrame
+    {
+      uint32_t seq;
+      std::string bytes;
+    };
+    uint32_t sessionId_;
+    uint32_t txFrames_;
+    std::deque<SentFrame> replay_;
+    size_t replayBytes_;
+    size_t replayLimit_;
+    // Oldest frame a client can resume from, anything older has been dropped from replay_
+    uint32_t replayFrom_;
+
+    COMMAND getCommand(std::string_view message);
+    COMMAND getBinaryCommand(std::string_view message);
+    void sendMsg(std::string msg, bool print_debug=true, bool replay=true);
     void sendAck(std::string data);
     void sendErr(std::string data);
-    std::string getAnyIncomingMessage();
-    std::string cleanString(std::string message);
-    void printIncomingCommand(std::string message);
+    void sendBinaryMsg(BINARY_MSG id, const std::string& payload, bool replay=true);
+    // Adds a complete frame to the outbox and counts it in the session, keeping it for replay if asked
+    void queueFrame(std::string frame, bool replay);
+    void checkConnection();
+    void openSession(JsonVariant data);
+    void sendBinaryAck(uint8_t id);
+    void sendBinaryErr(BINARY_ERR err);
+    std::string_view cleanString(std::string_view message);
+    void printIncomingCommand(std::string_view message);
     void sendStatus();
+    void sendTimeSync(double t0, double t1);
+    void sendPong(double t);
+    void sendPlan(JsonVariant data);
+    void sendParam(JsonVariant data, bool set);
+    void updateSocketStats();
+    void flushOutbox();
+    void sendBinaryStatus();
+    void sendStatusDelta();
+    void readUdp();
+    void sendUdpStatus();
 
 };
 
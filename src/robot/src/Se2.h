@@ -0,0 +1,101 @@
+#ifndef Se2_h
+#define Se2_h
+
+#include <cmath>
+#include "utils.h"
+
+// Angle and planar rotation helpers for the control path. Everything is inline so a cycle can
+// compute the rotation of the current pose once and reuse it for every frame conversion.
+
+// Wraps an angle to +/- pi in constant time for any finite input. The reduction is done in double so
+// large inputs don't pick up the rounding error of a float 2 pi.
+inline float wrapAngle(float a)
+{
+    constexpr double TWO_PI = 2 * M_PI;
+    double wrapped = a - TWO_PI * std::trunc(a / TWO_PI);
+    wrapped -= wrapped > M_PI ? TWO_PI : 0.0;
+    wrapped += wrapped < -M_PI ? TWO_PI : 0.0;
+    return static_cast<float>(wrapped);
+}
+
+// Sine and cosine of the same angle in one call
+inline void sinCos(float a, float* s, float* c)
+{
+#if defined(__GNUC__)
+    __builtin_sincosf(a, s, c);
+#else
+    *s = std::sin(a);
+    *c = std::cos(a);
+#endif
+}
+
+// Rotation between the robot (local) frame and the global frame for a robot heading
+struct Rotation2D
+{
+    float c;
+    float s;
+
+    Rotation2D()
+    : c(1), s(0)
+    {}
+
+    explicit Rotation2D(float a)
+    {
+        sinCos(a, &s, &c);
+    }
+
+    void toGlobal(float x_local, float y_local, float* x_global, float* y_global) const
+    {
+        *x_global = c * x_local - s * y_local;
+        *y_global = s * x_local + c * y_local;
+    }
+
+    void toLocal(float x_global, float y_global, float* x_local, float* y_local) const
+    {
+        *x_local =  c * x_global + s * y_global;
+        *y_local = -s * x_global + c * y_global;
+    }
+
+    Velocity toGlobal(const Velocity& local) const
+    {
+        Velocity global;
+        toGlobal(local.vx, local.vy, &global.vx, &global.vy);
+        global.va = local.va;
+        return global;
+    }
+
+    Velocity toLocal(const Velocity& global) const
+    {
+        Velocity local;
+        toLocal(global.vx, global.vy, &local.vx, &local.vy);
+        local.va = global.va;
+        return local;
+    }
+};
+
+// Pose reached by moving by a local frame offset from origin, whose heading gives rotation
+inline Point composePose(const Point& origin, const Rotation2D& rotation, const Point& local_offset)
+{
+    float dx_global;
+    float dy_global;
+    rotation.toGlobal(local_offset.x, local_offset.y, &dx_global, &dy_global);
+    return Point(origin.x + dx_global, origin.y + dy_global, wrapAngle(origin.a + local_offset.a));
+}
+
+// Global displacement over dt of a robot that starts at the heading of rotation and holds a local velocity. This
+// is the SE(2) exponential of the body twist, so a robot turning while it drives follows the arc it really
+// drives instead of a straight line along the start heading.
+inline void integrateLocalVelocity(const Rotation2D& rotation, const Velocity& local, float dt, float* dx_global, float* dy_global)
+{
+    const float turn = local.va * dt;
+    float s;
+    float c;
+    sinCos(turn, &s, &c);
+    // sin(turn) / turn and (1 - cos(turn)) / turn, by their series close to zero
+    const bool small = std::fabs(turn) < 1e-3f;
+    const float a = small ? 1 - turn * turn / 6 : s / turn;
+    const float b = small ? turn / 2 : (1 - c) / turn;
+    rotation.toGlobal((a * local.vx - b * local.vy) * dt, (b * local.vx + a * local.vy) * dt, dx_global, dy_global);
+}
+
+#endif //Se2_h
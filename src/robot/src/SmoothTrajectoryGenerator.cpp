@@ -1,31 +1,52 @@
 #include "SmoothTrajectoryGenerator.h"
+#include "TrajectoryCache.h"
 #include <plog/Log.h>
+#include <algorithm>
+#include <limits>
 #include "constants.h"
+#include "ConfigSnapshot.h"
 #include "utils.h"
 
 constexpr float d6 = 1/6.0;
 
-SmoothTrajectoryGenerator::SmoothTrajectoryGenerator()
-  : currentTrajectory_()
+SmoothTrajectoryGenerator::SmoothTrajectoryGenerator(TrajectoryCache* cache)
+  : currentTrajectory_(),
+    trans_region_hint_(1),
+    rot_region_hint_(1),
+    cache_(cache),
+    path_mode_(false),
+    path_segments_()
 {
     currentTrajectory_.complete = false;
-    solver_params_.num_loops = cfg.lookup("trajectory_generation.solver_max_loops"); 
-    solver_params_.beta_decay = cfg.lookup("trajectory_generation.solver_beta_decay");
-    solver_params_.alpha_decay = cfg.lookup("trajectory_generation.solver_alpha_decay");
-    solver_params_.exponent_decay = cfg.lookup("trajectory_generation.solver_exponent_decay");
+    refreshConfig();
+    path_segments_.reserve(MAX_PATH_WAYPOINTS);
+}
+
+void SmoothTrajectoryGenerator::refreshConfig()
+{
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    solver_params_ = config->solver;
+    blend_params_ = config->blend;
 }
 
 PVTPoint SmoothTrajectoryGenerator::lookup(float time)
 {
-    std::vector<float> trans_values = lookup_1D(time, currentTrajectory_.trans_params);
-    std::vector<float> rot_values = lookup_1D(time, currentTrajectory_.rot_params);    
+    if (path_mode_)
+    {
+        return lookupPath(time, &path_segments_);
+    }
+
+    Kinematics1D trans_values = lookup_1D(time, currentTrajectory_.trans_params, &trans_region_hint_);
+    Kinematics1D rot_values = lookup_1D(time, currentTrajectory_.rot_params, &rot_region_hint_);    
 
     // Map translational trajectory into XY space with direction vector
-    Eigen::Vector2f trans_pos_delta = trans_values[0] * currentTrajectory_.trans_direction;
-    Eigen::Vector2f trans_vel = trans_values[1] * currentTrajectory_.trans_direction;
+    Eigen::Vector2f trans_pos_delta = trans_values.p * currentTrajectory_.trans_direction;
+    Eigen::Vector2f trans_vel = trans_values.v * currentTrajectory_.trans_direction;
     // Map rotational trajectory into angular space with direction
-    float rot_pos_delta = rot_values[0] * currentTrajectory_.rot_direction;
-    float rot_vel = rot_values[1] * currentTrajectory_.rot_direction;
+    float rot_pos_delta = rot_values.p * currentTrajectory_.rot_direction;
+    float rot_vel = rot_values.v * currentTrajectory_.rot_direction;
+    Eigen::Vector2f trans_acc = trans_values.a * currentTrajectory_.trans_direction;
+    float rot_acc = rot_values.a * currentTrajectory_.rot_direction;
 
     // Build and return pvtpoint
     PVTPoint pvt;
@@ -34,42 +55,401 @@ PVTPoint SmoothTrajectoryGenerator::lookup(float time)
                      wrap_angle(currentTrajectory_.initialPoint.a + rot_pos_delta) };
     pvt.velocity = {trans_vel(0), trans_vel(1), rot_vel};
     pvt.time = time;
+    pvt.acceleration = {trans_acc(0), trans_acc(1), rot_acc};
     return pvt;
 }
 
-std::vector<float> lookup_1D(float time, const SCurveParameters& params)
+Kinematics1D lookup_1D(float time, const SCurveParameters& params, int* region_hint)
 {
     // Handle time before start of trajectory
     if(time <= params.switch_points[0].t)
     {
-        return {params.switch_points[0].p, params.switch_points[0].v};
+        return {params.switch_points[0].p, params.switch_points[0].v, params.switch_points[0].a};
     }
     // Handle time after the end of the trajectory
     else if (time > params.switch_points[7].t)
     {
-        return {params.switch_points[7].p, params.switch_points[7].v};
+        return {params.switch_points[7].p, params.switch_points[7].v, params.switch_points[7].a};
     }
-    // Handle times within the trajectory
-    else
+
+    // Walk from the hinted region to the one where switch_points[i-1].t < time <= switch_points[i].t
+    int i = region_hint && *region_hint >= 1 && *region_hint <= 7 ? *region_hint : 1;
+    while (i > 1 && time <= params.switch_points[i-1].t) i--;
+    while (i < 7 && time > params.switch_points[i].t) i++;
+    if (region_hint) *region_hint = i;
+
+    // Compute position and velocity from previous switch point
+    float dt = time - params.switch_points[i-1].t;
+    return computeKinematicsBasedOnRegion(params, i, dt);
+}
+
+void lookup_1D_batch(const float* times, size_t n, const SCurveParameters& params, float* p, float* v, float* a)
+{
+    // Every sample is a cubic from the switch point at the start of its region. The regions are found one sample
+    // at a time, then all the cubics are evaluated in one pass.
+    std::vector<float> dt(n);
+    std::vector<float> jerk(n);
+    const SwitchPoint* switch_points = params.switch_points;
+    int region = 1;
+    for (size_t i = 0; i < n; i++)
+    {
+        const float time = times[i];
+        const SwitchPoint* base;
+        if (time <= switch_points[0].t)
+        {
+            base = &switch_points[0];
+            dt[i] = 0;
+            jerk[i] = 0;
+        }
+        else if (time > switch_points[7].t)
+        {
+            base = &switch_points[7];
+            dt[i] = 0;
+            jerk[i] = 0;
+        }
+        else
+        {
+            while (region > 1 && time <= switch_points[region-1].t) region--;
+            while (region < 7 && time > switch_points[region].t) region++;
+            base = &switch_points[region-1];
+            dt[i] = time - base->t;
+            jerk[i] = region == 1 || region == 7 ? params.j_lim : region == 3 || region == 5 ? -params.j_lim : 0;
+        }
+        p[i] = base->p;
+        v[i] = base->v;
+        a[i] = base->a;
+    }
+
+    Eigen::Map<Eigen::ArrayXf> P(p, n), V(v, n), A(a, n);
+    Eigen::Map<const Eigen::ArrayXf> DT(dt.data(), n), J(jerk.data(), n);
+    // Each line only reads the ones below it, so the order matters
+    P += DT * (V + DT * (0.5f * A + DT * J * d6));
+    V += DT * (A + 0.5f * DT * J);
+    A += DT * J;
+}
+
+void TrajectorySamples::resize(size_t n)
+{
+    for (std::vector<float>* component : {&x, &y, &a, &vx, &vy, &va, &ax, &ay, &aa})
+    {
+        component->resize(n);
+    }
+}
+
+void SmoothTrajectoryGenerator::lookupBatch(const float* times, size_t n, TrajectorySamples* samples) const
+{
+    samples->resize(n);
+    Eigen::Map<Eigen::ArrayXf> x(samples->x.data(), n), y(samples->y.data(), n), a(samples->a.data(), n);
+    Eigen::Map<Eigen::ArrayXf> vx(samples->vx.data(), n), vy(samples->vy.data(), n), va(samples->va.data(), n);
+    Eigen::Map<Eigen::ArrayXf> ax(samples->ax.data(), n), ay(samples->ay.data(), n), aa(samples->aa.data(), n);
+    const Point origin = !path_mode_ ? currentTrajectory_.initialPoint :
+                         path_segments_.empty() ? Point(0, 0, 0) : path_segments_.front().traj.initialPoint;
+    x.setConstant(origin.x);
+    y.setConstant(origin.y);
+    a.setConstant(origin.a);
+    for (Eigen::Map<Eigen::ArrayXf>* component : {&vx, &vy, &va, &ax, &ay, &aa}) component->setZero();
+
+    // A point to point trajectory is a path with one leg starting at 0
+    std::vector<float> leg_times(n), p(n), v(n), acc(n);
+    Eigen::Map<Eigen::ArrayXf> P(p.data(), n), V(v.data(), n), A(acc.data(), n);
+    const size_t num_legs = path_mode_ ? path_segments_.size() : 1;
+    for (size_t leg = 0; leg < num_legs; leg++)
+    {
+        const Trajectory& traj = path_mode_ ? path_segments_[leg].traj : currentTrajectory_;
+        const float start_time = path_mode_ ? path_segments_[leg].start_time : 0;
+        Eigen::Map<Eigen::ArrayXf>(leg_times.data(), n) = Eigen::Map<const Eigen::ArrayXf>(times, n) - start_time;
+
+        lookup_1D_batch(leg_times.data(), n, traj.trans_params, p.data(), v.data(), acc.data());
+        x += P * traj.trans_direction(0);
+        y += P * traj.trans_direction(1);
+        vx += V * traj.trans_direction(0);
+        vy += V * traj.trans_direction(1);
+        ax += A * traj.trans_direction(0);
+        ay += A * traj.trans_direction(1);
+
+        lookup_1D_batch(leg_times.data(), n, traj.rot_params, p.data(), v.data(), acc.data());
+        a += P * traj.rot_direction;
+        va += V * traj.rot_direction;
+        aa += A * traj.rot_direction;
+    }
+    for (float& angle : samples->a) angle = wrap_angle(angle);
+}
+
+WheelFeasibility checkWheelLimits(const float* times, const TrajectorySamples& samples, const WheelLimits& limits)
+{
+    WheelFeasibility out = {true, 0, 0, 0};
+    const size_t n = samples.size();
+    if (n == 0) return out;
+
+    Eigen::Map<const Eigen::ArrayXf> a(samples.a.data(), n);
+    Eigen::Map<const Eigen::ArrayXf> vx(samples.vx.data(), n), vy(samples.vy.data(), n), va(samples.va.data(), n);
+    Eigen::Map<const Eigen::ArrayXf> ax(samples.ax.data(), n), ay(samples.ay.data(), n), aa(samples.aa.data(), n);
+
+    // Into the robot frame. The frame turns with the robot, which adds va times the velocity to the acceleration.
+    const Eigen::ArrayXf c = a.cos();
+    const Eigen::ArrayXf s = a.sin();
+    const Eigen::ArrayXf local_vx = c * vx + s * vy;
+    const Eigen::ArrayXf local_vy = c * vy - s * vx;
+    const Eigen::ArrayXf local_ax = c * ax + s * ay + va * local_vy;
+    const Eigen::ArrayXf local_ay = c * ay - s * ax - va * local_vx;
+
+    // Rim speed of each wheel, same signs as doIK
+    const float half_sq3 = std::sqrt(3.0f) / 2;
+    const float r = limits.base_radius;
+    const Eigen::ArrayXf wheel_vel = (-half_sq3 * local_vx + 0.5f * local_vy + r * va).abs()
+        .max((half_sq3 * local_vx + 0.5f * local_vy + r * va).abs())
+        .max((-local_vy + r * va).abs());
+    const Eigen::ArrayXf wheel_acc = (-half_sq3 * local_ax + 0.5f * local_ay + r * aa).abs()
+        .max((half_sq3 * local_ax + 0.5f * local_ay + r * aa).abs())
+        .max((-local_ay + r * aa).abs());
+
+    Eigen::Index worst;
+    const float worst_fraction = (wheel_vel / limits.max_vel).max(wheel_acc / limits.max_acc).maxCoeff(&worst);
+    out.max_vel = wheel_vel.maxCoeff();
+    out.max_acc = wheel_acc.maxCoeff();
+    out.worst_time = times[worst];
+    // Same allowance as the path checks for a profile that runs right at its limits
+    out.ok = worst_fraction <= 1.001f;
+    return out;
+}
+
+WheelFeasibility SmoothTrajectoryGenerator::checkWheelFeasibility(const WheelLimits& limits, float dt) const
+{
+    const size_t n = static_cast<size_t>(std::ceil(getDuration() / dt)) + 1;
+    std::vector<float> times(n);
+    for (size_t i = 0; i < n; i++) times[i] = i * dt;
+    TrajectorySamples samples;
+    lookupBatch(times.data(), n, &samples);
+    return checkWheelLimits(times.data(), samples, limits);
+}
+
+namespace
+{
+    // Sum of the path legs relative to the path start
+    struct PathKinematics
+    {
+        Eigen::Vector2f trans_pos;
+        Eigen::Vector2f trans_vel;
+        Eigen::Vector2f trans_acc;
+        float rot_pos;
+        float rot_vel;
+        float rot_acc;
+    };
+
+    PathKinematics evaluatePath(std::vector<PathSegment>& segments, size_t num_segments, float time)
     {
-        // Look for correct region
-        for (int i = 1; i <= 7; i++)
+        PathKinematics out = {{0,0}, {0,0}, {0,0}, 0, 0, 0};
+        for (size_t i = 0; i < num_segments; i++)
         {
-            // Once region is found, compute position and velocity from previous switch point
-            if(params.switch_points[i-1].t < time && time <= params.switch_points[i].t)
+            PathSegment& segment = segments[i];
+            float dt = time - segment.start_time;
+            Kinematics1D trans = lookup_1D(dt, segment.traj.trans_params, &segment.trans_region_hint);
+            Kinematics1D rot = lookup_1D(dt, segment.traj.rot_params, &segment.rot_region_hint);
+            out.trans_pos += trans.p * segment.traj.trans_direction;
+            out.trans_vel += trans.v * segment.traj.trans_direction;
+            out.trans_acc += trans.a * segment.traj.trans_direction;
+            out.rot_pos += rot.p * segment.traj.rot_direction;
+            out.rot_vel += rot.v * segment.traj.rot_direction;
+            out.rot_acc += rot.a * segment.traj.rot_direction;
+        }
+        return out;
+    }
+
+    float segmentEndTime(const PathSegment& segment)
+    {
+        return segment.start_time + trajectoryDuration(segment.traj);
+    }
+
+    // Checks the first num_segments legs stay within the limits between start and end
+    bool pathWithinLimits(std::vector<PathSegment>& segments, size_t num_segments, float start, float end,
+                          const DynamicLimits& trans_limits, const DynamicLimits& rot_limits, float check_dt)
+    {
+        // Small allowance for float error when a single leg runs right at its limits
+        const float tol = 1.001;
+        for (float t = start; t < end + check_dt; t += check_dt)
+        {
+            PathKinematics k = evaluatePath(segments, num_segments, std::min(t, end));
+            if (k.trans_vel.norm() > tol * trans_limits.max_vel || k.trans_acc.norm() > tol * trans_limits.max_acc ||
+                fabs(k.rot_vel) > tol * rot_limits.max_vel || fabs(k.rot_acc) > tol * rot_limits.max_acc)
             {
-                float dt = time - params.switch_points[i-1].t;
-                std::vector<float> values = computeKinematicsBasedOnRegion(params, i, dt);
-                return {values[2], values[1]};
+                return false;
             }
         }
+        return true;
     }
+}
 
-    PLOGE << "Should not get to this point in lookup";
-    return {0,0};
+float blendPathSegments(std::vector<PathSegment>* segments, const DynamicLimits& trans_limits, const DynamicLimits& rot_limits,
+                        const PathBlendParameters& blend)
+{
+    std::vector<PathSegment>& legs = *segments;
+    if (legs.empty()) return 0;
+
+    legs[0].start_time = 0;
+    float path_end = segmentEndTime(legs[0]);
+    for (size_t i = 1; i < legs.size(); i++)
+    {
+        // The earliest a leg can start is when the previous one starts slowing down, that way the two velocity
+        // profiles hand over with the same jerk limited ramp. Starting once everything before has finished means
+        // stopping at the waypoint, which is always feasible.
+        const PathSegment& prev = legs[i-1];
+        const float ramp_down = std::max(prev.traj.trans_params.switch_points[4].t, prev.traj.rot_params.switch_points[4].t);
+        const float earliest = std::min(prev.start_time + ramp_down, path_end);
+
+        float start = earliest;
+        for (int attempt = 0; ; attempt++)
+        {
+            legs[i].start_time = start;
+            if (start >= path_end ||
+                pathWithinLimits(legs, i + 1, start, path_end, trans_limits, rot_limits, blend.check_dt))
+            {
+                break;
+            }
+            if (attempt >= blend.max_iterations)
+            {
+                // Blending at a sharp corner can need more acceleration than is allowed, so stop instead
+                start = path_end;
+                legs[i].start_time = start;
+                break;
+            }
+            // Halve the overlap each time
+            start = earliest + (path_end - earliest) * (1 - std::pow(0.5f, attempt + 1));
+        }
+        path_end = std::max(path_end, segmentEndTime(legs[i]));
+    }
+
+    return path_end;
+}
+
+PVTPoint lookupPath(float time, std::vector<PathSegment>* segments)
+{
+    PVTPoint pvt;
+    pvt.time = time;
+    if (segments->empty())
+    {
+        pvt.position = {0, 0, 0};
+        pvt.velocity = {0, 0, 0};
+        return pvt;
+    }
+
+    const Point& start = segments->front().traj.initialPoint;
+    PathKinematics k = evaluatePath(*segments, segments->size(), time);
+    pvt.position = {start.x + k.trans_pos(0), start.y + k.trans_pos(1), wrap_angle(start.a + k.rot_pos)};
+    pvt.velocity = {k.trans_vel(0), k.trans_vel(1), k.rot_vel};
+    pvt.acceleration = {k.trans_acc(0), k.trans_acc(1), k.rot_acc};
+    return pvt;
 }
 
 
+float SmoothTrajectoryGenerator::getDuration() const
+{
+    if (!path_mode_)
+    {
+        return trajectoryDuration(currentTrajectory_);
+    }
+    float end_time = 0;
+    for (const PathSegment& segment : path_segments_)
+    {
+        end_time = std::max(end_time, segmentEndTime(segment));
+    }
+    return end_time;
+}
+
+float trajectoryDuration(const Trajectory& traj)
+{
+    return std::max(traj.trans_params.switch_points[7].t, traj.rot_params.switch_points[7].t);
+}
+
+SerialTrajectoryAxis toSerialTrajectoryAxis(uint16_t traj_id, SERIAL_TRAJECTORY_AXIS axis, float dir_x, float dir_y,
+                                            const SCurveParameters& params, float scale)
+{
+    SerialTrajectoryAxis out;
+    out.traj_id = traj_id;
+    out.axis = axis;
+    out.direction[0] = dir_x;
+    out.direction[1] = dir_y;
+    out.v_lim = scale * params.v_lim;
+    out.a_lim = scale * params.a_lim;
+    out.j_lim = scale * params.j_lim;
+    for (int i = 0; i < 8; i++)
+    {
+        out.switch_points[i][0] = params.switch_points[i].t;
+        out.switch_points[i][1] = scale * params.switch_points[i].p;
+        out.switch_points[i][2] = scale * params.switch_points[i].v;
+        out.switch_points[i][3] = scale * params.switch_points[i].a;
+    }
+    return out;
+}
+
+namespace
+{
+    // Regions 5 to 7 of an S-curve from v0, with the limits in params
+    void populateStopSwitchPoints(SCurveParameters* params, float v0, float dt_j, float dt_a)
+    {
+        params->v_lim = v0;
+        params->switch_points[0] = {0, 0, v0, 0};
+        for (int i = 1; i < 8; i++)
+        {
+            const float dt = i < 5 ? 0 : i == 6 ? dt_a : dt_j;
+            Kinematics1D values = computeKinematicsBasedOnRegion(*params, i, dt);
+            params->switch_points[i] = {params->switch_points[i-1].t + dt, values.p, values.v, values.a};
+        }
+    }
+}
+
+void generateStopSCurve(float v0, const DynamicLimits& limits, SCurveParameters* params)
+{
+    // Ramp the deceleration up to the limit, hold it and ramp back down. Slow enough that the limit is never
+    // reached, the ramps meet in the middle.
+    v0 = std::max(v0, 0.0f);
+    params->j_lim = limits.max_jerk;
+    params->a_lim = std::min(limits.max_acc, std::sqrt(v0 * limits.max_jerk));
+    const float dt_j = params->a_lim > 0 ? params->a_lim / params->j_lim : 0;
+    const float dt_a = params->a_lim > 0 ? std::max(v0 / params->a_lim - dt_j, 0.0f) : 0;
+    populateStopSwitchPoints(params, v0, dt_j, dt_a);
+}
+
+void stretchStopSCurve(SCurveParameters* params, float duration)
+{
+    const float end = params->switch_points[7].t;
+    if (end <= 0 || duration <= end) return;
+    const float k = duration / end;
+    const float dt_j = (params->switch_points[5].t - params->switch_points[4].t) * k;
+    const float dt_a = (params->switch_points[6].t - params->switch_points[5].t) * k;
+    params->a_lim /= k;
+    params->j_lim /= k * k;
+    populateStopSwitchPoints(params, params->switch_points[0].v, dt_j, dt_a);
+}
+
+Trajectory generateStopTrajectory(Point initialPoint, Velocity velocity, const DynamicLimits& trans_limits, const DynamicLimits& rot_limits)
+{
+    Trajectory traj;
+    traj.initialPoint = initialPoint;
+    const Eigen::Vector2f trans_vel = {velocity.vx, velocity.vy};
+    const float speed = trans_vel.norm();
+    traj.trans_direction = speed > 0 ? Eigen::Vector2f(trans_vel / speed) : Eigen::Vector2f(1, 0);
+    traj.rot_direction = velocity.va < 0 ? -1 : 1;
+    generateStopSCurve(speed, trans_limits, &traj.trans_params);
+    generateStopSCurve(std::fabs(velocity.va), rot_limits, &traj.rot_params);
+
+    const float duration = trajectoryDuration(traj);
+    stretchStopSCurve(&traj.trans_params, duration);
+    stretchStopSCurve(&traj.rot_params, duration);
+    traj.complete = true;
+    return traj;
+}
+
+bool SmoothTrajectoryGenerator::generateStopTrajectory(Point initialPoint, Velocity velocity, const DynamicLimits& trans_limits,
+                                                       const DynamicLimits& rot_limits)
+{
+    currentTrajectory_ = ::generateStopTrajectory(initialPoint, velocity, trans_limits, rot_limits);
+    path_mode_ = false;
+    trans_region_hint_ = 1;
+    rot_region_hint_ = 1;
+    PLOGD_(MOTION_LOG_ID) << "Stop " << currentTrajectory_.toString();
+    return currentTrajectory_.complete;
+}
+
 bool SmoothTrajectoryGenerator::generatePointToPointTrajectory(Point initialPoint, Point targetPoint, LIMITS_MODE limits_mode)
 {    
     // Print to logs
@@ -81,7 +461,15 @@ bool SmoothTrajectoryGenerator::generatePointToPointTrajectory(Point initialPoin
     PLOGD_(MOTION_LOG_ID).printf("Target point: %s", targetPoint.toString().c_str());
 
     MotionPlanningProblem mpp = buildMotionPlanningProblem(initialPoint, targetPoint, limits_mode, solver_params_);
-    currentTrajectory_ = generateTrajectory(mpp);
+    return setPointToPointTrajectory(cache_ ? cache_->getTrajectory(mpp, limits_mode) : generateTrajectory(mpp));
+}
+
+bool SmoothTrajectoryGenerator::setPointToPointTrajectory(const Trajectory& trajectory)
+{
+    currentTrajectory_ = trajectory;
+    path_mode_ = false;
+    trans_region_hint_ = 1;
+    rot_region_hint_ = 1;
 
     PLOGI << currentTrajectory_.toString();
     PLOGD_(MOTION_LOG_ID) << currentTrajectory_.toString();
@@ -112,6 +500,9 @@ bool SmoothTrajectoryGenerator::generateConstVelTrajectory(Point initialPoint, V
 
     MotionPlanningProblem mpp = buildMotionPlanningProblem(initialPoint, targetPoint, limits_mode, solver_params_);
     currentTrajectory_ = generateTrajectory(mpp);
+    path_mode_ = false;
+    trans_region_hint_ = 1;
+    rot_region_hint_ = 1;
 
     PLOGI << currentTrajectory_.toString();
     PLOGD_(MOTION_LOG_ID) << currentTrajectory_.toString();
@@ -119,50 +510,181 @@ bool SmoothTrajectoryGenerator::generateConstVelTrajectory(Point initialPoint, V
     return currentTrajectory_.complete;
 }
 
+bool SmoothTrajectoryGenerator::generatePathTrajectory(Point initialPoint, const std::vector<Point>& waypoints, LIMITS_MODE limits_mode)
+{
+    // Print to logs
+    PLOGI.printf("Generating path trajectory with %zu waypoints", waypoints.size());
+    PLOGI.printf("Starting point: %s", initialPoint.toString().c_str());
+    PLOGD_(MOTION_LOG_ID).printf("\nGenerating path trajectory with %zu waypoints", waypoints.size());
+    PLOGD_(MOTION_LOG_ID).printf("Starting point: %s", initialPoint.toString().c_str());
+
+    path_mode_ = false;
+    path_segments_.clear();
+    currentTrajectory_.complete = false;
+    if (waypoints.empty() || waypoints.size() > MAX_PATH_WAYPOINTS)
+    {
+        PLOGW << "Path needs between 1 and " << MAX_PATH_WAYPOINTS << " waypoints, got " << waypoints.size();
+        return false;
+    }
+
+    // Each leg is a normal rest to rest trajectory, blending happens by overlapping them in time
+    Point leg_start = initialPoint;
+    MotionPlanningProblem mpp;
+    for (const Point& waypoint : waypoints)
+    {
+        PLOGD_(MOTION_LOG_ID).printf("Waypoint: %s", waypoint.toString().c_str());
+        mpp = buildMotionPlanningProblem(leg_start, waypoint, limits_mode, solver_params_);
+        PathSegment segment;
+        segment.traj = cache_ ? cache_->getTrajectory(mpp, limits_mode) : generateTrajectory(mpp);
+        if (!segment.traj.complete)
+        {
+            PLOGW.printf("Failed to generate path leg to %s", waypoint.toString().c_str());
+            path_segments_.clear();
+            return false;
+        }
+        segment.start_time = 0;
+        segment.trans_region_hint = 1;
+        segment.rot_region_hint = 1;
+        path_segments_.push_back(segment);
+        leg_start = waypoint;
+    }
+
+    float end_time = blendPathSegments(&path_segments_, mpp.translationalLimits, mpp.rotationalLimits, blend_params_);
+    path_mode_ = true;
+
+    PLOGI.printf("Path trajectory generated, %.3f s", end_time);
+    for (const PathSegment& segment : path_segments_)
+    {
+        PLOGD_(MOTION_LOG_ID).printf("Leg start: %.3f s", segment.start_time);
+        PLOGD_(MOTION_LOG_ID) << segment.traj.toString();
+    }
+
+    return true;
+}
+
+void SmoothTrajectoryGenerator::foldFinishedSegments(float time)
+{
+    // The path is relative to the first leg's start point, so the travel of every leg that has finished is
+    // moved into that before the leg is dropped
+    Point origin = path_segments_.front().traj.initialPoint;
+    size_t kept = 0;
+    for (size_t i = 0; i < path_segments_.size(); i++)
+    {
+        const PathSegment& segment = path_segments_[i];
+        if (segmentEndTime(segment) <= time && path_segments_.size() - i + kept > 1)
+        {
+            const Eigen::Vector2f trans = segment.traj.trans_params.switch_points[7].p * segment.traj.trans_direction;
+            origin.x += trans(0);
+            origin.y += trans(1);
+            origin.a = wrap_angle(origin.a + segment.traj.rot_params.switch_points[7].p * segment.traj.rot_direction);
+            continue;
+        }
+        path_segments_[kept++] = segment;
+    }
+    path_segments_.resize(kept);
+    path_segments_.front().traj.initialPoint = origin;
+}
+
+bool SmoothTrajectoryGenerator::retarget(float time, Point targetPoint, LIMITS_MODE limits_mode)
+{
+    PLOGI.printf("Retargeting trajectory at %.3f s to %s", time, targetPoint.toString().c_str());
+    PLOGD_(MOTION_LOG_ID).printf("\nRetargeting trajectory at %.3f s to %s", time, targetPoint.toString().c_str());
+
+    // The running trajectory becomes the first leg of a path so the correction can be superimposed on it
+    if (!path_mode_)
+    {
+        if (!currentTrajectory_.complete) return false;
+        path_segments_.clear();
+        path_segments_.push_back({currentTrajectory_, 0, 1, 1});
+        path_mode_ = true;
+    }
+    if (path_segments_.empty()) return false;
+    foldFinishedSegments(time);
+    if (path_segments_.size() >= MAX_PATH_WAYPOINTS)
+    {
+        PLOGW << "Too many legs running to retarget, limit is " << MAX_PATH_WAYPOINTS;
+        return false;
+    }
+
+    // A rest to rest leg from where the path would have ended to the new target. Added on top of the path it
+    // keeps the position, velocity and acceleration the robot already has when it starts.
+    const float path_end = getDuration();
+    const Point old_end = lookupPath(path_end, &path_segments_).position;
+    MotionPlanningProblem mpp = buildMotionPlanningProblem(old_end, targetPoint, limits_mode, solver_params_);
+    PathSegment correction;
+    correction.traj = cache_ ? cache_->getTrajectory(mpp, limits_mode) : generateTrajectory(mpp);
+    if (!correction.traj.complete)
+    {
+        PLOGW.printf("Failed to generate retarget leg to %s", targetPoint.toString().c_str());
+        return false;
+    }
+    correction.trans_region_hint = 1;
+    correction.rot_region_hint = 1;
+    path_segments_.push_back(correction);
+
+    // Start the correction now if the summed legs stay within the limits, otherwise halve the wait until the
+    // rest of the path is done each time, same as blending a path waypoint
+    const float earliest = std::min(time, path_end);
+    float start = earliest;
+    for (int attempt = 0; ; attempt++)
+    {
+        path_segments_.back().start_time = start;
+        if (start >= path_end ||
+            pathWithinLimits(path_segments_, path_segments_.size(), start, path_end, mpp.translationalLimits, mpp.rotationalLimits, blend_params_.check_dt))
+        {
+            break;
+        }
+        if (attempt >= blend_params_.max_iterations)
+        {
+            start = path_end;
+            path_segments_.back().start_time = start;
+            break;
+        }
+        start = earliest + (path_end - earliest) * (1 - std::pow(0.5f, attempt + 1));
+    }
+    path_segments_.back().start_time = std::max(start, time);
+
+    PLOGI.printf("Retarget leg starts at %.3f s, path now ends at %.3f s", path_segments_.back().start_time, getDuration());
+    PLOGD_(MOTION_LOG_ID) << correction.traj.toString();
+    return true;
+}
+
 MotionPlanningProblem buildMotionPlanningProblem(Point initialPoint, Point targetPoint, LIMITS_MODE limits_mode, const SolverParameters& solver)
 {
     MotionPlanningProblem mpp;
     mpp.initialPoint = {initialPoint.x, initialPoint.y, initialPoint.a};
     mpp.targetPoint = {targetPoint.x, targetPoint.y, targetPoint.a};
 
-    DynamicLimits translationalLimits;
-    DynamicLimits rotationalLimits;
     if(limits_mode == LIMITS_MODE::VISION)
     {
         PLOGI << "Setting trajectory limits mode to LIMITS_MODE::VISION";
-        translationalLimits = { cfg.lookup("motion.translation.max_vel.vision"), 
-                                cfg.lookup("motion.translation.max_acc.vision"), 
-                                cfg.lookup("motion.translation.max_jerk.vision")};
-        rotationalLimits = {    cfg.lookup("motion.rotation.max_vel.vision"), 
-                                cfg.lookup("motion.rotation.max_acc.vision"), 
-                                cfg.lookup("motion.rotation.max_jerk.vision")};
     }
     else if(limits_mode == LIMITS_MODE::FINE || limits_mode == LIMITS_MODE::SLOW)
     {
         PLOGI << "Setting trajectory limits mode to LIMITS_MODE::FINE/SLOW";
-        translationalLimits = { cfg.lookup("motion.translation.max_vel.fine"), 
-                                cfg.lookup("motion.translation.max_acc.fine"), 
-                                cfg.lookup("motion.translation.max_jerk.fine")};
-        rotationalLimits = {    cfg.lookup("motion.rotation.max_vel.fine"), 
-                                cfg.lookup("motion.rotation.max_acc.fine"), 
-                                cfg.lookup("motion.rotation.max_jerk.fine")};
     }
     else
     {
         PLOGI << "Setting trajectory limits mode to LIMITS_MODE::COARSE";
-        translationalLimits = { cfg.lookup("motion.translation.max_vel.coarse"), 
-                                cfg.lookup("motion.translation.max_acc.coarse"), 
-                                cfg.lookup("motion.translation.max_jerk.coarse")};
-        rotationalLimits = {    cfg.lookup("motion.rotation.max_vel.coarse"), 
-                                cfg.lookup("motion.rotation.max_acc.coarse"), 
-                                cfg.lookup("motion.rotation.max_jerk.coarse")};
     }
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    DynamicLimits translationalLimits = config->translation.limits(limits_mode);
+    DynamicLimits rotationalLimits = config->rotation.limits(limits_mode);
 
     // This scaling makes sure to give some headroom for the controller to go a bit faster than the planned limits 
     // without actually violating any hard constraints
-    mpp.translationalLimits = translationalLimits * cfg.lookup("motion.limit_max_fraction");
-    mpp.rotationalLimits = rotationalLimits * cfg.lookup("motion.limit_max_fraction");
+    mpp.translationalLimits = translationalLimits * config->limit_max_fraction;
+    mpp.rotationalLimits = rotationalLimits * config->limit_max_fraction;
     mpp.solver_params = solver;
+    if(config->coupledPlanning(limits_mode))
+    {
+        mpp.wheelLimits = config->wheel_limits;
+        mpp.wheelLimits.max_vel *= config->limit_max_fraction;
+        mpp.wheelLimits.max_acc *= config->limit_max_fraction;
+        // Either axis on its own can go as fast as the wheels allow
+        mpp.translationalLimits.max_vel = mpp.wheelLimits.max_vel;
+        mpp.rotationalLimits.max_vel = mpp.wheelLimits.max_vel / mpp.wheelLimits.base_radius;
+    }
 
     return std::move(mpp);     
 }
@@ -174,6 +696,11 @@ bool sCurveWithinLimits(const SCurveParameters& params, const DynamicLimits& lim
 
 Trajectory generateTrajectory(MotionPlanningProblem problem)
 {   
+    if(problem.wheelLimits.enabled)
+    {
+        return generateCoupledTrajectory(problem);
+    }
+
     // Figure out delta that the trajectory needs to cover
     Eigen::Vector3f deltaPosition = problem.targetPoint - problem.initialPoint;
     deltaPosition(2) = wrap_angle(deltaPosition(2));
@@ -231,10 +758,80 @@ Trajectory generateTrajectory(MotionPlanningProblem problem)
     return traj;
 }
 
+Trajectory generateCoupledTrajectory(const MotionPlanningProblem& problem)
+{
+    Eigen::Vector3f deltaPosition = problem.targetPoint - problem.initialPoint;
+    deltaPosition(2) = wrap_angle(deltaPosition(2));
+
+    Trajectory traj;
+    traj.complete = false;
+    traj.initialPoint = {problem.initialPoint(0), problem.initialPoint(1), problem.initialPoint(2)};
+    traj.trans_direction = deltaPosition.head(2).normalized();
+    traj.rot_direction = sgn(deltaPosition(2));
+
+    // Axes too short to plan for on their own don't take any of the wheel budget
+    const float min_dist = ConfigSnapshot::current()->min_dist_limit;
+    const WheelLimits& wheels = problem.wheelLimits;
+    float trans_dist = deltaPosition.head(2).norm();
+    float rot_dist = fabs(deltaPosition(2));
+    if (trans_dist < min_dist) trans_dist = 0;
+    if (rot_dist < min_dist) rot_dist = 0;
+    const float wheel_dist = trans_dist + wheels.base_radius * rot_dist;
+
+    SCurveParameters profile;
+    if (wheel_dist < min_dist)
+    {
+        generateSCurve(0, problem.translationalLimits, problem.solver_params, &profile);
+        traj.trans_params = profile;
+        traj.rot_params = profile;
+        traj.complete = true;
+        return traj;
+    }
+
+    // Limits of the profile in wheel travel. An axis covering a fraction of it gets the same fraction of each limit.
+    DynamicLimits limits = {wheels.max_vel, wheels.max_acc, std::numeric_limits<float>::max()};
+    auto applyAxisLimits = [&](float dist, const DynamicLimits& axis)
+    {
+        if (dist == 0) return;
+        const float scale = wheel_dist / dist;
+        limits.max_vel = std::min(limits.max_vel, axis.max_vel * scale);
+        limits.max_acc = std::min(limits.max_acc, axis.max_acc * scale);
+        limits.max_jerk = std::min(limits.max_jerk, axis.max_jerk * scale);
+    };
+    applyAxisLimits(trans_dist, problem.translationalLimits);
+    applyAxisLimits(rot_dist, problem.rotationalLimits);
+
+    if (!generateSCurve(wheel_dist, limits, problem.solver_params, &profile))
+    {
+        PLOGW << "Failed to generate coupled trajectory";
+        return traj;
+    }
+
+    traj.trans_params = profile;
+    scaleSCurve(&traj.trans_params, trans_dist / wheel_dist);
+    traj.rot_params = profile;
+    scaleSCurve(&traj.rot_params, rot_dist / wheel_dist);
+    traj.complete = true;
+    return traj;
+}
+
+void scaleSCurve(SCurveParameters* params, float scale)
+{
+    params->v_lim *= scale;
+    params->a_lim *= scale;
+    params->j_lim *= scale;
+    for (int i = 0; i < 8; i++)
+    {
+        params->switch_points[i].p *= scale;
+        params->switch_points[i].v *= scale;
+        params->switch_points[i].a *= scale;
+    }
+}
+
 bool generateSCurve(float dist, DynamicLimits limits, const SolverParameters& solver, SCurveParameters* params)
 {
     // Handle case where distance is very close to 0
-    float min_dist = cfg.lookup("trajectory_generation.min_dist_limit"); 
+    float min_dist = ConfigSnapshot::current()->min_dist_limit;
     if (fabs(dist) < min_dist)
     {
         params->v_lim = 0;
@@ -249,7 +846,16 @@ bool generateSCurve(float dist, DynamicLimits limits, const SolverParameters& so
         }
         return true;
     }
-    
+
+    if (solver.mode == SOLVER_MODE::ANALYTIC)
+    {
+        return generateSCurveAnalytic(dist, limits, params);
+    }
+    return generateSCurveIterative(dist, limits, solver, params);
+}
+
+bool generateSCurveIterative(float dist, DynamicLimits limits, const SolverParameters& solver, SCurveParameters* params)
+{
     // Initialize parameters
     float v_lim = limits.max_vel;
     float a_lim = limits.max_acc;
@@ -304,6 +910,60 @@ bool generateSCurve(float dist, DynamicLimits limits, const SolverParameters& so
     return solution_found;
 }
 
+bool generateSCurveAnalytic(float dist, DynamicLimits limits, SCurveParameters* params)
+{
+    const float v_max = limits.max_vel;
+    const float a_max = limits.max_acc;
+    const float j_lim = limits.max_jerk;
+    if (v_max <= 0 || a_max <= 0 || j_lim <= 0)
+    {
+        PLOGW << "Trajectory limits must be positive";
+        return false;
+    }
+
+    // The profile is symmetric, so the distance covered accelerating to a peak velocity v over a time T
+    // and decelerating back down is v * T. Each case below solves that for the switch times.
+    float dt_j, dt_a, dt_v, v_peak;
+
+    // Fastest way to reach v_max, if v_max is low the acceleration limit is never hit
+    const float dt_j_vmax = std::min(a_max / j_lim, std::sqrt(v_max / j_lim));
+    const float dt_a_vmax = std::max(v_max / (j_lim * dt_j_vmax) - dt_j_vmax, 0.0f);
+    const float dist_vmax = v_max * (2 * dt_j_vmax + dt_a_vmax);
+    // Shortest move that hits a_max
+    const float dist_amax = 2 * std::pow(a_max, 3) / std::pow(j_lim, 2);
+
+    if (dist >= dist_vmax)
+    {
+        // Reaches v_max, cruise for the remaining distance
+        dt_j = dt_j_vmax;
+        dt_a = dt_a_vmax;
+        dt_v = (dist - dist_vmax) / v_max;
+        v_peak = v_max;
+    }
+    else if (dist >= dist_amax)
+    {
+        // Reaches a_max but not v_max: dist = v * (a/j + v/a), solve the quadratic for v
+        dt_j = a_max / j_lim;
+        v_peak = 0.5 * a_max * (std::sqrt(dt_j * dt_j + 4 * dist / a_max) - dt_j);
+        dt_a = std::max(v_peak / a_max - dt_j, 0.0f);
+        dt_v = 0;
+    }
+    else
+    {
+        // Only jerk regions: dist = 2 * j * dt_j^3
+        dt_j = std::cbrt(dist / (2 * j_lim));
+        dt_a = 0;
+        dt_v = 0;
+        v_peak = j_lim * dt_j * dt_j;
+    }
+
+    params->v_lim = std::min(v_peak, v_max);
+    params->a_lim = std::min(j_lim * dt_j, a_max);
+    params->j_lim = j_lim;
+    populateSwitchTimeParameters(params, dt_j, dt_a, dt_v);
+    return true;
+}
+
 void populateSwitchTimeParameters(SCurveParameters* params, float dt_j, float dt_a, float dt_v)
 {
     // Fill first point with all zeros
@@ -332,10 +992,10 @@ void populateSwitchTimeParameters(SCurveParameters* params, float dt_j, float dt
         }
 
         // Populate values
-        std::vector<float> values = computeKinematicsBasedOnRegion(*params, i, dt);
-        params->switch_points[i].a = values[0];
-        params->switch_points[i].v = values[1];
-        params->switch_points[i].p = values[2];
+        Kinematics1D values = computeKinematicsBasedOnRegion(*params, i, dt);
+        params->switch_points[i].a = values.a;
+        params->switch_points[i].v = values.v;
+        params->switch_points[i].p = values.p;
         params->switch_points[i].t = params->switch_points[i-1].t + dt;
     }
 }
@@ -410,7 +1070,7 @@ bool solveInverse(SCurveParameters* params)
     return true;
 }
 
-std::vector<float> computeKinematicsBasedOnRegion(const SCurveParameters& params, int region, float dt)
+Kinematics1D computeKinematicsBasedOnRegion(const SCurveParameters& params, int region, float dt)
 {
     float j, a, v, p;
     bool need_a = true;
@@ -453,7 +1113,7 @@ std::vector<float> computeKinematicsBasedOnRegion(const SCurveParameters& params
     {
         // Error
         PLOGE << "Invalid region value: " << region;
-        return {0,0,0,0};
+        return {0,0,0};
     }
 
     // Compute remaining values
@@ -474,5 +1134,5 @@ std::vector<float> computeKinematicsBasedOnRegion(const SCurveParameters& params
         0.5 * params.switch_points[region-1].a * std::pow(dt, 2) + 
         d6 * j * std::pow(dt, 3);
 
-    return {a,v,p};
+    return {p,v,a};
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 #define SmoothTrajectoryGenerator_h
 
 #include <Eigen/Dense>
+#include <vector>
 #include "utils.h"
+#include "serial/SerialBinaryProtocol.h"
 
 
 // Return structure for a trajectory point lookup that contains all the info about a point in time the controller
@@ -12,6 +14,7 @@ struct PVTPoint
     Point position;
     Velocity velocity;
     float time;
+    Velocity acceleration;  // Same layout as velocity, per s
 
     std::string toString() const
     {
@@ -49,6 +52,14 @@ struct SwitchPoint
     float a;
 };
 
+// Position, velocity and acceleration of a 1-D trajectory at a point in time
+struct Kinematics1D
+{
+    float p;
+    float v;
+    float a;
+};
+
 // Parameters defining a 1-D S-curve trajectory
 struct SCurveParameters
 {
@@ -85,12 +96,35 @@ struct Trajectory
     }
 };
 
+enum class SOLVER_MODE
+{
+    ITERATIVE,      // Decay the velocity and acceleration limits until a profile fits
+    ANALYTIC,       // Closed form time optimal profile for the given limits
+};
+
+// One leg of a multi-waypoint path. Legs are superimposed, and a leg may start before the previous one has
+// finished so the robot blends through the waypoint between them instead of stopping there.
+struct PathSegment
+{
+    Trajectory traj;
+    float start_time;
+    int trans_region_hint;
+    int rot_region_hint;
+};
+
+struct PathBlendParameters
+{
+    float check_dt;         // Sample period used to check limits while two legs overlap
+    int max_iterations;     // Attempts at a shorter overlap before stopping at the waypoint
+};
+
 struct SolverParameters
 {
     int num_loops;
     float alpha_decay;
     float beta_decay;
     float exponent_decay;
+    SOLVER_MODE mode = SOLVER_MODE::ITERATIVE;
 };
 
 enum class LIMITS_MODE
@@ -101,6 +135,16 @@ enum class LIMITS_MODE
     SLOW,
 };
 
+// What the omni wheels can do, shared between translation and rotation. A wheel moves at up to the translational
+// speed plus base_radius times the rotational speed, whatever the heading, and the same holds for acceleration.
+struct WheelLimits
+{
+    bool enabled;           // Plan with generateCoupledTrajectory
+    float base_radius;      // Wheel distance from the center of the base
+    float max_vel;          // At the wheel rim
+    float max_acc;
+};
+
 // All the pieces needed to define the motion planning problem
 struct MotionPlanningProblem
 {
@@ -109,44 +153,156 @@ struct MotionPlanningProblem
     DynamicLimits translationalLimits;
     DynamicLimits rotationalLimits;  
     SolverParameters solver_params;
+    WheelLimits wheelLimits = {false, 0, 0, 0};
+};
+
+// Trajectory samples with one array per component, so a whole trajectory can be evaluated and checked in a few
+// vectorized passes instead of one lookup at a time. Everything is in the global frame.
+struct TrajectorySamples
+{
+    std::vector<float> x, y, a;
+    std::vector<float> vx, vy, va;
+    std::vector<float> ax, ay, aa;
+
+    void resize(size_t n);
+    size_t size() const { return x.size(); };
+};
+
+// How close the wheels come to their limits over a set of samples, see checkWheelLimits
+struct WheelFeasibility
+{
+    bool ok;
+    float max_vel;          // Fastest any wheel goes, m/s at the rim
+    float max_acc;
+    float worst_time;       // Time of the sample closest to, or furthest over, a limit
 };
 
 // Helper methods - making public for easier testing
 MotionPlanningProblem buildMotionPlanningProblem(Point initialPoint, Point targetPoint, LIMITS_MODE limits_mode, const SolverParameters& solver);
 Trajectory generateTrajectory(MotionPlanningProblem problem);
+// Plans one profile over the combined wheel travel of the move, distance plus base_radius times angle, and gives
+// each axis its share of it. Both axes start and end together without stretching either, and the wheel limits
+// are split between them by how much of the move each one is. The per axis acceleration and jerk limits still
+// apply, the velocity limits come from the wheels.
+Trajectory generateCoupledTrajectory(const MotionPlanningProblem& problem);
+// Scales positions and all derivatives by scale while keeping the switch times
+void scaleSCurve(SCurveParameters* params, float scale);
 bool generateSCurve(float dist, DynamicLimits limits, const SolverParameters& solver, SCurveParameters* params);
+bool generateSCurveIterative(float dist, DynamicLimits limits, const SolverParameters& solver, SCurveParameters* params);
+bool generateSCurveAnalytic(float dist, DynamicLimits limits, SCurveParameters* params);
 void populateSwitchTimeParameters(SCurveParameters* params, float dt_j, float dt_a, float dt_v);
 bool synchronizeParameters(SCurveParameters* params1, SCurveParameters* params2);
 bool slowDownParamsToMatchTime(SCurveParameters* params, float time_to_match);
 bool solveInverse(SCurveParameters* params);
-std::vector<float> lookup_1D(float time, const SCurveParameters& params);
-std::vector<float> computeKinematicsBasedOnRegion(const SCurveParameters& params, int region, float dt);
+// If region_hint is given the search for the region containing time starts from it, and it is updated with the
+// region found. Successive lookups with increasing time then only check one or two regions.
+Kinematics1D lookup_1D(float time, const SCurveParameters& params, int* region_hint = nullptr);
+Kinematics1D computeKinematicsBasedOnRegion(const SCurveParameters& params, int region, float dt);
+// lookup_1D for n times at once, written to p, v and a. The times don't have to be sorted, but the region search
+// is quickest when they are.
+void lookup_1D_batch(const float* times, size_t n, const SCurveParameters& params, float* p, float* v, float* a);
+// Profile as the motor driver evaluates it, with positions, velocities, accelerations and the limits multiplied by scale
+SerialTrajectoryAxis toSerialTrajectoryAxis(uint16_t traj_id, SERIAL_TRAJECTORY_AXIS axis, float dir_x, float dir_y,
+                                            const SCurveParameters& params, float scale = 1.0f);
+// Wheel rim speeds and accelerations at each sample, from the same inverse kinematics as doIK in the motor driver
+// without the wheel radius and belt ratio. Only the base_radius and limits of limits are used.
+WheelFeasibility checkWheelLimits(const float* times, const TrajectorySamples& samples, const WheelLimits& limits);
+// Time the slower of the translation and rotation profiles ends at
+float trajectoryDuration(const Trajectory& traj);
+// Time optimal jerk limited slow down from speed v0 at zero acceleration to rest. It is the deceleration half of an
+// S-curve, regions 1 to 4 take no time, so it is looked up like any other profile starting from p = 0 at t = 0.
+void generateStopSCurve(float v0, const DynamicLimits& limits, SCurveParameters* params);
+// Makes a stop profile take duration instead, keeping its shape. Acceleration scales by 1/k and jerk by 1/k^2 for
+// a stretch of k, so a stop that fit its limits still does.
+void stretchStopSCurve(SCurveParameters* params, float duration);
+// Stops translation along the current direction of travel and rotation together, both come to rest at the same
+// time as the slower one would on its own
+Trajectory generateStopTrajectory(Point initialPoint, Velocity velocity, const DynamicLimits& trans_limits, const DynamicLimits& rot_limits);
 
+// Sets the start time of each segment as early as possible without the summed legs exceeding the velocity or
+// acceleration limits. Returns the end time of the path.
+float blendPathSegments(std::vector<PathSegment>* segments, const DynamicLimits& trans_limits, const DynamicLimits& rot_limits,
+                        const PathBlendParameters& blend);
+PVTPoint lookupPath(float time, std::vector<PathSegment>* segments);
+
+class TrajectoryCache;
 
 class SmoothTrajectoryGenerator
 {
 
   public:
-    SmoothTrajectoryGenerator();
+    // Point to point trajectories are looked up in cache if one is given, it must outlive the generator
+    SmoothTrajectoryGenerator(TrajectoryCache* cache = nullptr);
 
     // Generates a trajectory that starts at the initial point and ends at the target point. Setting fineMode to true makes the 
     // adjusts the dynamic limits for a more accurate motion. Returns a bool indicating if trajectory generation was
     // successful
     bool generatePointToPointTrajectory(Point initialPoint, Point targetPoint, LIMITS_MODE limits_mode);
 
+    // Makes a point to point trajectory solved somewhere else, such as by TrajectoryPlanner, the current one.
+    // Returns false if it isn't complete, like generatePointToPointTrajectory.
+    bool setPointToPointTrajectory(const Trajectory& trajectory);
+
     // Generates a trajectory that attempts to maintain the target velocity for a specified time. Note that the current implimentation
     // of this does not give a guarantee on the accuracy of the velocity if the specified velocity and move time would violate the dynamic 
     // limits of the fine or coarse movement mode. Returns a bool indicating if trajectory generation was successful
     bool generateConstVelTrajectory(Point initialPoint, Velocity velocity, float moveTime, LIMITS_MODE limits_mode);
 
+    // Generates a single trajectory from the initial point through each of the waypoints in turn, blending through
+    // intermediate waypoints without stopping where the limits allow it. Returns a bool indicating if trajectory
+    // generation was successful
+    bool generatePathTrajectory(Point initialPoint, const std::vector<Point>& waypoints, LIMITS_MODE limits_mode);
+
+    // Generates the quickest jerk limited stop from the given velocity, see generateStopTrajectory
+    bool generateStopTrajectory(Point initialPoint, Velocity velocity, const DynamicLimits& trans_limits, const DynamicLimits& rot_limits);
+
+    // Changes where the current trajectory or path ends, time seconds after it started, without stopping on the
+    // way. A rest to rest leg from the old end to targetPoint is superimposed on what is already running, so the
+    // robot carries on from the velocity and acceleration it has at that moment. The leg starts at time if the
+    // summed motion stays within the limits, otherwise as soon after as it can. Returns false and leaves the
+    // trajectory as it was if the leg couldn't be generated.
+    bool retarget(float time, Point targetPoint, LIMITS_MODE limits_mode);
+
     // Looks up a point in the current trajectory based on the time, in seconds, from the start of the trajectory
     PVTPoint lookup(float time);
 
+    // Looks up n times at once, samples is resized to n. Gives the same values as lookup at each time, plus the
+    // acceleration.
+    void lookupBatch(const float* times, size_t n, TrajectorySamples* samples) const;
+
+    // Samples the whole trajectory or path every dt seconds and checks it against limits
+    WheelFeasibility checkWheelFeasibility(const WheelLimits& limits, float dt) const;
+
+    // The current point to point trajectory, not meaningful while following a path
+    const Trajectory& getTrajectory() const { return currentTrajectory_; };
+
+    bool isPathTrajectory() const { return path_mode_; };
+
+    // Seconds from the start of the current trajectory or path until it ends
+    float getDuration() const;
+
+    // Picks up solver settings from the current config snapshot, for generators that are kept between moves
+    void refreshConfig();
+
   private:
 
+    // Drops path legs that have finished by time, keeping at least one
+    void foldFinishedSegments(float time);
+
     // The current trajectory - this lets the generation class hold onto this and just provide a lookup method
     // since I don't have a need to pass the trajectory around anywhere
     Trajectory currentTrajectory_;
+
+    // Last regions found by lookup, so a trajectory played forward in time doesn't rescan every region
+    int trans_region_hint_;
+    int rot_region_hint_;
+
+    TrajectoryCache* cache_;
+
+    // Set when the current trajectory is a path, in which case path_segments_ is used instead of currentTrajectory_
+    bool path_mode_;
+    std::vector<PathSegment> path_segments_;
+    PathBlendParameters blend_params_;
     
     // These need to be part of the class because they need to be loaded at construction time, not
     // program initialization time (i.e. as globals). This is because the config file is not
@@ -0,0 +1,39 @@
+#include "StartupReport.h"
+
+#include <plog/Log.h>
+
+StartupReport::StartupReport()
+: start_time_(ClockFactory::getFactoryInstance()->get_clock()->now()),
+  phases_(),
+  mutex_()
+{}
+
+void StartupReport::time(const std::string& name, const std::function<void()>& fn)
+{
+    Timer timer;
+    fn();
+    float ms = timer.dt_us() / 1000.0f;
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases_.push_back({name, ms});
+}
+
+std::vector<StartupReport::Phase> StartupReport::getPhases() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return phases_;
+}
+
+float StartupReport::getTotalMs() const
+{
+    return std::chrono::duration<float, std::milli>(ClockFactory::getFactoryInstance()->get_clock()->now() - start_time_).count();
+}
+
+void StartupReport::log() const
+{
+    std::vector<Phase> phases = getPhases();
+    for (const Phase& phase : phases)
+    {
+        PLOGI.printf("Startup %-20s %8.1f ms", phase.name.c_str(), phase.ms);
+    }
+    PLOGI.printf("Startup total %8.1f ms", getTotalMs());
+}
@@ -0,0 +1,44 @@
+#ifndef StartupReport_h
+#define StartupReport_h
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+// Collects how long each phase of startup took and logs them together, so a slow boot can be pinned on
+// one device. Phases can be timed from several threads at once.
+class StartupReport
+{
+  public:
+
+    struct Phase
+    {
+        std::string name;
+        float ms;
+    };
+
+    StartupReport();
+
+    // Runs fn and records how long it took under name
+    void time(const std::string& name, const std::function<void()>& fn);
+
+    // Phases in the order they finished
+    std::vector<Phase> getPhases() const;
+
+    // Since construction
+    float getTotalMs() const;
+
+    // Logs every phase and the total
+    void log() const;
+
+  private:
+
+    ClockTimePoint start_time_;
+    std::vector<Phase> phases_;
+    mutable std::mutex mutex_;
+};
+
+#endif //StartupReport_h
@@ -1,72 +1,686 @@
 #include "StatusUpdater.h"
 #include "constants.h"
 
+namespace
+{
+    enum class FIELD_TYPE
+    {
+        FLOAT,
+        INT,
+        BOOL,
+    };
+
+    struct StatusFieldInfo
+    {
+        const char* name;
+        uint32_t group;
+        FIELD_TYPE type;
+    };
+
+    // Order must match fillFieldValues below
+    const StatusFieldInfo STATUS_FIELDS[NUM_STATUS_FIELDS] = 
+    {
+        {"pos_x", STATUS_GROUP_POSE, FIELD_TYPE::FLOAT},
+        {"pos_y", STATUS_GROUP_POSE, FIELD_TYPE::FLOAT},
+        {"pos_a", STATUS_GROUP_POSE, FIELD_TYPE::FLOAT},
+        {"vel_x", STATUS_GROUP_VELOCITY, FIELD_TYPE::FLOAT},
+        {"vel_y", STATUS_GROUP_VELOCITY, FIELD_TYPE::FLOAT},
+        {"vel_a", STATUS_GROUP_VELOCITY, FIELD_TYPE::FLOAT},
+        {"controller_loop_ms", STATUS_GROUP_LOOP_TIMES, FIELD_TYPE::INT},
+        {"position_loop_ms", STATUS_GROUP_LOOP_TIMES, FIELD_TYPE::INT},
+        {"driver_loop_mean_us", STATUS_GROUP_LOOP_TIMES, FIELD_TYPE::INT},
+        {"driver_loop_max_us", STATUS_GROUP_LOOP_TIMES, FIELD_TYPE::INT},
+        {"main_allocs_max", STATUS_GROUP_LOOP_TIMES, FIELD_TYPE::INT},
+        {"main_allocs_total", STATUS_GROUP_LOOP_TIMES, FIELD_TYPE::INT},
+        {"in_progress", STATUS_GROUP_STATE, FIELD_TYPE::BOOL},
+        {"error_status", STATUS_GROUP_STATE, FIELD_TYPE::BOOL},
+        {"motor_driver_connected", STATUS_GROUP_STATE, FIELD_TYPE::BOOL},
+        {"lifter_driver_connected", STATUS_GROUP_STATE, FIELD_TYPE::BOOL},
+        {"cmd_queue_depth", STATUS_GROUP_STATE, FIELD_TYPE::INT},
+        {"cmd_seq", STATUS_GROUP_STATE, FIELD_TYPE::INT},
+        {"cmd_done_seq", STATUS_GROUP_STATE, FIELD_TYPE::INT},
+        {"tray_in_progress", STATUS_GROUP_STATE, FIELD_TYPE::BOOL},
+        {"tray_done_seq", STATUS_GROUP_STATE, FIELD_TYPE::INT},
+        {"field_plan_id", STATUS_GROUP_STATE, FIELD_TYPE::INT},
+        {"field_plan_state", STATUS_GROUP_STATE, FIELD_TYPE::INT},
+        {"field_plan_step", STATUS_GROUP_STATE, FIELD_TYPE::INT},
+        {"field_plan_steps", STATUS_GROUP_STATE, FIELD_TYPE::INT},
+        {"localization_confidence_x", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::FLOAT},
+        {"localization_confidence_y", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::FLOAT},
+        {"localization_confidence_a", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::FLOAT},
+        {"localization_total_confidence", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::FLOAT},
+        {"last_position_uncertainty", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::FLOAT},
+        {"mm_gate_nis", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::FLOAT},
+        {"mm_rejected", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::INT},
+        {"mm_rejected_in_row", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::INT},
+        {"mm_reacquisitions", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::INT},
+        {"localize_wait_s", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::FLOAT},
+        {"localize_wait_active", STATUS_GROUP_LOCALIZATION, FIELD_TYPE::BOOL},
+        {"cam_side_ok", STATUS_GROUP_CAMERA, FIELD_TYPE::BOOL},
+        {"cam_rear_ok", STATUS_GROUP_CAMERA, FIELD_TYPE::BOOL},
+        {"cam_both_ok", STATUS_GROUP_CAMERA, FIELD_TYPE::BOOL},
+        {"cam_side_u", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_side_v", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_rear_u", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_rear_v", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_side_x", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_side_y", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_rear_x", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_rear_y", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_pose_x", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_pose_y", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_pose_a", STATUS_GROUP_CAMERA, FIELD_TYPE::FLOAT},
+        {"cam_loop_ms", STATUS_GROUP_CAMERA, FIELD_TYPE::INT},
+        {"cam_side_allocs", STATUS_GROUP_CAMERA, FIELD_TYPE::INT},
+        {"cam_rear_allocs", STATUS_GROUP_CAMERA, FIELD_TYPE::INT},
+        {"cam_rejected_pairs", STATUS_GROUP_CAMERA, FIELD_TYPE::INT},
+        {"cam_pair_skew_ms", STATUS_GROUP_CAMERA, FIELD_TYPE::INT},
+        {"vision_x", STATUS_GROUP_VISION, FIELD_TYPE::FLOAT},
+        {"vision_y", STATUS_GROUP_VISION, FIELD_TYPE::FLOAT},
+        {"vision_a", STATUS_GROUP_VISION, FIELD_TYPE::FLOAT},
+        {"camera_stop_error", STATUS_GROUP_VISION, FIELD_TYPE::FLOAT},
+        {"last_mm_x", STATUS_GROUP_MARVELMIND, FIELD_TYPE::FLOAT},
+        {"last_mm_y", STATUS_GROUP_MARVELMIND, FIELD_TYPE::FLOAT},
+        {"last_mm_a", STATUS_GROUP_MARVELMIND, FIELD_TYPE::FLOAT},
+        {"last_mm_used", STATUS_GROUP_MARVELMIND, FIELD_TYPE::BOOL},
+        {"socket_rx_fill", STATUS_GROUP_SOCKET, FIELD_TYPE::INT},
+        {"socket_tx_fill", STATUS_GROUP_SOCKET, FIELD_TYPE::INT},
+        {"socket_capacity", STATUS_GROUP_SOCKET, FIELD_TYPE::INT},
+        {"socket_rx_drops", STATUS_GROUP_SOCKET, FIELD_TYPE::INT},
+        {"socket_tx_drops", STATUS_GROUP_SOCKET, FIELD_TYPE::INT},
+        {"socket_tcp_rtt_ms", STATUS_GROUP_SOCKET, FIELD_TYPE::FLOAT},
+        {"socket_ping_rtt_ms", STATUS_GROUP_SOCKET, FIELD_TYPE::FLOAT},
+        {"rt_active", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::BOOL},
+        {"rt_jitter_max_us", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_jitter_avg_us", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_overruns", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_jitter_hist_50us", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_jitter_hist_100us", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_jitter_hist_250us", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_jitter_hist_500us", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_jitter_hist_1ms", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_jitter_hist_over", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_allocs_max", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"rt_allocs_total", STATUS_GROUP_CONTROL_THREAD, FIELD_TYPE::INT},
+        {"traj_cache_hits", STATUS_GROUP_PLANNING, FIELD_TYPE::INT},
+        {"traj_cache_misses", STATUS_GROUP_PLANNING, FIELD_TYPE::INT},
+        {"traj_cache_hit_rate", STATUS_GROUP_PLANNING, FIELD_TYPE::FLOAT},
+        {"traj_time_remaining", STATUS_GROUP_PLANNING, FIELD_TYPE::FLOAT},
+        {"settle_time", STATUS_GROUP_PLANNING, FIELD_TYPE::FLOAT},
+        {"plan_wait_ms", STATUS_GROUP_PLANNING, FIELD_TYPE::FLOAT},
+        {"plan_time_ms", STATUS_GROUP_PLANNING, FIELD_TYPE::FLOAT},
+        {"soc_temp_c", STATUS_GROUP_SYSTEM, FIELD_TYPE::FLOAT},
+        {"throttle_flags", STATUS_GROUP_SYSTEM, FIELD_TYPE::INT},
+        {"cpu_core0_usage", STATUS_GROUP_SYSTEM, FIELD_TYPE::FLOAT},
+        {"cpu_core1_usage", STATUS_GROUP_SYSTEM, FIELD_TYPE::FLOAT},
+        {"cpu_core2_usage", STATUS_GROUP_SYSTEM, FIELD_TYPE::FLOAT},
+        {"cpu_core3_usage", STATUS_GROUP_SYSTEM, FIELD_TYPE::FLOAT},
+        {"cpu_process", STATUS_GROUP_SYSTEM, FIELD_TYPE::FLOAT},
+        {"cpu_main_thread", STATUS_GROUP_SYSTEM, FIELD_TYPE::FLOAT},
+        {"cpu_control_thread", STATUS_GROUP_SYSTEM, FIELD_TYPE::FLOAT},
+        {"vision_degrade", STATUS_GROUP_SYSTEM, FIELD_TYPE::INT},
+        {"trace_server_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_server_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_server_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_marvelmind_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_marvelmind_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_marvelmind_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_controller_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_controller_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_controller_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_tray_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_tray_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_tray_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_serial_send_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_serial_send_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_serial_send_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_serial_recv_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_serial_recv_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_serial_recv_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_capture_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_capture_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_capture_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_undistort_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_undistort_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_undistort_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_threshold_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_threshold_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_threshold_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_detect_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_detect_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_detect_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_coarse_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_coarse_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_coarse_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_refine_p50_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_refine_p99_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+        {"trace_cam_refine_max_us", STATUS_GROUP_TRACE, FIELD_TYPE::INT},
+    };
+
+    void fillFieldValues(const StatusUpdater::Status& s, double* out)
+    {
+        int i = 0;
+        out[i++] = s.pos_x;
+        out[i++] = s.pos_y;
+        out[i++] = s.pos_a;
+        out[i++] = s.vel_x;
+        out[i++] = s.vel_y;
+        out[i++] = s.vel_a;
+        out[i++] = s.controller_loop_ms;
+        out[i++] = s.position_loop_ms;
+        out[i++] = s.driver_loop_mean_us;
+        out[i++] = s.driver_loop_max_us;
+        out[i++] = s.main_allocs_max;
+        out[i++] = s.main_allocs_total;
+        out[i++] = s.in_progress;
+        out[i++] = s.error_status;
+        out[i++] = s.motor_driver_connected;
+        out[i++] = s.lifter_driver_connected;
+        out[i++] = s.cmd_queue_depth;
+        out[i++] = s.cmd_seq;
+        out[i++] = s.cmd_done_seq;
+        out[i++] = s.tray_in_progress;
+        out[i++] = s.tray_done_seq;
+        out[i++] = s.field_plan_id;
+        out[i++] = s.field_plan_state;
+        out[i++] = s.field_plan_step;
+        out[i++] = s.field_plan_steps;
+        out[i++] = s.localization_metrics.confidence_x;
+        out[i++] = s.localization_metrics.confidence_y;
+        out[i++] = s.localization_metrics.confidence_a;
+        out[i++] = s.localization_metrics.total_confidence;
+        out[i++] = s.localization_metrics.last_position_uncertainty;
+        out[i++] = s.localization_metrics.last_nis;
+        out[i++] = s.localization_metrics.rejected_readings;
+        out[i++] = s.localization_metrics.consecutive_rejections;
+        out[i++] = s.localization_metrics.reacquisitions;
+        out[i++] = s.localize_wait_s;
+        out[i++] = s.localize_wait_active;
+        out[i++] = s.camera_debug.side_ok;
+        out[i++] = s.camera_debug.rear_ok;
+        out[i++] = s.camera_debug.both_ok;
+        out[i++] = s.camera_debug.side_u;
+        out[i++] = s.camera_debug.side_v;
+        out[i++] = s.camera_debug.rear_u;
+        out[i++] = s.camera_debug.rear_v;
+        out[i++] = s.camera_debug.side_x;
+        out[i++] = s.camera_debug.side_y;
+        out[i++] = s.camera_debug.rear_x;
+        out[i++] = s.camera_debug.rear_y;
+        out[i++] = s.camera_debug.pose_x;
+        out[i++] = s.camera_debug.pose_y;
+        out[i++] = s.camera_debug.pose_a;
+        out[i++] = s.camera_debug.loop_ms;
+        out[i++] = s.camera_debug.side_buffer_allocations;
+        out[i++] = s.camera_debug.rear_buffer_allocations;
+        out[i++] = s.camera_debug.rejected_pairs;
+        out[i++] = s.camera_debug.pair_skew_ms;
+        out[i++] = s.vision_x;
+        out[i++] = s.vision_y;
+        out[i++] = s.vision_a;
+        out[i++] = s.camera_stop_error;
+        out[i++] = s.last_mm_x;
+        out[i++] = s.last_mm_y;
+        out[i++] = s.last_mm_a;
+        out[i++] = s.last_mm_used;
+        out[i++] = s.socket_stats.read_fill;
+        out[i++] = s.socket_stats.send_fill;
+        out[i++] = s.socket_stats.capacity;
+        out[i++] = s.socket_stats.read_drops;
+        out[i++] = s.socket_stats.send_drops;
+        out[i++] = s.socket_stats.tcp_rtt_ms;
+        out[i++] = s.socket_stats.ping_rtt_ms;
+        out[i++] = s.control_thread_stats.active;
+        out[i++] = s.control_thread_stats.jitter_max_us;
+        out[i++] = s.control_thread_stats.jitter_avg_us;
+        out[i++] = s.control_thread_stats.overruns;
+        for (int j = 0; j < CONTROL_JITTER_NUM_BUCKETS; j++)
+        {
+            out[i++] = s.control_thread_stats.jitter_hist[j];
+        }
+        out[i++] = s.control_thread_stats.allocs_max;
+        out[i++] = s.control_thread_stats.allocs_total;
+        out[i++] = s.trajectory_cache_stats.hits;
+        out[i++] = s.trajectory_cache_stats.misses;
+        out[i++] = s.trajectory_cache_stats.hitRate();
+        out[i++] = s.traj_time_remaining;
+        out[i++] = s.settle_time;
+        out[i++] = s.plan_wait_ms;
+        out[i++] = s.plan_time_ms;
+        out[i++] = s.system_health.soc_temp_c;
+        out[i++] = s.system_health.throttle_flags;
+        for (int j = 0; j < SYSTEM_HEALTH_MAX_CORES; j++)
+        {
+            out[i++] = s.system_health.core_usage[j];
+        }
+        out[i++] = s.system_health.process_cpu;
+        out[i++] = s.system_health.main_thread_cpu;
+        out[i++] = s.system_health.control_thread_cpu;
+        out[i++] = s.system_health.vision_degrade;
+        // Names in the table above follow TRACE_POINT order
+        for (int j = 0; j < TRACE_NUM_POINTS; j++)
+        {
+            out[i++] = s.trace_stats.p50_us[j];
+            out[i++] = s.trace_stats.p99_us[j];
+            out[i++] = s.trace_stats.max_us[j];
+        }
+    }
+
+    void setJsonField(JsonObject& doc, const StatusFieldInfo& info, double value)
+    {
+        switch (info.type)
+        {
+            case FIELD_TYPE::FLOAT:
+                doc[info.name] = static_cast<float>(value);
+                break;
+            case FIELD_TYPE::INT:
+                doc[info.name] = static_cast<int64_t>(value);
+                break;
+            case FIELD_TYPE::BOOL:
+                doc[info.name] = value != 0;
+                break;
+        }
+    }
+
+    // Renders the fields of one group as '"key":value,...' without the surrounding braces
+    void renderGroupFragment(uint32_t group, const double* values, std::string& out)
+    {
+        StaticJsonDocument<JSON_OBJECT_SIZE(NUM_STATUS_FIELDS)> doc;
+        JsonObject obj = doc.to<JsonObject>();
+        for (int i = 0; i < NUM_STATUS_FIELDS; i++)
+        {
+            if (STATUS_FIELDS[i].group == group)
+            {
+                setJsonField(obj, STATUS_FIELDS[i], values[i]);
+            }
+        }
+        std::string rendered;
+        serializeJson(doc, rendered);
+        out.assign(rendered, 1, rendered.size() - 2);
+    }
+}
+
 StatusUpdater::StatusUpdater() :
-  currentStatus_()
+  controller_(),
+  camera_(),
+  main_(),
+  server_(),
+  errorStatus_(false),
+  dirtyGroups_(STATUS_GROUP_ALL),
+  counter_(0),
+  lastPushedValues_(),
+  lastPushedValid_(false),
+  groupFragments_(),
+  jsonBuffer_()
 {
+    jsonBuffer_.reserve(STATUS_JSON_BUFFER_SIZE);
 }
 
-std::string StatusUpdater::getStatusJsonString() 
+StatusUpdater::Status StatusUpdater::getStatus() const
 {
-    // Return the status string
-    return currentStatus_.toJsonString();
+    const ControllerSection c = controller_.read();
+    const CameraSection cam = camera_.read();
+    const MainSection m = main_.read();
+    const ServerSection srv = server_.read();
+
+    Status s;
+    s.pos_x = c.pos_x;
+    s.pos_y = c.pos_y;
+    s.pos_a = c.pos_a;
+    s.vel_x = c.vel_x;
+    s.vel_y = c.vel_y;
+    s.vel_a = c.vel_a;
+    s.vision_x = c.vision_x;
+    s.vision_y = c.vision_y;
+    s.vision_a = c.vision_a;
+    s.camera_stop_error = m.camera_stop_error;
+    s.last_mm_x = c.last_mm_x;
+    s.last_mm_y = c.last_mm_y;
+    s.last_mm_a = c.last_mm_a;
+    s.last_mm_used = c.last_mm_used;
+    s.controller_loop_ms = c.controller_loop_ms;
+    s.position_loop_ms = m.position_loop_ms;
+    s.driver_loop_mean_us = c.driver_loop_mean_us;
+    s.driver_loop_max_us = c.driver_loop_max_us;
+    s.main_allocs_max = m.main_allocs_max;
+    s.main_allocs_total = m.main_allocs_total;
+    s.in_progress = m.in_progress;
+    s.error_status = errorStatus_.load(std::memory_order_acquire);
+    s.counter = counter_.load(std::memory_order_relaxed);
+    s.motor_driver_connected = c.motor_driver_connected;
+    s.lifter_driver_connected = c.lifter_driver_connected;
+    s.cmd_queue_depth = m.cmd_queue_depth;
+    s.cmd_seq = m.cmd_seq;
+    s.cmd_done_seq = m.cmd_done_seq;
+    s.tray_in_progress = m.tray_in_progress;
+    s.tray_done_seq = m.tray_done_seq;
+    s.field_plan_id = m.field_plan_id;
+    s.field_plan_state = m.field_plan_state;
+    s.field_plan_step = m.field_plan_step;
+    s.field_plan_steps = m.field_plan_steps;
+    s.localization_metrics = c.localization_metrics;
+    s.localize_wait_s = m.localize_wait_s;
+    s.localize_wait_active = m.localize_wait_active;
+    s.camera_debug = cam.camera_debug;
+    s.socket_stats = srv.socket_stats;
+    s.control_thread_stats = c.control_thread_stats;
+    s.trajectory_cache_stats = c.trajectory_cache_stats;
+    s.traj_time_remaining = c.traj_time_remaining;
+    s.settle_time = c.settle_time;
+    s.plan_wait_ms = c.plan_wait_ms;
+    s.plan_time_ms = c.plan_time_ms;
+    s.system_health = m.system_health;
+    s.trace_stats = m.trace_stats;
+    return s;
 }
 
-void StatusUpdater::updatePosition(float x, float y, float a)
+const std::string& StatusUpdater::getStatusJsonString() 
+{
+    // Only re-render the groups that changed since the last call, everything else comes from the cache.
+    // The bits are cleared before reading so a write landing in between is picked up next time.
+    const uint32_t dirty = dirtyGroups_.exchange(0, std::memory_order_acquire);
+    if (dirty)
+    {
+        double values[NUM_STATUS_FIELDS];
+        fillFieldValues(getStatus(), values);
+        for (int i = 0; i < NUM_STATUS_GROUPS; i++)
+        {
+            if (dirty & (1 << i))
+            {
+                renderGroupFragment(1 << i, values, groupFragments_[i]);
+            }
+        }
+    }
+
+    jsonBuffer_.clear();
+    jsonBuffer_ += "{\"type\":\"status\",\"data\":{";
+    for (int i = 0; i < NUM_STATUS_GROUPS; i++)
+    {
+        jsonBuffer_ += groupFragments_[i];
+        jsonBuffer_ += ',';
+    }
+    jsonBuffer_ += "\"counter\":";
+    jsonBuffer_ += std::to_string(counter_.fetch_add(1, std::memory_order_relaxed));
+    jsonBuffer_ += "}}";
+    return jsonBuffer_;
+}
+
+std::string StatusUpdater::getStatusBinaryString()
 {
-    currentStatus_.pos_x = x;
-    currentStatus_.pos_y = y;
-    currentStatus_.pos_a = a;
+    Status s = getStatus();
+    counter_.fetch_add(1, std::memory_order_relaxed);
+    return s.toBinaryString();
 }
 
-void StatusUpdater::updateVelocity(float vx, float vy, float va)
+std::string StatusUpdater::getStatusDeltaJsonString(uint32_t group_mask)
 {
-    currentStatus_.vel_x = vx;
-    currentStatus_.vel_y = vy;
-    currentStatus_.vel_a = va;
+    double values[NUM_STATUS_FIELDS];
+    fillFieldValues(getStatus(), values);
+
+    const size_t capacity = JSON_OBJECT_SIZE(NUM_STATUS_FIELDS + 2);
+    DynamicJsonDocument root(capacity);
+    root["type"] = "status_delta";
+    JsonObject doc = root.createNestedObject("data");
+
+    bool any_changed = false;
+    for (int i = 0; i < NUM_STATUS_FIELDS; i++)
+    {
+        const StatusFieldInfo& info = STATUS_FIELDS[i];
+        if (!(info.group & group_mask) || (lastPushedValid_ && values[i] == lastPushedValues_[i]))
+        {
+            continue;
+        }
+        any_changed = true;
+        lastPushedValues_[i] = values[i];
+        setJsonField(doc, info, values[i]);
+    }
+    lastPushedValid_ = true;
+
+    if (!any_changed)
+    {
+        return "";
+    }
+    // Counter is only sent alongside changed fields
+    doc["counter"] = counter_.fetch_add(1, std::memory_order_relaxed);
+
+    std::string msg;
+    serializeJson(root, msg);
+    return msg;
 }
 
-void StatusUpdater::updateInProgress(bool in_progress)
+void StatusUpdater::updatePosition(float x, float y, float a)
 {
-  currentStatus_.in_progress = in_progress;
+    controller_.write([&](ControllerSection& s)
+    {
+        s.pos_x = x;
+        s.pos_y = y;
+        s.pos_a = a;
+    });
+    markDirty(STATUS_GROUP_POSE);
+}
+
+void StatusUpdater::updateVelocity(float vx, float vy, float va)
+{
+    controller_.write([&](ControllerSection& s)
+    {
+        s.vel_x = vx;
+        s.vel_y = vy;
+        s.vel_a = va;
+    });
+    markDirty(STATUS_GROUP_VELOCITY);
 }
 
 void StatusUpdater::updateControlLoopTime(int controller_loop_ms)
 {
-    currentStatus_.controller_loop_ms = controller_loop_ms;
+    controller_.write([&](ControllerSection& s) { s.controller_loop_ms = controller_loop_ms; });
+    markDirty(STATUS_GROUP_LOOP_TIMES);
 }
 
-void StatusUpdater::updatePositionLoopTime(int position_loop_ms)
+void StatusUpdater::updateDriverLoopTime(int driver_loop_mean_us, int driver_loop_max_us)
 {
-    currentStatus_.position_loop_ms = position_loop_ms;
+    // Copied over from the control thread every cycle but only reported once a second
+    const ControllerSection& cur = controller_.writerView();
+    if(driver_loop_mean_us == cur.driver_loop_mean_us && driver_loop_max_us == cur.driver_loop_max_us) return;
+    controller_.write([&](ControllerSection& s)
+    {
+        s.driver_loop_mean_us = driver_loop_mean_us;
+        s.driver_loop_max_us = driver_loop_max_us;
+    });
+    markDirty(STATUS_GROUP_LOOP_TIMES);
 }
 
 void StatusUpdater::updateLocalizationMetrics(LocalizationMetrics localization_metrics)
 {
-    currentStatus_.localization_metrics = localization_metrics;
+    controller_.write([&](ControllerSection& s) { s.localization_metrics = localization_metrics; });
+    markDirty(STATUS_GROUP_LOCALIZATION);
 }
 
 void StatusUpdater::update_motor_driver_connected(bool connected)
 {
-  currentStatus_.motor_driver_connected = connected;
+    controller_.write([&](ControllerSection& s) { s.motor_driver_connected = connected; });
+    markDirty(STATUS_GROUP_STATE);
 }
 
 void StatusUpdater::update_lifter_driver_connected(bool connected)
 {
-  currentStatus_.lifter_driver_connected = connected;
+    controller_.write([&](ControllerSection& s) { s.lifter_driver_connected = connected; });
+    markDirty(STATUS_GROUP_STATE);
 }
 
 void StatusUpdater::updateVisionControllerPose(Point pose)
 {
-  currentStatus_.vision_x = pose.x;
-  currentStatus_.vision_y = pose.y;
-  currentStatus_.vision_a = pose.a;
+    controller_.write([&](ControllerSection& s)
+    {
+        s.vision_x = pose.x;
+        s.vision_y = pose.y;
+        s.vision_a = pose.a;
+    });
+    markDirty(STATUS_GROUP_VISION);
 }
 
 void StatusUpdater::updateLastMarvelmindPose(Point pose, bool pose_used)
 {
-  currentStatus_.last_mm_x = pose.x;
-  currentStatus_.last_mm_y = pose.y;
-  currentStatus_.last_mm_a = pose.a;
-  currentStatus_.last_mm_used = pose_used;
+    controller_.write([&](ControllerSection& s)
+    {
+        s.last_mm_x = pose.x;
+        s.last_mm_y = pose.y;
+        s.last_mm_a = pose.a;
+        s.last_mm_used = pose_used;
+    });
+    markDirty(STATUS_GROUP_MARVELMIND);
+}
+
+void StatusUpdater::updateControlThreadStats(ControlThreadStats control_thread_stats)
+{
+    controller_.write([&](ControllerSection& s) { s.control_thread_stats = control_thread_stats; });
+    markDirty(STATUS_GROUP_CONTROL_THREAD);
+}
+
+void StatusUpdater::updateTrajectoryCacheStats(TrajectoryCacheStats trajectory_cache_stats)
+{
+    controller_.write([&](ControllerSection& s) { s.trajectory_cache_stats = trajectory_cache_stats; });
+    markDirty(STATUS_GROUP_PLANNING);
+}
+
+void StatusUpdater::updateTrajTimeRemaining(float time_remaining)
+{
+    // Changes every control cycle while moving, only dirty the group when it does
+    if(time_remaining == controller_.writerView().traj_time_remaining) return;
+    controller_.write([&](ControllerSection& s) { s.traj_time_remaining = time_remaining; });
+    markDirty(STATUS_GROUP_PLANNING);
+}
+
+void StatusUpdater::updateSettleTime(float settle_time)
+{
+    // Copied over from the control thread every cycle, only dirty the group when it changes
+    if(settle_time == controller_.writerView().settle_time) return;
+    controller_.write([&](ControllerSection& s) { s.settle_time = settle_time; });
+    markDirty(STATUS_GROUP_PLANNING);
+}
+
+void StatusUpdater::updatePlanTiming(float wait_ms, float plan_ms)
+{
+    // Also copied over every cycle
+    const ControllerSection& cur = controller_.writerView();
+    if(wait_ms == cur.plan_wait_ms && plan_ms == cur.plan_time_ms) return;
+    controller_.write([&](ControllerSection& s)
+    {
+        s.plan_wait_ms = wait_ms;
+        s.plan_time_ms = plan_ms;
+    });
+    markDirty(STATUS_GROUP_PLANNING);
+}
+
+Point StatusUpdater::getPosition() const
+{
+    const ControllerSection c = controller_.read();
+    return {c.pos_x, c.pos_y, c.pos_a};
+}
+
+Velocity StatusUpdater::getVelocity() const
+{
+    const ControllerSection c = controller_.read();
+    return {c.vel_x, c.vel_y, c.vel_a};
+}
+
+void StatusUpdater::updateCameraDebug(CameraDebug camera_debug)
+{
+    camera_.write([&](CameraSection& s) { s.camera_debug = camera_debug; });
+    markDirty(STATUS_GROUP_CAMERA);
+}
+
+void StatusUpdater::updatePositionLoopTime(int position_loop_ms)
+{
+    main_.write([&](MainSection& s) { s.position_loop_ms = position_loop_ms; });
+    markDirty(STATUS_GROUP_LOOP_TIMES);
+}
+
+void StatusUpdater::updateMainLoopAllocations(uint32_t max_per_loop, uint32_t total)
+{
+    // Set every loop, only dirty the group when a count moves
+    const MainSection& cur = main_.writerView();
+    if(max_per_loop == cur.main_allocs_max && total == cur.main_allocs_total) return;
+    main_.write([&](MainSection& s)
+    {
+        s.main_allocs_max = max_per_loop;
+        s.main_allocs_total = total;
+    });
+    markDirty(STATUS_GROUP_LOOP_TIMES);
+}
+
+void StatusUpdater::updateInProgress(bool in_progress)
+{
+    main_.write([&](MainSection& s) { s.in_progress = in_progress; });
+    markDirty(STATUS_GROUP_STATE);
+}
+
+void StatusUpdater::updateCommandQueue(int depth, uint32_t seq, uint32_t done_seq)
+{
+    main_.write([&](MainSection& s)
+    {
+        s.cmd_queue_depth = depth;
+        s.cmd_seq = seq;
+        s.cmd_done_seq = done_seq;
+    });
+    markDirty(STATUS_GROUP_STATE);
+}
+
+void StatusUpdater::updateTrayStatus(bool tray_in_progress, uint32_t tray_done_seq)
+{
+    main_.write([&](MainSection& s)
+    {
+        s.tray_in_progress = tray_in_progress;
+        s.tray_done_seq = tray_done_seq;
+    });
+    markDirty(STATUS_GROUP_STATE);
+}
+
+void StatusUpdater::updateFieldPlan(uint32_t id, int state, int step, int steps)
+{
+    // Set every loop, only dirty the group when the plan moves on
+    const MainSection& cur = main_.writerView();
+    if(id == cur.field_plan_id && state == cur.field_plan_state &&
+       step == cur.field_plan_step && steps == cur.field_plan_steps) return;
+    main_.write([&](MainSection& s)
+    {
+        s.field_plan_id = id;
+        s.field_plan_state = state;
+        s.field_plan_step = step;
+        s.field_plan_steps = steps;
+    });
+    markDirty(STATUS_GROUP_STATE);
+}
+
+void StatusUpdater::updateCameraStopError(float error)
+{
+    main_.write([&](MainSection& s) { s.camera_stop_error = error; });
+    markDirty(STATUS_GROUP_VISION);
+}
+
+void StatusUpdater::updateLocalizeWait(float time_to_confidence, bool active)
+{
+    main_.write([&](MainSection& s)
+    {
+        s.localize_wait_s = time_to_confidence;
+        s.localize_wait_active = active;
+    });
+    markDirty(STATUS_GROUP_LOCALIZATION);
+}
+
+void StatusUpdater::updateSystemHealth(SystemHealthStats system_health)
+{
+    main_.write([&](MainSection& s) { s.system_health = system_health; });
+    markDirty(STATUS_GROUP_SYSTEM);
+}
+
+void StatusUpdater::updateTraceStats(TraceStats trace_stats)
+{
+    main_.write([&](MainSection& s) { s.trace_stats = trace_stats; });
+    markDirty(STATUS_GROUP_TRACE);
+}
+
+void StatusUpdater::updateSocketBufferStats(SocketBufferStats socket_stats)
+{
+    server_.write([&](ServerSection& s) { s.socket_stats = socket_stats; });
+    markDirty(STATUS_GROUP_SOCKET);
 }
@@ -2,15 +2,122 @@
 #ifndef StatusUpdater_h
 #define StatusUpdater_h
 
+#include <atomic>
 #include <ArduinoJson/ArduinoJson.h>
 #include "utils.h"
-
+#include "FlightRecorder.h"
+#include "Trace.h"
+#include "Mailbox.h"
+
+#define BINARY_STATUS_VERSION 2
+
+// Field groups used to select which fields get pushed to a status subscriber
+#define STATUS_GROUP_POSE (1 << 0)
+#define STATUS_GROUP_VELOCITY (1 << 1)
+#define STATUS_GROUP_LOOP_TIMES (1 << 2)
+#define STATUS_GROUP_STATE (1 << 3)
+#define STATUS_GROUP_LOCALIZATION (1 << 4)
+#define STATUS_GROUP_CAMERA (1 << 5)
+#define STATUS_GROUP_VISION (1 << 6)
+#define STATUS_GROUP_MARVELMIND (1 << 7)
+#define STATUS_GROUP_SOCKET (1 << 8)
+#define STATUS_GROUP_CONTROL_THREAD (1 << 9)
+#define STATUS_GROUP_PLANNING (1 << 10)
+#define STATUS_GROUP_TRACE (1 << 11)
+#define STATUS_GROUP_SYSTEM (1 << 12)
+#define STATUS_GROUP_ALL 0xFFFFFFFF
+#define NUM_STATUS_GROUPS 13
+
+// Initial capacity of the cached status JSON string
+#define STATUS_JSON_BUFFER_SIZE 8192
+
+#define NUM_STATUS_FIELDS 135
+
+// Bits in BinaryStatus::flags
+#define STATUS_FLAG_IN_PROGRESS (1 << 0)
+#define STATUS_FLAG_ERROR (1 << 1)
+#define STATUS_FLAG_MOTOR_DRIVER_CONNECTED (1 << 2)
+#define STATUS_FLAG_LIFTER_DRIVER_CONNECTED (1 << 3)
+#define STATUS_FLAG_LAST_MM_USED (1 << 4)
+#define STATUS_FLAG_CAM_SIDE_OK (1 << 5)
+#define STATUS_FLAG_CAM_REAR_OK (1 << 6)
+#define STATUS_FLAG_CAM_BOTH_OK (1 << 7)
+
+// Fixed layout status sent in binary status frames. All values are little endian.
+// Bump BINARY_STATUS_VERSION when changing this layout.
+#pragma pack(push, 1)
+struct BinaryStatus
+{
+  uint8_t version;
+  uint8_t counter;
+  uint8_t flags;
+  float pos_x;
+  float pos_y;
+  float pos_a;
+  float vel_x;
+  float vel_y;
+  float vel_a;
+  float vision_x;
+  float vision_y;
+  float vision_a;
+  float last_mm_x;
+  float last_mm_y;
+  float last_mm_a;
+  int32_t controller_loop_ms;
+  int32_t position_loop_ms;
+  float localization_confidence_x;
+  float localization_confidence_y;
+  float localization_confidence_a;
+  float localization_total_confidence;
+  float last_position_uncertainty;
+  float cam_side_u;
+  float cam_side_v;
+  float cam_rear_u;
+  float cam_rear_v;
+  float cam_side_x;
+  float cam_side_y;
+  float cam_rear_x;
+  float cam_rear_y;
+  float cam_pose_x;
+  float cam_pose_y;
+  float cam_pose_a;
+  int32_t cam_loop_ms;
+  uint16_t socket_rx_fill;
+  uint16_t socket_tx_fill;
+  uint32_t socket_rx_drops;
+  uint32_t socket_tx_drops;
+  int32_t rt_jitter_max_us;
+  uint32_t rt_overruns;
+};
+#pragma pack(pop)
+
+// Status is written in per-producer sections so that producers can move to their own threads without
+// racing the server. Each section is a SeqlockedSection with a single writer thread:
+//  - controller: RobotController, or ControlLoop::update copying over from the control thread
+//  - camera: whoever pulls results off the camera tracker
+//  - main: Robot's main loop
+//  - server: RobotServer
+// Writers never block. The serializers and getters take a torn-free copy of each section without locks.
+// Serialization (getStatusJsonString, getStatusBinaryString, getStatusDeltaJsonString) must stay on one thread.
 class StatusUpdater
 {
   public:
     StatusUpdater();
 
-    std::string getStatusJsonString();
+    // Status JSON is cached per field group and only re-rendered for groups that changed. The returned
+    // reference is valid until the next call.
+    const std::string& getStatusJsonString();
+
+    std::string getStatusBinaryString();
+
+    // Returns a status_delta message with only the fields in group_mask that changed since the last call,
+    // or an empty string if nothing changed
+    std::string getStatusDeltaJsonString(uint32_t group_mask);
+
+    // Forces the next delta to include every field in the mask
+    void resetStatusDelta() { lastPushedValid_ = false; };
+
+    // Controller section
 
     void updatePosition(float x, float y, float a);
 
@@ -18,31 +125,89 @@ class StatusUpdater
 
     void updateControlLoopTime(int controller_loop_ms);
 
+    // Loop period reported by the motor driver firmware
+    void updateDriverLoopTime(int driver_loop_mean_us, int driver_loop_max_us);
+
+    void updateLocalizationMetrics(LocalizationMetrics localization_metrics);
+
+    float getLocalizationConfidence() const {return controller_.read().localization_metrics.total_confidence;};
+
+    void update_motor_driver_connected(bool connected);
+
+    void update_lifter_driver_connected(bool connected);
+
+    void updateVisionControllerPose(Point pose);
+
+    void updateLastMarvelmindPose(Point pose, bool pose_used);
+
+    void updateControlThreadStats(ControlThreadStats control_thread_stats);
+
+    ControlThreadStats getControlThreadStats() const { return controller_.read().control_thread_stats; };
+
+    void updateTrajectoryCacheStats(TrajectoryCacheStats trajectory_cache_stats);
+
+    // Seconds left in the running trajectory, 0 when idle and negative when the mode can't tell
+    void updateTrajTimeRemaining(float time_remaining);
+
+    // s the last move took to settle at its goal after its trajectory ended
+    void updateSettleTime(float settle_time);
+
+    // ms the last position move waited for the planner and then took to plan, see TrajectoryPlanner
+    void updatePlanTiming(float wait_ms, float plan_ms);
+
+    Point getPosition() const;
+
+    Velocity getVelocity() const;
+
+    // Camera section
+
+    void updateCameraDebug(CameraDebug camera_debug);
+
+    // Main loop section
+
     void updatePositionLoopTime(int position_loop_ms);
 
+    // Heap allocations made by the main loop, see AllocationCounter
+    void updateMainLoopAllocations(uint32_t max_per_loop, uint32_t total);
+
     void updateInProgress(bool in_progress);
 
-    bool getInProgress() const { return currentStatus_.in_progress; };
-    
-    void setErrorStatus() { currentStatus_.error_status = true;}
+    bool getInProgress() const { return main_.read().in_progress; };
 
-    void clearErrorStatus() {currentStatus_.error_status = false;};
+    // Number of queued commands waiting, sequence id of the running command and of the last one that finished
+    void updateCommandQueue(int depth, uint32_t seq, uint32_t done_seq);
 
-    bool getErrorStatus() const {return currentStatus_.error_status;}
+    // Tray actions can finish after the command that followed them, so they report completion on their own
+    void updateTrayStatus(bool tray_in_progress, uint32_t tray_done_seq);
 
-    void updateLocalizationMetrics(LocalizationMetrics localization_metrics);
+    // Field plan id, FIELD_PLAN_STATE, steps done and steps uploaded
+    void updateFieldPlan(uint32_t id, int state, int step, int steps);
 
-    float getLocalizationConfidence() const {return currentStatus_.localization_metrics.total_confidence;};
+    // Signed distance move_fine_stop_vision came to rest past where it meant to
+    void updateCameraStopError(float error);
 
-    void update_motor_driver_connected(bool connected);
+    // How long the last wait_for_loc took to reach the confidence threshold (-1 if it timed out), and whether it moved
+    void updateLocalizeWait(float time_to_confidence, bool active);
 
-    void update_lifter_driver_connected(bool connected);
+    void updateSystemHealth(SystemHealthStats system_health);
 
-    void updateCameraDebug(CameraDebug camera_debug) {currentStatus_.camera_debug = camera_debug;};
+    void updateTraceStats(TraceStats trace_stats);
 
-    void updateVisionControllerPose(Point pose);
-    
-    void updateLastMarvelmindPose(Point pose, bool pose_used);
+    // Server section
+
+    void updateSocketBufferStats(SocketBufferStats socket_stats);
+
+    // The error flag is latched by several producers, so it is a plain atomic instead of part of a section
+    // The first error since it was last cleared also freezes the flight recorder
+    void setErrorStatus()
+    {
+        if(!errorStatus_.exchange(true, std::memory_order_acq_rel)) FlightRecorder::freeze(FLIGHT_FREEZE::ERROR);
+        markDirty(STATUS_GROUP_STATE);
+    };
+
+    void clearErrorStatus() { errorStatus_.store(false, std::memory_order_release); markDirty(STATUS_GROUP_STATE); };
+
+    bool getErrorStatus() const { return errorStatus_.load(std::memory_order_acquire); };
 
     struct Status
     {
@@ -58,6 +223,7 @@ class StatusUpdater
       float vision_x;
       float vision_y;
       float vision_a;
+      float camera_stop_error;
 
       // Last pose from mm
       float last_mm_x;
@@ -68,6 +234,10 @@ class StatusUpdater
       // Loop times
       int controller_loop_ms;
       int position_loop_ms;
+      int driver_loop_mean_us;
+      int driver_loop_max_us;
+      uint32_t main_allocs_max;
+      uint32_t main_allocs_total;
 
       bool in_progress;
       bool error_status;
@@ -76,10 +246,32 @@ class StatusUpdater
       bool motor_driver_connected;
       bool lifter_driver_connected;
 
+      int cmd_queue_depth;
+      uint32_t cmd_seq;
+      uint32_t cmd_done_seq;
+      bool tray_in_progress;
+      uint32_t tray_done_seq;
+      uint32_t field_plan_id;
+      int field_plan_state;
+      int field_plan_step;
+      int field_plan_steps;
+
       LocalizationMetrics localization_metrics;
+      float localize_wait_s;
+      bool localize_wait_active;
       CameraDebug camera_debug;
-
-      //When adding extra fields, update toJsonString method to serialize and add additional capacity
+      SocketBufferStats socket_stats;
+      ControlThreadStats control_thread_stats;
+      TrajectoryCacheStats trajectory_cache_stats;
+      float traj_time_remaining;
+      float settle_time;
+      float plan_wait_ms;
+      float plan_time_ms;
+      SystemHealthStats system_health;
+      TraceStats trace_stats;
+
+      //When adding extra fields, update toJsonString method to serialize and add additional capacity,
+      //add them to BinaryStatus/toBinaryString and to the field table in StatusUpdater.cpp
 
       Status():
       pos_x(0.0),
@@ -91,26 +283,52 @@ class StatusUpdater
       vision_x(0.0),
       vision_y(0.0),
       vision_a(0.0),
+      camera_stop_error(0.0),
       last_mm_x(0.0),
       last_mm_y(0.0),
       last_mm_a(0.0),
       last_mm_used(false),
       controller_loop_ms(999),
       position_loop_ms(999),
+      driver_loop_mean_us(0),
+      driver_loop_max_us(0),
+      main_allocs_max(0),
+      main_allocs_total(0),
       in_progress(false),
       error_status(false),
       counter(0),
       motor_driver_connected(false),
       lifter_driver_connected(false),
+      cmd_queue_depth(0),
+      cmd_seq(0),
+      cmd_done_seq(0),
+      tray_in_progress(false),
+      tray_done_seq(0),
+      field_plan_id(0),
+      field_plan_state(0),
+      field_plan_step(0),
+      field_plan_steps(0),
       localization_metrics(),
-      camera_debug()
+      localize_wait_s(-1.0),
+      localize_wait_active(false),
+      camera_debug(),
+      socket_stats(),
+      control_thread_stats(),
+      trajectory_cache_stats(),
+      traj_time_remaining(0.0),
+      settle_time(0.0),
+      plan_wait_ms(0.0),
+      plan_time_ms(0.0),
+      system_health(),
+      trace_stats()
       {
       }
 
+      // Uncached serialization of the full status. StatusUpdater::getStatusJsonString should be preferred.
       std::string toJsonString()
       {
         // Size the object correctly
-        const size_t capacity = JSON_OBJECT_SIZE(50); // Update when adding new fields
+        const size_t capacity = JSON_OBJECT_SIZE(144); // Update when adding new fields
         DynamicJsonDocument root(capacity);
 
         // Format to match messages sent by server
@@ -126,16 +344,35 @@ class StatusUpdater
         doc["vel_a"] = vel_a;
         doc["controller_loop_ms"] = controller_loop_ms;
         doc["position_loop_ms"] = position_loop_ms;
+        doc["driver_loop_mean_us"] = driver_loop_mean_us;
+        doc["driver_loop_max_us"] = driver_loop_max_us;
+        doc["main_allocs_max"] = main_allocs_max;
+        doc["main_allocs_total"] = main_allocs_total;
         doc["in_progress"] = in_progress;
         doc["error_status"] = error_status;
         doc["counter"] = counter++;
         doc["motor_driver_connected"] = motor_driver_connected;
         doc["lifter_driver_connected"] = lifter_driver_connected;
+        doc["cmd_queue_depth"] = cmd_queue_depth;
+        doc["cmd_seq"] = cmd_seq;
+        doc["cmd_done_seq"] = cmd_done_seq;
+        doc["tray_in_progress"] = tray_in_progress;
+        doc["tray_done_seq"] = tray_done_seq;
+        doc["field_plan_id"] = field_plan_id;
+        doc["field_plan_state"] = field_plan_state;
+        doc["field_plan_step"] = field_plan_step;
+        doc["field_plan_steps"] = field_plan_steps;
         doc["localization_confidence_x"] = localization_metrics.confidence_x;
         doc["localization_confidence_y"] = localization_metrics.confidence_y;
         doc["localization_confidence_a"] = localization_metrics.confidence_a;
         doc["localization_total_confidence"] = localization_metrics.total_confidence;
         doc["last_position_uncertainty"] = localization_metrics.last_position_uncertainty;
+        doc["mm_gate_nis"] = localization_metrics.last_nis;
+        doc["mm_rejected"] = localization_metrics.rejected_readings;
+        doc["mm_rejected_in_row"] = localization_metrics.consecutive_rejections;
+        doc["mm_reacquisitions"] = localization_metrics.reacquisitions;
+        doc["localize_wait_s"] = localize_wait_s;
+        doc["localize_wait_active"] = localize_wait_active;
         doc["cam_side_ok"] = camera_debug.side_ok;
         doc["cam_rear_ok"] = camera_debug.rear_ok;
         doc["cam_both_ok"] = camera_debug.both_ok;
@@ -151,25 +388,237 @@ class StatusUpdater
         doc["cam_pose_y"] = camera_debug.pose_y;
         doc["cam_pose_a"] = camera_debug.pose_a;
         doc["cam_loop_ms"] = camera_debug.loop_ms;
+        doc["cam_side_allocs"] = camera_debug.side_buffer_allocations;
+        doc["cam_rear_allocs"] = camera_debug.rear_buffer_allocations;
+        doc["cam_rejected_pairs"] = camera_debug.rejected_pairs;
+        doc["cam_pair_skew_ms"] = camera_debug.pair_skew_ms;
         doc["vision_x"] = vision_x;
         doc["vision_y"] = vision_y;
         doc["vision_a"] = vision_a;
+        doc["camera_stop_error"] = camera_stop_error;
         doc["last_mm_x"] = last_mm_x;
         doc["last_mm_y"] = last_mm_y;
         doc["last_mm_a"] = last_mm_a;
         doc["last_mm_used"] = last_mm_used;
+        doc["socket_rx_fill"] = socket_stats.read_fill;
+        doc["socket_tx_fill"] = socket_stats.send_fill;
+        doc["socket_capacity"] = socket_stats.capacity;
+        doc["socket_rx_drops"] = socket_stats.read_drops;
+        doc["socket_tx_drops"] = socket_stats.send_drops;
+        doc["socket_tcp_rtt_ms"] = socket_stats.tcp_rtt_ms;
+        doc["socket_ping_rtt_ms"] = socket_stats.ping_rtt_ms;
+        doc["rt_active"] = control_thread_stats.active;
+        doc["rt_jitter_max_us"] = control_thread_stats.jitter_max_us;
+        doc["rt_jitter_avg_us"] = control_thread_stats.jitter_avg_us;
+        doc["rt_overruns"] = control_thread_stats.overruns;
+        doc["rt_jitter_hist_50us"] = control_thread_stats.jitter_hist[0];
+        doc["rt_jitter_hist_100us"] = control_thread_stats.jitter_hist[1];
+        doc["rt_jitter_hist_250us"] = control_thread_stats.jitter_hist[2];
+        doc["rt_jitter_hist_500us"] = control_thread_stats.jitter_hist[3];
+        doc["rt_jitter_hist_1ms"] = control_thread_stats.jitter_hist[4];
+        doc["rt_jitter_hist_over"] = control_thread_stats.jitter_hist[5];
+        doc["rt_allocs_max"] = control_thread_stats.allocs_max;
+        doc["rt_allocs_total"] = control_thread_stats.allocs_total;
+        doc["traj_cache_hits"] = trajectory_cache_stats.hits;
+        doc["traj_cache_misses"] = trajectory_cache_stats.misses;
+        doc["traj_cache_hit_rate"] = trajectory_cache_stats.hitRate();
+        doc["traj_time_remaining"] = traj_time_remaining;
+        doc["settle_time"] = settle_time;
+        doc["plan_wait_ms"] = plan_wait_ms;
+        doc["plan_time_ms"] = plan_time_ms;
+        doc["soc_temp_c"] = system_health.soc_temp_c;
+        doc["throttle_flags"] = system_health.throttle_flags;
+        doc["cpu_core0_usage"] = system_health.core_usage[0];
+        doc["cpu_core1_usage"] = system_health.core_usage[1];
+        doc["cpu_core2_usage"] = system_health.core_usage[2];
+        doc["cpu_core3_usage"] = system_health.core_usage[3];
+        doc["cpu_process"] = system_health.process_cpu;
+        doc["cpu_main_thread"] = system_health.main_thread_cpu;
+        doc["cpu_control_thread"] = system_health.control_thread_cpu;
+        doc["vision_degrade"] = system_health.vision_degrade;
+        doc["trace_server_p50_us"] = trace_stats.p50_us[0];
+        doc["trace_server_p99_us"] = trace_stats.p99_us[0];
+        doc["trace_server_max_us"] = trace_stats.max_us[0];
+        doc["trace_marvelmind_p50_us"] = trace_stats.p50_us[1];
+        doc["trace_marvelmind_p99_us"] = trace_stats.p99_us[1];
+        doc["trace_marvelmind_max_us"] = trace_stats.max_us[1];
+        doc["trace_controller_p50_us"] = trace_stats.p50_us[2];
+        doc["trace_controller_p99_us"] = trace_stats.p99_us[2];
+        doc["trace_controller_max_us"] = trace_stats.max_us[2];
+        doc["trace_tray_p50_us"] = trace_stats.p50_us[3];
+        doc["trace_tray_p99_us"] = trace_stats.p99_us[3];
+        doc["trace_tray_max_us"] = trace_stats.max_us[3];
+        doc["trace_serial_send_p50_us"] = trace_stats.p50_us[4];
+        doc["trace_serial_send_p99_us"] = trace_stats.p99_us[4];
+        doc["trace_serial_send_max_us"] = trace_stats.max_us[4];
+        doc["trace_serial_recv_p50_us"] = trace_stats.p50_us[5];
+        doc["trace_serial_recv_p99_us"] = trace_stats.p99_us[5];
+        doc["trace_serial_recv_max_us"] = trace_stats.max_us[5];
+        doc["trace_cam_capture_p50_us"] = trace_stats.p50_us[6];
+        doc["trace_cam_capture_p99_us"] = trace_stats.p99_us[6];
+        doc["trace_cam_capture_max_us"] = trace_stats.max_us[6];
+        doc["trace_cam_undistort_p50_us"] = trace_stats.p50_us[7];
+        doc["trace_cam_undistort_p99_us"] = trace_stats.p99_us[7];
+        doc["trace_cam_undistort_max_us"] = trace_stats.max_us[7];
+        doc["trace_cam_threshold_p50_us"] = trace_stats.p50_us[8];
+        doc["trace_cam_threshold_p99_us"] = trace_stats.p99_us[8];
+        doc["trace_cam_threshold_max_us"] = trace_stats.max_us[8];
+        doc["trace_cam_detect_p50_us"] = trace_stats.p50_us[9];
+        doc["trace_cam_detect_p99_us"] = trace_stats.p99_us[9];
+        doc["trace_cam_detect_max_us"] = trace_stats.max_us[9];
+        doc["trace_cam_coarse_p50_us"] = trace_stats.p50_us[10];
+        doc["trace_cam_coarse_p99_us"] = trace_stats.p99_us[10];
+        doc["trace_cam_coarse_max_us"] = trace_stats.max_us[10];
+        doc["trace_cam_refine_p50_us"] = trace_stats.p50_us[11];
+        doc["trace_cam_refine_p99_us"] = trace_stats.p99_us[11];
+        doc["trace_cam_refine_max_us"] = trace_stats.max_us[11];
 
         // Serialize and return string
         std::string msg;
         serializeJson(root, msg);
         return msg;
       }
+
+      std::string toBinaryString()
+      {
+        BinaryStatus out;
+        out.version = BINARY_STATUS_VERSION;
+        out.counter = counter++;
+        out.flags = (in_progress ? STATUS_FLAG_IN_PROGRESS : 0) |
+                    (error_status ? STATUS_FLAG_ERROR : 0) |
+                    (motor_driver_connected ? STATUS_FLAG_MOTOR_DRIVER_CONNECTED : 0) |
+                    (lifter_driver_connected ? STATUS_FLAG_LIFTER_DRIVER_CONNECTED : 0) |
+                    (last_mm_used ? STATUS_FLAG_LAST_MM_USED : 0) |
+                    (camera_debug.side_ok ? STATUS_FLAG_CAM_SIDE_OK : 0) |
+                    (camera_debug.rear_ok ? STATUS_FLAG_CAM_REAR_OK : 0) |
+                    (camera_debug.both_ok ? STATUS_FLAG_CAM_BOTH_OK : 0);
+        out.pos_x = pos_x;
+        out.pos_y = pos_y;
+        out.pos_a = pos_a;
+        out.vel_x = vel_x;
+        out.vel_y = vel_y;
+        out.vel_a = vel_a;
+        out.vision_x = vision_x;
+        out.vision_y = vision_y;
+        out.vision_a = vision_a;
+        out.last_mm_x = last_mm_x;
+        out.last_mm_y = last_mm_y;
+        out.last_mm_a = last_mm_a;
+        out.controller_loop_ms = controller_loop_ms;
+        out.position_loop_ms = position_loop_ms;
+        out.localization_confidence_x = localization_metrics.confidence_x;
+        out.localization_confidence_y = localization_metrics.confidence_y;
+        out.localization_confidence_a = localization_metrics.confidence_a;
+        out.localization_total_confidence = localization_metrics.total_confidence;
+        out.last_position_uncertainty = localization_metrics.last_position_uncertainty;
+        out.cam_side_u = camera_debug.side_u;
+        out.cam_side_v = camera_debug.side_v;
+        out.cam_rear_u = camera_debug.rear_u;
+        out.cam_rear_v = camera_debug.rear_v;
+        out.cam_side_x = camera_debug.side_x;
+        out.cam_side_y = camera_debug.side_y;
+        out.cam_rear_x = camera_debug.rear_x;
+        out.cam_rear_y = camera_debug.rear_y;
+        out.cam_pose_x = camera_debug.pose_x;
+        out.cam_pose_y = camera_debug.pose_y;
+        out.cam_pose_a = camera_debug.pose_a;
+        out.cam_loop_ms = camera_debug.loop_ms;
+        out.socket_rx_fill = socket_stats.read_fill;
+        out.socket_tx_fill = socket_stats.send_fill;
+        out.socket_rx_drops = socket_stats.read_drops;
+        out.socket_tx_drops = socket_stats.send_drops;
+        out.rt_jitter_max_us = control_thread_stats.jitter_max_us;
+        out.rt_overruns = control_thread_stats.overruns;
+
+        return std::string(reinterpret_cast<const char*>(&out), sizeof(out));
+      }
     };
 
-    Status getStatus() { return currentStatus_;};
+    // Consistent copy of every section. Each section is torn-free on its own, sections written by different
+    // threads may be from slightly different moments.
+    Status getStatus() const;
 
   private:
-    Status currentStatus_;
+
+    struct ControllerSection
+    {
+      float pos_x = 0.0;
+      float pos_y = 0.0;
+      float pos_a = 0.0;
+      float vel_x = 0.0;
+      float vel_y = 0.0;
+      float vel_a = 0.0;
+      float vision_x = 0.0;
+      float vision_y = 0.0;
+      float vision_a = 0.0;
+      float last_mm_x = 0.0;
+      float last_mm_y = 0.0;
+      float last_mm_a = 0.0;
+      bool last_mm_used = false;
+      int controller_loop_ms = 999;
+      int driver_loop_mean_us = 0;
+      int driver_loop_max_us = 0;
+      bool motor_driver_connected = false;
+      bool lifter_driver_connected = false;
+      LocalizationMetrics localization_metrics;
+      ControlThreadStats control_thread_stats;
+      TrajectoryCacheStats trajectory_cache_stats;
+      float traj_time_remaining = 0.0;
+      float settle_time = 0.0;
+      float plan_wait_ms = 0.0;
+      float plan_time_ms = 0.0;
+    };
+
+    struct CameraSection
+    {
+      CameraDebug camera_debug;
+    };
+
+    struct MainSection
+    {
+      int position_loop_ms = 999;
+      uint32_t main_allocs_max = 0;
+      uint32_t main_allocs_total = 0;
+      bool in_progress = false;
+      int cmd_queue_depth = 0;
+      uint32_t cmd_seq = 0;
+      uint32_t cmd_done_seq = 0;
+      bool tray_in_progress = false;
+      uint32_t tray_done_seq = 0;
+      uint32_t field_plan_id = 0;
+      int field_plan_state = 0;
+      int field_plan_step = 0;
+      int field_plan_steps = 0;
+      float camera_stop_error = 0.0;
+      float localize_wait_s = -1.0;
+      bool localize_wait_active = false;
+      SystemHealthStats system_health;
+      TraceStats trace_stats;
+    };
+
+    struct ServerSection
+    {
+      SocketBufferStats socket_stats;
+    };
+
+    // Called by writers after their section write so a serializer that clears the bit sees the new values
+    void markDirty(uint32_t groups) { dirtyGroups_.fetch_or(groups, std::memory_order_release); };
+
+    SeqlockedSection<ControllerSection> controller_;
+    SeqlockedSection<CameraSection> camera_;
+    SeqlockedSection<MainSection> main_;
+    SeqlockedSection<ServerSection> server_;
+    std::atomic<bool> errorStatus_;
+    std::atomic<uint32_t> dirtyGroups_;
+
+    // Serializer state
+    std::atomic<uint8_t> counter_;
+    double lastPushedValues_[NUM_STATUS_FIELDS];
+    bool lastPushedValid_;
+
+    // Cached JSON for getStatusJsonString
+    std::string groupFragments_[NUM_STATUS_GROUPS];
+    std::string jsonBuffer_;
 
 };
 
@@ -0,0 +1,229 @@
+#include "SystemHealth.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <plog/Log.h>
+
+namespace
+{
+    // Thread ids from registerThread, 0 until registered
+    std::atomic<int> registered_tids[static_cast<int>(SYSTEM_THREAD::COUNT)];
+
+    // Reuses the capacity of contents, so repeated reads don't allocate
+    bool readFile(const char* path, std::string* contents)
+    {
+        FILE* file = fopen(path, "r");
+        if(!file) return false;
+        contents->clear();
+        char buffer[4096];
+        size_t n;
+        while((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            contents->append(buffer, n);
+        }
+        fclose(file);
+        return true;
+    }
+
+    float usage(uint64_t ticks, uint64_t previous_ticks, long ticks_per_s, double elapsed_s)
+    {
+        return ticks >= previous_ticks ? static_cast<float>((ticks - previous_ticks) / static_cast<double>(ticks_per_s) / elapsed_s) : 0;
+    }
+}
+
+// Parsed in place since the samples are taken from the main loop
+int parseCoreTicks(const std::string& proc_stat, CpuTicks* cores, int max_cores)
+{
+    int count = 0;
+    const char* line = proc_stat.c_str();
+    while(count < max_cores && *line)
+    {
+        // The aggregate "cpu " line is skipped, only the numbered ones are per core
+        if(strncmp(line, "cpu", 3) == 0 && line[3] >= '0' && line[3] <= '9')
+        {
+            const char* p = strchr(line, ' ');
+            uint64_t fields[8] = {0};     // user nice system idle iowait irq softirq steal
+            for (int i = 0; p && i < 8; i++)
+            {
+                char* end;
+                fields[i] = strtoull(p, &end, 10);
+                p = end;
+            }
+            cores[count].busy = fields[0] + fields[1] + fields[2] + fields[5] + fields[6] + fields[7];
+            cores[count].total = cores[count].busy + fields[3] + fields[4];
+            count++;
+        }
+        const char* next = strchr(line, '\n');
+        if(!next) break;
+        line = next + 1;
+    }
+    return count;
+}
+
+bool parseStatCpuTicks(const std::string& stat, uint64_t* ticks)
+{
+    // The command name can hold spaces and parentheses, the fields after it can't
+    size_t name_end = stat.rfind(')');
+    if(name_end == std::string::npos) return false;
+    // utime and stime are the 12th and 13th fields after the name
+    const char* p = stat.c_str() + name_end + 1;
+    for (int i = 0; i < 11; i++)
+    {
+        while(*p == ' ') p++;
+        if(!*p) return false;
+        while(*p && *p != ' ') p++;
+    }
+    char* end;
+    const uint64_t utime = strtoull(p, &end, 10);
+    if(end == p) return false;
+    p = end;
+    const uint64_t stime = strtoull(p, &end, 10);
+    if(end == p) return false;
+    *ticks = utime + stime;
+    return true;
+}
+
+uint32_t parseThrottled(const std::string& text)
+{
+    return static_cast<uint32_t>(strtoul(text.c_str(), nullptr, 16));
+}
+
+SystemHealthMonitor::SystemHealthMonitor()
+: temp_path_(static_cast<const char*>(cfg.lookup("system_health.temp_path"))),
+  throttle_path_(static_cast<const char*>(cfg.lookup("system_health.throttle_path"))),
+  have_previous_(false),
+  previous_time_(),
+  previous_cores_(),
+  previous_process_ticks_(0),
+  previous_thread_ticks_(),
+  ticks_per_s_(sysconf(_SC_CLK_TCK)),
+  text_()
+{
+    // Bigger than /proc/stat on a Pi
+    text_.reserve(8192);
+    if(!readFile(temp_path_.c_str(), &text_)) PLOGW << "No SoC temperature at " << temp_path_;
+    if(!readFile(throttle_path_.c_str(), &text_)) PLOGW << "No throttle flags at " << throttle_path_;
+}
+
+void SystemHealthMonitor::registerThread(SYSTEM_THREAD thread)
+{
+    registered_tids[static_cast<int>(thread)] = static_cast<int>(syscall(SYS_gettid));
+}
+
+SystemHealthStats SystemHealthMonitor::sample()
+{
+    SystemHealthStats stats;
+    std::string& text = text_;
+    if(readFile(temp_path_.c_str(), &text)) stats.soc_temp_c = atof(text.c_str()) / 1000.0;
+    if(readFile(throttle_path_.c_str(), &text)) stats.throttle_flags = parseThrottled(text);
+
+    const Clock::time_point now = Clock::now();
+    const double elapsed_s = std::chrono::duration<double>(now - previous_time_).count();
+    const bool have_usage = have_previous_ && elapsed_s > 0;
+
+    CpuTicks cores[SYSTEM_HEALTH_MAX_CORES];
+    stats.num_cores = readFile("/proc/stat", &text) ? parseCoreTicks(text, cores, SYSTEM_HEALTH_MAX_CORES) : 0;
+    for (int i = 0; i < stats.num_cores; i++)
+    {
+        const uint64_t total = cores[i].total - previous_cores_[i].total;
+        if(have_usage && total > 0) stats.core_usage[i] = static_cast<float>(cores[i].busy - previous_cores_[i].busy) / total;
+        previous_cores_[i] = cores[i];
+    }
+
+    uint64_t ticks = 0;
+    if(readFile("/proc/self/stat", &text) && parseStatCpuTicks(text, &ticks))
+    {
+        if(have_usage) stats.process_cpu = usage(ticks, previous_process_ticks_, ticks_per_s_, elapsed_s);
+        previous_process_ticks_ = ticks;
+    }
+
+    float* thread_cpu[] = {&stats.main_thread_cpu, &stats.control_thread_cpu};
+    static_assert(sizeof(thread_cpu) / sizeof(thread_cpu[0]) == static_cast<int>(SYSTEM_THREAD::COUNT), "Every SYSTEM_THREAD needs a stats field");
+    for (int i = 0; i < static_cast<int>(SYSTEM_THREAD::COUNT); i++)
+    {
+        const int tid = registered_tids[i];
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+        if(tid && readFile(path, &text) && parseStatCpuTicks(text, &ticks))
+        {
+            if(have_usage) *thread_cpu[i] = usage(ticks, previous_thread_ticks_[i], ticks_per_s_, elapsed_s);
+            previous_thread_ticks_[i] = ticks;
+        }
+    }
+
+    previous_time_ = now;
+    have_previous_ = true;
+    return stats;
+}
+
+
+VisionDegradePolicy::VisionDegradePolicy()
+: enabled_(cfg.lookup("system_health.degrade.enabled")),
+  warn_temp_(cfg.lookup("system_health.degrade.warn_temp")),
+  hot_temp_(cfg.lookup("system_health.degrade.hot_temp")),
+  temp_hysteresis_(cfg.lookup("system_health.degrade.temp_hysteresis")),
+  max_jitter_us_(cfg.lookup("system_health.degrade.max_jitter_us")),
+  escalate_time_(cfg.lookup("system_health.degrade.escalate_time")),
+  recover_time_(cfg.lookup("system_health.degrade.recover_time")),
+  level_(static_cast<int>(VISION_DEGRADE::NONE)),
+  pressure_floor_(0),
+  last_control_overruns_(0),
+  last_loop_overruns_(0),
+  escalate_timer_(),
+  recover_timer_()
+{}
+
+void VisionDegradePolicy::setLevel(int level)
+{
+    PLOGW << "Vision degrade level " << level_ << " -> " << level;
+    level_ = level;
+    escalate_timer_.reset();
+    recover_timer_.reset();
+}
+
+VISION_DEGRADE VisionDegradePolicy::update(const SystemHealthStats& health, const ControlThreadStats& control, uint32_t loop_overruns)
+{
+    // Lateness is judged on what happened since the last update
+    const bool late = control.overruns != last_control_overruns_ || loop_overruns != last_loop_overruns_ ||
+                      (control.active && control.jitter_max_us > max_jitter_us_);
+    last_control_overruns_ = control.overruns;
+    last_loop_overruns_ = loop_overruns;
+    if(!enabled_) return VISION_DEGRADE::NONE;
+
+    // Levels already reached hold on until the temperature is clear of the threshold that raised them
+    const float warn_temp = warn_temp_ - (level_ >= 1 ? temp_hysteresis_ : 0);
+    const float hot_temp = hot_temp_ - (level_ >= 2 ? temp_hysteresis_ : 0);
+    int wanted = 0;
+    if(late || (health.throttle_flags & THROTTLE_ACTIVE_MASK) || health.soc_temp_c >= warn_temp) wanted = 1;
+    if(health.soc_temp_c >= hot_temp) wanted = 2;
+    // A level that was only reached because pressure outlasted the one below is kept while any pressure lasts
+    if(wanted == 0) pressure_floor_ = 0;
+    else wanted = std::max(wanted, pressure_floor_);
+
+    const int max_level = static_cast<int>(VISION_DEGRADE::MINIMAL);
+    if(wanted > level_)
+    {
+        setLevel(wanted);
+    }
+    else if(wanted == level_ && level_ > 0)
+    {
+        // Still under pressure with this much shed, try shedding more
+        recover_timer_.reset();
+        if(level_ < max_level && escalate_timer_.dt_s() > escalate_time_)
+        {
+            setLevel(level_ + 1);
+            pressure_floor_ = level_;
+        }
+    }
+    else if(wanted < level_)
+    {
+        escalate_timer_.reset();
+        if(recover_timer_.dt_s() > recover_time_) setLevel(level_ - 1);
+    }
+    return static_cast<VISION_DEGRADE>(level_);
+}
@@ -0,0 +1,108 @@
+#ifndef SystemHealth_h
+#define SystemHealth_h
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "utils.h"
+#include "camera_tracker/CameraTrackerBase.h"
+
+// Samples the SoC temperature, the firmware throttle flags and how busy each core and the robot's own threads
+// are, and decides how much camera work to shed before a hot or throttled Pi starts making the control loop
+// late. Everything is read from sysfs and procfs, once per system_health.rate.
+
+// Bits of the Raspberry Pi firmware get_throttled value that are set while the condition lasts. The same bits
+// shifted up by 16 latch once the condition has happened since boot.
+#define THROTTLE_UNDER_VOLTAGE (1 << 0)
+#define THROTTLE_FREQ_CAPPED (1 << 1)
+#define THROTTLE_THROTTLED (1 << 2)
+#define THROTTLE_SOFT_TEMP_LIMIT (1 << 3)
+#define THROTTLE_ACTIVE_MASK 0xF
+
+// Threads whose CPU time is reported on their own
+enum class SYSTEM_THREAD
+{
+    MAIN,
+    CONTROL,
+    COUNT,
+};
+
+struct CpuTicks
+{
+    uint64_t busy = 0;
+    uint64_t total = 0;
+};
+
+// Per core ticks from the cpuN lines of /proc/stat, returns how many cores were found (at most max_cores)
+int parseCoreTicks(const std::string& proc_stat, CpuTicks* cores, int max_cores);
+
+// utime + stime from a /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat line, false if it can't be parsed
+bool parseStatCpuTicks(const std::string& stat, uint64_t* ticks);
+
+// get_throttled as written by the firmware driver, hex with or without a 0x prefix
+uint32_t parseThrottled(const std::string& text);
+
+class SystemHealthMonitor
+{
+  public:
+
+    // Reads its paths from system_health
+    SystemHealthMonitor();
+
+    // Called from the thread itself, its CPU time is then reported in SystemHealthStats
+    static void registerThread(SYSTEM_THREAD thread);
+
+    // Usage figures cover the time since the previous sample, so the first one only has the temperature and flags
+    SystemHealthStats sample();
+
+  private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    std::string temp_path_;
+    std::string throttle_path_;
+    bool have_previous_;
+    Clock::time_point previous_time_;
+    CpuTicks previous_cores_[SYSTEM_HEALTH_MAX_CORES];
+    uint64_t previous_process_ticks_;
+    uint64_t previous_thread_ticks_[static_cast<int>(SYSTEM_THREAD::COUNT)];
+    long ticks_per_s_;
+    std::string text_;      // File contents, kept to reuse its buffer
+};
+
+// Turns temperature, throttling and control loop lateness into a VISION_DEGRADE level. Pressure raises the
+// level straight away, and raises it again if it is still there after escalate_time. The level only comes
+// back down a step at a time, after recover_time below the thresholds less temp_hysteresis.
+class VisionDegradePolicy
+{
+  public:
+
+    // Reads system_health.degrade
+    VisionDegradePolicy();
+
+    // loop_overruns is the running total of missed main loop controller cycles
+    VISION_DEGRADE update(const SystemHealthStats& health, const ControlThreadStats& control, uint32_t loop_overruns);
+
+    VISION_DEGRADE getLevel() const { return static_cast<VISION_DEGRADE>(level_); };
+
+  private:
+
+    void setLevel(int level);
+
+    bool enabled_;
+    float warn_temp_;
+    float hot_temp_;
+    float temp_hysteresis_;
+    int max_jitter_us_;
+    float escalate_time_;
+    float recover_time_;
+    int level_;
+    int pressure_floor_;
+    uint32_t last_control_overruns_;
+    uint32_t last_loop_overruns_;
+    Timer escalate_timer_;
+    Timer recover_timer_;
+};
+
+#endif //SystemHealth_h
@@ -0,0 +1,283 @@
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <plog/Log.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+namespace
+{
+    struct ColumnSpec
+    {
+        const char* name;
+        TELEMETRY_TYPE type;
+        size_t record_offset;
+    };
+
+    #define TELEMETRY_COLUMN(name, type, field) {name, TELEMETRY_TYPE::type, offsetof(TelemetryRecord, field)}
+    #define TELEMETRY_AXES(prefix, field) \
+        {prefix "_x", TELEMETRY_TYPE::F32, offsetof(TelemetryRecord, field)}, \
+        {prefix "_y", TELEMETRY_TYPE::F32, offsetof(TelemetryRecord, field) + sizeof(float)}, \
+        {prefix "_a", TELEMETRY_TYPE::F32, offsetof(TelemetryRecord, field) + 2 * sizeof(float)}
+
+    // Names match the rows of the text motion log so the plotting tools can use either
+    const ColumnSpec COLUMNS[] =
+    {
+        TELEMETRY_COLUMN("stamp", F64, stamp),
+        TELEMETRY_COLUMN("move_id", U32, move_id),
+        TELEMETRY_COLUMN("mode", U32, mode),
+        TELEMETRY_COLUMN("time", F32, time),
+        TELEMETRY_AXES("pos", pos),
+        TELEMETRY_AXES("target_pos", target_pos),
+        TELEMETRY_AXES("vel", vel),
+        TELEMETRY_AXES("target_vel", target_vel),
+        TELEMETRY_AXES("control_vel", control_vel),
+        TELEMETRY_AXES("kf_cov", kf_cov),
+        {"cam_side_u", TELEMETRY_TYPE::F32, offsetof(TelemetryRecord, cam_uv)},
+        {"cam_side_v", TELEMETRY_TYPE::F32, offsetof(TelemetryRecord, cam_uv) + sizeof(float)},
+        {"cam_rear_u", TELEMETRY_TYPE::F32, offsetof(TelemetryRecord, cam_uv) + 2 * sizeof(float)},
+        {"cam_rear_v", TELEMETRY_TYPE::F32, offsetof(TelemetryRecord, cam_uv) + 3 * sizeof(float)},
+    };
+
+    #undef TELEMETRY_COLUMN
+    #undef TELEMETRY_AXES
+
+    const uint32_t NUM_COLUMNS = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+    static_assert(sizeof(TelemetryChunkHeader) + NUM_COLUMNS * sizeof(TelemetryColumnDesc) <= TELEMETRY_DATA_OFFSET,
+                  "Telemetry column table doesn't fit in front of the data");
+
+    size_t typeSize(TELEMETRY_TYPE type)
+    {
+        return type == TELEMETRY_TYPE::F64 ? 8 : 4;
+    }
+
+    // Columns are 8 byte aligned so doubles can be read in place
+    size_t columnStride(TELEMETRY_TYPE type, uint32_t capacity)
+    {
+        return (typeSize(type) * capacity + 7) & ~static_cast<size_t>(7);
+    }
+
+    std::string runPrefix()
+    {
+        char buf[32];
+        time_t now = time(nullptr);
+        strftime(buf, sizeof(buf), "%Y%m%d_%H%M%S", localtime(&now));
+        return std::string(buf);
+    }
+}
+
+TelemetryWriter::TelemetryWriter(const std::string& dir, uint32_t records_per_chunk)
+: dir_(dir),
+  prefix_(runPrefix()),
+  capacity_(records_per_chunk > 0 ? records_per_chunk : 1),
+  chunk_size_(TELEMETRY_DATA_OFFSET),
+  chunk_paths_(),
+  records_written_(0),
+  fd_(-1),
+  data_(nullptr),
+  header_(nullptr),
+  count_(0)
+{
+    for (const ColumnSpec& col : COLUMNS)
+    {
+        chunk_size_ += columnStride(col.type, capacity_);
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    if (ec) PLOGE.printf("Could not create telemetry directory %s: %s", dir_.c_str(), ec.message().c_str());
+}
+
+TelemetryWriter::~TelemetryWriter()
+{
+    closeChunk();
+}
+
+bool TelemetryWriter::append(const TelemetryRecord& record)
+{
+    if (!data_ || count_ >= capacity_)
+    {
+        closeChunk();
+        if (!openChunk()) return false;
+    }
+
+    TelemetryRecord stamped = record;
+    stamped.stamp = std::chrono::duration<double>(ClockFactory::getFactoryInstance()->get_clock()->now().time_since_epoch()).count();
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(&stamped);
+
+    const TelemetryColumnDesc* descs = reinterpret_cast<const TelemetryColumnDesc*>(header_ + 1);
+    for (uint32_t i = 0; i < NUM_COLUMNS; i++)
+    {
+        const size_t size = typeSize(COLUMNS[i].type);
+        memcpy(data_ + descs[i].offset + count_ * size, src + COLUMNS[i].record_offset, size);
+    }
+    count_++;
+    records_written_++;
+    // Readers of a live chunk only look at values below record_count
+    __atomic_store_n(&header_->record_count, static_cast<uint64_t>(count_), __ATOMIC_RELEASE);
+    return true;
+}
+
+bool TelemetryWriter::openChunk()
+{
+    char name[64];
+    snprintf(name, sizeof(name), "telemetry_%s_%04u.bin", prefix_.c_str(), static_cast<unsigned int>(chunk_paths_.size()));
+    const std::string path = dir_ + "/" + name;
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0)
+    {
+        PLOGE.printf("Could not create telemetry chunk %s", path.c_str());
+        return false;
+    }
+    // Reserve the blocks up front, writing through the mapping into a sparse file on a full disk would SIGBUS
+    if (posix_fallocate(fd_, 0, chunk_size_) != 0)
+    {
+        PLOGE.printf("Could not allocate %zu bytes for telemetry chunk %s", chunk_size_, path.c_str());
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    void* mem = mmap(nullptr, chunk_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+    if (mem == MAP_FAILED)
+    {
+        PLOGE.printf("Could not map telemetry chunk %s", path.c_str());
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    data_ = static_cast<uint8_t*>(mem);
+    header_ = reinterpret_cast<TelemetryChunkHeader*>(data_);
+    count_ = 0;
+
+    memset(header_, 0, sizeof(TelemetryChunkHeader));
+    memcpy(header_->magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC));
+    header_->version = TELEMETRY_VERSION;
+    header_->num_columns = NUM_COLUMNS;
+    header_->capacity = capacity_;
+    header_->chunk_index = static_cast<uint32_t>(chunk_paths_.size());
+
+    TelemetryColumnDesc* descs = reinterpret_cast<TelemetryColumnDesc*>(header_ + 1);
+    uint32_t offset = TELEMETRY_DATA_OFFSET;
+    for (uint32_t i = 0; i < NUM_COLUMNS; i++)
+    {
+        memset(&descs[i], 0, sizeof(TelemetryColumnDesc));
+        strncpy(descs[i].name, COLUMNS[i].name, TELEMETRY_COLUMN_NAME_SIZE - 1);
+        descs[i].type = static_cast<uint32_t>(COLUMNS[i].type);
+        descs[i].offset = offset;
+        offset += columnStride(COLUMNS[i].type, capacity_);
+    }
+
+    chunk_paths_.push_back(path);
+    PLOGI.printf("Started telemetry chunk %s", path.c_str());
+    return true;
+}
+
+void TelemetryWriter::closeChunk()
+{
+    if (data_)
+    {
+        // Hands the dirty pages to the kernel without waiting for them to hit the disk
+        msync(data_, chunk_size_, MS_ASYNC);
+        munmap(data_, chunk_size_);
+        data_ = nullptr;
+        header_ = nullptr;
+    }
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+
+bool TelemetryReader::open(const std::string& path)
+{
+    data_.clear();
+    columns_.clear();
+    count_ = 0;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    data_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (data_.size() < TELEMETRY_DATA_OFFSET) return false;
+
+    TelemetryChunkHeader header;
+    memcpy(&header, data_.data(), sizeof(header));
+    if (memcmp(header.magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC)) != 0 || header.version != TELEMETRY_VERSION)
+    {
+        return false;
+    }
+    if (sizeof(TelemetryChunkHeader) + header.num_columns * sizeof(TelemetryColumnDesc) > TELEMETRY_DATA_OFFSET)
+    {
+        return false;
+    }
+
+    count_ = std::min<uint64_t>(header.record_count, header.capacity);
+    for (uint32_t i = 0; i < header.num_columns; i++)
+    {
+        TelemetryColumnDesc desc;
+        memcpy(&desc, data_.data() + sizeof(TelemetryChunkHeader) + i * sizeof(TelemetryColumnDesc), sizeof(desc));
+        desc.name[TELEMETRY_COLUMN_NAME_SIZE - 1] = '\0';
+        const TELEMETRY_TYPE type = static_cast<TELEMETRY_TYPE>(desc.type);
+        if (desc.offset + typeSize(type) * count_ > data_.size()) return false;
+        columns_[desc.name] = {type, desc.offset};
+    }
+    return true;
+}
+
+std::vector<double> TelemetryReader::column(const std::string& name) const
+{
+    std::vector<double> values;
+    auto it = columns_.find(name);
+    if (it == columns_.end()) return values;
+
+    values.reserve(count_);
+    const uint8_t* src = data_.data() + it->second.offset;
+    for (uint64_t i = 0; i < count_; i++)
+    {
+        switch (it->second.type)
+        {
+            case TELEMETRY_TYPE::F32:
+            {
+                float v;
+                memcpy(&v, src + i * sizeof(v), sizeof(v));
+                values.push_back(v);
+                break;
+            }
+            case TELEMETRY_TYPE::F64:
+            {
+                double v;
+                memcpy(&v, src + i * sizeof(v), sizeof(v));
+                values.push_back(v);
+                break;
+            }
+            case TELEMETRY_TYPE::U32:
+            {
+                uint32_t v;
+                memcpy(&v, src + i * sizeof(v), sizeof(v));
+                values.push_back(v);
+                break;
+            }
+        }
+    }
+    return values;
+}
+
+std::vector<std::string> TelemetryReader::columnNames() const
+{
+    std::vector<std::string> names;
+    for (const auto& kv : columns_)
+    {
+        names.push_back(kv.first);
+    }
+    return names;
+}
@@ -0,0 +1,136 @@
+#ifndef Telemetry_h
+#define Telemetry_h
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Binary telemetry for the control cycle. Records go into fixed size chunk files laid out by column, so a
+// reader can pull out one signal without parsing anything and a crashed run still leaves every completed
+// record readable. The files are memory mapped and preallocated, appending a record is a handful of stores.
+//
+// Chunk file layout, all little endian:
+//   TelemetryChunkHeader at offset 0
+//   TelemetryColumnDesc[num_columns] right after it
+//   Column data starting at TELEMETRY_DATA_OFFSET, each column holds capacity values back to back at its
+//   own offset. Only the first record_count values of each column are valid.
+
+#define TELEMETRY_MAGIC "DRTELEM"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_DATA_OFFSET 4096
+#define TELEMETRY_COLUMN_NAME_SIZE 24
+
+enum class TELEMETRY_TYPE : uint32_t
+{
+    F32 = 0,
+    F64 = 1,
+    U32 = 2,
+};
+
+struct TelemetryChunkHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_columns;
+    uint32_t capacity;          // Records the chunk has room for
+    uint32_t chunk_index;       // Position of this chunk in the run
+    uint64_t record_count;      // Written last for each record, so anything below it is complete
+    uint64_t reserved[4];
+};
+
+struct TelemetryColumnDesc
+{
+    char name[TELEMETRY_COLUMN_NAME_SIZE];
+    uint32_t type;              // TELEMETRY_TYPE
+    uint32_t offset;            // File offset of the first value
+};
+
+// One control cycle. Fields a mode doesn't have are left as NaN.
+struct TelemetryRecord
+{
+    double stamp = 0;           // Robot clock in seconds, filled by the writer
+    uint32_t move_id = 0;       // Increments for each move so runs in the same chunk can be split apart
+    uint32_t mode = 0;          // LIMITS_MODE of the move
+    float time = 0;             // Seconds since the trajectory started
+    float pos[3] = {0, 0, 0};
+    float target_pos[3] = {0, 0, 0};
+    float vel[3] = {0, 0, 0};
+    float target_vel[3] = {0, 0, 0};
+    float control_vel[3] = {0, 0, 0};
+    float kf_cov[3] = {NAN, NAN, NAN};          // Diagonal of the filter covariance feeding pos
+    float cam_uv[4] = {NAN, NAN, NAN, NAN};     // side u, side v, rear u, rear v
+};
+
+class TelemetryWriter
+{
+  public:
+
+    // Chunks are written to dir/telemetry_<start time>_<index>.bin, dir is created if it doesn't exist
+    TelemetryWriter(const std::string& dir, uint32_t records_per_chunk);
+
+    ~TelemetryWriter();
+
+    // Not thread safe, meant to be called from the control loop only. Returns false if the record couldn't
+    // be written because a chunk file couldn't be created.
+    bool append(const TelemetryRecord& record);
+
+    // Chunk files written so far, the last one is the one being appended to
+    const std::vector<std::string>& chunkPaths() const { return chunk_paths_; };
+
+    uint64_t recordsWritten() const { return records_written_; };
+
+    TelemetryWriter(const TelemetryWriter&) = delete;
+    TelemetryWriter& operator=(const TelemetryWriter&) = delete;
+
+  private:
+
+    bool openChunk();
+
+    void closeChunk();
+
+    const std::string dir_;
+    const std::string prefix_;
+    const uint32_t capacity_;
+    size_t chunk_size_;
+    std::vector<std::string> chunk_paths_;
+    uint64_t records_written_;
+
+    int fd_;
+    uint8_t* data_;
+    TelemetryChunkHeader* header_;
+    uint32_t count_;
+};
+
+// Reads chunk files back, also fine to use on a chunk that is still being written
+class TelemetryReader
+{
+  public:
+
+    // Returns false if the file is missing or isn't a telemetry chunk
+    bool open(const std::string& path);
+
+    uint64_t size() const { return count_; };
+
+    bool hasColumn(const std::string& name) const { return columns_.count(name) > 0; };
+
+    // Values of one column widened to double, empty if there is no such column
+    std::vector<double> column(const std::string& name) const;
+
+    std::vector<std::string> columnNames() const;
+
+  private:
+
+    struct Column
+    {
+        TELEMETRY_TYPE type;
+        uint32_t offset;
+    };
+
+    std::vector<uint8_t> data_;
+    std::map<std::string, Column> columns_;
+    uint64_t count_ = 0;
+};
+
+#endif //Telemetry_h
@@ -0,0 +1,222 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+    // Log-linear histogram: 4 buckets per power of 2 of (us + 1), up to ~16 s
+    const int HIST_SUB_BUCKETS = 4;
+    const int HIST_MAX_OCTAVE = 23;
+    const int HIST_NUM_BUCKETS = (HIST_MAX_OCTAVE + 1) * HIST_SUB_BUCKETS;
+
+    const char* const TRACE_POINT_NAMES[TRACE_NUM_POINTS] =
+    {
+        "server",
+        "marvelmind",
+        "controller",
+        "tray",
+        "serial_send",
+        "serial_recv",
+        "cam_capture",
+        "cam_undistort",
+        "cam_threshold",
+        "cam_detect",
+        "cam_coarse",
+        "cam_refine",
+    };
+
+    struct TraceEvent
+    {
+        uint64_t start_ns;
+        uint32_t duration_ns;
+        TRACE_POINT point;
+    };
+
+    // Written only by its own thread. Dumps read it without stopping the writer, so events being
+    // overwritten during a dump are detected after the copy and dropped.
+    struct ThreadBuffer
+    {
+        std::atomic<uint32_t> head;
+        TraceEvent events[TRACE_BUFFER_SIZE];
+    };
+
+    std::atomic<bool> g_enabled(false);
+    const std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+
+    std::atomic<uint32_t> g_hist[TRACE_NUM_POINTS][HIST_NUM_BUCKETS];
+    std::atomic<uint32_t> g_max_us[TRACE_NUM_POINTS];
+
+    ThreadBuffer g_buffers[TRACE_MAX_THREADS];
+    std::atomic<int> g_num_buffers(0);
+
+    thread_local ThreadBuffer* t_buffer = nullptr;
+    thread_local bool t_buffer_claimed = false;
+
+    int bucketIndex(uint32_t us)
+    {
+        uint32_t v = us + 1;
+        int octave = 31 - __builtin_clz(v);
+        if (octave > HIST_MAX_OCTAVE) return HIST_NUM_BUCKETS - 1;
+        // Next two bits below the leading one pick the sub bucket
+        int sub = octave >= 2 ? (v >> (octave - 2)) & 3 : (v << (2 - octave)) & 3;
+        return octave * HIST_SUB_BUCKETS + sub;
+    }
+
+    // Largest us value that lands in the bucket. Bucket idx covers us + 1 in [(4 + sub), (5 + sub)) * 2^octave / 4.
+    uint32_t bucketUpperBound(int idx)
+    {
+        if (idx + 1 >= HIST_NUM_BUCKETS) return UINT32_MAX;
+        int octave = idx / HIST_SUB_BUCKETS;
+        int sub = idx % HIST_SUB_BUCKETS;
+        uint32_t end = static_cast<uint32_t>(HIST_SUB_BUCKETS + sub + 1) << octave;
+        return (end + 3) / 4 - 2;
+    }
+
+    ThreadBuffer* threadBuffer()
+    {
+        if (!t_buffer_claimed)
+        {
+            t_buffer_claimed = true;
+            int idx = g_num_buffers.fetch_add(1);
+            if (idx < TRACE_MAX_THREADS) t_buffer = &g_buffers[idx];
+        }
+        return t_buffer;
+    }
+
+    void updateMax(std::atomic<uint32_t>& max, uint32_t value)
+    {
+        uint32_t prev = max.load(std::memory_order_relaxed);
+        while (value > prev && !max.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {}
+    }
+}
+
+const char* tracePointName(TRACE_POINT point)
+{
+    int idx = static_cast<int>(point);
+    return idx < TRACE_NUM_POINTS ? TRACE_POINT_NAMES[idx] : "unknown";
+}
+
+namespace Tracer
+{
+
+void setEnabled(bool enabled)
+{
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool isEnabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t nowNs()
+{
+    // Offset by one so a valid start time is never 0, which ScopedTrace uses for disabled
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count() + 1;
+}
+
+void record(TRACE_POINT point, uint64_t start_ns, uint64_t end_ns)
+{
+    const int p = static_cast<int>(point);
+    if (p >= TRACE_NUM_POINTS) return;
+    uint64_t duration_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+    uint32_t us = static_cast<uint32_t>(std::min<uint64_t>(duration_ns / 1000, UINT32_MAX - 1));
+    g_hist[p][bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    updateMax(g_max_us[p], us);
+
+    ThreadBuffer* buffer = threadBuffer();
+    if (!buffer) return;
+    uint32_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent& event = buffer->events[head & (TRACE_BUFFER_SIZE - 1)];
+    event.start_ns = start_ns;
+    event.duration_ns = static_cast<uint32_t>(std::min<uint64_t>(duration_ns, UINT32_MAX));
+    event.point = point;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+TraceStats getStats(bool reset)
+{
+    TraceStats stats;
+    for (int p = 0; p < TRACE_NUM_POINTS; p++)
+    {
+        uint32_t counts[HIST_NUM_BUCKETS];
+        uint64_t total = 0;
+        for (int b = 0; b < HIST_NUM_BUCKETS; b++)
+        {
+            counts[b] = reset ? g_hist[p][b].exchange(0, std::memory_order_relaxed) : g_hist[p][b].load(std::memory_order_relaxed);
+            total += counts[b];
+        }
+        stats.max_us[p] = reset ? g_max_us[p].exchange(0, std::memory_order_relaxed) : g_max_us[p].load(std::memory_order_relaxed);
+        stats.count[p] = static_cast<uint32_t>(total);
+        if (total == 0) continue;
+
+        const uint64_t p50_rank = (total + 1) / 2;
+        const uint64_t p99_rank = (total * 99 + 99) / 100;
+        uint64_t cumulative = 0;
+        bool have_p50 = false;
+        for (int b = 0; b < HIST_NUM_BUCKETS; b++)
+        {
+            cumulative += counts[b];
+            if (!have_p50 && cumulative >= p50_rank)
+            {
+                stats.p50_us[p] = std::min(bucketUpperBound(b), stats.max_us[p]);
+                have_p50 = true;
+            }
+            if (cumulative >= p99_rank)
+            {
+                stats.p99_us[p] = std::min(bucketUpperBound(b), stats.max_us[p]);
+                break;
+            }
+        }
+    }
+    return stats;
+}
+
+bool dumpChromeTrace(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) return false;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    std::vector<TraceEvent> events(TRACE_BUFFER_SIZE);
+    const int num_buffers = std::min(g_num_buffers.load(), TRACE_MAX_THREADS);
+    for (int t = 0; t < num_buffers; t++)
+    {
+        ThreadBuffer& buffer = g_buffers[t];
+        const uint32_t head = buffer.head.load(std::memory_order_acquire);
+        const uint32_t num = std::min<uint32_t>(head, TRACE_BUFFER_SIZE);
+        for (uint32_t i = 0; i < num; i++)
+        {
+            events[i] = buffer.events[(head - num + i) & (TRACE_BUFFER_SIZE - 1)];
+        }
+        // Anything the writer lapped while copying is unreliable
+        const uint32_t new_head = buffer.head.load(std::memory_order_acquire);
+        const uint32_t overwritten = std::min(new_head - head, num);
+
+        for (uint32_t i = overwritten; i < num; i++)
+        {
+            const TraceEvent& e = events[i];
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",", tracePointName(e.point), t, e.start_ns / 1000.0, e.duration_ns / 1000.0);
+            first = false;
+        }
+    }
+    fprintf(file, "]}\n");
+    return fclose(file) == 0;
+}
+
+void clear()
+{
+    getStats(true);
+    const int num_buffers = std::min(g_num_buffers.load(), TRACE_MAX_THREADS);
+    for (int t = 0; t < num_buffers; t++)
+    {
+        g_buffers[t].head.store(0, std::memory_order_release);
+    }
+}
+
+}
@@ -0,0 +1,96 @@
+#ifndef Trace_h
+#define Trace_h
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Low overhead timing of the hot paths. A TRACE_SCOPE records how long the enclosing scope took into a
+// histogram per trace point and, for Chrome trace dumps, into a ring buffer owned by the calling thread.
+// Nothing is locked or allocated on the recording side, and a disabled tracer only costs a flag check.
+
+enum class TRACE_POINT : uint8_t
+{
+    SERVER,
+    MARVELMIND,
+    CONTROLLER,
+    TRAY,
+    SERIAL_SEND,
+    SERIAL_RECV,
+    CAMERA_CAPTURE,
+    CAMERA_UNDISTORT,
+    CAMERA_THRESHOLD,
+    CAMERA_DETECT,
+    CAMERA_COARSE,          // Downsample, threshold and candidate detection of the pyramid search
+    CAMERA_REFINE,          // Full resolution detection in the pyramid candidate windows
+    COUNT,
+};
+
+#define TRACE_NUM_POINTS static_cast<int>(TRACE_POINT::COUNT)
+
+// Events kept per thread for trace dumps, must be a power of 2
+#define TRACE_BUFFER_SIZE 4096
+// Threads beyond this still feed the histograms but don't show up in trace dumps
+#define TRACE_MAX_THREADS 16
+
+const char* tracePointName(TRACE_POINT point);
+
+// Percentiles are the upper edge of the histogram bucket they fall in, which is within ~20%
+struct TraceStats
+{
+    uint32_t p50_us[TRACE_NUM_POINTS] = {0};
+    uint32_t p99_us[TRACE_NUM_POINTS] = {0};
+    uint32_t max_us[TRACE_NUM_POINTS] = {0};
+    uint32_t count[TRACE_NUM_POINTS] = {0};
+};
+
+namespace Tracer
+{
+    void setEnabled(bool enabled);
+
+    bool isEnabled();
+
+    // Records one event, normally called through TRACE_SCOPE
+    void record(TRACE_POINT point, uint64_t start_ns, uint64_t end_ns);
+
+    // Nanoseconds on a monotonic clock. Tracing deliberately bypasses ClockFactory so mock clocks don't
+    // distort it and it stays cheap.
+    uint64_t nowNs();
+
+    // Stats for everything recorded since the last reset. Recording may continue while this runs.
+    TraceStats getStats(bool reset);
+
+    // Writes the events still in the ring buffers as Chrome trace JSON (chrome://tracing or Perfetto).
+    // Returns false if the file couldn't be written.
+    bool dumpChromeTrace(const std::string& path);
+
+    // Drops all recorded events and histograms, only meant for tests
+    void clear();
+}
+
+class ScopedTrace
+{
+  public:
+    explicit ScopedTrace(TRACE_POINT point)
+    : point_(point),
+      start_ns_(Tracer::isEnabled() ? Tracer::nowNs() : 0)
+    {}
+
+    ~ScopedTrace()
+    {
+        if (start_ns_ != 0) Tracer::record(point_, start_ns_, Tracer::nowNs());
+    }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+  private:
+    TRACE_POINT point_;
+    uint64_t start_ns_;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(point) ScopedTrace TRACE_CONCAT(trace_scope_, __LINE__)(point)
+
+#endif //Trace_h
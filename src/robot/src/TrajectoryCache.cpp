@@ -0,0 +1,119 @@
+#include "TrajectoryCache.h"
+#include <plog/Log.h>
+#include "constants.h"
+#include "ConfigSnapshot.h"
+
+TrajectoryCache::TrajectoryCache()
+: enabled_(cfg.lookup("trajectory_generation.cache.enabled")),
+  trans_resolution_(cfg.lookup("trajectory_generation.cache.trans_resolution")),
+  rot_resolution_(cfg.lookup("trajectory_generation.cache.rot_resolution")),
+  min_dist_(cfg.lookup("trajectory_generation.min_dist_limit")),
+  entries_(static_cast<int>(cfg.lookup("trajectory_generation.cache.size"))),
+  use_counter_(0),
+  stats_(),
+  config_generation_(0)
+{
+    clear();
+}
+
+void TrajectoryCache::clear()
+{
+    for (auto& entry : entries_)
+    {
+        entry.valid = false;
+    }
+}
+
+Trajectory TrajectoryCache::getTrajectory(const MotionPlanningProblem& problem, LIMITS_MODE limits_mode)
+{
+    if (!enabled_ || entries_.empty())
+    {
+        return generateTrajectory(problem);
+    }
+
+    const uint32_t generation = ConfigSnapshot::current()->generation;
+    if (generation != config_generation_)
+    {
+        clear();
+        config_generation_ = generation;
+    }
+
+    Eigen::Vector3f delta_position = problem.targetPoint - problem.initialPoint;
+    delta_position(2) = wrap_angle(delta_position(2));
+    const float trans_dist = delta_position.head(2).norm();
+    const float rot_dist = fabs(delta_position(2));
+    const int trans_bucket = getBucket(trans_dist, trans_resolution_);
+    const int rot_bucket = getBucket(rot_dist, rot_resolution_);
+
+    Entry* entry = find(limits_mode, trans_bucket, rot_bucket);
+    if (entry)
+    {
+        stats_.hits++;
+    }
+    else
+    {
+        stats_.misses++;
+
+        // Solve the move to the far edge of the bucket along the same directions
+        MotionPlanningProblem bucket_problem = problem;
+        bucket_problem.targetPoint.head(2) = problem.initialPoint.head(2) +
+            delta_position.head(2).normalized() * trans_bucket * trans_resolution_;
+        bucket_problem.targetPoint(2) = problem.initialPoint(2) + sgn(delta_position(2)) * rot_bucket * rot_resolution_;
+        Trajectory bucket_traj = generateTrajectory(bucket_problem);
+        if (!bucket_traj.complete)
+        {
+            // Don't cache failures, let the exact problem report its own error
+            return generateTrajectory(problem);
+        }
+
+        entry = &getSlot();
+        entry->valid = true;
+        entry->limits_mode = limits_mode;
+        entry->trans_bucket = trans_bucket;
+        entry->rot_bucket = rot_bucket;
+        entry->trans_params = bucket_traj.trans_params;
+        entry->rot_params = bucket_traj.rot_params;
+    }
+    entry->last_used = ++use_counter_;
+
+    Trajectory traj;
+    traj.initialPoint = {problem.initialPoint(0), problem.initialPoint(1), problem.initialPoint(2)};
+    traj.trans_direction = delta_position.head(2).normalized();
+    traj.rot_direction = sgn(delta_position(2));
+    traj.trans_params = entry->trans_params;
+    traj.rot_params = entry->rot_params;
+    scaleSCurve(&traj.trans_params, trans_bucket > 0 ? trans_dist / (trans_bucket * trans_resolution_) : 0);
+    scaleSCurve(&traj.rot_params, rot_bucket > 0 ? rot_dist / (rot_bucket * rot_resolution_) : 0);
+    traj.complete = true;
+    return traj;
+}
+
+int TrajectoryCache::getBucket(float dist, float resolution) const
+{
+    if (dist < min_dist_) return 0;
+    return std::max(static_cast<int>(std::ceil(dist / resolution)), 1);
+}
+
+TrajectoryCache::Entry* TrajectoryCache::find(LIMITS_MODE limits_mode, int trans_bucket, int rot_bucket)
+{
+    for (auto& entry : entries_)
+    {
+        if (entry.valid && entry.limits_mode == limits_mode && entry.trans_bucket == trans_bucket && entry.rot_bucket == rot_bucket)
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+TrajectoryCache::Entry& TrajectoryCache::getSlot()
+{
+    Entry* oldest = &entries_[0];
+    for (auto& entry : entries_)
+    {
+        if (!entry.valid) return entry;
+        if (entry.last_used < oldest->last_used) oldest = &entry;
+    }
+    return *oldest;
+}
+
@@ -0,0 +1,59 @@
+#ifndef TrajectoryCache_h
+#define TrajectoryCache_h
+
+#include "SmoothTrajectoryGenerator.h"
+#include "utils.h"
+#include <vector>
+
+// Keeps solved trajectories for recently seen moves. Moves are keyed by their translational and rotational
+// distance, quantized up to the cache resolution, and the limits mode. Each entry is solved for the far edge
+// of its bucket and scaled down to the requested distance, so every hit ends exactly on target without
+// exceeding the limits. Direction and start point come from the new move, so a repeated relative move
+// anywhere on the field reuses the same entry. Entries are dropped when the config snapshot is reloaded, since
+// the limits they were solved with may have changed.
+class TrajectoryCache
+{
+  public:
+
+    TrajectoryCache();
+
+    // Returns the trajectory for problem, solving it only on a cache miss
+    Trajectory getTrajectory(const MotionPlanningProblem& problem, LIMITS_MODE limits_mode);
+
+    void clear();
+
+    TrajectoryCacheStats getStats() const { return stats_; };
+
+  private:
+
+    struct Entry
+    {
+        bool valid;
+        LIMITS_MODE limits_mode;
+        int trans_bucket;
+        int rot_bucket;
+        uint32_t last_used;
+        SCurveParameters trans_params;
+        SCurveParameters rot_params;
+    };
+
+    // Bucket 0 is reserved for distances too small to plan, everything else rounds up
+    int getBucket(float dist, float resolution) const;
+
+    Entry* find(LIMITS_MODE limits_mode, int trans_bucket, int rot_bucket);
+
+    // Least recently used entry, or an unused one
+    Entry& getSlot();
+
+    bool enabled_;
+    float trans_resolution_;
+    float rot_resolution_;
+    float min_dist_;
+    std::vector<Entry> entries_;
+    uint32_t use_counter_;
+    TrajectoryCacheStats stats_;
+    uint32_t config_generation_;   // Config snapshot the entries were solved with
+};
+
+
+#endif //TrajectoryCache_h
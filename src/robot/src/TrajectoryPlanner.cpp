@@ -0,0 +1,62 @@
+#include "TrajectoryPlanner.h"
+
+#include <plog/Log.h>
+
+TrajectoryPlanner::TrajectoryPlanner()
+: cache_(),
+  mutex_(),
+  wake_(),
+  queue_(),
+  stopping_(false),
+  thread_(&TrajectoryPlanner::threadLoop, this)
+{}
+
+TrajectoryPlanner::~TrajectoryPlanner()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+std::future<PlannedTrajectory> TrajectoryPlanner::submit(const MotionPlanningProblem& problem, LIMITS_MODE limits_mode)
+{
+    Request request;
+    request.problem = problem;
+    request.limits_mode = limits_mode;
+    request.submitted = Clock::now();
+    std::future<PlannedTrajectory> result = request.result.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(request));
+    }
+    wake_.notify_one();
+    return result;
+}
+
+void TrajectoryPlanner::threadLoop()
+{
+    while(true)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if(stopping_) return;
+            request = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        PlannedTrajectory plan;
+        const Clock::time_point start = Clock::now();
+        plan.trajectory = cache_.getTrajectory(request.problem, request.limits_mode);
+        const Clock::time_point end = Clock::now();
+        plan.wait_ms = std::chrono::duration<float, std::milli>(start - request.submitted).count();
+        plan.plan_ms = std::chrono::duration<float, std::milli>(end - start).count();
+        plan.cache_stats = cache_.getStats();
+        if(!plan.trajectory.complete) PLOGW.printf("Planner could not solve the trajectory after %.3f ms", plan.plan_ms);
+        request.result.set_value(plan);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef TrajectoryPlanner_h
+#define TrajectoryPlanner_h
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "SmoothTrajectoryGenerator.h"
+#include "TrajectoryCache.h"
+#include "utils.h"
+
+struct PlannedTrajectory
+{
+    Trajectory trajectory;
+    float wait_ms = 0;                  // From submit until the worker picked the problem up
+    float plan_ms = 0;                  // Solving, or finding it in the cache
+    TrajectoryCacheStats cache_stats;   // The planner's own cache, as of this plan
+};
+
+// Solves point to point trajectories on a worker thread so the iterative s-curve solver never holds up the
+// loop that asked for them. Each submit gets a future for its result, problems are solved in the order they
+// were submitted. A caller that no longer wants a plan can just drop its future. The planner keeps its own
+// TrajectoryCache, which only the worker touches.
+class TrajectoryPlanner
+{
+  public:
+
+    TrajectoryPlanner();
+
+    // Finishes the problem being solved, anything still queued is abandoned
+    ~TrajectoryPlanner();
+
+    TrajectoryPlanner(const TrajectoryPlanner&) = delete;
+    TrajectoryPlanner& operator=(const TrajectoryPlanner&) = delete;
+
+    std::future<PlannedTrajectory> submit(const MotionPlanningProblem& problem, LIMITS_MODE limits_mode);
+
+  private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Request
+    {
+        MotionPlanningProblem problem;
+        LIMITS_MODE limits_mode;
+        Clock::time_point submitted;
+        std::promise<PlannedTrajectory> result;
+    };
+
+    void threadLoop();
+
+    TrajectoryCache cache_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Request> queue_;
+    bool stopping_;
+    std::thread thread_;
+};
+
+#endif //TrajectoryPlanner_h
@@ -1,5 +1,6 @@
 #include "TrayController.h"
 #include "constants.h"
+#include "ConfigSnapshot.h"
 #include <plog/Log.h>
 #include "serial/SerialCommsFactory.h"
 
@@ -36,9 +37,23 @@ TrayController::TrayController()
   load_complete_(false),
   action_step_(0),
   fake_tray_motion_(cfg.lookup("tray.fake_tray_motions")),
+  overlap_motion_(cfg.lookup("tray.overlap_motion")),
   cur_action_(ACTION::NONE),
   controller_rate_(cfg.lookup("tray.controller_frequency")),
-  is_initialized_(false)
+  action_timer_(),
+  status_poll_timer_(),
+  status_polling_(false),
+  done_timeout_ms_(cfg.lookup("tray.done_timeout_ms")),
+  status_poll_ms_(cfg.lookup("tray.status_poll_ms")),
+  is_initialized_(false),
+  scurve_enabled_(cfg.lookup("tray.scurve.enabled")),
+  scurve_limits_({cfg.lookup("tray.scurve.max_vel"), cfg.lookup("tray.scurve.max_acc"), cfg.lookup("tray.scurve.max_jerk")}),
+  steps_per_rev_(cfg.lookup("tray.steps_per_rev")),
+  default_pos_(getPos(LifterPosType::DEFAULT)),
+  place_pos_(getPos(LifterPosType::PLACE)),
+  load_pos_(getPos(LifterPosType::LOAD)),
+  lifter_pos_(-1),
+  lifter_traj_id_(0)
 {
     if(fake_tray_motion_) PLOGW << "Fake tray motion enabled";
 }
@@ -83,6 +98,8 @@ void TrayController::estop()
     cur_action_ = ACTION::NONE;
     action_step_ = 0;
     action_step_running_ = false;
+    // Wherever the lifter stopped, it has to be homed before the next profile
+    lifter_pos_ = -1;
     PLOGW << "Estopping tray control";
     if (serial_to_lifter_driver_->isConnected())
     {
@@ -90,6 +107,24 @@ void TrayController::estop()
     }
 }
 
+bool TrayController::canOverlapWith(COMMAND motion_cmd) const
+{
+    if(!overlap_motion_) return false;
+
+    const bool relative_move = motion_cmd == COMMAND::MOVE_REL || motion_cmd == COMMAND::MOVE_REL_SLOW;
+    switch (cur_action_)
+    {
+        case ACTION::PLACE:
+            // Once the latch has opened the tiles are on the floor, so the tray can reset while the base backs away
+            return action_step_ >= 2 && relative_move;
+        case ACTION::LOAD:
+            // Once loading is complete the tray can go to the driving position while the base leaves the station
+            return action_step_ >= 2 && (relative_move || motion_cmd == COMMAND::MOVE || motion_cmd == COMMAND::MOVE_PATH);
+        default:
+            return false;
+    }
+}
+
 void TrayController::setLoadComplete()
 {
     if(cur_action_ == ACTION::LOAD && action_step_ == 1)
@@ -126,7 +161,7 @@ void TrayController::update()
     }
 }
 
-void TrayController::runStepAndWaitForCompletion(std::string data, std::string debug_print)
+void TrayController::runStepAndWaitForCompletion(const char* data, const char* done_step, const char* debug_print)
 {
     if(!action_step_running_)
     {
@@ -135,26 +170,84 @@ void TrayController::runStepAndWaitForCompletion(std::string data, std::string d
             serial_to_lifter_driver_->send(data);
         }
         action_step_running_ = true;
+        status_polling_ = false;
         PLOGI << debug_print;
         action_timer_.reset();
+        status_poll_timer_.reset();
     }
     else
     {
-        // Request status and wait for command to complete
-        std::string msg = "";
+        bool step_done = false;
         if (serial_to_lifter_driver_->isConnected())
         {
-            serial_to_lifter_driver_->send("lift:status_req");
-            msg = serial_to_lifter_driver_->rcv_lift();
+            // Only poll if the done message is overdue, in case it was lost or the driver doesn't send it
+            if(action_timer_.dt_ms() > done_timeout_ms_ && status_poll_timer_.dt_ms() >= status_poll_ms_)
+            {
+                if(!status_polling_) PLOGW << "No done message from lifter driver, polling status";
+                status_polling_ = true;
+                serial_to_lifter_driver_->send("lift:status_req");
+                status_poll_timer_.reset();
+            }
+
+            // Drain everything so command replies don't pile up, done messages from other steps are stale
+            for(std::string msg = serial_to_lifter_driver_->rcv_lift(); !msg.empty(); msg = serial_to_lifter_driver_->rcv_lift())
+            {
+                if((msg.compare(0, 5, "done:") == 0 && msg.compare(5, std::string::npos, done_step) == 0) ||
+                   (status_polling_ && msg == "none"))
+                {
+                    step_done = true;
+                }
+            }
+        }
+        if(fake_tray_motion_ && action_timer_.dt_ms() > 1000)
+        {
+            step_done = true;
         }
-        // Initial delay for action
-        if(action_timer_.dt_ms() > 1000 && (msg == "none" || fake_tray_motion_)) {
+        if(step_done) {
             action_step_running_ = false;
             action_step_++;
         }
     }
 }
 
+void TrayController::runMoveAndWaitForCompletion(int pos, const char* debug_print)
+{
+    // The message is only built when the step starts, the calls after that just wait for it
+    std::string data;
+    if(!action_step_running_)
+    {
+        if(scurve_enabled_ && lifter_pos_ >= 0 && lifter_pos_ != pos && serial_to_lifter_driver_->isConnected())
+        {
+            data = uploadLifterProfile(pos);
+        }
+        else
+        {
+            data = "lift:pos:" + std::to_string(pos);
+        }
+    }
+    const int step = action_step_;
+    runStepAndWaitForCompletion(data.c_str(), "pos", debug_print);
+    if(action_step_ != step) lifter_pos_ = pos;
+}
+
+std::string TrayController::uploadLifterProfile(int pos)
+{
+    const float dist_revs = static_cast<float>(pos - lifter_pos_) / steps_per_rev_;
+    SCurveParameters params;
+    if(!generateSCurve(fabs(dist_revs), scurve_limits_, ConfigSnapshot::current()->solver, &params))
+    {
+        PLOGW.printf("No lifter profile for %.2f revs, using the driver's own move", dist_revs);
+        return "lift:pos:" + std::to_string(pos);
+    }
+
+    uint8_t payload[SERIAL_TRAJECTORY_AXIS_PAYLOAD_SIZE];
+    encodeTrajectoryAxisPayload(toSerialTrajectoryAxis(lifter_traj_id_++, SERIAL_TRAJECTORY_AXIS::LIFTER,
+        sgn(dist_revs), 0, params, steps_per_rev_), payload);
+    serial_to_lifter_driver_->send_frame(SERIAL_BINARY_CHANNEL::TRAJECTORY_AXIS, payload, SERIAL_TRAJECTORY_AXIS_PAYLOAD_SIZE);
+    PLOGI.printf("Lifter profile for %.2f revs takes %.2f s", dist_revs, params.switch_points[7].t);
+    return "lift:scurve:" + std::to_string(pos);
+}
+
 void TrayController::updateInitialize()
 {
     /*
@@ -167,24 +260,18 @@ void TrayController::updateInitialize()
     // 0 - Close latch
     if(action_step_ == 0)
     {
-        std::string data = "lift:close";
-        std::string debug = "Closing latch";
-        runStepAndWaitForCompletion(data, debug);
+        runStepAndWaitForCompletion("lift:close", "close", "Closing latch");
     }
     // 1 - Do tray init
     if(action_step_ == 1)
     {
-        std::string data = "lift:home";
-        std::string debug = "Homing tray";
-        runStepAndWaitForCompletion(data, debug);
+        runStepAndWaitForCompletion("lift:home", "home", "Homing tray");
+        if(action_step_ == 2) lifter_pos_ = 0;
     }
     // 2 - Move to default location
     if(action_step_ == 2)
     {
-        int pos = getPos(LifterPosType::DEFAULT);
-        std::string data = "lift:pos:" + std::to_string(pos);
-        std::string debug = "Moving tray to default position";
-        runStepAndWaitForCompletion(data, debug);
+        runMoveAndWaitForCompletion(default_pos_, "Moving tray to default position");
     }
     // 3 - Done with actinon
     if(action_step_ == 3)
@@ -208,32 +295,22 @@ void TrayController::updatePlace()
     // 0 - Move tray to place
     if(action_step_ == 0)
     {
-        int pos = getPos(LifterPosType::PLACE);
-        std::string data = "lift:pos:" + std::to_string(pos);
-        std::string debug = "Moving tray to placement position";
-        runStepAndWaitForCompletion(data, debug);
+        runMoveAndWaitForCompletion(place_pos_, "Moving tray to placement position");
     }
     // 1 - Open latch
     if(action_step_ == 1)
     {
-        std::string data = "lift:open";
-        std::string debug = "Opening latch";
-        runStepAndWaitForCompletion(data, debug);
+        runStepAndWaitForCompletion("lift:open", "open", "Opening latch");
     }
     // 2 - Move tray to default
     if(action_step_ == 2)
     {
-        int pos = getPos(LifterPosType::DEFAULT);
-        std::string data = "lift:pos:" + std::to_string(pos);
-        std::string debug = "Moving tray to default position";
-        runStepAndWaitForCompletion(data, debug);
+        runMoveAndWaitForCompletion(default_pos_, "Moving tray to default position");
     }
     // 3 - Close latch
     if(action_step_ == 3)
     {
-        std::string data = "lift:close";
-        std::string debug = "Closing latch";
-        runStepAndWaitForCompletion(data, debug);
+        runStepAndWaitForCompletion("lift:close", "close", "Closing latch");
     }
     // 4 - Done with actinon
     if(action_step_ == 4)
@@ -255,10 +332,7 @@ void TrayController::updateLoad()
     // 0 - Move tray to load
     if(action_step_ == 0)
     {
-        int pos = getPos(LifterPosType::LOAD);
-        std::string data = "lift:pos:" + std::to_string(pos);
-        std::string debug = "Moving tray to load position";
-        runStepAndWaitForCompletion(data, debug);
+        runMoveAndWaitForCompletion(load_pos_, "Moving tray to load position");
     }
     // 1 - Wait for load complete signal
     if(action_step_ == 1)
@@ -282,10 +356,7 @@ void TrayController::updateLoad()
     // 2 - Move to default
     if(action_step_ == 2)
     {
-        int pos = getPos(LifterPosType::DEFAULT);
-        std::string data = "lift:pos:" + std::to_string(pos);
-        std::string debug = "Moving tray to default position";
-        runStepAndWaitForCompletion(data, debug);
+        runMoveAndWaitForCompletion(default_pos_, "Moving tray to default position");
     }
     // 3 - Done with actinon
     if(action_step_ == 3)
@@ -1,7 +1,9 @@
 #ifndef TrayController_h
 #define TrayController_h
 
+#include "constants.h"
 #include "serial/SerialComms.h"
+#include "SmoothTrajectoryGenerator.h"
 #include "utils.h"
 
 class TrayController
@@ -20,12 +22,18 @@ class TrayController
 
     bool isActionRunning() {return cur_action_ != ACTION::NONE;}
 
+    // True if the rest of the current action is safe to run while the base does the given motion command
+    bool canOverlapWith(COMMAND motion_cmd) const;
+
     void update();
 
     void estop();
 
     void setLoadComplete();
 
+    // Rate limiter for update(), used by the main loop scheduler
+    RateController* getControllerRate() { return &controller_rate_; };
+
     // Used for testing
     void setTrayInitialized(bool value) {is_initialized_ = value;};
 
@@ -44,12 +52,33 @@ class TrayController
     bool load_complete_;
     int action_step_;
     bool fake_tray_motion_;
+    bool overlap_motion_;
     ACTION cur_action_;
     RateController controller_rate_;       // Rate limit controller loop
     Timer action_timer_;
+    Timer status_poll_timer_;
+    bool status_polling_;               // Fallback when no done message arrived, step is done once status reports none
+    int done_timeout_ms_;
+    int status_poll_ms_;
     bool is_initialized_;
-
-    void runStepAndWaitForCompletion(std::string data, std::string debug_print);
+    bool scurve_enabled_;               // Jerk limited lifter moves, planned here and followed by the driver
+    DynamicLimits scurve_limits_;       // In revs
+    int steps_per_rev_;
+    int default_pos_;                   // Lifter positions in steps, read once so the steps don't look them up every update
+    int place_pos_;
+    int load_pos_;
+    int lifter_pos_;                    // Steps from home the lifter last finished a move at, -1 when unknown
+    uint16_t lifter_traj_id_;
+
+    // Sends data to the lifter driver when the step starts, then waits until the driver sends
+    // "lift:done:<done_step>" or, after done_timeout_ms_, until a status request reports "none"
+    void runStepAndWaitForCompletion(const char* data, const char* done_step, const char* debug_print);
+    // Lifter move step. Once the lifter position is known the move is uploaded as an s-curve, otherwise it is
+    // left to the driver's trapezoidal move.
+    void runMoveAndWaitForCompletion(int pos, const char* debug_print);
+    // Uploads the profile from lifter_pos_ to pos and returns the message that starts it, or the plain move
+    // message if no profile could be made
+    std::string uploadLifterProfile(int pos);
     void updateInitialize();
     void updateLoad();
     void updatePlace();
@@ -0,0 +1,185 @@
+#ifndef WindowedStats_h
+#define WindowedStats_h
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Statistics over the last window values added, all updated in constant time per value so they
+// are cheap enough to keep on every loop.
+//
+// Values live in a fixed inline ring of capacity N, the window can be set smaller at runtime.
+//  - Sum and variance come from running sums, shifted by the first value to keep the cancellation small
+//  - Min and max come from monotonic queues of ring positions, amortized O(1)
+//  - Quantiles are approximate, from a histogram of NUM_BINS bins over [hist_min, hist_max). Values outside
+//    the range land in the end bins. Without a range all values share one bin and quantiles are
+//    interpolated between min and max.
+template <class T, size_t N, size_t NUM_BINS = 32>
+class WindowedStats
+{
+  static_assert(N > 0, "WindowedStats capacity must be nonzero");
+  static_assert(NUM_BINS > 0, "WindowedStats needs at least one histogram bin");
+
+  public:
+    explicit WindowedStats(size_t window = N, double hist_min = 0, double hist_max = 0)
+    : window_(std::min(std::max(window, size_t(1)), N)),
+      hist_min_(hist_min),
+      hist_scale_(hist_max > hist_min ? NUM_BINS / (hist_max - hist_min) : 0),
+      values_(),
+      min_queue_(),
+      max_queue_()
+    {
+        clear();
+    }
+
+    void add(T value)
+    {
+        if(count_ == 0) shift_ = value;
+        if(count_ == window_)
+        {
+            const T old = values_[(total_ - count_) % N];
+            const double d = static_cast<double>(old) - static_cast<double>(shift_);
+            sum_ -= d;
+            sum_sq_ -= d * d;
+            bins_[bin(old)]--;
+            count_--;
+        }
+
+        values_[total_ % N] = value;
+        const double d = static_cast<double>(value) - static_cast<double>(shift_);
+        sum_ += d;
+        sum_sq_ += d * d;
+        bins_[bin(value)]++;
+        count_++;
+
+        pushMonotonic(min_queue_, &min_head_, &min_size_, [&](T back) { return back >= value; });
+        pushMonotonic(max_queue_, &max_head_, &max_size_, [&](T back) { return back <= value; });
+        total_++;
+    }
+
+    void clear()
+    {
+        count_ = 0;
+        total_ = 0;
+        shift_ = T();
+        sum_ = 0;
+        sum_sq_ = 0;
+        min_head_ = 0;
+        min_size_ = 0;
+        max_head_ = 0;
+        max_size_ = 0;
+        bins_.fill(0);
+    }
+
+    size_t count() const { return count_; }
+    size_t window() const { return window_; }
+    bool full() const { return count_ == window_; }
+
+    // Newest value, only valid if count() > 0
+    T latest() const { return values_[(total_ - 1) % N]; }
+
+    double sum() const { return static_cast<double>(shift_) * count_ + sum_; }
+
+    double mean() const
+    {
+        if(count_ == 0) return 0;
+        return static_cast<double>(shift_) + sum_ / count_;
+    }
+
+    // Population variance, same as vectorStddev over the window
+    double variance() const
+    {
+        if(count_ == 0) return 0;
+        return std::max((sum_sq_ - sum_ * sum_ / count_) / count_, 0.0);
+    }
+
+    double stddev() const { return std::sqrt(variance()); }
+
+    T min() const { return count_ ? values_[min_queue_[min_head_] % N] : T(); }
+    T max() const { return count_ ? values_[max_queue_[max_head_] % N] : T(); }
+
+    // Same as zScore(mean, stddev, value) for the current window
+    double zScore(T value) const
+    {
+        const double sd = stddev();
+        if(sd < 0.0001) return 0;
+        return std::fabs((static_cast<double>(value) - mean()) / sd);
+    }
+
+    // Approximate value below which fraction q of the window lies
+    double quantile(double q) const
+    {
+        if(count_ == 0) return 0;
+        const double lo = static_cast<double>(min());
+        const double hi = static_cast<double>(max());
+        if(hist_scale_ == 0) return lo + std::clamp(q, 0.0, 1.0) * (hi - lo);
+
+        const double target = std::clamp(q, 0.0, 1.0) * count_;
+        double seen = 0;
+        for(size_t i = 0; i < NUM_BINS; i++)
+        {
+            if(bins_[i] == 0) continue;
+            if(seen + bins_[i] >= target)
+            {
+                const double frac = (target - seen) / bins_[i];
+                const double value = hist_min_ + (i + frac) / hist_scale_;
+                return std::clamp(value, lo, hi);
+            }
+            seen += bins_[i];
+        }
+        return hi;
+    }
+
+  private:
+
+    size_t bin(T value) const
+    {
+        if(hist_scale_ == 0) return 0;
+        const double b = (static_cast<double>(value) - hist_min_) * hist_scale_;
+        if(b <= 0) return 0;
+        return std::min(static_cast<size_t>(b), NUM_BINS - 1);
+    }
+
+    // Drops positions from the front that left the window and ones from the back that the new value
+    // dominates, then appends the new value's position
+    template <class Dominated>
+    void pushMonotonic(std::array<uint64_t, N>& queue, size_t* head, size_t* size, Dominated dominated)
+    {
+        const uint64_t oldest = total_ + 1 - count_;
+        while(*size > 0 && queue[*head] < oldest)
+        {
+            *head = (*head + 1) % N;
+            (*size)--;
+        }
+        while(*size > 0 && dominated(values_[queue[(*head + *size - 1) % N] % N]))
+        {
+            (*size)--;
+        }
+        queue[(*head + *size) % N] = total_;
+        (*size)++;
+    }
+
+    size_t window_;
+    double hist_min_;
+    double hist_scale_;
+
+    std::array<T, N> values_;
+    size_t count_;
+    uint64_t total_;            // Values added since clear, the ring position of a value is its index mod N
+    T shift_;
+    double sum_;                // Sum of (value - shift_) over the window
+    double sum_sq_;
+
+    std::array<uint64_t, N> min_queue_;
+    size_t min_head_;
+    size_t min_size_;
+    std::array<uint64_t, N> max_queue_;
+    size_t max_head_;
+    size_t max_size_;
+
+    std::array<uint32_t, NUM_BINS> bins_;
+};
+
+#endif //WindowedStats_h
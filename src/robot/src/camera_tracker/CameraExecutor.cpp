@@ -0,0 +1,308 @@
+#include "CameraExecutor.h"
+
+#include <plog/Log.h>
+#include <cmath>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    // Longest the dispatcher sleeps without anything to wait for, bounds how long stop takes
+    constexpr int max_poll_ms = 100;
+
+    // CPU time used by the calling thread, so waiting on a blocking capture isn't charged to the budget
+    double threadCpuSeconds()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+}
+
+CameraExecutor::CameraExecutor(int num_workers, const std::vector<int>& worker_cpus, float max_cpu_cores)
+: num_workers_(std::max(num_workers, 1)),
+  worker_cpus_(worker_cpus),
+  max_cpu_cores_(max_cpu_cores),
+  // Allow a short burst above the cap so a single slow frame doesn't stall the next one
+  max_budget_s_(std::max(max_cpu_cores, 0.0f) * 0.1),
+  slots_(),
+  mutex_(),
+  work_cv_(),
+  ready_(),
+  wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  running_(false),
+  dispatcher_(),
+  workers_(),
+  min_period_(Clock::duration::zero()),
+  budget_s_(0),
+  last_refill_(Clock::now()),
+  stats_(),
+  busy_s_(0),
+  stats_start_(Clock::now())
+{
+    if(wake_fd_ < 0) PLOGE << "Could not create camera executor eventfd: " << strerror(errno);
+}
+
+CameraExecutor::~CameraExecutor()
+{
+    stop();
+    if(wake_fd_ >= 0) close(wake_fd_);
+}
+
+void CameraExecutor::add(CameraPipeline* pipeline)
+{
+    if(running_)
+    {
+        PLOGE << "Camera pipelines must be added before the executor starts";
+        return;
+    }
+    Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(pipeline->framePeriodS()));
+    slots_.push_back({pipeline, pipeline->frameReadyFd(), period, Clock::now(), false, false});
+}
+
+void CameraExecutor::start()
+{
+    if(running_) return;
+    PLOGI.printf("Starting camera executor: %zu pipelines on %i workers, cpu cap %.2f cores", slots_.size(), num_workers_, max_cpu_cores_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = true;
+        budget_s_ = max_budget_s_;
+        last_refill_ = Clock::now();
+        stats_start_ = last_refill_;
+        for (Slot& slot : slots_)
+        {
+            // Pipelines open their capture lazily, so the descriptor and frame rate may have changed since add
+            slot.fd = slot.pipeline->frameReadyFd();
+            slot.period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(slot.pipeline->framePeriodS()));
+            slot.busy = false;
+            slot.next_due = last_refill_;
+        }
+    }
+    for (int i = 0; i < num_workers_; i++)
+    {
+        workers_.emplace_back(&CameraExecutor::workerLoop, this, i);
+    }
+    dispatcher_ = std::thread(&CameraExecutor::dispatchLoop, this);
+}
+
+void CameraExecutor::stop()
+{
+    if(!running_) return;
+    PLOGI << "Stopping camera executor";
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        ready_.clear();
+    }
+    work_cv_.notify_all();
+    wakeDispatcher();
+    dispatcher_.join();
+    for (std::thread& worker : workers_)
+    {
+        worker.join();
+    }
+    workers_.clear();
+}
+
+void CameraExecutor::setMaxFrameRate(float fps)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        min_period_ = fps > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.0f / fps)) : Clock::duration::zero();
+    }
+    wakeDispatcher();
+}
+
+void CameraExecutor::setPaused(CameraPipeline* pipeline, bool paused)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (Slot& slot : slots_)
+        {
+            if(slot.pipeline == pipeline) slot.paused = paused;
+        }
+    }
+    wakeDispatcher();
+}
+
+CameraExecutor::Stats CameraExecutor::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    double elapsed_s = std::chrono::duration<double>(now - stats_start_).count();
+    if(elapsed_s > 0)
+    {
+        stats_.cpu_cores = busy_s_ / elapsed_s;
+        busy_s_ = 0;
+        stats_start_ = now;
+    }
+    return stats_;
+}
+
+void CameraExecutor::refillBudget(Clock::time_point now)
+{
+    if(max_cpu_cores_ <= 0) return;
+    budget_s_ += std::chrono::duration<double>(now - last_refill_).count() * max_cpu_cores_;
+    budget_s_ = std::min(budget_s_, max_budget_s_);
+    last_refill_ = now;
+}
+
+void CameraExecutor::dispatch(Slot* slot)
+{
+    slot->busy = true;
+    ready_.push_back(slot);
+    work_cv_.notify_one();
+}
+
+void CameraExecutor::wakeDispatcher()
+{
+    uint64_t one = 1;
+    if(wake_fd_ >= 0 && write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        PLOGW << "Could not wake camera dispatcher: " << strerror(errno);
+    }
+}
+
+void CameraExecutor::dispatchLoop()
+{
+    std::vector<pollfd> pfds;
+    std::vector<Slot*> polled_slots;
+    pfds.reserve(slots_.size() + 1);
+    polled_slots.reserve(slots_.size());
+
+    while(true)
+    {
+        pfds.clear();
+        polled_slots.clear();
+        if(wake_fd_ >= 0) pfds.push_back({wake_fd_, POLLIN, 0});
+        int timeout_ms = max_poll_ms;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(!running_) break;
+            Clock::time_point now = Clock::now();
+            refillBudget(now);
+            if(max_cpu_cores_ > 0 && budget_s_ < 0)
+            {
+                // Frames keep arriving while throttled, the pipelines will skip to the newest when they run
+                stats_.throttled++;
+                timeout_ms = static_cast<int>(std::ceil(-budget_s_ / max_cpu_cores_ * 1000));
+            }
+            else
+            {
+                for (Slot& slot : slots_)
+                {
+                    if(slot.busy || slot.paused) continue;
+                    // Under a frame rate limit polled pipelines wait out the rest of their period first
+                    if(slot.fd >= 0 && min_period_ > Clock::duration::zero() && slot.next_due > now)
+                    {
+                        int due_ms = std::chrono::duration_cast<std::chrono::milliseconds>(slot.next_due - now).count() + 1;
+                        timeout_ms = std::min(timeout_ms, due_ms);
+                    }
+                    else if(slot.fd >= 0)
+                    {
+                        pfds.push_back({slot.fd, POLLIN, 0});
+                        polled_slots.push_back(&slot);
+                    }
+                    else if(slot.next_due <= now)
+                    {
+                        dispatch(&slot);
+                    }
+                    else
+                    {
+                        int due_ms = std::chrono::duration_cast<std::chrono::milliseconds>(slot.next_due - now).count() + 1;
+                        timeout_ms = std::min(timeout_ms, due_ms);
+                    }
+                }
+            }
+        }
+
+        int r = poll(pfds.data(), pfds.size(), std::min(std::max(timeout_ms, 0), max_poll_ms));
+        if(r < 0 && errno != EINTR)
+        {
+            PLOGE << "Camera dispatcher poll failed: " << strerror(errno);
+            std::this_thread::sleep_for(std::chrono::milliseconds(max_poll_ms));
+            continue;
+        }
+        if(r <= 0) continue;
+
+        size_t first_slot_pfd = 0;
+        if(wake_fd_ >= 0)
+        {
+            first_slot_pfd = 1;
+            uint64_t count;
+            if(pfds[0].revents & POLLIN)
+            {
+                ssize_t n = read(wake_fd_, &count, sizeof(count));
+                (void) n;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!running_) break;
+        for (size_t i = first_slot_pfd; i < pfds.size(); i++)
+        {
+            Slot* slot = polled_slots[i - first_slot_pfd];
+            if(pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+            {
+                // Don't spin on a broken device, fall back to running it once per frame period
+                PLOGW.printf("%s camera can't be polled, running it on a timer", slot->pipeline->name().c_str());
+                slot->fd = -1;
+            }
+            else if(pfds[i].revents & POLLIN)
+            {
+                dispatch(slot);
+            }
+        }
+    }
+}
+
+void CameraExecutor::workerLoop(int index)
+{
+    int cpu = index < static_cast<int>(worker_cpus_.size()) ? worker_cpus_[index] : -1;
+    if(cpu >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if(rc != 0) PLOGW.printf("Could not pin camera worker %i to cpu %i: %s", index, cpu, strerror(rc));
+    }
+
+    while(true)
+    {
+        Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [this]() { return !ready_.empty() || !running_; });
+            if(!running_) return;
+            slot = ready_.front();
+            ready_.pop_front();
+        }
+
+        Clock::time_point start = Clock::now();
+        double cpu_start_s = threadCpuSeconds();
+        slot->pipeline->oneLoop();
+        double busy_s = threadCpuSeconds() - cpu_start_s;
+        Clock::time_point end = Clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(max_cpu_cores_ > 0)
+            {
+                refillBudget(end);
+                budget_s_ -= busy_s;
+            }
+            busy_s_ += busy_s;
+            stats_.runs++;
+            slot->busy = false;
+            slot->next_due = start + std::max(slot->period, min_period_);
+        }
+        wakeDispatcher();
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef CameraExecutor_h
+#define CameraExecutor_h
+
+#include "CameraPipeline.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs camera pipelines on a fixed set of worker threads instead of a busy thread per camera. A pipeline only
+// runs when it has a new frame: pipelines whose capture can be polled are woken by their device, the rest are
+// run once per frame period. A dispatcher thread does the waiting and hands ready pipelines to the workers, a
+// pipeline never runs on two workers at once.
+//
+// CPU time spent in pipelines is charged to a budget that refills at max_cpu_cores core seconds per second. While
+// it is overdrawn new frames wait, and since pipelines always take the newest frame the ones that arrived in
+// the meantime are skipped rather than queued. Frames are skipped the same way when a lower frame rate is
+// asked for with setMaxFrameRate.
+class CameraExecutor
+{
+  public:
+
+    struct Stats
+    {
+      uint32_t runs = 0;            // Pipeline frames processed
+      uint32_t throttled = 0;       // Times dispatch waited for the cpu budget
+      float cpu_cores = 0;          // Average cores of CPU time used by pipelines since the last getStats
+    };
+
+    // worker_cpus gives the core to pin each worker to, -1 or a missing entry leaves it unpinned.
+    // max_cpu_cores <= 0 disables the cap.
+    CameraExecutor(int num_workers, const std::vector<int>& worker_cpus, float max_cpu_cores);
+
+    ~CameraExecutor();
+
+    // Pipelines must be added before start and outlive the executor, and must not have their own thread running
+    void add(CameraPipeline* pipeline);
+
+    void start();
+
+    void stop();
+
+    bool running() const { return running_; }
+
+    // Pipelines are run at most fps times a second whatever their capture rate, <= 0 removes the limit
+    void setMaxFrameRate(float fps);
+
+    // A paused pipeline isn't run until it is resumed, its last output stays as it was
+    void setPaused(CameraPipeline* pipeline, bool paused);
+
+    Stats getStats();
+
+  private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Slot
+    {
+      CameraPipeline* pipeline;
+      int fd;
+      Clock::duration period;
+      Clock::time_point next_due;
+      bool busy;
+      bool paused;
+    };
+
+    void dispatchLoop();
+
+    void workerLoop(int index);
+
+    // Hands slot to a worker, must hold mutex_
+    void dispatch(Slot* slot);
+
+    // Adds budget for the time since the last refill, must hold mutex_
+    void refillBudget(Clock::time_point now);
+
+    void wakeDispatcher();
+
+    int num_workers_;
+    std::vector<int> worker_cpus_;
+    float max_cpu_cores_;
+    double max_budget_s_;
+
+    std::vector<Slot> slots_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::deque<Slot*> ready_;
+    int wake_fd_;                     // eventfd the dispatcher polls so finished pipelines get rearmed
+    bool running_;
+    std::thread dispatcher_;
+    std::vector<std::thread> workers_;
+
+    // Guarded by mutex_
+    Clock::duration min_period_;      // From setMaxFrameRate, zero for no limit
+    double budget_s_;
+    Clock::time_point last_refill_;
+    Stats stats_;
+    double busy_s_;
+    Clock::time_point stats_start_;
+};
+
+#endif //CameraExecutor_h
@@ -2,9 +2,36 @@
 
 #include <plog/Log.h>
 #include "constants.h"
-#include <mutex>
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 
-std::mutex data_mutex;
+
+namespace
+{
+    // Largest subpixel refinement window is twice this plus one pixels square
+    constexpr int max_centroid_radius_px = 16;
+
+    // Keypoint with the largest area, keypoints must not be empty
+    const cv::KeyPoint& bestKeypoint(const std::vector<cv::KeyPoint>& keypoints)
+    {
+        const cv::KeyPoint* best_keypoint = &keypoints.front();
+        for (const auto& k : keypoints) {
+            // PLOGI << "Keypoint: " << k.class_id;
+            // PLOGI << "Point: " << k.pt;
+            // PLOGI << "Angle: " << k.angle;
+            // PLOGI << "Size: " << k.size;
+            if(k.size > best_keypoint->size)
+            {
+                best_keypoint = &k;
+            }
+        }
+        return *best_keypoint;
+    }
+}
 
 cv::Point2f getBestKeypoint(std::vector<cv::KeyPoint> keypoints)
 {
@@ -12,32 +39,54 @@ cv::Point2f getBestKeypoint(std::vector<cv::KeyPoint> keypoints)
     {
         return {0,0};
     }
-    
-    // Get keypoint with largest area
-    cv::KeyPoint best_keypoint = keypoints.front();
-    for (const auto& k : keypoints) {
-        // PLOGI << "Keypoint: " << k.class_id;
-        // PLOGI << "Point: " << k.pt;
-        // PLOGI << "Angle: " << k.angle;
-        // PLOGI << "Size: " << k.size;
-        if(k.size > best_keypoint.size)
-        {
-            best_keypoint = k;
-        }
-    }
-    return best_keypoint.pt;
+    return bestKeypoint(keypoints).pt;
 }
 
 CameraPipeline::CameraPipeline(CAMERA_ID id, bool start_thread)
-: use_debug_image_(cfg.lookup("vision_tracker.debug.use_debug_image")),
+: CameraPipeline(cameraIdToString(id), start_thread)
+{}
+
+CameraPipeline::CameraPipeline(const std::string& name, bool start_thread)
+: opened_(false),
+  use_debug_image_(cfg.lookup("vision_tracker.debug.use_debug_image")),
   output_debug_images_(cfg.lookup("vision_tracker.debug.save_camera_debug")),
   thread_running_(false),
-  current_output_()
+  output_mailbox_(),
+  output_seq_(0),
+  last_read_seq_(0),
+  output_notify_fd_(-1),
+  use_fused_kernel_(cfg.lookup("vision_tracker.detection.fused_kernel")),
+  fused_kernel_(),
+  use_opencl_(cfg.lookup("vision_tracker.detection.opencl")),
+  ocl_kernel_(),
+  use_capture_timestamp_(cfg.lookup("vision_tracker.detection.use_capture_timestamp")),
+  use_subpixel_(cfg.lookup("vision_tracker.detection.subpixel.enabled")),
+  subpixel_window_scale_(cfg.lookup("vision_tracker.detection.subpixel.window_scale")),
+  capture_timestamp_warned_(false)
 {
-    initCamera(id);
+    initCamera(name);
 
     // Configure detection parameters
     threshold_ = cfg.lookup("vision_tracker.detection.threshold");
+    std::string undistort_mode = cfg.lookup("vision_tracker.detection.undistort_mode");
+    undistort_mode_ = UNDISTORT_MODE::REMAP;
+    if(undistort_mode == "points") undistort_mode_ = UNDISTORT_MODE::POINTS;
+    else if(undistort_mode == "lut") undistort_mode_ = UNDISTORT_MODE::LUT;
+    else if(undistort_mode != "remap") PLOGW << "Unknown undistort mode " << undistort_mode << ", using remap";
+
+    // The tracking window is sized once the camera is open and its frame rate is known, and again whenever a
+    // profile changes the rate
+    pixels_per_meter_u_ = cfg.lookup("vision_tracker.physical.pixels_per_meter_u");
+    pixels_per_meter_v_ = cfg.lookup("vision_tracker.physical.pixels_per_meter_v");
+    use_roi_tracking_ = cfg.lookup("vision_tracker.detection.roi.enabled");
+    float max_trans_vel = cfg.lookup("motion.translation.max_vel.vision");
+    float max_rot_vel = cfg.lookup("motion.rotation.max_vel.vision");
+    roi_motion_m_per_s_ = max_trans_vel + max_rot_vel * camera_data_.lever_arm;
+    roi_motion_scale_ = cfg.lookup("vision_tracker.detection.roi.motion_scale");
+    roi_margin_px_ = cfg.lookup("vision_tracker.detection.roi.margin_px");
+    roi_half_size_px_ = 0;
+    roi_valid_ = false;
+    roi_center_ = {0,0};
     blob_params_.minThreshold = 10;
     blob_params_.maxThreshold = 200;
     blob_params_.filterByArea = cfg.lookup("vision_tracker.detection.blob.use_area");
@@ -50,6 +99,73 @@ CameraPipeline::CameraPipeline(CAMERA_ID id, bool start_thread)
     blob_params_.filterByConvexity = false;
     blob_params_.filterByInertia = false;
     blob_detector_ = cv::SimpleBlobDetector::create(blob_params_);
+    std::string detector = cfg.lookup("vision_tracker.detection.detector");
+    if(detector == "components")
+    {
+        component_detector_ = std::make_unique<ComponentMarkerDetector>(blob_params_);
+    }
+    else if(detector != "blob")
+    {
+        PLOGW << "Unknown detector " << detector << ", using blob";
+    }
+
+    // The coarse detector sees every blob shrunk by the pyramid scale
+    use_pyramid_ = cfg.lookup("vision_tracker.detection.pyramid.enabled");
+    pyramid_scale_ = 1 << static_cast<int>(cfg.lookup("vision_tracker.detection.pyramid.levels"));
+    pyramid_margin_px_ = cfg.lookup("vision_tracker.detection.pyramid.margin_px");
+    pyramid_max_candidates_ = cfg.lookup("vision_tracker.detection.pyramid.max_candidates");
+    if(use_pyramid_)
+    {
+        cv::SimpleBlobDetector::Params coarse_params = blob_params_;
+        const float area_scale = static_cast<float>(pyramid_scale_ * pyramid_scale_);
+        coarse_params.minArea = blob_params_.minArea / area_scale;
+        coarse_params.maxArea = blob_params_.maxArea / area_scale;
+        coarse_params.minDistBetweenBlobs = blob_params_.minDistBetweenBlobs / pyramid_scale_;
+        if(component_detector_) coarse_component_detector_ = std::make_unique<ComponentMarkerDetector>(coarse_params);
+        else coarse_blob_detector_ = cv::SimpleBlobDetector::create(coarse_params);
+    }
+
+    // Profiles are applied once the camera is open, starting from IDLE
+    use_profiles_ = cfg.lookup("vision_tracker.profiles.enabled");
+    const char* profile_names[] = {"idle", "vision"};
+    for (int i = 0; i < 2; i++)
+    {
+        const std::string group = std::string("vision_tracker.profiles.") + profile_names[i];
+        CaptureProfile& profile = profiles_[i];
+        profile.fps = cfg.lookup(group + ".fps");
+        profile.auto_exposure = cfg.lookup(group + ".auto_exposure");
+        profile.exposure_us = cfg.lookup(group + ".exposure_us");
+        profile.gain = cfg.lookup(group + ".gain");
+        const libconfig::Setting& controls = cfg.lookup(group + ".controls");
+        if(controls.getLength() % 2 != 0) PLOGW.printf("Odd number of values in %s.controls, the last is ignored", group.c_str());
+        for (int j = 0; j < controls.getLength() - controls.getLength() % 2; j++)
+        {
+            profile.controls.push_back(controls[j]);
+        }
+    }
+    requested_profile_ = static_cast<int>(CAMERA_PROFILE::IDLE);
+    applied_profile_ = -1;
+
+    // Debug images go to a background writer, with the target location cached up front
+    std::string target_config_name = "vision_tracker.physical." + name;
+    Eigen::Vector2f target_point_world = {float(cfg.lookup(target_config_name + ".target_x")), 
+                                          float(cfg.lookup(target_config_name + ".target_y"))};
+    Eigen::Vector2f target_point_camera = robotToCamera(target_point_world);
+
+    // A marker pattern needs its other blobs in the tracking window as well as the largest
+    const libconfig::Setting& pattern = cfg.lookup(target_config_name + ".pattern");
+    marker_points_ = std::max(1, std::min(pattern.getLength() / 2, MAX_MARKER_POINTS));
+    pattern_span_px_ = 0;
+    for (int i = 0; i < marker_points_; i++)
+    {
+        for (int j = 0; j < i; j++)
+        {
+            const float span_m = std::hypot(float(pattern[2 * i]) - float(pattern[2 * j]), float(pattern[2 * i + 1]) - float(pattern[2 * j + 1]));
+            pattern_span_px_ = std::max(pattern_span_px_, span_m * std::max(pixels_per_meter_u_, pixels_per_meter_v_));
+        }
+    }
+    debug_writer_ = std::make_unique<DebugImageWriter>(name, camera_data_.debug_output_path,
+        cv::Point2f(target_point_camera[0], target_point_camera[1]), cfg.lookup("vision_tracker.debug.writer_queue_size"), /*start_thread=*/ true);
 
     // Start thread
     if (start_thread) start();
@@ -58,24 +174,23 @@ CameraPipeline::CameraPipeline(CAMERA_ID id, bool start_thread)
 CameraPipeline::~CameraPipeline()
 {
     stop();
+    if(camera_data_.grabber) camera_data_.grabber->stop();
 }
 
-void CameraPipeline::initCamera(CAMERA_ID id)
+void CameraPipeline::initCamera(const std::string& name)
 {
     // Get config strings
-    std::string name = cameraIdToString(id);
     std::string calibration_path_config_name = "vision_tracker." + name + ".calibration_file";
-    std::string camera_path_config_name = "vision_tracker." + name + ".camera_path";
     std::string debug_output_path_config_name = "vision_tracker." + name + ".debug_output_path";
-    std::string debug_image_config_name = "vision_tracker." + name + ".debug_image";
     std::string x_offset_config_name = "vision_tracker.physical." + name + ".x_offset";
     std::string y_offset_config_name = "vision_tracker.physical." + name + ".y_offset";
     std::string z_offset_config_name = "vision_tracker.physical." + name + ".z_offset";
+    std::string rotation_config_name = "vision_tracker.physical." + name + ".rotation";
     std::string x_res_scale_config_name = "vision_tracker." + name + ".resolution_scale_x";
     std::string y_res_scale_config_name = "vision_tracker." + name + ".resolution_scale_y";
     
     // Initialize intrinsic calibration data
-    camera_data_.id = id;
+    camera_data_.name = name;
     std::string calibration_path = cfg.lookup(calibration_path_config_name);
     PLOGI.printf("Loading %s camera calibration from %s", name.c_str(), calibration_path.c_str());
     cv::FileStorage fs(calibration_path, cv::FileStorage::READ);
@@ -102,15 +217,18 @@ void CameraPipeline::initCamera(CAMERA_ID id)
     float y_offset = cfg.lookup(y_offset_config_name);
     float z_offset = cfg.lookup(z_offset_config_name);
     Eigen::Vector3f camera_pose = {x_offset, y_offset, z_offset};
-    Eigen::Matrix3f camera_rotation;
-    // Hardcoding rotation matrices here for simplicity
-    if(id == CAMERA_ID::SIDE) 
+    camera_data_.lever_arm = std::hypot(x_offset, y_offset);
+    // Row major camera to robot frame rotation
+    const libconfig::Setting& rotation_setting = cfg.lookup(rotation_config_name);
+    if(rotation_setting.getLength() != 9)
     {
-        camera_rotation << 1,0,0, 0,-1,0, 0,0,-1;
+        PLOGE.printf("%s camera rotation needs 9 values, got %i", name.c_str(), rotation_setting.getLength());
+        throw;
     }
-    else
+    Eigen::Matrix3f camera_rotation;
+    for (int i = 0; i < 9; i++)
     {
-        camera_rotation << 0,1,0, 1,0,0, 0,0,-1;
+        camera_rotation(i / 3, i % 3) = rotation_setting[i];
     }
     // From https://ksimek.github.io/2012/08/22/extrinsic/
     camera_data_.t = -1 * camera_rotation * camera_pose;
@@ -118,42 +236,72 @@ void CameraPipeline::initCamera(CAMERA_ID id)
     // PLOGI << name << " R: " << camera_data_.R;
     // PLOGI << name << " t: " << camera_data_.t.transpose();
 
-    // Precompute some inverse values for later re-use
-    camera_data_.R_inv = camera_data_.R.inverse();
-    Eigen::Matrix3f tmp;
+    // Ground points have z = 0, so projecting them only takes the first two columns of R and t. The
+    // homography and its inverse are all the per point conversions need.
+    Eigen::Matrix3f K;
     // Hack to get around problems with enabling eigen support in opencv
-    tmp << camera_data_.K.at<double>(0,0), camera_data_.K.at<double>(0,1), camera_data_.K.at<double>(0,2),
-           camera_data_.K.at<double>(1,0), camera_data_.K.at<double>(1,1), camera_data_.K.at<double>(1,2),
-           camera_data_.K.at<double>(2,0), camera_data_.K.at<double>(2,1), camera_data_.K.at<double>(2,2);
-    camera_data_.K_inv = tmp.inverse();
+    K << camera_data_.K.at<double>(0,0), camera_data_.K.at<double>(0,1), camera_data_.K.at<double>(0,2),
+         camera_data_.K.at<double>(1,0), camera_data_.K.at<double>(1,1), camera_data_.K.at<double>(1,2),
+         camera_data_.K.at<double>(2,0), camera_data_.K.at<double>(2,1), camera_data_.K.at<double>(2,2);
+    Eigen::Matrix3f ground_to_camera;
+    ground_to_camera << camera_data_.R.col(0), camera_data_.R.col(1), camera_data_.t;
+    camera_data_.pixel_from_ground = K * ground_to_camera;
+    camera_data_.ground_from_pixel = camera_data_.pixel_from_ground.inverse();
 
     // PLOGI << name << " K: " << camera_data_.K;
-    // PLOGI << name << " Ktmp: " << tmp;
-    // PLOGI << name << " Kinv: " << camera_data_.K_inv;
+    // PLOGI << name << " H: " << camera_data_.pixel_from_ground;
     
-    // Initialize camera calibration capture or debug data
+    // Initialze debug output path. Always read so debug output can be toggled on later without config lookups.
+    camera_data_.debug_output_path = std::string(cfg.lookup(debug_output_path_config_name)); 
+}
+
+void CameraPipeline::open()
+{
+    if(opened_) return;
+    Timer timer;
+    const std::string& name = camera_data_.name;
     if(!use_debug_image_)
     {
-        std::string camera_path = cfg.lookup(camera_path_config_name);
-        camera_data_.capture = cv::VideoCapture(camera_path);
-        if (!camera_data_.capture.isOpened()) 
+        std::string camera_path = cfg.lookup("vision_tracker." + name + ".camera_path");
+        std::string capture_backend = cfg.lookup("vision_tracker.detection.capture_backend");
+        if(capture_backend != "v4l2" && capture_backend != "opencv") PLOGW << "Unknown capture backend " << capture_backend << ", using opencv";
+        int width = 0;
+        int height = 0;
+        int fps = 0;
+        // Opened straight at the first profile's rate so applying it doesn't have to change the frame interval
+        const int open_fps = use_profiles_ ? profiles_[requested_profile_].fps : 30;
+        if(capture_backend == "v4l2" && camera_data_.v4l2.open(camera_path, 320, 240, open_fps, cfg.lookup("vision_tracker.detection.v4l2_buffers")))
         {
-            PLOGE.printf("Could not open %s camera at %s", name.c_str(), camera_path.c_str());
-            throw;
+            width = camera_data_.v4l2.width();
+            height = camera_data_.v4l2.height();
+            fps = camera_data_.v4l2.fps();
+        }
+        else
+        {
+            if(capture_backend == "v4l2") PLOGW.printf("V4L2 capture unavailable for %s camera, falling back to OpenCV", name.c_str());
+            camera_data_.capture = cv::VideoCapture(camera_path);
+            if (!camera_data_.capture.isOpened()) 
+            {
+                PLOGE.printf("Could not open %s camera at %s", name.c_str(), camera_path.c_str());
+                throw;
+            }
+            camera_data_.capture.set(cv::CAP_PROP_FRAME_WIDTH, 320);
+            camera_data_.capture.set(cv::CAP_PROP_FRAME_HEIGHT, 240);
+            camera_data_.capture.set(cv::CAP_PROP_FPS, open_fps);
+            // Keep the driver from queueing frames behind the one being processed
+            camera_data_.capture.set(cv::CAP_PROP_BUFFERSIZE, 1);
+            width = camera_data_.capture.get(cv::CAP_PROP_FRAME_WIDTH);
+            height = camera_data_.capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+            fps = camera_data_.capture.get(cv::CAP_PROP_FPS);
         }
         PLOGI.printf("Opened %s camera at %s", name.c_str(), camera_path.c_str());
-        camera_data_.capture.set(cv::CAP_PROP_FRAME_WIDTH, 320);
-        camera_data_.capture.set(cv::CAP_PROP_FRAME_HEIGHT, 240);
-        camera_data_.capture.set(cv::CAP_PROP_FPS, 30);
-
-        int width = camera_data_.capture.get(cv::CAP_PROP_FRAME_WIDTH);
-        int height = camera_data_.capture.get(cv::CAP_PROP_FRAME_HEIGHT);
-        int fps = camera_data_.capture.get(cv::CAP_PROP_FPS);
         PLOGI.printf("Properties %s: resolution: %ix%i, fps: %i", name.c_str(), width, height, fps);
+        camera_data_.fps = fps > 0 ? fps : 30;
+        initUndistortMaps(cv::Size(width, height));
     } 
     else 
     {
-        std::string image_path = cfg.lookup(debug_image_config_name);
+        std::string image_path = cfg.lookup("vision_tracker." + name + ".debug_image");
         camera_data_.debug_frame = cv::imread(image_path, cv::IMREAD_GRAYSCALE);
         if(camera_data_.debug_frame.empty())
         {
@@ -161,12 +309,104 @@ void CameraPipeline::initCamera(CAMERA_ID id)
             throw;
         }
         PLOGW.printf("Loading %s debug image from %s", name.c_str(), image_path.c_str());
+        camera_data_.fps = 30;
+        initUndistortMaps(camera_data_.debug_frame.size());
+    }
+
+    // Capture settings go in before the grabber thread starts reading, cv::VideoCapture can't take them after
+    applyProfile(static_cast<CAMERA_PROFILE>(requested_profile_.load()));
+    if(camera_data_.capture.isOpened() && cfg.lookup("vision_tracker.detection.latest_frame_thread"))
+    {
+        camera_data_.grabber = std::make_unique<LatestFrameGrabber>(camera_data_.capture);
+        camera_data_.grabber->start();
+    }
+    opened_ = true;
+    PLOGI.printf("%s camera ready in %i ms", name.c_str(), timer.dt_ms());
+}
+
+void CameraPipeline::applyProfile(CAMERA_PROFILE profile)
+{
+    applied_profile_ = static_cast<int>(profile);
+    const CaptureProfile& settings = profiles_[applied_profile_];
+    const char* profile_name = profile == CAMERA_PROFILE::VISION ? "vision" : "idle";
+    if(!use_profiles_ || use_debug_image_)
+    {
+        sizeTrackingRoi();
+        return;
+    }
+    if(camera_data_.v4l2.isOpened())
+    {
+        V4l2Capture& v4l2 = camera_data_.v4l2;
+        if(v4l2.fps() != settings.fps) v4l2.setFrameRate(settings.fps);
+        v4l2.setExposure(settings.auto_exposure, settings.exposure_us);
+        if(settings.gain >= 0) v4l2.setGain(settings.gain);
+        for (size_t i = 0; i < settings.controls.size(); i += 2)
+        {
+            v4l2.setControl(settings.controls[i], settings.controls[i + 1]);
+        }
+        camera_data_.fps = v4l2.fps();
+    }
+    else if(!camera_data_.grabber)
+    {
+        // The OpenCV V4L2 backend passes exposure through in driver units and takes its own auto exposure values
+        cv::VideoCapture& capture = camera_data_.capture;
+        capture.set(cv::CAP_PROP_FPS, settings.fps);
+        capture.set(cv::CAP_PROP_AUTO_EXPOSURE, settings.auto_exposure ? 3 : 1);
+        if(!settings.auto_exposure) capture.set(cv::CAP_PROP_EXPOSURE, std::max(1, (settings.exposure_us + 50) / 100));
+        if(settings.gain >= 0) capture.set(cv::CAP_PROP_GAIN, settings.gain);
+        if(!settings.controls.empty()) PLOGW.printf("%s camera %s profile controls need v4l2 capture", camera_data_.name.c_str(), profile_name);
+        const double fps = capture.get(cv::CAP_PROP_FPS);
+        camera_data_.fps = fps > 0 ? fps : settings.fps;
     }
+    else
+    {
+        PLOGW.printf("%s camera can't switch to the %s profile while the OpenCV grabber thread owns the capture", camera_data_.name.c_str(), profile_name);
+        return;
+    }
+    PLOGI.printf("%s camera %s profile: %.0f fps, %s exposure %i us", camera_data_.name.c_str(), profile_name, camera_data_.fps,
+        settings.auto_exposure ? "auto" : "manual", settings.exposure_us);
+    sizeTrackingRoi();
+}
 
-    // Initialze debug output path
-    if(output_debug_images_)
+void CameraPipeline::sizeTrackingRoi()
+{
+    const float motion_per_frame_m = roi_motion_m_per_s_ / camera_data_.fps;
+    roi_half_size_px_ = static_cast<int>(roi_motion_scale_ * motion_per_frame_m * std::max(pixels_per_meter_u_, pixels_per_meter_v_) + pattern_span_px_) + roi_margin_px_;
+    PLOGI.printf("%s camera ROI tracking: %s, half size %i px", camera_data_.name.c_str(), use_roi_tracking_ ? "on" : "off", roi_half_size_px_);
+}
+
+void CameraPipeline::initUndistortMaps(cv::Size image_size)
+{
+    // Same output camera matrix as cv::undistort uses, so pixel coordinates are unchanged from before
+    cv::initUndistortRectifyMap(camera_data_.K, camera_data_.D, cv::Mat(), camera_data_.K, image_size, 
+                                CV_16SC2, camera_data_.undistort_map_1, camera_data_.undistort_map_2);
+    camera_data_.undistort_map_size = image_size;
+    if(undistort_mode_ == UNDISTORT_MODE::LUT)
     {
-        camera_data_.debug_output_path = std::string(cfg.lookup(debug_output_path_config_name)); 
+        Timer timer;
+        camera_data_.ground_lut.init(camera_data_.K, camera_data_.D, camera_data_.ground_from_pixel, image_size);
+        PLOGI.printf("%s camera ground lookup table built in %i ms", camera_data_.name.c_str(), timer.dt_ms());
+    }
+    if(use_fused_kernel_) fused_kernel_.init(camera_data_.K, camera_data_.D, image_size);
+    // Without a device this stays on whichever CPU path is configured
+    if(use_opencl_) use_opencl_ = ocl_kernel_.init(camera_data_.undistort_map_1, camera_data_.undistort_map_2);
+}
+
+void CameraPipeline::undistortKeypoints(std::vector<cv::KeyPoint>& keypoints)
+{
+    if(keypoints.empty()) return;
+
+    std::vector<cv::Point2f> distorted_pts;
+    distorted_pts.reserve(keypoints.size());
+    for (const auto& k : keypoints)
+    {
+        distorted_pts.push_back(k.pt);
+    }
+    std::vector<cv::Point2f> undistorted_pts;
+    cv::undistortPoints(distorted_pts, undistorted_pts, camera_data_.K, camera_data_.D, cv::noArray(), camera_data_.K);
+    for (size_t i = 0; i < keypoints.size() && i < undistorted_pts.size(); i++)
+    {
+        keypoints[i].pt = undistorted_pts[i];
     }
 }
 
@@ -178,104 +418,318 @@ std::string CameraPipeline::cameraIdToString(CAMERA_ID id)
     return "unk";
 }
 
-std::vector<cv::KeyPoint> CameraPipeline::allKeypointsInImage(cv::Mat img_raw, bool output_debug)
+void CameraPipeline::prepareBuffers(const cv::Mat& img_raw)
+{
+    for (cv::Mat* buffer : {&camera_data_.undistorted_buffer, &camera_data_.thresh_buffer})
+    {
+        if(buffer->size() != img_raw.size() || buffer->type() != img_raw.type())
+        {
+            buffer->create(img_raw.size(), img_raw.type());
+            camera_data_.buffer_allocations++;
+        }
+    }
+    if(camera_data_.centroid_buffer.type() != img_raw.type())
+    {
+        camera_data_.centroid_buffer.create(2 * max_centroid_radius_px + 1, 2 * max_centroid_radius_px + 1, img_raw.type());
+        camera_data_.buffer_allocations++;
+    }
+    if(camera_data_.keypoints.capacity() < 10)
+    {
+        camera_data_.keypoints.reserve(10);
+        camera_data_.buffer_allocations++;
+    }
+    if(use_pyramid_)
+    {
+        const cv::Size coarse_size(img_raw.cols / pyramid_scale_, img_raw.rows / pyramid_scale_);
+        for (cv::Mat* buffer : {&camera_data_.coarse_buffer, &camera_data_.coarse_thresh_buffer})
+        {
+            if(buffer->size() != coarse_size || buffer->type() != img_raw.type())
+            {
+                buffer->create(coarse_size, img_raw.type());
+                camera_data_.buffer_allocations++;
+            }
+        }
+        if(camera_data_.candidates.capacity() < 10)
+        {
+            for (std::vector<cv::KeyPoint>* v : {&camera_data_.candidates, &camera_data_.window_keypoints}) v->reserve(10);
+            for (std::vector<cv::Point2f>* v : {&camera_data_.candidate_centers, &camera_data_.undistorted_centers}) v->reserve(10);
+            camera_data_.buffer_allocations++;
+        }
+    }
+}
+
+cv::Point2f CameraPipeline::refineCentroid(const cv::Mat& img_raw, const cv::KeyPoint& keypoint)
+{
+    // Window a bit bigger than the blob so the whole marker and its falloff are included
+    int radius = static_cast<int>(std::ceil(0.5f * keypoint.size * subpixel_window_scale_));
+    radius = std::max(2, std::min(radius, max_centroid_radius_px));
+    cv::Rect window(static_cast<int>(std::round(keypoint.pt.x)) - radius, static_cast<int>(std::round(keypoint.pt.y)) - radius, 2 * radius + 1, 2 * radius + 1);
+    window &= cv::Rect(0, 0, camera_data_.undistort_map_size.width, camera_data_.undistort_map_size.height);
+    if(window.empty()) return keypoint.pt;
+
+    // Undistort just the window, so this works the same whichever of remap and points mode produced the keypoint.
+    // LUT mode keypoints are raw pixels, so the centroid is taken on the raw window.
+    cv::Mat patch;
+    if(undistort_mode_ == UNDISTORT_MODE::LUT)
+    {
+        patch = img_raw(window);
+    }
+    else
+    {
+        patch = camera_data_.centroid_buffer(cv::Rect(0, 0, window.width, window.height));
+        cv::remap(img_raw, patch, camera_data_.undistort_map_1(window), camera_data_.undistort_map_2(window), cv::INTER_LINEAR);
+        checkBufferReused(patch, camera_data_.centroid_buffer);
+    }
+
+    // Weight by brightness above the detection threshold, so the background contributes nothing. Colour
+    // frames weight each channel like the per channel threshold does.
+    const int channels = patch.channels();
+    double sum_w = 0;
+    double sum_x = 0;
+    double sum_y = 0;
+    for (int y = 0; y < patch.rows; y++)
+    {
+        const uchar* row = patch.ptr<uchar>(y);
+        for (int x = 0; x < patch.cols; x++)
+        {
+            int w = 0;
+            for (int c = 0; c < channels; c++)
+            {
+                w += std::max(row[x * channels + c] - threshold_, 0);
+            }
+            if(w == 0) continue;
+            sum_w += w;
+            sum_x += w * x;
+            sum_y += w * y;
+        }
+    }
+    if(sum_w <= 0) return keypoint.pt;
+    return {static_cast<float>(window.x + sum_x / sum_w), static_cast<float>(window.y + sum_y / sum_w)};
+}
+
+void CameraPipeline::checkBufferReused(const cv::Mat& view, const cv::Mat& buffer)
+{
+    if(!view.empty() && view.data != buffer.data) camera_data_.buffer_allocations++;
+}
+
+void CameraPipeline::allKeypointsInImage(const cv::Mat& img_raw, bool output_debug, std::vector<cv::KeyPoint>& keypoints)
 {   
     // Timer t;
 
-    // Undistort and crop
+    // Undistort with the precomputed maps. In points only mode the full image is only undistorted for debug output.
+    if(img_raw.size() != camera_data_.undistort_map_size)
+    {
+        PLOGW.printf("Frame size changed for %s camera, recomputing undistortion maps", camera_data_.name.c_str());
+        initUndistortMaps(img_raw.size());
+    }
+    prepareBuffers(img_raw);
     cv::Mat img_undistorted;
-    cv::Rect validPixROI;
-    // PLOGI << "init memory time: " << t.dt_ms();
-    // t.reset();
-    cv::Mat newcameramtx = cv::getOptimalNewCameraMatrix(camera_data_.K, camera_data_.D, img_raw.size(), /*alpha=*/1, img_raw.size(), &validPixROI);
-    // PLOGI << "new camera time: " << t.dt_ms();
-    // t.reset();
-    cv::undistort(img_raw, img_undistorted, camera_data_.K, camera_data_.D);
+    cv::Mat img_thresh;
+    keypoints.clear();
 
-    // PLOGI << "undistort time: " << t.dt_ms();
-    // t.reset();
+    // In tracking mode only search around the last detection, and fall back to the full frame if the marker 
+    // isn't there. Debug output always uses the full frame.
+    if(use_roi_tracking_ && roi_valid_ && !output_debug)
+    {
+        cv::Rect roi = getTrackingRoi(img_raw.size());
+        if(!roi.empty()) keypointsInRegion(img_raw, roi, img_undistorted, img_thresh, keypoints);
+    }
+    if(keypoints.empty() && use_pyramid_ && !output_debug)
+    {
+        coarseToFineKeypoints(img_raw, img_undistorted, img_thresh, keypoints);
+    }
+    else if(keypoints.empty())
+    {
+        keypointsInRegion(img_raw, cv::Rect(0, 0, img_raw.cols, img_raw.rows), img_undistorted, img_thresh, keypoints);
+    }
+    roi_valid_ = !keypoints.empty();
 
-    // Threshold
-    cv::Mat img_thresh;
-    cv::threshold(img_undistorted, img_thresh, threshold_, 255, cv::THRESH_BINARY_INV);
-    // PLOGI <<" Threshold";
+    if(output_debug)
+    {
+        // Rendering and encoding happen on the writer thread, this only copies the images
+        cv::Point2f best_keypoint = getBestKeypoint(keypoints);
+        Eigen::Vector2f best_point_m = undistort_mode_ == UNDISTORT_MODE::LUT ? rawPixelToRobot(best_keypoint) : cameraToRobot(best_keypoint);
+        debug_writer_->submit(img_raw, img_undistorted, img_thresh, keypoints, best_keypoint, best_point_m);
+    }
 
-    // PLOGI << "threshold time: " << t.dt_ms();
+    // PLOGI << "debug time: " << t.dt_ms();
     // t.reset();
+}
 
-    // Blob detection
-    std::vector<cv::KeyPoint> keypoints;
-    keypoints.reserve(10);
-    // PLOGI << "blob memory time: " << t.dt_ms();
-    // t.reset();
-    blob_detector_->detect(img_thresh, keypoints);
-    // PLOGI <<"Num blobs " << keypoints.size();
+void CameraPipeline::keypointsInRegion(const cv::Mat& img_raw, cv::Rect roi, cv::Mat& img_undistorted, cv::Mat& img_thresh, std::vector<cv::KeyPoint>& keypoints)
+{
+    // Views into the preallocated buffers, which remap and threshold write into without allocating
+    cv::Rect buffer_roi(0, 0, roi.width, roi.height);
+    img_undistorted = camera_data_.undistorted_buffer(buffer_roi);
+    img_thresh = camera_data_.thresh_buffer(buffer_roi);
+
+    // The maps give the source pixel for each output pixel, so cropping them undistorts just the roi
+    const bool detect_on_raw = undistort_mode_ != UNDISTORT_MODE::REMAP;
+    bool need_undistorted_image = !detect_on_raw || output_debug_images_;
+    bool opencl = use_opencl_ && !detect_on_raw && !output_debug_images_;
+    bool fused = opencl || (use_fused_kernel_ && !detect_on_raw && !output_debug_images_);
+    {
+        // The fused kernels also threshold, all of it is counted as undistortion
+        TRACE_SCOPE(TRACE_POINT::CAMERA_UNDISTORT);
+        if(opencl)
+        {
+            // Only the thresholded roi comes back from the device
+            ocl_kernel_.apply(img_raw, img_thresh, threshold_, roi);
+        }
+        else if(fused)
+        {
+            // Interpolated image is never materialized, the kernel writes the thresholded roi directly
+            fused_kernel_.apply(img_raw, img_thresh, threshold_, roi);
+        }
+        else if(need_undistorted_image)
+        {
+            cv::remap(img_raw, img_undistorted, camera_data_.undistort_map_1(roi), camera_data_.undistort_map_2(roi), cv::INTER_LINEAR);
+        }
+    }
 
-    // PLOGI << "blob detect time: " << t.dt_ms();
-    // t.reset();
+    // Threshold
+    if(!fused)
+    {
+        TRACE_SCOPE(TRACE_POINT::CAMERA_THRESHOLD);
+        cv::threshold(detect_on_raw ? img_raw(roi) : img_undistorted, img_thresh, threshold_, 255, cv::THRESH_BINARY_INV);
+    }
+    if(need_undistorted_image && !fused) checkBufferReused(img_undistorted, camera_data_.undistorted_buffer);
+    checkBufferReused(img_thresh, camera_data_.thresh_buffer);
 
-    if(output_debug)
+    // Blob detection
+    // Markers are bright, so they are the zero pixels after the inverted threshold
+    {
+        TRACE_SCOPE(TRACE_POINT::CAMERA_DETECT);
+        if(component_detector_) component_detector_->detect(img_thresh, keypoints, 0);
+        else blob_detector_->detect(img_thresh, keypoints);
+    }
+    for (auto& k : keypoints)
+    {
+        k.pt.x += roi.x;
+        k.pt.y += roi.y;
+    }
+    if(!keypoints.empty()) roi_center_ = getBestKeypoint(keypoints);
+    if(undistort_mode_ == UNDISTORT_MODE::POINTS) undistortKeypoints(keypoints);
+}
+
+void CameraPipeline::coarseToFineKeypoints(const cv::Mat& img_raw, cv::Mat& img_undistorted, cv::Mat& img_thresh, std::vector<cv::KeyPoint>& keypoints)
+{
+    std::vector<cv::KeyPoint>& candidates = camera_data_.candidates;
     {
-        std::string debug_path = camera_data_.id == CAMERA_ID::SIDE ? 
-            cfg.lookup("vision_tracker.side.debug_output_path") :
-            cfg.lookup("vision_tracker.rear.debug_output_path");
-        cv::imwrite(debug_path + "img_raw.jpg", img_raw);
-        cv::imwrite(debug_path + "img_undistorted.jpg", img_undistorted);
-        cv::imwrite(debug_path + "img_thresh.jpg", img_thresh);
+        // The coarse frame is never undistorted, only the few candidate centers are when they need to be
+        TRACE_SCOPE(TRACE_POINT::CAMERA_COARSE);
+        cv::resize(img_raw, camera_data_.coarse_buffer, camera_data_.coarse_buffer.size(), 0, 0, cv::INTER_AREA);
+        cv::threshold(camera_data_.coarse_buffer, camera_data_.coarse_thresh_buffer, threshold_, 255, cv::THRESH_BINARY_INV);
+        if(coarse_component_detector_) coarse_component_detector_->detect(camera_data_.coarse_thresh_buffer, candidates, 0);
+        else coarse_blob_detector_->detect(camera_data_.coarse_thresh_buffer, candidates);
+    }
+    if(candidates.empty()) return;
 
-        cv::Mat img_with_keypoints;
-        cv::drawKeypoints(img_thresh, keypoints, img_with_keypoints, cv::Scalar(0,0,255), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
-        cv::imwrite(debug_path + "img_keypoints.jpg", img_with_keypoints);
+    TRACE_SCOPE(TRACE_POINT::CAMERA_REFINE);
+    std::sort(candidates.begin(), candidates.end(), [](const cv::KeyPoint& a, const cv::KeyPoint& b) { return a.size > b.size; });
+    if(static_cast<int>(candidates.size()) > pyramid_max_candidates_) candidates.resize(pyramid_max_candidates_);
 
-        cv::Mat img_with_best_keypoint = img_undistorted;
-        cv::Point2f best_keypoint = getBestKeypoint(keypoints);
-        cv::circle(img_with_best_keypoint, best_keypoint, 1, cv::Scalar(0,0,255), -1);
-        cv::circle(img_with_best_keypoint, best_keypoint, 10, cv::Scalar(0,0,255), 5);
-        Eigen::Vector2f best_point_m = cameraToRobot(best_keypoint);
-        std::string label_text = "Best:" + std::to_string(best_point_m[0]) +"m,"+ std::to_string(best_point_m[1]) + "m";
-        cv::putText(img_with_best_keypoint, //target image
-                    label_text, //text
-                    cv::Point(10, 20), //top-left position
-                    cv::FONT_HERSHEY_DUPLEX,
-                    0.5,
-                    CV_RGB(255,0,0), //font color
-                    1);
-        Eigen::Vector2f target_point_world;
-        if(camera_data_.id == CAMERA_ID::SIDE)
+    // A coarse pixel covers pyramid_scale_ full ones, so its center is half of that less half a pixel in
+    std::vector<cv::Point2f>& centers = camera_data_.candidate_centers;
+    centers.clear();
+    const float offset = 0.5f * (pyramid_scale_ - 1);
+    for (const cv::KeyPoint& candidate : candidates)
+    {
+        centers.emplace_back(candidate.pt.x * pyramid_scale_ + offset, candidate.pt.y * pyramid_scale_ + offset);
+    }
+    // Remap mode detects in undistorted coordinates, so that is where the windows have to be
+    if(undistort_mode_ == UNDISTORT_MODE::REMAP)
+    {
+        cv::undistortPoints(centers, camera_data_.undistorted_centers, camera_data_.K, camera_data_.D, cv::noArray(), camera_data_.K);
+        centers.swap(camera_data_.undistorted_centers);
+    }
+
+    const cv::Rect frame(0, 0, img_raw.cols, img_raw.rows);
+    float best_size = -1;
+    cv::Point2f best_center = roi_center_;
+    for (size_t i = 0; i < candidates.size() && i < centers.size(); i++)
+    {
+        // Windows overlapping one already searched would only find the same blob again
+        const cv::Point2f& center = centers[i];
+        bool searched = false;
+        for (const cv::KeyPoint& k : keypoints) searched |= std::hypot(k.pt.x - center.x, k.pt.y - center.y) < 0.5f * k.size + pyramid_margin_px_;
+        if(searched) continue;
+
+        const int half_size = static_cast<int>(std::ceil(0.5f * candidates[i].size * pyramid_scale_)) + pyramid_margin_px_;
+        cv::Rect window(static_cast<int>(center.x) - half_size, static_cast<int>(center.y) - half_size, 2 * half_size + 1, 2 * half_size + 1);
+        window &= frame;
+        if(window.empty()) continue;
+
+        std::vector<cv::KeyPoint>& window_keypoints = camera_data_.window_keypoints;
+        keypointsInRegion(img_raw, window, img_undistorted, img_thresh, window_keypoints);
+        if(window_keypoints.empty()) continue;
+        // keypointsInRegion leaves roi_center_ at this window's best, the tracking window follows the overall best
+        const float size = bestKeypoint(window_keypoints).size;
+        if(size > best_size)
         {
-            target_point_world << float(cfg.lookup("vision_tracker.physical.side.target_x")), float(cfg.lookup("vision_tracker.physical.side.target_y"));
+            best_size = size;
+            best_center = roi_center_;
         }
-        else 
+        keypoints.insert(keypoints.end(), window_keypoints.begin(), window_keypoints.end());
+    }
+    roi_center_ = best_center;
+}
+
+cv::Rect CameraPipeline::getTrackingRoi(cv::Size image_size)
+{
+    int x = static_cast<int>(roi_center_.x) - roi_half_size_px_;
+    int y = static_cast<int>(roi_center_.y) - roi_half_size_px_;
+    cv::Rect roi(x, y, 2 * roi_half_size_px_, 2 * roi_half_size_px_);
+    return roi & cv::Rect(0, 0, image_size.width, image_size.height);
+}
+
+ClockTimePoint CameraPipeline::getCaptureTime()
+{
+    ClockTimePoint grab_time = ClockFactory::getFactoryInstance()->get_clock()->now();
+    if(!use_capture_timestamp_) return grab_time;
+
+    // Both backends report the driver buffer timestamp, which is taken from CLOCK_MONOTONIC like steady_clock
+    double capture_ms = camera_data_.capture_timestamp_ms;
+    ClockTimePoint capture_time(std::chrono::duration_cast<ClockTimePoint::duration>(std::chrono::duration<double, std::milli>(capture_ms)));
+    
+    // Anything implausible means the backend isn't giving monotonic timestamps, so fall back to when the frame was grabbed
+    if(capture_ms <= 0 || capture_time > grab_time || grab_time - capture_time > std::chrono::seconds(1))
+    {
+        if(!capture_timestamp_warned_)
         {
-            target_point_world << float(cfg.lookup("vision_tracker.physical.rear.target_x")), float(cfg.lookup("vision_tracker.physical.rear.target_y"));
+            PLOGW.printf("%s camera capture timestamps unusable, using grab time", camera_data_.name.c_str());
+            capture_timestamp_warned_ = true;
         }
-        Eigen::Vector2f target_point_camera = robotToCamera(target_point_world);
-        cv::Point2f pt{target_point_camera[0], target_point_camera[1]};
-        cv::circle(img_with_best_keypoint, pt, 5, cv::Scalar(255,0,0), -1);
-        std::string label_text2 = "Target:" + std::to_string(target_point_camera[0]) +"px, "+ std::to_string(target_point_camera[1]) + "px";
-        cv::putText(img_with_best_keypoint, //target image
-                    label_text2, //text
-                    cv::Point(10, 40), //top-left position
-                    cv::FONT_HERSHEY_DUPLEX,
-                    0.5,
-                    CV_RGB(0,0,255), //font color
-                    1);
-
-        cv::imwrite(debug_path + "img_best_keypoint.jpg", img_with_best_keypoint);
-        PLOGI.printf("Writing debug images %s",cameraIdToString(camera_data_.id).c_str());
+        return grab_time;
     }
+    return capture_time;
+}
 
-    // PLOGI << "debug time: " << t.dt_ms();
-    // t.reset();
-
-    return keypoints;
+void CameraPipeline::captureFrame(cv::Mat& frame)
+{
+    TRACE_SCOPE(TRACE_POINT::CAMERA_CAPTURE);
+    // Same as VideoCapture, a failed read leaves an empty frame
+    if(camera_data_.v4l2.isOpened())
+    {
+        if(!camera_data_.v4l2.grab(frame, &camera_data_.capture_timestamp_ms)) frame.release();
+    }
+    else if(camera_data_.grabber)
+    {
+        if(!camera_data_.grabber->take(frame, &camera_data_.capture_timestamp_ms)) frame.release();
+    }
+    else
+    {
+        camera_data_.capture >> frame;
+        camera_data_.capture_timestamp_ms = camera_data_.capture.get(cv::CAP_PROP_POS_MSEC);
+    }
 }
 
 void CameraPipeline::start()
 {
+    open();
     if(!thread_running_)
     {
-        PLOGI.printf("Starting %s camera thread",cameraIdToString(camera_data_.id).c_str());
+        PLOGI.printf("Starting %s camera thread",camera_data_.name.c_str());
         thread_running_ = true;
         thread_ = std::thread(&CameraPipeline::threadLoop, this);
         // thread_.detach();
@@ -286,7 +740,7 @@ void CameraPipeline::stop()
 {
     if(thread_running_)
     {
-        PLOGI.printf("Stopping %s camera thread",cameraIdToString(camera_data_.id).c_str());
+        PLOGI.printf("Stopping %s camera thread",camera_data_.name.c_str());
         thread_running_ = false;
         thread_.join();
     }
@@ -302,95 +756,130 @@ void CameraPipeline::threadLoop()
 
 void CameraPipeline::oneLoop()
 {
-    Eigen::Vector2f best_point_m = {0,0};
+    Eigen::Vector2f points_m[MAX_MARKER_POINTS];
+    int num_points = 0;
     cv::Point2f best_point_px = {0,0};
     bool detected = false;
+    ClockTimePoint frame_time = ClockFactory::getFactoryInstance()->get_clock()->now();
+    open();
     try
     {
 
-        // Get latest frame
-        cv::Mat frame;
-        if (use_debug_image_) frame = camera_data_.debug_frame;
-        else camera_data_.capture >> frame;
+        // Get latest frame. The capture decodes into the same buffer as long as the format doesn't change.
+        cv::Mat& frame = camera_data_.frame;
+        if (use_debug_image_) 
+        {
+            frame = camera_data_.debug_frame;
+            frame_time = ClockFactory::getFactoryInstance()->get_clock()->now();
+        }
+        else 
+        {
+            // Zero copy v4l2 frames and grabber frames rotate between fixed buffers, that isn't an allocation
+            if(requested_profile_ != applied_profile_) applyProfile(static_cast<CAMERA_PROFILE>(requested_profile_.load()));
+            const uchar* previous_data = frame.data;
+            captureFrame(frame);
+            bool rotating_buffers = camera_data_.v4l2.zeroCopy() || camera_data_.grabber;
+            if(frame.data != previous_data && !rotating_buffers) camera_data_.buffer_allocations++;
+            frame_time = getCaptureTime();
+        }
 
         // Perform keypoint detection
-        std::vector<cv::KeyPoint> keypoints = allKeypointsInImage(frame, output_debug_images_);
+        std::vector<cv::KeyPoint>& keypoints = camera_data_.keypoints;
+        allKeypointsInImage(frame, output_debug_images_, keypoints);
 
         // Do post-processing if the detection was successful
         detected = !keypoints.empty();
         if(detected) 
         {
-            best_point_px = getBestKeypoint(keypoints);
-            best_point_m = cameraToRobot(best_point_px);
-
+            // The largest blobs are the marker, as many of them as its pattern has, with the largest first
+            const auto larger = [](const cv::KeyPoint& a, const cv::KeyPoint& b) { return a.size > b.size; };
+            std::iter_swap(keypoints.begin(), std::min_element(keypoints.begin(), keypoints.end(), larger));
+            num_points = std::min(marker_points_, static_cast<int>(keypoints.size()));
+            std::partial_sort(keypoints.begin() + 1, keypoints.begin() + num_points, keypoints.end(), larger);
+            for (int i = 0; i < num_points; i++)
+            {
+                cv::Point2f point_px = keypoints[i].pt;
+                if(use_subpixel_) 
+                {
+                    TRACE_SCOPE(TRACE_POINT::CAMERA_DETECT);
+                    point_px = refineCentroid(frame, keypoints[i]);
+                }
+                points_m[i] = undistort_mode_ == UNDISTORT_MODE::LUT ? rawPixelToRobot(point_px) : cameraToRobot(point_px);
+                if(i == 0) best_point_px = point_px;
+            }
         }
     }
     catch (cv::Exception& e)
     {
         PLOGW << "Caught cv::Exception: " << e.what();
         detected = false;
-        best_point_m = {0,0};
+        num_points = 0;
         best_point_px = {0,0};
     }
     
 
-    // Update output values in thread-safe manner
+    // Publish without blocking, the reader picks up whatever is newest
+    PublishedOutput published;
+    published.seq = ++output_seq_;
+    published.ok = detected;
+    published.timestamp = frame_time;
+    published.point_x = num_points > 0 ? points_m[0][0] : 0;
+    published.point_y = num_points > 0 ? points_m[0][1] : 0;
+    published.u = best_point_px.x;
+    published.v = best_point_px.y;
+    published.num_points = num_points;
+    for (int i = 0; i < num_points; i++)
+    {
+        published.points[2 * i] = points_m[i][0];
+        published.points[2 * i + 1] = points_m[i][1];
+    }
+    published.buffer_allocations = camera_data_.buffer_allocations;
+    published.latency_ms = std::chrono::duration<float, std::milli>(ClockFactory::getFactoryInstance()->get_clock()->now() - frame_time).count();
+    output_mailbox_.write(published);
+    if(output_notify_fd_ >= 0)
     {
-        std::lock_guard<std::mutex> read_lock(data_mutex);
-        current_output_.ok = detected;
-        current_output_.timestamp = ClockFactory::getFactoryInstance()->get_clock()->now();
-        current_output_.point = best_point_m;
-        current_output_.uv = {best_point_px.x, best_point_px.y};
+        uint64_t one = 1;
+        if(write(output_notify_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) PLOGW << "Could not signal new camera output: " << strerror(errno);
     }
 }
 
 CameraPipelineOutput CameraPipeline::getData()
 {
-    std::lock_guard<std::mutex> read_lock(data_mutex);
-    CameraPipelineOutput output = current_output_;
-    current_output_.ok = false;
+    PublishedOutput published = output_mailbox_.read();
+    CameraPipelineOutput output;
+    // Each output is only reported ok once, matching up repeated reads of the same frame by sequence number
+    output.ok = published.ok && published.seq != last_read_seq_;
+    output.timestamp = published.timestamp;
+    output.point = {published.point_x, published.point_y};
+    output.uv = {published.u, published.v};
+    output.num_points = published.num_points;
+    for (int i = 0; i < published.num_points; i++)
+    {
+        output.points[i] = {published.points[2 * i], published.points[2 * i + 1]};
+    }
+    output.buffer_allocations = published.buffer_allocations;
+    output.latency_ms = published.latency_ms;
+    last_read_seq_ = published.seq;
     return output;
 }
 
 Eigen::Vector2f CameraPipeline::cameraToRobot(cv::Point2f cameraPt)
 {
-    Eigen::Vector3f uv_point = {cameraPt.x, cameraPt.y, 1};
-
-    // Compute scaling factor for Z=0
-    Eigen::Vector3f tmp1 = camera_data_.R_inv * camera_data_.K_inv * uv_point;
-    Eigen::Vector3f tmp2 = camera_data_.R_inv * camera_data_.t;
-    float s = tmp2(2,0) / tmp1(2,0);
-
-    // Debug
-    Eigen::Vector3f scaled_cam_frame = s * camera_data_.K_inv * uv_point;
-    Eigen::Vector3f cam_frame_offset = scaled_cam_frame  - camera_data_.t;
-
-    // Convert to world coordinate
-    Eigen::Vector3f world_point = camera_data_.R_inv * cam_frame_offset;
-    // PLOGI << cameraIdToString(id);
-    // PLOGI << "uv_point: " << uv_point.transpose();
-    // PLOGI << "scaled_cam_frame: " << scaled_cam_frame.transpose();
-    // PLOGI << "cam_frame_offset: " << cam_frame_offset.transpose();
-    // PLOGI << "world_point: " << world_point.transpose();
-
-
-    if(fabs(world_point(2)) > 1e-3) PLOGE.printf("Z value %f is not near zero", world_point(2));
-
-    return {world_point(0),world_point(1)};
+    const Eigen::Vector3f ground = camera_data_.ground_from_pixel * Eigen::Vector3f(cameraPt.x, cameraPt.y, 1);
+    return {ground[0] / ground[2], ground[1] / ground[2]};
 }
 
 Eigen::Vector2f CameraPipeline::robotToCamera(Eigen::Vector2f robotPt)
 {
-    Eigen::Vector4f robot_point_3d = {robotPt[0], robotPt[1], 0, 1};
-    Eigen::MatrixXf r_t(3,4);
-    r_t << camera_data_.R, camera_data_.t;
-
-    Eigen::Matrix3f K_tmp;
-    // Hack to get around problems with enabling eigen support in opencv
-    K_tmp << camera_data_.K.at<double>(0,0), camera_data_.K.at<double>(0,1), camera_data_.K.at<double>(0,2),
-           camera_data_.K.at<double>(1,0), camera_data_.K.at<double>(1,1), camera_data_.K.at<double>(1,2),
-           camera_data_.K.at<double>(2,0), camera_data_.K.at<double>(2,1), camera_data_.K.at<double>(2,2);
-
-    Eigen::Vector3f camera_pt_scaled = K_tmp * r_t * robot_point_3d;
+    const Eigen::Vector3f camera_pt_scaled = camera_data_.pixel_from_ground * Eigen::Vector3f(robotPt[0], robotPt[1], 1);
     return {camera_pt_scaled[0]/camera_pt_scaled[2], camera_pt_scaled[1]/camera_pt_scaled[2]};
+}
+
+Eigen::Vector2f CameraPipeline::rawPixelToRobot(cv::Point2f rawPt)
+{
+    if(camera_data_.ground_lut.ready()) return camera_data_.ground_lut.lookup(rawPt);
+    std::vector<cv::Point2f> distorted = {rawPt};
+    std::vector<cv::Point2f> undistorted;
+    cv::undistortPoints(distorted, undistorted, camera_data_.K, camera_data_.D, cv::noArray(), camera_data_.K);
+    return cameraToRobot(undistorted.front());
 }
\ No newline at end of file
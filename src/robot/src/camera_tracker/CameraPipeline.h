@@ -2,23 +2,45 @@
 #define CameraPipeline_h
 
 #include "utils.h"
+#include "Mailbox.h"
+#include "ComponentMarkerDetector.h"
+#include "DebugImageWriter.h"
+#include "FusedUndistortThreshold.h"
+#include "OclUndistortThreshold.h"
+#include "GroundLut.h"
+#include "V4l2Capture.h"
+#include "LatestFrameGrabber.h"
+#include "CameraTrackerBase.h"
 #include <opencv2/opencv.hpp>
 #include <Eigen/Dense>
 #include <thread>
 #include <atomic>
 
+// The original two cameras, any camera can also be built by its vision_tracker config group name
 enum class CAMERA_ID
 {
     REAR,
     SIDE
 };
 
+// How detections get from the distorted frame to the robot frame, vision_tracker.detection.undistort_mode
+enum class UNDISTORT_MODE
+{
+    REMAP,          // Whole image undistorted with the precomputed maps before detection
+    POINTS,         // Detection on the raw image, the blob centers are undistorted
+    LUT,            // Detection on the raw image, the best blob center is looked up in the GroundLut
+};
+
 struct CameraPipelineOutput
 {
   bool ok = false;
-  ClockTimePoint timestamp = ClockFactory::getFactoryInstance()->get_clock()->now();
+  ClockTimePoint timestamp = ClockFactory::getFactoryInstance()->get_clock()->now();   // When the frame was captured
   Eigen::Vector2f point = {0,0};
-  Eigen::Vector2f uv = {0,0};
+  Eigen::Vector2f uv = {0,0};       // Undistorted pixel, or the raw one in LUT mode
+  int num_points = 0;               // Marker pattern blobs found, largest first. point is the first of them.
+  Eigen::Vector2f points[MAX_MARKER_POINTS];
+  uint32_t buffer_allocations = 0;
+  float latency_ms = 0;             // From frame capture to this output being published
 };
 
 class CameraPipeline 
@@ -27,10 +49,21 @@ class CameraPipeline
 
     CameraPipeline(CAMERA_ID id, bool start_thread);
 
+    // Camera described by vision_tracker.<name> and vision_tracker.physical.<name>
+    CameraPipeline(const std::string& name, bool start_thread);
+
     ~CameraPipeline();
 
+    // Latest output, never blocks the capture thread. ok is only set the first time a given output is returned.
+    // Must only be called from one thread.
     CameraPipelineOutput getData();
 
+    // Opens the capture, or loads the debug image, and builds the undistortion maps. Only the calibration is
+    // loaded on construction, the camera is opened on the first call to this, start() or oneLoop().
+    void open();
+
+    bool isOpen() const { return opened_; }
+
     void start();
 
     void stop();
@@ -39,45 +72,188 @@ class CameraPipeline
 
     void toggleDebugImageOutput() {output_debug_images_ = !output_debug_images_;};
 
+    // Switches to the vision_tracker.profiles capture settings for profile. Applied by the thread running
+    // oneLoop before it reads the next frame, does nothing with profiles disabled.
+    void setProfile(CAMERA_PROFILE profile) { requested_profile_ = static_cast<int>(profile); }
+
+    // Undistorted pixel to the ground point it sees in the robot frame
     Eigen::Vector2f cameraToRobot(cv::Point2f cameraPt);
 
     Eigen::Vector2f robotToCamera(Eigen::Vector2f robotPt);
+
+    // Raw pixel to the ground point, through the lookup table in LUT mode and by undistorting it otherwise
+    Eigen::Vector2f rawPixelToRobot(cv::Point2f rawPt);
+
+    const std::string& name() const { return camera_data_.name; }
+
+    // Descriptor that polls readable when oneLoop has a new frame to process without waiting, or -1 if the
+    // capture can't be polled and oneLoop should just be run once per frame period
+    int frameReadyFd() const { return camera_data_.grabber ? camera_data_.grabber->readyFd() : camera_data_.v4l2.fd(); }
+
+    float framePeriodS() const { return 1.0f / camera_data_.fps; }
+
+    // eventfd that is signalled every time oneLoop publishes an output, -1 for none. Set before starting.
+    void setOutputNotifyFd(int fd) { output_notify_fd_ = fd; }
+
+    static std::string cameraIdToString(CAMERA_ID id);
   
   private:
 
     struct CameraData 
     {
-      CAMERA_ID id;
+      std::string name;
       cv::VideoCapture capture;
+      V4l2Capture v4l2;             // Used instead of capture if open
+      std::unique_ptr<LatestFrameGrabber> grabber;    // Reads capture on its own thread if set
+      double capture_timestamp_ms = 0;  // Driver timestamp of the last frame
       cv::Mat K;
-      Eigen::Matrix3f K_inv;
       cv::Mat D;
+      cv::Mat undistort_map_1;      // Fixed point undistortion maps computed once in initCamera
+      cv::Mat undistort_map_2;
+      cv::Size undistort_map_size;
+      GroundLut ground_lut;         // Built with the maps in LUT mode
+      float fps = 30;               // Nominal until the capture is open
+      float lever_arm;              // Distance (meters) from robot origin to the camera, used for ROI sizing
       Eigen::Matrix3f R;
-      Eigen::Matrix3f R_inv;
       Eigen::Vector3f t;
+      Eigen::Matrix3f pixel_from_ground;    // Homography between the ground plane and undistorted pixels, K * [r1 r2 t]
+      Eigen::Matrix3f ground_from_pixel;
       cv::Mat debug_frame;
       std::string debug_output_path;
+
+      // Working buffers reused every frame. Results for a roi are written to views at the top left
+      // of the full frame buffers so tracking windows of different sizes don't reallocate.
+      cv::Mat frame;
+      cv::Mat undistorted_buffer;
+      cv::Mat thresh_buffer;
+      cv::Mat centroid_buffer;      // Undistorted patch around the best keypoint for subpixel refinement
+      cv::Mat coarse_buffer;        // Downsampled frame and its threshold for the pyramid search
+      cv::Mat coarse_thresh_buffer;
+      std::vector<cv::KeyPoint> keypoints;
+      std::vector<cv::KeyPoint> candidates;         // Pyramid search blobs, in coarse pixels
+      std::vector<cv::KeyPoint> window_keypoints;   // Detections in one candidate window
+      std::vector<cv::Point2f> candidate_centers;   // Full resolution raw pixels, and undistorted for remap mode
+      std::vector<cv::Point2f> undistorted_centers;
+      uint32_t buffer_allocations = 0;    // Times any working buffer was (re)allocated
+    };
+
+    // Capture settings of one CAMERA_PROFILE
+    struct CaptureProfile
+    {
+      int fps;
+      bool auto_exposure;
+      int exposure_us;              // Only used with auto_exposure off
+      int gain;                     // -1 leaves the driver's gain alone
+      std::vector<int> controls;    // V4L2 control id and value pairs for anything else, e.g. sensor binning
     };
 
     void threadLoop();
 
-    std::string cameraIdToString(CAMERA_ID id);
-    
-    void initCamera(CAMERA_ID id);
+    // Puts the profile's settings on the open capture without reopening it, then resizes the tracking window
+    // for the frame rate it ended up with
+    void applyProfile(CAMERA_PROFILE profile);
+
+    // Sizes the tracking window from how far the marker can move in one frame at vision max velocity
+    void sizeTrackingRoi();
+
+    void initCamera(const std::string& name);
+
+    // Undistortion maps, and in LUT mode the ground lookup table, for frames of image_size
+    void initUndistortMaps(cv::Size image_size);
+
+    // Undistorts keypoint centers in place. Used when the full image is not undistorted.
+    void undistortKeypoints(std::vector<cv::KeyPoint>& keypoints);
+
+    // Fills keypoints with all detections in img_raw, reusing the working buffers in camera_data_
+    void allKeypointsInImage(const cv::Mat& img_raw, bool output_debug, std::vector<cv::KeyPoint>& keypoints);
+
+    // Undistort, threshold and run blob detection within roi. Keypoints are returned in full frame coordinates.
+    void keypointsInRegion(const cv::Mat& img_raw, cv::Rect roi, cv::Mat& img_undistorted, cv::Mat& img_thresh, std::vector<cv::KeyPoint>& keypoints);
+
+    // Finds candidate blobs on the frame downsampled by pyramid_scale_, then runs keypointsInRegion only in a
+    // window around each of them, so a frame without the marker costs a fraction of a full frame search
+    void coarseToFineKeypoints(const cv::Mat& img_raw, cv::Mat& img_undistorted, cv::Mat& img_thresh, std::vector<cv::KeyPoint>& keypoints);
 
-    std::vector<cv::KeyPoint> allKeypointsInImage(cv::Mat img_raw, bool output_debug);
+    // Makes sure the full frame working buffers match the frame format, counting any allocation
+    void prepareBuffers(const cv::Mat& img_raw);
+
+    // Counts an allocation if a view that should have been written in place ended up with its own memory
+    void checkBufferReused(const cv::Mat& view, const cv::Mat& buffer);
+
+    // Intensity weighted centroid of the marker around keypoint, on an undistorted patch of img_raw. Returns the
+    // keypoint location if nothing in the window is above the threshold.
+    cv::Point2f refineCentroid(const cv::Mat& img_raw, const cv::KeyPoint& keypoint);
+
+    // Search window around the last detection
+    cv::Rect getTrackingRoi(cv::Size image_size);
+
+    // Reads the next frame from whichever capture backend is open
+    void captureFrame(cv::Mat& frame);
+
+    // When the frame just read from the capture was exposed, or when it was grabbed if the driver timestamp is unusable
+    ClockTimePoint getCaptureTime();
 
     CameraData camera_data_;
+    bool opened_;
     bool use_debug_image_;
     std::atomic<bool> output_debug_images_;
     std::atomic<bool> thread_running_;
     std::thread thread_;
-    CameraPipelineOutput current_output_;
+
+    // Plain copy of CameraPipelineOutput for the seqlock mailbox, Eigen types aren't trivially copyable
+    struct PublishedOutput
+    {
+      uint32_t seq;
+      bool ok;
+      ClockTimePoint timestamp;
+      float point_x;
+      float point_y;
+      float u;
+      float v;
+      int num_points;
+      float points[2 * MAX_MARKER_POINTS];
+      uint32_t buffer_allocations;
+      float latency_ms;
+    };
+    LatestValueMailbox<PublishedOutput> output_mailbox_;
+    uint32_t output_seq_;       // Only touched by the thread running oneLoop
+    uint32_t last_read_seq_;    // Only touched by the thread calling getData
+    int output_notify_fd_;
+    std::unique_ptr<DebugImageWriter> debug_writer_;
 
     // Params read from config
     cv::SimpleBlobDetector::Params blob_params_;
     cv::Ptr<cv::SimpleBlobDetector> blob_detector_;
+    std::unique_ptr<ComponentMarkerDetector> component_detector_;    // Used instead of blob_detector_ if set
+    cv::Ptr<cv::SimpleBlobDetector> coarse_blob_detector_;          // Same limits scaled to the pyramid frame
+    std::unique_ptr<ComponentMarkerDetector> coarse_component_detector_;
     int threshold_;
+    UNDISTORT_MODE undistort_mode_;
+    bool use_fused_kernel_;
+    FusedUndistortThreshold fused_kernel_;
+    bool use_opencl_;
+    OclUndistortThreshold ocl_kernel_;
+    bool use_capture_timestamp_;
+    bool use_subpixel_;
+    float subpixel_window_scale_;
+    bool capture_timestamp_warned_;
+    bool use_pyramid_;
+    int pyramid_scale_;           // Full resolution pixels per coarse pixel across
+    int pyramid_margin_px_;
+    int pyramid_max_candidates_;
+    bool use_profiles_;
+    CaptureProfile profiles_[2];  // By CAMERA_PROFILE
+    std::atomic<int> requested_profile_;
+    int applied_profile_;         // -1 until the camera is open
+    int marker_points_;           // Blobs in this camera's marker pattern, 1 for a single marker
+    float pattern_span_px_;       // Farthest any pattern blob can be from the largest one
+    bool use_roi_tracking_;
+    int roi_half_size_px_;
+    float roi_motion_m_per_s_;    // Fastest the marker moves at vision max velocity
+    float roi_motion_scale_;
+    int roi_margin_px_;
+    bool roi_valid_;
+    cv::Point2f roi_center_;      // Last detection in the coordinates detection ran in (distorted in points and LUT modes)
     float pixels_per_meter_u_;
     float pixels_per_meter_v_;
 };
@@ -2,136 +2,554 @@
 
 #include <plog/Log.h>
 #include "constants.h"
+#include "InputRecorder.h"
+#include "Se2.h"
+#include <algorithm>
+#include <errno.h>
+#include <future>
+#include <limits>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 constexpr int num_samples_to_average = 10;
 
+namespace
+{
+    // Longest the fusion thread sleeps without an output, bounds how long stop takes
+    constexpr int max_poll_ms = 100;
+
+    void signalFd(int fd)
+    {
+        uint64_t one = 1;
+        if(fd >= 0 && write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) PLOGW << "Could not signal camera pose: " << strerror(errno);
+    }
+
+    void drainFd(int fd)
+    {
+        uint64_t count;
+        ssize_t n = read(fd, &count, sizeof(count));
+        (void) n;
+    }
+
+    int configuredCameraCount()
+    {
+        return std::min(cfg.lookup("vision_tracker.cameras").getLength(), MAX_CAMERAS);
+    }
+}
+
 CameraTracker::CameraTracker(bool start_thread)
 : camera_loop_time_averager_(num_samples_to_average),
-  rear_cam_(CAMERA_ID::REAR, start_thread),
-  side_cam_(CAMERA_ID::SIDE, start_thread),
+  debug_(),
+  cameras_(),
+  side_index_(-1),
+  rear_index_(-1),
+  min_cameras_(std::max(int(cfg.lookup("vision_tracker.pairing.min_cameras")), 2)),
   output_({{0,0,0}, false, ClockFactory::getFactoryInstance()->get_clock()->now(), false}),
-  last_rear_cam_output_(),
-  last_side_cam_output_(),
-  side_cam_ok_filter_(0.5),
-  rear_cam_ok_filter_(0.5),
-  both_cams_ok_filter_(0.5),
-  running_(false)
+  frame_pairer_(cfg.lookup("vision_tracker.pairing.history_size"), cfg.lookup("vision_tracker.pairing.max_skew_ms"), configuredCameraCount(),
+                cfg.lookup("vision_tracker.pairing.single_camera_wait_ms")),
+  pattern_match_radius_(cfg.lookup("vision_tracker.pairing.pattern_match_radius")),
+  pose_ok_filter_(0.5),
+  executor_(),
+  running_(false),
+  use_fusion_thread_(cfg.lookup("vision_tracker.fusion_thread")),
+  output_ready_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  pose_ready_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  output_mailbox_(),
+  debug_mailbox_(),
+  reduced_fps_(cfg.lookup("vision_tracker.degrade.reduced_fps")),
+  minimal_fps_(cfg.lookup("vision_tracker.degrade.minimal_fps")),
+  degrade_level_(static_cast<int>(VISION_DEGRADE::NONE)),
+  degrade_paused_(0),
+  paused_mask_(0),
+  use_duty_cycle_(cfg.lookup("vision_tracker.duty_cycle.enabled")),
+  idle_fps_(cfg.lookup("vision_tracker.duty_cycle.idle_fps")),
+  demand_mask_(static_cast<bool>(cfg.lookup("vision_tracker.debug.save_camera_debug")) ? 1u << static_cast<int>(CAMERA_CONSUMER::DEBUG) : 0),
+  camera_profile_(static_cast<int>(CAMERA_PROFILE::IDLE)),
+  fusion_thread_running_(false),
+  fusion_thread_()
 {
-    // Target points
-    robot_P_side_target_ = {cfg.lookup("vision_tracker.physical.side.target_x"), 
-                            cfg.lookup("vision_tracker.physical.side.target_y")};
-    robot_P_rear_target_ = {cfg.lookup("vision_tracker.physical.rear.target_x"), 
-                            cfg.lookup("vision_tracker.physical.rear.target_y")};
+    if(output_ready_fd_ < 0 || pose_ready_fd_ < 0)
+    {
+        PLOGE << "Could not create camera tracker eventfds, fusing from update() instead: " << strerror(errno);
+        use_fusion_thread_ = false;
+    }
+
+    const libconfig::Setting& camera_names = cfg.lookup("vision_tracker.cameras");
+    if(camera_names.getLength() > MAX_CAMERAS) PLOGE.printf("%i cameras configured, only using the first %i", camera_names.getLength(), MAX_CAMERAS);
+    const int num_cameras = configuredCameraCount();
+    cameras_.reserve(num_cameras);
+    for (int i = 0; i < num_cameras; i++)
+    {
+        std::string name = camera_names[i];
+        std::string physical = "vision_tracker.physical." + name;
+        cameras_.push_back({std::make_unique<CameraPipeline>(name, /*start_thread=*/ false),
+                            {cfg.lookup(physical + ".target_x"), cfg.lookup(physical + ".target_y")},
+                            {},
+                            0,
+                            cfg.lookup(physical + ".weight"),
+                            LatchedBool(0.5),
+                            CameraPipelineOutput()});
+        // Same as the pipeline, a pattern of fewer than two blobs is the single marker at the target
+        Camera& camera = cameras_.back();
+        const libconfig::Setting& pattern = cfg.lookup(physical + ".pattern");
+        camera.pattern_size = std::min(pattern.getLength() / 2, MAX_MARKER_POINTS);
+        for (int j = 0; j < camera.pattern_size; j++)
+        {
+            camera.pattern[j] = {pattern[2 * j], pattern[2 * j + 1]};
+        }
+        if(camera.pattern_size < 2)
+        {
+            camera.pattern_size = 1;
+            camera.pattern[0] = camera.target;
+        }
+    }
+    if(num_cameras < min_cameras_) PLOGE.printf("Only %i cameras configured, %i are needed for a pose", num_cameras, min_cameras_);
+    side_index_ = cameraIndex("side");
+    rear_index_ = cameraIndex("rear");
+    debug_.num_cameras = num_cameras;
+
+    // Pipelines share a few workers instead of each spinning its own thread
+    const libconfig::Setting& worker_cpus_setting = cfg.lookup("vision_tracker.executor.worker_cpus");
+    std::vector<int> worker_cpus;
+    for (int i = 0; i < worker_cpus_setting.getLength(); i++)
+    {
+        worker_cpus.push_back(worker_cpus_setting[i]);
+    }
+    executor_ = std::make_unique<CameraExecutor>(cfg.lookup("vision_tracker.executor.workers"), worker_cpus, 
+                                                 cfg.lookup("vision_tracker.executor.max_cpu_cores"));
+    for (Camera& camera : cameras_)
+    {
+        if(use_fusion_thread_) camera.pipeline->setOutputNotifyFd(output_ready_fd_);
+        executor_->add(camera.pipeline.get());
+    }
+    output_mailbox_.write(output_);
+    debug_mailbox_.write(debug_);
+    if(start_thread) start();
 }
 
-CameraTracker::~CameraTracker() {}
+CameraTracker::~CameraTracker()
+{
+    stop();
+    if(output_ready_fd_ >= 0) close(output_ready_fd_);
+    if(pose_ready_fd_ >= 0) close(pose_ready_fd_);
+}
+
+int CameraTracker::cameraIndex(const std::string& name)
+{
+    for (size_t i = 0; i < cameras_.size(); i++)
+    {
+        if(cameras_[i].pipeline->name() == name) return i;
+    }
+    return -1;
+}
 
 void CameraTracker::update()
 {
-    CameraPipelineOutput side_output = side_cam_.getData();
-    CameraPipelineOutput rear_output = rear_cam_.getData();
-    output_.raw_detection = side_output.ok && rear_output.ok;
-    debug_.side_ok = side_cam_ok_filter_.update(side_output.ok);
-    debug_.rear_ok = rear_cam_ok_filter_.update(rear_output.ok);
-    bool new_output_pose_ready = false;
+    // The fusion thread already picks up every output as it is published
+    if(!fusion_thread_running_) fuseAndPublish();
+}
 
-    if(rear_output.ok)
+void CameraTracker::fuseAndPublish()
+{
+    bool new_pose = fuse();
+    output_mailbox_.write(output_);
+    debug_mailbox_.write(debug_);
+    if(new_pose) signalFd(pose_ready_fd_);
+}
+
+void CameraTracker::fusionLoop()
+{
+    pollfd pfd = {output_ready_fd_, POLLIN, 0};
+    while(fusion_thread_running_)
+    {
+        int r = poll(&pfd, 1, max_poll_ms);
+        if(r < 0 && errno != EINTR)
+        {
+            PLOGE << "Camera fusion poll failed: " << strerror(errno);
+            std::this_thread::sleep_for(std::chrono::milliseconds(max_poll_ms));
+            continue;
+        }
+        if(r <= 0) continue;
+        drainFd(output_ready_fd_);
+        fuseAndPublish();
+    }
+}
+
+bool CameraTracker::fuse()
+{
+    int num_ok = 0;
+    int num_standalone = 0;
+    debug_.degrade_level = degrade_level_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < cameras_.size(); i++)
+    {
+        Camera& camera = cameras_[i];
+        CameraPipelineOutput output = camera.pipeline->getData();
+        CameraHealth& health = debug_.cameras[i];
+        health.ok = camera.ok_filter.update(output.ok);
+        health.buffer_allocations = output.buffer_allocations;
+        health.paused = paused_mask_.load(std::memory_order_relaxed) & (1u << i);
+        if(output.ok)
+        {
+            health.latency_ms = output.latency_ms;
+            health.detections++;
+            num_ok++;
+            if(camera.pattern_size > 1 && output.num_points >= 2) num_standalone++;
+        }
+        frame_pairer_.add(i, output);
+    }
+    output_.raw_detection = num_ok >= min_cameras_ || num_standalone > 0;
+    if(side_index_ >= 0)
     {
-        last_rear_cam_output_ = rear_output;
+        debug_.side_ok = debug_.cameras[side_index_].ok;
+        debug_.side_buffer_allocations = debug_.cameras[side_index_].buffer_allocations;
     }
-    if(side_output.ok)
+    if(rear_index_ >= 0)
     {
-        last_side_cam_output_ = side_output;
+        debug_.rear_ok = debug_.cameras[rear_index_].ok;
+        debug_.rear_buffer_allocations = debug_.cameras[rear_index_].buffer_allocations;
     }
 
-    if(last_side_cam_output_.ok && last_rear_cam_output_.ok) new_output_pose_ready = true;
+    // Only solve the pose from frames captured close together
+    CameraPipelineOutput outputs[MAX_CAMERAS];
+    bool used[MAX_CAMERAS] = {};
+    bool new_output_pose_ready = frame_pairer_.getGroup(outputs, used, min_cameras_);
+    debug_.rejected_pairs = frame_pairer_.getRejectedPairs();
+    debug_.pair_skew_ms = frame_pairer_.getLastSkewMs();
 
-    // int time_delta_ms = std::chrono::duration_cast<std::chrono::milliseconds>
-    //     (last_side_cam_output_.timestamp - last_rear_cam_output_.timestamp).count();
-    // if(abs(time_delta_ms) > 400)
-    // {
-    //     PLOGW << "Camera timestamp delta too large: " << time_delta_ms;
-    //     new_output_pose_ready = false;
-    // }
+    Point pose;
+    if(new_output_pose_ready)
+    {
+        // Patterns are matched around the last pose while tracking, otherwise around the origin vision moves aim for
+        const Point prior = output_.ok ? output_.pose : Point(0, 0, 0);
+        Eigen::Vector2f points[MAX_POSE_POINTS];
+        Eigen::Vector2f targets[MAX_POSE_POINTS];
+        float weights[MAX_POSE_POINTS];
+        int count = 0;
+        for (size_t i = 0; i < cameras_.size(); i++)
+        {
+            if(!used[i]) continue;
+            const Camera& camera = cameras_[i];
+            const CameraPipelineOutput& output = outputs[i];
+            if(camera.pattern_size == 1)
+            {
+                points[count] = output.point;
+                targets[count] = camera.target;
+                weights[count] = camera.weight;
+                count++;
+                continue;
+            }
+            int matches[MAX_MARKER_POINTS];
+            used[i] = matchPattern(output.points, output.num_points, camera.pattern, camera.pattern_size, prior, pattern_match_radius_, matches) > 0;
+            for (int j = 0; j < output.num_points; j++)
+            {
+                if(matches[j] < 0) continue;
+                points[count] = output.points[j];
+                targets[count] = camera.pattern[matches[j]];
+                weights[count] = camera.weight;
+                count++;
+            }
+        }
+        new_output_pose_ready = solveRobotPose(points, targets, weights, count, &pose);
+    }
 
-    output_.ok = both_cams_ok_filter_.update(new_output_pose_ready);
+    output_.ok = pose_ok_filter_.update(new_output_pose_ready);
     debug_.both_ok = output_.ok;
-    if(!new_output_pose_ready) return;
+    if(!new_output_pose_ready) return false;
 
-    // Populate output
-    output_.pose = computeRobotPoseFromImagePoints(last_side_cam_output_.point, last_rear_cam_output_.point);
-    output_.timestamp = ClockFactory::getFactoryInstance()->get_clock()->now();
+    // Populate output, stamped at the mean capture time of the frames used
+    output_.pose = pose;
+    ClockTimePoint::duration offset_sum(0);
+    ClockTimePoint reference_time;
+    int num_used = 0;
+    for (size_t i = 0; i < cameras_.size(); i++)
+    {
+        if(!used[i]) continue;
+        if(num_used == 0) reference_time = outputs[i].timestamp;
+        offset_sum += outputs[i].timestamp - reference_time;
+        cameras_[i].last_output = outputs[i];
+        num_used++;
+    }
+    output_.timestamp = reference_time + offset_sum / num_used;
     camera_loop_time_averager_.mark_point();
 
     // Populate debug
-    debug_.side_u = last_side_cam_output_.uv[0];
-    debug_.side_v = last_side_cam_output_.uv[1];
-    debug_.rear_u = last_rear_cam_output_.uv[0];
-    debug_.rear_v = last_rear_cam_output_.uv[1];
-    debug_.side_x = last_side_cam_output_.point[0];
-    debug_.side_y = last_side_cam_output_.point[1];
-    debug_.rear_x = last_rear_cam_output_.point[0];
-    debug_.rear_y = last_rear_cam_output_.point[1];
+    Rotation2D rotation(pose.a);
+    for (size_t i = 0; i < cameras_.size(); i++)
+    {
+        CameraHealth& health = debug_.cameras[i];
+        health.used = used[i];
+        if(!used[i]) continue;
+        health.poses++;
+        const CameraPipelineOutput& output = cameras_[i].last_output;
+        health.u = output.uv[0];
+        health.v = output.uv[1];
+        health.x = output.point[0];
+        health.y = output.point[1];
+        float marker_x, marker_y;
+        rotation.toGlobal(output.point[0], output.point[1], &marker_x, &marker_y);
+        // Against whichever of its pattern blobs the largest marker point ended up on
+        const Camera& camera = cameras_[i];
+        health.residual = std::numeric_limits<float>::max();
+        for (int j = 0; j < camera.pattern_size; j++)
+        {
+            health.residual = std::min(health.residual, std::hypot(pose.x + marker_x - camera.pattern[j][0], pose.y + marker_y - camera.pattern[j][1]));
+        }
+    }
+    debug_.cameras_used = num_used;
+    if(side_index_ >= 0)
+    {
+        const CameraHealth& side = debug_.cameras[side_index_];
+        debug_.side_u = side.u;
+        debug_.side_v = side.v;
+        debug_.side_x = side.x;
+        debug_.side_y = side.y;
+    }
+    if(rear_index_ >= 0)
+    {
+        const CameraHealth& rear = debug_.cameras[rear_index_];
+        debug_.rear_u = rear.u;
+        debug_.rear_v = rear.v;
+        debug_.rear_x = rear.x;
+        debug_.rear_y = rear.y;
+    }
     debug_.pose_x = output_.pose.x;
     debug_.pose_y = output_.pose.y;
     debug_.pose_a = output_.pose.a;
     debug_.loop_ms = camera_loop_time_averager_.get_ms();
-
-    // Mark camera output values as not okay to make sure they are only used once
-    last_rear_cam_output_.ok = false;
-    last_side_cam_output_.ok = false;
+    CameraExecutor::Stats executor_stats = executor_->getStats();
+    debug_.vision_cpu_cores = executor_stats.cpu_cores;
+    debug_.throttled_frames = executor_stats.throttled;
+    return true;
 }
 
 CameraTrackerOutput CameraTracker::getPoseFromCamera()
 {
-    return output_;
+    CameraTrackerOutput output = output_mailbox_.read();
+    InputRecorder::recordCamera(output);
+    return output;
 }
 
 CameraDebug CameraTracker::getCameraDebug()
 {
-    return debug_;
+    return debug_mailbox_.read();
 }
 
 void CameraTracker::start()
 {
-    rear_cam_.start();
-    side_cam_.start();
+    if(running_) return;
+
+    // Cameras are only opened when first started. Opening is mostly waiting on the driver, so do them all at once.
+    std::vector<std::future<void>> opens;
+    for (Camera& camera : cameras_)
+    {
+        if(!camera.pipeline->isOpen()) opens.push_back(std::async(std::launch::async, [&camera]() { camera.pipeline->open(); }));
+    }
+    for (std::future<void>& open : opens)
+    {
+        open.get();
+    }
+
     camera_loop_time_averager_ = TimeRunningAverage(num_samples_to_average);
+    if(use_fusion_thread_)
+    {
+        fusion_thread_running_ = true;
+        fusion_thread_ = std::thread(&CameraTracker::fusionLoop, this);
+    }
+    applyRate();
+    executor_->start();
     running_ = true;
 }
 
 void CameraTracker::stop()
 {
-    rear_cam_.stop();
-    side_cam_.stop();
+    executor_->stop();
+    fusion_thread_running_ = false;
+    if(fusion_thread_.joinable()) fusion_thread_.join();
     running_ = false;
 }
 
+void CameraTracker::setCameraProfile(CAMERA_PROFILE profile)
+{
+    if(static_cast<int>(profile) == camera_profile_.exchange(static_cast<int>(profile))) return;
+    PLOGI << "Camera profile " << (profile == CAMERA_PROFILE::VISION ? "vision" : "idle");
+    for (Camera& camera : cameras_)
+    {
+        camera.pipeline->setProfile(profile);
+    }
+}
+
+void CameraTracker::setDegradeLevel(VISION_DEGRADE level)
+{
+    if(static_cast<int>(level) == degrade_level_.exchange(static_cast<int>(level))) return;
+    if(level == VISION_DEGRADE::NONE) PLOGI << "Vision back to full rate";
+    else PLOGW << "Degrading vision to level " << static_cast<int>(level);
+
+    // Keep enough cameras for a pose running, the ones seeing their marker first
+    uint32_t paused = 0;
+    if(level == VISION_DEGRADE::MINIMAL)
+    {
+        const CameraDebug debug = debug_mailbox_.read();
+        int kept = 0;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (size_t i = 0; i < cameras_.size(); i++)
+            {
+                const bool seeing = debug.cameras[i].ok;
+                if((pass == 0) != seeing) continue;
+                if(kept < min_cameras_) kept++;
+                else paused |= 1u << i;
+            }
+        }
+    }
+    degrade_paused_ = paused;
+    applyRate();
+}
+
+void CameraTracker::setCameraDemand(CAMERA_CONSUMER consumer, bool wanted)
+{
+    const uint32_t bit = 1u << static_cast<int>(consumer);
+    const bool was_demanded = demanded();
+    if(wanted) demand_mask_ |= bit;
+    else demand_mask_ &= ~bit;
+    if(demanded() == was_demanded) return;
+    PLOGI << (was_demanded ? "Cameras idle" : "Cameras to full rate");
+    applyRate();
+}
+
+bool CameraTracker::demanded() const
+{
+    return !use_duty_cycle_ || demand_mask_ != 0;
+}
+
+void CameraTracker::applyRate()
+{
+    const VISION_DEGRADE level = static_cast<VISION_DEGRADE>(degrade_level_.load());
+    float fps = level == VISION_DEGRADE::NONE ? 0 : level == VISION_DEGRADE::REDUCED_RATE ? reduced_fps_ : minimal_fps_;
+    uint32_t paused = degrade_paused_;
+    if(!demanded())
+    {
+        if(idle_fps_ > 0) fps = fps > 0 ? std::min(fps, idle_fps_) : idle_fps_;
+        else paused = (1u << cameras_.size()) - 1;
+    }
+    executor_->setMaxFrameRate(fps);
+    for (size_t i = 0; i < cameras_.size(); i++)
+    {
+        executor_->setPaused(cameras_[i].pipeline.get(), paused & (1u << i));
+    }
+    paused_mask_ = paused;
+}
+
 void CameraTracker::toggleDebugImageOutput()
 {
-    rear_cam_.toggleDebugImageOutput();
-    side_cam_.toggleDebugImageOutput();
+    for (Camera& camera : cameras_)
+    {
+        camera.pipeline->toggleDebugImageOutput();
+    }
+    const uint32_t debug_bit = 1u << static_cast<int>(CAMERA_CONSUMER::DEBUG);
+    setCameraDemand(CAMERA_CONSUMER::DEBUG, !(demand_mask_ & debug_bit));
 }
 
 Point CameraTracker::computeRobotPoseFromImagePoints(Eigen::Vector2f p_side, Eigen::Vector2f p_rear)
-{  
-    // Solve linear equations to get pose values
-    Eigen::Matrix4f A;
-    Eigen::Vector4f b;
-    A << 1, 0, -p_rear[1], p_rear[0],
-         0, 1,  p_rear[0], p_rear[1],
-         1, 0, -p_side[1], p_side[0],
-         0, 1,  p_side[0], p_side[1];
-    b << robot_P_rear_target_[0],
-         robot_P_rear_target_[1],
-         robot_P_side_target_[0],
-         robot_P_side_target_[1];
+{
+    Eigen::Vector2f points[MAX_CAMERAS];
+    bool used[MAX_CAMERAS] = {};
+    if(side_index_ >= 0) { points[side_index_] = p_side; used[side_index_] = true; }
+    if(rear_index_ >= 0) { points[rear_index_] = p_rear; used[rear_index_] = true; }
+    Point pose = {0,0,0};
+    computeRobotPose(points, used, &pose);
+    return pose;
+}
+
+bool CameraTracker::computeRobotPose(const Eigen::Vector2f* points, const bool* used, Point* pose)
+{
+    Eigen::Vector2f used_points[MAX_CAMERAS];
+    Eigen::Vector2f targets[MAX_CAMERAS];
+    float weights[MAX_CAMERAS];
+    int count = 0;
+    for (size_t i = 0; i < cameras_.size(); i++)
+    {
+        if(!used[i]) continue;
+        used_points[count] = points[i];
+        targets[count] = cameras_[i].target;
+        weights[count] = cameras_[i].weight;
+        count++;
+    }
+    return solveRobotPose(used_points, targets, weights, count, pose);
+}
+
+bool CameraTracker::solveRobotPose(const Eigen::Vector2f* points, const Eigen::Vector2f* targets, const float* weights, int count, Point* pose)
+{
+    // Each point gives two equations in x, y, sin(a), cos(a) from target = pose + R(a) * point. Rows are
+    // scaled by sqrt(weight) so the least squares solution weights each point's squared error. Two points from
+    // one camera's pattern pin the pose down as well as one from each of two cameras. Sized at compile time
+    // for MAX_POSE_POINTS so solving doesn't allocate.
+    typedef Eigen::Matrix<float, Eigen::Dynamic, 4, Eigen::ColMajor, 2 * MAX_POSE_POINTS, 4> SystemMatrix;
+    typedef Eigen::Matrix<float, Eigen::Dynamic, 1, Eigen::ColMajor, 2 * MAX_POSE_POINTS, 1> SystemVector;
+    if(count < 2 || count > MAX_POSE_POINTS) return false;
+
+    SystemMatrix A(2 * count, 4);
+    SystemVector b(2 * count);
+    for (int i = 0; i < count; i++)
+    {
+        const Eigen::Vector2f& p = points[i];
+        const float w = std::sqrt(std::max(weights[i], 0.0f));
+        A.row(2 * i) << w, 0, -w * p[1], w * p[0];
+        A.row(2 * i + 1) << 0, w, w * p[0], w * p[1];
+        b[2 * i] = w * targets[i][0];
+        b[2 * i + 1] = w * targets[i][1];
+    }
     Eigen::Vector4f x = A.colPivHouseholderQr().solve(b);
     
     // Populate pose with angle averaging
-    float pose_x = x[0];
-    float pose_y = x[1];
-    float pose_a = atan2(x[2], x[3]);
-    return {pose_x, pose_y, pose_a};
+    pose->x = x[0];
+    pose->y = x[1];
+    pose->a = atan2(x[2], x[3]);
+    return true;
 }
 
+int CameraTracker::matchPattern(const Eigen::Vector2f* points, int num_points, const Eigen::Vector2f* pattern, int pattern_size,
+                                Point prior_pose, float max_distance, int* matches)
+{
+    // Where each point would be in the target frame if the robot were at the prior
+    Rotation2D rotation(prior_pose.a);
+    Eigen::Vector2f moved[MAX_MARKER_POINTS];
+    num_points = std::min(num_points, MAX_MARKER_POINTS);
+    pattern_size = std::min(pattern_size, MAX_MARKER_POINTS);
+    for (int i = 0; i < num_points; i++)
+    {
+        float x, y;
+        rotation.toGlobal(points[i][0], points[i][1], &x, &y);
+        moved[i] = {prior_pose.x + x, prior_pose.y + y};
+        matches[i] = -1;
+    }
+
+    // At most four a side, so just take the closest free pair until none are close enough
+    bool blob_taken[MAX_MARKER_POINTS] = {};
+    int matched = 0;
+    while(true)
+    {
+        int best_point = -1;
+        int best_blob = -1;
+        float best_distance = max_distance;
+        for (int i = 0; i < num_points; i++)
+        {
+            if(matches[i] >= 0) continue;
+            for (int j = 0; j < pattern_size; j++)
+            {
+                if(blob_taken[j]) continue;
+                const float distance = (moved[i] - pattern[j]).norm();
+                if(distance > best_distance) continue;
+                best_distance = distance;
+                best_point = i;
+                best_blob = j;
+            }
+        }
+        if(best_point < 0) break;
+        matches[best_point] = best_blob;
+        blob_taken[best_blob] = true;
+        matched++;
+    }
+    return matched;
+}
@@ -4,8 +4,21 @@
 #include "CameraTrackerBase.h"
 #include "utils.h"
 #include <Eigen/Dense>
+#include <memory>
+#include <vector>
 #include "CameraPipeline.h"
-
+#include "FramePairer.h"
+#include "CameraExecutor.h"
+#include "Mailbox.h"
+#include <atomic>
+#include <thread>
+
+// Runs the cameras listed in vision_tracker.cameras on a shared CameraExecutor and solves the robot pose
+// from whichever of them see their marker in frames captured close together.
+//
+// With vision_tracker.fusion_thread set the pose is solved on a thread of its own that wakes whenever a
+// pipeline publishes, instead of waiting for the main loop to call update(). The pose and debug data are
+// published through mailboxes so they can be read from any thread.
 class CameraTracker : public CameraTrackerBase
 {
   public:
@@ -27,27 +40,98 @@ class CameraTracker : public CameraTrackerBase
 
     virtual CameraDebug getCameraDebug() override;
 
+    virtual int poseReadyFd() override { return pose_ready_fd_; };
+
+    // Lowers the pipeline frame rate, and at MINIMAL pauses cameras beyond the ones the pose needs, keeping
+    // the ones that see their marker
+    virtual void setDegradeLevel(VISION_DEGRADE level) override;
+
+    // Each pipeline switches its capture settings before its next frame
+    virtual void setCameraProfile(CAMERA_PROFILE profile) override;
+
+    // With vision_tracker.duty_cycle on, pipelines are held to idle_fps (or paused if it is 0) until a consumer
+    // wants the poses. The captures keep streaming, so the first frame after that is as fresh as any other.
+    virtual void setCameraDemand(CAMERA_CONSUMER consumer, bool wanted) override;
+
     // Below here exposed for testing only (yes, bad practice, but useful for now)
 
     Point computeRobotPoseFromImagePoints(Eigen::Vector2f p_side, Eigen::Vector2f p_rear);
 
+    // Weighted least squares pose from the marker points (robot frame) of the cameras flagged in used, in
+    // vision_tracker.cameras order. Returns false if fewer than 2 cameras are used.
+    bool computeRobotPose(const Eigen::Vector2f* points, const bool* used, Point* pose);
+
+    // Weighted least squares pose that puts each marker point (robot frame) onto its target. Needs at most
+    // MAX_POSE_POINTS and at least 2 points, returns false otherwise.
+    static bool solveRobotPose(const Eigen::Vector2f* points, const Eigen::Vector2f* targets, const float* weights, int count, Point* pose);
+
+    // Pairs marker points seen by one camera (robot frame) with the blobs of its pattern (target frame), each
+    // point with the blob it lands nearest to when moved by prior_pose, closest pairs first. Points further than
+    // max_distance from every free blob get -1 in matches. Returns the number of points matched.
+    static int matchPattern(const Eigen::Vector2f* points, int num_points, const Eigen::Vector2f* pattern, int pattern_size,
+                            Point prior_pose, float max_distance, int* matches);
+
     void oneLoop();
 
   private:
 
+    struct Camera
+    {
+      std::unique_ptr<CameraPipeline> pipeline;
+      Eigen::Vector2f target;       // Where the marker is in the robot frame when the robot is at the origin
+      Eigen::Vector2f pattern[MAX_MARKER_POINTS];   // Same for each blob of its pattern, just target for a single marker
+      int pattern_size;
+      float weight;
+      LatchedBool ok_filter;
+      CameraPipelineOutput last_output;
+    };
+
+    // Index in cameras_ of the camera with this config name, or -1
+    int cameraIndex(const std::string& name);
+
+    // Solves the pose from the latest pipeline outputs, returns true if there is a new one
+    bool fuse();
+
+    // Fuses and publishes the results, signalling pose_ready_fd_ if there is a new pose
+    void fuseAndPublish();
+
+    void fusionLoop();
+
+    // Whether anything wants full rate poses, debug images included
+    bool demanded() const;
+
+    // Frame rate cap and paused cameras for the degrade level and demand together
+    void applyRate();
+
     TimeRunningAverage camera_loop_time_averager_;
     CameraDebug debug_;
-    CameraPipeline rear_cam_;
-    CameraPipeline side_cam_;
+    std::vector<Camera> cameras_;
+    int side_index_;
+    int rear_index_;
+    int min_cameras_;
     CameraTrackerOutput output_;
-    Eigen::Vector2f robot_P_side_target_;
-    Eigen::Vector2f robot_P_rear_target_;
-    CameraPipelineOutput last_rear_cam_output_;
-    CameraPipelineOutput last_side_cam_output_;
-    LatchedBool side_cam_ok_filter_;
-    LatchedBool rear_cam_ok_filter_;
-    LatchedBool both_cams_ok_filter_;
+    FramePairer frame_pairer_;
+    float pattern_match_radius_;
+    LatchedBool pose_ok_filter_;
+    std::unique_ptr<CameraExecutor> executor_;    // After cameras_ so it stops before the pipelines go away
     bool running_;
+
+    bool use_fusion_thread_;
+    int output_ready_fd_;         // Signalled by the pipelines on every output
+    int pose_ready_fd_;
+    LatestValueMailbox<CameraTrackerOutput> output_mailbox_;
+    LatestValueMailbox<CameraDebug> debug_mailbox_;
+    float reduced_fps_;
+    float minimal_fps_;
+    std::atomic<int> degrade_level_;
+    std::atomic<uint32_t> degrade_paused_;  // Bit per camera, set while setDegradeLevel has it paused
+    std::atomic<uint32_t> paused_mask_;     // Same for everything that pauses it, duty cycling included
+    bool use_duty_cycle_;
+    float idle_fps_;
+    std::atomic<uint32_t> demand_mask_;     // Bit per CAMERA_CONSUMER, DEBUG tracks toggleDebugImageOutput
+    std::atomic<int> camera_profile_;
+    std::atomic<bool> fusion_thread_running_;
+    std::thread fusion_thread_;
 };
 
 
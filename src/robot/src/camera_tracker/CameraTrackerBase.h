@@ -11,6 +11,33 @@ struct CameraTrackerOutput
   bool raw_detection;
 };
 
+// How much camera work is shed to keep the rest of the robot on time, see SystemHealth.h
+enum class VISION_DEGRADE
+{
+  NONE,
+  REDUCED_RATE,       // Pipelines run at vision_tracker.degrade.reduced_fps
+  MINIMAL,            // Run at minimal_fps, and cameras the pose doesn't need are paused
+};
+
+// Capture settings the cameras run with, from vision_tracker.profiles. Vision moves want short exposures and
+// a high frame rate so the marker doesn't smear, the rest of the time a low rate is enough and costs less.
+enum class CAMERA_PROFILE
+{
+  IDLE,
+  VISION,
+};
+
+// What the camera poses are wanted for. With vision_tracker.duty_cycle on, the pipelines only run at full rate
+// while at least one consumer wants them, and tick over at the keep-alive rate otherwise.
+enum class CAMERA_CONSUMER
+{
+  VISION_MOVE,
+  STOP_TRIGGER,       // MOVE_FINE_STOP_VISION watching for the markers to come into view
+  DEBUG,              // Debug images being saved, set through toggleDebugImageOutput
+  CALIBRATION,        // Camera calibration sampling the marker points
+  COUNT,
+};
+
 class CameraTrackerBase
 {
   public:
@@ -29,6 +56,18 @@ class CameraTrackerBase
 
     virtual CameraDebug getCameraDebug() = 0;
 
+    // Descriptor that polls readable when a new pose has been published, so its one consumer can act on the
+    // pose as soon as it exists. -1 if poses only change when update() is called.
+    virtual int poseReadyFd() = 0;
+
+    virtual void setDegradeLevel(VISION_DEGRADE level) = 0;
+
+    // Cheap to call every loop, only a change is passed on to the cameras
+    virtual void setCameraProfile(CAMERA_PROFILE profile) = 0;
+
+    // Registers or drops consumer's interest in the poses, also cheap to call every loop
+    virtual void setCameraDemand(CAMERA_CONSUMER consumer, bool wanted) = 0;
+
 };
 
 
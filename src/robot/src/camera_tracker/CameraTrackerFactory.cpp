@@ -1,6 +1,7 @@
 #include "CameraTrackerFactory.h"
 #include "CameraTracker.h"
 #include "CameraTrackerMock.h"
+#include "CameraTrackerShm.h"
 
 #include <plog/Log.h> 
 
@@ -23,6 +24,7 @@ void CameraTrackerFactory::set_mode(CAMERA_TRACKER_FACTORY_MODE mode)
 
 CameraTrackerBase* CameraTrackerFactory::get_camera_tracker()
 {
+    std::lock_guard<std::mutex> lock(mutex_);
     if (!camera_tracker_)
     {
         build_camera_tracker();
@@ -44,12 +46,20 @@ void CameraTrackerFactory::build_camera_tracker()
         camera_tracker_ = std::make_unique<CameraTrackerMock>();
         PLOGI << "Built CameraTrackerMock";
     }
+    else if (mode_ == CAMERA_TRACKER_FACTORY_MODE::SHARED_MEMORY)
+    {
+        camera_tracker_ = std::make_unique<CameraTrackerShmClient>(static_cast<const char*>(cfg.lookup("vision_process.shm_name")),
+                                                                   cfg.lookup("vision_process.timeout"),
+                                                                   cfg.lookup("vision_process.spawn"));
+        PLOGI << "Built CameraTrackerShmClient";
+    }
 }
 
 
 // Private constructor
 CameraTrackerFactory::CameraTrackerFactory()
 : mode_(CAMERA_TRACKER_FACTORY_MODE::STANDARD),
-  camera_tracker_()
+  camera_tracker_(),
+  mutex_()
 {}
   
\ No newline at end of file
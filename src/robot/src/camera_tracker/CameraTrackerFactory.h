@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <map>
+#include <mutex>
 
 #include "CameraTrackerBase.h"
 
@@ -10,6 +11,7 @@ enum class CAMERA_TRACKER_FACTORY_MODE
 {
   STANDARD,
   MOCK,
+  SHARED_MEMORY,    // Reads the tracker running in the vision process, see CameraTrackerShm.h
 };
 
 class CameraTrackerFactory
@@ -21,6 +23,7 @@ class CameraTrackerFactory
 
     void set_mode(CAMERA_TRACKER_FACTORY_MODE mode);
 
+    // Builds the tracker on first use. Safe to call from several threads, later callers wait for the build.
     CameraTrackerBase* get_camera_tracker();
 
     // Delete copy and assignment constructors
@@ -40,6 +43,8 @@ class CameraTrackerFactory
 
     std::unique_ptr<CameraTrackerBase> camera_tracker_;
 
+    std::mutex mutex_;
+
 };
 
 
@@ -2,6 +2,7 @@
 #define CameraTrackerMock_h
 
 #include "utils.h"
+#include "CameraTrackerBase.h"
 
 class CameraTrackerMock : public CameraTrackerBase
 {
@@ -17,9 +18,42 @@ class CameraTrackerMock : public CameraTrackerBase
 
     virtual void toggleDebugImageOutput() override {};
 
-    virtual CameraTrackerOutput getPoseFromCamera() override { return {{0,0,0},false, ClockFactory::getFactoryInstance()->get_clock()->now(),false};};
+    virtual CameraTrackerOutput getPoseFromCamera() override 
+    { 
+        if(have_mock_output_) return mock_output_;
+        return {{0,0,0},false, ClockFactory::getFactoryInstance()->get_clock()->now(),false};
+    };
 
     virtual CameraDebug getCameraDebug() override {return CameraDebug(); }; 
+
+    virtual int poseReadyFd() override { return -1; };
+
+    virtual void setDegradeLevel(VISION_DEGRADE level) override { degrade_level_ = level; };
+
+    VISION_DEGRADE getDegradeLevel() const { return degrade_level_; };
+
+    virtual void setCameraProfile(CAMERA_PROFILE profile) override { camera_profile_ = profile; };
+
+    CAMERA_PROFILE getCameraProfile() const { return camera_profile_; };
+
+    virtual void setCameraDemand(CAMERA_CONSUMER consumer, bool wanted) override 
+    { 
+        const uint32_t bit = 1u << static_cast<int>(consumer);
+        demand_ = wanted ? demand_ | bit : demand_ & ~bit;
+    };
+
+    bool getCameraDemand(CAMERA_CONSUMER consumer) const { return demand_ & (1u << static_cast<int>(consumer)); };
+
+    // Pose returned from now on instead of no detection, used by the simulator
+    void mock_set_output(CameraTrackerOutput output) { mock_output_ = output; have_mock_output_ = true; };
+
+  private:
+
+    bool have_mock_output_ = false;
+    VISION_DEGRADE degrade_level_ = VISION_DEGRADE::NONE;
+    CAMERA_PROFILE camera_profile_ = CAMERA_PROFILE::IDLE;
+    uint32_t demand_ = 0;
+    CameraTrackerOutput mock_output_;
 };
 
 
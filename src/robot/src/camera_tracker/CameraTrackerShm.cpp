@@ -0,0 +1,400 @@
+#include "CameraTrackerShm.h"
+
+#include <plog/Log.h>
+#include "InputRecorder.h"
+#include <climits>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace
+{
+    // Longest the client watcher sleeps on the futex, bounds how long shutdown takes
+    constexpr int watch_timeout_ms = 100;
+    // Respawns of a vision process that keeps exiting are at least this far apart
+    constexpr float respawn_interval_s = 1.0;
+    // How long a peer that is initializing the segment gets before it is considered dead
+    constexpr int init_wait_ms = 100;
+
+    int64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            ClockFactory::getFactoryInstance()->get_clock()->now().time_since_epoch()).count();
+    }
+
+    // The segment is mapped shared so these are the process-shared futex operations, not the private ones
+    void futexWake(std::atomic<uint32_t>* word)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    void futexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeout_ms)
+    {
+        timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    void signalFd(int fd)
+    {
+        uint64_t one = 1;
+        if(fd >= 0 && write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) PLOGW << "Could not signal camera pose: " << strerror(errno);
+    }
+
+    void drainFd(int fd)
+    {
+        uint64_t count;
+        ssize_t n = read(fd, &count, sizeof(count));
+        (void) n;
+    }
+
+    CameraTrackerOutput lostOutput()
+    {
+        return {{0,0,0}, false, ClockFactory::getFactoryInstance()->get_clock()->now(), false};
+    }
+}
+
+CameraTrackerShmMapping::CameraTrackerShmMapping()
+: segment_(nullptr)
+{}
+
+CameraTrackerShmMapping::~CameraTrackerShmMapping()
+{
+    close();
+}
+
+bool CameraTrackerShmMapping::open(const std::string& name)
+{
+    close();
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+    if(fd < 0)
+    {
+        PLOGE << "Could not open camera shared memory " << name << ": " << strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (static_cast<size_t>(st.st_size) != sizeof(CameraTrackerShmSegment) && ftruncate(fd, sizeof(CameraTrackerShmSegment)) < 0))
+    {
+        PLOGE << "Could not size camera shared memory " << name << ": " << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    void* addr = mmap(nullptr, sizeof(CameraTrackerShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(addr == MAP_FAILED)
+    {
+        PLOGE << "Could not map camera shared memory " << name << ": " << strerror(errno);
+        return false;
+    }
+    segment_ = static_cast<CameraTrackerShmSegment*>(addr);
+    initialize();
+    return true;
+}
+
+void CameraTrackerShmMapping::close()
+{
+    if(segment_) munmap(segment_, sizeof(CameraTrackerShmSegment));
+    segment_ = nullptr;
+}
+
+void CameraTrackerShmMapping::remove(const std::string& name)
+{
+    shm_unlink(name.c_str());
+}
+
+void CameraTrackerShmMapping::initialize()
+{
+    // Whoever swaps out an unusable magic owns initialization, anyone else waits for them to finish
+    Timer wait_timer;
+    uint32_t magic = segment_->magic.load(std::memory_order_acquire);
+    while(magic != CAMERA_SHM_MAGIC)
+    {
+        if(magic == CAMERA_SHM_INITIALIZING && wait_timer.dt_ms() < init_wait_ms)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            magic = segment_->magic.load(std::memory_order_acquire);
+            continue;
+        }
+        if(segment_->magic.compare_exchange_strong(magic, CAMERA_SHM_INITIALIZING, std::memory_order_acq_rel))
+        {
+            // A fresh segment is already zero, a stale one isn't. Everything after magic is reset.
+            char* start = reinterpret_cast<char*>(segment_) + sizeof(segment_->magic);
+            memset(start, 0, sizeof(CameraTrackerShmSegment) - sizeof(segment_->magic));
+            new (&segment_->output) LatestValueMailbox<CameraTrackerOutput>();
+            new (&segment_->debug) LatestValueMailbox<CameraDebug>();
+            segment_->output.write(lostOutput());
+            segment_->debug.write(CameraDebug());
+            segment_->magic.store(CAMERA_SHM_MAGIC, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+
+CameraTrackerShmServer::CameraTrackerShmServer(const std::string& name, CameraTrackerBase* tracker)
+: name_(name),
+  tracker_(tracker),
+  mapping_(),
+  handled_toggles_(0),
+  applied_degrade_(-1),
+  applied_profile_(-1),
+  applied_demand_(-1),
+  last_output_(lostOutput())
+{}
+
+bool CameraTrackerShmServer::open()
+{
+    if(!mapping_.open(name_)) return false;
+    CameraTrackerShmSegment* segment = mapping_.get();
+    // Toggles from before this process started were meant for the one it replaces
+    handled_toggles_ = segment->debug_toggles.load(std::memory_order_acquire);
+    segment->server_pid.store(getpid(), std::memory_order_relaxed);
+    segment->server_starts.fetch_add(1, std::memory_order_relaxed);
+    segment->heartbeat_ns.store(nowNs(), std::memory_order_release);
+    PLOGI << "Vision process publishing to " << name_;
+    return true;
+}
+
+void CameraTrackerShmServer::runOnce(int timeout_ms)
+{
+    CameraTrackerShmSegment* segment = mapping_.get();
+    if(!segment) return;
+
+    const bool run_requested = segment->run_requested.load(std::memory_order_acquire);
+    if(run_requested && !tracker_->running())
+    {
+        PLOGI << "Starting cameras";
+        tracker_->start();
+    }
+    else if(!run_requested && tracker_->running())
+    {
+        PLOGI << "Stopping cameras";
+        tracker_->stop();
+    }
+    const uint32_t toggles = segment->debug_toggles.load(std::memory_order_acquire);
+    for (; handled_toggles_ != toggles; handled_toggles_++)
+    {
+        tracker_->toggleDebugImageOutput();
+    }
+    const int degrade = segment->degrade_level.load(std::memory_order_acquire);
+    if(degrade != applied_degrade_)
+    {
+        tracker_->setDegradeLevel(static_cast<VISION_DEGRADE>(degrade));
+        applied_degrade_ = degrade;
+    }
+    const int profile = segment->camera_profile.load(std::memory_order_acquire);
+    if(profile != applied_profile_)
+    {
+        tracker_->setCameraProfile(static_cast<CAMERA_PROFILE>(profile));
+        applied_profile_ = profile;
+    }
+    const int demand = segment->camera_demand.load(std::memory_order_acquire);
+    if(demand != applied_demand_)
+    {
+        for (int i = 0; i < static_cast<int>(CAMERA_CONSUMER::COUNT); i++)
+        {
+            // Debug images come across as toggles, so the tracker keeps that bit itself
+            if(i == static_cast<int>(CAMERA_CONSUMER::DEBUG)) continue;
+            tracker_->setCameraDemand(static_cast<CAMERA_CONSUMER>(i), demand & (1 << i));
+        }
+        applied_demand_ = demand;
+    }
+
+    const int fd = tracker_->poseReadyFd();
+    if(fd >= 0 && tracker_->running())
+    {
+        pollfd pfd = {fd, POLLIN, 0};
+        if(poll(&pfd, 1, timeout_ms) > 0) drainFd(fd);
+    }
+    else if(timeout_ms > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+    }
+
+    tracker_->update();
+    publish();
+}
+
+void CameraTrackerShmServer::publish()
+{
+    CameraTrackerShmSegment* segment = mapping_.get();
+    const CameraTrackerOutput output = tracker_->getPoseFromCamera();
+    segment->output.write(output);
+    segment->debug.write(tracker_->getCameraDebug());
+    segment->tracker_running.store(tracker_->running(), std::memory_order_relaxed);
+    segment->heartbeat_ns.store(nowNs(), std::memory_order_release);
+    if(output.timestamp != last_output_.timestamp || output.ok != last_output_.ok)
+    {
+        segment->pose_count.fetch_add(1, std::memory_order_release);
+        futexWake(&segment->pose_count);
+    }
+    last_output_ = output;
+}
+
+void CameraTrackerShmServer::run(const std::atomic<bool>& keep_running, int timeout_ms)
+{
+    while(keep_running)
+    {
+        runOnce(timeout_ms);
+    }
+    tracker_->stop();
+    if(mapping_.get()) mapping_.get()->tracker_running.store(0, std::memory_order_relaxed);
+    PLOGI << "Vision process stopped";
+}
+
+
+CameraTrackerShmClient::CameraTrackerShmClient(const std::string& name, float timeout_s, bool spawn)
+: mapping_(),
+  timeout_(std::chrono::nanoseconds(static_cast<int64_t>(timeout_s * 1e9))),
+  spawn_(spawn),
+  spawned_(false),
+  server_child_(-1),
+  respawn_timer_(),
+  pose_ready_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  watch_running_(false),
+  watch_thread_()
+{
+    if(!mapping_.open(name))
+    {
+        PLOGE << "Camera poses from the vision process are unavailable";
+        return;
+    }
+    if(pose_ready_fd_ >= 0)
+    {
+        // Counted from here so a pose published before the thread gets going still signals
+        const uint32_t seen = mapping_.get()->pose_count.load(std::memory_order_acquire);
+        watch_running_ = true;
+        watch_thread_ = std::thread(&CameraTrackerShmClient::watchLoop, this, seen);
+    }
+    else
+    {
+        PLOGW << "Could not create camera pose eventfd, poses are only picked up on the loop rate: " << strerror(errno);
+    }
+}
+
+CameraTrackerShmClient::~CameraTrackerShmClient()
+{
+    watch_running_ = false;
+    if(watch_thread_.joinable()) watch_thread_.join();
+    if(server_child_ > 0)
+    {
+        kill(server_child_, SIGTERM);
+        waitpid(server_child_, nullptr, 0);
+    }
+    if(pose_ready_fd_ >= 0) close(pose_ready_fd_);
+}
+
+void CameraTrackerShmClient::spawnServer()
+{
+    // posix_spawn rather than fork since this process is already threaded
+    char arg0[] = "robot-main";
+    char arg1[] = "-v";
+    char* argv[] = {arg0, arg1, nullptr};
+    pid_t pid;
+    int err = posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, argv, environ);
+    respawn_timer_.reset();
+    spawned_ = true;
+    if(err != 0)
+    {
+        PLOGE << "Could not start the vision process: " << strerror(err);
+        return;
+    }
+    server_child_ = pid;
+    PLOGI << "Started vision process " << pid;
+}
+
+void CameraTrackerShmClient::watchLoop(uint32_t seen)
+{
+    CameraTrackerShmSegment* segment = mapping_.get();
+    while(watch_running_)
+    {
+        futexWait(&segment->pose_count, seen, watch_timeout_ms);
+        const uint32_t count = segment->pose_count.load(std::memory_order_acquire);
+        if(count != seen) signalFd(pose_ready_fd_);
+        seen = count;
+    }
+}
+
+void CameraTrackerShmClient::start()
+{
+    if(mapping_.get()) mapping_.get()->run_requested.store(1, std::memory_order_release);
+}
+
+void CameraTrackerShmClient::stop()
+{
+    if(mapping_.get()) mapping_.get()->run_requested.store(0, std::memory_order_release);
+}
+
+void CameraTrackerShmClient::update()
+{
+    if(!spawn_ || !mapping_.get()) return;
+    if(server_child_ > 0)
+    {
+        int status = 0;
+        if(waitpid(server_child_, &status, WNOHANG) != server_child_) return;
+        if(WIFSIGNALED(status)) PLOGE << "Vision process " << server_child_ << " killed by signal " << WTERMSIG(status);
+        else PLOGE << "Vision process " << server_child_ << " exited with status " << WEXITSTATUS(status);
+        server_child_ = -1;
+    }
+    // The first spawn is here rather than in the constructor, which may run on a startup thread. The vision
+    // process's death signal fires when the thread that spawned it exits, not the whole process.
+    if(!spawned_ || respawn_timer_.dt_s() > respawn_interval_s) spawnServer();
+}
+
+bool CameraTrackerShmClient::serverAlive()
+{
+    CameraTrackerShmSegment* segment = mapping_.get();
+    return segment && nowNs() - segment->heartbeat_ns.load(std::memory_order_acquire) < timeout_.count();
+}
+
+bool CameraTrackerShmClient::running()
+{
+    return serverAlive() && mapping_.get()->tracker_running.load(std::memory_order_relaxed);
+}
+
+void CameraTrackerShmClient::toggleDebugImageOutput()
+{
+    if(mapping_.get()) mapping_.get()->debug_toggles.fetch_add(1, std::memory_order_release);
+}
+
+void CameraTrackerShmClient::setDegradeLevel(VISION_DEGRADE level)
+{
+    if(mapping_.get()) mapping_.get()->degrade_level.store(static_cast<uint32_t>(level), std::memory_order_release);
+}
+
+void CameraTrackerShmClient::setCameraProfile(CAMERA_PROFILE profile)
+{
+    if(mapping_.get()) mapping_.get()->camera_profile.store(static_cast<uint32_t>(profile), std::memory_order_release);
+}
+
+void CameraTrackerShmClient::setCameraDemand(CAMERA_CONSUMER consumer, bool wanted)
+{
+    if(!mapping_.get()) return;
+    const uint32_t bit = 1u << static_cast<int>(consumer);
+    if(wanted) mapping_.get()->camera_demand.fetch_or(bit, std::memory_order_release);
+    else mapping_.get()->camera_demand.fetch_and(~bit, std::memory_order_release);
+}
+
+CameraTrackerOutput CameraTrackerShmClient::getPoseFromCamera()
+{
+    CameraTrackerOutput output = serverAlive() ? mapping_.get()->output.read() : lostOutput();
+    InputRecorder::recordCamera(output);
+    return output;
+}
+
+CameraDebug CameraTrackerShmClient::getCameraDebug()
+{
+    return mapping_.get() ? mapping_.get()->debug.read() : CameraDebug();
+}
@@ -0,0 +1,155 @@
+#ifndef CameraTrackerShm_h
+#define CameraTrackerShm_h
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+
+#include "CameraTrackerBase.h"
+#include "Mailbox.h"
+#include "utils.h"
+
+// Runs the camera tracker in a vision process of its own (robot-main -v) so an OpenCV stall or crash can't take
+// the control loop with it. The vision process publishes the tracker output and debug data to a POSIX shared
+// memory segment through seqlocks, and robot-main reads them with CameraTrackerShmClient. Start, stop and debug
+// image requests go the other way through counters in the same segment. Nothing in the segment is ever waited
+// on under a lock, so either side can die or restart at any point without blocking the other.
+
+// Magic changes with the layout, a segment left behind by another version is reinitialized
+#define CAMERA_SHM_MAGIC 0x44525604
+#define CAMERA_SHM_INITIALIZING 0xFFFFFFFF
+
+struct CameraTrackerShmSegment
+{
+    std::atomic<uint32_t> magic;            // Must stay first, see CameraTrackerShmMapping::initialize
+    // Written by the vision process
+    std::atomic<int64_t> heartbeat_ns;      // Steady clock of its last loop
+    std::atomic<uint32_t> server_pid;
+    std::atomic<uint32_t> server_starts;    // Times a vision process attached
+    std::atomic<uint32_t> tracker_running;
+    std::atomic<uint32_t> pose_count;       // Bumped and futex woken on every new pose
+    LatestValueMailbox<CameraTrackerOutput> output;
+    LatestValueMailbox<CameraDebug> debug;
+    // Written by robot-main
+    std::atomic<uint32_t> run_requested;
+    std::atomic<uint32_t> debug_toggles;    // Total requests, the vision process toggles once per increment
+    std::atomic<uint32_t> degrade_level;    // VISION_DEGRADE
+    std::atomic<uint32_t> camera_profile;   // CAMERA_PROFILE
+    std::atomic<uint32_t> camera_demand;    // Bit per CAMERA_CONSUMER
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free,
+              "Shared memory atomics must be lock free to work across processes");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "pose_count is used as a futex word");
+
+// Maps the named segment, creating and initializing it if needed. Both sides open it the same way so
+// either can come up first, and a restarted vision process picks up the segment robot-main is still reading.
+class CameraTrackerShmMapping
+{
+  public:
+    CameraTrackerShmMapping();
+
+    ~CameraTrackerShmMapping();
+
+    // Returns false if the segment can't be opened or mapped
+    bool open(const std::string& name);
+
+    void close();
+
+    CameraTrackerShmSegment* get() const { return segment_; };
+
+    // Removes the name so the next open starts from a fresh segment, existing mappings stay valid
+    static void remove(const std::string& name);
+
+  private:
+
+    void initialize();
+
+    CameraTrackerShmSegment* segment_;
+};
+
+// Vision process side. Follows the requests from robot-main and publishes whatever the tracker produces.
+class CameraTrackerShmServer
+{
+  public:
+    CameraTrackerShmServer(const std::string& name, CameraTrackerBase* tracker);
+
+    bool open();
+
+    // Applies new requests, waits up to timeout_ms for the tracker to signal a pose, then updates it and publishes
+    void runOnce(int timeout_ms);
+
+    // Calls runOnce until keep_running goes false, then stops the tracker
+    void run(const std::atomic<bool>& keep_running, int timeout_ms);
+
+  private:
+
+    void publish();
+
+    std::string name_;
+    CameraTrackerBase* tracker_;
+    CameraTrackerShmMapping mapping_;
+    uint32_t handled_toggles_;
+    int applied_degrade_;                   // -1 until the first request has been applied
+    int applied_profile_;                   // Same
+    int applied_demand_;                    // Same
+    CameraTrackerOutput last_output_;
+};
+
+// robot-main side. Optionally spawns the vision process itself on the first update and restarts it whenever it exits.
+class CameraTrackerShmClient : public CameraTrackerBase
+{
+  public:
+    // timeout_s is how long the vision process can go without publishing before its poses count as lost
+    CameraTrackerShmClient(const std::string& name, float timeout_s, bool spawn);
+
+    virtual ~CameraTrackerShmClient();
+
+    virtual void start() override;
+
+    virtual void stop() override;
+
+    // Spawns the vision process, or reaps and respawns it if it exited. Call from the main thread.
+    virtual void update() override;
+
+    // Only true while the vision process is alive and its tracker is running
+    virtual bool running() override;
+
+    virtual void toggleDebugImageOutput() override;
+
+    // Not ok with the current time while the vision process is down
+    virtual CameraTrackerOutput getPoseFromCamera() override;
+
+    virtual CameraDebug getCameraDebug() override;
+
+    virtual int poseReadyFd() override { return pose_ready_fd_; };
+
+    virtual void setDegradeLevel(VISION_DEGRADE level) override;
+
+    virtual void setCameraProfile(CAMERA_PROFILE profile) override;
+
+    virtual void setCameraDemand(CAMERA_CONSUMER consumer, bool wanted) override;
+
+    // Whether the vision process published within the timeout
+    bool serverAlive();
+
+  private:
+
+    void spawnServer();
+
+    // Turns futex wakes from the vision process into pose_ready_fd_ signals
+    void watchLoop(uint32_t seen);
+
+    CameraTrackerShmMapping mapping_;
+    std::chrono::nanoseconds timeout_;
+    bool spawn_;
+    bool spawned_;
+    pid_t server_child_;
+    Timer respawn_timer_;
+    int pose_ready_fd_;
+    std::atomic<bool> watch_running_;
+    std::thread watch_thread_;
+};
+
+#endif //CameraTrackerShm_h
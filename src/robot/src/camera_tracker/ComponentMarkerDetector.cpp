@@ -0,0 +1,118 @@
+#include "ComponentMarkerDetector.h"
+
+#include <cmath>
+
+ComponentMarkerDetector::ComponentMarkerDetector(const cv::SimpleBlobDetector::Params& params)
+: params_(params),
+  labels_(),
+  components_()
+{}
+
+void ComponentMarkerDetector::detect(const cv::Mat& binary_img, std::vector<cv::KeyPoint>& keypoints, uchar foreground_value)
+{
+    keypoints.clear();
+    const int rows = binary_img.rows;
+    const int cols = binary_img.cols;
+    labels_.assign(rows * cols, -1);
+    components_.clear();
+
+    // Label pixels and accumulate moments in the same pass, merging labels when two regions touch
+    for (int y = 0; y < rows; y++)
+    {
+        const uchar* row = binary_img.ptr<uchar>(y);
+        int* label_row = labels_.data() + y * cols;
+        const int* prev_label_row = y > 0 ? label_row - cols : nullptr;
+        for (int x = 0; x < cols; x++)
+        {
+            if (row[x] != foreground_value) continue;
+
+            int label = -1;
+            if (x > 0 && label_row[x-1] >= 0) label = label_row[x-1];
+            if (prev_label_row)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    int nx = x + dx;
+                    if (nx < 0 || nx >= cols || prev_label_row[nx] < 0) continue;
+                    label = label < 0 ? prev_label_row[nx] : merge(label, prev_label_row[nx]);
+                }
+            }
+            if (label < 0) label = newLabel(x, y);
+            else addPixel(label, x, y);
+            label_row[x] = label;
+        }
+    }
+
+    // Filter root components and keep the largest at the front
+    for (int i = 0; i < static_cast<int>(components_.size()); i++)
+    {
+        const ComponentStats& c = components_[i];
+        if (c.parent != i) continue;
+
+        const double area = c.m00;
+        if (params_.filterByArea && (area < params_.minArea || area >= params_.maxArea)) continue;
+
+        const double cx = c.m10 / area;
+        const double cy = c.m01 / area;
+        const double mu20 = c.m20 - cx * c.m10;
+        const double mu02 = c.m02 - cy * c.m01;
+        // Treat each pixel as a unit square so single pixel and line shaped components stay well defined
+        const double spread = mu20 + mu02 + area / 6.0;
+        const double circularity = area * area / (2 * M_PI * spread);
+        if (params_.filterByCircularity && (circularity < params_.minCircularity || circularity >= params_.maxCircularity)) continue;
+
+        cv::KeyPoint k(static_cast<float>(cx), static_cast<float>(cy), static_cast<float>(2 * std::sqrt(area / M_PI)));
+        keypoints.push_back(k);
+        if (keypoints.back().size > keypoints.front().size)
+        {
+            std::swap(keypoints.front(), keypoints.back());
+        }
+    }
+}
+
+int ComponentMarkerDetector::newLabel(int x, int y)
+{
+    int label = static_cast<int>(components_.size());
+    components_.push_back({label, 0, 0, 0, 0, 0});
+    addPixel(label, x, y);
+    return label;
+}
+
+int ComponentMarkerDetector::findRoot(int label)
+{
+    while (components_[label].parent != label)
+    {
+        // Path halving keeps the trees shallow
+        components_[label].parent = components_[components_[label].parent].parent;
+        label = components_[label].parent;
+    }
+    return label;
+}
+
+int ComponentMarkerDetector::merge(int a, int b)
+{
+    int root_a = findRoot(a);
+    int root_b = findRoot(b);
+    if (root_a == root_b) return root_a;
+    if (root_b < root_a) std::swap(root_a, root_b);
+
+    ComponentStats& keep = components_[root_a];
+    ComponentStats& gone = components_[root_b];
+    keep.m00 += gone.m00;
+    keep.m10 += gone.m10;
+    keep.m01 += gone.m01;
+    keep.m20 += gone.m20;
+    keep.m02 += gone.m02;
+    gone.parent = root_a;
+    return root_a;
+}
+
+void ComponentMarkerDetector::addPixel(int label, int x, int y)
+{
+    ComponentStats& c = components_[findRoot(label)];
+    c.m00 += 1;
+    c.m10 += x;
+    c.m01 += y;
+    c.m20 += static_cast<double>(x) * x;
+    c.m02 += static_cast<double>(y) * y;
+}
@@ -0,0 +1,44 @@
+#ifndef ComponentMarkerDetector_h
+#define ComponentMarkerDetector_h
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Single pass connected components detector for already binarized images. Used as a cheaper
+// alternative to cv::SimpleBlobDetector, which re-thresholds the image at many levels.
+// Uses the area and circularity limits from cv::SimpleBlobDetector::Params. Circularity is computed
+// from second order moments as A^2 / (2*pi*(mu20 + mu02)), which is 1 for a disk and smaller for
+// elongated or irregular shapes.
+class ComponentMarkerDetector
+{
+  public:
+    ComponentMarkerDetector(const cv::SimpleBlobDetector::Params& params);
+
+    // Finds 8-connected regions of foreground_value pixels in a single channel 8 bit image. Keypoint
+    // size is the diameter of a disk with the same area. The largest accepted component is placed
+    // first in keypoints.
+    void detect(const cv::Mat& binary_img, std::vector<cv::KeyPoint>& keypoints, uchar foreground_value = 0);
+
+  private:
+
+    struct ComponentStats
+    {
+        int parent;
+        double m00;
+        double m10;
+        double m01;
+        double m20;
+        double m02;
+    };
+
+    int newLabel(int x, int y);
+    int findRoot(int label);
+    int merge(int a, int b);
+    void addPixel(int label, int x, int y);
+
+    cv::SimpleBlobDetector::Params params_;
+    std::vector<int> labels_;                // Label per pixel, reused between calls
+    std::vector<ComponentStats> components_; // Accumulated moments per label, reused between calls
+};
+
+#endif //ComponentMarkerDetector_h
@@ -0,0 +1,150 @@
+#include "DebugImageWriter.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#include <plog/Log.h>
+
+DebugImageWriter::DebugImageWriter(const std::string& camera_name, const std::string& output_path, cv::Point2f target_px,
+                                   int queue_size, bool start_thread)
+: camera_name_(camera_name),
+  output_path_(output_path),
+  target_px_(target_px),
+  mutex_(),
+  cv_(),
+  slots_(std::max(queue_size, 1)),
+  head_(0),
+  count_(0),
+  working_frame_(),
+  thread_running_(false),
+  thread_(),
+  dropped_frames_(0),
+  written_frames_(0)
+{
+    if (start_thread)
+    {
+        thread_running_ = true;
+        thread_ = std::thread(&DebugImageWriter::threadLoop, this);
+    }
+}
+
+DebugImageWriter::~DebugImageWriter()
+{
+    if (thread_running_)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            thread_running_ = false;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+}
+
+void DebugImageWriter::submit(const cv::Mat& img_raw, const cv::Mat& img_undistorted, const cv::Mat& img_thresh,
+                              const std::vector<cv::KeyPoint>& keypoints, cv::Point2f best_keypoint, Eigen::Vector2f best_point_m)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const int num_slots = static_cast<int>(slots_.size());
+        if (count_ == num_slots)
+        {
+            // Drop the oldest pending frame and reuse its slot
+            head_ = (head_ + 1) % num_slots;
+            count_--;
+            dropped_frames_++;
+        }
+        Frame& slot = slots_[(head_ + count_) % num_slots];
+        // copyTo reuses the slot memory once it has seen a frame of this size
+        img_raw.copyTo(slot.img_raw);
+        img_undistorted.copyTo(slot.img_undistorted);
+        img_thresh.copyTo(slot.img_thresh);
+        slot.keypoints.assign(keypoints.begin(), keypoints.end());
+        slot.best_keypoint = best_keypoint;
+        slot.best_point_m = best_point_m;
+        count_++;
+    }
+    cv_.notify_one();
+}
+
+bool DebugImageWriter::writeOne()
+{
+    if (!takeFrame(working_frame_, /*wait=*/ false)) return false;
+    writeFrame(working_frame_);
+    return true;
+}
+
+bool DebugImageWriter::takeFrame(Frame& frame, bool wait)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (wait)
+    {
+        cv_.wait(lock, [this]{ return count_ > 0 || !thread_running_; });
+    }
+    if (count_ == 0) return false;
+
+    Frame& slot = slots_[head_];
+    std::swap(frame.img_raw, slot.img_raw);
+    std::swap(frame.img_undistorted, slot.img_undistorted);
+    std::swap(frame.img_thresh, slot.img_thresh);
+    std::swap(frame.keypoints, slot.keypoints);
+    frame.best_keypoint = slot.best_keypoint;
+    frame.best_point_m = slot.best_point_m;
+    head_ = (head_ + 1) % static_cast<int>(slots_.size());
+    count_--;
+    return true;
+}
+
+void DebugImageWriter::threadLoop()
+{
+    // Encoding is best effort, so only use cpu time nothing else wants
+    struct sched_param param;
+    param.sched_priority = 0;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    if (rc != 0) PLOGW.printf("Could not lower %s debug writer priority: %s", camera_name_.c_str(), strerror(rc));
+
+    while (thread_running_)
+    {
+        if (takeFrame(working_frame_, /*wait=*/ true))
+        {
+            writeFrame(working_frame_);
+        }
+    }
+}
+
+void DebugImageWriter::writeFrame(Frame& frame)
+{
+    cv::imwrite(output_path_ + "img_raw.jpg", frame.img_raw);
+    cv::imwrite(output_path_ + "img_undistorted.jpg", frame.img_undistorted);
+    cv::imwrite(output_path_ + "img_thresh.jpg", frame.img_thresh);
+
+    cv::Mat img_with_keypoints;
+    cv::drawKeypoints(frame.img_thresh, frame.keypoints, img_with_keypoints, cv::Scalar(0,0,255), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
+    cv::imwrite(output_path_ + "img_keypoints.jpg", img_with_keypoints);
+
+    // The undistorted copy is owned by the writer, so it is safe to draw on directly
+    cv::Mat& img_with_best_keypoint = frame.img_undistorted;
+    cv::circle(img_with_best_keypoint, frame.best_keypoint, 1, cv::Scalar(0,0,255), -1);
+    cv::circle(img_with_best_keypoint, frame.best_keypoint, 10, cv::Scalar(0,0,255), 5);
+    std::string label_text = "Best:" + std::to_string(frame.best_point_m[0]) +"m,"+ std::to_string(frame.best_point_m[1]) + "m";
+    cv::putText(img_with_best_keypoint, //target image
+                label_text, //text
+                cv::Point(10, 20), //top-left position
+                cv::FONT_HERSHEY_DUPLEX,
+                0.5,
+                CV_RGB(255,0,0), //font color
+                1);
+    cv::circle(img_with_best_keypoint, target_px_, 5, cv::Scalar(255,0,0), -1);
+    std::string label_text2 = "Target:" + std::to_string(target_px_.x) +"px, "+ std::to_string(target_px_.y) + "px";
+    cv::putText(img_with_best_keypoint, //target image
+                label_text2, //text
+                cv::Point(10, 40), //top-left position
+                cv::FONT_HERSHEY_DUPLEX,
+                0.5,
+                CV_RGB(0,0,255), //font color
+                1);
+    cv::imwrite(output_path_ + "img_best_keypoint.jpg", img_with_best_keypoint);
+
+    written_frames_++;
+    PLOGI.printf("Wrote debug images %s", camera_name_.c_str());
+}
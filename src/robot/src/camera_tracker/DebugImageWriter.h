@@ -0,0 +1,72 @@
+#ifndef DebugImageWriter_h
+#define DebugImageWriter_h
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Dense>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Renders and encodes camera debug images on a background thread so the capture thread only pays for
+// copying the images. Frames are queued in a fixed number of slots whose buffers are reused; when all
+// slots are pending the oldest one is overwritten.
+class DebugImageWriter
+{
+  public:
+
+    // output_path is the directory prefix for the images, target_px the target point in image coordinates
+    DebugImageWriter(const std::string& camera_name, const std::string& output_path, cv::Point2f target_px,
+                     int queue_size, bool start_thread);
+
+    ~DebugImageWriter();
+
+    // Copies the images into the queue. Called from the capture thread.
+    void submit(const cv::Mat& img_raw, const cv::Mat& img_undistorted, const cv::Mat& img_thresh,
+                const std::vector<cv::KeyPoint>& keypoints, cv::Point2f best_keypoint, Eigen::Vector2f best_point_m);
+
+    // Renders and writes the oldest pending frame. Returns false if nothing was pending.
+    bool writeOne();
+
+    uint32_t getDroppedFrames() const { return dropped_frames_; };
+
+    uint32_t getWrittenFrames() const { return written_frames_; };
+
+  private:
+
+    struct Frame
+    {
+      cv::Mat img_raw;
+      cv::Mat img_undistorted;
+      cv::Mat img_thresh;
+      std::vector<cv::KeyPoint> keypoints;
+      cv::Point2f best_keypoint;
+      Eigen::Vector2f best_point_m;
+    };
+
+    void threadLoop();
+
+    // Takes the oldest pending frame, swapping buffers with frame so both keep their memory
+    bool takeFrame(Frame& frame, bool wait);
+
+    void writeFrame(Frame& frame);
+
+    std::string camera_name_;
+    std::string output_path_;
+    cv::Point2f target_px_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Frame> slots_;
+    int head_;                 // Oldest pending slot
+    int count_;                // Number of pending slots
+    Frame working_frame_;      // Owned by the writer while rendering
+
+    std::atomic<bool> thread_running_;
+    std::thread thread_;
+    std::atomic<uint32_t> dropped_frames_;
+    std::atomic<uint32_t> written_frames_;
+};
+
+#endif //DebugImageWriter_h
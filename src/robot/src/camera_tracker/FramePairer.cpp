@@ -0,0 +1,149 @@
+#include "FramePairer.h"
+
+#include <plog/Log.h>
+
+FramePairer::FramePairer(int history_size, int max_skew_ms, int num_cameras, int standalone_wait_ms)
+: rings_(),
+  candidates_(),
+  max_skew_(std::chrono::milliseconds(max_skew_ms)),
+  standalone_wait_(std::chrono::milliseconds(standalone_wait_ms)),
+  use_standalone_(standalone_wait_ms >= 0),
+  new_data_(false),
+  rejected_pairs_(0),
+  last_skew_ms_(0)
+{
+    if(num_cameras > MAX_CAMERAS)
+    {
+        PLOGE.printf("%i cameras configured, only using the first %i", num_cameras, MAX_CAMERAS);
+        num_cameras = MAX_CAMERAS;
+    }
+    rings_.resize(std::max(num_cameras, 1));
+    for (Ring& ring : rings_)
+    {
+        ring.entries.resize(std::max(history_size, 1));
+    }
+    candidates_.reserve(rings_.size() * rings_.front().entries.size());
+}
+
+void FramePairer::Ring::add(const CameraPipelineOutput& output)
+{
+    if(count == static_cast<int>(entries.size()))
+    {
+        head = (head + 1) % entries.size();
+        count--;
+    }
+    entries[(head + count) % entries.size()] = output;
+    count++;
+}
+
+void FramePairer::Ring::dropUpTo(int i)
+{
+    head = (head + i + 1) % entries.size();
+    count -= i + 1;
+}
+
+void FramePairer::add(int camera, const CameraPipelineOutput& output)
+{
+    if(camera < 0 || camera >= numCameras()) return;
+    Ring& ring = rings_[camera];
+    if(!output.ok || (ring.count > 0 && output.timestamp <= ring.at(ring.count - 1).timestamp)) return;
+    ring.add(output);
+    new_data_ = true;
+}
+
+FramePairer::Group FramePairer::groupFrom(ClockTimePoint anchor)
+{
+    Group group;
+    group.count = 0;
+    group.standalone = false;
+    for (int c = 0; c < numCameras(); c++)
+    {
+        // Entries are in capture order, so the first one in the window from the back is the newest
+        Ring& ring = rings_[c];
+        group.index[c] = -1;
+        for (int i = ring.count - 1; i >= 0; i--)
+        {
+            ClockTimePoint ts = ring.at(i).timestamp;
+            if(ts < anchor) break;
+            if(ts - anchor > max_skew_) continue;
+            group.index[c] = i;
+            group.standalone |= ring.at(i).num_points >= 2;
+            if(group.count == 0 || ts < group.oldest) group.oldest = ts;
+            if(group.count == 0 || ts > group.newest) group.newest = ts;
+            group.count++;
+            break;
+        }
+    }
+    return group;
+}
+
+bool FramePairer::getGroup(CameraPipelineOutput* outputs, bool* used, int min_cameras)
+{
+    int cameras_with_data = 0;
+    for (const Ring& ring : rings_)
+    {
+        if(ring.count > 0) cameras_with_data++;
+    }
+    min_cameras = std::max(min_cameras, 1);
+    if(cameras_with_data < min_cameras && !use_standalone_) return false;
+    const ClockTimePoint now = ClockFactory::getFactoryInstance()->get_clock()->now();
+
+    // Rings are only a few entries long, so just try every detection as the start of the window. Each window 
+    // takes the newest detection of each camera in it, which keeps every pair of frames within the skew.
+    std::vector<Group>& candidates = candidates_;
+    candidates.clear();
+    bool waiting = false;
+    for (int c = 0; c < numCameras(); c++)
+    {
+        for (int i = 0; i < rings_[c].count; i++)
+        {
+            Group group = groupFrom(rings_[c].at(i).timestamp);
+            // Short groups wait in case the rest of a full one is still being processed
+            const bool alone_ok = use_standalone_ && group.standalone && now - group.newest >= standalone_wait_;
+            if(group.count >= min_cameras || alone_ok) candidates.push_back(group);
+            else if(use_standalone_ && group.standalone) waiting = true;
+        }
+    }
+    bool found = !candidates.empty();
+    if(found)
+    {
+        ClockTimePoint freshest = candidates.front().oldest;
+        for (const Group& group : candidates)
+        {
+            freshest = std::max(freshest, group.oldest);
+        }
+        const Group* best = nullptr;
+        for (const Group& group : candidates)
+        {
+            if(freshest - group.oldest > max_skew_) continue;
+            if(!best || group.count > best->count || (group.count == best->count && group.oldest > best->oldest)) best = &group;
+        }
+
+        for (int c = 0; c < numCameras(); c++)
+        {
+            used[c] = best->index[c] >= 0;
+            if(!used[c]) continue;
+            outputs[c] = rings_[c].at(best->index[c]);
+            rings_[c].dropUpTo(best->index[c]);
+        }
+        last_skew_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(best->newest - best->oldest).count();
+    }
+
+    // Not rejected yet while a detection could still be used alone
+    if(found || !waiting)
+    {
+        if(!found && new_data_) rejected_pairs_++;
+        new_data_ = false;
+    }
+    return found;
+}
+
+bool FramePairer::getPair(CameraPipelineOutput& side, CameraPipelineOutput& rear)
+{
+    CameraPipelineOutput outputs[MAX_CAMERAS];
+    bool used[MAX_CAMERAS];
+    if(!getGroup(outputs, used, numCameras())) return false;
+    side = outputs[0];
+    rear = outputs[1];
+    return true;
+}
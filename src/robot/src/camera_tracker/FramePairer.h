@@ -0,0 +1,77 @@
+#ifndef FramePairer_h
+#define FramePairer_h
+
+#include "CameraPipeline.h"
+#include <vector>
+
+// Buffers recent detections from each camera and matches them up by capture time, so the pose is only
+// solved from frames taken close together. The side/rear calls are the two camera case, with side as
+// camera 0 and rear as camera 1.
+class FramePairer
+{
+  public:
+
+    // A detection with at least two marker pattern points can make a pose on its own. It is used alone if no
+    // group of min_cameras turned up by standalone_wait_ms after it was captured, negative never uses it alone.
+    FramePairer(int history_size, int max_skew_ms, int num_cameras = 2, int standalone_wait_ms = -1);
+
+    // Adds the latest output from a camera. Outputs that aren't ok or are no newer than the last one are ignored.
+    void add(int camera, const CameraPipelineOutput& output);
+    void addSide(const CameraPipelineOutput& output) { add(0, output); };
+    void addRear(const CameraPipelineOutput& output) { add(1, output); };
+
+    // Finds a group of detections from at least min_cameras cameras, all within the skew window. outputs and
+    // used have an entry per camera, used says which outputs were filled in. Detections at or before the ones
+    // returned are consumed so they can't be used again.
+    //
+    // The freshest group is the one whose oldest frame is newest. A group with more cameras is preferred if its
+    // oldest frame is at most one skew window older than that. Single camera groups only count as described
+    // for the constructor.
+    bool getGroup(CameraPipelineOutput* outputs, bool* used, int min_cameras);
+
+    // Freshest side/rear pair within the skew window
+    bool getPair(CameraPipelineOutput& side, CameraPipelineOutput& rear);
+
+    // Number of times new detections were available but none made a group close enough in time
+    uint32_t getRejectedPairs() const { return rejected_pairs_; };
+
+    // Capture time spread of the last returned group
+    int getLastSkewMs() const { return last_skew_ms_; };
+
+    int numCameras() const { return static_cast<int>(rings_.size()); };
+
+  private:
+
+    struct Ring
+    {
+        std::vector<CameraPipelineOutput> entries;
+        int head = 0;         // Oldest entry
+        int count = 0;
+
+        CameraPipelineOutput& at(int i) { return entries[(head + i) % entries.size()]; };
+        void add(const CameraPipelineOutput& output);
+        void dropUpTo(int i);  // Drops entries 0..i
+    };
+
+    // Newest detection of each camera in the window starting at the anchor time, -1 for cameras without one
+    struct Group
+    {
+        int index[MAX_CAMERAS];
+        int count;
+        ClockTimePoint oldest;
+        ClockTimePoint newest;
+        bool standalone;      // Has a detection that can make a pose alone
+    };
+    Group groupFrom(ClockTimePoint anchor);
+
+    std::vector<Ring> rings_;
+    std::vector<Group> candidates_;   // Reused by getGroup
+    ClockTimePoint::duration max_skew_;
+    ClockTimePoint::duration standalone_wait_;
+    bool use_standalone_;
+    bool new_data_;
+    uint32_t rejected_pairs_;
+    int last_skew_ms_;
+};
+
+#endif //FramePairer_h
@@ -0,0 +1,151 @@
+#include "FusedUndistortThreshold.h"
+
+#include <cmath>
+#include <plog/Log.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FUSED_KERNEL_USE_NEON 1
+#endif
+
+// Fractional bits of the bilinear weights, same as OpenCV's INTER_BITS
+#define FRAC_BITS 5
+#define FRAC_SCALE (1 << FRAC_BITS)
+
+FusedUndistortThreshold::FusedUndistortThreshold()
+: size_(0, 0),
+  table_(),
+  src_step_(0)
+{}
+
+void FusedUndistortThreshold::init(const cv::Mat& K, const cv::Mat& D, cv::Size image_size)
+{
+    cv::Mat map_x;
+    cv::Mat map_y;
+    cv::initUndistortRectifyMap(K, D, cv::Mat(), K, image_size, CV_32FC1, map_x, map_y);
+    initFromMaps(map_x, map_y);
+}
+
+void FusedUndistortThreshold::initFromMaps(const cv::Mat& map_x, const cv::Mat& map_y)
+{
+    size_ = map_x.size();
+    src_step_ = size_.width;
+    table_.resize(size_.width * size_.height);
+
+    for (int r = 0; r < size_.height; r++)
+    {
+        const float* xs = map_x.ptr<float>(r);
+        const float* ys = map_y.ptr<float>(r);
+        for (int c = 0; c < size_.width; c++)
+        {
+            int x0 = static_cast<int>(std::floor(xs[c]));
+            int y0 = static_cast<int>(std::floor(ys[c]));
+            int fx = static_cast<int>(std::lround((xs[c] - x0) * FRAC_SCALE));
+            int fy = static_cast<int>(std::lround((ys[c] - y0) * FRAC_SCALE));
+            if (fx == FRAC_SCALE) { x0++; fx = 0; }
+            if (fy == FRAC_SCALE) { y0++; fy = 0; }
+            // Exactly on the last row or column only the pixel itself contributes
+            if (x0 == size_.width - 1 && fx == 0) { x0--; fx = FRAC_SCALE; }
+            if (y0 == size_.height - 1 && fy == 0) { y0--; fy = FRAC_SCALE; }
+
+            Entry& e = table_[r * size_.width + c];
+            // Pixels whose 2x2 neighbourhood leaves the source image are treated as outside (value 0)
+            bool inside = x0 >= 0 && y0 >= 0 && x0 + 1 < size_.width && y0 + 1 < size_.height;
+            e.offset = inside ? y0 * src_step_ + x0 : -1;
+            e.fx = static_cast<uint8_t>(fx);
+            e.fy = static_cast<uint8_t>(fy);
+        }
+    }
+}
+
+void FusedUndistortThreshold::apply(const cv::Mat& src, cv::Mat& dst, int threshold, cv::Rect roi)
+{
+    if (src.size() != size_ || src.type() != CV_8UC1)
+    {
+        PLOGE << "Fused kernel source does not match lookup table";
+        return;
+    }
+    if (dst.rows != roi.height || dst.cols != roi.width || dst.type() != CV_8UC1)
+    {
+        dst.create(roi.height, roi.width, CV_8UC1);
+    }
+    // Offsets in the table assume a continuous source
+    cv::Mat continuous_src = src.isContinuous() ? src : src.clone();
+    const uint8_t* src_data = continuous_src.ptr<uint8_t>(0);
+
+    for (int r = 0; r < roi.height; r++)
+    {
+        const Entry* table_row = table_.data() + (roi.y + r) * size_.width + roi.x;
+        uint8_t* out = dst.ptr<uint8_t>(r);
+#ifdef FUSED_KERNEL_USE_NEON
+        applyRowNeon(src_data, src_step_, table_row, out, roi.width, threshold);
+#else
+        applyRowScalar(src_data, src_step_, table_row, out, roi.width, threshold);
+#endif
+    }
+}
+
+void FusedUndistortThreshold::applyRowScalar(const uint8_t* src, int src_step, const Entry* table, uint8_t* out, int len, int threshold)
+{
+    for (int i = 0; i < len; i++)
+    {
+        const Entry& e = table[i];
+        int val = 0;
+        if (e.offset >= 0)
+        {
+            const uint8_t* p = src + e.offset;
+            int top = p[0] * (FRAC_SCALE - e.fx) + p[1] * e.fx;
+            int bot = p[src_step] * (FRAC_SCALE - e.fx) + p[src_step + 1] * e.fx;
+            val = (top * (FRAC_SCALE - e.fy) + bot * e.fy + (1 << (2 * FRAC_BITS - 1))) >> (2 * FRAC_BITS);
+        }
+        out[i] = val > threshold ? 0 : 255;
+    }
+}
+
+void FusedUndistortThreshold::applyRowNeon(const uint8_t* src, int src_step, const Entry* table, uint8_t* out, int len, int threshold)
+{
+#ifdef FUSED_KERNEL_USE_NEON
+    const uint8x8_t scale = vdup_n_u8(FRAC_SCALE);
+    const uint8x8_t thresh = vdup_n_u8(static_cast<uint8_t>(std::max(0, std::min(255, threshold))));
+    int i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        // NEON has no gather, so collect the neighbourhoods first and do the arithmetic in lanes
+        uint8_t p00[8], p01[8], p10[8], p11[8], fxs[8], fys[8];
+        for (int j = 0; j < 8; j++)
+        {
+            const Entry& e = table[i + j];
+            if (e.offset >= 0)
+            {
+                const uint8_t* p = src + e.offset;
+                p00[j] = p[0];
+                p01[j] = p[1];
+                p10[j] = p[src_step];
+                p11[j] = p[src_step + 1];
+            }
+            else
+            {
+                p00[j] = p01[j] = p10[j] = p11[j] = 0;
+            }
+            fxs[j] = e.fx;
+            fys[j] = e.fy;
+        }
+        uint8x8_t fx = vld1_u8(fxs);
+        uint8x8_t fy = vld1_u8(fys);
+        uint8x8_t ifx = vsub_u8(scale, fx);
+        uint16x8_t top = vmlal_u8(vmull_u8(vld1_u8(p00), ifx), vld1_u8(p01), fx);
+        uint16x8_t bot = vmlal_u8(vmull_u8(vld1_u8(p10), ifx), vld1_u8(p11), fx);
+        uint16x8_t ify = vmovl_u8(vsub_u8(scale, fy));
+        uint16x8_t fy16 = vmovl_u8(fy);
+        uint32x4_t lo = vmlal_u16(vmull_u16(vget_low_u16(top), vget_low_u16(ify)), vget_low_u16(bot), vget_low_u16(fy16));
+        uint32x4_t hi = vmlal_u16(vmull_u16(vget_high_u16(top), vget_high_u16(ify)), vget_high_u16(bot), vget_high_u16(fy16));
+        uint16x8_t val16 = vcombine_u16(vrshrn_n_u32(lo, 2 * FRAC_BITS), vrshrn_n_u32(hi, 2 * FRAC_BITS));
+        uint8x8_t val = vqmovn_u16(val16);
+        // Inverse binary threshold: 0 where val > threshold, 255 elsewhere
+        vst1_u8(out + i, vmvn_u8(vcgt_u8(val, thresh)));
+    }
+    applyRowScalar(src, src_step, table + i, out + i, len - i, threshold);
+#else
+    applyRowScalar(src, src_step, table, out, len, threshold);
+#endif
+}
@@ -0,0 +1,47 @@
+#ifndef FusedUndistortThreshold_h
+#define FusedUndistortThreshold_h
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+// Does the undistortion remap (bilinear) and the inverse binary threshold in one pass, writing
+// straight into a reused output buffer. Equivalent to cv::remap(INTER_LINEAR, BORDER_CONSTANT 0)
+// followed by cv::threshold(THRESH_BINARY_INV, maxval 255), but without the intermediate image.
+// The interpolation and compare run 8 pixels at a time with NEON where available.
+class FusedUndistortThreshold
+{
+  public:
+    FusedUndistortThreshold();
+
+    // Builds the lookup table for undistorting with K and D (K is reused as the new camera matrix)
+    void init(const cv::Mat& K, const cv::Mat& D, cv::Size image_size);
+
+    // Builds the lookup table from float maps of source x and y coordinates (CV_32FC1), as produced by
+    // cv::initUndistortRectifyMap
+    void initFromMaps(const cv::Mat& map_x, const cv::Mat& map_y);
+
+    // Writes the thresholded, undistorted roi of src (CV_8UC1, same size as the maps) into dst
+    void apply(const cv::Mat& src, cv::Mat& dst, int threshold, cv::Rect roi);
+
+    cv::Size size() const { return size_; };
+
+  private:
+
+    // Per output pixel source offset and bilinear fractions, in 1/32nds of a pixel like OpenCV's INTER_BITS
+    struct Entry
+    {
+        int32_t offset;     // Index of the top left source pixel, or -1 if the source is outside the image
+        uint8_t fx;
+        uint8_t fy;
+    };
+
+    void applyRowScalar(const uint8_t* src, int src_step, const Entry* table, uint8_t* out, int len, int threshold);
+    void applyRowNeon(const uint8_t* src, int src_step, const Entry* table, uint8_t* out, int len, int threshold);
+
+    cv::Size size_;
+    std::vector<Entry> table_;
+    int src_step_;
+};
+
+#endif //FusedUndistortThreshold_h
@@ -0,0 +1,58 @@
+#include "GroundLut.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+GroundLut::GroundLut()
+: table_()
+{}
+
+void GroundLut::init(const cv::Mat& K, const cv::Mat& D, const Eigen::Matrix3f& ground_from_pixel, cv::Size image_size)
+{
+    // Undistorting every pixel center in one call is far cheaper than one call per point, and only runs once
+    std::vector<cv::Point2f> distorted;
+    distorted.reserve(image_size.area());
+    for (int y = 0; y < image_size.height; y++)
+    {
+        for (int x = 0; x < image_size.width; x++)
+        {
+            distorted.emplace_back(x, y);
+        }
+    }
+    std::vector<cv::Point2f> undistorted;
+    cv::undistortPoints(distorted, undistorted, K, D, cv::noArray(), K);
+
+    table_.create(image_size, CV_32FC2);
+    for (int y = 0; y < image_size.height; y++)
+    {
+        float* row = table_.ptr<float>(y);
+        for (int x = 0; x < image_size.width; x++)
+        {
+            const cv::Point2f& uv = undistorted[y * image_size.width + x];
+            const Eigen::Vector3f ground = ground_from_pixel * Eigen::Vector3f(uv.x, uv.y, 1);
+            row[2 * x] = ground[0] / ground[2];
+            row[2 * x + 1] = ground[1] / ground[2];
+        }
+    }
+}
+
+Eigen::Vector2f GroundLut::lookup(cv::Point2f pt) const
+{
+    // Top left of the four entries around pt, kept one short of the edge so the other three exist
+    const float x = std::min(std::max(pt.x, 0.0f), static_cast<float>(table_.cols - 1));
+    const float y = std::min(std::max(pt.y, 0.0f), static_cast<float>(table_.rows - 1));
+    const int x0 = std::min(static_cast<int>(x), table_.cols - 2);
+    const int y0 = std::min(static_cast<int>(y), table_.rows - 2);
+    const float fx = x - x0;
+    const float fy = y - y0;
+
+    const float* top = table_.ptr<float>(y0) + 2 * x0;
+    const float* bottom = table_.ptr<float>(y0 + 1) + 2 * x0;
+    Eigen::Vector2f value;
+    for (int i = 0; i < 2; i++)
+    {
+        value[i] = (1 - fy) * ((1 - fx) * top[i] + fx * top[i + 2]) + fy * ((1 - fx) * bottom[i] + fx * bottom[i + 2]);
+    }
+    return value;
+}
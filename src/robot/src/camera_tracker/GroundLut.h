@@ -0,0 +1,32 @@
+#ifndef GroundLut_h
+#define GroundLut_h
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Dense>
+
+// Maps raw (distorted) pixel coordinates straight to the point on the ground plane they see, in the robot
+// frame. One entry is kept per pixel center and subpixel points are interpolated bilinearly between the four
+// around them, so undistorting and projecting a detection is a single lookup and the image itself never has
+// to be undistorted.
+class GroundLut
+{
+  public:
+    GroundLut();
+
+    // ground_from_pixel takes undistorted homogeneous pixels to homogeneous ground points. K and D undistort
+    // the pixel centers first, with K reused as the new camera matrix like the undistortion maps.
+    void init(const cv::Mat& K, const cv::Mat& D, const Eigen::Matrix3f& ground_from_pixel, cv::Size image_size);
+
+    bool ready() const { return !table_.empty(); };
+
+    cv::Size size() const { return table_.size(); };
+
+    // Points outside the image are clamped to its edge
+    Eigen::Vector2f lookup(cv::Point2f pt) const;
+
+  private:
+
+    cv::Mat table_;     // CV_32FC2, ground x and y for each pixel center
+};
+
+#endif //GroundLut_h
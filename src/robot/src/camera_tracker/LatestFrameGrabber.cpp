@@ -0,0 +1,91 @@
+#include "LatestFrameGrabber.h"
+
+#include <plog/Log.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+LatestFrameGrabber::LatestFrameGrabber(cv::VideoCapture& capture)
+: capture_(capture),
+  mutex_(),
+  frame_cv_(),
+  latest_(),
+  latest_timestamp_ms_(0),
+  latest_fresh_(false),
+  ready_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  running_(false),
+  dropped_frames_(0),
+  thread_()
+{
+    if(ready_fd_ < 0) PLOGW << "Could not create frame grabber eventfd: " << strerror(errno);
+}
+
+LatestFrameGrabber::~LatestFrameGrabber()
+{
+    stop();
+    if(ready_fd_ >= 0) close(ready_fd_);
+}
+
+void LatestFrameGrabber::start()
+{
+    if(running_) return;
+    running_ = true;
+    thread_ = std::thread(&LatestFrameGrabber::threadLoop, this);
+}
+
+void LatestFrameGrabber::stop()
+{
+    if(!running_) return;
+    // The thread notices after its current read returns, at most a frame period
+    running_ = false;
+    thread_.join();
+    frame_cv_.notify_all();
+}
+
+void LatestFrameGrabber::threadLoop()
+{
+    cv::Mat back;
+    while(running_)
+    {
+        if(!capture_.read(back) || back.empty())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        double timestamp_ms = capture_.get(cv::CAP_PROP_POS_MSEC);
+        bool was_fresh;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv::swap(back, latest_);
+            latest_timestamp_ms_ = timestamp_ms;
+            was_fresh = latest_fresh_;
+            latest_fresh_ = true;
+            // Signalled under the lock so the eventfd state always matches latest_fresh_
+            uint64_t one = 1;
+            if(ready_fd_ >= 0 && !was_fresh && write(ready_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            {
+                PLOGW << "Could not signal frame ready: " << strerror(errno);
+            }
+        }
+        if(was_fresh) dropped_frames_++;
+        frame_cv_.notify_one();
+    }
+}
+
+bool LatestFrameGrabber::take(cv::Mat& frame, double* timestamp_ms, int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(!frame_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return latest_fresh_ || !running_; })) return false;
+    if(!latest_fresh_) return false;
+    cv::swap(frame, latest_);
+    *timestamp_ms = latest_timestamp_ms_;
+    latest_fresh_ = false;
+    if(ready_fd_ >= 0)
+    {
+        uint64_t count;
+        ssize_t n = read(ready_fd_, &count, sizeof(count));
+        (void) n;
+    }
+    return true;
+}
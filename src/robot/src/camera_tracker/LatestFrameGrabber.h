@@ -0,0 +1,52 @@
+#ifndef LatestFrameGrabber_h
+#define LatestFrameGrabber_h
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Reads a cv::VideoCapture on its own thread as fast as frames arrive and keeps only the newest one, so
+// a consumer that is slower than the camera always gets the latest frame instead of working through the
+// driver queue. Frames rotate between three buffers so steady state reading doesn't allocate.
+class LatestFrameGrabber
+{
+  public:
+
+    // The capture must be open and outlive the grabber, and must not be read by anything else while it runs
+    explicit LatestFrameGrabber(cv::VideoCapture& capture);
+
+    ~LatestFrameGrabber();
+
+    void start();
+
+    void stop();
+
+    // Waits up to timeout_ms for a frame newer than the last one taken and swaps it into frame. frame's old
+    // buffer is reused for later reads. timestamp_ms is the capture's CAP_PROP_POS_MSEC for the frame.
+    bool take(cv::Mat& frame, double* timestamp_ms, int timeout_ms = 1000);
+
+    // eventfd that is readable while an untaken frame is waiting, -1 if it couldn't be created
+    int readyFd() const { return ready_fd_; }
+
+    // Frames that were replaced before anyone took them
+    uint32_t droppedFrames() const { return dropped_frames_; }
+
+  private:
+
+    void threadLoop();
+
+    cv::VideoCapture& capture_;
+    std::mutex mutex_;
+    std::condition_variable frame_cv_;
+    cv::Mat latest_;                // Guarded by mutex_
+    double latest_timestamp_ms_;
+    bool latest_fresh_;
+    int ready_fd_;
+    std::atomic<bool> running_;
+    std::atomic<uint32_t> dropped_frames_;
+    std::thread thread_;
+};
+
+#endif //LatestFrameGrabber_h
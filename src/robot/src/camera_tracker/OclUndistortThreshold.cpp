@@ -0,0 +1,44 @@
+#include "OclUndistortThreshold.h"
+
+#include <plog/Log.h>
+#include <opencv2/core/ocl.hpp>
+
+OclUndistortThreshold::OclUndistortThreshold()
+: ready_(false),
+  map_1_(),
+  map_2_(),
+  src_(),
+  undistorted_(),
+  thresh_()
+{}
+
+bool OclUndistortThreshold::init(const cv::Mat& map_1, const cv::Mat& map_2)
+{
+    ready_ = false;
+    if(!cv::ocl::haveOpenCL())
+    {
+        PLOGW << "OpenCL not available, camera preprocessing stays on the CPU";
+        return false;
+    }
+    cv::ocl::setUseOpenCL(true);
+    if(!cv::ocl::useOpenCL() || !cv::ocl::Device::getDefault().available())
+    {
+        PLOGW << "No usable OpenCL device, camera preprocessing stays on the CPU";
+        return false;
+    }
+
+    map_1.copyTo(map_1_);
+    map_2.copyTo(map_2_);
+    ready_ = true;
+    PLOGI << "Camera preprocessing on OpenCL device " << cv::ocl::Device::getDefault().name();
+    return true;
+}
+
+void OclUndistortThreshold::apply(const cv::Mat& src, cv::Mat& dst, int threshold, cv::Rect roi)
+{
+    // Remap can pull from anywhere in the frame, so the whole frame goes up. The cropped maps keep the work to the roi.
+    src.copyTo(src_);
+    cv::remap(src_, undistorted_, map_1_(roi), map_2_(roi), cv::INTER_LINEAR);
+    cv::threshold(undistorted_, thresh_, threshold, 255, cv::THRESH_BINARY_INV);
+    thresh_.copyTo(dst);
+}
@@ -0,0 +1,36 @@
+#ifndef OclUndistortThreshold_h
+#define OclUndistortThreshold_h
+
+#include <opencv2/opencv.hpp>
+
+// Runs the undistortion remap and the inverse binary threshold on an OpenCL device through OpenCV's
+// transparent API, so the camera threads don't spend CPU on them. Gives the same result as the CPU
+// remap and threshold in CameraPipeline. The frame is uploaded once and only the thresholded roi is read back,
+// which is all blob detection needs.
+class OclUndistortThreshold
+{
+  public:
+    OclUndistortThreshold();
+
+    // Uploads the fixed point undistortion maps (CV_16SC2 and CV_16UC1 from cv::initUndistortRectifyMap).
+    // Returns false if there is no usable OpenCL device, in which case apply must not be called.
+    bool init(const cv::Mat& map_1, const cv::Mat& map_2);
+
+    bool ready() const { return ready_; }
+
+    // Writes the thresholded, undistorted roi of src (CV_8UC1, same size as the maps) into dst
+    void apply(const cv::Mat& src, cv::Mat& dst, int threshold, cv::Rect roi);
+
+  private:
+
+    bool ready_;
+    cv::UMat map_1_;
+    cv::UMat map_2_;
+
+    // Device buffers reused every frame
+    cv::UMat src_;
+    cv::UMat undistorted_;
+    cv::UMat thresh_;
+};
+
+#endif //OclUndistortThreshold_h
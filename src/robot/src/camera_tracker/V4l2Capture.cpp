@@ -0,0 +1,353 @@
+#include "V4l2Capture.h"
+
+#include <plog/Log.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+namespace
+{
+    // ioctl that retries when interrupted by a signal
+    int xioctl(int fd, unsigned long request, void* arg)
+    {
+        int r;
+        do
+        {
+            r = ioctl(fd, request, arg);
+        } while (r == -1 && errno == EINTR);
+        return r;
+    }
+}
+
+V4l2Capture::V4l2Capture()
+: fd_(-1),
+  buffers_(),
+  held_buffer_(-1),
+  streaming_(false),
+  grey_(false),
+  width_(0),
+  height_(0),
+  fps_(0),
+  bytes_per_line_(0),
+  y_buffer_(),
+  dropped_frames_(0)
+{}
+
+V4l2Capture::~V4l2Capture()
+{
+    close();
+}
+
+bool V4l2Capture::open(const std::string& device_path, int width, int height, int fps, int num_buffers)
+{
+    close();
+    fd_ = ::open(device_path.c_str(), O_RDWR | O_NONBLOCK);
+    if(fd_ < 0)
+    {
+        PLOGW.printf("Could not open V4L2 device %s: %s", device_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if(xioctl(fd_, VIDIOC_QUERYCAP, &cap) == -1 || !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING))
+    {
+        PLOGW.printf("%s is not a V4L2 streaming capture device", device_path.c_str());
+        close();
+        return false;
+    }
+
+    // Prefer GREY so frames can be used in place, otherwise YUYV which every UVC camera offers
+    v4l2_format fmt;
+    bool format_ok = false;
+    for (uint32_t pixel_format : {V4L2_PIX_FMT_GREY, V4L2_PIX_FMT_YUYV})
+    {
+        memset(&fmt, 0, sizeof(fmt));
+        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt.fmt.pix.width = width;
+        fmt.fmt.pix.height = height;
+        fmt.fmt.pix.pixelformat = pixel_format;
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+        // Drivers adjust the format to the nearest they support rather than failing, so check what came back
+        if(xioctl(fd_, VIDIOC_S_FMT, &fmt) == 0 && fmt.fmt.pix.pixelformat == pixel_format)
+        {
+            format_ok = true;
+            break;
+        }
+    }
+    if(!format_ok)
+    {
+        PLOGW.printf("%s offers neither GREY nor YUYV", device_path.c_str());
+        close();
+        return false;
+    }
+    grey_ = fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_GREY;
+    width_ = fmt.fmt.pix.width;
+    height_ = fmt.fmt.pix.height;
+    bytes_per_line_ = fmt.fmt.pix.bytesperline;
+    const size_t min_bytes_per_line = static_cast<size_t>(width_) * (grey_ ? 1 : 2);
+    if(bytes_per_line_ < min_bytes_per_line) bytes_per_line_ = min_bytes_per_line;
+
+    fps_ = fps;
+    requestFrameRate(fps);
+
+    v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = num_buffers;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if(xioctl(fd_, VIDIOC_REQBUFS, &req) == -1 || req.count < 2)
+    {
+        PLOGW.printf("Could not get mmap buffers for %s: %s", device_path.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < req.count; i++)
+    {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if(xioctl(fd_, VIDIOC_QUERYBUF, &buf) == -1)
+        {
+            PLOGW.printf("Could not query buffer %u for %s: %s", i, device_path.c_str(), strerror(errno));
+            close();
+            return false;
+        }
+        void* start = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buf.m.offset);
+        if(start == MAP_FAILED)
+        {
+            PLOGW.printf("Could not map buffer %u for %s: %s", i, device_path.c_str(), strerror(errno));
+            close();
+            return false;
+        }
+        buffers_.push_back({start, buf.length});
+    }
+
+    if(!startStreaming())
+    {
+        close();
+        return false;
+    }
+
+    PLOGI.printf("Opened V4L2 capture %s: %ix%i %s, %i fps, %zu buffers", device_path.c_str(), width_, height_,
+        grey_ ? "GREY" : "YUYV", fps_, buffers_.size());
+    return true;
+}
+
+void V4l2Capture::close()
+{
+    if(fd_ < 0) return;
+    if(streaming_)
+    {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(fd_, VIDIOC_STREAMOFF, &type);
+        streaming_ = false;
+    }
+    for (const Buffer& b : buffers_)
+    {
+        munmap(b.start, b.length);
+    }
+    buffers_.clear();
+    held_buffer_ = -1;
+    ::close(fd_);
+    fd_ = -1;
+}
+
+bool V4l2Capture::setControl(uint32_t id, int32_t value)
+{
+    if(fd_ < 0) return false;
+    v4l2_control control;
+    memset(&control, 0, sizeof(control));
+    control.id = id;
+    control.value = value;
+    if(xioctl(fd_, VIDIOC_S_CTRL, &control) == -1)
+    {
+        PLOGW.printf("Could not set V4L2 control 0x%08x to %i: %s", id, value, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool V4l2Capture::setExposure(bool auto_exposure, int exposure_us)
+{
+    if(fd_ < 0) return false;
+    if(auto_exposure)
+    {
+        // UVC cameras only offer aperture priority as their auto mode, most others full auto
+        v4l2_control control = {V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_APERTURE_PRIORITY};
+        if(xioctl(fd_, VIDIOC_S_CTRL, &control) == 0) return true;
+        return setControl(V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_AUTO);
+    }
+    if(!setControl(V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_MANUAL)) return false;
+    return setControl(V4L2_CID_EXPOSURE_ABSOLUTE, std::max(1, (exposure_us + 50) / 100));
+}
+
+bool V4l2Capture::setGain(int gain)
+{
+    return setControl(V4L2_CID_GAIN, gain);
+}
+
+bool V4l2Capture::setFrameRate(int fps)
+{
+    if(fd_ < 0 || fps <= 0) return false;
+    if(requestFrameRate(fps)) return true;
+    if(errno != EBUSY || !streaming_)
+    {
+        PLOGW.printf("Could not set V4L2 frame rate to %i: %s", fps, strerror(errno));
+        return false;
+    }
+
+    // Stopping the stream returns every buffer to us, including the one the last frame points into
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(fd_, VIDIOC_STREAMOFF, &type);
+    streaming_ = false;
+    held_buffer_ = -1;
+    const bool ok = requestFrameRate(fps);
+    if(!ok) PLOGW.printf("Could not set V4L2 frame rate to %i: %s", fps, strerror(errno));
+    return startStreaming() && ok;
+}
+
+bool V4l2Capture::grab(cv::Mat& frame, double* timestamp_ms, int timeout_ms)
+{
+    if(!streaming_) return false;
+
+    // The caller is done with the last frame now
+    if(held_buffer_ >= 0)
+    {
+        queueBuffer(held_buffer_);
+        held_buffer_ = -1;
+    }
+
+    pollfd pfd = {fd_, POLLIN, 0};
+    int r;
+    do
+    {
+        r = poll(&pfd, 1, timeout_ms);
+    } while (r == -1 && errno == EINTR);
+    if(r <= 0)
+    {
+        if(r == 0) PLOGW << "Timed out waiting for V4L2 frame";
+        else PLOGW << "Polling V4L2 device failed: " << strerror(errno);
+        return false;
+    }
+
+    // Drain everything that is ready and keep only the newest
+    int newest = -1;
+    size_t bytes_used = 0;
+    while (true)
+    {
+        double ts = 0;
+        size_t used = 0;
+        int index = dequeueBuffer(&ts, &used);
+        if(index < 0) break;
+        if(newest >= 0)
+        {
+            queueBuffer(newest);
+            dropped_frames_++;
+        }
+        newest = index;
+        *timestamp_ms = ts;
+        bytes_used = used;
+    }
+    if(newest < 0) return false;
+
+    const size_t frame_bytes = bytes_per_line_ * height_;
+    if(bytes_used < frame_bytes)
+    {
+        PLOGW.printf("Short V4L2 frame, %zu of %zu bytes", bytes_used, frame_bytes);
+        queueBuffer(newest);
+        return false;
+    }
+
+    if(grey_)
+    {
+        frame = cv::Mat(height_, width_, CV_8UC1, buffers_[newest].start, bytes_per_line_);
+        held_buffer_ = newest;
+    }
+    else
+    {
+        cv::Mat yuyv(height_, width_, CV_8UC2, buffers_[newest].start, bytes_per_line_);
+        cv::extractChannel(yuyv, y_buffer_, 0);
+        queueBuffer(newest);
+        frame = y_buffer_;
+    }
+    return true;
+}
+
+bool V4l2Capture::queueBuffer(int index)
+{
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    if(xioctl(fd_, VIDIOC_QBUF, &buf) == -1)
+    {
+        PLOGW.printf("Could not queue V4L2 buffer %i: %s", index, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool V4l2Capture::startStreaming()
+{
+    for (size_t i = 0; i < buffers_.size(); i++)
+    {
+        if(!queueBuffer(i)) return false;
+    }
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if(xioctl(fd_, VIDIOC_STREAMON, &type) == -1)
+    {
+        PLOGW << "Could not start V4L2 streaming: " << strerror(errno);
+        return false;
+    }
+    streaming_ = true;
+    return true;
+}
+
+bool V4l2Capture::requestFrameRate(int fps)
+{
+    v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    parm.parm.capture.timeperframe.numerator = 1;
+    parm.parm.capture.timeperframe.denominator = fps;
+    if(xioctl(fd_, VIDIOC_S_PARM, &parm) == -1) return false;
+    if(parm.parm.capture.timeperframe.numerator > 0)
+    {
+        fps_ = parm.parm.capture.timeperframe.denominator / parm.parm.capture.timeperframe.numerator;
+    }
+    return true;
+}
+
+int V4l2Capture::dequeueBuffer(double* timestamp_ms, size_t* bytes_used)
+{
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if(xioctl(fd_, VIDIOC_DQBUF, &buf) == -1)
+    {
+        if(errno != EAGAIN) PLOGW << "Could not dequeue V4L2 buffer: " << strerror(errno);
+        return -1;
+    }
+    if(buf.flags & V4L2_BUF_FLAG_ERROR)
+    {
+        queueBuffer(buf.index);
+        return dequeueBuffer(timestamp_ms, bytes_used);
+    }
+
+    const bool monotonic = (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+    *timestamp_ms = monotonic ? buf.timestamp.tv_sec * 1000.0 + buf.timestamp.tv_usec / 1000.0 : 0;
+    *bytes_used = buf.bytesused;
+    return buf.index;
+}
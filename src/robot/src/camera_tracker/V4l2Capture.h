@@ -0,0 +1,94 @@
+#ifndef V4l2Capture_h
+#define V4l2Capture_h
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Camera capture straight from V4L2 memory mapped driver buffers, for when only luminance is needed.
+// cv::VideoCapture decodes every frame to BGR, this hands out the Y plane the detection thresholds on.
+//
+// GREY frames are wrapped by a cv::Mat header over the driver buffer with no copy. YUYV interleaves luma
+// and chroma so the Y plane can't be viewed as a single channel image, it is extracted in one pass into a
+// reused buffer. grab() always returns the newest filled buffer and requeues any older ones, so frames
+// that queued up while the last one was being processed never add latency.
+class V4l2Capture
+{
+  public:
+
+    V4l2Capture();
+
+    ~V4l2Capture();
+
+    // Opens the device and starts streaming. Asks for GREY and falls back to YUYV if the driver
+    // doesn't offer it. Returns false (and logs why) if the device can't be used.
+    bool open(const std::string& device_path, int width, int height, int fps, int num_buffers);
+
+    void close();
+
+    bool isOpened() const { return fd_ >= 0; }
+
+    // Device descriptor, readable when a frame is ready. -1 if not open.
+    int fd() const { return fd_; }
+
+    // Waits up to timeout_ms for a frame and points frame at the newest one. The driver buffer behind a
+    // zero copy frame stays owned by the caller until the next grab() or close(), copy anything that has to
+    // live longer. timestamp_ms is the driver capture timestamp (CLOCK_MONOTONIC), or 0 if it has none.
+    bool grab(cv::Mat& frame, double* timestamp_ms, int timeout_ms = 1000);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int fps() const { return fps_; }
+
+    // Camera controls, applied to the open device without reopening it. Each returns false (and logs why) if
+    // the driver doesn't have the control or refuses the value, the rest of the capture is unaffected.
+    bool setControl(uint32_t id, int32_t value);
+
+    // Auto exposure on, or manual at exposure_us (of which the driver keeps 100 us steps)
+    bool setExposure(bool auto_exposure, int exposure_us);
+
+    bool setGain(int gain);
+
+    // Asks for a new frame interval, fps() is then what the driver settled on. Drivers that won't change it
+    // while streaming (UVC) get a stream restart on the same buffers, which costs a frame or two, not an open.
+    bool setFrameRate(int fps);
+
+    // True if frames are views of the driver buffers rather than copies
+    bool zeroCopy() const { return grey_; }
+
+    // Older filled buffers requeued unread by grab(), i.e. frames skipped to stay on the newest
+    uint32_t droppedFrames() const { return dropped_frames_; }
+
+  private:
+
+    struct Buffer
+    {
+      void* start;
+      size_t length;
+    };
+
+    bool queueBuffer(int index);
+
+    // Queues every buffer and turns streaming on
+    bool startStreaming();
+
+    // VIDIOC_S_PARM, updates fps_ if the driver accepts it
+    bool requestFrameRate(int fps);
+
+    // Dequeues without blocking, returns the buffer index or -1 if none is ready
+    int dequeueBuffer(double* timestamp_ms, size_t* bytes_used);
+
+    int fd_;
+    std::vector<Buffer> buffers_;
+    int held_buffer_;               // Buffer the last frame points into, requeued on the next grab
+    bool streaming_;
+    bool grey_;
+    int width_;
+    int height_;
+    int fps_;
+    size_t bytes_per_line_;
+    cv::Mat y_buffer_;              // Extracted luma for YUYV
+    uint32_t dropped_frames_;
+};
+
+#endif //V4l2Capture_h
@@ -22,29 +22,59 @@ extern libconfig::Config cfg;
 #define LOCALIZATION_LOG_ID 3
 #define MOTION_CSV_LOG_ID 4
 
-// Commands use to communicate about behavior specified from master
+// Most waypoints accepted in a single move_path command
+#define MAX_PATH_WAYPOINTS 16
+
+// Commands the robot will hold while busy, must be a power of 2
+#define COMMAND_QUEUE_SIZE 16
+
+// Largest window a TimeRunningAverage keeps, its samples are stored inline
+#define TIME_RUNNING_AVERAGE_MAX_WINDOW 128
+
+// Most cameras the vision tracker can run, see vision_tracker.cameras
+#define MAX_CAMERAS 4
+
+// Most blobs in one camera's marker pattern, see vision_tracker.physical.<camera>.pattern
+#define MAX_MARKER_POINTS 4
+
+// Most marker points one pose is solved from
+#define MAX_POSE_POINTS (MAX_CAMERAS * MAX_MARKER_POINTS)
+
+// Largest median window of the distance sensor, see distance_sensor.median_window
+#define DISTANCE_MEDIAN_MAX_WINDOW 15
+
+// Commands use to communicate about behavior specified from master. The values are the binary protocol
+// ids (see CommandRegistry.h), so new commands go on the end and existing ones are never renumbered.
 enum class COMMAND
 {
-    NONE,
-    MOVE,
-    MOVE_REL,
-    MOVE_FINE,
-    MOVE_CONST_VEL,
-    MOVE_WITH_VISION,
-    PLACE_TRAY,
-    LOAD_TRAY,
-    INITIALIZE_TRAY,
-    POSITION,
-    ESTOP,
-    LOAD_COMPLETE,
-    CLEAR_ERROR,
-    WAIT_FOR_LOCALIZATION,
-    SET_POSE,
-    TOGGLE_VISION_DEBUG,
-    START_CAMERAS,
-    STOP_CAMERAS,
-    MOVE_REL_SLOW,
-    MOVE_FINE_STOP_VISION,
+    NONE = 0,
+    MOVE = 1,
+    MOVE_REL = 2,
+    MOVE_FINE = 3,
+    MOVE_CONST_VEL = 4,
+    MOVE_WITH_VISION = 5,
+    PLACE_TRAY = 6,
+    LOAD_TRAY = 7,
+    INITIALIZE_TRAY = 8,
+    POSITION = 9,
+    ESTOP = 10,
+    LOAD_COMPLETE = 11,
+    CLEAR_ERROR = 12,
+    WAIT_FOR_LOCALIZATION = 13,
+    SET_POSE = 14,
+    TOGGLE_VISION_DEBUG = 15,
+    START_CAMERAS = 16,
+    STOP_CAMERAS = 17,
+    MOVE_REL_SLOW = 18,
+    MOVE_FINE_STOP_VISION = 19,
+    MOVE_PATH = 20,
+    DUMP_TRACE = 21,
+    UPDATE_GOAL = 22,
+    FIELD_PLAN_UPLOAD = 23,
+    FIELD_PLAN_RUN = 24,
+    FIELD_PLAN_PAUSE = 25,
+    FIELD_PLAN_ABORT = 26,
+    CALIBRATE_CAMERAS = 27,
 };
 
 #endif
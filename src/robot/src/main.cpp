@@ -3,18 +3,33 @@
 #include <plog/Formatters/TxtFormatter.h>
 #include <plog/Formatters/MessageOnlyFormatter.h>
 #include <plog/Appenders/ColorConsoleAppender.h>
-#include <plog/Appenders/RollingFileAppender.h>
+#include "AsyncLogAppender.h"
+#include <atomic>
 #include <chrono>
+#include <csignal>
+#include <future>
 #include <iostream>
+#include <sys/prctl.h>
 
 #include "robot.h"
+#include "CameraCalibration.h"
 #include "constants.h"
+#include "ConfigSnapshot.h"
+#include "FlightRecorder.h"
+#include "InputRecorder.h"
+#include "RealtimeMemory.h"
+#include "StartupReport.h"
 #include "sockets/SocketMultiThreadWrapperFactory.h"
 #include "camera_tracker/CameraTrackerFactory.h"
+#include "camera_tracker/CameraTrackerShm.h"
+#include "serial/SerialCommsFactory.h"
 
 libconfig::Config cfg = libconfig::Config();
 
-void configure_logger()
+std::atomic<bool> vision_process_running(true);
+
+// The vision process only writes the main log, as vision_log_<date>_<time>.txt
+void configure_logger(bool vision_process)
 {
     // Get current date/time
     const std::time_t datetime =  std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
@@ -22,28 +37,68 @@ void configure_logger()
     std::strftime(datetime_str, sizeof(datetime_str), "%Y%m%d_%H%M%S", std::localtime(&datetime));
 
     // Make file names
-    std::string robot_log_file_name = std::string("log/robot_log_") + std::string(datetime_str) + std::string(".txt");
+    std::string robot_log_file_name = std::string(vision_process ? "log/vision_log_" : "log/robot_log_") + std::string(datetime_str) + std::string(".txt");
     std::string motion_log_file_name = std::string("log/motion_log_") + std::string(datetime_str) + std::string(".txt");
     std::string localization_log_file_name = std::string("log/localization_log_") + std::string(datetime_str) + std::string(".txt");
 
+    // File appenders write on their own threads so SD card stalls don't hold up the robot or control loops
+    const int queue_size = cfg.lookup("logging.queue_size");
+
     // Initialize robot logs to to go file and console
     std::string log_level = cfg.lookup("log_level");
     plog::Severity severity = plog::severityFromString(log_level.c_str());
-    static plog::RollingFileAppender<plog::TxtFormatter> fileAppender(robot_log_file_name.c_str(), 1000000, 5);
+    static AsyncLogAppender fileAppender(robot_log_file_name, LOG_FORMAT::TXT, queue_size, 1000000, 5);
     static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
     plog::init(severity, &fileAppender).addAppender(&consoleAppender); 
+    if(vision_process)
+    {
+        PLOGI << "Logger ready";
+        return;
+    }
 
     // Initialize motion logs to go to file
-    static plog::RollingFileAppender<plog::TxtFormatter> motionFileAppender(motion_log_file_name.c_str(), 1000000, 5);
+    static AsyncLogAppender motionFileAppender(motion_log_file_name, LOG_FORMAT::TXT, queue_size, 1000000, 5);
     plog::init<MOTION_LOG_ID>(plog::debug, &motionFileAppender);
 
     // Initialize localization logs to go to file
-    static plog::RollingFileAppender<plog::TxtFormatter> localizationFileAppender(localization_log_file_name.c_str(), 1000000, 5);
+    static AsyncLogAppender localizationFileAppender(localization_log_file_name, LOG_FORMAT::TXT, queue_size, 1000000, 5);
     plog::init<LOCALIZATION_LOG_ID>(plog::debug, &localizationFileAppender);
 
     PLOGI << "Logger ready";
 }
 
+void start_input_log()
+{
+    if(!cfg.lookup("input_log.enabled")) return;
+
+    const std::time_t datetime =  std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    char datetime_str[50];
+    std::strftime(datetime_str, sizeof(datetime_str), "%Y%m%d_%H%M%S", std::localtime(&datetime));
+    std::string dir = cfg.lookup("input_log.dir");
+    InputRecorder::start(dir + "/input_log_" + std::string(datetime_str) + ".bin");
+}
+
+void start_flight_recorder()
+{
+    if(!cfg.lookup("flight_recorder.enabled")) return;
+
+    std::string path = cfg.lookup("flight_recorder.path");
+    std::string dump_dir = cfg.lookup("flight_recorder.dump_dir");
+    int records = cfg.lookup("flight_recorder.records");
+    int post_freeze_records = cfg.lookup("flight_recorder.post_freeze_records");
+    // The ring left behind by the last run is kept before it is overwritten, in case that run crashed
+    FlightRecorder::open(path, records, post_freeze_records, dump_dir + "/flight_previous_run.bin");
+}
+
+void apply_camera_calibration()
+{
+    if(!cfg.lookup("camera_calibration.apply_on_start")) return;
+
+    // Before anything builds a camera, in the vision process as well as the robot
+    std::string path = cfg.lookup("camera_calibration.output_path");
+    applyCameraExtrinsicsFile(path);
+}
+
 void setup_mock_socket()
 {
     bool enabled = cfg.lookup("mock_socket.enabled");
@@ -78,26 +133,100 @@ void capture_images()
     PLOGI << "Camera image capture complete...Exiting";
 }
 
+// Entry point of the vision process, runs the camera tracker and publishes it to shared memory until terminated
+void run_vision_process()
+{
+    // Goes down with robot-main when robot-main started it. robot-main spawns it from its main thread, since the
+    // signal is sent when the spawning thread exits.
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    std::signal(SIGTERM, [](int) { vision_process_running = false; });
+    std::signal(SIGINT, [](int) { vision_process_running = false; });
+
+    CameraTrackerShmServer server(static_cast<const char*>(cfg.lookup("vision_process.shm_name")),
+                                  CameraTrackerFactory::getFactoryInstance()->get_camera_tracker());
+    if(!server.open()) return;
+    server.run(vision_process_running, cfg.lookup("vision_process.poll_ms"));
+}
+
+// Devices that don't depend on each other are built at the same time. The serial port and camera tracker
+// get threads of their own while the Robot constructor opens everything else, and it then picks those two up
+// from their factories, waiting for them if they aren't done yet.
+std::unique_ptr<Robot> build_robot(StartupReport& startup)
+{
+    std::vector<std::future<void>> devices;
+    if(cfg.lookup("startup.parallel_init"))
+    {
+        // Created here since the lazy singletons themselves aren't thread safe
+        SerialCommsFactory* serial_factory = SerialCommsFactory::getFactoryInstance();
+        CameraTrackerFactory* camera_factory = CameraTrackerFactory::getFactoryInstance();
+        devices.push_back(std::async(std::launch::async, [&startup, serial_factory]()
+        {
+            startup.time("clearcore serial", [serial_factory]() { serial_factory->get_serial_comms(CLEARCORE_USB); });
+        }));
+        devices.push_back(std::async(std::launch::async, [&startup, camera_factory]()
+        {
+            startup.time("camera tracker", [camera_factory]() { camera_factory->get_camera_tracker(); });
+        }));
+    }
+
+    std::unique_ptr<Robot> robot;
+    startup.time("robot", [&robot]() { robot = std::make_unique<Robot>(); });
+    for (std::future<void>& device : devices)
+    {
+        device.get();
+    }
+    return robot;
+}
+
 int main(int argc, char** argv)
 {
     try
     {
-        cfg.readFile(CONSTANTS_FILE);
+        StartupReport startup;
+        startup.time("config", []()
+        {
+            cfg.readFile(CONSTANTS_FILE);
+            ConfigSnapshot::reload();
+        });
         std::string name = cfg.lookup("name");
+        const bool vision_process = argc > 1 && std::string(argv[1]) == "-v";
 
-        configure_logger();
+        startup.time("logger", [vision_process]() { configure_logger(vision_process); });
         PLOGI << "Loaded constants file: " << name;
+        apply_camera_calibration();
+
+        if(cfg.lookup("memory.lock"))
+        {
+            // Before the robot is built so every thread it starts has its stack locked as it is mapped
+            startup.time("memory lock", []()
+            {
+                RealtimeMemory::lockAndPrefault(1024 * 1024 * static_cast<size_t>(static_cast<int>(cfg.lookup("memory.heap_prefault_mb"))),
+                                                1024 * static_cast<size_t>(static_cast<int>(cfg.lookup("memory.stack_prefault_kb"))));
+            });
+        }
 
         if(argc > 1 && std::string(argv[1]) == "-c")
         {
             capture_images();
         } 
+        else if(vision_process)
+        {
+            run_vision_process();
+        }
         else 
         {
+            if(cfg.lookup("vision_process.enabled"))
+            {
+                CameraTrackerFactory::getFactoryInstance()->set_mode(CAMERA_TRACKER_FACTORY_MODE::SHARED_MEMORY);
+            }
             setup_mock_socket();
+            start_input_log();
+            start_flight_recorder();
 
-            Robot r;
-            r.run(); //Should loop forver until stopped
+            std::unique_ptr<Robot> r = build_robot(startup);
+            startup.log();
+            r->run(); //Should loop forver until stopped
+            InputRecorder::stop();
         }
 
     }
@@ -2,35 +2,114 @@
 
 #include <plog/Log.h> 
 #include "utils.h"
+#include "ConfigSnapshot.h"
+#include "FlightRecorder.h"
+#include "InputRecorder.h"
+#include "Trace.h"
 #include "camera_tracker/CameraTrackerFactory.h"
 
 
-WaitForLocalizeHelper::WaitForLocalizeHelper(const StatusUpdater& statusUpdater, float max_timeout, float confidence_threshold) 
+WaitForLocalizeHelper::WaitForLocalizeHelper(StatusUpdater& statusUpdater, ControlLoop& controller, float max_timeout, float confidence_threshold) 
 : statusUpdater_(statusUpdater),
+    controller_(controller),
     timer_(),
+    hold_timer_(),
     max_timeout_(max_timeout),
-    confidence_threshold_(confidence_threshold)
-{}
+    confidence_threshold_(confidence_threshold),
+    active_(cfg.lookup("localization.active_wait.enabled")),
+    passive_s_(cfg.lookup("localization.active_wait.passive_s")),
+    hold_s_(cfg.lookup("localization.active_wait.hold_s")),
+    excitation_(),
+    moves_(0),
+    moving_(false),
+    running_(false),
+    time_to_confidence_(-1)
+{
+    const libconfig::Setting& excitation = cfg.lookup("localization.active_wait.excitation");
+    for (int i = 0; i + 2 < excitation.getLength(); i += 3)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            excitation_.push_back(excitation[i + j]);
+        }
+    }
+    if(excitation_.empty()) active_ = false;
+}
 
 bool WaitForLocalizeHelper::isDone() 
 {
-    if(timer_.dt_s() > max_timeout_)
+    if(!running_) return true;
+    if(moving_)
+    {
+        if(controller_.isTrajectoryRunning()) return false;
+        moving_ = false;
+        hold_timer_.reset();
+    }
+
+    float confidence = statusUpdater_.getLocalizationConfidence();
+    if(time_to_confidence_ < 0 && confidence > confidence_threshold_)
+    {
+        time_to_confidence_ = timer_.dt_s();
+    }
+    const bool timed_out = timer_.dt_s() > max_timeout_;
+
+    // Whatever happens, a move out is undone first
+    if(moves_ % 2 == 1)
+    {
+        startMove();
+        return false;
+    }
+    if(timed_out)
     {
         PLOGW.printf("Exiting wait for localize due to time");
+        finish();
         return true;
     }
-    float confidence = statusUpdater_.getLocalizationConfidence();
-    if(confidence > confidence_threshold_)
+    if(time_to_confidence_ >= 0)
     {
-        PLOGI.printf("Exiting wait for localize with confidence: %4.2f", confidence);
+        PLOGI.printf("Exiting wait for localize with confidence: %4.2f after %4.2f s", confidence, time_to_confidence_);
+        finish();
         return true;
     }
+    if(active_ && timer_.dt_s() > passive_s_ && (moves_ == 0 || hold_timer_.dt_s() > hold_s_))
+    {
+        startMove();
+    }
     return false;
 }
 
 void WaitForLocalizeHelper::start()
 {
     timer_.reset();
+    moves_ = 0;
+    moving_ = false;
+    running_ = true;
+    time_to_confidence_ = -1;
+}
+
+void WaitForLocalizeHelper::abort()
+{
+    if(!running_) return;
+    PLOGW.printf("Wait for localize aborted after %i moves", moves_);
+    running_ = false;
+    moving_ = false;
+}
+
+void WaitForLocalizeHelper::startMove()
+{
+    // Cycles through the excitation moves, every other one going back the way it came
+    const int num_moves = excitation_.size() / 3;
+    const float* move = &excitation_[3 * ((moves_ / 2) % num_moves)];
+    const float sign = moves_ % 2 == 0 ? 1 : -1;
+    controller_.moveToPositionRelativeSlow(sign * move[0], sign * move[1], sign * move[2]);
+    moves_++;
+    moving_ = true;
+}
+
+void WaitForLocalizeHelper::finish()
+{
+    running_ = false;
+    statusUpdater_.updateLocalizeWait(time_to_confidence_, moves_ > 0);
 }
 
 
@@ -38,58 +117,133 @@ void WaitForLocalizeHelper::start()
 Robot::Robot()
 : statusUpdater_(),
   server_(statusUpdater_),
+  mm_wrapper_(),
   controller_(statusUpdater_),
   tray_controller_(),
-  mm_wrapper_(),
+  scheduler_(),
   position_time_averager_(10),
   robot_loop_time_averager_(20),
-  wait_for_localize_helper_(statusUpdater_, cfg.lookup("localization.max_wait_time"), cfg.lookup("localization.confidence_for_wait")),
+  wait_for_localize_helper_(statusUpdater_, controller_, cfg.lookup("localization.max_wait_time"), cfg.lookup("localization.confidence_for_wait")),
   vision_print_rate_(10),
   camera_tracker_(CameraTrackerFactory::getFactoryInstance()->get_camera_tracker()),
+  camera_calibrator_(controller_, camera_tracker_),
   camera_motion_start_time_(ClockTimePoint::min()),
   camera_trigger_time_1_(ClockTimePoint::min()),
   camera_trigger_time_2_(ClockTimePoint::min()),
   camera_stop_triggered_(false),
-  curCmd_(COMMAND::NONE)
+  camera_markers_confirmed_(false),
+  camera_confirm_pos_(0, 0, 0),
+  camera_stop_travel_(cfg.lookup("motion.stop_fast.camera_stop_travel")),
+  camera_stop_latency_(cfg.lookup("motion.stop_fast.camera_stop_latency")),
+  camera_stop_goal_(0, 0, 0),
+  fine_move_target_(0, 0, 0),
+  curCmd_(COMMAND::NONE),
+  curCmdSeq_(0),
+  curCmdPlanStep_(false),
+  doneCmdSeq_(0),
+  overlapTrayCmd_(COMMAND::NONE),
+  overlapTrayCmdSeq_(0),
+  overlapTrayCmdPlanStep_(false),
+  trayDoneCmdSeq_(0),
+  cmdQueue_(),
+  trace_window_timer_(),
+  trace_window_ms_(cfg.lookup("trace.window_ms")),
+  trace_dump_path_(static_cast<const char*>(cfg.lookup("trace.dump_path"))),
+  main_allocs_(),
+  system_health_enabled_(cfg.lookup("system_health.enabled")),
+  system_health_rate_(cfg.lookup("system_health.rate")),
+  system_health_(),
+  degrade_policy_(),
+  field_plan_(static_cast<const char*>(cfg.lookup("field_plan.journal_path"))),
+  field_plan_step_running_(false),
+  flight_dump_dir_(static_cast<const char*>(cfg.lookup("flight_recorder.dump_dir"))),
+  flight_loop_rate_(cfg.lookup("flight_recorder.loop_hz")),
+  flight_loop_timer_(),
+  flight_loop_max_ms_(0)
 {
+    Tracer::setEnabled(cfg.lookup("trace.enabled"));
+    if(controller_.getControllerRate())
+    {
+        scheduler_.addTask("RobotController", controller_.getControllerRate());
+    }
+    scheduler_.addTask("TrayController", tray_controller_.getControllerRate());
+    // Camera poses are picked up by the control thread itself when there is one
+    if(!controller_.isThreaded())
+    {
+        scheduler_.addWakeFd(camera_tracker_->poseReadyFd());
+    }
+    // Nobody knows where the robot was taken while it was down, so by default master has to say to carry on
+    if(field_plan_.getState() == FIELD_PLAN_STATE::RUNNING && !cfg.lookup("field_plan.resume_on_start"))
+    {
+        field_plan_.pause();
+    }
     PLOGI.printf("Robot starting");
 }
 
 void Robot::run()
 {
+    SystemHealthMonitor::registerThread(SYSTEM_THREAD::MAIN);
     while(true)
     {
         runOnce();
+        scheduler_.sleepUntilNextDeadline();
     }
 }
 
 
 void Robot::runOnce() 
 {
-    // Check for new command and try to start it
-    COMMAND newCmd = server_.oneLoop();
-    bool status = tryStartNewCmd(newCmd);
+    InputRecorder::recordLoop(ClockFactory::getFactoryInstance()->get_clock()->now());
+    flight_loop_max_ms_ = std::max(flight_loop_max_ms_, flight_loop_timer_.dt_ms());
+    flight_loop_timer_.reset();
 
-    // Update our current command if we successfully started a new command
-    if(status)
+    // Check for new command and either queue it or try to start it
+    COMMAND newCmd = COMMAND::NONE;
     {
-        curCmd_ = newCmd;
-        statusUpdater_.updateInProgress(true);
+        TRACE_SCOPE(TRACE_POINT::SERVER);
+        newCmd = server_.oneLoop();
+    }
+    if(newCmd != COMMAND::NONE)
+    {
+        RobotServer::CommandData data = server_.getCommandData(newCmd);
+        FlightRecorder::record(FLIGHT_RECORD::EVENT, 0, static_cast<uint16_t>(FLIGHT_EVENT::COMMAND_RECEIVED),
+                               static_cast<uint32_t>(newCmd), {static_cast<float>(data.seq)});
+        if(field_plan_.getState() == FIELD_PLAN_STATE::RUNNING && isLongRunningCmd(newCmd))
+        {
+            PLOGW.printf("Field plan %u is running, rejecting command %i", field_plan_.getPlanId(), static_cast<int>(newCmd));
+        }
+        else if(server_.isQueueRequested() && isLongRunningCmd(newCmd))
+        {
+            enqueueCmd(data);
+        }
+        else if(tryStartNewCmd(data))
+        {
+            // Update our current command if we successfully started a new command
+            setCurrentCmd(data);
+        }
     }
 
     // Service marvelmind
-    std::vector<float> positions = mm_wrapper_.getPositions();
-    if (positions.size() == 3)
+    MarvelmindReading reading;
+    bool new_reading = false;
+    {
+        TRACE_SCOPE(TRACE_POINT::MARVELMIND);
+        new_reading = mm_wrapper_.getLatest(&reading);
+    }
+    if (new_reading)
     {
         position_time_averager_.mark_point();
-        float angle_rad = wrap_angle(positions[2] * M_PI / 180.0);
-        controller_.inputPosition(positions[0], positions[1], angle_rad);
+        controller_.inputPosition(reading.x, reading.y, reading.a, reading.time, reading.trans_cov, reading.angle_cov);
     }
 
     // Service various modules
     controller_.update();
-    tray_controller_.update();
+    {
+        TRACE_SCOPE(TRACE_POINT::TRAY);
+        tray_controller_.update();
+    }
     camera_tracker_->update();
+    camera_calibrator_.update();
 
     // Verify if MOVE_FINE_STOP_VISION needs to trigger stop
     if(checkForCameraStopTrigger())
@@ -98,76 +252,111 @@ void Robot::runOnce()
         camera_stop_triggered_ = true;
     }
 
-    // Check if the current command has finished
+    // Check if the current command and any tray command left running in the background have finished
+    if(overlapTrayCmd_ != COMMAND::NONE && checkForCmdComplete(overlapTrayCmd_))
+    {
+        if(overlapTrayCmdPlanStep_) finishFieldPlanStep();
+        else finishCmd(overlapTrayCmd_, overlapTrayCmdSeq_);
+        overlapTrayCmd_ = COMMAND::NONE;
+        overlapTrayCmdSeq_ = 0;
+        overlapTrayCmdPlanStep_ = false;
+    }
     bool done = checkForCmdComplete(curCmd_);
     if(done)
     {
+        if(curCmd_ == COMMAND::MOVE_FINE_STOP_VISION && camera_stop_triggered_)
+        {
+            reportCameraStopError();
+        }
+        if(curCmd_ == COMMAND::CALIBRATE_CAMERAS && !camera_calibrator_.succeeded())
+        {
+            // Master only sees the command finish, the error status tells it nothing was written
+            statusUpdater_.setErrorStatus();
+        }
+        if(curCmd_ != COMMAND::NONE)
+        {
+            // Plan steps report their progress through the journal rather than the master's sequence ids
+            if(curCmdPlanStep_) finishFieldPlanStep();
+            else finishCmd(curCmd_, curCmdSeq_);
+        }
         curCmd_ = COMMAND::NONE;
-        statusUpdater_.updateInProgress(false);
+        curCmdSeq_ = 0;
+        curCmdPlanStep_ = false;
+    }
+
+    // Tuned settings also go in while idle, so plans and get_param agree with the next move
+    if(curCmd_ == COMMAND::NONE && ConfigSnapshot::hasPendingParams())
+    {
+        ConfigSnapshot::applyPendingParams();
     }
 
+    // Start the next queued command right away so there is no idle cycle between them
+    startNextQueuedCmd();
+    startNextFieldPlanStep();
+    const bool vision_cmd = curCmd_ == COMMAND::MOVE_WITH_VISION || curCmd_ == COMMAND::MOVE_FINE_STOP_VISION ||
+                            curCmd_ == COMMAND::CALIBRATE_CAMERAS;
+    camera_tracker_->setCameraProfile(vision_cmd ? CAMERA_PROFILE::VISION : CAMERA_PROFILE::IDLE);
+    camera_tracker_->setCameraDemand(CAMERA_CONSUMER::VISION_MOVE, curCmd_ == COMMAND::MOVE_WITH_VISION);
+    camera_tracker_->setCameraDemand(CAMERA_CONSUMER::STOP_TRIGGER, curCmd_ == COMMAND::MOVE_FINE_STOP_VISION);
+    camera_tracker_->setCameraDemand(CAMERA_CONSUMER::CALIBRATION, curCmd_ == COMMAND::CALIBRATE_CAMERAS);
+    statusUpdater_.updateInProgress(curCmd_ != COMMAND::NONE || overlapTrayCmd_ != COMMAND::NONE);
+
     // Update loop time and status updater
+    statusUpdater_.updateCommandQueue(static_cast<int>(cmdQueue_.size()), curCmdSeq_, doneCmdSeq_);
+    statusUpdater_.updateTrayStatus(tray_controller_.isActionRunning(), trayDoneCmdSeq_);
+    statusUpdater_.updateFieldPlan(field_plan_.getPlanId(), static_cast<int>(field_plan_.getState()), field_plan_.getNextStep(), field_plan_.getReceived());
     statusUpdater_.updatePositionLoopTime(position_time_averager_.get_ms());
     CameraDebug camera_debug = camera_tracker_->getCameraDebug();
     statusUpdater_.updateCameraDebug(camera_debug);
+    if(Tracer::isEnabled() && trace_window_timer_.dt_ms() > trace_window_ms_)
+    {
+        statusUpdater_.updateTraceStats(Tracer::getStats(true));
+        trace_window_timer_.reset();
+    }
+    if(system_health_enabled_ && system_health_rate_.ready())
+    {
+        SystemHealthStats health = system_health_.sample();
+        const VISION_DEGRADE degrade = degrade_policy_.update(health, statusUpdater_.getControlThreadStats(), scheduler_.getOverruns("RobotController"));
+        camera_tracker_->setDegradeLevel(degrade);
+        health.vision_degrade = static_cast<int>(degrade);
+        statusUpdater_.updateSystemHealth(health);
+    }
+    main_allocs_.markLoop();
+    statusUpdater_.updateMainLoopAllocations(main_allocs_.windowMax(), static_cast<uint32_t>(main_allocs_.total()));
     robot_loop_time_averager_.mark_point();
+    if(FlightRecorder::isEnabled())
+    {
+        if(flight_loop_rate_.ready())
+        {
+            FlightRecorder::record(FLIGHT_RECORD::LOOP, 0, static_cast<uint16_t>(curCmd_), static_cast<uint32_t>(cmdQueue_.size()),
+                                   {static_cast<float>(robot_loop_time_averager_.get_ms()), static_cast<float>(flight_loop_max_ms_),
+                                    static_cast<float>(position_time_averager_.get_ms())});
+            flight_loop_max_ms_ = 0;
+        }
+        // Only does any work once after each fault, and the file itself is written off this thread
+        FlightRecorder::dumpIfFrozen(flight_dump_dir_);
+    }
 }
 
 
-bool Robot::tryStartNewCmd(COMMAND cmd)
+bool Robot::tryStartNewCmd(const RobotServer::CommandData& data)
 {
-    // Position info doesn't count as a real 'command' since it doesn't interrupt anything
-    // Always service it, but don't consider it starting a new command
-    if (cmd == COMMAND::POSITION)
-    {
-        RobotServer::PositionData data = server_.getPositionData();
-        controller_.inputPosition(data.x, data.y, data.a);
+    COMMAND cmd = data.cmd;
+    const CommandSpec* spec = findCommand(cmd);
 
-        // Update the position rate
-        position_time_averager_.mark_point();
+    // Just do nothing for NONE
+    if (!spec) { return false; }
 
-        return false;
-    }
-    if (cmd == COMMAND::SET_POSE)
-    {
-        RobotServer::PositionData data = server_.getPositionData();
-        controller_.forceSetPosition(data.x, data.y, data.a);
-        return false;
-    }
-    if (cmd == COMMAND::TOGGLE_VISION_DEBUG)
-    {
-        camera_tracker_->toggleDebugImageOutput();
-        return false;
-    }
-    if (cmd == COMMAND::START_CAMERAS)
-    {
-        camera_tracker_->start();
-        return false;
-    }
-    if (cmd == COMMAND::STOP_CAMERAS)
-    {
-        camera_tracker_->stop();
-        return false;
-    }
-    // Same with ESTOP
-    if (cmd == COMMAND::ESTOP)
+    // Immediate commands don't count as a real 'command' since they don't interrupt anything.
+    // Always service them, but don't consider it starting a new command
+    if (spec->done == CMD_DONE::IMMEDIATE)
     {
-        controller_.estop();
-        tray_controller_.estop();
-        return false;
-    }
-    // Same with LOAD_COMPLETE
-    if (cmd == COMMAND::LOAD_COMPLETE)
-    {
-        tray_controller_.setLoadComplete();
+        runImmediateCmd(data);
         return false;
     }
 
-    // Just do nothing for NONE
-    if (cmd == COMMAND::NONE) { return false;}
-    
     // For all other commands, we need to make sure we aren't doing anything else at the moment
-    if(statusUpdater_.getInProgress())
+    if(isBusyFor(cmd))
     {
         PLOGW << "Command " << static_cast<int>(curCmd_) << " already running, rejecting new command: " << static_cast<int>(cmd);
         return false;
@@ -176,113 +365,255 @@ bool Robot::tryStartNewCmd(COMMAND cmd)
     {
         return false;
     }
-    
-    // Start new command
-    if(cmd == COMMAND::MOVE)
-    {
-        RobotServer::PositionData data = server_.getMoveData();
-        controller_.moveToPosition(data.x, data.y, data.a);
-    }
-    else if(cmd == COMMAND::MOVE_REL)
-    {
-        RobotServer::PositionData data = server_.getMoveData();
-        controller_.moveToPositionRelative(data.x, data.y, data.a);
-    }
-    else if(cmd == COMMAND::MOVE_REL_SLOW)
-    {
-        RobotServer::PositionData data = server_.getMoveData();
-        controller_.moveToPositionRelativeSlow(data.x, data.y, data.a);
-    }
-    else if(cmd == COMMAND::MOVE_FINE)
+    // No other motion command is running, though a tray action may still be finishing in the background.
+    // Settings tuned since the last move take effect before this one plans.
+    ConfigSnapshot::applyPendingParams();
+    return startLongRunningCmd(data);
+}
+
+void Robot::runImmediateCmd(const RobotServer::CommandData& data)
+{
+    switch (data.cmd)
     {
-        RobotServer::PositionData data = server_.getMoveData();
-        controller_.moveToPositionFine(data.x, data.y, data.a);
+        case COMMAND::POSITION:
+        {
+            RobotServer::PositionData pos = server_.getPositionData();
+            const ClockTimePoint now = ClockFactory::getFactoryInstance()->get_clock()->now();
+            ClockTimePoint measured_time = now;
+            if (server_.getPositionTime(&measured_time) && measured_time > now)
+            {
+                // Master's clock offset estimate is off, a reading can't be from the future
+                PLOGW.printf("Position timestamp is %.3f s in the future", std::chrono::duration<float>(measured_time - now).count());
+                measured_time = now;
+            }
+            controller_.inputPosition(pos.x, pos.y, pos.a, measured_time);
+
+            // Update the position rate
+            position_time_averager_.mark_point();
+            break;
+        }
+        case COMMAND::SET_POSE:
+        {
+            RobotServer::PositionData pos = server_.getPositionData();
+            controller_.forceSetPosition(pos.x, pos.y, pos.a);
+            break;
+        }
+        case COMMAND::UPDATE_GOAL:
+            controller_.updateGoal(data.move.x, data.move.y, data.move.a);
+            // The camera stop checks how close the robot is to where it is going
+            if(curCmd_ == COMMAND::MOVE_FINE_STOP_VISION) fine_move_target_ = {data.move.x, data.move.y, data.move.a};
+            break;
+        case COMMAND::TOGGLE_VISION_DEBUG:
+            camera_tracker_->toggleDebugImageOutput();
+            break;
+        case COMMAND::DUMP_TRACE:
+            if(Tracer::dumpChromeTrace(trace_dump_path_)) PLOGI.printf("Wrote trace to %s", trace_dump_path_.c_str());
+            else PLOGE.printf("Failed to write trace to %s", trace_dump_path_.c_str());
+            break;
+        case COMMAND::START_CAMERAS:
+            camera_tracker_->start();
+            break;
+        case COMMAND::STOP_CAMERAS:
+            camera_tracker_->stop();
+            break;
+        case COMMAND::ESTOP:
+            FlightRecorder::freeze(FLIGHT_FREEZE::ESTOP);
+            camera_calibrator_.abort();
+            wait_for_localize_helper_.abort();
+            controller_.estop();
+            tray_controller_.estop();
+            flushCmdQueue();
+            // The step that was cut short is run again from its start
+            field_plan_.pause();
+            field_plan_step_running_ = false;
+            break;
+        case COMMAND::LOAD_COMPLETE:
+            tray_controller_.setLoadComplete();
+            break;
+        case COMMAND::CLEAR_ERROR:
+            statusUpdater_.clearErrorStatus();
+            break;
+        case COMMAND::FIELD_PLAN_UPLOAD:
+        case COMMAND::FIELD_PLAN_RUN:
+        case COMMAND::FIELD_PLAN_PAUSE:
+        case COMMAND::FIELD_PLAN_ABORT:
+            handleFieldPlanCmd(data.cmd);
+            break;
+        default:
+            PLOGW.printf("Immediate command %i not handled", static_cast<int>(data.cmd));
+            break;
     }
-    else if(cmd == COMMAND::MOVE_FINE_STOP_VISION)
-    {
-        if(!camera_tracker_->running()) 
+}
+
+bool Robot::startLongRunningCmd(const RobotServer::CommandData& data)
+{
+    switch (data.cmd)
+    {
+        case COMMAND::MOVE:
+            controller_.moveToPosition(data.move.x, data.move.y, data.move.a);
+            break;
+        case COMMAND::MOVE_REL:
+            controller_.moveToPositionRelative(data.move.x, data.move.y, data.move.a);
+            break;
+        case COMMAND::MOVE_REL_SLOW:
+            controller_.moveToPositionRelativeSlow(data.move.x, data.move.y, data.move.a);
+            break;
+        case COMMAND::MOVE_FINE:
+            controller_.moveToPositionFine(data.move.x, data.move.y, data.move.a);
+            break;
+        case COMMAND::MOVE_FINE_STOP_VISION:
+            if(!camera_tracker_->running())
+            {
+                PLOGW << "Cannot start MOVE_FINE_STOP_VISION if camera tracker isn't running";
+                return false;
+            }
+            controller_.moveToPositionFine(data.move.x, data.move.y, data.move.a);
+            resetCameraStopTriggers();
+            camera_motion_start_time_ = ClockFactory::getFactoryInstance()->get_clock()->now();
+            fine_move_target_ = {data.move.x, data.move.y, data.move.a};
+            break;
+        case COMMAND::MOVE_CONST_VEL:
+            controller_.moveConstVel(data.velocity.vx, data.velocity.vy, data.velocity.va, data.velocity.t);
+            break;
+        case COMMAND::MOVE_WITH_VISION:
+            controller_.moveWithVision(data.move.x, data.move.y, data.move.a);
+            break;
+        case COMMAND::MOVE_PATH:
         {
-            PLOGW << "Cannot start MOVE_FINE_STOP_VISION if camera tracker isn't running";
-            return false;
+            std::vector<Point> waypoints;
+            for (int i = 0; i < data.num_path_points; i++)
+            {
+                waypoints.push_back({data.path[i].x, data.path[i].y, data.path[i].a});
+            }
+            controller_.moveAlongPath(waypoints);
+            break;
         }
-        RobotServer::PositionData data = server_.getMoveData();
-        controller_.moveToPositionFine(data.x, data.y, data.a);
-        resetCameraStopTriggers();
-        camera_motion_start_time_ = ClockFactory::getFactoryInstance()->get_clock()->now();
-        fine_move_target_ = {data.x, data.y, data.a};
-    
+        case COMMAND::PLACE_TRAY:
+        case COMMAND::LOAD_TRAY:
+        {
+            bool ok = data.cmd == COMMAND::PLACE_TRAY ? tray_controller_.place() : tray_controller_.load();
+            if(!ok) statusUpdater_.setErrorStatus();
+            return ok;
+        }
+        case COMMAND::INITIALIZE_TRAY:
+            tray_controller_.initialize();
+            break;
+        case COMMAND::WAIT_FOR_LOCALIZATION:
+            wait_for_localize_helper_.start();
+            break;
+        case COMMAND::CALIBRATE_CAMERAS:
+            return camera_calibrator_.start();
+        default:
+            PLOGW.printf("Unknown command!");
+            return false;
     }
-    else if(cmd == COMMAND::MOVE_CONST_VEL)
+    return true;
+}
+
+bool Robot::isBusyFor(COMMAND cmd)
+{
+    COMMAND tray_cmd = overlapTrayCmd_;
+    if(tray_cmd == COMMAND::NONE && isTrayCmd(curCmd_))
     {
-        RobotServer::VelocityData data = server_.getVelocityData();
-        controller_.moveConstVel(data.vx, data.vy, data.va, data.t);
+        tray_cmd = curCmd_;
     }
-    else if (cmd == COMMAND::MOVE_WITH_VISION)
+    if(curCmd_ != COMMAND::NONE && curCmd_ != tray_cmd)
     {
-        RobotServer::PositionData data = server_.getMoveData();
-        controller_.moveWithVision(data.x, data.y, data.a);
+        return true;
     }
-    else if(cmd == COMMAND::PLACE_TRAY)
+    // A running tray action only blocks motion its current step isn't marked safe to overlap with
+    return tray_cmd != COMMAND::NONE && !tray_controller_.canOverlapWith(cmd);
+}
+
+void Robot::setCurrentCmd(const RobotServer::CommandData& data)
+{
+    if(isTrayCmd(curCmd_))
     {
-        bool ok = tray_controller_.place();
-        if(!ok) statusUpdater_.setErrorStatus();
-        return ok;
+        PLOGI.printf("Finishing tray command %i in the background during command %i", static_cast<int>(curCmd_), static_cast<int>(data.cmd));
+        overlapTrayCmd_ = curCmd_;
+        overlapTrayCmdSeq_ = curCmdSeq_;
+        overlapTrayCmdPlanStep_ = curCmdPlanStep_;
     }
-    else if(cmd == COMMAND::LOAD_TRAY)
+    curCmd_ = data.cmd;
+    curCmdSeq_ = data.seq;
+    curCmdPlanStep_ = false;
+    statusUpdater_.updateInProgress(true);
+}
+
+void Robot::finishCmd(COMMAND cmd, uint32_t seq)
+{
+    doneCmdSeq_ = seq;
+    if(isTrayCmd(cmd))
     {
-        bool ok = tray_controller_.load();
-        if(!ok) statusUpdater_.setErrorStatus();
-        return ok;
+        trayDoneCmdSeq_ = seq;
     }
-    else if(cmd == COMMAND::INITIALIZE_TRAY)
+}
+
+void Robot::enqueueCmd(const RobotServer::CommandData& data)
+{
+    if(!cmdQueue_.push(data))
     {
-        tray_controller_.initialize();
+        // The command was already acked, so the error status is the only way master finds out
+        PLOGE.printf("Command queue full, dropping command %i with seq %u", static_cast<int>(data.cmd), data.seq);
+        statusUpdater_.setErrorStatus();
+        return;
     }
-    else if (cmd == COMMAND::WAIT_FOR_LOCALIZATION)
+    PLOGI.printf("Queued command %i with seq %u, %zu waiting", static_cast<int>(data.cmd), data.seq, cmdQueue_.size());
+}
+
+void Robot::startNextQueuedCmd()
+{
+    RobotServer::CommandData data;
+    if(!cmdQueue_.peek(&data) || isBusyFor(data.cmd)) return;
+    cmdQueue_.pop(&data);
+
+    if(tryStartNewCmd(data))
     {
-        wait_for_localize_helper_.start();
+        setCurrentCmd(data);
     }
     else
     {
-        PLOGW.printf("Unknown command!");
-        return false;
+        // Later commands probably depend on this one, so don't run them either
+        PLOGW.printf("Queued command %i with seq %u failed to start, flushing queue", static_cast<int>(data.cmd), data.seq);
+        flushCmdQueue();
     }
-
-    return true;
 }
 
-bool Robot::checkForCmdComplete(COMMAND cmd)
+void Robot::flushCmdQueue()
 {
-    if (cmd == COMMAND::NONE)
+    RobotServer::CommandData data;
+    int num_flushed = 0;
+    while(cmdQueue_.pop(&data))
     {
-        return true;
-    }
-    else if(cmd == COMMAND::MOVE || 
-            cmd == COMMAND::MOVE_REL ||
-            cmd == COMMAND::MOVE_FINE ||
-            cmd == COMMAND::MOVE_CONST_VEL ||
-            cmd == COMMAND::MOVE_WITH_VISION || 
-            cmd == COMMAND::MOVE_REL_SLOW || 
-            cmd == COMMAND::MOVE_FINE_STOP_VISION)
-    {
-        return !controller_.isTrajectoryRunning();
+        num_flushed++;
     }
-    else if(cmd == COMMAND::PLACE_TRAY ||
-            cmd == COMMAND::LOAD_TRAY ||
-            cmd == COMMAND::INITIALIZE_TRAY)
+    if(num_flushed > 0)
     {
-        return !tray_controller_.isActionRunning();
+        PLOGW.printf("Flushed %i queued commands", num_flushed);
     }
-    else if (cmd == COMMAND::WAIT_FOR_LOCALIZATION) 
+}
+
+bool Robot::checkForCmdComplete(COMMAND cmd)
+{
+    const CommandSpec* spec = findCommand(cmd);
+    switch (spec ? spec->done : CMD_DONE::IMMEDIATE)
     {
-        return wait_for_localize_helper_.isDone();
+        case CMD_DONE::TRAJECTORY:
+            return !controller_.isTrajectoryRunning();
+        case CMD_DONE::TRAY:
+            return !tray_controller_.isActionRunning();
+        case CMD_DONE::LOCALIZATION:
+            return wait_for_localize_helper_.isDone();
+        case CMD_DONE::CALIBRATION:
+            return !camera_calibrator_.isRunning();
+        case CMD_DONE::IMMEDIATE:
+            break;
     }
-    else
+    if (cmd != COMMAND::NONE)
     {
-        PLOGE.printf("Completion check not implimented for command: %i",cmd);
-        return true;
+        PLOGE.printf("Completion check not implimented for command: %i", static_cast<int>(cmd));
     }
-        
+    return true;
 }
 
 bool Robot::checkForCameraStopTrigger()
@@ -302,20 +633,47 @@ bool Robot::checkForCameraStopTrigger()
         Eigen::Vector2f dp = {fine_move_target_.x - current_pos.x, fine_move_target_.y - current_pos.y};
         bool pos_in_tolerance = dp.norm() < 0.5;
 
+        bool confirmed = false;
         if(camera_trigger_1_ && camera_trigger_2 && timestamp_after_1 && timestamp_after_2 && pos_in_tolerance)
         {
-            return true;
+            confirmed = true;
         }
         else if(camera_trigger_1_ && timestamp_after_1 && timestamp_difference)
         {
             camera_trigger_time_2_ = camera_output.timestamp;
-            return true;
+            confirmed = true;
         }
         else
         {
             camera_trigger_time_1_ = camera_output.timestamp;
-            return false;
         }
+
+        const Velocity vel = statusUpdater_.getVelocity();
+        const Eigen::Vector2f vel_xy = {vel.vx, vel.vy};
+        if(confirmed && !camera_markers_confirmed_)
+        {
+            // The markers came into view when the first of the two frames was captured. Capture, processing and
+            // however long this loop took to see the result all went by since then, so step back along the
+            // velocity to where the robot was at that moment.
+            const ClockTimePoint now = ClockFactory::getFactoryInstance()->get_clock()->now();
+            const float since_seen = std::max(0.0f, std::chrono::duration_cast<FpSeconds>(now - camera_trigger_time_1_).count());
+            camera_markers_confirmed_ = true;
+            camera_confirm_pos_ = {current_pos.x - vel.vx * since_seen, current_pos.y - vel.vy * since_seen, current_pos.a};
+            const float heading = vel_xy.norm() > 1e-3 ? atan2(vel.vy, vel.vx) : 0.0f;
+            camera_stop_goal_ = {camera_confirm_pos_.x + camera_stop_travel_ * cos(heading),
+                                 camera_confirm_pos_.y + camera_stop_travel_ * sin(heading), heading};
+            PLOGI.printf("Camera markers confirmed at [%.3f, %.3f], %.0f ms after they were seen", 
+                camera_confirm_pos_.x, camera_confirm_pos_.y, 1000 * since_seen);
+        }
+        if(!camera_markers_confirmed_) return false;
+
+        // Keep going at speed while the robot can still stop within camera_stop_travel_ of where the markers
+        // were seen, the vision move that follows is then as short as it can be. The stop has to be commanded
+        // a latency ahead of when it needs to start, and this check doesn't run again for another loop.
+        const Eigen::Vector2f travelled = {current_pos.x - camera_confirm_pos_.x, current_pos.y - camera_confirm_pos_.y};
+        const float stop_distance = RobotControllerModeStopFast::predictStopDistance(vel);
+        const float lead_distance = vel_xy.norm() * (camera_stop_latency_ + robot_loop_time_averager_.get_sec());
+        return travelled.norm() + lead_distance + stop_distance >= camera_stop_travel_;
     }
     else
     {
@@ -324,9 +682,92 @@ bool Robot::checkForCameraStopTrigger()
     return false;
 }
 
+void Robot::handleFieldPlanCmd(COMMAND cmd)
+{
+    switch (cmd)
+    {
+        case COMMAND::FIELD_PLAN_UPLOAD:
+        {
+            // Already acked, master checks field_plan_steps in the status to see it was taken
+            const RobotServer::FieldPlanChunk& chunk = server_.getFieldPlanChunk();
+            field_plan_.addChunk(chunk.id, chunk.first, chunk.total, chunk.steps, chunk.num_steps);
+            break;
+        }
+        case COMMAND::FIELD_PLAN_RUN:
+            field_plan_.run();
+            break;
+        case COMMAND::FIELD_PLAN_PAUSE:
+            // The running step still finishes, the plan stops after it
+            field_plan_.pause();
+            break;
+        case COMMAND::FIELD_PLAN_ABORT:
+            // A step already running carries on, but finishing it no longer touches the journal
+            field_plan_.abort();
+            field_plan_step_running_ = false;
+            break;
+        default:
+            break;
+    }
+}
+
+void Robot::startNextFieldPlanStep()
+{
+    // Steps run one at a time, anything master started or queued before the plan goes first
+    if(field_plan_.getState() != FIELD_PLAN_STATE::RUNNING || field_plan_step_running_) return;
+    if(curCmd_ != COMMAND::NONE || overlapTrayCmd_ != COMMAND::NONE || !cmdQueue_.empty()) return;
+    if(statusUpdater_.getErrorStatus())
+    {
+        PLOGW.printf("Pausing field plan %u for the error status", field_plan_.getPlanId());
+        field_plan_.pause();
+        return;
+    }
+
+    const FieldPlanStep& step = field_plan_.currentStep();
+    RobotServer::CommandData data = {};
+    data.cmd = static_cast<COMMAND>(step.cmd);
+    data.move = {step.x, step.y, step.a};
+    PLOGI.printf("Field plan %u step %i of %i: command %i to [%.3f, %.3f, %.3f]", field_plan_.getPlanId(),
+                 field_plan_.getNextStep() + 1, field_plan_.getNumSteps(), static_cast<int>(data.cmd), step.x, step.y, step.a);
+    if(!tryStartNewCmd(data))
+    {
+        PLOGE.printf("Field plan %u step %i failed to start", field_plan_.getPlanId(), field_plan_.getNextStep());
+        field_plan_.pause();
+        return;
+    }
+    setCurrentCmd(data);
+    curCmdPlanStep_ = true;
+    field_plan_step_running_ = true;
+}
+
+void Robot::finishFieldPlanStep()
+{
+    // An estop or abort already dealt with the journal, the step just ran out
+    if(!field_plan_step_running_) return;
+    field_plan_step_running_ = false;
+    // A step that ended in an error is run again once master has cleared it and resumed
+    if(statusUpdater_.getErrorStatus())
+    {
+        PLOGW.printf("Field plan %u step %i ended with an error", field_plan_.getPlanId(), field_plan_.getNextStep());
+        field_plan_.pause();
+        return;
+    }
+    field_plan_.commitStep();
+}
+
+void Robot::reportCameraStopError()
+{
+    // Positive when the robot came to rest past the goal along the direction it was travelling
+    const Point rest_pos = controller_.getCurrentPosition();
+    const float error = (rest_pos.x - camera_stop_goal_.x) * cos(camera_stop_goal_.a) +
+                        (rest_pos.y - camera_stop_goal_.y) * sin(camera_stop_goal_.a);
+    statusUpdater_.updateCameraStopError(error);
+    PLOGI.printf("Camera stop at [%.3f, %.3f], %.4f m from the goal", rest_pos.x, rest_pos.y, error);
+}
+
 void Robot::resetCameraStopTriggers()
 {
     camera_stop_triggered_ = false;
+    camera_markers_confirmed_ = false;
     camera_trigger_time_1_ = ClockTimePoint::min();
     camera_trigger_time_2_ = ClockTimePoint::min();
 }
@@ -1,26 +1,53 @@
 #ifndef Robot_h
 #define Robot_h
 
+#include "CameraCalibration.h"
+#include "LoopScheduler.h"
+#include "Mailbox.h"
 #include "MarvelmindWrapper.h"
-#include "RobotController.h"
+#include "ControlLoop.h"
+#include "FieldPlan.h"
+#include "RealtimeMemory.h"
 #include "RobotServer.h"
 #include "StatusUpdater.h"
+#include "SystemHealth.h"
 #include "TrayController.h"
 #include "utils.h"
 #include "camera_tracker/CameraTracker.h"
 
+// Waits for the localization confidence to reach confidence_for_wait. Standing still the heading only converges
+// slowly from the marvelmind fixes, so with localization.active_wait enabled the base also makes small slow moves,
+// each undone by the reverse move, while the readings come in. With excitation entries that are a pure translation
+// or a pure rotation it ends back where it started, as far as the pose estimate goes. A mixed [dx, dy, da] entry
+// is a robot frame move whose reverse starts from a turned frame, so that one leaves it offset.
 class WaitForLocalizeHelper 
 {
   public:
-    WaitForLocalizeHelper(const StatusUpdater& statusUpdater, float max_timeout, float confidence_threshold);
+    WaitForLocalizeHelper(StatusUpdater& statusUpdater, ControlLoop& controller, float max_timeout, float confidence_threshold);
     bool isDone();
     void start();
 
+    // Stops the moves where they are, for an estop
+    void abort();
+
   private:
-    const StatusUpdater& statusUpdater_;
+    void startMove();
+    void finish();
+
+    StatusUpdater& statusUpdater_;
+    ControlLoop& controller_;
     Timer timer_;
+    Timer hold_timer_;
     float max_timeout_;
     float confidence_threshold_;
+    bool active_;
+    float passive_s_;
+    float hold_s_;
+    std::vector<float> excitation_;   // dx, dy, da of each move out in the robot frame
+    int moves_;                       // Moves started, odd while away from the start pose
+    bool moving_;
+    bool running_;
+    float time_to_confidence_;        // s, -1 until the threshold is reached
 };
 
 
@@ -38,31 +65,78 @@ class Robot
     COMMAND getCurrentCommand() { return curCmd_; };
     StatusUpdater::Status getStatus() { return statusUpdater_.getStatus(); };
 
+    // When run() would next wake up, lets the simulator skip straight there
+    ClockTimePoint getNextDeadline() { return scheduler_.getNextDeadline(); };
+
+    // Replay feeds recorded marvelmind readings in through this
+    MarvelmindWrapper& getMarvelmind() { return mm_wrapper_; };
+
   private:
 
     bool checkForCmdComplete(COMMAND cmd);
-    bool tryStartNewCmd(COMMAND cmd);
+    bool tryStartNewCmd(const RobotServer::CommandData& data);
+    void runImmediateCmd(const RobotServer::CommandData& data);
+    bool startLongRunningCmd(const RobotServer::CommandData& data);
+    bool isBusyFor(COMMAND cmd);
+    void setCurrentCmd(const RobotServer::CommandData& data);
+    void finishCmd(COMMAND cmd, uint32_t seq);
+    void enqueueCmd(const RobotServer::CommandData& data);
+    void startNextQueuedCmd();
+    void flushCmdQueue();
     bool checkForCameraStopTrigger();
     void resetCameraStopTriggers();
+    void reportCameraStopError();
+    void handleFieldPlanCmd(COMMAND cmd);
+    void startNextFieldPlanStep();
+    void finishFieldPlanStep();
 
     StatusUpdater statusUpdater_;
     RobotServer server_;
-    RobotController controller_;
+    MarvelmindWrapper mm_wrapper_;     // Before the controllers so the hedges open while the serial port is still being built
+    ControlLoop controller_;
     TrayController tray_controller_;
-    MarvelmindWrapper mm_wrapper_;
+    LoopScheduler scheduler_;
 
     TimeRunningAverage position_time_averager_;    // Handles keeping average of the position update timing
     TimeRunningAverage robot_loop_time_averager_; 
     WaitForLocalizeHelper wait_for_localize_helper_;
     RateController vision_print_rate_;
     CameraTrackerBase* camera_tracker_;
+    CameraCalibrator camera_calibrator_;
     ClockTimePoint camera_motion_start_time_;
     ClockTimePoint camera_trigger_time_1_;
     ClockTimePoint camera_trigger_time_2_;
     bool camera_stop_triggered_;
+    bool camera_markers_confirmed_;     // Seen in two frames in a row since the move started, latched until they are lost
+    Point camera_confirm_pos_;          // Where the robot was when the first of those frames was captured
+    float camera_stop_travel_;          // How far from camera_confirm_pos_ the robot may come to rest
+    float camera_stop_latency_;         // s from calling stopFast to the wheels starting to slow down
+    Point camera_stop_goal_;            // Where the robot should come to rest, heading in a is the direction of travel
     Point fine_move_target_;
 
     COMMAND curCmd_;
+    uint32_t curCmdSeq_;          // Sequence id of curCmd_, 0 when idle
+    bool curCmdPlanStep_;         // curCmd_ was started by the field plan, which tracks it instead of a sequence id
+    uint32_t doneCmdSeq_;         // Sequence id of the last command that finished
+    COMMAND overlapTrayCmd_;      // Tray command finishing in the background while curCmd_ moves the base
+    uint32_t overlapTrayCmdSeq_;
+    bool overlapTrayCmdPlanStep_;
+    uint32_t trayDoneCmdSeq_;     // Sequence id of the last tray command that finished
+    SpscQueue<RobotServer::CommandData, COMMAND_QUEUE_SIZE> cmdQueue_;   // Only used from the robot loop
+    Timer trace_window_timer_;    // Trace percentiles are published and reset once per window
+    int trace_window_ms_;
+    std::string trace_dump_path_;
+    AllocationCounter main_allocs_;   // Heap allocations per runOnce, which includes the controller unless it is threaded
+    bool system_health_enabled_;
+    RateController system_health_rate_;
+    SystemHealthMonitor system_health_;
+    VisionDegradePolicy degrade_policy_;
+    FieldPlanJournal field_plan_;
+    bool field_plan_step_running_;   // The journal's current step is running, cleared when an estop or abort cuts it short
+    std::string flight_dump_dir_;
+    RateController flight_loop_rate_;   // LOOP records for the flight recorder
+    Timer flight_loop_timer_;
+    int flight_loop_max_ms_;            // Longest runOnce since the last LOOP record
 };
 
 
@@ -1,15 +1,96 @@
 #include "RobotControllerModeBase.h"
+#include "constants.h"
+#include "ConfigSnapshot.h"
+#include <plog/Log.h>
 
 RobotControllerModeBase::RobotControllerModeBase(bool fake_perfect_motion)
 : move_start_timer_(),
   move_running_(false),
-  fake_perfect_motion_(fake_perfect_motion)
+  fake_perfect_motion_(fake_perfect_motion),
+  log_motion_csv_(ConfigSnapshot::current()->log_motion_csv),
+  cycle_record_(),
+  cycle_record_ready_(false),
+  settle_(),
+  approach_(),
+  approach_enabled_(false),
+  approach_active_(false),
+  approach_window_(0)
 {
 }
 
-void RobotControllerModeBase::startMove()
+void RobotControllerModeBase::reset()
+{
+    move_running_ = false;
+    log_motion_csv_ = ConfigSnapshot::current()->log_motion_csv;
+    cycle_record_ready_ = false;
+    settle_.start({0, 0, 0});
+    approach_enabled_ = false;
+    approach_active_ = false;
+}
+
+void RobotControllerModeBase::startMove(SettleDetector::Params settle)
 {
     move_running_ = true;
+    settle_.start(settle);
     move_start_timer_.reset();
     loop_timer_.reset();
-}
\ No newline at end of file
+}
+void RobotControllerModeBase::configureApproach(LIMITS_MODE limits_mode)
+{
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    // Faked motion follows the trajectory exactly, there is nothing to approach
+    approach_enabled_ = config->approach_mpc.enabled && limits_mode != LIMITS_MODE::COARSE && !fake_perfect_motion_;
+    approach_active_ = false;
+    approach_window_ = config->approach_mpc.window;
+    if(approach_enabled_)
+    {
+        approach_.configure(config->approach_mpc, config->translation.limits(limits_mode), config->rotation.limits(limits_mode),
+                            config->wheel_limits);
+    }
+}
+
+bool RobotControllerModeBase::approachActive(float time_remaining)
+{
+    if(!approach_active_ && approach_enabled_ && time_remaining <= approach_window_)
+    {
+        approach_active_ = true;
+        approach_.restart();
+        PLOGI_(MOTION_LOG_ID).printf("Approach controller taking over with %.3f s of trajectory left", time_remaining);
+    }
+    return approach_active_;
+}
+
+TelemetryRecord RobotControllerModeBase::cycleRecord(float time, Point pos, const PVTPoint& target, Velocity vel, Velocity control_vel)
+{
+    TelemetryRecord record;
+    record.time = time;
+    record.pos[0] = pos.x; record.pos[1] = pos.y; record.pos[2] = pos.a;
+    record.target_pos[0] = target.position.x; record.target_pos[1] = target.position.y; record.target_pos[2] = target.position.a;
+    record.vel[0] = vel.vx; record.vel[1] = vel.vy; record.vel[2] = vel.va;
+    record.target_vel[0] = target.velocity.vx; record.target_vel[1] = target.velocity.vy; record.target_vel[2] = target.velocity.va;
+    record.control_vel[0] = control_vel.vx; record.control_vel[1] = control_vel.vy; record.control_vel[2] = control_vel.va;
+    return record;
+}
+
+void RobotControllerModeBase::logCycle(const TelemetryRecord& record)
+{
+    if(log_motion_csv_)
+    {
+        PLOGI_(MOTION_CSV_LOG_ID).printf("time,%.4f",record.time);
+        PLOGI_(MOTION_CSV_LOG_ID).printf("pos,%.4f,%.4f,%.4f",record.pos[0],record.pos[1],record.pos[2]);
+        PLOGI_(MOTION_CSV_LOG_ID).printf("target_pos,%.4f,%.4f,%.4f",record.target_pos[0],record.target_pos[1],record.target_pos[2]);
+        PLOGI_(MOTION_CSV_LOG_ID).printf("vel,%.4f,%.4f,%.4f",record.vel[0],record.vel[1],record.vel[2]);
+        PLOGI_(MOTION_CSV_LOG_ID).printf("target_vel,%.4f,%.4f,%.4f",record.target_vel[0],record.target_vel[1],record.target_vel[2]);
+        PLOGI_(MOTION_CSV_LOG_ID).printf("control_vel,%.4f,%.4f,%.4f",record.control_vel[0],record.control_vel[1],record.control_vel[2]);
+    }
+    cycle_record_ = record;
+    cycle_record_ready_ = true;
+}
+
+bool RobotControllerModeBase::takeCycleRecord(TelemetryRecord* record)
+{
+    if(!cycle_record_ready_) return false;
+    *record = cycle_record_;
+    cycle_record_ready_ = false;
+    return true;
+}
@@ -1,7 +1,10 @@
 #ifndef RobotControllerModeBase_h
 #define RobotControllerModeBase_h
 
+#include "ApproachMpc.h"
+#include "Se2.h"
 #include "SmoothTrajectoryGenerator.h"
+#include "Telemetry.h"
 #include "utils.h"
 
 class RobotControllerModeBase
@@ -11,26 +14,61 @@ class RobotControllerModeBase
 
     RobotControllerModeBase(bool fake_perfect_motion);
 
-    virtual Velocity computeTargetVelocity(Point current_position, Velocity current_velocity, bool log_this_cycle) = 0;
+    // current_rotation is the rotation of current_position's heading, computed once per cycle by the controller
+    virtual Velocity computeTargetVelocity(Point current_position, Velocity current_velocity, const Rotation2D& current_rotation, bool log_this_cycle) = 0;
 
     virtual bool checkForMoveComplete(Point current_position, Velocity current_velocity) = 0;
 
+    // Modes are kept between moves, this puts one back in its constructed state with the current config.
+    // Must not allocate so switching modes from a trigger stays fast.
+    virtual void reset();
+
+    // True if the motor driver is following the trajectory itself, so the target velocity must not be streamed
+    virtual bool followedByMotorDriver() const { return false; };
+
+    // Seconds until the planned move ends, negative for modes that keep replanning and can't say
+    virtual float getTimeRemaining() { return -1; };
+
+    // Moves the goal of the running move without stopping first. False if the mode can't, or nothing is running.
+    virtual bool updateGoal(Point goal) { (void) goal; return false; };
+
+    // s from the end of the last trajectory to it settling, negative if it didn't or the mode doesn't check
+    float getSettleTime() const { return settle_.settleTime(); };
+
+    // Hands over the record logged by the last computeTargetVelocity call, false if nothing was logged since
+    bool takeCycleRecord(TelemetryRecord* record);
+
   protected:
 
-    struct TrajectoryTolerances
-    {
-        float trans_pos_err;
-        float ang_pos_err;
-        float trans_vel_err;
-        float ang_vel_err;
-    };
+    // settle is how checkForMoveComplete decides the move has come to rest, for modes that use settle_
+    void startMove(SettleDetector::Params settle = {0, 0, 0});
+
+    // Record with the fields every mode has, modes with a filter or cameras fill in the rest before logging it
+    static TelemetryRecord cycleRecord(float time, Point pos, const PVTPoint& target, Velocity vel, Velocity control_vel);
+
+    // Writes the cycle to the text motion log if that is enabled and keeps it for the binary telemetry
+    void logCycle(const TelemetryRecord& record);
+
+    // Sets approach_ up for a move in limits_mode, called as the move starts. Only fine and vision moves use it,
+    // and only with motion.approach_mpc enabled.
+    void configureApproach(LIMITS_MODE limits_mode);
 
-    void startMove();
+    // True once approach_ has taken over the move, which happens when the trajectory has less than
+    // motion.approach_mpc.window left and lasts until the move ends
+    bool approachActive(float time_remaining);
 
     Timer move_start_timer_;
     Timer loop_timer_;
     bool move_running_; 
     bool fake_perfect_motion_;
+    bool log_motion_csv_;
+    TelemetryRecord cycle_record_;
+    bool cycle_record_ready_;
+    SettleDetector settle_;
+    ApproachMpc approach_;
+    bool approach_enabled_;
+    bool approach_active_;
+    float approach_window_;
 
 };
 
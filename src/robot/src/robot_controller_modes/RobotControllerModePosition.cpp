@@ -1,51 +1,169 @@
 #include "RobotControllerModePosition.h"
 #include "constants.h"
+#include "ConfigSnapshot.h"
 #include <plog/Log.h>
 
-RobotControllerModePosition::RobotControllerModePosition(bool fake_perfect_motion)
+namespace
+{
+    // Lets the driver ignore corrections meant for an earlier trajectory
+    uint16_t next_traj_id = 0;
+}
+
+RobotControllerModePosition::RobotControllerModePosition(bool fake_perfect_motion, TrajectoryCache* cache)
 : RobotControllerModeBase(fake_perfect_motion),
-  traj_gen_(),
+  traj_gen_(cache),
   limits_mode_(LIMITS_MODE::FINE),
   goal_pos_(0,0,0),
-  current_target_()
+  current_target_(),
+  driver_serial_(nullptr),
+  driver_following_(false),
+  traj_id_(0),
+  correction_timer_(),
+  correction_period_s_(0)
 {
-    coarse_tolerances_.trans_pos_err = cfg.lookup("motion.translation.position_threshold.coarse");
-    coarse_tolerances_.ang_pos_err = cfg.lookup("motion.rotation.position_threshold.coarse");
-    coarse_tolerances_.trans_vel_err = cfg.lookup("motion.translation.velocity_threshold.coarse");
-    coarse_tolerances_.ang_vel_err = cfg.lookup("motion.rotation.velocity_threshold.coarse");
-
-    fine_tolerances_.trans_pos_err = cfg.lookup("motion.translation.position_threshold.fine");
-    fine_tolerances_.ang_pos_err = cfg.lookup("motion.rotation.position_threshold.fine");
-    fine_tolerances_.trans_vel_err = cfg.lookup("motion.translation.velocity_threshold.fine");
-    fine_tolerances_.ang_vel_err = cfg.lookup("motion.rotation.velocity_threshold.fine");
-
-    PositionController::Gains position_gains;
-    position_gains.kp = cfg.lookup("motion.translation.gains.kp");
-    position_gains.ki = cfg.lookup("motion.translation.gains.ki");
-    position_gains.kd = cfg.lookup("motion.translation.gains.kd");
-    x_controller_ = PositionController(position_gains);
-    y_controller_ = PositionController(position_gains);
-
-    PositionController::Gains angle_gains;
-    angle_gains.kp = cfg.lookup("motion.rotation.gains.kp");
-    angle_gains.ki = cfg.lookup("motion.rotation.gains.ki");
-    angle_gains.kd = cfg.lookup("motion.rotation.gains.kd");
-    a_controller_ = PositionController(angle_gains);
+    reset();
+}
+
+void RobotControllerModePosition::reset()
+{
+    RobotControllerModeBase::reset();
+    traj_gen_.refreshConfig();
+    limits_mode_ = LIMITS_MODE::FINE;
+    driver_serial_ = nullptr;
+    driver_following_ = false;
+
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    correction_period_s_ = config->driver_correction_period_s;
+
+    coarse_tolerances_.trans_pos_err = config->translation.position_threshold_coarse;
+    coarse_tolerances_.ang_pos_err = config->rotation.position_threshold_coarse;
+    coarse_tolerances_.trans_vel_err = config->translation.velocity_threshold_coarse;
+    coarse_tolerances_.ang_vel_err = config->rotation.velocity_threshold_coarse;
+
+    fine_tolerances_.trans_pos_err = config->translation.position_threshold_fine;
+    fine_tolerances_.ang_pos_err = config->rotation.position_threshold_fine;
+    fine_tolerances_.trans_vel_err = config->translation.velocity_threshold_fine;
+    fine_tolerances_.ang_vel_err = config->rotation.velocity_threshold_fine;
+
+    x_controller_ = PositionController(config->translation.gains);
+    y_controller_ = PositionController(config->translation.gains);
+    a_controller_ = PositionController(config->rotation.gains);
 }
 
 bool RobotControllerModePosition::startMove(Point current_position, Point target_position, LIMITS_MODE limits_mode)
 {
     limits_mode_ = limits_mode;
     goal_pos_ = target_position;
-    bool ok = traj_gen_.generatePointToPointTrajectory(current_position, target_position, limits_mode);
-    if(ok) RobotControllerModeBase::startMove();
+    return beginPointToPoint(traj_gen_.generatePointToPointTrajectory(current_position, target_position, limits_mode));
+}
+
+bool RobotControllerModePosition::startPlannedMove(Point target_position, const Trajectory& trajectory, LIMITS_MODE limits_mode)
+{
+    limits_mode_ = limits_mode;
+    goal_pos_ = target_position;
+    return beginPointToPoint(traj_gen_.setPointToPointTrajectory(trajectory));
+}
+
+bool RobotControllerModePosition::beginPointToPoint(bool generated)
+{
+    if(!generated) return false;
+    warnIfOverWheelLimits();
+    if(driver_serial_) uploadTrajectory();
+    RobotControllerModeBase::startMove(ConfigSnapshot::current()->settle.params(limits_mode_));
+    configureApproach(limits_mode_);
+    return true;
+}
+
+void RobotControllerModePosition::warnIfOverWheelLimits()
+{
+    // The axis limits don't bound the wheels for every mix of translation and rotation, the velocity clamp
+    // in the controller does. This says up front when a move is going to hit it.
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    if(config->wheel_check_dt <= 0) return;
+    WheelFeasibility wheels = traj_gen_.checkWheelFeasibility(config->wheel_limits, config->wheel_check_dt);
+    if(!wheels.ok)
+    {
+        PLOGW.printf("Trajectory exceeds wheel limits at %.2f s, max wheel vel %.3f m/s, max wheel acc %.3f m/s^2",
+            wheels.worst_time, wheels.max_vel, wheels.max_acc);
+    }
+}
+
+void RobotControllerModePosition::enableDriverTrajectory(SerialCommsBase* serial)
+{
+    driver_serial_ = serial;
+}
+
+void RobotControllerModePosition::uploadTrajectory()
+{
+    const Trajectory& traj = traj_gen_.getTrajectory();
+    traj_id_ = next_traj_id++;
+
+    uint8_t payload[SERIAL_TRAJECTORY_AXIS_PAYLOAD_SIZE];
+    encodeTrajectoryAxisPayload(toSerialTrajectoryAxis(traj_id_, SERIAL_TRAJECTORY_AXIS::TRANSLATION, 
+        traj.trans_direction[0], traj.trans_direction[1], traj.trans_params), payload);
+    driver_serial_->send_frame(SERIAL_BINARY_CHANNEL::TRAJECTORY_AXIS, payload, SERIAL_TRAJECTORY_AXIS_PAYLOAD_SIZE);
+    encodeTrajectoryAxisPayload(toSerialTrajectoryAxis(traj_id_, SERIAL_TRAJECTORY_AXIS::ROTATION, 
+        static_cast<float>(traj.rot_direction), 0, traj.rot_params), payload);
+    driver_serial_->send_frame(SERIAL_BINARY_CHANNEL::TRAJECTORY_AXIS, payload, SERIAL_TRAJECTORY_AXIS_PAYLOAD_SIZE);
+
+    uint8_t start_payload[SERIAL_TRAJECTORY_START_PAYLOAD_SIZE];
+    encodeTrajectoryStartPayload(traj_id_, traj.initialPoint.a, start_payload);
+    driver_serial_->send_frame(SERIAL_BINARY_CHANNEL::TRAJECTORY_START, start_payload, SERIAL_TRAJECTORY_START_PAYLOAD_SIZE);
+
+    driver_following_ = true;
+    correction_timer_.reset();
+    PLOGI.printf("Uploaded trajectory %u to motor driver", traj_id_);
+}
+
+void RobotControllerModePosition::sendCorrection(Point current_position, Velocity control_vel)
+{
+    SerialTrajectoryCorrection correction;
+    correction.traj_id = traj_id_;
+    correction.vel = {control_vel.vx - current_target_.velocity.vx,
+                      control_vel.vy - current_target_.velocity.vy,
+                      control_vel.va - current_target_.velocity.va};
+    correction.heading_error = angle_diff(current_position.a, current_target_.position.a);
+
+    uint8_t payload[SERIAL_TRAJECTORY_CORRECTION_PAYLOAD_SIZE];
+    encodeTrajectoryCorrectionPayload(correction, payload);
+    driver_serial_->send_frame(SERIAL_BINARY_CHANNEL::TRAJECTORY_CORRECTION, payload, SERIAL_TRAJECTORY_CORRECTION_PAYLOAD_SIZE);
+}
+
+bool RobotControllerModePosition::startPath(Point current_position, const std::vector<Point>& waypoints, LIMITS_MODE limits_mode)
+{
+    if(waypoints.empty()) return false;
+    limits_mode_ = limits_mode;
+    goal_pos_ = waypoints.back();
+    bool ok = traj_gen_.generatePathTrajectory(current_position, waypoints, limits_mode);
+    if(ok) warnIfOverWheelLimits();
+    if(ok) RobotControllerModeBase::startMove(ConfigSnapshot::current()->settle.params(limits_mode));
     return ok;
 }
 
-Velocity RobotControllerModePosition::computeTargetVelocity(Point current_position, Velocity current_velocity, bool log_this_cycle)
+bool RobotControllerModePosition::updateGoal(Point goal)
+{
+    if(!move_running_ || !traj_gen_.retarget(move_start_timer_.dt_s(), goal, limits_mode_)) return false;
+    goal_pos_ = goal;
+    if(driver_following_)
+    {
+        driver_following_ = false;
+        PLOGI.printf("Stopped driver following of trajectory %u for new goal", traj_id_);
+    }
+    return true;
+}
+
+float RobotControllerModePosition::getTimeRemaining()
+{
+    return std::max(0.0f, traj_gen_.getDuration() - move_start_timer_.dt_s());
+}
+
+Velocity RobotControllerModePosition::computeTargetVelocity(Point current_position, Velocity current_velocity, const Rotation2D& current_rotation, bool log_this_cycle)
 {
     float dt_from_traj_start = move_start_timer_.dt_s();
-    current_target_ = traj_gen_.lookup(dt_from_traj_start);
+    // The driver can only follow the whole trajectory, so it keeps the approach to itself
+    const bool approach = !driver_following_ && approachActive(traj_gen_.getDuration() - dt_from_traj_start);
+    if(approach) current_target_ = {goal_pos_, {0, 0, 0}, dt_from_traj_start, {0, 0, 0}};
+    else current_target_ = traj_gen_.lookup(dt_from_traj_start);
 
     // Print motion estimates to log
     PLOGD_IF_(MOTION_LOG_ID, log_this_cycle) << "Target: " << current_target_.toString();
@@ -61,17 +179,30 @@ Velocity RobotControllerModePosition::computeTargetVelocity(Point current_positi
     {
         float dt_since_last_loop = loop_timer_.dt_s();
         loop_timer_.reset();
-        output.vx = x_controller_.compute(current_target_.position.x, current_position.x, current_target_.velocity.vx, current_velocity.vx, dt_since_last_loop);
-        output.vy = y_controller_.compute(current_target_.position.y, current_position.y, current_target_.velocity.vy, current_velocity.vy, dt_since_last_loop);
-        output.va = a_controller_.compute(current_target_.position.a, current_position.a, current_target_.velocity.va, current_velocity.va, dt_since_last_loop);
+        if(approach)
+        {
+            // The approach works in the robot frame, the wheels limit it there
+            const Velocity error = {goal_pos_.x - current_position.x, goal_pos_.y - current_position.y, angle_diff(goal_pos_.a, current_position.a)};
+            const Velocity local_output = approach_.solve(current_rotation.toLocal(error), current_rotation.toLocal(current_velocity), dt_since_last_loop);
+            output = current_rotation.toGlobal(local_output);
+        }
+        else
+        {
+            // A driver following the trajectory itself already accelerates along it, it only needs the feedback
+            const Velocity target_acc = driver_following_ ? Velocity() : current_target_.acceleration;
+            output.vx = x_controller_.compute(current_target_.position.x, current_position.x, current_target_.velocity.vx, current_velocity.vx, dt_since_last_loop, target_acc.vx);
+            output.vy = y_controller_.compute(current_target_.position.y, current_position.y, current_target_.velocity.vy, current_velocity.vy, dt_since_last_loop, target_acc.vy);
+            output.va = a_controller_.compute(current_target_.position.a, current_position.a, current_target_.velocity.va, current_velocity.va, dt_since_last_loop, target_acc.va);
+        }
+
+        if(driver_following_ && correction_timer_.dt_s() >= correction_period_s_)
+        {
+            correction_timer_.reset();
+            sendCorrection(current_position, output);
+        }
     }
 
-    PLOGI_(MOTION_CSV_LOG_ID).printf("time,%.4f",dt_from_traj_start);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("pos,%.4f,%.4f,%.4f",current_position.x,current_position.y,current_position.a);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("target_pos,%.4f,%.4f,%.4f",current_target_.position.x,current_target_.position.y,current_target_.position.a);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("vel,%.4f,%.4f,%.4f",current_velocity.vx,current_velocity.vy,current_velocity.va);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("target_vel,%.4f,%.4f,%.4f",current_target_.velocity.vx,current_target_.velocity.vy,current_target_.velocity.va);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("control_vel,%.4f,%.4f,%.4f",output.vx,output.vy,output.va);
+    logCycle(cycleRecord(dt_from_traj_start, current_position, current_target_, current_velocity, output));
 
     return output;
 }
@@ -84,18 +215,13 @@ bool RobotControllerModePosition::checkForMoveComplete(Point current_position, V
     // Verify our target velocity is zero (i.e. we reached the end of the trajectory)
     bool zero_cmd_vel = current_target_.velocity.nearZero();
 
-    // Verify actual translational and rotational positions are within tolerance
+    // Trajectory is done when we aren't commanding any velocity and both our actual velocity and position
+    // have settled within the correct tolerance. Odometry doesn't give an uncertainty so none is allowed for.
     Eigen::Vector2f dp = {goal_pos_.x - current_position.x, goal_pos_.y - current_position.y};
-    bool pos_in_tolerance = dp.norm() < tol.trans_pos_err &&
-                            fabs(angle_diff(goal_pos_.a, current_position.a)) < tol.ang_pos_err; 
-
-    // Verify actual translational and rotational velocities are within tolerance
     Eigen::Vector2f dv = {current_velocity.vx, current_velocity.vy};
-    bool vel_in_tolerance = dv.norm() < tol.trans_vel_err && fabs(current_velocity.va) < tol.ang_vel_err;
-
-    // Trajectory is done when we aren't commanding any velocity, our both our actual velocity and
-    // position are within the correct tolerance.
-    bool traj_complete = zero_cmd_vel && vel_in_tolerance && pos_in_tolerance;
+    SettleDetector::Sample sample = {zero_cmd_vel, dp.norm(), fabs(angle_diff(goal_pos_.a, current_position.a)),
+                                     dv.norm(), fabs(current_velocity.va), 0, 0};
+    bool traj_complete = settle_.update(sample, tol, move_start_timer_.dt_s());
     
     if(traj_complete) 
     {
@@ -3,6 +3,7 @@
 
 #include "RobotControllerModeBase.h"
 #include "SmoothTrajectoryGenerator.h"
+#include "serial/SerialCommsBase.h"
 #include "utils.h"
 
 class RobotControllerModePosition : public RobotControllerModeBase
@@ -10,16 +11,50 @@ class RobotControllerModePosition : public RobotControllerModeBase
 
   public:
 
-    RobotControllerModePosition(bool fake_perfect_motion);
+    // cache is optional, and must outlive the mode
+    RobotControllerModePosition(bool fake_perfect_motion, TrajectoryCache* cache = nullptr);
+
+    // Also turns driver trajectories back off
+    virtual void reset() override;
 
     bool startMove(Point current_position, Point target_position, LIMITS_MODE limits_mode);
 
-    virtual Velocity computeTargetVelocity(Point current_position, Velocity current_velocity, bool log_this_cycle) override;
+    // Same as startMove with a trajectory that has already been solved, see TrajectoryPlanner
+    bool startPlannedMove(Point target_position, const Trajectory& trajectory, LIMITS_MODE limits_mode);
+
+    // Follows a path through each waypoint in turn, the move completes at the last one
+    bool startPath(Point current_position, const std::vector<Point>& waypoints, LIMITS_MODE limits_mode);
+
+    virtual Velocity computeTargetVelocity(Point current_position, Velocity current_velocity, const Rotation2D& current_rotation, bool log_this_cycle) override;
 
     virtual bool checkForMoveComplete(Point current_position, Velocity current_velocity) override;
 
+    // Point to point moves are uploaded to the motor driver, which evaluates the s-curves at its own loop rate.
+    // Only the feedback part of the position controller is sent, at motion.driver_trajectory.correction_frequency.
+    // Must be called before startMove, serial must outlive the mode.
+    void enableDriverTrajectory(SerialCommsBase* serial);
+
+    virtual bool followedByMotorDriver() const override { return driver_following_; };
+
+    // Goes to 0 when the trajectory ends, settling onto the goal after that isn't included
+    virtual float getTimeRemaining() override;
+
+    // Splices a trajectory to the new goal onto the one running. The driver only has the trajectory it was
+    // uploaded, so after this the rest of the move is followed here and streamed as velocities again.
+    virtual bool updateGoal(Point goal) override;
+
   protected:
 
+    // Shared by both ways of starting a point to point move once the trajectory is in traj_gen_
+    bool beginPointToPoint(bool generated);
+
+    void uploadTrajectory();
+
+    // Warns if the planned move takes a wheel past trajectory_generation.coupled limits
+    void warnIfOverWheelLimits();
+
+    void sendCorrection(Point current_position, Velocity control_vel);
+
     SmoothTrajectoryGenerator traj_gen_; 
     LIMITS_MODE limits_mode_;
     Point goal_pos_;
@@ -31,6 +66,12 @@ class RobotControllerModePosition : public RobotControllerModeBase
     PositionController x_controller_;
     PositionController y_controller_;
     PositionController a_controller_;
+
+    SerialCommsBase* driver_serial_;
+    bool driver_following_;
+    uint16_t traj_id_;
+    Timer correction_timer_;
+    float correction_period_s_;
     
 
 };
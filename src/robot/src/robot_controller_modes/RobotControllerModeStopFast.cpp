@@ -1,36 +1,72 @@
 #include "RobotControllerModeStopFast.h"
 #include "constants.h"
+#include "ConfigSnapshot.h"
 #include <plog/Log.h>
 
 RobotControllerModeStopFast::RobotControllerModeStopFast(bool fake_perfect_motion)
 : RobotControllerModeBase(fake_perfect_motion),
+  planned_(false),
+  traj_gen_(),
   current_target_()
 {
-    fine_tolerances_.trans_pos_err = cfg.lookup("motion.translation.position_threshold.fine");
-    fine_tolerances_.ang_pos_err = cfg.lookup("motion.rotation.position_threshold.fine");
-    fine_tolerances_.trans_vel_err = cfg.lookup("motion.translation.velocity_threshold.fine");
-    fine_tolerances_.ang_vel_err = cfg.lookup("motion.rotation.velocity_threshold.fine");
-
-    max_decel_ = {cfg.lookup("motion.translation.max_acc.coarse"),
-                  cfg.lookup("motion.translation.max_acc.coarse"),
-                  cfg.lookup("motion.rotation.max_acc.coarse")};
-                          
-    PositionController::Gains position_gains;
-    position_gains.kp = cfg.lookup("motion.translation.gains.kp");
-    position_gains.ki = cfg.lookup("motion.translation.gains.ki");
-    position_gains.kd = cfg.lookup("motion.translation.gains.kd");
-    x_controller_ = PositionController(position_gains);
-    y_controller_ = PositionController(position_gains);
-
-    PositionController::Gains angle_gains;
-    angle_gains.kp = cfg.lookup("motion.rotation.gains.kp");
-    angle_gains.ki = cfg.lookup("motion.rotation.gains.ki");
-    angle_gains.kd = cfg.lookup("motion.rotation.gains.kd");
-    a_controller_ = PositionController(angle_gains);
+    reset();
+}
+
+void RobotControllerModeStopFast::reset()
+{
+    RobotControllerModeBase::reset();
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    fine_tolerances_.trans_pos_err = config->translation.position_threshold_fine;
+    fine_tolerances_.ang_pos_err = config->rotation.position_threshold_fine;
+    fine_tolerances_.trans_vel_err = config->translation.velocity_threshold_fine;
+    fine_tolerances_.ang_vel_err = config->rotation.velocity_threshold_fine;
+
+    planned_ = config->stop_fast_planned;
+    trans_limits_ = config->translation.coarse;
+    rot_limits_ = config->rotation.coarse;
+    max_decel_ = {config->translation.coarse.max_acc,
+                  config->translation.coarse.max_acc,
+                  config->rotation.coarse.max_acc};
+
+    x_controller_ = PositionController(config->translation.gains);
+    y_controller_ = PositionController(config->translation.gains);
+    a_controller_ = PositionController(config->rotation.gains);
+}
+
+float RobotControllerModeStopFast::predictStopDistance(Velocity velocity)
+{
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    const DynamicLimits& limits = config->translation.coarse;
+    if(config->stop_fast_planned)
+    {
+        SCurveParameters params;
+        generateStopSCurve(Eigen::Vector2f(velocity.vx, velocity.vy).norm(), limits, &params);
+        return params.switch_points[7].p;
+    }
+    // Both axes at the full deceleration from their own speed
+    const Eigen::Vector2f dist = {velocity.vx * velocity.vx, velocity.vy * velocity.vy};
+    return dist.norm() / (2 * limits.max_acc);
+}
+
+float RobotControllerModeStopFast::getTimeRemaining()
+{
+    if(!planned_) return -1;
+    return std::max(0.0f, traj_gen_.getDuration() - move_start_timer_.dt_s());
 }
 
 void RobotControllerModeStopFast::startMove(Point current_position, Velocity current_velocity)
 {
+    if(planned_)
+    {
+        traj_gen_.generateStopTrajectory(current_position, current_velocity, trans_limits_, rot_limits_);
+        const Trajectory& traj = traj_gen_.getTrajectory();
+        PLOGW.printf("Starting planned STOP_FAST from velocity %.3f,%.3f,%.3f, stopping in %.3f m and %.3f rad over %.3f s",
+            current_velocity.vx, current_velocity.vy, current_velocity.va, traj.trans_params.switch_points[7].p,
+            traj.rot_params.switch_points[7].p, traj_gen_.getDuration());
+        RobotControllerModeBase::startMove();
+        return;
+    }
+
     (void) current_position;
     initial_vel_sign_ = {
         sgn(current_velocity.vx),
@@ -42,14 +78,13 @@ void RobotControllerModeStopFast::startMove(Point current_position, Velocity cur
         -initial_vel_sign_[1] * max_decel_[1],
         -initial_vel_sign_[2] * max_decel_[2],
     };
-    PLOGW.printf("Starting STOP_FAST from velocity %s at decel: %f,%f,%f",current_velocity.toString().c_str(),
-        current_decel_[0],current_decel_[1], current_decel_[2]);
+    PLOGW.printf("Starting STOP_FAST from velocity %.3f,%.3f,%.3f at decel: %f,%f,%f",
+        current_velocity.vx, current_velocity.vy, current_velocity.va, current_decel_[0], current_decel_[1], current_decel_[2]);
     RobotControllerModeBase::startMove();
 }
 
-Velocity RobotControllerModeStopFast::computeTargetVelocity(Point current_position, Velocity current_velocity, bool log_this_cycle)
+PVTPoint RobotControllerModeStopFast::constantDecelTarget(Point current_position, Velocity current_velocity, float time)
 {
-    float dt_from_traj_start = move_start_timer_.dt_s();
     float dt = loop_timer_.dt_s();
     Point target_pos = {
         current_position.x + current_velocity.vx * dt + 0.5f * current_decel_[0] * dt * dt,
@@ -62,11 +97,27 @@ Velocity RobotControllerModeStopFast::computeTargetVelocity(Point current_positi
         current_velocity.va + current_decel_[2]*dt,
     };
 
-    if(current_velocity.vx != 0 && sgn(current_velocity.vx) != initial_vel_sign_[0]) target_vel.vx = 0;
-    if(current_velocity.vy != 0 && sgn(current_velocity.vy) != initial_vel_sign_[1]) target_vel.vy = 0;
-    if(current_velocity.va != 0 && sgn(current_velocity.va) != initial_vel_sign_[2]) target_vel.va = 0;
+    Velocity target_acc = {current_decel_[0], current_decel_[1], current_decel_[2]};
+
+    if(current_velocity.vx != 0 && sgn(current_velocity.vx) != initial_vel_sign_[0]) target_vel.vx = target_acc.vx = 0;
+    if(current_velocity.vy != 0 && sgn(current_velocity.vy) != initial_vel_sign_[1]) target_vel.vy = target_acc.vy = 0;
+    if(current_velocity.va != 0 && sgn(current_velocity.va) != initial_vel_sign_[2]) target_vel.va = target_acc.va = 0;
+
+    return {target_pos, target_vel, time, target_acc};
+}
 
-    current_target_ = {target_pos, target_vel, dt_from_traj_start};
+Velocity RobotControllerModeStopFast::computeTargetVelocity(Point current_position, Velocity current_velocity, const Rotation2D& current_rotation, bool log_this_cycle)
+{
+    (void) current_rotation;
+    float dt_from_traj_start = move_start_timer_.dt_s();
+    if(planned_)
+    {
+        current_target_ = traj_gen_.lookup(dt_from_traj_start);
+    }
+    else
+    {
+        current_target_ = constantDecelTarget(current_position, current_velocity, dt_from_traj_start);
+    }
 
     // Print motion estimates to log
     PLOGD_IF_(MOTION_LOG_ID, log_this_cycle) << "Target: " << current_target_.toString();
@@ -82,17 +133,21 @@ Velocity RobotControllerModeStopFast::computeTargetVelocity(Point current_positi
     {
         float dt_since_last_loop = loop_timer_.dt_s();
         loop_timer_.reset();
-        output.vx = x_controller_.compute(0, 0, current_target_.velocity.vx, current_velocity.vx, dt_since_last_loop);
-        output.vy = y_controller_.compute(0, 0, current_target_.velocity.vy, current_velocity.vy, dt_since_last_loop);
-        output.va = a_controller_.compute(0, 0, current_target_.velocity.va, current_velocity.va, dt_since_last_loop);
+        if(planned_)
+        {
+            output.vx = x_controller_.compute(current_target_.position.x, current_position.x, current_target_.velocity.vx, current_velocity.vx, dt_since_last_loop, current_target_.acceleration.vx);
+            output.vy = y_controller_.compute(current_target_.position.y, current_position.y, current_target_.velocity.vy, current_velocity.vy, dt_since_last_loop, current_target_.acceleration.vy);
+            output.va = a_controller_.compute(current_target_.position.a, current_position.a, current_target_.velocity.va, current_velocity.va, dt_since_last_loop, current_target_.acceleration.va);
+        }
+        else
+        {
+            output.vx = x_controller_.compute(0, 0, current_target_.velocity.vx, current_velocity.vx, dt_since_last_loop);
+            output.vy = y_controller_.compute(0, 0, current_target_.velocity.vy, current_velocity.vy, dt_since_last_loop);
+            output.va = a_controller_.compute(0, 0, current_target_.velocity.va, current_velocity.va, dt_since_last_loop);
+        }
     }
 
-    PLOGI_(MOTION_CSV_LOG_ID).printf("time,%.4f",dt_from_traj_start);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("pos,%.4f,%.4f,%.4f",current_position.x,current_position.y,current_position.a);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("target_pos,%.4f,%.4f,%.4f",current_target_.position.x,current_target_.position.y,current_target_.position.a);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("vel,%.4f,%.4f,%.4f",current_velocity.vx,current_velocity.vy,current_velocity.va);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("target_vel,%.4f,%.4f,%.4f",current_target_.velocity.vx,current_target_.velocity.vy,current_target_.velocity.va);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("control_vel,%.4f,%.4f,%.4f",output.vx,output.vy,output.va);
+    logCycle(cycleRecord(dt_from_traj_start, current_position, current_target_, current_velocity, output));
 
     return output;
 }
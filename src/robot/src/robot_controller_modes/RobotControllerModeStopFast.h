@@ -4,6 +4,7 @@
 #include "RobotControllerModeBase.h"
 #include "SmoothTrajectoryGenerator.h"
 #include "utils.h"
+#include <array>
 
 class RobotControllerModeStopFast : public RobotControllerModeBase
 {
@@ -12,19 +13,38 @@ class RobotControllerModeStopFast : public RobotControllerModeBase
 
     RobotControllerModeStopFast(bool fake_perfect_motion);
 
+    virtual void reset() override;
+
     void startMove(Point current_position, Velocity current_velocity);
 
-    virtual Velocity computeTargetVelocity(Point current_position, Velocity current_velocity, bool log_this_cycle) override;
+    virtual Velocity computeTargetVelocity(Point current_position, Velocity current_velocity, const Rotation2D& current_rotation, bool log_this_cycle) override;
 
     virtual bool checkForMoveComplete(Point current_position, Velocity current_velocity) override;
 
+    // Only known for planned stops
+    virtual float getTimeRemaining() override;
+
+    // How far the robot would travel if a stop started now at velocity, with the current config
+    static float predictStopDistance(Velocity velocity);
+
   protected:
 
+    // Target for the next cycle when each axis just decelerates from where it is
+    PVTPoint constantDecelTarget(Point current_position, Velocity current_velocity, float time);
+
+    // With motion.stop_fast.planned the stop is a synchronized jerk limited trajectory from the state at the
+    // start, and the position along it is tracked. Otherwise each axis decelerates at its limit from the
+    // measured velocity every cycle.
+    bool planned_;
+    SmoothTrajectoryGenerator traj_gen_;
+    DynamicLimits trans_limits_;
+    DynamicLimits rot_limits_;
+
     PVTPoint current_target_;
     TrajectoryTolerances fine_tolerances_;
-    std::vector<float> max_decel_; 
-    std::vector<float> current_decel_;
-    std::vector<int> initial_vel_sign_;  
+    std::array<float, 3> max_decel_;
+    std::array<float, 3> current_decel_;
+    std::array<int, 3> initial_vel_sign_;
 
     PositionController x_controller_;
     PositionController y_controller_;
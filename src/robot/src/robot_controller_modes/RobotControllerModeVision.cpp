@@ -1,9 +1,12 @@
 #include "RobotControllerModeVision.h"
 #include "constants.h"
+#include "ConfigSnapshot.h"
+#include "FlightRecorder.h"
 #include <plog/Log.h>
 #include "camera_tracker/CameraTrackerFactory.h"
 
-RobotControllerModeVision::RobotControllerModeVision(bool fake_perfect_motion, StatusUpdater& status_updater)
+RobotControllerModeVision::RobotControllerModeVision(bool fake_perfect_motion, StatusUpdater& status_updater, const DistanceSensor& distance_sensor,
+                                                     Localization& localization)
 : RobotControllerModeBase(fake_perfect_motion),
   status_updater_(status_updater),
   traj_gen_(),
@@ -11,39 +14,34 @@ RobotControllerModeVision::RobotControllerModeVision(bool fake_perfect_motion, S
   current_point_(0,0,0),
   current_target_(),
   camera_tracker_(CameraTrackerFactory::getFactoryInstance()->get_camera_tracker()),
-  traj_done_timer_(),
-  kf_(3,3)
+  last_vision_update_time_(),
+  vision_timeout_timer_(),
+  vision_timeout_ms_(cfg.lookup("flight_recorder.vision_timeout_ms")),
+  vision_timeout_reported_(false),
+  distance_sensor_(distance_sensor),
+  localization_(localization)
 {
-    tolerances_.trans_pos_err = cfg.lookup("motion.translation.position_threshold.vision");
-    tolerances_.ang_pos_err = cfg.lookup("motion.rotation.position_threshold.vision");
-    tolerances_.trans_vel_err = cfg.lookup("motion.translation.velocity_threshold.vision");
-    tolerances_.ang_vel_err = cfg.lookup("motion.rotation.velocity_threshold.vision");
-
-    PositionController::Gains position_gains;
-    position_gains.kp = cfg.lookup("motion.translation.gains_vision.kp");
-    position_gains.ki = cfg.lookup("motion.translation.gains_vision.ki");
-    position_gains.kd = cfg.lookup("motion.translation.gains_vision.kd");
-    x_controller_ = PositionController(position_gains);
-    y_controller_ = PositionController(position_gains);
-
-    PositionController::Gains angle_gains;
-    angle_gains.kp = cfg.lookup("motion.rotation.gains_vision.kp");
-    angle_gains.ki = cfg.lookup("motion.rotation.gains_vision.ki");
-    angle_gains.kd = cfg.lookup("motion.rotation.gains_vision.kd");
-    a_controller_ = PositionController(angle_gains);
-
-    Eigen::MatrixXf A = Eigen::MatrixXf::Identity(3,3);
-    Eigen::MatrixXf B = Eigen::MatrixXf::Identity(3,3);
-    Eigen::MatrixXf C = Eigen::MatrixXf::Identity(3,3);
-    Eigen::MatrixXf Q(3,3);
-    Q << cfg.lookup("vision_tracker.kf.predict_trans_cov"),0,0, 
-         0,cfg.lookup("vision_tracker.kf.predict_trans_cov"),0,
-         0,0,cfg.lookup("vision_tracker.kf.predict_angle_cov");
-    Eigen::MatrixXf R(3,3);
-    R << cfg.lookup("vision_tracker.kf.meas_trans_cov"),0,0, 
-         0,cfg.lookup("vision_tracker.kf.meas_trans_cov"),0,
-         0,0,cfg.lookup("vision_tracker.kf.meas_angle_cov");
-    kf_ = KalmanFilter(A,B,C,Q,R);
+    reset();
+}
+
+void RobotControllerModeVision::reset()
+{
+    RobotControllerModeBase::reset();
+    traj_gen_.refreshConfig();
+    last_vision_update_time_ = ClockTimePoint();
+    vision_timeout_timer_.reset();
+    vision_timeout_reported_ = false;
+    localization_.resetCameraFrame();
+
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    tolerances_.trans_pos_err = config->translation.position_threshold_vision;
+    tolerances_.ang_pos_err = config->rotation.position_threshold_vision;
+    tolerances_.trans_vel_err = config->translation.velocity_threshold_vision;
+    tolerances_.ang_vel_err = config->rotation.velocity_threshold_vision;
+
+    x_controller_ = PositionController(config->translation.gains_vision);
+    y_controller_ = PositionController(config->translation.gains_vision);
+    a_controller_ = PositionController(config->rotation.gains_vision);
 }
 
 bool RobotControllerModeVision::startMove(Point target_point)
@@ -57,44 +55,72 @@ bool RobotControllerModeVision::startMove(Point target_point)
     current_point_ = tracker_output.pose;
     goal_point_ = target_point;
     bool ok = traj_gen_.generatePointToPointTrajectory(current_point_, target_point, LIMITS_MODE::VISION);
-    if(ok) RobotControllerModeBase::startMove();
+    if(ok) RobotControllerModeBase::startMove(ConfigSnapshot::current()->settle.params(LIMITS_MODE::VISION));
+    if(ok) configureApproach(LIMITS_MODE::VISION);
+    vision_timeout_timer_.reset();
+    vision_timeout_reported_ = false;
     return ok;
 }
 
-Velocity RobotControllerModeVision::computeTargetVelocity(Point current_position, Velocity current_velocity, bool log_this_cycle)
+bool RobotControllerModeVision::updateGoal(Point goal)
+{
+    if(!move_running_ || !traj_gen_.retarget(move_start_timer_.dt_s(), goal, LIMITS_MODE::VISION)) return false;
+    goal_point_ = goal;
+    settle_.start(ConfigSnapshot::current()->settle.params(LIMITS_MODE::VISION));
+    return true;
+}
+
+bool RobotControllerModeVision::measurementPending()
+{
+    CameraTrackerOutput tracker_output = camera_tracker_->getPoseFromCamera();
+    return tracker_output.ok && tracker_output.timestamp > last_vision_update_time_;
+}
+
+Velocity RobotControllerModeVision::computeTargetVelocity(Point current_position, Velocity current_velocity, const Rotation2D& current_rotation, bool log_this_cycle)
 {   
+    (void) current_position;
+
     // Get current target global position and global velocity according to the trajectory
     float dt_from_traj_start = move_start_timer_.dt_s();
-    current_target_ = traj_gen_.lookup(dt_from_traj_start);
+    const bool approach = approachActive(traj_gen_.getDuration() - dt_from_traj_start);
+    if(approach) current_target_ = {goal_point_, {0, 0, 0}, dt_from_traj_start, {0, 0, 0}};
+    else current_target_ = traj_gen_.lookup(dt_from_traj_start);
 
     // Get previous loop time
     float dt_since_last_loop = loop_timer_.dt_s();
     loop_timer_.reset();
 
-    // Convert global velocity into local robot frame and use it to predict the filter
-    Eigen::Vector3f local_vel;
-    local_vel[0] = cos(current_position.a) * current_velocity.vx + sin(current_position.a) * current_velocity.vy;
-    local_vel[1] = - sin(current_position.a) * current_velocity.vx + cos(current_position.a) * current_velocity.vy;
-    local_vel[2] = current_velocity.va;
-    Eigen::Vector3f udt = local_vel * dt_since_last_loop;
-    if(udt.norm() > 0)
-    {
-        kf_.predict(udt);
-    }
+    // The estimate already has the odometry up to this cycle, the velocity is only used as feedback
+    const Velocity local_velocity = current_rotation.toLocal(current_velocity);
+    Eigen::Vector3f local_vel = {local_velocity.vx, local_velocity.vy, local_velocity.va};
 
     // Get latest pose from cameras and do update step if data is available
     CameraTrackerOutput tracker_output = camera_tracker_->getPoseFromCamera();
     if(tracker_output.ok && tracker_output.timestamp > last_vision_update_time_)
     {
-        // Get the current distance measurements from the sensors and update the filter
-        Eigen::Vector3f point_vec = {tracker_output.pose.x,tracker_output.pose.y,tracker_output.pose.a};
-        kf_.update(point_vec);
+        bool in_history = localization_.updateCameraReading(tracker_output.pose, tracker_output.timestamp);
+        if(!in_history) PLOGW << "Vision measurement older than filter history, applying at current time";
+        PLOGD_IF_(MOTION_LOG_ID, log_this_cycle) << "Vision measurement replayed " << localization_.getCameraReplayCount() << " predictions";
+        const float age = clockToSeconds(ClockFactory::getFactoryInstance()->get_clock()->now()) - clockToSeconds(tracker_output.timestamp);
+        FlightRecorder::record(FLIGHT_RECORD::CAMERA, in_history ? 1 : 0, 0, 0, {tracker_output.pose.x, tracker_output.pose.y, tracker_output.pose.a, age});
         last_vision_update_time_ = tracker_output.timestamp;
+        vision_timeout_timer_.reset();
+    }
+    else if(vision_timeout_ms_ > 0 && !vision_timeout_reported_ && vision_timeout_timer_.dt_ms() > vision_timeout_ms_)
+    {
+        // The move carries on from odometry, but whatever starved it of camera poses is worth a look
+        PLOGW.printf("No camera pose for %i ms during vision move", vision_timeout_timer_.dt_ms());
+        FlightRecorder::freeze(FLIGHT_FREEZE::VISION_TIMEOUT);
+        vision_timeout_reported_ = true;
+    }
+    const DistanceReading range_reading = distance_sensor_.getReading();
+    if(localization_.updateRangeReading(range_reading))
+    {
+        PLOGD_IF_(MOTION_LOG_ID, log_this_cycle) << "Range measurement " << range_reading.range << " fused";
     }
     
     // Update current point from state
-    Eigen::VectorXf state = kf_.state();
-    current_point_ = {state[0], state[1], state[2]};
+    current_point_ = localization_.getCameraPose();
     status_updater_.updateVisionControllerPose(current_point_);
 
     // Print motion estimates to log
@@ -108,25 +134,30 @@ Velocity RobotControllerModeVision::computeTargetVelocity(Point current_position
     {
         output_local = current_target_.velocity;
     }
+    else if(approach)
+    {
+        // The camera frame pose is controlled as if it were the robot frame, like the PIDs below do
+        const Velocity error = {goal_point_.x - current_point_.x, goal_point_.y - current_point_.y, angle_diff(goal_point_.a, current_point_.a)};
+        output_local = approach_.solve(error, local_velocity, dt_since_last_loop);
+    }
     else
     {
-        output_local.vx =  x_controller_.compute(current_target_.position.x, current_point_.x, current_target_.velocity.vx, local_vel[0], dt_since_last_loop);
-        output_local.vy =  y_controller_.compute(current_target_.position.y, current_point_.y, current_target_.velocity.vy, local_vel[1], dt_since_last_loop);
-        output_local.va =  a_controller_.compute(current_target_.position.a, current_point_.a, current_target_.velocity.va, local_vel[2], dt_since_last_loop);
+        output_local.vx =  x_controller_.compute(current_target_.position.x, current_point_.x, current_target_.velocity.vx, local_vel[0], dt_since_last_loop, current_target_.acceleration.vx);
+        output_local.vy =  y_controller_.compute(current_target_.position.y, current_point_.y, current_target_.velocity.vy, local_vel[1], dt_since_last_loop, current_target_.acceleration.vy);
+        output_local.va =  a_controller_.compute(current_target_.position.a, current_point_.a, current_target_.velocity.va, local_vel[2], dt_since_last_loop, current_target_.acceleration.va);
     }
 
     // Rotate this commanded velocity back into global frame because currently it is in the local robot frame
-    Velocity output_global;
-    output_global.vx = cos(current_position.a) * output_local.vx - sin(current_position.a) * output_local.vy;
-    output_global.vy = sin(current_position.a) * output_local.vx + cos(current_position.a) * output_local.vy;
-    output_global.va = output_local.va;
-
-    PLOGI_(MOTION_CSV_LOG_ID).printf("time,%.4f",dt_from_traj_start);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("pos,%.4f,%.4f,%.4f",current_point_.x,current_point_.y,current_point_.a);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("target_pos,%.4f,%.4f,%.4f",current_target_.position.x,current_target_.position.y,current_target_.position.a);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("vel,%.4f,%.4f,%.4f",local_vel[0],local_vel[1],local_vel[2]);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("target_vel,%.4f,%.4f,%.4f",current_target_.velocity.vx,current_target_.velocity.vy,current_target_.velocity.va);
-    PLOGI_(MOTION_CSV_LOG_ID).printf("control_vel,%.4f,%.4f,%.4f",output_local.vx,output_local.vy,output_local.va);
+    Velocity output_global = current_rotation.toGlobal(output_local);
+
+    TelemetryRecord record = cycleRecord(dt_from_traj_start, current_point_, current_target_,
+                                         {local_vel[0], local_vel[1], local_vel[2]}, output_local);
+    const Eigen::Vector3f kf_cov = localization_.getCameraCovarianceDiagonal();
+    for (int i = 0; i < 3; i++) record.kf_cov[i] = kf_cov[i];
+    CameraDebug camera_debug = camera_tracker_->getCameraDebug();
+    if(camera_debug.side_ok) { record.cam_uv[0] = camera_debug.side_u; record.cam_uv[1] = camera_debug.side_v; }
+    if(camera_debug.rear_ok) { record.cam_uv[2] = camera_debug.rear_u; record.cam_uv[3] = camera_debug.rear_v; }
+    logCycle(record);
 
     return output_global;
 }
@@ -138,23 +169,19 @@ bool RobotControllerModeVision::checkForMoveComplete(Point current_position, Vel
     // Verify our target velocity is zero (i.e. we reached the end of the trajectory)
     bool zero_cmd_vel = current_target_.velocity.nearZero();
 
-    // Verify actual translational and rotational positions are within tolerance
+    // Trajectory is done when we aren't commanding any velocity and both our actual velocity and the filtered
+    // camera position have settled within the correct tolerance. The filter covariance says how far the
+    // camera position can be trusted, a confident estimate settles without waiting out the full dwell.
     Eigen::Vector2f dp = {goal_point_.x - current_point_.x, goal_point_.y - current_point_.y};
-    bool pos_in_tolerance = dp.norm() < tolerances_.trans_pos_err &&
-                            fabs(angle_diff(goal_point_.a, current_point_.a)) < tolerances_.ang_pos_err; 
-
-    // Verify actual translational and rotational velocities are within tolerance
     Eigen::Vector2f dv = {current_velocity.vx, current_velocity.vy};
-    bool vel_in_tolerance = dv.norm() < tolerances_.trans_vel_err && fabs(current_velocity.va) < tolerances_.ang_vel_err;
-
-    // Trajectory is done when we aren't commanding any velocity, our both our actual velocity and
-    // position are within the correct tolerance.
-    bool maybe_traj_complete = zero_cmd_vel && vel_in_tolerance && pos_in_tolerance;
+    const Eigen::Vector3f kf_cov = localization_.getCameraCovarianceDiagonal();
+    SettleDetector::Sample sample = {zero_cmd_vel, dp.norm(), fabs(angle_diff(goal_point_.a, current_point_.a)),
+                                     dv.norm(), fabs(current_velocity.va), sqrtf(kf_cov(0) + kf_cov(1)), sqrtf(kf_cov(2))};
+    bool traj_complete = settle_.update(sample, tolerances_, move_start_timer_.dt_s());
 
-    if (!maybe_traj_complete) traj_done_timer_.reset();
-    else PLOGI_(MOTION_LOG_ID) << "Camera move maybe done";
+    if(settle_.inTolerance()) PLOGI_(MOTION_LOG_ID) << "Camera move maybe done";
 
-    if(maybe_traj_complete && traj_done_timer_.dt_s() > 0.8) 
+    if(traj_complete) 
     {
         move_running_ = false;
         PLOGI_(MOTION_LOG_ID) << "Camera move done";
@@ -5,7 +5,9 @@
 #include "SmoothTrajectoryGenerator.h"
 #include "utils.h"
 #include "camera_tracker/CameraTracker.h"
-#include "KalmanFilter.h"
+#include "DistanceSensor.h"
+#include "Localization.h"
+#include "ConfigSnapshot.h"
 #include "StatusUpdater.h"
 
 class RobotControllerModeVision : public RobotControllerModeBase
@@ -13,14 +15,26 @@ class RobotControllerModeVision : public RobotControllerModeBase
 
   public:
 
-    RobotControllerModeVision(bool fake_perfect_motion, StatusUpdater& status_updater);
+    // distance_sensor is updated by the controller, its readings are fused in close to the goal. Camera poses and
+    // ranges go into the camera frame of localization, which the controller predicts from odometry.
+    RobotControllerModeVision(bool fake_perfect_motion, StatusUpdater& status_updater, const DistanceSensor& distance_sensor,
+                              Localization& localization);
+
+    // Also starts the camera frame over, the first camera pose of the next move initializes it
+    virtual void reset() override;
 
     bool startMove(Point target_point);
 
-    virtual Velocity computeTargetVelocity(Point current_position, Velocity current_velocity, bool log_this_cycle) override;
+    // The goal is in the same camera frame as startMove's, the new trajectory is spliced onto the running one
+    virtual bool updateGoal(Point goal) override;
+
+    virtual Velocity computeTargetVelocity(Point current_position, Velocity current_velocity, const Rotation2D& current_rotation, bool log_this_cycle) override;
 
     virtual bool checkForMoveComplete(Point current_position, Velocity current_velocity) override;
 
+    // True if the camera tracker has a pose newer than the last one the filter was updated with
+    bool measurementPending();
+
   protected:
 
     StatusUpdater& status_updater_;
@@ -29,15 +43,18 @@ class RobotControllerModeVision : public RobotControllerModeBase
     Point current_point_;
     PVTPoint current_target_;
     CameraTrackerBase* camera_tracker_;
-    Timer traj_done_timer_;
     ClockTimePoint last_vision_update_time_;
+    Timer vision_timeout_timer_;        // Since the move started or the last camera pose
+    int vision_timeout_ms_;             // Freezes the flight recorder when exceeded, 0 to turn off
+    bool vision_timeout_reported_;
 
     TrajectoryTolerances tolerances_;
 
     PositionController x_controller_;
     PositionController y_controller_;
     PositionController a_controller_;    
-    KalmanFilter kf_;
+    const DistanceSensor& distance_sensor_;
+    Localization& localization_;
 
 };
 
@@ -7,11 +7,16 @@
 MockSerialComms::MockSerialComms(std::string portName)
 : SerialCommsBase(),
   send_base_data_(),
+  send_base_times_(),
   send_lift_data_(),
   send_distance_data_(),
   rcv_base_data_(),
   rcv_lift_data_(),
   rcv_distance_data_(),
+  send_base_velocity_data_(),
+  rcv_base_odometry_data_(),
+  rcv_driver_stats_data_(),
+  send_frame_data_(),
   port_(portName)
 {
     connected_ = true;
@@ -26,6 +31,7 @@ void MockSerialComms::send(std::string msg)
     if (msg.rfind("base:", 0) == 0)
     {
         send_base_data_.push(msg.substr(5, std::string::npos));
+        send_base_times_.push(std::chrono::steady_clock::now());
     }
     else if (msg.rfind("lift:", 0) == 0)
     {
@@ -91,14 +97,98 @@ void MockSerialComms::mock_send(std::string msg)
     }
 }
 
+namespace
+{
+    SerialVelocity quantize(SerialVelocity vel)
+    {
+        uint8_t payload[SERIAL_VELOCITY_PAYLOAD_SIZE];
+        encodeVelocityPayload(vel, payload);
+        return decodeVelocityPayload(payload);
+    }
+
+    SerialOdometry quantize(SerialOdometry odom)
+    {
+        uint8_t payload[SERIAL_ODOMETRY_PAYLOAD_SIZE];
+        encodeOdometryPayload(odom, payload);
+        return decodeOdometryPayload(payload);
+    }
+
+    template <typename T>
+    bool popVelocity(std::queue<T>& queue, T* vel)
+    {
+        if(queue.empty())
+        {
+            return false;
+        }
+        *vel = queue.front();
+        queue.pop();
+        return true;
+    }
+}
+
+void MockSerialComms::send_base_velocity(SerialVelocity vel)
+{
+    send_base_velocity_data_.push(quantize(vel));
+}
+
+void MockSerialComms::send_frame(SERIAL_BINARY_CHANNEL channel, const uint8_t* payload, uint8_t len)
+{
+    send_frame_data_.push({channel, std::string(reinterpret_cast<const char*>(payload), len)});
+}
+
+bool MockSerialComms::mock_rcv_frame(SERIAL_BINARY_CHANNEL* channel, std::string* payload)
+{
+    if(send_frame_data_.empty())
+    {
+        return false;
+    }
+    *channel = send_frame_data_.front().first;
+    *payload = send_frame_data_.front().second;
+    send_frame_data_.pop();
+    return true;
+}
+
+bool MockSerialComms::rcv_base_odometry(SerialOdometry* odom)
+{
+    return popVelocity(rcv_base_odometry_data_, odom);
+}
+
+void MockSerialComms::mock_send_base_odometry(SerialOdometry odom)
+{
+    rcv_base_odometry_data_.push(quantize(odom));
+}
+
+bool MockSerialComms::rcv_driver_stats(SerialDriverStats* stats)
+{
+    return popVelocity(rcv_driver_stats_data_, stats);
+}
+
+void MockSerialComms::mock_send_driver_stats(SerialDriverStats stats)
+{
+    rcv_driver_stats_data_.push(stats);
+}
+
+bool MockSerialComms::mock_rcv_base_velocity(SerialVelocity* vel)
+{
+    return popVelocity(send_base_velocity_data_, vel);
+}
+
 std::string MockSerialComms::mock_rcv_base()
+{
+    std::chrono::steady_clock::time_point sent_time;
+    return mock_rcv_base(&sent_time);
+}
+
+std::string MockSerialComms::mock_rcv_base(std::chrono::steady_clock::time_point* sent_time)
 {
     if(send_base_data_.empty())
     {
         return "";
     }
     std::string outdata = send_base_data_.front();
+    *sent_time = send_base_times_.front();
     send_base_data_.pop();
+    send_base_times_.pop();
     return outdata;
 }
 
@@ -134,6 +224,7 @@ void MockSerialComms::purge_data()
     {
         send_base_data_.pop();
     }
+    send_base_times_ = std::queue<std::chrono::steady_clock::time_point>();
     while(!send_distance_data_.empty())
     {
         send_distance_data_.pop();
@@ -150,4 +241,8 @@ void MockSerialComms::purge_data()
     {
         rcv_distance_data_.pop();
     }
+    send_base_velocity_data_ = std::queue<SerialVelocity>();
+    rcv_base_odometry_data_ = std::queue<SerialOdometry>();
+    rcv_driver_stats_data_ = std::queue<SerialDriverStats>();
+    send_frame_data_ = std::queue<std::pair<SERIAL_BINARY_CHANNEL, std::string>>();
 }
\ No newline at end of file
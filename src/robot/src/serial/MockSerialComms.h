@@ -1,8 +1,10 @@
 #ifndef MockSerialComms_h
 #define MockSerialComms_h
 
+#include <chrono>
 #include <string>
 #include <queue>
+#include <utility>
 
 #include "SerialCommsBase.h"
 
@@ -23,24 +25,50 @@ class MockSerialComms : public SerialCommsBase
 
     std::string rcv_distance() override;
 
+    void send_base_velocity(SerialVelocity vel) override;
+
+    void send_frame(SERIAL_BINARY_CHANNEL channel, const uint8_t* payload, uint8_t len) override;
+
+    bool rcv_base_odometry(SerialOdometry* odom) override;
+
+    bool rcv_driver_stats(SerialDriverStats* stats) override;
+
     void mock_send(std::string msg);
     
     std::string mock_rcv_lift();
     
     std::string mock_rcv_base();
 
+    // Also gives the wall clock time the message was sent at, for latency benchmarks that run on the mock clock
+    std::string mock_rcv_base(std::chrono::steady_clock::time_point* sent_time);
+
     std::string mock_rcv_distance();
 
+    // Binary frames go through the same fixed point encoding as the real link
+    void mock_send_base_odometry(SerialOdometry odom);
+
+    bool mock_rcv_base_velocity(SerialVelocity* vel);
+
+    void mock_send_driver_stats(SerialDriverStats stats);
+
+    // Oldest frame passed to send_frame, returns false if there is none
+    bool mock_rcv_frame(SERIAL_BINARY_CHANNEL* channel, std::string* payload);
+
     void purge_data();
 
   protected:
 
     std::queue<std::string> send_base_data_;
+    std::queue<std::chrono::steady_clock::time_point> send_base_times_;
     std::queue<std::string> send_lift_data_;
     std::queue<std::string> send_distance_data_;
     std::queue<std::string> rcv_base_data_;
     std::queue<std::string> rcv_lift_data_;
     std::queue<std::string> rcv_distance_data_;
+    std::queue<SerialVelocity> send_base_velocity_data_;
+    std::queue<SerialOdometry> rcv_base_odometry_data_;
+    std::queue<SerialDriverStats> rcv_driver_stats_data_;
+    std::queue<std::pair<SERIAL_BINARY_CHANNEL, std::string>> send_frame_data_;
     std::string port_;
     
 
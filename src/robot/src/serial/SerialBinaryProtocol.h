@@ -0,0 +1,344 @@
+#ifndef SerialBinaryProtocol_h
+#define SerialBinaryProtocol_h
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+
+// Compact binary frames that share the port with the <...> text messages. Must match robot_motor_driver/SerialComms.h
+//   SERIAL_BINARY_START, channel, payload length, payload, CRC-16/CCITT of channel + length + payload (little endian)
+// Text messages are plain ascii so the start byte can't show up inside one.
+#define SERIAL_BINARY_START '\xA5'
+#define SERIAL_BINARY_MAX_PAYLOAD 160
+#define SERIAL_BINARY_OVERHEAD 5
+
+// Velocities are sent as int16 in units of 0.1 mm/s and 0.1 mrad/s, same resolution as the old %.4f text
+#define SERIAL_VELOCITY_SCALE 10000.0f
+#define SERIAL_VELOCITY_PAYLOAD_SIZE 6
+// Measured velocity followed by the driver's uint32 micros() timestamp and a uint16 report counter
+#define SERIAL_ODOMETRY_PAYLOAD_SIZE 12
+// Trajectory id, axis, direction, limits and the 8 switch points (t, p, v, a) of one s-curve, all float32
+#define SERIAL_TRAJECTORY_AXIS_PAYLOAD_SIZE 151
+// Trajectory id and the initial heading
+#define SERIAL_TRAJECTORY_START_PAYLOAD_SIZE 6
+// Trajectory id, global velocity correction and heading error
+#define SERIAL_TRAJECTORY_CORRECTION_PAYLOAD_SIZE 12
+// Max and mean loop period as uint32 us, then uint16 loop count and uint16 dropped text messages
+#define SERIAL_DRIVER_STATS_PAYLOAD_SIZE 12
+// Odometry report period as uint32 us, then command timeout as uint16 ms
+#define SERIAL_STREAM_CONFIG_PAYLOAD_SIZE 6
+
+enum class SERIAL_BINARY_CHANNEL : uint8_t
+{
+    BASE_VELOCITY = 1,    // Commanded velocity to the driver. Local frame vx, vy, va
+    BASE_ODOMETRY = 2,    // Measured velocity back from the driver, stamped with the driver clock
+    // Trajectories followed on the driver. Both axes are uploaded, then started. Until the next BASE_VELOCITY
+    // the driver evaluates them itself, adding the latest correction, and streams BASE_ODOMETRY.
+    TRAJECTORY_AXIS = 3,
+    TRAJECTORY_START = 4,
+    TRAJECTORY_CORRECTION = 5,
+    DRIVER_STATS = 6,     // Loop time of the driver firmware, sent about once a second
+    // Makes the driver send BASE_ODOMETRY at a fixed rate instead of answering each BASE_VELOCITY, and sets
+    // how long it waits for a command before ramping the wheels to a stop
+    STREAM_CONFIG = 7,
+};
+
+enum class SERIAL_TRAJECTORY_AXIS : uint8_t
+{
+    TRANSLATION = 0,
+    ROTATION = 1,
+    LIFTER = 2,         // Positions in lifter steps, started with a lift:scurve:<target> text message
+};
+
+struct SerialVelocity
+{
+  float vx;
+  float vy;
+  float va;
+};
+
+struct SerialOdometry
+{
+  SerialVelocity vel;
+  uint32_t timestamp_us;    // Driver micros() when the motor speeds were read, wraps every ~71 minutes
+  uint16_t seq;             // Incremented for every report, gaps mean reports were lost
+};
+
+// One s-curve as the driver evaluates it, see SCurveParameters
+struct SerialTrajectoryAxis
+{
+  uint16_t traj_id;
+  SERIAL_TRAJECTORY_AXIS axis;
+  float direction[2];         // Unit xy direction for translation, [+-1, 0] for rotation and the lifter
+  float v_lim;
+  float a_lim;
+  float j_lim;
+  float switch_points[8][4];  // t, p, v, a
+};
+
+struct SerialDriverStats
+{
+  uint32_t loop_max_us;       // Longest time between two firmware loops in the report period
+  uint32_t loop_mean_us;
+  uint16_t loop_count;        // Loops in the report period, saturates
+  uint16_t rx_dropped;        // Text messages the driver dropped for being too long, since it started
+};
+
+struct SerialStreamConfig
+{
+  uint32_t period_us;           // Between odometry reports, 0 turns streaming off
+  uint16_t command_timeout_ms;  // 0 keeps the driver default
+};
+
+struct SerialTrajectoryCorrection
+{
+  uint16_t traj_id;
+  SerialVelocity vel;         // Global frame feedback velocity added to the trajectory velocity
+  float heading_error;        // Estimated heading minus trajectory heading, used to rotate into the local frame
+};
+
+inline uint16_t serialCrc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+inline int16_t velocityToFixed(float v)
+{
+    float scaled = std::round(v * SERIAL_VELOCITY_SCALE);
+    if (scaled > INT16_MAX) scaled = INT16_MAX;
+    if (scaled < INT16_MIN) scaled = INT16_MIN;
+    return static_cast<int16_t>(scaled);
+}
+
+inline float fixedToVelocity(int16_t v)
+{
+    return static_cast<float>(v) / SERIAL_VELOCITY_SCALE;
+}
+
+// Writes a complete frame to out, which must hold SERIAL_BINARY_OVERHEAD + len bytes. Returns the frame size.
+inline size_t encodeSerialFrame(SERIAL_BINARY_CHANNEL channel, const uint8_t* payload, uint8_t len, uint8_t* out)
+{
+    out[0] = static_cast<uint8_t>(SERIAL_BINARY_START);
+    out[1] = static_cast<uint8_t>(channel);
+    out[2] = len;
+    for (uint8_t i = 0; i < len; i++)
+    {
+        out[3 + i] = payload[i];
+    }
+    uint16_t crc = serialCrc16(out + 1, 2 + len);
+    out[3 + len] = static_cast<uint8_t>(crc & 0xFF);
+    out[4 + len] = static_cast<uint8_t>(crc >> 8);
+    return SERIAL_BINARY_OVERHEAD + len;
+}
+
+inline void encodeVelocityPayload(const SerialVelocity& vel, uint8_t* out)
+{
+    const int16_t vals[3] = {velocityToFixed(vel.vx), velocityToFixed(vel.vy), velocityToFixed(vel.va)};
+    for (int i = 0; i < 3; i++)
+    {
+        const uint16_t u = static_cast<uint16_t>(vals[i]);
+        out[2*i] = static_cast<uint8_t>(u & 0xFF);
+        out[2*i + 1] = static_cast<uint8_t>(u >> 8);
+    }
+}
+
+inline SerialVelocity decodeVelocityPayload(const uint8_t* in)
+{
+    float vals[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const uint16_t u = static_cast<uint16_t>(in[2*i] | (in[2*i + 1] << 8));
+        vals[i] = fixedToVelocity(static_cast<int16_t>(u));
+    }
+    return {vals[0], vals[1], vals[2]};
+}
+
+// Whether two velocities go over the link as the same command
+inline bool sameFixedVelocity(const SerialVelocity& a, const SerialVelocity& b)
+{
+    return velocityToFixed(a.vx) == velocityToFixed(b.vx) &&
+           velocityToFixed(a.vy) == velocityToFixed(b.vy) &&
+           velocityToFixed(a.va) == velocityToFixed(b.va);
+}
+
+inline void encodeOdometryPayload(const SerialOdometry& odom, uint8_t* out)
+{
+    encodeVelocityPayload(odom.vel, out);
+    for (int i = 0; i < 4; i++)
+    {
+        out[SERIAL_VELOCITY_PAYLOAD_SIZE + i] = static_cast<uint8_t>(odom.timestamp_us >> (8*i));
+    }
+    out[SERIAL_VELOCITY_PAYLOAD_SIZE + 4] = static_cast<uint8_t>(odom.seq & 0xFF);
+    out[SERIAL_VELOCITY_PAYLOAD_SIZE + 5] = static_cast<uint8_t>(odom.seq >> 8);
+}
+
+inline SerialOdometry decodeOdometryPayload(const uint8_t* in)
+{
+    SerialOdometry odom;
+    odom.vel = decodeVelocityPayload(in);
+    odom.timestamp_us = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        odom.timestamp_us |= static_cast<uint32_t>(in[SERIAL_VELOCITY_PAYLOAD_SIZE + i]) << (8*i);
+    }
+    odom.seq = static_cast<uint16_t>(in[SERIAL_VELOCITY_PAYLOAD_SIZE + 4] | (in[SERIAL_VELOCITY_PAYLOAD_SIZE + 5] << 8));
+    return odom;
+}
+
+inline uint8_t* putUint16(uint16_t v, uint8_t* out)
+{
+    out[0] = static_cast<uint8_t>(v & 0xFF);
+    out[1] = static_cast<uint8_t>(v >> 8);
+    return out + 2;
+}
+
+inline const uint8_t* getUint16(const uint8_t* in, uint16_t* v)
+{
+    *v = static_cast<uint16_t>(in[0] | (in[1] << 8));
+    return in + 2;
+}
+
+inline uint8_t* putUint32(uint32_t v, uint8_t* out)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = static_cast<uint8_t>(v >> (8*i));
+    }
+    return out + 4;
+}
+
+inline const uint8_t* getUint32(const uint8_t* in, uint32_t* v)
+{
+    *v = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        *v |= static_cast<uint32_t>(in[i]) << (8*i);
+    }
+    return in + 4;
+}
+
+inline void encodeDriverStatsPayload(const SerialDriverStats& stats, uint8_t* out)
+{
+    out = putUint32(stats.loop_max_us, out);
+    out = putUint32(stats.loop_mean_us, out);
+    out = putUint16(stats.loop_count, out);
+    putUint16(stats.rx_dropped, out);
+}
+
+inline void encodeStreamConfigPayload(const SerialStreamConfig& config, uint8_t* out)
+{
+    out = putUint32(config.period_us, out);
+    putUint16(config.command_timeout_ms, out);
+}
+
+inline SerialStreamConfig decodeStreamConfigPayload(const uint8_t* in)
+{
+    SerialStreamConfig config;
+    in = getUint32(in, &config.period_us);
+    getUint16(in, &config.command_timeout_ms);
+    return config;
+}
+
+inline SerialDriverStats decodeDriverStatsPayload(const uint8_t* in)
+{
+    SerialDriverStats stats;
+    in = getUint32(in, &stats.loop_max_us);
+    in = getUint32(in, &stats.loop_mean_us);
+    in = getUint16(in, &stats.loop_count);
+    getUint16(in, &stats.rx_dropped);
+    return stats;
+}
+
+// Floats go over as little endian IEEE 754 single precision
+inline uint8_t* putFloat(float v, uint8_t* out)
+{
+    uint32_t u;
+    std::memcpy(&u, &v, sizeof(u));
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = static_cast<uint8_t>(u >> (8*i));
+    }
+    return out + 4;
+}
+
+inline const uint8_t* getFloat(const uint8_t* in, float* v)
+{
+    uint32_t u = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        u |= static_cast<uint32_t>(in[i]) << (8*i);
+    }
+    std::memcpy(v, &u, sizeof(u));
+    return in + 4;
+}
+
+inline void encodeTrajectoryAxisPayload(const SerialTrajectoryAxis& traj, uint8_t* out)
+{
+    out = putUint16(traj.traj_id, out);
+    *out++ = static_cast<uint8_t>(traj.axis);
+    out = putFloat(traj.direction[0], out);
+    out = putFloat(traj.direction[1], out);
+    out = putFloat(traj.v_lim, out);
+    out = putFloat(traj.a_lim, out);
+    out = putFloat(traj.j_lim, out);
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            out = putFloat(traj.switch_points[i][j], out);
+        }
+    }
+}
+
+inline SerialTrajectoryAxis decodeTrajectoryAxisPayload(const uint8_t* in)
+{
+    SerialTrajectoryAxis traj;
+    in = getUint16(in, &traj.traj_id);
+    traj.axis = static_cast<SERIAL_TRAJECTORY_AXIS>(*in++);
+    in = getFloat(in, &traj.direction[0]);
+    in = getFloat(in, &traj.direction[1]);
+    in = getFloat(in, &traj.v_lim);
+    in = getFloat(in, &traj.a_lim);
+    in = getFloat(in, &traj.j_lim);
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            in = getFloat(in, &traj.switch_points[i][j]);
+        }
+    }
+    return traj;
+}
+
+inline void encodeTrajectoryStartPayload(uint16_t traj_id, float initial_heading, uint8_t* out)
+{
+    out = putUint16(traj_id, out);
+    putFloat(initial_heading, out);
+}
+
+inline void encodeTrajectoryCorrectionPayload(const SerialTrajectoryCorrection& correction, uint8_t* out)
+{
+    out = putUint16(correction.traj_id, out);
+    encodeVelocityPayload(correction.vel, out);
+    putFloat(correction.heading_error, out + SERIAL_VELOCITY_PAYLOAD_SIZE);
+}
+
+inline SerialTrajectoryCorrection decodeTrajectoryCorrectionPayload(const uint8_t* in)
+{
+    SerialTrajectoryCorrection correction;
+    in = getUint16(in, &correction.traj_id);
+    correction.vel = decodeVelocityPayload(in);
+    getFloat(in + SERIAL_VELOCITY_PAYLOAD_SIZE, &correction.heading_error);
+    return correction;
+}
+
+#endif //SerialBinaryProtocol_h
@@ -1,136 +1,157 @@
 #include "SerialComms.h"
 
 #include <plog/Log.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+
+#include "constants.h"
+#include "InputRecorder.h"
+#include "Trace.h"
+
+namespace
+{
+    LibSerial::BaudRate toLibSerialBaud(int baud)
+    {
+        switch (baud)
+        {
+            case 115200:  return LibSerial::BaudRate::BAUD_115200;
+            case 230400:  return LibSerial::BaudRate::BAUD_230400;
+            case 460800:  return LibSerial::BaudRate::BAUD_460800;
+            case 921600:  return LibSerial::BaudRate::BAUD_921600;
+            case 1000000: return LibSerial::BaudRate::BAUD_1000000;
+            case 2000000: return LibSerial::BaudRate::BAUD_2000000;
+            default:
+                PLOGW.printf("Unsupported baud rate %d, using 115200", baud);
+                return LibSerial::BaudRate::BAUD_115200;
+        }
+    }
+}
 
 SerialComms::SerialComms(std::string portName)
 : SerialCommsBase(),
   serial_(portName),
-  recvInProgress_(false),
-  recvIdx_(0),
-  buffer_(""),
-  base_data_(),
-  lift_data_(),
-  distance_data_()
+  demux_(),
+  thread_running_(false),
+  reader_thread_(),
+  tx_scheduler_(),
+  writer_thread_(),
+  tx_stats_period_(cfg.lookup("serial.tx_stats_period"))
 {
     // If we get here, that means serial_ was constructed correctly which means 
     // we have a valid connection
     connected_ = true;
-    serial_.SetBaudRate(LibSerial::BaudRate::BAUD_115200);    
+    int baud = cfg.lookup("serial.baud");
+    serial_.SetBaudRate(toLibSerialBaud(baud));
+    PLOGI.printf("Serial baud rate %d", baud);
+
+    thread_running_ = true;
+    reader_thread_ = std::thread(&SerialComms::readerLoop, this);
+    writer_thread_ = std::thread(&SerialComms::writerLoop, this);
 }
 
 SerialComms::~SerialComms()
 {
+    if (thread_running_)
+    {
+        thread_running_ = false;
+        reader_thread_.join();
+        writer_thread_.join();
+    }
 }
 
 std::string SerialComms::rcv_base()
 {
-    rcv();
-    if(base_data_.empty())
-    {
-        return "";
-    }
-    std::string outdata = base_data_.front();
-    base_data_.pop();
-    return outdata;
+    std::string msg = demux_.pop(SERIAL_CHANNEL::BASE);
+    InputRecorder::recordSerial(INPUT_RECORD::SERIAL_BASE, msg);
+    return msg;
 }
 
 std::string SerialComms::rcv_lift()
 {
-    rcv();
-    if(lift_data_.empty())
-    {
-        return "";
-    }
-    std::string outdata = lift_data_.front();
-    lift_data_.pop();
-    return outdata;
+    std::string msg = demux_.pop(SERIAL_CHANNEL::LIFT);
+    InputRecorder::recordSerial(INPUT_RECORD::SERIAL_LIFT, msg);
+    return msg;
 }
 
 std::string SerialComms::rcv_distance()
 {
-    rcv();
-    if(distance_data_.empty())
-    {
-        return "";
-    }
-    std::string outdata = distance_data_.front();
-    distance_data_.pop();
-    return outdata;
+    std::string msg = demux_.pop(SERIAL_CHANNEL::DISTANCE);
+    InputRecorder::recordSerial(INPUT_RECORD::SERIAL_DISTANCE, msg);
+    return msg;
+}
+
+void SerialComms::send_base_velocity(SerialVelocity vel)
+{
+    uint8_t payload[SERIAL_VELOCITY_PAYLOAD_SIZE];
+    encodeVelocityPayload(vel, payload);
+    send_frame(SERIAL_BINARY_CHANNEL::BASE_VELOCITY, payload, SERIAL_VELOCITY_PAYLOAD_SIZE);
 }
 
-void SerialComms::rcv()
+void SerialComms::send_frame(SERIAL_BINARY_CHANNEL channel, const uint8_t* payload, uint8_t len)
 {
+    if (len > SERIAL_BINARY_MAX_PAYLOAD)
+    {
+        PLOGE.printf("Serial binary payload of %u bytes is too long", len);
+        return;
+    }
+    uint8_t frame[SERIAL_BINARY_OVERHEAD + SERIAL_BINARY_MAX_PAYLOAD];
+    size_t frame_size = encodeSerialFrame(channel, payload, len, frame);
+
     if(!connected_)
     {
-        PLOGE.printf("Cannot receive if port isn't connected");
+        PLOGE.printf("Cannot send if port isn't connected");
         return;
     }
-    
-    bool newData = false;
-    const int timeout_ms = 5;
-    std::string new_msg;
-    while (serial_.IsDataAvailable() && newData == false) 
+    tx_scheduler_.push(SerialTxScheduler::classifyFrame(channel, payload, len),
+                       std::string(reinterpret_cast<const char*>(frame), frame_size));
+}
+
+bool SerialComms::rcv_base_odometry(SerialOdometry* odom)
+{
+    if(!demux_.popBaseOdometry(odom)) return false;
+    InputRecorder::recordOdometry(*odom);
+    return true;
+}
+
+bool SerialComms::rcv_driver_stats(SerialDriverStats* stats)
+{
+    return demux_.popDriverStats(stats);
+}
+
+void SerialComms::readerLoop()
+{
+    const int fd = serial_.GetFileDescriptor();
+    // Bounds how long shutdown waits for the thread
+    const int poll_timeout_ms = 20;
+    char buffer[256];
+
+    while (thread_running_)
     {
-        char rc = ' ';
-        try
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int rc = poll(&pfd, 1, poll_timeout_ms);
+        if (rc < 0 && errno != EINTR)
         {
-            serial_.ReadByte(rc, timeout_ms);
-        }
-        catch (LibSerial::ReadTimeout&)
-        {
-            PLOGI.printf("Serial timeout");
-            break;
+            PLOGE.printf("Serial poll failed: %s", strerror(errno));
+            std::this_thread::sleep_for(std::chrono::milliseconds(poll_timeout_ms));
+            continue;
         }
+        if (rc <= 0) continue;
 
-        if (recvInProgress_ == true) 
+        // Everything available in one read rather than a byte at a time
+        ssize_t num_read = read(fd, buffer, sizeof(buffer));
+        if (num_read > 0)
         {
-            if (rc == START_CHAR)
-            {
-              buffer_ = "";
-            }
-            else if (rc != END_CHAR) 
-            {
-                buffer_ += rc;
-            }
-            else 
-            {
-                recvInProgress_ = false;
-                newData = true;
-                new_msg = buffer_;
-                buffer_ = "";
-            }
+            TRACE_SCOPE(TRACE_POINT::SERIAL_RECV);
+            demux_.consume(buffer, static_cast<size_t>(num_read));
         }
-        else if (rc == START_CHAR) 
+        else if (num_read < 0 && errno != EAGAIN && errno != EINTR)
         {
-            recvInProgress_ = true;
+            PLOGE.printf("Serial read failed: %s", strerror(errno));
         }
     }
-
-    // Figure out what to do with the message based on the identifier
-    if (new_msg.rfind("DEBUG", 0) == 0)
-    {
-        PLOGI << new_msg;
-    }
-    else if (new_msg.rfind("base:", 0) == 0)
-    {
-        base_data_.push(new_msg.substr(5, std::string::npos));
-    }
-    else if (new_msg.rfind("lift:", 0) == 0)
-    {
-        lift_data_.push(new_msg.substr(5, std::string::npos));
-    }
-    else if (new_msg.rfind("dist:", 0) == 0)
-    {
-        distance_data_.push(new_msg.substr(5, std::string::npos));
-    }
-    else if (new_msg.empty())
-    {
-        // Do nothing
-    }
-    else
-    {
-        PLOGE << "Unknown message type, skipping: " << new_msg;
-    }
 }
 
 void SerialComms::send(std::string msg)
@@ -145,6 +166,47 @@ void SerialComms::send(std::string msg)
     {
       std::string toSend = START_CHAR + msg + END_CHAR;
       PLOGD.printf("Serial send: %s",toSend.c_str());
-      serial_.Write(toSend);
+      tx_scheduler_.push(SerialTxScheduler::classifyMessage(msg), std::move(toSend), SerialTxScheduler::flushMask(msg));
     }
-}
\ No newline at end of file
+}
+
+SerialTxClassStats SerialComms::getTxStats(SERIAL_TX_CLASS tx_class)
+{
+    return tx_scheduler_.getStats(tx_class);
+}
+
+void SerialComms::writerLoop()
+{
+    // Bounds how long shutdown waits for the thread
+    const std::chrono::milliseconds pop_timeout(20);
+    auto last_report = std::chrono::steady_clock::now();
+    std::string bytes;
+
+    // Anything still queued at shutdown, like a power off, is written before the thread exits
+    while (thread_running_ || tx_scheduler_.size() > 0)
+    {
+        if (tx_scheduler_.pop(&bytes, pop_timeout))
+        {
+            TRACE_SCOPE(TRACE_POINT::SERIAL_SEND);
+            serial_.Write(bytes);
+        }
+
+        if (tx_stats_period_ > 0 && std::chrono::steady_clock::now() - last_report > std::chrono::duration<float>(tx_stats_period_))
+        {
+            logTxStats();
+            last_report = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+void SerialComms::logTxStats()
+{
+    const char* names[] = {"safety", "base", "lift", "poll"};
+    for (int i = 0; i < static_cast<int>(SERIAL_TX_CLASS::NUM_CLASSES); i++)
+    {
+        const SerialTxClassStats stats = tx_scheduler_.getStats(static_cast<SERIAL_TX_CLASS>(i));
+        if (stats.sent == 0 && stats.coalesced == 0 && stats.flushed == 0) continue;
+        PLOGI.printf("Serial TX %s: %u sent, %u coalesced, %u flushed, queued mean %.0f us p99 %.0f us max %.0f us",
+            names[i], stats.sent, stats.coalesced, stats.flushed, stats.latency_mean_us, stats.latency_p99_us, stats.latency_max_us);
+    }
+}
@@ -2,9 +2,12 @@
 #define SerialComms_h
 
 #include <libserial/SerialPort.h>
-#include <queue>
+#include <atomic>
+#include <thread>
 
 #include "SerialCommsBase.h"
+#include "SerialDemux.h"
+#include "SerialTxScheduler.h"
 
 // Factory method
 std::unique_ptr<SerialCommsBase> buildSerialComms(std::string portName);
@@ -26,20 +29,36 @@ class SerialComms : public SerialCommsBase
 
     std::string rcv_distance() override;
 
+    void send_base_velocity(SerialVelocity vel) override;
+
+    void send_frame(SERIAL_BINARY_CHANNEL channel, const uint8_t* payload, uint8_t len) override;
+
+    bool rcv_base_odometry(SerialOdometry* odom) override;
+
+    bool rcv_driver_stats(SerialDriverStats* stats) override;
+
+    SerialTxClassStats getTxStats(SERIAL_TX_CLASS tx_class) override;
+
   protected:
 
-    void rcv();
+    // Waits for data on the port and does bulk reads into demux_ until the object is destroyed
+    void readerLoop();
 
     LibSerial::SerialPort serial_;;
 
-    bool recvInProgress_;
-    int recvIdx_;
-    std::string buffer_;
-    
-    std::queue<std::string> base_data_;
-    std::queue<std::string> lift_data_;
-    std::queue<std::string> distance_data_;
-    
+    // Filled by the reader thread. The motor and lifter channels may be serviced from different
+    // threads, each channel queue only ever has one consumer.
+    SerialDemux demux_;
+    std::atomic<bool> thread_running_;
+    std::thread reader_thread_;
+
+    // Sends can come from any thread, they are queued by priority and written by writer_thread_
+    void writerLoop();
+    void logTxStats();
+
+    SerialTxScheduler tx_scheduler_;
+    std::thread writer_thread_;
+    float tx_stats_period_;
 
 };
 
@@ -24,4 +24,34 @@ void SerialCommsBase::send(std::string msg)
 {
     (void) msg; // Silence warnings
     return;
-}
\ No newline at end of file
+}
+
+void SerialCommsBase::send_base_velocity(SerialVelocity vel)
+{
+    (void) vel;
+}
+
+void SerialCommsBase::send_frame(SERIAL_BINARY_CHANNEL channel, const uint8_t* payload, uint8_t len)
+{
+    (void) channel;
+    (void) payload;
+    (void) len;
+}
+
+bool SerialCommsBase::rcv_base_odometry(SerialOdometry* odom)
+{
+    (void) odom;
+    return false;
+}
+
+bool SerialCommsBase::rcv_driver_stats(SerialDriverStats* stats)
+{
+    (void) stats;
+    return false;
+}
+
+SerialTxClassStats SerialCommsBase::getTxStats(SERIAL_TX_CLASS tx_class)
+{
+    (void) tx_class;
+    return SerialTxClassStats();
+}
@@ -3,6 +3,9 @@
 
 #include <string>
 
+#include "SerialBinaryProtocol.h"
+#include "SerialTxScheduler.h"
+
 #define START_CHAR '<'
 #define END_CHAR '>'
 
@@ -22,6 +25,21 @@ class SerialCommsBase
 
     virtual std::string rcv_distance();
 
+    // Local frame base velocity as a binary frame, much cheaper on the link than the "base:" text message
+    virtual void send_base_velocity(SerialVelocity vel);
+
+    // Any binary frame, payload is len bytes, at most SERIAL_BINARY_MAX_PAYLOAD
+    virtual void send_frame(SERIAL_BINARY_CHANNEL channel, const uint8_t* payload, uint8_t len);
+
+    // Oldest binary odometry report from the motor driver, returns false if there is none
+    virtual bool rcv_base_odometry(SerialOdometry* odom);
+
+    // Oldest loop time report from the motor driver, returns false if there is none
+    virtual bool rcv_driver_stats(SerialDriverStats* stats);
+
+    // Counts and TX queue latency of one priority class of outgoing messages
+    virtual SerialTxClassStats getTxStats(SERIAL_TX_CLASS tx_class);
+
     bool isConnected() {return connected_;};
 
   protected:
@@ -23,6 +23,7 @@ void SerialCommsFactory::set_mode(SERIAL_FACTORY_MODE mode)
 
 SerialCommsBase* SerialCommsFactory::get_serial_comms(std::string portName)
 {
+    std::lock_guard<std::mutex> lock(mutex_);
     if (comms_objects_.count(portName) == 0)
     {
         build_serial_comms(portName);
@@ -62,6 +63,7 @@ void SerialCommsFactory::build_serial_comms(std::string portName)
 // Private constructor
 SerialCommsFactory::SerialCommsFactory()
 : mode_(SERIAL_FACTORY_MODE::STANDARD),
-  comms_objects_()
+  comms_objects_(),
+  mutex_()
 {}
   
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <map>
+#include <mutex>
 
 #include "SerialCommsBase.h"
 
@@ -21,6 +22,7 @@ class SerialCommsFactory
 
     void set_mode(SERIAL_FACTORY_MODE mode);
 
+    // Builds the port on first use. Safe to call from several threads, later callers wait for the build.
     SerialCommsBase* get_serial_comms(std::string portName);
 
     // Delete copy and assignment constructors
@@ -40,6 +42,8 @@ class SerialCommsFactory
 
     std::map<std::string, std::unique_ptr<SerialCommsBase>> comms_objects_;
 
+    std::mutex mutex_;
+
 };
 
 
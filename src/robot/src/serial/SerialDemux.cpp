@@ -0,0 +1,224 @@
+#include "SerialDemux.h"
+
+#include <plog/Log.h>
+
+namespace
+{
+    const size_t PREFIX_LEN = 5;
+
+    bool hasPrefix(const char* data, size_t len, const char* prefix, size_t prefix_len)
+    {
+        return len >= prefix_len && std::memcmp(data, prefix, prefix_len) == 0;
+    }
+}
+
+SerialDemux::SerialDemux()
+: recv_in_progress_(false),
+  overflowed_(false),
+  msg_(),
+  dropped_messages_(0),
+  binary_state_(BINARY_STATE::IDLE),
+  binary_channel_(0),
+  binary_len_(0),
+  binary_idx_(0),
+  binary_crc_(0),
+  binary_payload_(),
+  bad_frames_(0),
+  base_odometry_queue_(),
+  base_queue_(),
+  lift_queue_(),
+  distance_queue_()
+{
+}
+
+void SerialDemux::consume(const char* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        const char rc = data[i];
+        if (consumeBinary(static_cast<uint8_t>(rc)))
+        {
+            // Binary frames can't show up inside text, so any text message in progress was cut off
+            recv_in_progress_ = false;
+            continue;
+        }
+        if (rc == START_CHAR)
+        {
+            // A start char always restarts the message, matching the old byte at a time framing
+            recv_in_progress_ = true;
+            overflowed_ = false;
+            msg_.len = 0;
+        }
+        else if (!recv_in_progress_)
+        {
+            continue;
+        }
+        else if (rc == END_CHAR)
+        {
+            recv_in_progress_ = false;
+            if (overflowed_)
+            {
+                dropped_messages_++;
+                PLOGW.printf("Serial message longer than %i bytes, dropping", SERIAL_MAX_MSG_SIZE);
+            }
+            else
+            {
+                dispatch(msg_);
+            }
+        }
+        else if (msg_.len < SERIAL_MAX_MSG_SIZE)
+        {
+            msg_.data[msg_.len++] = rc;
+        }
+        else
+        {
+            overflowed_ = true;
+        }
+    }
+}
+
+void SerialDemux::dispatch(const SerialMsg& msg)
+{
+    SpscQueue<SerialMsg, SERIAL_CHANNEL_QUEUE_SIZE>* queue = nullptr;
+    if (hasPrefix(msg.data, msg.len, "DEBUG", 5))
+    {
+        PLOGI << std::string(msg.data, msg.len);
+        return;
+    }
+    else if (hasPrefix(msg.data, msg.len, "base:", PREFIX_LEN))
+    {
+        queue = &base_queue_;
+    }
+    else if (hasPrefix(msg.data, msg.len, "lift:", PREFIX_LEN))
+    {
+        queue = &lift_queue_;
+    }
+    else if (hasPrefix(msg.data, msg.len, "dist:", PREFIX_LEN))
+    {
+        queue = &distance_queue_;
+    }
+    else if (msg.len == 0)
+    {
+        return;
+    }
+    else
+    {
+        PLOGE << "Unknown message type, skipping: " << std::string(msg.data, msg.len);
+        return;
+    }
+
+    SerialMsg stripped;
+    stripped.len = msg.len - PREFIX_LEN;
+    std::memcpy(stripped.data, msg.data + PREFIX_LEN, stripped.len);
+    if (!queue->push(stripped))
+    {
+        dropped_messages_++;
+        PLOGW << "Serial channel queue full, dropping: " << std::string(msg.data, msg.len);
+    }
+}
+
+bool SerialDemux::consumeBinary(uint8_t byte)
+{
+    switch (binary_state_)
+    {
+        case BINARY_STATE::IDLE:
+            if (byte != static_cast<uint8_t>(SERIAL_BINARY_START)) return false;
+            binary_state_ = BINARY_STATE::CHANNEL;
+            break;
+        case BINARY_STATE::CHANNEL:
+            binary_channel_ = byte;
+            binary_state_ = BINARY_STATE::LENGTH;
+            break;
+        case BINARY_STATE::LENGTH:
+            if (byte > SERIAL_BINARY_MAX_PAYLOAD)
+            {
+                bad_frames_++;
+                binary_state_ = BINARY_STATE::IDLE;
+                break;
+            }
+            binary_len_ = byte;
+            binary_idx_ = 0;
+            binary_state_ = binary_len_ > 0 ? BINARY_STATE::PAYLOAD : BINARY_STATE::CRC_LOW;
+            break;
+        case BINARY_STATE::PAYLOAD:
+            binary_payload_[binary_idx_++] = byte;
+            if (binary_idx_ == binary_len_) binary_state_ = BINARY_STATE::CRC_LOW;
+            break;
+        case BINARY_STATE::CRC_LOW:
+            binary_crc_ = byte;
+            binary_state_ = BINARY_STATE::CRC_HIGH;
+            break;
+        case BINARY_STATE::CRC_HIGH:
+            binary_crc_ |= static_cast<uint16_t>(byte) << 8;
+            binary_state_ = BINARY_STATE::IDLE;
+            dispatchBinary();
+            break;
+    }
+    return true;
+}
+
+void SerialDemux::dispatchBinary()
+{
+    const uint8_t header[2] = {binary_channel_, binary_len_};
+    uint16_t crc = serialCrc16(header, 2);
+    crc = serialCrc16(binary_payload_, binary_len_, crc);
+    if (crc != binary_crc_)
+    {
+        bad_frames_++;
+        PLOGW.printf("Serial binary frame on channel %u failed CRC", binary_channel_);
+        return;
+    }
+
+    if (binary_channel_ == static_cast<uint8_t>(SERIAL_BINARY_CHANNEL::BASE_ODOMETRY) && binary_len_ == SERIAL_ODOMETRY_PAYLOAD_SIZE)
+    {
+        if (!base_odometry_queue_.push(decodeOdometryPayload(binary_payload_)))
+        {
+            dropped_messages_++;
+        }
+    }
+    else if (binary_channel_ == static_cast<uint8_t>(SERIAL_BINARY_CHANNEL::DRIVER_STATS) && binary_len_ == SERIAL_DRIVER_STATS_PAYLOAD_SIZE)
+    {
+        if (!driver_stats_queue_.push(decodeDriverStatsPayload(binary_payload_)))
+        {
+            dropped_messages_++;
+        }
+    }
+    else
+    {
+        bad_frames_++;
+        PLOGW.printf("Unexpected serial binary frame, channel %u length %u", binary_channel_, binary_len_);
+    }
+}
+
+bool SerialDemux::popBaseOdometry(SerialOdometry* odom)
+{
+    return base_odometry_queue_.pop(odom);
+}
+
+bool SerialDemux::popDriverStats(SerialDriverStats* stats)
+{
+    return driver_stats_queue_.pop(stats);
+}
+
+std::string SerialDemux::pop(SERIAL_CHANNEL channel)
+{
+    SerialMsg msg;
+    bool ok = false;
+    switch (channel)
+    {
+        case SERIAL_CHANNEL::BASE:
+            ok = base_queue_.pop(&msg);
+            break;
+        case SERIAL_CHANNEL::LIFT:
+            ok = lift_queue_.pop(&msg);
+            break;
+        case SERIAL_CHANNEL::DISTANCE:
+            ok = distance_queue_.pop(&msg);
+            break;
+    }
+    if (!ok)
+    {
+        return "";
+    }
+    return std::string(msg.data, msg.len);
+}
@@ -0,0 +1,96 @@
+#ifndef SerialDemux_h
+#define SerialDemux_h
+
+#include <string>
+
+#include "Mailbox.h"
+#include "SerialBinaryProtocol.h"
+#include "SerialCommsBase.h"
+
+#define SERIAL_MAX_MSG_SIZE 128
+#define SERIAL_CHANNEL_QUEUE_SIZE 64
+// Driver stats come about once a second
+#define SERIAL_DRIVER_STATS_QUEUE_SIZE 4
+
+enum class SERIAL_CHANNEL
+{
+    BASE,
+    LIFT,
+    DISTANCE,
+};
+
+// Frames START_CHAR ... END_CHAR messages out of raw serial bytes and sorts them into a lock-free
+// queue per channel by their "base:", "lift:" or "dist:" prefix, which is stripped. Binary frames
+// (see SerialBinaryProtocol.h) are checked and decoded into their own queues. One thread feeds
+// bytes in with consume, each channel may then be popped from one other thread. Framing uses a fixed
+// buffer so nothing is allocated on the reading side.
+class SerialDemux
+{
+  public:
+
+    SerialDemux();
+
+    // Called with any number of bytes, messages may be split across calls
+    void consume(const char* data, size_t len);
+
+    // Oldest message on the channel, or an empty string if there is none
+    std::string pop(SERIAL_CHANNEL channel);
+
+    // Oldest binary odometry report, returns false if there is none
+    bool popBaseOdometry(SerialOdometry* odom);
+
+    // Oldest driver loop time report, returns false if there is none
+    bool popDriverStats(SerialDriverStats* stats);
+
+    // Messages lost because they were too long or their channel queue was full
+    uint32_t getDroppedMessages() const { return dropped_messages_; };
+
+    // Binary frames that failed the CRC or had an unexpected channel or length
+    uint32_t getBadFrames() const { return bad_frames_; };
+
+  private:
+
+    struct SerialMsg
+    {
+      uint16_t len;
+      char data[SERIAL_MAX_MSG_SIZE];
+    };
+
+    enum class BINARY_STATE
+    {
+        IDLE,
+        CHANNEL,
+        LENGTH,
+        PAYLOAD,
+        CRC_LOW,
+        CRC_HIGH,
+    };
+
+    void dispatch(const SerialMsg& msg);
+
+    // Returns true while the byte was part of a binary frame
+    bool consumeBinary(uint8_t byte);
+
+    void dispatchBinary();
+
+    bool recv_in_progress_;
+    bool overflowed_;
+    SerialMsg msg_;
+    std::atomic<uint32_t> dropped_messages_;
+
+    BINARY_STATE binary_state_;
+    uint8_t binary_channel_;
+    uint8_t binary_len_;
+    uint8_t binary_idx_;
+    uint16_t binary_crc_;
+    uint8_t binary_payload_[SERIAL_BINARY_MAX_PAYLOAD];
+    std::atomic<uint32_t> bad_frames_;
+    SpscQueue<SerialOdometry, SERIAL_CHANNEL_QUEUE_SIZE> base_odometry_queue_;
+    SpscQueue<SerialDriverStats, SERIAL_DRIVER_STATS_QUEUE_SIZE> driver_stats_queue_;
+
+    SpscQueue<SerialMsg, SERIAL_CHANNEL_QUEUE_SIZE> base_queue_;
+    SpscQueue<SerialMsg, SERIAL_CHANNEL_QUEUE_SIZE> lift_queue_;
+    SpscQueue<SerialMsg, SERIAL_CHANNEL_QUEUE_SIZE> distance_queue_;
+};
+
+#endif //SerialDemux_h
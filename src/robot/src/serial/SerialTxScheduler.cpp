@@ -0,0 +1,159 @@
+#include "SerialTxScheduler.h"
+
+namespace
+{
+    bool hasPrefix(const std::string& msg, const char* prefix)
+    {
+        return msg.compare(0, std::char_traits<char>::length(prefix), prefix) == 0;
+    }
+
+    // Byte of the axis in an encoded SerialTrajectoryAxis, after the uint16 trajectory id
+    const uint8_t TRAJECTORY_AXIS_OFFSET = 2;
+}
+
+SerialTxScheduler::SerialTxScheduler()
+: mutex_(),
+  cv_(),
+  classes_()
+{
+    for (ClassState& c : classes_)
+    {
+        c.latency_us = WindowedStats<float, SERIAL_TX_LATENCY_WINDOW>(SERIAL_TX_LATENCY_WINDOW, 0, SERIAL_TX_LATENCY_HIST_MAX_US);
+    }
+}
+
+SERIAL_TX_CLASS SerialTxScheduler::classifyMessage(const std::string& msg)
+{
+    if (hasPrefix(msg, "base:Power:") || msg == "lift:stop")
+    {
+        return SERIAL_TX_CLASS::SAFETY;
+    }
+    else if (hasPrefix(msg, "base:"))
+    {
+        return SERIAL_TX_CLASS::BASE;
+    }
+    else if (msg == "lift:status_req")
+    {
+        return SERIAL_TX_CLASS::POLL;
+    }
+    return SERIAL_TX_CLASS::LIFT;
+}
+
+uint32_t SerialTxScheduler::flushMask(const std::string& msg)
+{
+    if (msg == "lift:stop")
+    {
+        return SERIAL_TX_CLASS_BIT(SERIAL_TX_CLASS::LIFT) | SERIAL_TX_CLASS_BIT(SERIAL_TX_CLASS::POLL);
+    }
+    else if (msg == "base:Power:OFF")
+    {
+        return SERIAL_TX_CLASS_BIT(SERIAL_TX_CLASS::BASE);
+    }
+    return 0;
+}
+
+SERIAL_TX_CLASS SerialTxScheduler::classifyFrame(SERIAL_BINARY_CHANNEL channel, const uint8_t* payload, uint8_t len)
+{
+    switch (channel)
+    {
+        case SERIAL_BINARY_CHANNEL::STREAM_CONFIG:
+            // Sent just before powering on, so it has to stay ahead of the power message
+            return SERIAL_TX_CLASS::SAFETY;
+        case SERIAL_BINARY_CHANNEL::TRAJECTORY_AXIS:
+            if (len > TRAJECTORY_AXIS_OFFSET && payload[TRAJECTORY_AXIS_OFFSET] == static_cast<uint8_t>(SERIAL_TRAJECTORY_AXIS::LIFTER))
+            {
+                // Has to go out before the lift:scurve message that starts it
+                return SERIAL_TX_CLASS::LIFT;
+            }
+            return SERIAL_TX_CLASS::BASE;
+        default:
+            return SERIAL_TX_CLASS::BASE;
+    }
+}
+
+void SerialTxScheduler::push(SERIAL_TX_CLASS tx_class, std::string bytes, uint32_t flush_mask)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < static_cast<int>(SERIAL_TX_CLASS::NUM_CLASSES); i++)
+        {
+            if (flush_mask & (1u << i)) flush(static_cast<SERIAL_TX_CLASS>(i));
+        }
+
+        ClassState& c = classes_[static_cast<int>(tx_class)];
+        if (tx_class == SERIAL_TX_CLASS::POLL)
+        {
+            for (const PendingTx& pending : c.queue)
+            {
+                if (pending.bytes == bytes)
+                {
+                    c.counts.coalesced++;
+                    return;
+                }
+            }
+        }
+        c.queue.push_back({std::move(bytes), ClockType::now()});
+    }
+    cv_.notify_one();
+}
+
+bool SerialTxScheduler::pop(std::string* bytes, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    ClassState* next = nullptr;
+    cv_.wait_for(lock, timeout, [&]()
+    {
+        for (ClassState& c : classes_)
+        {
+            if (!c.queue.empty())
+            {
+                next = &c;
+                return true;
+            }
+        }
+        return false;
+    });
+    if (!next)
+    {
+        return false;
+    }
+
+    PendingTx& front = next->queue.front();
+    *bytes = std::move(front.bytes);
+    next->latency_us.add(std::chrono::duration<float, std::micro>(ClockType::now() - front.queued_time).count());
+    next->counts.sent++;
+    next->queue.pop_front();
+    return true;
+}
+
+size_t SerialTxScheduler::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t total = 0;
+    for (const ClassState& c : classes_)
+    {
+        total += c.queue.size();
+    }
+    return total;
+}
+
+SerialTxClassStats SerialTxScheduler::getStats(SERIAL_TX_CLASS tx_class)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const ClassState& c = classes_[static_cast<int>(tx_class)];
+    SerialTxClassStats stats = c.counts;
+    if (c.latency_us.count() > 0)
+    {
+        stats.latency_mean_us = c.latency_us.mean();
+        stats.latency_p99_us = c.latency_us.quantile(0.99);
+        stats.latency_max_us = c.latency_us.max();
+    }
+    return stats;
+}
+
+void SerialTxScheduler::flush(SERIAL_TX_CLASS tx_class)
+{
+    ClassState& c = classes_[static_cast<int>(tx_class)];
+    c.counts.flushed += c.queue.size();
+    c.queue.clear();
+}
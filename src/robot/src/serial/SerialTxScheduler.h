@@ -0,0 +1,96 @@
+#ifndef SerialTxScheduler_h
+#define SerialTxScheduler_h
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "SerialBinaryProtocol.h"
+#include "WindowedStats.h"
+
+// TX queue latencies kept per class for the stats, and the range of their histogram for the p99
+#define SERIAL_TX_LATENCY_WINDOW 256
+#define SERIAL_TX_LATENCY_HIST_MAX_US 20000
+
+// Priority classes for outgoing serial traffic, highest first
+enum class SERIAL_TX_CLASS
+{
+    SAFETY,   // Power, stream config and stop messages
+    BASE,     // Base velocity and trajectory frames
+    LIFT,     // Lifter commands and lifter profile uploads
+    POLL,     // Status requests, duplicates of one still waiting are dropped
+    NUM_CLASSES,
+};
+
+#define SERIAL_TX_CLASS_BIT(c) (1u << static_cast<int>(c))
+
+struct SerialTxClassStats
+{
+    uint32_t sent = 0;
+    uint32_t coalesced = 0;       // Polls dropped because the same poll was already waiting
+    uint32_t flushed = 0;         // Messages dropped by a later stop message for the same device
+    float latency_mean_us = 0;    // Time between being queued and being handed to the port
+    float latency_p99_us = 0;
+    float latency_max_us = 0;
+};
+
+// Orders outgoing serial messages so that a burst of lifter traffic can't hold up a base velocity
+// command on the shared link. Any thread can push, one writer thread pops the highest priority
+// message and writes it. Messages in a class keep their order.
+//
+// Stop messages drop anything still waiting for the same device, so a "lift:stop" can't be followed
+// by a lifter move that was queued before it.
+class SerialTxScheduler
+{
+  public:
+
+    SerialTxScheduler();
+
+    // Class for a text message, msg without the START_CHAR/END_CHAR framing
+    static SERIAL_TX_CLASS classifyMessage(const std::string& msg);
+
+    // SERIAL_TX_CLASS_BIT mask of the classes a text message drops from the queue when it is pushed
+    static uint32_t flushMask(const std::string& msg);
+
+    // Class for a binary frame
+    static SERIAL_TX_CLASS classifyFrame(SERIAL_BINARY_CHANNEL channel, const uint8_t* payload, uint8_t len);
+
+    // Queues the wire bytes of one message, after dropping anything waiting in the classes in flush_mask
+    void push(SERIAL_TX_CLASS tx_class, std::string bytes, uint32_t flush_mask = 0);
+
+    // Writer side. Waits up to timeout for a message, returns false if there was none.
+    bool pop(std::string* bytes, std::chrono::milliseconds timeout);
+
+    // Messages waiting in all classes
+    size_t size();
+
+    SerialTxClassStats getStats(SERIAL_TX_CLASS tx_class);
+
+  private:
+
+    using ClockType = std::chrono::steady_clock;
+
+    struct PendingTx
+    {
+        std::string bytes;
+        ClockType::time_point queued_time;
+    };
+
+    struct ClassState
+    {
+        std::deque<PendingTx> queue;
+        SerialTxClassStats counts;
+        WindowedStats<float, SERIAL_TX_LATENCY_WINDOW> latency_us;
+    };
+
+    // Drops waiting messages in tx_class, called with mutex_ held
+    void flush(SERIAL_TX_CLASS tx_class);
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    ClassState classes_[static_cast<int>(SERIAL_TX_CLASS::NUM_CLASSES)];
+};
+
+#endif //SerialTxScheduler_h
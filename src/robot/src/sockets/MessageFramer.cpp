@@ -0,0 +1,79 @@
+#include "MessageFramer.h"
+
+#include <cstring>
+#include <plog/Log.h>
+
+MessageFramer::MessageFramer()
+: buffer_(),
+  pos_(0),
+  dropped_frames_(0)
+{
+}
+
+void MessageFramer::append(const std::string& data)
+{
+    // Only an incomplete frame is ever left behind, so this moves at most one frame's worth of bytes
+    buffer_.erase(0, pos_);
+    pos_ = 0;
+    buffer_ += data;
+}
+
+bool MessageFramer::next(Frame* frame)
+{
+    const char* base = buffer_.data();
+    const size_t len = buffer_.size();
+    while (pos_ < len)
+    {
+        const char* text = static_cast<const char*>(memchr(base + pos_, START_CHAR, len - pos_));
+        const char* binary = static_cast<const char*>(memchr(base + pos_, BINARY_START_CHAR, len - pos_));
+        if (!text && !binary)
+        {
+            pos_ = len;
+            return false;
+        }
+        const size_t start = (text && (!binary || text < binary) ? text : binary) - base;
+
+        if (base[start] == START_CHAR)
+        {
+            const char* end = static_cast<const char*>(memchr(base + start + 1, END_CHAR, len - start - 1));
+            if (!end)
+            {
+                pos_ = start;
+                if (len - start <= MAX_TEXT_FRAME_SIZE) return false;
+                PLOGW.printf("Dropping text frame with no end after %zu bytes", len - start);
+                dropped_frames_++;
+                pos_ = start + 1;
+                continue;
+            }
+            std::string_view body(base + start + 1, end - base - start - 1);
+            const size_t restart = body.rfind(START_CHAR);
+            if (restart != std::string_view::npos) body.remove_prefix(restart + 1);
+            pos_ = end - base + 1;
+            *frame = {false, body};
+            return true;
+        }
+
+        if (len - start < 3)
+        {
+            pos_ = start;
+            return false;
+        }
+        const size_t body_len = static_cast<uint8_t>(base[start + 1]) | (static_cast<uint8_t>(base[start + 2]) << 8);
+        if (body_len == 0 || body_len > BINARY_MAX_BODY_SIZE)
+        {
+            PLOGW.printf("Dropping binary frame with bad length %zu", body_len);
+            dropped_frames_++;
+            pos_ = start + 1;
+            continue;
+        }
+        if (len - start - 3 < body_len)
+        {
+            pos_ = start;
+            return false;
+        }
+        *frame = {true, std::string_view(base + start + 3, body_len)};
+        pos_ = start + 3 + body_len;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,56 @@
+#ifndef MessageFramer_h
+#define MessageFramer_h
+
+#include <string>
+#include <string_view>
+
+#define START_CHAR '<'
+#define END_CHAR '>'
+
+// Binary frames are BINARY_START_CHAR, a little endian uint16 body length, then the body which is
+// a 1 byte message id followed by packed little endian payload. Replies use the same encoding as the request.
+#define BINARY_START_CHAR '\xA5'
+#define BINARY_MAX_BODY_SIZE 256
+
+// A text frame still missing its END_CHAR after this many bytes is given up on
+#define MAX_TEXT_FRAME_SIZE 4096
+
+// Splits the byte stream from the socket into START_CHAR ... END_CHAR text frames and length delimited
+// binary frames. Bytes outside of a frame are ignored, and a START_CHAR inside a text frame starts it over.
+// Frames are returned as views into the framer's own buffer so nothing is copied per message.
+class MessageFramer
+{
+  public:
+
+    struct Frame
+    {
+      bool binary;
+      std::string_view body;   // Without the start/end chars or the binary length
+    };
+
+    MessageFramer();
+
+    // Adds bytes as they came off the socket, frames may be split across calls.
+    // Invalidates the bodies of frames returned before.
+    void append(const std::string& data);
+
+    // Next complete frame, returns false once everything left is an incomplete frame
+    bool next(Frame* frame);
+
+    // Drops everything buffered, for when the stream starts over on a new connection
+    void reset() { buffer_.clear(); pos_ = 0; };
+
+    // Bytes held back waiting for the rest of a frame
+    size_t pendingBytes() const { return buffer_.size() - pos_; };
+
+    // Binary frames with an impossible length and text frames that never ended
+    uint32_t getDroppedFrames() const { return dropped_frames_; };
+
+  private:
+
+    std::string buffer_;
+    size_t pos_;
+    uint32_t dropped_frames_;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#include "MockMonitorServer.h"
+
+MockMonitorServer::MockMonitorServer()
+: MonitorServerBase(),
+  has_clients_(false),
+  published_()
+{
+}
+
+void MockMonitorServer::publish(std::string frame)
+{
+    published_.push(std::move(frame));
+}
+
+std::string MockMonitorServer::mock_get_published()
+{
+    if(published_.empty()) return "";
+    std::string frame = published_.front();
+    published_.pop();
+    return frame;
+}
+
+void MockMonitorServer::purge_data()
+{
+    published_ = {};
+    has_clients_ = false;
+}
@@ -0,0 +1,26 @@
+#ifndef MockMonitorServer_h
+#define MockMonitorServer_h
+
+#include <queue>
+
+#include "MonitorServerBase.h"
+
+class MockMonitorServer : public MonitorServerBase
+{
+  public:
+    MockMonitorServer();
+
+    bool hasClients() override { return has_clients_; };
+    void publish(std::string frame) override;
+
+    void mock_set_has_clients(bool has_clients) { has_clients_ = has_clients; };
+    // Oldest published frame, empty if there are none
+    std::string mock_get_published();
+    void purge_data();
+
+  private:
+    bool has_clients_;
+    std::queue<std::string> published_;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "MockSocketMultiThreadWrapper.h"
+#include "MessageFramer.h"
 
 #include <plog/Log.h>
+#include <algorithm>
 
 MockSocketMultiThreadWrapper::MockSocketMultiThreadWrapper()
 : SocketMultiThreadWrapperBase(),
@@ -8,6 +10,10 @@ MockSocketMultiThreadWrapper::MockSocketMultiThreadWrapper()
   rcv_data_(),
   ms_until_next_command_(-1),
   send_immediate_(true),
+  send_count_(0),
+  connection_id_(0),
+  accepted_id_(0),
+  send_limit_(0),
   timer_()
 {
 }
@@ -28,7 +34,8 @@ std::string MockSocketMultiThreadWrapper::getData()
     rcv_data_.pop();
     PLOGI << "Popped: " << outdata << " data left: " << rcv_data_.size();
 
-    if(outdata[1] != '{')
+    // Purely numeric entries are a delay before the next command rather than data
+    if(!outdata.empty() && std::all_of(outdata.begin(), outdata.end(), ::isdigit))
     {
         ms_until_next_command_ = stoi(outdata);
         timer_.reset();
@@ -40,9 +47,32 @@ std::string MockSocketMultiThreadWrapper::getData()
     return outdata;
 }
 
-void MockSocketMultiThreadWrapper::sendData(std::string data)
+bool MockSocketMultiThreadWrapper::sendData(std::string data)
 {
-    send_data_.push(data);
+    send_count_++;
+    if(send_limit_ > 0 && data.size() > send_limit_)
+    {
+        return false;
+    }
+    // RobotServer sends everything from one loop at once, split it back up so tests can look at each frame
+    size_t offset = 0;
+    while(offset < data.size())
+    {
+        size_t len = data.size() - offset;
+        if(data[offset] == BINARY_START_CHAR && len >= 3)
+        {
+            const uint8_t* header = reinterpret_cast<const uint8_t*>(data.data() + offset + 1);
+            len = std::min(len, static_cast<size_t>(3 + (header[0] | (header[1] << 8))));
+        }
+        else if(data[offset] == START_CHAR)
+        {
+            size_t end = data.find(END_CHAR, offset);
+            if(end != std::string::npos) len = end - offset + 1;
+        }
+        send_data_.push(data.substr(offset, len));
+        offset += len;
+    }
+    return true;
 }
 
 bool MockSocketMultiThreadWrapper::dataAvailableToRead()
@@ -74,8 +104,22 @@ void MockSocketMultiThreadWrapper::sendMockData(std::string data)
     rcv_data_.push(data);
 }
 
+void MockSocketMultiThreadWrapper::mock_reconnect()
+{
+    connection_id_++;
+    while(!send_data_.empty())
+    {
+        send_data_.pop();
+    }
+}
+
 void MockSocketMultiThreadWrapper::purge_data()
 {
+    send_count_ = 0;
+    // Back to the connection a new RobotServer starts out on
+    connection_id_ = 0;
+    accepted_id_ = 0;
+    send_limit_ = 0;
     while(!send_data_.empty())
     {
         send_data_.pop();
@@ -13,21 +13,35 @@ class MockSocketMultiThreadWrapper : public SocketMultiThreadWrapperBase
     MockSocketMultiThreadWrapper();
 
     std::string getData();
-    void sendData(std::string data);
+    bool sendData(std::string data);
     bool dataAvailableToRead();
+    uint32_t getConnectionId() {return connection_id_;};
+    void acceptConnection(uint32_t id) {accepted_id_ = id;};
 
     void add_mock_data(std::string data);
+    // One frame per call even when several were sent together
     std::string getMockData();
     void sendMockData(std::string data);
 
     void purge_data();
     void set_send_immediate(bool send_immediate) {send_immediate_ = send_immediate;};
+    // Number of sendData calls since the last purge
+    int mock_get_send_count() const {return send_count_;};
+    // A new client takes over the connection, replies the old one hadn't read yet are lost with it
+    void mock_reconnect();
+    uint32_t mock_get_accepted_id() const {return accepted_id_;};
+    // sendData drops anything longer than this, like a full send buffer would. 0 takes anything.
+    void mock_set_send_limit(size_t limit) {send_limit_ = limit;};
 
   private:
     std::queue<std::string> send_data_;
     std::queue<std::string> rcv_data_;
     int ms_until_next_command_;
     bool send_immediate_;
+    int send_count_;
+    uint32_t connection_id_;
+    uint32_t accepted_id_;
+    size_t send_limit_;
     Timer timer_;
 
 };
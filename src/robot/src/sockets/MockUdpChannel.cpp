@@ -0,0 +1,43 @@
+#include "MockUdpChannel.h"
+
+MockUdpChannel::MockUdpChannel()
+: UdpChannelBase(),
+  rcv_data_(),
+  send_data_(),
+  have_peer_(false)
+{
+}
+
+bool MockUdpChannel::receive(std::string* datagram)
+{
+    if(rcv_data_.empty()) return false;
+    *datagram = rcv_data_.front();
+    rcv_data_.pop();
+    have_peer_ = true;
+    return true;
+}
+
+void MockUdpChannel::send(const std::string& datagram)
+{
+    if(have_peer_) send_data_.push(datagram);
+}
+
+void MockUdpChannel::mock_add_datagram(const std::string& datagram)
+{
+    rcv_data_.push(datagram);
+}
+
+std::string MockUdpChannel::mock_get_sent()
+{
+    if(send_data_.empty()) return "";
+    std::string datagram = send_data_.front();
+    send_data_.pop();
+    return datagram;
+}
+
+void MockUdpChannel::purge_data()
+{
+    rcv_data_ = {};
+    send_data_ = {};
+    have_peer_ = false;
+}
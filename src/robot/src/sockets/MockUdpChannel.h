@@ -0,0 +1,29 @@
+#ifndef MockUdpChannel_h
+#define MockUdpChannel_h
+
+#include <queue>
+
+#include "UdpChannelBase.h"
+
+class MockUdpChannel : public UdpChannelBase
+{
+  public:
+    MockUdpChannel();
+
+    bool receive(std::string* datagram) override;
+    void send(const std::string& datagram) override;
+    bool hasPeer() override { return have_peer_; };
+
+    // Queues a datagram as if it came from the peer
+    void mock_add_datagram(const std::string& datagram);
+    // Next datagram sent to the peer, empty if there are none
+    std::string mock_get_sent();
+    void purge_data();
+
+  private:
+    std::queue<std::string> rcv_data_;
+    std::queue<std::string> send_data_;
+    bool have_peer_;
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include "MonitorServer.h"
+
+#include <plog/Log.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// Upper bound on how long the monitor thread sleeps without any I/O events
+#define MONITOR_WAIT_TIMEOUT_MS 100
+
+MonitorServer::MonitorServer(int port, int max_clients)
+: MonitorServerBase(),
+  listen_fd_(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)),
+  wake_fd_(eventfd(0, EFD_NONBLOCK)),
+  max_clients_(max_clients),
+  clients_(),
+  num_clients_(0),
+  mutex_(),
+  latest_(),
+  latest_gen_(0),
+  taken_gen_(0),
+  running_(true),
+  thread_()
+{
+    if(listen_fd_ < 0)
+    {
+        PLOGE.printf("Could not create monitor socket: %s", strerror(errno));
+        return;
+    }
+    int on = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if(bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd_, max_clients_) < 0)
+    {
+        PLOGE.printf("Could not listen for monitors on port %d: %s", port, strerror(errno));
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return;
+    }
+    PLOGI.printf("Listening for monitor clients on port %d", port);
+    thread_ = std::thread(&MonitorServer::loop, this);
+}
+
+MonitorServer::~MonitorServer()
+{
+    running_ = false;
+    if(thread_.joinable())
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(wake_fd_, &one, sizeof(one));
+        (void)ret;
+        thread_.join();
+    }
+    for(Client& client : clients_) close(client.fd);
+    if(listen_fd_ >= 0) close(listen_fd_);
+    if(wake_fd_ >= 0) close(wake_fd_);
+}
+
+void MonitorServer::publish(std::string frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        latest_ = std::make_shared<const std::string>(std::move(frame));
+        latest_gen_++;
+    }
+    // Failure here only means the counter is already set, so the monitor thread will still wake up
+    uint64_t one = 1;
+    ssize_t ret = write(wake_fd_, &one, sizeof(one));
+    (void)ret;
+}
+
+void MonitorServer::loop()
+{
+    std::vector<pollfd> fds;
+    while(running_)
+    {
+        fds.clear();
+        fds.push_back({listen_fd_, POLLIN, 0});
+        fds.push_back({wake_fd_, POLLIN, 0});
+        for(const Client& client : clients_)
+        {
+            fds.push_back({client.fd, static_cast<short>(POLLIN | (client.frame ? POLLOUT : 0)), 0});
+        }
+        if(poll(fds.data(), fds.size(), MONITOR_WAIT_TIMEOUT_MS) < 0 && errno != EINTR)
+        {
+            PLOGE.printf("Error waiting on monitor sockets: %s", strerror(errno));
+            continue;
+        }
+
+        if(fds[1].revents & POLLIN)
+        {
+            uint64_t count;
+            ssize_t ret = read(wake_fd_, &count, sizeof(count));
+            (void)ret;
+            takeLatestFrame();
+        }
+
+        // fds lines up with clients_ until clients are removed below
+        for(size_t i = 0; i < clients_.size(); i++)
+        {
+            const short revents = fds[i + 2].revents;
+            bool ok = true;
+            if(revents & (POLLIN | POLLHUP | POLLERR)) ok = drainInput(clients_[i]);
+            if(ok && clients_[i].frame) ok = sendFrame(clients_[i]);
+            if(!ok) clients_[i].fd = -1;
+        }
+        for(auto it = clients_.begin(); it != clients_.end();)
+        {
+            it = it->fd < 0 ? clients_.erase(it) : it + 1;
+        }
+
+        if(fds[0].revents & POLLIN) acceptClients();
+        num_clients_ = static_cast<int>(clients_.size());
+    }
+}
+
+void MonitorServer::acceptClients()
+{
+    while(true)
+    {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK);
+        if(fd < 0) return;
+        if(static_cast<int>(clients_.size()) >= max_clients_)
+        {
+            PLOGW.printf("Rejecting monitor client, already have %d", max_clients_);
+            close(fd);
+            continue;
+        }
+        clients_.push_back({fd, nullptr, 0, 0});
+        PLOGI.printf("Monitor client connected, %zu total", clients_.size());
+    }
+}
+
+void MonitorServer::takeLatestFrame()
+{
+    std::shared_ptr<const std::string> frame;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(latest_gen_ == taken_gen_) return;
+        taken_gen_ = latest_gen_;
+        frame = latest_;
+    }
+    for(Client& client : clients_)
+    {
+        if(client.frame)
+        {
+            // Still busy with the last one, this client's link can't keep up with the publish rate
+            client.skipped++;
+            continue;
+        }
+        client.frame = frame;
+        client.offset = 0;
+    }
+}
+
+bool MonitorServer::sendFrame(Client& client)
+{
+    const std::string& data = *client.frame;
+    ssize_t sent = send(client.fd, data.data() + client.offset, data.size() - client.offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if(sent < 0)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK) return true;
+        closeClient(client, strerror(errno));
+        return false;
+    }
+    client.offset += sent;
+    if(client.offset == data.size()) client.frame.reset();
+    return true;
+}
+
+bool MonitorServer::drainInput(Client& client)
+{
+    // Monitors are read-only, anything they send is thrown away
+    char scratch[256];
+    while(true)
+    {
+        ssize_t len = recv(client.fd, scratch, sizeof(scratch), MSG_DONTWAIT);
+        if(len > 0) continue;
+        if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        closeClient(client, len == 0 ? "closed" : strerror(errno));
+        return false;
+    }
+}
+
+void MonitorServer::closeClient(Client& client, const char* reason)
+{
+    PLOGI.printf("Monitor client disconnected (%s), skipped %u frames", reason, client.skipped);
+    close(client.fd);
+}
@@ -0,0 +1,55 @@
+#ifndef MonitorServer_h
+#define MonitorServer_h
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MonitorServerBase.h"
+
+class MonitorServer : public MonitorServerBase
+{
+  public:
+    MonitorServer(int port, int max_clients);
+    ~MonitorServer();
+
+    bool hasClients() override { return num_clients_ > 0; };
+    void publish(std::string frame) override;
+
+  private:
+
+    struct Client
+    {
+      int fd;
+      // Shared by every client it is sent to, null once fully sent
+      std::shared_ptr<const std::string> frame;
+      size_t offset;
+      uint32_t skipped;
+    };
+
+    void loop();
+    void acceptClients();
+    void takeLatestFrame();
+    // Returns false if the client has gone away
+    bool sendFrame(Client& client);
+    bool drainInput(Client& client);
+    void closeClient(Client& client, const char* reason);
+
+    int listen_fd_;
+    int wake_fd_;
+    int max_clients_;
+    std::vector<Client> clients_;
+    std::atomic<int> num_clients_;
+
+    std::mutex mutex_;
+    std::shared_ptr<const std::string> latest_;
+    uint64_t latest_gen_;
+    uint64_t taken_gen_;
+
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+#endif
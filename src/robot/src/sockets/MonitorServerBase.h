@@ -0,0 +1,18 @@
+#ifndef MonitorServerBase_h
+#define MonitorServerBase_h
+
+#include <string>
+
+// Read-only connections for dashboards and debugging tools, separate from the master's command link.
+// Every client gets the same status frames and anything they send is ignored.
+class MonitorServerBase
+{
+  public:
+    virtual ~MonitorServerBase() {};
+    virtual bool hasClients() = 0;
+    // Queues one frame for every client. A client still sending an earlier frame skips this one, so a slow
+    // client only ever sees fewer updates and never holds anything else up.
+    virtual void publish(std::string frame) = 0;
+};
+
+#endif
@@ -68,4 +68,24 @@ void ServerSocket::accept ( ServerSocket& sock )
 void ServerSocket::set_non_blocking()
 {
   Socket::set_non_blocking(true);
-}
\ No newline at end of file
+}
+
+int ServerSocket::wait ( const int wake_fd, const int timeout_ms, const int listen_fd ) const
+{
+  return Socket::wait ( wake_fd, timeout_ms, listen_fd );
+}
+
+bool ServerSocket::set_low_latency()
+{
+  return Socket::set_low_latency();
+}
+
+ssize_t ServerSocket::send_segments ( const char* first, size_t first_len, const char* second, size_t second_len ) const
+{
+  return Socket::send_segments ( first, first_len, second, second_len );
+}
+
+int ServerSocket::rtt_us() const
+{
+  return Socket::rtt_us();
+}
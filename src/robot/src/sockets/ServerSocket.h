@@ -21,6 +21,11 @@ class ServerSocket : private Socket
 
   void accept ( ServerSocket& );
   void set_non_blocking();
+  int wait ( const int wake_fd, const int timeout_ms, const int listen_fd = -1 ) const;
+  int fd() const { return Socket::fd(); }
+  bool set_low_latency();
+  ssize_t send_segments ( const char* first, size_t first_len, const char* second, size_t second_len ) const;
+  int rtt_us() const;
 
 };
 
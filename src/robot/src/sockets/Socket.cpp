@@ -6,12 +6,15 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <netinet/tcp.h>
 #include <iostream>
 
 
 
 Socket::Socket() :
-  m_sock ( -1 )
+  m_sock ( -1 ),
+  m_low_latency ( false )
 {
 
   memset ( &m_addr,
@@ -149,11 +152,60 @@ int Socket::recv ( std::string& s ) const
     }
   else
     {
-      s = buf;
+      // Quick ack mode drops back to delayed acks on its own, so it is turned on again after every read
+      if ( m_low_latency )
+        {
+          int on = 1;
+          setsockopt ( m_sock, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof ( on ) );
+        }
+      // Binary frames can contain zero bytes
+      s.assign ( buf, status );
       return status;
     }
 }
 
+ssize_t Socket::send_segments ( const char* first, size_t first_len, const char* second, size_t second_len ) const
+{
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<char*> ( first );
+  iov[0].iov_len = first_len;
+  iov[1].iov_base = const_cast<char*> ( second );
+  iov[1].iov_len = second_len;
+
+  struct msghdr msg;
+  memset ( &msg, 0, sizeof ( msg ) );
+  msg.msg_iov = iov;
+  msg.msg_iovlen = second_len > 0 ? 2 : 1;
+
+  // Same as writev, but sendmsg can take MSG_NOSIGNAL
+  ssize_t status = ::sendmsg ( m_sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT );
+  if ( status == -1 )
+    {
+      return ( errno == EAGAIN || errno == EWOULDBLOCK ) ? 0 : -1;
+    }
+  return status;
+}
+
+bool Socket::set_low_latency()
+{
+  // No Nagle delay on small writes and no delayed ack on reads
+  int on = 1;
+  m_low_latency = true;
+  return setsockopt ( m_sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof ( on ) ) == 0 &&
+         setsockopt ( m_sock, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof ( on ) ) == 0;
+}
+
+int Socket::rtt_us() const
+{
+  struct tcp_info info;
+  socklen_t len = sizeof ( info );
+  if ( getsockopt ( m_sock, IPPROTO_TCP, TCP_INFO, &info, &len ) == -1 )
+    {
+      return -1;
+    }
+  return info.tcpi_rtt;
+}
+
 
 
 bool Socket::connect ( const std::string host, const int port )
@@ -196,4 +248,37 @@ void Socket::set_non_blocking ( const bool b )
   fcntl ( m_sock,
 	  F_SETFL,opts );
 
-}
\ No newline at end of file
+}
+
+int Socket::wait ( const int wake_fd, const int timeout_ms, const int listen_fd ) const
+{
+  // Negative fds are ignored by poll
+  struct pollfd fds[3];
+  fds[0].fd = m_sock;
+  fds[0].events = POLLIN;
+  fds[0].revents = 0;
+  fds[1].fd = wake_fd;
+  fds[1].events = POLLIN;
+  fds[1].revents = 0;
+  fds[2].fd = listen_fd;
+  fds[2].events = POLLIN;
+  fds[2].revents = 0;
+
+  int status = ::poll ( fds, 3, timeout_ms );
+
+  if ( status == -1 )
+    {
+      return errno == EINTR ? 0 : -1;
+    }
+
+  int flags = 0;
+  // Hangups and errors are reported as readable so the following recv sees them
+  if ( fds[0].revents & ( POLLIN | POLLHUP | POLLERR ) )
+    flags |= SOCKET_READABLE;
+  if ( wake_fd >= 0 && ( fds[1].revents & POLLIN ) )
+    flags |= SOCKET_WOKEN;
+  if ( listen_fd >= 0 && ( fds[2].revents & POLLIN ) )
+    flags |= SOCKET_ACCEPTABLE;
+
+  return flags;
+}
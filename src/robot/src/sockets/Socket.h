@@ -17,6 +17,11 @@ const int MAXHOSTNAME = 200;
 const int MAXCONNECTIONS = 5;
 const int MAXRECV = 500;
 
+// Flags returned by Socket::wait
+const int SOCKET_READABLE = 0x1;
+const int SOCKET_WOKEN = 0x2;
+const int SOCKET_ACCEPTABLE = 0x4;
+
 class Socket
 {
  public:
@@ -36,15 +41,33 @@ class Socket
   bool send ( const std::string ) const;
   int recv ( std::string& ) const;
 
+  // Gathers both segments into one non-blocking write. Returns the bytes written, which may be fewer than
+  // asked for, 0 if the socket can't take anything right now or -1 on error.
+  ssize_t send_segments ( const char* first, size_t first_len, const char* second, size_t second_len ) const;
+
+  // Turns off Nagle and delayed acks for a connection that carries small latency sensitive messages
+  bool set_low_latency();
+
+  // Kernel's smoothed round trip time estimate for the connection, -1 if unavailable
+  int rtt_us() const;
+
 
   void set_non_blocking ( const bool );
 
+  // Sleep until the socket is readable, wake_fd is readable, a client is waiting on listen_fd, or timeout_ms
+  // passes (-1 waits forever). Returns a combination of SOCKET_READABLE, SOCKET_WOKEN and SOCKET_ACCEPTABLE,
+  // 0 on timeout or -1 on error.
+  int wait ( const int wake_fd, const int timeout_ms, const int listen_fd = -1 ) const;
+
   bool is_valid() const { return m_sock != -1; }
 
+  int fd() const { return m_sock; }
+
  private:
 
   int m_sock;
   sockaddr_in m_addr;
+  bool m_low_latency;
 
 
 };
@@ -1,55 +1,94 @@
 #include "SocketMultiThreadWrapper.h"
+#include "InputRecorder.h"
 
 #include <plog/Log.h>
 #include "sockets/ServerSocket.h"
 #include "sockets/SocketException.h"
 #include "sockets/SocketTimeoutException.h"
-#include <mutex>
+#include "constants.h"
+#include <chrono>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
 
 #define PORT 8123
-
-std::mutex read_mutex;
-std::mutex send_mutex;
+// Upper bound on how long the socket thread sleeps without any I/O events
+#define WAIT_TIMEOUT_MS 100
+// How often the socket thread checks whether the main thread has taken a new connection
+#define ACCEPT_POLL_MS 1
 
 SocketMultiThreadWrapper::SocketMultiThreadWrapper()
 : SocketMultiThreadWrapperBase(),
   data_buffer(),
-  send_buffer()
+  send_buffer(),
+  data_drop_count(0),
+  send_drop_count(0),
+  tcp_rtt_us(0),
+  wake_fd(eventfd(0, EFD_NONBLOCK)),
+  connection_id(0),
+  accepted_id(0),
+  idle_timeout_ms(cfg.lookup("session.idle_timeout_ms"))
 {
+    if(wake_fd < 0)
+    {
+        PLOGE.printf("Could not create eventfd, socket thread will only wake on timeout");
+    }
     run_thread = std::thread(&SocketMultiThreadWrapper::socket_loop, this);
     run_thread.detach();
 }
 
 bool SocketMultiThreadWrapper::dataAvailableToRead()
 {
-    std::lock_guard<std::mutex> read_lock(read_mutex);
-    return data_buffer.size() > 0;
+    return !data_buffer.empty();
 }
 
 std::string SocketMultiThreadWrapper::getData()
 {
-    std::string outstring;
-    const std::lock_guard<std::mutex> lock(read_mutex);
-    while(!data_buffer.empty())
-    {
-        outstring.push_back(data_buffer.front());
-        data_buffer.pop();
-    }
+    std::string outstring(data_buffer.size(), '\0');
+    size_t len = data_buffer.read(&outstring[0], outstring.size());
+    outstring.resize(len);
+    InputRecorder::recordSocket(outstring);
     return outstring;
 }
 
-void SocketMultiThreadWrapper::sendData(std::string data)
+bool SocketMultiThreadWrapper::sendData(std::string data)
 {
-    const std::lock_guard<std::mutex> lock(send_mutex);
-    if(send_buffer.size() + data.size() >= BUFFER_SIZE)
+    if(!send_buffer.write(data.data(), data.size()))
     {
-        PLOGE.printf("Send buffer overflow, dropping message: %s", data.c_str());
-        return;
+        send_drop_count++;
+        PLOGE.printf("Send buffer overflow, dropping %zu byte message", data.size());
+        return false;
     }
-    for(const char c : data)
+    if(wake_fd >= 0)
     {
-        send_buffer.push(c);
+        // Failure here only means the counter is already set, so the socket thread will still wake up
+        uint64_t one = 1;
+        ssize_t ret = write(wake_fd, &one, sizeof(one));
+        (void)ret;
     }
+    return true;
+}
+
+SocketBufferStats SocketMultiThreadWrapper::getBufferStats()
+{
+    SocketBufferStats stats;
+    stats.read_fill = data_buffer.size();
+    stats.send_fill = send_buffer.size();
+    stats.capacity = BUFFER_SIZE;
+    stats.read_drops = data_drop_count;
+    stats.send_drops = send_drop_count;
+    stats.tcp_rtt_ms = tcp_rtt_us / 1000.0f;
+    return stats;
+}
+
+uint32_t SocketMultiThreadWrapper::getConnectionId()
+{
+    return connection_id.load(std::memory_order_acquire);
+}
+
+void SocketMultiThreadWrapper::acceptConnection(uint32_t id)
+{
+    accepted_id.store(id, std::memory_order_release);
 }
 
 void SocketMultiThreadWrapper::socket_loop()
@@ -63,59 +102,109 @@ void SocketMultiThreadWrapper::socket_loop()
         ServerSocket socket;
         server.accept(socket);
         socket.set_non_blocking();
+        if(!socket.set_low_latency())
+        {
+            PLOGW.printf("Could not set low latency socket options");
+        }
         bool keep_connection = true;
-        PLOGI.printf("Client connected");
+        bool send_blocked = false;
+
+        // Nothing is read from the new client until the main thread has finished with the old one, and
+        // replies queued for the old one are dropped once it has
+        const uint32_t id = connection_id.load(std::memory_order_relaxed) + 1;
+        connection_id.store(id, std::memory_order_release);
+        while(accepted_id.load(std::memory_order_acquire) != id)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_POLL_MS));
+        }
+        send_buffer.consume(send_buffer.size());
+        PLOGI.printf("Client connected, connection %u", id);
+        auto last_rx_time = std::chrono::steady_clock::now();
 
         // Stay connected to the client while the connection is valid
         while(keep_connection)
         {
-            // Try to read data from the client
-            std::string read_data;
-            try
+            // Sleep until the client sends something or there is new data to send. If the kernel
+            // couldn't take everything last time, check back soon instead of waiting on a wakeup.
+            int events = socket.wait(wake_fd, send_blocked ? 1 : WAIT_TIMEOUT_MS, server.fd());
+            if(events < 0)
             {
-                socket >> read_data;
+                PLOGE.printf("Error waiting on socket, disconnecting");
+                keep_connection = false;
+                continue;
             }
-            catch (SocketTimeoutException &e) {}
-            catch (SocketException& e)
+            if(events & SOCKET_ACCEPTABLE)
             {
-                //PLOGI.printf("Caught exception while reading: %s", e.description().c_str());
-                // If read fails for something other than timeout, disconnect
+                // Master only reconnects when it has given up on this connection, which may not be dead on
+                // this side yet. The newest client always wins.
+                PLOGI.printf("New client waiting, dropping connection %u", id);
                 keep_connection = false;
                 continue;
             }
+            if(events & SOCKET_WOKEN)
+            {
+                // Clear the wakeup counter, the send buffer is drained below
+                uint64_t count;
+                ssize_t ret = read(wake_fd, &count, sizeof(count));
+                (void)ret;
+            }
 
+            // Try to read data from the client
+            std::string read_data;
+            if(events & SOCKET_READABLE)
             {
-                // Copy data into buffer for output if we got info from the client
-                std::lock_guard<std::mutex> read_lock(read_mutex);
-                if(data_buffer.size() + read_data.size() >= BUFFER_SIZE)
+                try
                 {
-                    PLOGE.printf("Data buffer overflow, dropping message");
+                    socket >> read_data;
                 }
-                else
+                catch (SocketTimeoutException &e) {}
+                catch (SocketException& e)
                 {
-                    for (uint i = 0; i < read_data.size(); i++)
-                    {
-                        //PLOGD << std::hex << std::to_integer<int>(read_buff[i]) << std::dec << ' ';
-                        data_buffer.push(read_data[i]);
-                    }
+                    //PLOGI.printf("Caught exception while reading: %s", e.description().c_str());
+                    // If read fails for something other than timeout, disconnect
+                    keep_connection = false;
+                    continue;
                 }
             }
 
+            // Copy data into buffer for output if we got info from the client
+            if(!read_data.empty() && !data_buffer.write(read_data.data(), read_data.size()))
+            {
+                data_drop_count++;
+                PLOGE.printf("Data buffer overflow, dropping message");
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if(!read_data.empty())
+            {
+                last_rx_time = now;
+            }
+            else if(idle_timeout_ms > 0 && now - last_rx_time > std::chrono::milliseconds(idle_timeout_ms))
+            {
+                // Master polls far more often than this, a silent link is most likely gone
+                PLOGW.printf("Nothing from client for %d ms, disconnecting", idle_timeout_ms);
+                keep_connection = false;
+                continue;
+            }
+
+            // Everything waiting goes out in one gathered write straight from the ring buffer
+            const char* first;
+            const char* second;
+            size_t first_len;
+            size_t second_len;
+            size_t send_len = send_buffer.peek(&first, &first_len, &second, &second_len);
+            send_blocked = false;
+            if(send_len > 0)
             {
-                // If we have data ready to be sent, send it
-                std::lock_guard<std::mutex> send_lock(send_mutex);
-                if(send_buffer.size() > 0)
+                PLOGD.printf("Length to send: %zu", send_len);
+                ssize_t sent = socket.send_segments(first, first_len, second, second_len);
+                if(sent < 0)
                 {
-                    PLOGD.printf("Length to send: %i", send_buffer.size());
-                    std::string send_data;
-                    while(!send_buffer.empty())
-                    {
-                        send_data.push_back(send_buffer.front());
-                        send_buffer.pop();
-                    }
-                    socket << send_data;
+                    keep_connection = false;
+                    continue;
                 }
-
+                send_buffer.consume(sent);
+                send_blocked = static_cast<size_t>(sent) < send_len;
+                tcp_rtt_us = socket.rtt_us();
             }
         }
 
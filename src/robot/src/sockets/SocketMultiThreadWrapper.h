@@ -1,11 +1,15 @@
 #ifndef SocketMultiThreadWrapper_h
 #define SocketMultiThreadWrapper_h
 
-#include <queue>
+#include <atomic>
 #include <thread>
 #include "SocketMultiThreadWrapperBase.h"
+#include "SpscByteRingBuffer.h"
 
 #define BUFFER_SIZE 2048
+// Replies are bigger than commands, this holds a few of the largest while the client catches up
+#define SEND_BUFFER_SIZE 32768
+static_assert(SEND_BUFFER_SIZE >= 2 * MAX_SEND_FRAME_SIZE, "Send buffer must hold at least two of the largest frames");
 
 class SocketMultiThreadWrapper : public SocketMultiThreadWrapperBase
 {
@@ -13,19 +17,35 @@ class SocketMultiThreadWrapper : public SocketMultiThreadWrapperBase
   public:
     SocketMultiThreadWrapper();
     std::string getData();
-    void sendData(std::string data);
+    bool sendData(std::string data);
     bool dataAvailableToRead();
+    SocketBufferStats getBufferStats();
+    uint32_t getConnectionId();
+    void acceptConnection(uint32_t id);
 
   private:
     
     void socket_loop();
 
-    std::queue<char> data_buffer;
-    std::queue<char> send_buffer;
+    // Each buffer has exactly one producer and one consumer thread, so no locking is needed
+    SpscByteRingBuffer<BUFFER_SIZE> data_buffer;
+    SpscByteRingBuffer<SEND_BUFFER_SIZE> send_buffer;
+    std::atomic<uint32_t> data_drop_count;
+    std::atomic<uint32_t> send_drop_count;
+    // Sampled by the socket thread after each send
+    std::atomic<int> tcp_rtt_us;
+    // eventfd used to wake the socket thread when there is new data to send
+    int wake_fd;
+    // Bumped by the socket thread for each client, echoed back by the main thread once it has dropped
+    // everything left over from the previous one
+    std::atomic<uint32_t> connection_id;
+    std::atomic<uint32_t> accepted_id;
+    // Drop a client that has sent nothing for this long, 0 waits for TCP to notice
+    int idle_timeout_ms;
     std::thread run_thread;
 
 };
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -2,16 +2,27 @@
 #define SocketMultiThreadWrapperBase_h
 
 #include <string>
+#include "utils.h"
+
+// Longest frame sendData has to take in one piece. A full JSON status is about 4 KB, a plan reply is capped to fit.
+#define MAX_SEND_FRAME_SIZE 8192
 
 class SocketMultiThreadWrapperBase
 {
   public:
     virtual ~SocketMultiThreadWrapperBase() {};
     virtual std::string getData() = 0;
-    virtual void sendData(std::string data) = 0;
+    // Queues data to go out whole, returns false if it was dropped because there wasn't room for all of it
+    virtual bool sendData(std::string data) = 0;
     virtual bool dataAvailableToRead() = 0;
+    virtual SocketBufferStats getBufferStats() { return SocketBufferStats(); };
+
+    // Goes up each time a client connects. The socket thread doesn't read from the new client until
+    // acceptConnection is called with its id, so everything read before that came from the old one.
+    virtual uint32_t getConnectionId() { return 0; };
+    virtual void acceptConnection(uint32_t id) { (void) id; };
 };
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,11 @@
 #include "SocketMultiThreadWrapperFactory.h"
 #include "SocketMultiThreadWrapper.h"
 #include "MockSocketMultiThreadWrapper.h"
+#include "UdpChannel.h"
+#include "MockUdpChannel.h"
+#include "MonitorServer.h"
+#include "MockMonitorServer.h"
+#include "constants.h"
 
 #include <plog/Log.h> 
 
@@ -61,6 +66,46 @@ SocketMultiThreadWrapperBase* SocketMultiThreadWrapperFactory::get_socket()
     return socket_.get();
 }
 
+UdpChannelBase* SocketMultiThreadWrapperFactory::get_udp_channel()
+{
+    if(udp_channel_)
+    {
+        return udp_channel_.get();
+    }
+
+    if(mode_ == SOCKET_FACTORY_MODE::STANDARD)
+    {
+        udp_channel_ = std::make_unique<UdpChannel> (cfg.lookup("udp.port"));
+        PLOGI << "Built UdpChannel";
+    }
+    else if (mode_ == SOCKET_FACTORY_MODE::MOCK)
+    {
+        udp_channel_ = std::make_unique<MockUdpChannel> ();
+        PLOGI << "Built MockUdpChannel";
+    }
+    return udp_channel_.get();
+}
+
+MonitorServerBase* SocketMultiThreadWrapperFactory::get_monitor_server()
+{
+    if(monitor_server_)
+    {
+        return monitor_server_.get();
+    }
+
+    if(mode_ == SOCKET_FACTORY_MODE::STANDARD)
+    {
+        monitor_server_ = std::make_unique<MonitorServer> (cfg.lookup("monitor.port"), cfg.lookup("monitor.max_clients"));
+        PLOGI << "Built MonitorServer";
+    }
+    else if (mode_ == SOCKET_FACTORY_MODE::MOCK)
+    {
+        monitor_server_ = std::make_unique<MockMonitorServer> ();
+        PLOGI << "Built MockMonitorServer";
+    }
+    return monitor_server_.get();
+}
+
 
 // Private constructor
 SocketMultiThreadWrapperFactory::SocketMultiThreadWrapperFactory()
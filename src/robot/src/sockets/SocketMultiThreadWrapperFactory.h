@@ -4,6 +4,8 @@
 #include <memory>
 
 #include "SocketMultiThreadWrapperBase.h"
+#include "UdpChannelBase.h"
+#include "MonitorServerBase.h"
 
 enum class SOCKET_FACTORY_MODE
 {
@@ -26,6 +28,12 @@ class SocketMultiThreadWrapperFactory
 
     SocketMultiThreadWrapperBase* get_socket();
 
+    // Side channel bound to udp.port, built on first use in the same mode as the socket
+    UdpChannelBase* get_udp_channel();
+
+    // Read-only status connections on monitor.port, built on first use in the same mode as the socket
+    MonitorServerBase* get_monitor_server();
+
     // Delete copy and assignment constructors
     SocketMultiThreadWrapperFactory(SocketMultiThreadWrapperFactory const&) = delete;
     SocketMultiThreadWrapperFactory& operator= (SocketMultiThreadWrapperFactory const&) = delete;
@@ -39,7 +47,8 @@ class SocketMultiThreadWrapperFactory
 
     SOCKET_FACTORY_MODE mode_;
     std::unique_ptr<SocketMultiThreadWrapperBase> socket_;
-    
+    std::unique_ptr<UdpChannelBase> udp_channel_;
+    std::unique_ptr<MonitorServerBase> monitor_server_;
 
 };
 
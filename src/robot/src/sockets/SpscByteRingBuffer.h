@@ -0,0 +1,97 @@
+#ifndef SpscByteRingBuffer_h
+#define SpscByteRingBuffer_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+// Fixed capacity single-producer/single-consumer byte ring buffer. One thread may call write()
+// while another calls read() without any locking. Reads and writes are done in bulk with at most
+// two memcpy calls each, so there is no per-byte overhead or allocation.
+template <size_t N>
+class SpscByteRingBuffer
+{
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscByteRingBuffer capacity must be a power of 2");
+
+  public:
+    SpscByteRingBuffer()
+    : head_(0),
+      tail_(0)
+    {}
+
+    // Producer side. Writes all len bytes or nothing (so framed messages are never split) and
+    // returns false if there was not enough room.
+    bool write(const char* data, size_t len)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        if(len > N - (head - tail))
+        {
+            return false;
+        }
+
+        const size_t start = head & (N - 1);
+        const size_t first = len < N - start ? len : N - start;
+        std::memcpy(buf_ + start, data, first);
+        std::memcpy(buf_, data + first, len - first);
+        head_.store(head + len, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Copies up to max_len bytes into out and returns the number of bytes copied.
+    size_t read(char* out, size_t max_len)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t available = head - tail;
+        const size_t len = available < max_len ? available : max_len;
+
+        const size_t start = tail & (N - 1);
+        const size_t first = len < N - start ? len : N - start;
+        std::memcpy(out, buf_ + start, first);
+        std::memcpy(out + first, buf_, len - first);
+        tail_.store(tail + len, std::memory_order_release);
+        return len;
+    }
+
+    // Consumer side. Points first and second at everything stored, second is only used when the data wraps
+    // around the end of the buffer. Nothing is removed until consume() is called.
+    size_t peek(const char** first, size_t* first_len, const char** second, size_t* second_len) const
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t len = head_.load(std::memory_order_acquire) - tail;
+        const size_t start = tail & (N - 1);
+        *first = buf_ + start;
+        *first_len = len < N - start ? len : N - start;
+        *second = buf_;
+        *second_len = len - *first_len;
+        return len;
+    }
+
+    // Consumer side. Drops len bytes after a peek, len must not be more than peek returned.
+    void consume(size_t len)
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    // Number of bytes currently stored. Exact when called from either the producer or consumer thread,
+    // a snapshot otherwise.
+    size_t size() const
+    {
+        // Load tail first so a concurrent read can never make the result negative
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return head_.load(std::memory_order_acquire) - tail;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    static constexpr size_t capacity() { return N; }
+
+  private:
+    // Indices increase monotonically and are masked on access, so the full capacity is usable
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+    char buf_[N];
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "UdpChannel.h"
+#include "InputRecorder.h"
+
+#include <plog/Log.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// Largest datagram read, anything longer is truncated and will fail to parse
+#define MAX_DATAGRAM_SIZE 512
+
+UdpChannel::UdpChannel(int port)
+: UdpChannelBase(),
+  fd_(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)),
+  have_peer_(false),
+  peer_()
+{
+    if(fd_ < 0)
+    {
+        PLOGE.printf("Could not create UDP socket: %s", strerror(errno));
+        return;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if(bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        PLOGE.printf("Could not bind UDP port %d: %s", port, strerror(errno));
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    PLOGI.printf("Listening for UDP on port %d", port);
+}
+
+UdpChannel::~UdpChannel()
+{
+    if(fd_ >= 0) close(fd_);
+}
+
+bool UdpChannel::receive(std::string* datagram)
+{
+    if(fd_ < 0) return false;
+    char buffer[MAX_DATAGRAM_SIZE];
+    sockaddr_in from = {};
+    socklen_t from_len = sizeof(from);
+    ssize_t len = recvfrom(fd_, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+    if(len < 0)
+    {
+        if(errno != EAGAIN && errno != EWOULDBLOCK) PLOGW.printf("UDP receive failed: %s", strerror(errno));
+        return false;
+    }
+    datagram->assign(buffer, len);
+    InputRecorder::recordUdp(*datagram);
+    peer_ = from;
+    have_peer_ = true;
+    return true;
+}
+
+void UdpChannel::send(const std::string& datagram)
+{
+    if(fd_ < 0 || !have_peer_) return;
+    // Nothing is queued here, a datagram the kernel can't take right now is stale by the time it could
+    ssize_t ret = sendto(fd_, datagram.data(), datagram.size(), MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&peer_), sizeof(peer_));
+    if(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        PLOGW.printf("UDP send failed: %s", strerror(errno));
+    }
+}
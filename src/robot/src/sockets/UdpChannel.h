@@ -0,0 +1,24 @@
+#ifndef UdpChannel_h
+#define UdpChannel_h
+
+#include <netinet/in.h>
+
+#include "UdpChannelBase.h"
+
+class UdpChannel : public UdpChannelBase
+{
+  public:
+    UdpChannel(int port);
+    ~UdpChannel();
+
+    bool receive(std::string* datagram) override;
+    void send(const std::string& datagram) override;
+    bool hasPeer() override { return have_peer_; };
+
+  private:
+    int fd_;
+    bool have_peer_;
+    sockaddr_in peer_;
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef UdpChannelBase_h
+#define UdpChannelBase_h
+
+#include <string>
+
+// Connectionless side channel for traffic where only the newest value matters. Nothing is retransmitted,
+// so a lost datagram never holds up anything behind it the way it does on the TCP stream.
+class UdpChannelBase
+{
+  public:
+    virtual ~UdpChannelBase() {};
+    // Never blocks, returns false when nothing is waiting. The sender becomes the peer for send().
+    virtual bool receive(std::string* datagram) = 0;
+    // Sends to whoever the last datagram came from, dropped if nothing has been received yet
+    virtual void send(const std::string& datagram) = 0;
+    virtual bool hasPeer() = 0;
+};
+
+#endif
@@ -1,7 +1,9 @@
 #define _USE_MATH_DEFINES
  
 #include "utils.h"
+#include "Se2.h"
 
+#include <algorithm>
 #include <cmath>
 #include <chrono>
 #include <plog/Log.h>
@@ -9,23 +11,11 @@
 #include <stdio.h>
 #include <sstream>
 #include <plog/Init.h>
-#include <plog/Formatters/CsvFormatter.h>
-#include <plog/Appenders/RollingFileAppender.h>
+#include "AsyncLogAppender.h"
 
 float wrap_angle(float a)
 {
-  while(std::abs(a) > M_PI)
-  {
-    if(a > M_PI)
-    {
-      a -= 2*M_PI;
-    }
-    else if (a < -1*M_PI)
-    {
-      a += 2*M_PI;
-    }
-  }
-  return a;
+  return wrapAngle(a);
 }
 
 float angle_diff(float a1, float a2)
@@ -39,51 +29,54 @@ float angle_diff(float a1, float a2)
 RateController::RateController(int hz)
 : timer_(),
   dt_us_(1000000 / hz),
-  always_ready_(cfg.lookup("motion.rate_always_ready"))
+  always_ready_(cfg.lookup("motion.rate_always_ready")),
+  overruns_(0)
 {
 }
 
 bool RateController::ready()
 {
-  if(always_ready_ || timer_.dt_us() > dt_us_)
+  if(always_ready_)
+  {
+    return true;
+  }
+  int dt_us = timer_.dt_us();
+  if(dt_us >= dt_us_)
   {
+    if(dt_us >= 2 * dt_us_) 
+    {
+      overruns_++;
+    }
     timer_.reset();
     return true;
   }
   return false;
 }
 
+ClockTimePoint RateController::nextReadyTime()
+{
+  if(always_ready_)
+  {
+    return ClockFactory::getFactoryInstance()->get_clock()->now();
+  }
+  return timer_.getStartTime() + std::chrono::microseconds(dt_us_);
+}
+
 
-TimeRunningAverage::TimeRunningAverage(int window_size)
-: buf_(),
-  buf_idx_(0),
-  window_size_(window_size),
-  filled_(false),
+TimeRunningAverage::TimeRunningAverage(int window_size, int hist_max_ms)
+: stats_(window_size, 0, hist_max_ms),
   started_(false),
   timer_()
 {
-    buf_.reserve(window_size_);
+    if (window_size > TIME_RUNNING_AVERAGE_MAX_WINDOW)
+    {
+        PLOGW.printf("TimeRunningAverage window %i is larger than the max of %i", window_size, TIME_RUNNING_AVERAGE_MAX_WINDOW);
+    }
 }
 
 int TimeRunningAverage::get_ms()
 {
-    int sum_end_idx = buf_idx_;
-    if(filled_)
-    {
-        sum_end_idx = window_size_;
-    }
-
-    if (sum_end_idx == 0)
-    {
-        return 0;
-    }
-
-    int sum = 0;
-    for(int i = 0; i < sum_end_idx; i++)
-    {
-        sum += buf_[i];
-    }
-    return sum / sum_end_idx;
+    return static_cast<int>(stats_.mean());
 }
 
 float TimeRunningAverage::get_sec()
@@ -101,15 +94,8 @@ void TimeRunningAverage::mark_point()
         return;
     }
 
-    buf_[buf_idx_] = timer_.dt_ms();
+    stats_.add(timer_.dt_ms());
     timer_.reset();
-
-    buf_idx_++;
-    if (buf_idx_ >= window_size_)
-    {
-        filled_ = true;
-        buf_idx_ = 0;
-    }
 }
 
 
@@ -147,6 +133,16 @@ ClockTimePoint ClockWrapper::now()
     return std::chrono::steady_clock::now();
 }
 
+double clockToSeconds(ClockTimePoint time)
+{
+    return std::chrono::duration<double>(time.time_since_epoch()).count();
+}
+
+ClockTimePoint secondsToClock(double seconds)
+{
+    return ClockTimePoint(std::chrono::duration_cast<ClockTimePoint::duration>(std::chrono::duration<double>(seconds)));
+}
+
 
 MockClockWrapper::MockClockWrapper()
 : ClockWrapperBase(),
@@ -232,6 +228,10 @@ ClockFactory::ClockFactory()
 {}
 
 
+PositionController::PositionController() 
+: PositionController(Gains{0,0,0})
+{ }
+
 PositionController::PositionController(Gains gains) 
 : gains_(gains),
   error_sum_(0.0)
@@ -242,15 +242,108 @@ void PositionController::reset()
     error_sum_ = 0.0;
 }
 
-float PositionController::compute(float target_position, float actual_position, float target_velocity, float actual_velocity, float dt)
+float PositionController::compute(float target_position, float actual_position, float target_velocity, float actual_velocity, float dt,
+                                  float target_acceleration)
 {
+    const float scale = phaseScale(phase(target_velocity, target_acceleration));
+    const float ki = scale * gains_.ki;
     float pos_err = target_position - actual_position;
     float vel_err = target_velocity - actual_velocity;
     error_sum_ += pos_err * dt;
-    float output_velocity = target_velocity + gains_.kp * pos_err + gains_.kd * vel_err + gains_.ki * error_sum_;
+    // Clamping the sum instead of the output lets the integral unwind as soon as the error changes sign
+    if(gains_.max_integral > 0 && ki > 0)
+    {
+        const float max_sum = gains_.max_integral / ki;
+        error_sum_ = std::max(-max_sum, std::min(max_sum, error_sum_));
+    }
+    float output_velocity = target_velocity + gains_.ka * target_acceleration + scale * gains_.kp * pos_err + 
+                            scale * gains_.kd * vel_err + ki * error_sum_;
     return output_velocity;
 }
 
+PositionController::Phase PositionController::phase(float target_velocity, float target_acceleration)
+{
+    const float eps = 1e-3;
+    if(fabs(target_acceleration) < eps)
+    {
+        return fabs(target_velocity) < eps ? Phase::SETTLE : Phase::CRUISE;
+    }
+    return target_acceleration * target_velocity >= 0 ? Phase::ACCEL : Phase::DECEL;
+}
+
+float PositionController::phaseScale(Phase phase) const
+{
+    switch (phase)
+    {
+        case Phase::ACCEL:
+            return gains_.scale_accel;
+        case Phase::CRUISE:
+            return gains_.scale_cruise;
+        case Phase::DECEL:
+            return gains_.scale_decel;
+        default:
+            return gains_.scale_settle;
+    }
+}
+
+SettleDetector::SettleDetector()
+: params_({0, 0, 0}),
+  stopped_since_(-1),
+  in_tol_since_(-1),
+  confident_since_(-1),
+  last_trans_vel_(0),
+  last_ang_vel_(0),
+  settle_time_(-1)
+{ }
+
+void SettleDetector::start(Params params)
+{
+    params_ = params;
+    stopped_since_ = -1;
+    in_tol_since_ = -1;
+    confident_since_ = -1;
+    last_trans_vel_ = 0;
+    last_ang_vel_ = 0;
+    settle_time_ = -1;
+}
+
+bool SettleDetector::update(const Sample& sample, const TrajectoryTolerances& tol, float time)
+{
+    if(!sample.target_stopped)
+    {
+        stopped_since_ = -1;
+        in_tol_since_ = -1;
+        confident_since_ = -1;
+        last_trans_vel_ = sample.trans_vel;
+        last_ang_vel_ = sample.ang_vel;
+        return false;
+    }
+    if(stopped_since_ < 0) stopped_since_ = time;
+
+    const bool in_tol = sample.trans_err < tol.trans_pos_err && sample.ang_err < tol.ang_pos_err &&
+                        sample.trans_vel < tol.trans_vel_err && sample.ang_vel < tol.ang_vel_err;
+
+    // Slowing down, or slow enough that it can't drift far before the next check
+    const bool trans_slowing = sample.trans_vel <= last_trans_vel_ || sample.trans_vel < 0.5f * tol.trans_vel_err;
+    const bool ang_slowing = sample.ang_vel <= last_ang_vel_ || sample.ang_vel < 0.5f * tol.ang_vel_err;
+    const float k = params_.confidence_sigma;
+    const bool confident = in_tol && trans_slowing && ang_slowing &&
+                           sample.trans_err + k * sample.trans_std < tol.trans_pos_err &&
+                           sample.ang_err + k * sample.ang_std < tol.ang_pos_err;
+    last_trans_vel_ = sample.trans_vel;
+    last_ang_vel_ = sample.ang_vel;
+
+    if(!in_tol) in_tol_since_ = -1;
+    else if(in_tol_since_ < 0) in_tol_since_ = time;
+    if(!confident) confident_since_ = -1;
+    else if(confident_since_ < 0) confident_since_ = time;
+
+    const bool settled = (in_tol && time - in_tol_since_ >= params_.dwell) ||
+                         (confident && time - confident_since_ >= params_.confident_dwell);
+    if(settled && settle_time_ < 0) settle_time_ = time - stopped_since_;
+    return settled;
+}
+
 
 float vectorMean(const std::vector<float>& data)
 {
@@ -313,17 +406,22 @@ std::vector<float> parseCommaDelimitedStringToFloat(const std::string& str_in)
 
 
 
-void reset_last_motion_logger()
+namespace
 {
-    // Delete the loggers
-    g_logger.reset();
-    g_appender.reset();
+    std::unique_ptr<AsyncLogAppender> g_appender;
+    std::unique_ptr<plog::Logger<MOTION_CSV_LOG_ID>> g_logger;
+}
 
-    // Delete the file
-    remove("log/last_motion_log.csv");
+void reset_last_motion_logger()
+{
+    if(!g_appender)
+    {
+        int queue_size = cfg.lookup("logging.queue_size");
+        g_appender.reset(new AsyncLogAppender("log/last_motion_log.csv", LOG_FORMAT::CSV, queue_size));
+        g_logger.reset(new plog::Logger<MOTION_CSV_LOG_ID>(plog::debug));
+        g_logger->addAppender(g_appender.get());
+    }
 
-    // Re-initialize the logger
-    g_appender.reset(new plog::RollingFileAppender<plog::CsvFormatter>("log/last_motion_log.csv"));
-    g_logger.reset(new plog::Logger<MOTION_CSV_LOG_ID>(plog::debug));
-    g_logger->addAppender(g_appender.get());
+    // Starts the file over on the writer thread, so this is safe to call from the control loop
+    g_appender->rotate();
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <plog/Logger.h> 
 
 #include "constants.h"
+#include "WindowedStats.h"
 
 using ClockTimePoint = std::chrono::time_point<std::chrono::steady_clock>;
 using FpSeconds = std::chrono::duration<float, std::chrono::seconds::period>;
@@ -89,6 +90,10 @@ class ClockFactory
   std::unique_ptr<ClockWrapperBase> clock_instance_;
 };
 
+// Clock times as seconds since the clock epoch, used to exchange timestamps with master
+double clockToSeconds(ClockTimePoint time);
+ClockTimePoint secondsToClock(double seconds);
+
 
 // Simple timer class that can return the time since reset in various formats
 class Timer
@@ -99,6 +104,7 @@ class Timer
     int dt_us();
     int dt_ms();
     float dt_s();
+    ClockTimePoint getStartTime() const { return prev_time_; };
 
   private:
     ClockTimePoint prev_time_;
@@ -106,10 +112,14 @@ class Timer
 
 
 // Keeps an average of how long the time delta is between events
+// Interval statistics between calls to mark_point over the last window_size intervals (at most
+// TIME_RUNNING_AVERAGE_MAX_WINDOW), in ms. Quantiles are resolved over 0 to hist_max_ms.
 class TimeRunningAverage
 {
   public:
-    TimeRunningAverage(int window_size);
+    using Stats = WindowedStats<int, TIME_RUNNING_AVERAGE_MAX_WINDOW>;
+
+    TimeRunningAverage(int window_size, int hist_max_ms = 100);
 
     int get_ms();
 
@@ -117,12 +127,11 @@ class TimeRunningAverage
 
     void mark_point();
 
+    const Stats& get_stats() const { return stats_; };
+
   private:
 
-    std::vector<int> buf_;
-    int buf_idx_;
-    int window_size_;
-    bool filled_;
+    Stats stats_;
     bool started_;
     Timer timer_;
 
@@ -134,10 +143,19 @@ class RateController
   public:
     RateController(int hz);
     bool ready(); 
+    // Time at which ready() will next return true
+    ClockTimePoint nextReadyTime();
+    // Number of times ready() fired a full period or more late
+    uint32_t getOverruns() const { return overruns_; };
+    // Starts the period over from now, for when the task it gates had to run early
+    void restart() { timer_.reset(); };
+    // Keeps the overrun count and the time of the last period
+    void setRate(int hz) { dt_us_ = 1000000 / hz; };
   private:
     Timer timer_;
     int dt_us_;
     bool always_ready_;
+    uint32_t overruns_;
 };
 
 
@@ -297,6 +315,11 @@ class CircularBuffer
     }
 
     bool isFull() const { return full_;}
+
+    int size() const { return static_cast<int>(data_->size()); }
+
+    // i-th oldest value, reads in place instead of copying like get_contents
+    const T& at(int i) const { return (*data_)[full_ ? (idx_ + i) % size_ : i]; }
     
   private:
     std::unique_ptr<std::vector<T>> data_;
@@ -316,22 +339,101 @@ class PositionController
         float kp;
         float ki;
         float kd;    
+        float ka = 0;               // s of target acceleration fed forward, makes up for the drive lagging the command
+        float max_integral = 0;     // Most the integral term can add to the command, 0 for no limit
+        // kp, ki and kd are scaled by these depending on what the target is doing, see Phase
+        float scale_accel = 1;
+        float scale_cruise = 1;
+        float scale_decel = 1;
+        float scale_settle = 1;
     };
 
-    PositionController(Gains gains = {0,0,0});
+    enum class Phase
+    {
+        ACCEL,      // Target speeding up, including starting from rest
+        CRUISE,     // Target moving at a steady speed
+        DECEL,      // Target slowing down
+        SETTLE,     // Target at rest, before the move starts or once it has ended
+    };
+
+    PositionController();
+
+    PositionController(Gains gains);
 
     // Resets error sum to avoid integral windup
     void reset();
 
-    // Compute control velocity for target position with feedforward velocity
-    float compute(float target_position, float actual_position, float target_velocity, float actual_velocity, float dt);
+    // Compute control velocity for target position with feedforward velocity and acceleration
+    float compute(float target_position, float actual_position, float target_velocity, float actual_velocity, float dt,
+                  float target_acceleration = 0);
+
+    static Phase phase(float target_velocity, float target_acceleration);
 
   private:
 
+    float phaseScale(Phase phase) const;
+
     Gains gains_;
     float error_sum_;
 };
 
+struct TrajectoryTolerances
+{
+    float trans_pos_err;
+    float ang_pos_err;
+    float trans_vel_err;
+    float ang_vel_err;
+};
+
+// Decides when a move has come to rest at its goal. The plain test is the goal tolerance holding for a fixed
+// dwell after the trajectory ends. While the estimate is inside the tolerance by confidence_sigma of its own
+// uncertainty and the speed isn't climbing, the shorter confident dwell is enough.
+class SettleDetector
+{
+  public:
+
+    struct Params
+    {
+        float dwell;            // s
+        float confident_dwell;  // s
+        float confidence_sigma;
+    };
+
+    struct Sample
+    {
+        bool target_stopped;    // The trajectory has reached its end
+        float trans_err;        // Distance from the goal
+        float ang_err;
+        float trans_vel;        // Speed
+        float ang_vel;
+        float trans_std;        // Standard deviation of the position estimate, 0 if it isn't known
+        float ang_std;
+    };
+
+    SettleDetector();
+
+    // Called when a move starts
+    void start(Params params);
+
+    // time is s since the move started, true once the move has settled
+    bool update(const Sample& sample, const TrajectoryTolerances& tol, float time);
+
+    bool inTolerance() const { return in_tol_since_ >= 0; };
+
+    // s from the end of the trajectory to settling, negative until the move has settled
+    float settleTime() const { return settle_time_; };
+
+  private:
+
+    Params params_;
+    float stopped_since_;
+    float in_tol_since_;
+    float confident_since_;
+    float last_trans_vel_;
+    float last_ang_vel_;
+    float settle_time_;
+};
+
 struct LocalizationMetrics 
 {
     float last_position_uncertainty;
@@ -339,10 +441,35 @@ struct LocalizationMetrics
     float confidence_y;
     float confidence_a;
     float total_confidence;
+    float last_nis;                         // Innovation distance of the last position reading, see localization.gating
+    uint32_t rejected_readings;             // Position readings the gate has dropped since startup
+    uint32_t consecutive_rejections;        // Readings dropped since the last one accepted
+    uint32_t reacquisitions;                // Times the estimate was reset to readings that kept being rejected
+};
+
+// Per camera state for the vision tracker, in vision_tracker.cameras order
+struct CameraHealth
+{
+    bool ok = false;                        // Filtered detection state
+    bool used = false;                      // Contributed to the last pose
+    float u = 0;
+    float v = 0;
+    float x = 0;                            // Marker position in the robot frame
+    float y = 0;
+    float residual = 0;                     // Distance (m) between where the last pose puts the marker and its target
+    uint32_t detections = 0;                // Frames where the marker was found
+    uint32_t poses = 0;                     // Poses this camera contributed to
+    uint32_t buffer_allocations = 0;
+    float latency_ms = 0;                   // Capture to detection output for the last detection
+    bool paused = false;                    // Not being run to save CPU, see VISION_DEGRADE
 };
 
 struct CameraDebug
 {
+    int num_cameras = 0;
+    CameraHealth cameras[MAX_CAMERAS];
+    int cameras_used = 0;                   // Cameras in the last pose solve
+    // Copies of the side and rear camera state, if configured
     bool side_ok = false;
     bool rear_ok = false;
     bool both_ok = false;
@@ -358,6 +485,61 @@ struct CameraDebug
     float pose_y;
     float pose_a;
     int loop_ms = 0;
+    uint32_t side_buffer_allocations = 0;   // Working buffer allocations per pipeline, steady state should not grow
+    uint32_t rear_buffer_allocations = 0;
+    uint32_t rejected_pairs = 0;            // Detections from both cameras that were too far apart in time to pair
+    int pair_skew_ms = 0;
+    float vision_cpu_cores = 0;             // CPU used by the camera pipelines between poses
+    uint32_t throttled_frames = 0;          // Times camera work waited on the vision cpu cap
+    int degrade_level = 0;                  // VISION_DEGRADE the tracker is running at
+};
+
+struct SocketBufferStats
+{
+    int read_fill = 0;
+    int send_fill = 0;
+    int capacity = 0;               // Of the read buffer
+    uint32_t read_drops = 0;
+    uint32_t send_drops = 0;
+    float tcp_rtt_ms = 0;           // Kernel round trip estimate for the master connection
+    float ping_rtt_ms = 0;          // Round trip of the last ping as measured by master, includes the robot loop
+};
+
+struct TrajectoryCacheStats
+{
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+
+    float hitRate() const { return hits + misses > 0 ? static_cast<float>(hits) / (hits + misses) : 0; };
+};
+
+// Number of buckets in the control thread wake up lateness histogram, see ControlLoop.cpp for the bounds
+#define CONTROL_JITTER_NUM_BUCKETS 6
+
+struct ControlThreadStats
+{
+    bool active = false;
+    int jitter_max_us = 0;
+    int jitter_avg_us = 0;
+    uint32_t overruns = 0;
+    uint32_t jitter_hist[CONTROL_JITTER_NUM_BUCKETS] = {0};
+    uint32_t allocs_max = 0;        // Most heap allocations in one cycle during the last second
+    uint32_t allocs_total = 0;
+};
+
+// Cores reported individually in SystemHealthStats, the rest are only in the process total
+#define SYSTEM_HEALTH_MAX_CORES 4
+
+struct SystemHealthStats
+{
+    float soc_temp_c = 0;
+    uint32_t throttle_flags = 0;            // Raspberry Pi get_throttled bits, see SystemHealth.h
+    int num_cores = 0;
+    float core_usage[SYSTEM_HEALTH_MAX_CORES] = {0};   // Busy fraction of each core since the last sample
+    float process_cpu = 0;                  // Cores used by this process
+    float main_thread_cpu = 0;              // Cores used by the threads registered with SystemHealth
+    float control_thread_cpu = 0;
+    int vision_degrade = 0;                 // VISION_DEGRADE asked of the camera tracker
 };
 
 //*******************************************
@@ -383,8 +565,7 @@ std::vector<float> parseCommaDelimitedStringToFloat(const std::string& str_in);
 //           Logging
 //*******************************************
 
-static std::unique_ptr<plog::IAppender> g_appender;
-static std::unique_ptr<plog::Logger<MOTION_CSV_LOG_ID>> g_logger;
+// Truncates log/last_motion_log.csv so it only holds the current move
 void reset_last_motion_logger();
 
 #endif
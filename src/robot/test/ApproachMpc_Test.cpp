@@ -0,0 +1,67 @@
+#include <Catch/catch.hpp>
+
+#include "ApproachMpc.h"
+
+namespace
+{
+    ApproachMpcParams makeParams()
+    {
+        return {true, 0.6, 0.1, 100, 20, 10, 1, 1, 20};
+    }
+}
+
+TEST_CASE("Approach MPC drives an integrator onto the goal within the limits", "[ApproachMpc]")
+{
+    const DynamicLimits trans_limits = {0.1, 0.15, 1.0};
+    const DynamicLimits rot_limits = {0.3, 0.5, 1.0};
+    const WheelLimits wheels = {false, 0.3, 0.12, 0.2};
+    ApproachMpc mpc;
+    mpc.configure(makeParams(), trans_limits, rot_limits, wheels);
+    mpc.restart();
+
+    // Start a few centimeters off and already drifting away, the robot frame is kept fixed
+    const float cycle_dt = 0.01;
+    Eigen::Vector3f error = {0.06, -0.03, 0.1};
+    Eigen::Vector3f velocity = {-0.02, 0, 0};
+    float max_acc = 0;
+    float max_wheel_vel = 0;
+    for (int i = 0; i < 300; i++)
+    {
+        const Velocity cmd = mpc.solve({error[0], error[1], error[2]}, {velocity[0], velocity[1], velocity[2]}, cycle_dt);
+        const Eigen::Vector3f next = {cmd.vx, cmd.vy, cmd.va};
+
+        CHECK(std::abs(cmd.vx) <= trans_limits.max_vel + 1e-5);
+        CHECK(std::abs(cmd.vy) <= trans_limits.max_vel + 1e-5);
+        CHECK(std::abs(cmd.va) <= rot_limits.max_vel + 1e-5);
+        max_acc = std::max(max_acc, (next.head<2>() - velocity.head<2>()).cwiseAbs().maxCoeff() / cycle_dt);
+        // Rim speeds with the same wheel layout as doIK
+        Eigen::Matrix3f to_wheels;
+        to_wheels << -std::sqrt(3.0f) / 2, 0.5f, wheels.base_radius,
+                      std::sqrt(3.0f) / 2, 0.5f, wheels.base_radius,
+                      0, -1, wheels.base_radius;
+        max_wheel_vel = std::max(max_wheel_vel, (to_wheels * next).cwiseAbs().maxCoeff());
+
+        velocity = next;
+        error -= velocity * cycle_dt;
+    }
+    CHECK(max_acc <= trans_limits.max_acc + 1e-3);
+    CHECK(max_wheel_vel <= wheels.max_vel + 1e-3);
+    CHECK(error.head<2>().norm() == Approx(0).margin(0.002));
+    CHECK(error[2] == Approx(0).margin(0.005));
+    CHECK(velocity.norm() == Approx(0).margin(0.01));
+    CHECK(mpc.getPrimalResidual() < 1e-3);
+}
+
+TEST_CASE("Approach MPC holds still at the goal", "[ApproachMpc]")
+{
+    ApproachMpc mpc;
+    mpc.configure(makeParams(), {0.1, 0.15, 1.0}, {0.3, 0.5, 1.0}, {false, 0.3, 0.12, 0.2});
+    mpc.restart();
+    for (int i = 0; i < 5; i++)
+    {
+        const Velocity cmd = mpc.solve({0, 0, 0}, {0, 0, 0}, 0.01);
+        CHECK(cmd.vx == Approx(0).margin(1e-5));
+        CHECK(cmd.vy == Approx(0).margin(1e-5));
+        CHECK(cmd.va == Approx(0).margin(1e-5));
+    }
+}
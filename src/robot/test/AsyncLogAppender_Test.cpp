@@ -0,0 +1,133 @@
+#include <Catch/catch.hpp>
+
+#include "AsyncLogAppender.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    std::vector<std::string> readLines(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::vector<std::string> lines;
+        std::string line;
+        while (std::getline(file, line)) lines.push_back(line);
+        return lines;
+    }
+
+    bool log(AsyncLogAppender& appender, const std::string& msg)
+    {
+        plog::util::Time time = {0, 0};
+        return appender.push(plog::info, time, 7, "func", 12, msg.c_str());
+    }
+}
+
+TEST_CASE("Async log writes in order", "[AsyncLogAppender]")
+{
+    const std::string path = "/tmp/async_log_test.txt";
+    std::remove(path.c_str());
+    {
+        AsyncLogAppender appender(path, LOG_FORMAT::TXT, 128);
+        for (int i = 0; i < 100; i++) log(appender, "msg " + std::to_string(i));
+        appender.flush();
+
+        std::vector<std::string> lines = readLines(path);
+        REQUIRE(lines.size() == 100);
+        for (int i = 0; i < 100; i++)
+        {
+            CHECK(lines[i].find("INFO  [7] [func@12] msg " + std::to_string(i)) != std::string::npos);
+        }
+        CHECK(appender.getStats().written == 100);
+        CHECK(appender.getStats().dropped == 0);
+    }
+}
+
+TEST_CASE("Async log csv and rotation", "[AsyncLogAppender]")
+{
+    const std::string path = "/tmp/async_log_test.csv";
+    std::remove(path.c_str());
+    AsyncLogAppender appender(path, LOG_FORMAT::CSV, 16);
+    log(appender, "first \"quoted\"");
+    appender.flush();
+
+    std::vector<std::string> lines = readLines(path);
+    REQUIRE(lines.size() == 2);
+    CHECK(lines[0] == "Date;Time;Severity;TID;This;Function;Message");
+    CHECK(lines[1].find(";INFO;7;0;func@12;\"first \"\"quoted\"\"\"") != std::string::npos);
+
+    // Only what was logged after the rotation survives
+    log(appender, "old");
+    appender.rotate();
+    log(appender, "new");
+    appender.flush();
+    lines = readLines(path);
+    REQUIRE(lines.size() == 2);
+    CHECK(lines[0] == "Date;Time;Severity;TID;This;Function;Message");
+    CHECK(lines[1].find("\"new\"") != std::string::npos);
+    CHECK(appender.getStats().rotations == 1);
+}
+
+TEST_CASE("Async log drops when full", "[AsyncLogAppender]")
+{
+    const std::string path = "/tmp/async_log_drop_test.txt";
+    std::remove(path.c_str());
+    AsyncLogAppender appender(path, LOG_FORMAT::TXT, 8, 0, 0, /*start_thread=*/ false);
+    int accepted = 0;
+    for (int i = 0; i < 10; i++) accepted += log(appender, "msg") ? 1 : 0;
+    CHECK(accepted == 8);
+    CHECK(appender.getStats().dropped == 2);
+
+    appender.start();
+    appender.flush();
+    std::vector<std::string> lines = readLines(path);
+    REQUIRE(lines.size() == 9);
+    CHECK(lines[8].find("dropped 2 messages") != std::string::npos);
+
+    // Room again once the writer caught up
+    CHECK(log(appender, "later"));
+}
+
+TEST_CASE("Async log rolls files by size", "[AsyncLogAppender]")
+{
+    const std::string path = "/tmp/async_log_roll_test.txt";
+    const std::string rolled_1 = "/tmp/async_log_roll_test.1.txt";
+    const std::string rolled_2 = "/tmp/async_log_roll_test.2.txt";
+    for (const std::string& p : {path, rolled_1, rolled_2}) std::remove(p.c_str());
+
+    AsyncLogAppender appender(path, LOG_FORMAT::TXT, 16, 200, 3);
+    for (int i = 0; i < 30; i++)
+    {
+        log(appender, "message number " + std::to_string(i));
+        appender.flush();
+    }
+    CHECK_FALSE(readLines(rolled_1).empty());
+    CHECK_FALSE(readLines(rolled_2).empty());
+    CHECK(readLines("/tmp/async_log_roll_test.3.txt").empty());
+    CHECK(appender.getStats().rotations > 2);
+}
+
+TEST_CASE("Async log from many threads", "[AsyncLogAppender]")
+{
+    const std::string path = "/tmp/async_log_threads_test.txt";
+    std::remove(path.c_str());
+    AsyncLogAppender appender(path, LOG_FORMAT::TXT, 4096);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&appender, t]()
+        {
+            for (int i = 0; i < 500; i++) log(appender, "thread " + std::to_string(t) + " msg " + std::to_string(i));
+        });
+    }
+    for (auto& t : threads) t.join();
+    appender.flush();
+
+    AsyncLogStats stats = appender.getStats();
+    CHECK(stats.written + stats.dropped == 2000);
+    size_t expected_lines = stats.written + (stats.dropped > 0 ? 1 : 0);
+    CHECK(readLines(path).size() == expected_lines);
+}
@@ -0,0 +1,111 @@
+#include <Catch/catch.hpp>
+
+#include "CameraCalibration.h"
+#include "test-utils.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    // Normalized image point of a ground point in the robot frame, same model as the pipelines
+    Eigen::Vector2f project(const CameraExtrinsics& extrinsics, Eigen::Vector2f ground)
+    {
+        const Eigen::Vector3f camera = extrinsics.rotation.transpose() * Eigen::Vector3f(ground[0], ground[1], 0)
+                                       - extrinsics.rotation * extrinsics.offset;
+        return {camera[0] / camera[2], camera[1] / camera[2]};
+    }
+
+    // Ground point in the robot frame a normalized image point is reported as
+    Eigen::Vector2f unproject(const CameraExtrinsics& extrinsics, Eigen::Vector2f image)
+    {
+        Eigen::Matrix3f M;
+        M << extrinsics.rotation.transpose().col(0), extrinsics.rotation.transpose().col(1), -1 * extrinsics.rotation * extrinsics.offset;
+        const Eigen::Vector3f ground = M.inverse() * Eigen::Vector3f(image[0], image[1], 1);
+        return {ground[0] / ground[2], ground[1] / ground[2]};
+    }
+
+    // What a camera mounted at actual reports through the configured extrinsics from each pose
+    std::vector<CalibrationObservation> observe(const CameraExtrinsics& actual, const CameraExtrinsics& configured,
+                                                Eigen::Vector2f marker, const std::vector<Point>& poses)
+    {
+        std::vector<CalibrationObservation> observations;
+        for (const Point& pose : poses)
+        {
+            const float c = cos(pose.a);
+            const float s = sin(pose.a);
+            const Eigen::Vector2f local = { c * (marker[0] - pose.x) + s * (marker[1] - pose.y),
+                                           -s * (marker[0] - pose.x) + c * (marker[1] - pose.y)};
+            observations.push_back({pose, unproject(configured, project(actual, local))});
+        }
+        return observations;
+    }
+
+    CameraExtrinsics sideCamera()
+    {
+        CameraExtrinsics extrinsics;
+        extrinsics.offset = {0.0, 0.93, 0.485};
+        extrinsics.rotation << 1, 0, 0,  0, -1, 0,  0, 0, -1;
+        return extrinsics;
+    }
+}
+
+TEST_CASE("Camera extrinsics from a calibration pattern", "[CameraCalibration]")
+{
+    const CameraExtrinsics configured = sideCamera();
+    CameraExtrinsics actual = configured;
+    actual.offset += Eigen::Vector3f(0.015, -0.02, 0.01);
+    actual.rotation = Eigen::AngleAxisf(0.03, Eigen::Vector3f(0.3, 1, 0.2).normalized()).toRotationMatrix() * configured.rotation;
+    const Eigen::Vector2f marker = {2.0, 3.93};
+    const std::vector<Point> poses = {{2.0, 3.0, 0.0}, {2.04, 3.0, 0.0}, {1.96, 3.0, 0.0}, {2.0, 3.04, 0.0},
+                                      {2.0, 2.96, 0.0}, {2.0, 3.0, 0.1}, {2.0, 3.0, -0.1}};
+
+    SECTION("Recovers the actual mounting")
+    {
+        ExtrinsicsSolution solution;
+        REQUIRE(solveCameraExtrinsics(configured, observe(actual, configured, marker, poses), &solution));
+        CHECK((solution.extrinsics.offset - actual.offset).norm() < 1e-3);
+        CHECK((solution.extrinsics.rotation - actual.rotation).norm() < 1e-3);
+        CHECK((solution.marker - marker).norm() < 1e-3);
+        CHECK(solution.rms_mrad < 0.05);
+    }
+
+    SECTION("Already calibrated stays put")
+    {
+        ExtrinsicsSolution solution;
+        REQUIRE(solveCameraExtrinsics(actual, observe(actual, actual, marker, poses), &solution));
+        CHECK((solution.extrinsics.offset - actual.offset).norm() < 1e-4);
+        CHECK(solution.rms_mrad < 0.05);
+    }
+
+    SECTION("Needs turning to tell the camera from the marker")
+    {
+        std::vector<Point> straight(poses.begin(), poses.begin() + 5);
+        ExtrinsicsSolution solution;
+        REQUIRE_FALSE(solveCameraExtrinsics(configured, observe(actual, configured, marker, straight), &solution));
+        REQUIRE_FALSE(solveCameraExtrinsics(configured, observe(actual, configured, marker, {poses[0], poses[5], poses[6]}), &solution));
+    }
+}
+
+TEST_CASE("Calibrated extrinsics are applied over the config", "[CameraCalibration]")
+{
+    const std::string path = "/tmp/camera_calibration_test.cfg";
+    {
+        std::ofstream out(path);
+        out << "side = {\n  x_offset = 0.01;\n  y_offset = 0.92;\n  z_offset = 0.5;\n"
+               "  rotation = [1.0, 0.0, 0.0,  0.0, -1.0, 0.0,  0.0, 0.0, -1.0];\n  rms_mrad = 0.3;\n};\n"
+               "nonexistent = {\n  x_offset = 0.0;\n};\n";
+    }
+    SafeConfigModifier<float> config_modifier_1("vision_tracker.physical.side.x_offset", 0.0);
+    SafeConfigModifier<float> config_modifier_2("vision_tracker.physical.side.y_offset", 0.93);
+    SafeConfigModifier<float> config_modifier_3("vision_tracker.physical.side.z_offset", 0.485);
+
+    REQUIRE(applyCameraExtrinsicsFile(path));
+    const CameraExtrinsics extrinsics = readCameraExtrinsics("side");
+    CHECK(extrinsics.offset[0] == Approx(0.01));
+    CHECK(extrinsics.offset[1] == Approx(0.92));
+    CHECK(extrinsics.offset[2] == Approx(0.5));
+    CHECK(extrinsics.rotation(1, 1) == Approx(-1));
+    REQUIRE_FALSE(applyCameraExtrinsicsFile("/tmp/camera_calibration_test_missing.cfg"));
+    std::filesystem::remove(path);
+}
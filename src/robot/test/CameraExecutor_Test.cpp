@@ -0,0 +1,53 @@
+#include <Catch/catch.hpp>
+
+#include "camera_tracker/CameraExecutor.h"
+#include "test-utils.h"
+#include <unistd.h>
+
+TEST_CASE("Executor paces debug image pipelines at frame rate", "[Camera]")
+{
+    SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+    SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", "/home/pi/images/test/TestImage2.jpg");
+    SafeConfigModifier<std::string> config_modifier_3("vision_tracker.rear.debug_image", "/home/pi/images/test/TestImage2.jpg");
+
+    CameraPipeline side(CAMERA_ID::SIDE, /*start_thread=*/ false);
+    CameraPipeline rear(CAMERA_ID::REAR, /*start_thread=*/ false);
+    CameraExecutor executor(1, {-1}, 0);
+    executor.add(&side);
+    executor.add(&rear);
+    executor.start();
+    usleep(500000);
+    executor.stop();
+
+    // Debug images can't be polled, so each pipeline runs once per frame period (30 fps) instead of spinning
+    CameraExecutor::Stats stats = executor.getStats();
+    CHECK(stats.runs >= 20);
+    CHECK(stats.runs <= 2 * 17);
+    CHECK(side.getData().ok);
+    CHECK(rear.getData().ok);
+}
+
+TEST_CASE("Executor frame rate limit and paused pipelines", "[Camera]")
+{
+    SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+    SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", "/home/pi/images/test/TestImage2.jpg");
+    SafeConfigModifier<std::string> config_modifier_3("vision_tracker.rear.debug_image", "/home/pi/images/test/TestImage2.jpg");
+
+    CameraPipeline side(CAMERA_ID::SIDE, /*start_thread=*/ false);
+    CameraPipeline rear(CAMERA_ID::REAR, /*start_thread=*/ false);
+    CameraExecutor executor(1, {-1}, 0);
+    executor.add(&side);
+    executor.add(&rear);
+    executor.setMaxFrameRate(10);
+    executor.setPaused(&rear, true);
+    executor.start();
+    usleep(500000);
+    executor.stop();
+
+    // Only side runs, at 10 fps instead of 30
+    CameraExecutor::Stats stats = executor.getStats();
+    CHECK(stats.runs >= 3);
+    CHECK(stats.runs <= 7);
+    CHECK(side.getData().ok);
+    CHECK_FALSE(rear.getData().ok);
+}
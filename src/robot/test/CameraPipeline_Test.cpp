@@ -115,4 +115,223 @@ TEST_CASE("Marker Detection", "[Camera]")
             CHECK(output.uv == item.expected_point_px);
         }
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Undistort modes agree", "[Camera]")
+{
+    std::vector<std::pair<std::string, CAMERA_ID>> test_images = {
+        {"20210712175430_side_img_raw.jpg", CAMERA_ID::SIDE},
+        {"20210712175436_rear_img_raw.jpg", CAMERA_ID::REAR},
+        {"20210712180208_side_img_raw.jpg", CAMERA_ID::SIDE},
+        {"20210712180047_rear_img_raw.jpg", CAMERA_ID::REAR},
+    };
+
+    for (const auto& item : test_images) 
+    {
+        std::string image_path = "/home/pi/DominoRobot/src/robot/test/testdata/new_images/" + item.first;
+        SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+        SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", image_path);
+        SafeConfigModifier<std::string> config_modifier_3("vision_tracker.rear.debug_image", image_path);
+
+        CameraPipelineOutput remap_output;
+        {
+            SafeConfigModifier<std::string> mode_modifier("vision_tracker.detection.undistort_mode", "remap");
+            CameraPipeline c(item.second, /*start_thread=*/ false);
+            c.oneLoop();
+            remap_output = c.getData();
+        }
+        CameraPipelineOutput points_output;
+        {
+            SafeConfigModifier<std::string> mode_modifier("vision_tracker.detection.undistort_mode", "points");
+            CameraPipeline c(item.second, /*start_thread=*/ false);
+            c.oneLoop();
+            points_output = c.getData();
+        }
+        CameraPipelineOutput lut_output;
+        {
+            SafeConfigModifier<std::string> mode_modifier("vision_tracker.detection.undistort_mode", "lut");
+            CameraPipeline c(item.second, /*start_thread=*/ false);
+            c.oneLoop();
+            lut_output = c.getData();
+        }
+
+        PLOGI << "Checking undistort modes in image " << item.first;
+        REQUIRE(remap_output.ok);
+        REQUIRE(points_output.ok);
+        REQUIRE(lut_output.ok);
+        CHECK((remap_output.uv - points_output.uv).norm() < 2.0);
+        // LUT mode reports the raw pixel, so only the robot frame points compare
+        CHECK((points_output.point - lut_output.point).norm() < 0.002);
+    }
+}
+
+TEST_CASE("ROI tracking matches full frame detection", "[Camera]")
+{
+    std::string image_path = "/home/pi/DominoRobot/src/robot/test/testdata/new_images/20210712175430_side_img_raw.jpg";
+    SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+    SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", image_path);
+    SafeConfigModifier<bool> config_modifier_3("vision_tracker.detection.roi.enabled", true);
+
+    CameraPipeline c(CAMERA_ID::SIDE, /*start_thread=*/ false);
+
+    // First frame searches the full image, the second only the window around the first detection
+    c.oneLoop();
+    CameraPipelineOutput full_frame_output = c.getData();
+    c.oneLoop();
+    CameraPipelineOutput roi_output = c.getData();
+
+    REQUIRE(full_frame_output.ok);
+    REQUIRE(roi_output.ok);
+    CHECK(roi_output.uv == full_frame_output.uv);
+}
+
+TEST_CASE("Pyramid search matches full frame detection", "[Camera]")
+{
+    std::vector<std::pair<std::string, CAMERA_ID>> test_images = {
+        {"20210712175430_side_img_raw.jpg", CAMERA_ID::SIDE},
+        {"20210712175436_rear_img_raw.jpg", CAMERA_ID::REAR},
+    };
+
+    for (const auto& item : test_images)
+    {
+        std::string image_path = "/home/pi/DominoRobot/src/robot/test/testdata/new_images/" + item.first;
+        SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+        SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", image_path);
+        SafeConfigModifier<std::string> config_modifier_3("vision_tracker.rear.debug_image", image_path);
+
+        CameraPipelineOutput full_frame_output;
+        {
+            CameraPipeline c(item.second, /*start_thread=*/ false);
+            c.oneLoop();
+            full_frame_output = c.getData();
+        }
+        for (int levels : {1, 2})
+        {
+            SafeConfigModifier<bool> pyramid_modifier("vision_tracker.detection.pyramid.enabled", true);
+            SafeConfigModifier<int> levels_modifier("vision_tracker.detection.pyramid.levels", levels);
+            CameraPipeline c(item.second, /*start_thread=*/ false);
+            c.oneLoop();
+            CameraPipelineOutput pyramid_output = c.getData();
+
+            PLOGI << "Checking pyramid search with " << levels << " levels in image " << item.first;
+            REQUIRE(full_frame_output.ok);
+            REQUIRE(pyramid_output.ok);
+            CHECK(pyramid_output.uv == full_frame_output.uv);
+        }
+    }
+}
+
+TEST_CASE("Component detector matches blob detector", "[Camera]")
+{
+    std::vector<std::pair<std::string, CAMERA_ID>> test_images = {
+        {"20210712175430_side_img_raw.jpg", CAMERA_ID::SIDE},
+        {"20210712175436_rear_img_raw.jpg", CAMERA_ID::REAR},
+        {"20210712175606_side_img_raw.jpg", CAMERA_ID::SIDE},
+        {"20210712175612_rear_img_raw.jpg", CAMERA_ID::REAR},
+    };
+
+    for (const auto& item : test_images) 
+    {
+        std::string image_path = "/home/pi/DominoRobot/src/robot/test/testdata/new_images/" + item.first;
+        SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+        SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", image_path);
+        SafeConfigModifier<std::string> config_modifier_3("vision_tracker.rear.debug_image", image_path);
+
+        CameraPipelineOutput blob_output;
+        {
+            SafeConfigModifier<std::string> detector_modifier("vision_tracker.detection.detector", "blob");
+            CameraPipeline c(item.second, /*start_thread=*/ false);
+            c.oneLoop();
+            blob_output = c.getData();
+        }
+        CameraPipelineOutput component_output;
+        {
+            SafeConfigModifier<std::string> detector_modifier("vision_tracker.detection.detector", "components");
+            CameraPipeline c(item.second, /*start_thread=*/ false);
+            c.oneLoop();
+            component_output = c.getData();
+        }
+
+        PLOGI << "Checking detectors in image " << item.first;
+        REQUIRE(component_output.ok == blob_output.ok);
+        if(blob_output.ok) CHECK((blob_output.uv - component_output.uv).norm() < 1.0);
+    }
+}
+
+TEST_CASE("Subpixel refinement stays on the marker", "[Camera]")
+{
+    std::vector<std::pair<std::string, CAMERA_ID>> test_images = {
+        {"20210712175430_side_img_raw.jpg", CAMERA_ID::SIDE},
+        {"20210712175436_rear_img_raw.jpg", CAMERA_ID::REAR},
+        {"20210712180208_side_img_raw.jpg", CAMERA_ID::SIDE},
+        {"20210712180047_rear_img_raw.jpg", CAMERA_ID::REAR},
+    };
+
+    for (const auto& item : test_images) 
+    {
+        std::string image_path = "/home/pi/DominoRobot/src/robot/test/testdata/new_images/" + item.first;
+        SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+        SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", image_path);
+        SafeConfigModifier<std::string> config_modifier_3("vision_tracker.rear.debug_image", image_path);
+
+        CameraPipelineOutput keypoint_output;
+        {
+            SafeConfigModifier<bool> subpixel_modifier("vision_tracker.detection.subpixel.enabled", false);
+            CameraPipeline c(item.second, /*start_thread=*/ false);
+            c.oneLoop();
+            keypoint_output = c.getData();
+        }
+        CameraPipelineOutput refined_output;
+        {
+            SafeConfigModifier<bool> subpixel_modifier("vision_tracker.detection.subpixel.enabled", true);
+            CameraPipeline c(item.second, /*start_thread=*/ false);
+            c.oneLoop();
+            refined_output = c.getData();
+        }
+
+        PLOGI << "Checking subpixel refinement in image " << item.first;
+        REQUIRE(keypoint_output.ok);
+        REQUIRE(refined_output.ok);
+        CHECK((keypoint_output.uv - refined_output.uv).norm() < 1.5);
+    }
+}
+
+TEST_CASE("Steady state frames reuse buffers", "[Camera]")
+{
+    std::string image_path = "/home/pi/DominoRobot/src/robot/test/testdata/new_images/20210712175430_side_img_raw.jpg";
+    SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+    SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", image_path);
+    SafeConfigModifier<bool> config_modifier_3("vision_tracker.detection.roi.enabled", true);
+
+    CameraPipeline c(CAMERA_ID::SIDE, /*start_thread=*/ false);
+
+    // The first frame sizes the buffers, after that full frame and roi passes must reuse them
+    c.oneLoop();
+    CameraPipelineOutput first_output = c.getData();
+    REQUIRE(first_output.ok);
+    REQUIRE(first_output.buffer_allocations > 0);
+    for (int i = 0; i < 10; i++)
+    {
+        c.oneLoop();
+        CameraPipelineOutput output = c.getData();
+        CHECK(output.ok);
+        CHECK(output.buffer_allocations == first_output.buffer_allocations);
+    }
+}
+
+TEST_CASE("Outputs are only ok once", "[Camera]")
+{
+    std::string image_path = "/home/pi/DominoRobot/src/robot/test/testdata/new_images/20210712175430_side_img_raw.jpg";
+    SafeConfigModifier<bool> config_modifier_1("vision_tracker.debug.use_debug_image", true);
+    SafeConfigModifier<std::string> config_modifier_2("vision_tracker.side.debug_image", image_path);
+
+    CameraPipeline c(CAMERA_ID::SIDE, /*start_thread=*/ false);
+    CHECK_FALSE(c.getData().ok);
+    c.oneLoop();
+    CameraPipelineOutput first = c.getData();
+    CameraPipelineOutput second = c.getData();
+    REQUIRE(first.ok);
+    CHECK_FALSE(second.ok);
+    CHECK(second.uv == first.uv);
+    c.oneLoop();
+    CHECK(c.getData().ok);
+}
@@ -0,0 +1,153 @@
+#include <Catch/catch.hpp>
+
+#include "camera_tracker/CameraTrackerShm.h"
+#include "camera_tracker/CameraTrackerMock.h"
+#include "test-utils.h"
+
+#include <poll.h>
+
+namespace
+{
+    const std::string SHM_NAME = "/domino_vision_test";
+
+    // Mock that keeps track of the requests it was passed
+    class RequestCountingTracker : public CameraTrackerMock
+    {
+      public:
+        virtual void start() override { starts++; running_ = true; };
+        virtual void stop() override { if(running_) stops++; running_ = false; };
+        virtual bool running() override { return running_; };
+        virtual void toggleDebugImageOutput() override { toggles++; };
+
+        int starts = 0;
+        int stops = 0;
+        int toggles = 0;
+
+      private:
+        bool running_ = false;
+    };
+
+    bool waitReadable(int fd)
+    {
+        pollfd pfd = {fd, POLLIN, 0};
+        return poll(&pfd, 1, 1000) > 0;
+    }
+}
+
+TEST_CASE("Shared memory tracker hands poses to the client", "[CameraTrackerShm]")
+{
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    CameraTrackerShmMapping::remove(SHM_NAME);
+    CameraTrackerMock tracker;
+    CameraTrackerShmServer server(SHM_NAME, &tracker);
+    REQUIRE(server.open());
+    CameraTrackerShmClient client(SHM_NAME, 0.5, false);
+    REQUIRE(client.poseReadyFd() >= 0);
+
+    server.runOnce(0);
+    REQUIRE(client.serverAlive());
+    REQUIRE(client.running());
+    REQUIRE_FALSE(client.getPoseFromCamera().ok);
+
+    const ClockTimePoint t = mock_clock->now();
+    tracker.mock_set_output({{1.5, -0.25, 0.1}, true, t, true});
+    server.runOnce(0);
+    REQUIRE(waitReadable(client.poseReadyFd()));
+    CameraTrackerOutput output = client.getPoseFromCamera();
+    REQUIRE(output.ok);
+    REQUIRE(output.raw_detection);
+    REQUIRE(output.pose.x == Approx(1.5));
+    REQUIRE(output.pose.y == Approx(-0.25));
+    REQUIRE(output.pose.a == Approx(0.1));
+    REQUIRE(output.timestamp == t);
+
+    // Goes lost once the vision process stops publishing
+    mock_clock->advance_ms(600);
+    REQUIRE_FALSE(client.serverAlive());
+    REQUIRE_FALSE(client.running());
+    REQUIRE_FALSE(client.getPoseFromCamera().ok);
+    server.runOnce(0);
+    REQUIRE(client.getPoseFromCamera().ok);
+
+    CameraTrackerShmMapping::remove(SHM_NAME);
+}
+
+TEST_CASE("Shared memory tracker passes requests to the vision process", "[CameraTrackerShm]")
+{
+    reset_mock_clock();
+    CameraTrackerShmMapping::remove(SHM_NAME);
+    CameraTrackerShmClient client(SHM_NAME, 0.5, false);
+    client.start();
+    client.toggleDebugImageOutput();
+
+    RequestCountingTracker tracker;
+    {
+        CameraTrackerShmServer server(SHM_NAME, &tracker);
+        REQUIRE(server.open());
+        server.runOnce(0);
+        // Toggles sent before the vision process was up aren't applied
+        REQUIRE(tracker.starts == 1);
+        REQUIRE(tracker.toggles == 0);
+        REQUIRE(client.running());
+
+        client.toggleDebugImageOutput();
+        client.toggleDebugImageOutput();
+        server.runOnce(0);
+        REQUIRE(tracker.toggles == 2);
+
+        REQUIRE(tracker.getDegradeLevel() == VISION_DEGRADE::NONE);
+        client.setDegradeLevel(VISION_DEGRADE::MINIMAL);
+        server.runOnce(0);
+        REQUIRE(tracker.getDegradeLevel() == VISION_DEGRADE::MINIMAL);
+
+        REQUIRE(tracker.getCameraProfile() == CAMERA_PROFILE::IDLE);
+        client.setCameraProfile(CAMERA_PROFILE::VISION);
+        server.runOnce(0);
+        REQUIRE(tracker.getCameraProfile() == CAMERA_PROFILE::VISION);
+
+        client.setCameraDemand(CAMERA_CONSUMER::VISION_MOVE, true);
+        client.setCameraDemand(CAMERA_CONSUMER::STOP_TRIGGER, true);
+        client.setCameraDemand(CAMERA_CONSUMER::STOP_TRIGGER, false);
+        server.runOnce(0);
+        REQUIRE(tracker.getCameraDemand(CAMERA_CONSUMER::VISION_MOVE));
+        REQUIRE_FALSE(tracker.getCameraDemand(CAMERA_CONSUMER::STOP_TRIGGER));
+
+        client.stop();
+        server.runOnce(0);
+        REQUIRE(tracker.stops == 1);
+        REQUIRE_FALSE(client.running());
+        client.start();
+    }
+
+    // A restarted vision process picks up the segment and the standing run request
+    RequestCountingTracker restarted;
+    CameraTrackerShmServer server(SHM_NAME, &restarted);
+    REQUIRE(server.open());
+    server.runOnce(0);
+    REQUIRE(restarted.starts == 1);
+    REQUIRE(restarted.getDegradeLevel() == VISION_DEGRADE::MINIMAL);
+    REQUIRE(restarted.getCameraProfile() == CAMERA_PROFILE::VISION);
+    REQUIRE(restarted.getCameraDemand(CAMERA_CONSUMER::VISION_MOVE));
+    REQUIRE(client.running());
+
+    CameraTrackerShmMapping::remove(SHM_NAME);
+}
+
+TEST_CASE("Shared memory segment from another layout is reset", "[CameraTrackerShm]")
+{
+    reset_mock_clock();
+    CameraTrackerShmMapping::remove(SHM_NAME);
+    {
+        CameraTrackerShmMapping mapping;
+        REQUIRE(mapping.open(SHM_NAME));
+        mapping.get()->magic = 0x12345678;
+        mapping.get()->run_requested = 1;
+    }
+    CameraTrackerShmMapping mapping;
+    REQUIRE(mapping.open(SHM_NAME));
+    REQUIRE(mapping.get()->magic == CAMERA_SHM_MAGIC);
+    REQUIRE(mapping.get()->run_requested == 0);
+    REQUIRE_FALSE(mapping.get()->output.read().ok);
+
+    CameraTrackerShmMapping::remove(SHM_NAME);
+}
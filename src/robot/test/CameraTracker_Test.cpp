@@ -77,3 +77,110 @@ TEST_CASE("Robot pose from coords", "[Camera]")
         CHECK(p.a == Approx(-a_offset).margin(0.0005));
     }
 }
+
+namespace
+{
+    // Marker point a camera sees when the robot is at pose, for a marker whose point is target at the origin
+    Eigen::Vector2f markerPointAtPose(Eigen::Vector2f target, Point pose)
+    {
+        float dx = target[0] - pose.x;
+        float dy = target[1] - pose.y;
+        return {cos(pose.a) * dx + sin(pose.a) * dy, -sin(pose.a) * dx + cos(pose.a) * dy};
+    }
+}
+
+TEST_CASE("Pose solve from any subset of cameras", "[CameraTracker]")
+{
+    const Point pose = {0.1, -0.05, 0.03};
+    Eigen::Vector2f targets[4] = {{0.0, -1.4}, {-1.4, 0.0}, {0.0, 1.4}, {1.2, 0.3}};
+    Eigen::Vector2f points[4];
+    for (int i = 0; i < 4; i++)
+    {
+        points[i] = markerPointAtPose(targets[i], pose);
+    }
+    float weights[4] = {1, 1, 1, 1};
+
+    for (int count : {2, 3, 4})
+    {
+        Point p;
+        REQUIRE(CameraTracker::solveRobotPose(points, targets, weights, count, &p));
+        CHECK(p.x == Approx(pose.x).margin(0.0005));
+        CHECK(p.y == Approx(pose.y).margin(0.0005));
+        CHECK(p.a == Approx(pose.a).margin(0.0005));
+    }
+
+    Point p;
+    CHECK_FALSE(CameraTracker::solveRobotPose(points, targets, weights, 1, &p));
+    CHECK_FALSE(CameraTracker::solveRobotPose(points, targets, weights, MAX_POSE_POINTS + 1, &p));
+}
+
+TEST_CASE("Pose solve weights cameras", "[CameraTracker]")
+{
+    const Point pose = {0.1, -0.05, 0.03};
+    Eigen::Vector2f targets[3] = {{0.0, -1.4}, {-1.4, 0.0}, {0.0, 1.4}};
+    Eigen::Vector2f points[3];
+    for (int i = 0; i < 3; i++)
+    {
+        points[i] = markerPointAtPose(targets[i], pose);
+    }
+    // Third detection is off by 5 cm
+    points[2][0] += 0.05;
+
+    Point equal;
+    float equal_weights[3] = {1, 1, 1};
+    REQUIRE(CameraTracker::solveRobotPose(points, targets, equal_weights, 3, &equal));
+    Point weighted;
+    float low_weights[3] = {1, 1, 0.01};
+    REQUIRE(CameraTracker::solveRobotPose(points, targets, low_weights, 3, &weighted));
+
+    // Down weighting the bad camera moves the solution toward the one from the other two
+    float equal_error = std::hypot(equal.x - pose.x, equal.y - pose.y);
+    float weighted_error = std::hypot(weighted.x - pose.x, weighted.y - pose.y);
+    CHECK(equal_error > 0.005);
+    CHECK(weighted_error < 0.25 * equal_error);
+}
+
+TEST_CASE("Pose from one camera's marker pattern", "[CameraTracker]")
+{
+    // Three blob pattern by the side camera, seen in a different order than configured plus one reflection
+    const Point pose = {0.03, -0.02, 0.04};
+    const Eigen::Vector2f pattern[3] = {{0.0, 0.93}, {0.08, 0.93}, {0.0, 1.01}};
+    Eigen::Vector2f points[4] = {markerPointAtPose(pattern[2], pose), markerPointAtPose(pattern[0], pose),
+                                 {0.3, 0.5}, markerPointAtPose(pattern[1], pose)};
+
+    int matches[4];
+    REQUIRE(CameraTracker::matchPattern(points, 4, pattern, 3, {0, 0, 0}, 0.03, matches) == 3);
+    CHECK(matches[0] == 2);
+    CHECK(matches[1] == 0);
+    CHECK(matches[2] == -1);
+    CHECK(matches[3] == 1);
+
+    Eigen::Vector2f used_points[3];
+    Eigen::Vector2f targets[3];
+    float weights[3] = {1, 1, 1};
+    int count = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if(matches[i] < 0) continue;
+        used_points[count] = points[i];
+        targets[count] = pattern[matches[i]];
+        count++;
+    }
+    Point p;
+    REQUIRE(CameraTracker::solveRobotPose(used_points, targets, weights, count, &p));
+    CHECK(p.x == Approx(pose.x).margin(0.0005));
+    CHECK(p.y == Approx(pose.y).margin(0.0005));
+    CHECK(p.a == Approx(pose.a).margin(0.0005));
+
+    // Further from the prior than the match radius nothing matches, the prior brings them back
+    const Point far = {0.1, 0.05, 0.0};
+    for (int i = 0; i < 3; i++)
+    {
+        used_points[i] = markerPointAtPose(pattern[i], far);
+    }
+    CHECK(CameraTracker::matchPattern(used_points, 3, pattern, 3, {0, 0, 0}, 0.03, matches) == 0);
+    CHECK(CameraTracker::matchPattern(used_points, 3, pattern, 3, {0.09, 0.05, 0.0}, 0.03, matches) == 3);
+    CHECK(matches[0] == 0);
+    CHECK(matches[1] == 1);
+    CHECK(matches[2] == 2);
+}
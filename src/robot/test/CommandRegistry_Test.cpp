@@ -0,0 +1,36 @@
+#include <Catch/catch.hpp>
+
+#include "CommandRegistry.h"
+
+TEST_CASE("Every command type is found", "[CommandRegistry]")
+{
+    for(const CommandSpec& spec : COMMAND_TABLE)
+    {
+        REQUIRE(findCommand(spec.type) == &spec);
+        if(spec.cmd != COMMAND::NONE)
+        {
+            REQUIRE(findCommand(spec.cmd) == &spec);
+        }
+    }
+    REQUIRE(findCommand("") == nullptr);
+    REQUIRE(findCommand("mov") == nullptr);
+    REQUIRE(findCommand("move_") == nullptr);
+    REQUIRE(findCommand(COMMAND::NONE) == nullptr);
+    REQUIRE(findCommand(static_cast<COMMAND>(0x81)) == nullptr);
+}
+
+TEST_CASE("Command classification", "[CommandRegistry]")
+{
+    static_assert(isLongRunningCmd(COMMAND::MOVE_PATH));
+    static_assert(isLongRunningCmd(COMMAND::WAIT_FOR_LOCALIZATION));
+    static_assert(!isLongRunningCmd(COMMAND::POSITION));
+    static_assert(!isLongRunningCmd(COMMAND::NONE));
+    static_assert(isTrayCmd(COMMAND::PLACE_TRAY));
+    static_assert(!isTrayCmd(COMMAND::MOVE));
+    // Binary ids are part of the protocol and can't move
+    static_assert(static_cast<int>(COMMAND::POSITION) == 9);
+    static_assert(static_cast<int>(COMMAND::DUMP_TRACE) == 21);
+    static_assert(!isLongRunningCmd(COMMAND::UPDATE_GOAL));
+    REQUIRE(findCommand("p")->payload == CMD_PAYLOAD::POSITION);
+    REQUIRE_FALSE(findCommand("status")->ack);
+}
@@ -0,0 +1,107 @@
+#include <Catch/catch.hpp>
+
+#include "camera_tracker/ComponentMarkerDetector.h"
+#include "test-utils.h"
+
+namespace
+{
+    cv::SimpleBlobDetector::Params getTestParams()
+    {
+        cv::SimpleBlobDetector::Params params;
+        params.filterByArea = true;
+        params.minArea = 20;
+        params.maxArea = 2000;
+        params.filterByCircularity = true;
+        params.minCircularity = 0.6;
+        params.maxCircularity = 1.1;
+        return params;
+    }
+
+    // White background with the given shapes drawn as 0 valued pixels
+    cv::Mat makeImage()
+    {
+        cv::Mat img(100, 120, CV_8UC1);
+        for (int y = 0; y < img.rows; y++)
+        {
+            for (int x = 0; x < img.cols; x++)
+            {
+                img.ptr<uchar>(y)[x] = 255;
+            }
+        }
+        return img;
+    }
+
+    void drawDisk(cv::Mat& img, int cx, int cy, int r)
+    {
+        for (int y = cy - r; y <= cy + r; y++)
+        {
+            for (int x = cx - r; x <= cx + r; x++)
+            {
+                if ((x - cx) * (x - cx) + (y - cy) * (y - cy) <= r * r) img.ptr<uchar>(y)[x] = 0;
+            }
+        }
+    }
+
+    void drawRect(cv::Mat& img, int x0, int y0, int w, int h)
+    {
+        for (int y = y0; y < y0 + h; y++)
+        {
+            for (int x = x0; x < x0 + w; x++)
+            {
+                img.ptr<uchar>(y)[x] = 0;
+            }
+        }
+    }
+}
+
+TEST_CASE("Component detector finds disks", "[ComponentMarkerDetector]")
+{
+    ComponentMarkerDetector detector(getTestParams());
+    cv::Mat img = makeImage();
+    drawDisk(img, 30, 40, 5);
+    drawDisk(img, 80, 60, 10);
+
+    std::vector<cv::KeyPoint> keypoints;
+    detector.detect(img, keypoints);
+    REQUIRE(keypoints.size() == 2);
+
+    // Largest comes first
+    CHECK(keypoints[0].pt.x == Approx(80));
+    CHECK(keypoints[0].pt.y == Approx(60));
+    CHECK(keypoints[0].size == Approx(20).margin(1));
+    CHECK(keypoints[1].pt.x == Approx(30));
+    CHECK(keypoints[1].pt.y == Approx(40));
+}
+
+TEST_CASE("Component detector filters", "[ComponentMarkerDetector]")
+{
+    ComponentMarkerDetector detector(getTestParams());
+    cv::Mat img = makeImage();
+    drawDisk(img, 20, 20, 1);        // Too small
+    drawRect(img, 40, 10, 60, 3);    // Not circular
+    drawDisk(img, 60, 60, 8);        // Marker
+
+    std::vector<cv::KeyPoint> keypoints;
+    detector.detect(img, keypoints);
+    REQUIRE(keypoints.size() == 1);
+    CHECK(keypoints[0].pt.x == Approx(60));
+    CHECK(keypoints[0].pt.y == Approx(60));
+}
+
+TEST_CASE("Component detector merges labels", "[ComponentMarkerDetector]")
+{
+    // A U shape needs two labels that are joined on the bottom row
+    cv::SimpleBlobDetector::Params params = getTestParams();
+    params.filterByCircularity = false;
+    ComponentMarkerDetector detector(params);
+    cv::Mat img = makeImage();
+    drawRect(img, 10, 10, 4, 20);
+    drawRect(img, 30, 10, 4, 20);
+    drawRect(img, 10, 30, 24, 4);
+
+    std::vector<cv::KeyPoint> keypoints;
+    detector.detect(img, keypoints);
+    REQUIRE(keypoints.size() == 1);
+    float area = 4*20*2 + 24*4;
+    CHECK(keypoints[0].size == Approx(2 * std::sqrt(area / M_PI)));
+}
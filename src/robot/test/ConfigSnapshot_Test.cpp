@@ -0,0 +1,119 @@
+#include <Catch/catch.hpp>
+
+#include "ConfigSnapshot.h"
+#include "TrajectoryCache.h"
+#include "test-utils.h"
+
+TEST_CASE("Config snapshot matches cfg", "[ConfigSnapshot]")
+{
+    std::shared_ptr<const ConfigSnapshot> config = ConfigSnapshot::current();
+    CHECK(config->translation.coarse.max_vel == Approx(float(cfg.lookup("motion.translation.max_vel.coarse"))));
+    CHECK(config->rotation.vision.max_jerk == Approx(float(cfg.lookup("motion.rotation.max_jerk.vision"))));
+    CHECK(config->translation.gains_vision.kp == Approx(float(cfg.lookup("motion.translation.gains_vision.kp"))));
+    CHECK(config->rotation.velocity_threshold_fine == Approx(float(cfg.lookup("motion.rotation.velocity_threshold.fine"))));
+    CHECK(config->vision_kf.history_length == int(cfg.lookup("vision_tracker.kf.history_length")));
+
+    CHECK(&config->translation.limits(LIMITS_MODE::COARSE) == &config->translation.coarse);
+    CHECK(&config->translation.limits(LIMITS_MODE::FINE) == &config->translation.fine);
+    CHECK(&config->translation.limits(LIMITS_MODE::SLOW) == &config->translation.fine);
+    CHECK(&config->rotation.limits(LIMITS_MODE::VISION) == &config->rotation.vision);
+}
+
+TEST_CASE("Config snapshot reload swaps in new values", "[ConfigSnapshot]")
+{
+    std::shared_ptr<const ConfigSnapshot> before = ConfigSnapshot::current();
+    const float old_kp = before->translation.gains.kp;
+    {
+        SafeConfigModifier<float> kp_modifier("motion.translation.gains.kp", old_kp + 1.0f);
+        std::shared_ptr<const ConfigSnapshot> during = ConfigSnapshot::current();
+        CHECK(during->translation.gains.kp == Approx(old_kp + 1.0f));
+        CHECK(during->generation != before->generation);
+        // Holders of the old snapshot keep a consistent view
+        CHECK(before->translation.gains.kp == Approx(old_kp));
+    }
+    CHECK(ConfigSnapshot::current()->translation.gains.kp == Approx(old_kp));
+}
+
+TEST_CASE("Trajectory cache drops entries on config reload", "[ConfigSnapshot]")
+{
+    SafeConfigModifier<bool> cache_modifier("trajectory_generation.cache.enabled", true);
+    TrajectoryCache cache;
+    MotionPlanningProblem problem = buildMotionPlanningProblem({0,0,0}, {1,0,0}, LIMITS_MODE::COARSE, ConfigSnapshot::current()->solver);
+
+    cache.getTrajectory(problem, LIMITS_MODE::COARSE);
+    cache.getTrajectory(problem, LIMITS_MODE::COARSE);
+    CHECK(cache.getStats().hits == 1);
+    CHECK(cache.getStats().misses == 1);
+
+    float max_vel = cfg.lookup("motion.translation.max_vel.coarse");
+    SafeConfigModifier<float> vel_modifier("motion.translation.max_vel.coarse", max_vel * 0.5f);
+    cache.getTrajectory(problem, LIMITS_MODE::COARSE);
+    CHECK(cache.getStats().hits == 1);
+    CHECK(cache.getStats().misses == 2);
+}
+
+TEST_CASE("Config params are staged until applied", "[ConfigSnapshot]")
+{
+    const float old_kp = ConfigSnapshot::current()->translation.gains.kp;
+    const float old_max_vel = ConfigSnapshot::current()->translation.coarse.max_vel;
+    // Put back whatever the test tunes
+    SafeConfigModifier<float> kp_modifier("motion.translation.gains.kp", old_kp);
+    SafeConfigModifier<int> frequency_modifier("motion.controller_frequency", 40);
+    const uint32_t generation = ConfigSnapshot::current()->generation;
+
+    std::string error;
+    double value = 0;
+    bool pending = true;
+    REQUIRE(ConfigSnapshot::getParam("motion.translation.gains.kp", &value, &pending));
+    CHECK(value == Approx(old_kp));
+    CHECK_FALSE(pending);
+    CHECK_FALSE(ConfigSnapshot::hasPendingParams());
+
+    REQUIRE(ConfigSnapshot::setParam("motion.translation.gains.kp", old_kp + 1.0, &error));
+    REQUIRE(ConfigSnapshot::setParam("motion.controller_frequency", 50, &error));
+    REQUIRE(ConfigSnapshot::getParam("motion.translation.gains.kp", &value, &pending));
+    CHECK(value == Approx(old_kp + 1.0));
+    CHECK(pending);
+    // Nothing changes for moves until the staged values are applied
+    CHECK(ConfigSnapshot::hasPendingParams());
+    CHECK(ConfigSnapshot::current()->translation.gains.kp == Approx(old_kp));
+    CHECK(ConfigSnapshot::current()->generation == generation);
+
+    ConfigSnapshot::applyPendingParams();
+    CHECK_FALSE(ConfigSnapshot::hasPendingParams());
+    CHECK(ConfigSnapshot::current()->translation.gains.kp == Approx(old_kp + 1.0));
+    CHECK(ConfigSnapshot::current()->controller_frequency == 50);
+    CHECK(ConfigSnapshot::current()->generation != generation);
+    REQUIRE(ConfigSnapshot::getParam("motion.translation.gains.kp", &value, &pending));
+    CHECK_FALSE(pending);
+
+    SECTION("Rejected values aren't staged")
+    {
+        CHECK_FALSE(ConfigSnapshot::setParam("name", 1, &error));
+        CHECK(error == "not_tunable");
+        // Only read at startup, so setting it live would do nothing
+        CHECK_FALSE(ConfigSnapshot::setParam("motion.rate_always_ready", 1, &error));
+        CHECK(error == "not_tunable");
+        CHECK_FALSE(ConfigSnapshot::getParam("motion.rate_always_ready", &value, &pending));
+
+        CHECK_FALSE(ConfigSnapshot::setParam("trajectory_generation.solver_max_loops", 2.5, &error));
+        CHECK(error == "bad_value");
+        CHECK_FALSE(ConfigSnapshot::setParam("trajectory_generation.coupled.enabled", 2, &error));
+        CHECK(error == "bad_value");
+        CHECK_FALSE(ConfigSnapshot::setParam("motion.translation.max_vel.coarse", 0, &error));
+        CHECK(error == "invalid");
+        CHECK_FALSE(ConfigSnapshot::setParam("motion.controller_frequency", -5, &error));
+        CHECK(error == "invalid");
+        {
+            // The approach MPC needs the wheel limits even with coupled planning off
+            SafeConfigModifier<bool> coupled_modifier("trajectory_generation.coupled.enabled", false);
+            SafeConfigModifier<bool> mpc_modifier("motion.approach_mpc.enabled", true);
+            CHECK_FALSE(ConfigSnapshot::setParam("trajectory_generation.coupled.wheel_max_acc", 0, &error));
+            CHECK(error == "invalid");
+        }
+
+        CHECK_FALSE(ConfigSnapshot::hasPendingParams());
+        CHECK(float(cfg.lookup("motion.translation.max_vel.coarse")) == Approx(old_max_vel));
+        CHECK(int(cfg.lookup("motion.controller_frequency")) == 50);
+    }
+}
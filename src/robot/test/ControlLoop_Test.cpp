@@ -0,0 +1,94 @@
+#include <Catch/catch.hpp>
+#include <thread>
+
+#include "ControlLoop.h"
+#include "Mailbox.h"
+#include "test-utils.h"
+
+TEST_CASE("SpscQueue", "[ControlLoop]")
+{
+    SpscQueue<int, 4> q;
+    int val = 0;
+    REQUIRE(q.empty());
+    REQUIRE_FALSE(q.pop(&val));
+
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(q.push(i));
+    }
+    REQUIRE_FALSE(q.push(4));
+
+    REQUIRE(q.pop(&val));
+    REQUIRE(val == 0);
+    REQUIRE(q.push(4));
+    for (int i = 1; i <= 4; i++)
+    {
+        REQUIRE(q.pop(&val));
+        REQUIRE(val == i);
+    }
+    REQUIRE(q.empty());
+}
+
+TEST_CASE("LatestValueMailbox", "[ControlLoop]")
+{
+    LatestValueMailbox<Point> mailbox;
+    REQUIRE(mailbox.read() == Point(0,0,0));
+    mailbox.write({1,2,3});
+    REQUIRE(mailbox.read() == Point(1,2,3));
+    mailbox.write({4,5,6});
+    REQUIRE(mailbox.read() == Point(4,5,6));
+}
+
+TEST_CASE("SeqlockedSection", "[ControlLoop]")
+{
+    SeqlockedSection<Point> section;
+    REQUIRE(section.read() == Point(0,0,0));
+    section.write([](Point& p) { p.x = 1; p.a = 3; });
+    REQUIRE(section.read() == Point(1,0,3));
+    REQUIRE(section.writerView().x == 1);
+}
+
+TEST_CASE("Inline control loop", "[ControlLoop]")
+{
+    StatusUpdater s;
+    ControlLoop c(s);
+    REQUIRE_FALSE(c.isThreaded());
+
+    c.forceSetPosition(1,2,0.5);
+    REQUIRE(c.getCurrentPosition() == Point(1,2,0.5));
+    c.update();
+    REQUIRE(s.getStatus().pos_x == 1);
+    REQUIRE_FALSE(s.getStatus().control_thread_stats.active);
+}
+
+TEST_CASE("Threaded control loop", "[ControlLoop]")
+{
+    SafeConfigModifier<bool> enable_modifier("motion.control_thread.enabled", true);
+    SafeConfigModifier<int> cpu_modifier("motion.control_thread.cpu", -1);
+    SafeConfigModifier<int> priority_modifier("motion.control_thread.priority", 0);
+    SafeConfigModifier<int> freq_modifier("motion.controller_frequency", 1000);
+
+    StatusUpdater s;
+    ControlLoop c(s);
+    REQUIRE(c.isThreaded());
+
+    c.forceSetPosition(1,2,0.5);
+    for (int i = 0; i < 1000 && !(c.getCurrentPosition() == Point(1,2,0.5)); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        c.update();
+    }
+    REQUIRE(c.getCurrentPosition() == Point(1,2,0.5));
+    REQUIRE(s.getStatus().pos_x == 1);
+    REQUIRE(s.getStatus().pos_y == 2);
+
+    ControlThreadStats stats = s.getStatus().control_thread_stats;
+    REQUIRE(stats.active);
+    uint32_t samples = 0;
+    for (int i = 0; i < CONTROL_JITTER_NUM_BUCKETS; i++)
+    {
+        samples += stats.jitter_hist[i];
+    }
+    REQUIRE(samples > 0);
+    REQUIRE(stats.jitter_max_us >= stats.jitter_avg_us);
+}
@@ -0,0 +1,38 @@
+#include <Catch/catch.hpp>
+
+#include "camera_tracker/DebugImageWriter.h"
+#include "test-utils.h"
+
+TEST_CASE("Debug writer drops oldest frames", "[DebugImageWriter]")
+{
+    DebugImageWriter writer("test", "/tmp/", {10, 10}, 2, /*start_thread=*/ false);
+    cv::Mat img(24, 32, CV_8UC1);
+    std::vector<cv::KeyPoint> keypoints = {cv::KeyPoint(5, 5, 3)};
+
+    REQUIRE_FALSE(writer.writeOne());
+    for (int i = 0; i < 5; i++)
+    {
+        writer.submit(img, img, img, keypoints, {5, 5}, {0.1, 0.2});
+    }
+    CHECK(writer.getDroppedFrames() == 3);
+
+    REQUIRE(writer.writeOne());
+    REQUIRE(writer.writeOne());
+    REQUIRE_FALSE(writer.writeOne());
+    CHECK(writer.getWrittenFrames() == 2);
+}
+
+TEST_CASE("Debug writer thread", "[DebugImageWriter]")
+{
+    DebugImageWriter writer("test", "/tmp/", {10, 10}, 2, /*start_thread=*/ true);
+    cv::Mat img(24, 32, CV_8UC1);
+    std::vector<cv::KeyPoint> keypoints;
+
+    writer.submit(img, img, img, keypoints, {0, 0}, {0, 0});
+    for (int i = 0; i < 1000 && writer.getWrittenFrames() == 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(writer.getWrittenFrames() == 1);
+    CHECK(writer.getDroppedFrames() == 0);
+}
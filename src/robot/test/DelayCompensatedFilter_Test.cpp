@@ -0,0 +1,161 @@
+#include <Catch/catch.hpp>
+
+#include "DelayCompensatedFilter.h"
+#include "test-utils.h"
+
+namespace
+{
+    KalmanFilter3 makeFilter()
+    {
+        Eigen::Matrix3f I = Eigen::Matrix3f::Identity();
+        return KalmanFilter3(I, I, I, 0.01 * I, 0.1 * I);
+    }
+
+    ClockTimePoint timeAt(int ms)
+    {
+        return ClockTimePoint(std::chrono::milliseconds(ms));
+    }
+
+    void requireStateNear(const Eigen::Vector3f& a, const Eigen::Vector3f& b)
+    {
+        for (int i = 0; i < a.size(); i++)
+        {
+            CHECK(a[i] == Approx(b[i]));
+        }
+    }
+}
+
+TEST_CASE("Delayed measurement matches in order filtering", "[DelayCompensatedFilter]")
+{
+    DelayCompensatedFilter filter(makeFilter(), 20);
+    KalmanFilter3 reference = makeFilter();
+    Eigen::Vector3f u = {0.1, 0.0, 0.01};
+    Eigen::Vector3f y = {0.5, 0.1, 0.0};
+
+    // Measurement taken at 350 ms arrives after the prediction at 900 ms
+    for (int i = 0; i < 10; i++)
+    {
+        filter.predict(u, timeAt(i * 100));
+        reference.predict(u);
+        if (i == 3) reference.update(y);
+    }
+    REQUIRE(filter.update(y, timeAt(350)));
+    CHECK(filter.lastReplayCount() == 6);
+    requireStateNear(filter.state(), reference.state());
+
+    // Later predictions continue from the corrected state
+    filter.predict(u, timeAt(1000));
+    reference.predict(u);
+    requireStateNear(filter.state(), reference.state());
+}
+
+TEST_CASE("Current measurement does not replay", "[DelayCompensatedFilter]")
+{
+    DelayCompensatedFilter filter(makeFilter(), 20);
+    KalmanFilter3 reference = makeFilter();
+    Eigen::Vector3f u = {0.1, 0.0, 0.0};
+    Eigen::Vector3f y = {0.5, 0.0, 0.0};
+
+    for (int i = 0; i < 5; i++)
+    {
+        filter.predict(u, timeAt(i * 100));
+        reference.predict(u);
+    }
+    reference.update(y);
+    REQUIRE(filter.update(y, timeAt(400)));
+    CHECK(filter.lastReplayCount() == 0);
+    requireStateNear(filter.state(), reference.state());
+}
+
+TEST_CASE("Measurement older than history", "[DelayCompensatedFilter]")
+{
+    DelayCompensatedFilter filter(makeFilter(), 4);
+    KalmanFilter3 reference = makeFilter();
+    Eigen::Vector3f u = {0.1, 0.0, 0.0};
+    Eigen::Vector3f y = {0.5, 0.0, 0.0};
+
+    for (int i = 0; i < 10; i++)
+    {
+        filter.predict(u, timeAt(i * 100));
+        reference.predict(u);
+    }
+    // Only 600-900 ms are still in the history, so this is applied now
+    reference.update(y);
+    REQUIRE_FALSE(filter.update(y, timeAt(200)));
+    requireStateNear(filter.state(), reference.state());
+}
+
+TEST_CASE("Delayed measurement with its own covariance", "[DelayCompensatedFilter]")
+{
+    // Localization predicts with zero input too, so the covariance grows while standing still
+    DelayCompensatedFilter filter(makeFilter(), 20, true);
+    KalmanFilter3 reference = makeFilter();
+    Eigen::Vector3f y = {0.5, 0.1, 0.0};
+    Eigen::Matrix3f R = 2.0 * Eigen::Matrix3f::Identity();
+
+    for (int i = 0; i < 6; i++)
+    {
+        Eigen::Vector3f u = i < 3 ? Eigen::Vector3f(0.1, 0.0, 0.0) : Eigen::Vector3f::Zero();
+        filter.predict(u, timeAt(i * 100));
+        reference.predict(u);
+        if (i == 1) reference.update(y, R);
+    }
+    REQUIRE(filter.update(y, R, timeAt(150)));
+    CHECK(filter.lastReplayCount() == 4);
+    requireStateNear(filter.state(), reference.state());
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK(filter.covariance()(i,i) == Approx(reference.covariance()(i,i)));
+    }
+}
+
+TEST_CASE("Replayed predictions keep their own process covariance", "[DelayCompensatedFilter]")
+{
+    DelayCompensatedFilter filter(makeFilter(), 20, true);
+    KalmanFilter3 reference = makeFilter();
+    Eigen::Vector3f u = {0.1, 0.0, 0.0};
+    Eigen::Vector3f y = {0.3, 0.1, 0.0};
+
+    for (int i = 0; i < 6; i++)
+    {
+        Eigen::Matrix3f Q = 0.001 * (i + 1) * Eigen::Matrix3f::Identity();
+        filter.predict(u, Q, timeAt(i * 100));
+        reference.predict(u, Q);
+        if (i == 2) reference.update(y);
+    }
+    REQUIRE(filter.update(y, timeAt(250)));
+    CHECK(filter.lastReplayCount() == 3);
+    requireStateNear(filter.state(), reference.state());
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK(filter.covariance()(i,i) == Approx(reference.covariance()(i,i)));
+    }
+
+    // Predictions without their own covariance still use the filter's
+    filter.predict(u, timeAt(600));
+    reference.predict(u, 0.01 * Eigen::Matrix3f::Identity());
+    CHECK(filter.covariance()(0,0) == Approx(reference.covariance()(0,0)));
+}
+
+TEST_CASE("Innovation distance is taken at the measurement time", "[DelayCompensatedFilter]")
+{
+    DelayCompensatedFilter filter(makeFilter(), 20, true);
+    Eigen::Vector3f u = {0.1, 0.0, 0.0};
+    Eigen::Matrix3f R = 0.1 * Eigen::Matrix3f::Identity();
+    for (int i = 0; i < 10; i++)
+    {
+        filter.predict(u, timeAt(i * 100));
+    }
+
+    // Matches the estimate at 350 ms exactly, even though the current estimate has moved on
+    KalmanFilter3 reference = makeFilter();
+    for (int i = 0; i < 4; i++) reference.predict(u);
+    CHECK(filter.innovationNis(reference.state(), R, timeAt(350)) == Approx(0).margin(1e-6));
+    CHECK(filter.innovationNis(reference.state(), R, timeAt(1000)) == Approx(0.36f / (filter.covariance()(0,0) + 0.1f)));
+
+    Eigen::Vector3f offset = {0.2, 0.0, 0.0};
+    const float expected = 0.04f / (reference.covariance()(0,0) + 0.1f);
+    CHECK(filter.innovationNis(reference.state() + offset, R, timeAt(350)) == Approx(expected));
+    // Nothing about the filter changes
+    CHECK(filter.state()[0] == Approx(1.0));
+}
@@ -0,0 +1,122 @@
+#include <Catch/catch.hpp>
+
+#include "DistanceSensor.h"
+#include "robot_controller_modes/RobotControllerModeVision.h"
+#include "camera_tracker/CameraTrackerFactory.h"
+#include "camera_tracker/CameraTrackerMock.h"
+#include "test-utils.h"
+
+namespace
+{
+    // Exposes the filtered camera pose
+    class TestVisionMode : public RobotControllerModeVision
+    {
+      public:
+        using RobotControllerModeVision::RobotControllerModeVision;
+        Point pose() const { return current_point_; };
+    };
+}
+
+TEST_CASE("Distance message parsing", "[DistanceSensor]")
+{
+    float range = 0;
+    REQUIRE(parseDistanceMsg("0.125", &range));
+    REQUIRE(range == Approx(0.125));
+    REQUIRE_FALSE(parseDistanceMsg("", &range));
+    REQUIRE_FALSE(parseDistanceMsg("0.1,0.2", &range));
+    REQUIRE_FALSE(parseDistanceMsg("none", &range));
+}
+
+TEST_CASE("Distance median filter", "[DistanceSensor]")
+{
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    DistanceSensor sensor;
+    const int window = cfg.lookup("distance_sensor.median_window");
+    REQUIRE(window == 5);
+
+    // Not ok until the window is full
+    for (int i = 0; i < window - 1; i++)
+    {
+        sensor.addSample(0.1 + 0.001 * i, mock_clock->now());
+        REQUIRE_FALSE(sensor.getReading().ok);
+        mock_clock->advance_ms(10);
+    }
+    sensor.addSample(0.1, mock_clock->now());
+    REQUIRE(sensor.getReading().ok);
+
+    // A single spike doesn't come through, and the reading keeps the time of the sample it picked
+    const ClockTimePoint spike_time = mock_clock->now();
+    sensor.addSample(0.3, spike_time);
+    DistanceReading reading = sensor.getReading();
+    REQUIRE(reading.ok);
+    REQUIRE(reading.range < 0.11);
+    REQUIRE(reading.time < spike_time);
+
+    // Nothing in view starts the window over
+    sensor.addSample(10.0, mock_clock->now());
+    REQUIRE_FALSE(sensor.getReading().ok);
+
+    // Readings go stale without new samples
+    for (int i = 0; i < window; i++) sensor.addSample(0.2, mock_clock->now());
+    REQUIRE(sensor.getReading().range == Approx(0.2));
+    mock_clock->advance_ms(1000 * static_cast<float>(cfg.lookup("distance_sensor.timeout")) + 1);
+    REQUIRE_FALSE(sensor.getReading().ok);
+}
+
+TEST_CASE("Distance sensor reads serial", "[DistanceSensor]")
+{
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    DistanceSensor sensor;
+    const float latency = cfg.lookup("distance_sensor.latency");
+
+    mock_serial->mock_send("dist:garbage");
+    for (int i = 0; i < 5; i++) mock_serial->mock_send("dist:0.08");
+    sensor.update();
+    DistanceReading reading = sensor.getReading();
+    REQUIRE(reading.ok);
+    REQUIRE(reading.range == Approx(0.08));
+    REQUIRE(std::chrono::duration<float>(mock_clock->now() - reading.time).count() == Approx(latency).margin(1e-4));
+    REQUIRE(mock_serial->rcv_distance() == "");
+}
+
+TEST_CASE("Vision moves fuse ranges close in", "[DistanceSensor]")
+{
+    SafeConfigModifier<bool> fusion_modifier("distance_sensor.fusion.enabled", true);
+    SafeConfigModifier<bool> motion_modifier("motion.fake_perfect_motion", true);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    CameraTrackerMock* camera = dynamic_cast<CameraTrackerMock*>(CameraTrackerFactory::getFactoryInstance()->get_camera_tracker());
+    REQUIRE(camera);
+    const float origin = cfg.lookup("distance_sensor.fusion.origin");
+    const float sign = cfg.lookup("distance_sensor.fusion.sign");
+    const float max_range = cfg.lookup("distance_sensor.fusion.max_range");
+
+    StatusUpdater s;
+    DistanceSensor sensor;
+    Localization localization;
+    TestVisionMode mode(true, s, sensor, localization);
+    camera->mock_set_output({{0.03, 0.01, 0}, true, mock_clock->now(), true});
+    REQUIRE(mode.startMove({0, 0, 0}));
+
+    auto run = [&](float range, int cycles)
+    {
+        for (int i = 0; i < cycles; i++)
+        {
+            mock_clock->advance_ms(10);
+            sensor.addSample(range, mock_clock->now());
+            mode.computeTargetVelocity({0,0,0}, {0,0,0}, Rotation2D(0), false);
+        }
+    };
+
+    // Too far out the cameras are trusted
+    run(max_range + 0.05, 10);
+    REQUIRE(mode.pose().x == Approx(0.03).margin(0.002));
+
+    // Close in the range takes over its axis and leaves the others alone
+    const float range = 0.07;
+    run(range, 10);
+    REQUIRE(mode.pose().x == Approx(origin + sign * range).margin(0.001));
+    REQUIRE(mode.pose().y == Approx(0.01).margin(0.001));
+
+    camera->mock_set_output({{0, 0, 0}, false, mock_clock->now(), false});
+}
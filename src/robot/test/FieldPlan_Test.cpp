@@ -0,0 +1,138 @@
+#include <Catch/catch.hpp>
+
+#include "FieldPlan.h"
+
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+namespace
+{
+    std::vector<FieldPlanStep> makeSteps(int n)
+    {
+        std::vector<FieldPlanStep> steps;
+        for (int i = 0; i < n; i++)
+        {
+            const COMMAND cmd = i % 2 ? COMMAND::PLACE_TRAY : COMMAND::MOVE_FINE;
+            steps.push_back({static_cast<uint8_t>(cmd), {0, 0, 0}, 0.1f * i, -0.1f * i, 0});
+        }
+        return steps;
+    }
+
+    std::string journalPath()
+    {
+        return "/tmp/field_plan_test_" + std::to_string(getpid()) + ".journal";
+    }
+}
+
+TEST_CASE("Field plan upload in chunks", "[FieldPlan]")
+{
+    FieldPlanJournal journal("");
+    REQUIRE_FALSE(journal.isPersistent());
+    REQUIRE(journal.getState() == FIELD_PLAN_STATE::EMPTY);
+    const std::vector<FieldPlanStep> steps = makeSteps(20);
+
+    REQUIRE(journal.addChunk(7, 0, 20, steps.data(), 16));
+    REQUIRE(journal.getState() == FIELD_PLAN_STATE::UPLOADING);
+    REQUIRE(journal.getReceived() == 16);
+    REQUIRE_FALSE(journal.run());
+
+    // Has to carry on from where the last chunk ended, in the same plan
+    CHECK_FALSE(journal.addChunk(7, 8, 20, steps.data() + 8, 4));
+    CHECK_FALSE(journal.addChunk(8, 16, 20, steps.data() + 16, 4));
+    CHECK_FALSE(journal.addChunk(7, 16, 21, steps.data() + 16, 4));
+    CHECK_FALSE(journal.addChunk(7, 16, 20, steps.data() + 16, 5));
+    REQUIRE(journal.getReceived() == 16);
+
+    REQUIRE(journal.addChunk(7, 16, 20, steps.data() + 16, 4));
+    REQUIRE(journal.getState() == FIELD_PLAN_STATE::READY);
+    REQUIRE(journal.getPlanId() == 7);
+    REQUIRE(journal.getNumSteps() == 20);
+    REQUIRE(journal.getNextStep() == 0);
+
+    REQUIRE(journal.run());
+    REQUIRE_FALSE(journal.addChunk(9, 0, 1, steps.data(), 1));
+    for (int i = 0; i < 20; i++)
+    {
+        REQUIRE(journal.currentStep().cmd == steps[i].cmd);
+        REQUIRE(journal.currentStep().x == steps[i].x);
+        journal.commitStep();
+    }
+    REQUIRE(journal.getState() == FIELD_PLAN_STATE::DONE);
+    REQUIRE_FALSE(journal.run());
+
+    // A new plan can replace a finished one
+    REQUIRE(journal.addChunk(9, 0, 1, steps.data(), 1));
+    REQUIRE(journal.getState() == FIELD_PLAN_STATE::READY);
+    journal.abort();
+    REQUIRE(journal.getState() == FIELD_PLAN_STATE::EMPTY);
+    REQUIRE(journal.getNumSteps() == 0);
+}
+
+TEST_CASE("Field plan journal survives a restart", "[FieldPlan]")
+{
+    const std::string path = journalPath();
+    std::remove(path.c_str());
+    const std::vector<FieldPlanStep> steps = makeSteps(5);
+    {
+        FieldPlanJournal journal(path);
+        REQUIRE(journal.isPersistent());
+        REQUIRE(journal.addChunk(3, 0, 5, steps.data(), 5));
+        REQUIRE(journal.run());
+        journal.commitStep();
+        journal.commitStep();
+    }
+
+    {
+        // Picked up where it was, still running so the owner can decide whether to carry on
+        FieldPlanJournal journal(path);
+        REQUIRE(journal.getState() == FIELD_PLAN_STATE::RUNNING);
+        REQUIRE(journal.getPlanId() == 3);
+        REQUIRE(journal.getNextStep() == 2);
+        REQUIRE(journal.currentStep().x == steps[2].x);
+        REQUIRE(journal.pause());
+    }
+
+    {
+        FieldPlanJournal journal(path);
+        REQUIRE(journal.getState() == FIELD_PLAN_STATE::PAUSED);
+        REQUIRE(journal.run());
+        REQUIRE(journal.getNextStep() == 2);
+    }
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Field plan journal drops incomplete or corrupt plans", "[FieldPlan]")
+{
+    const std::string path = journalPath();
+    std::remove(path.c_str());
+    const std::vector<FieldPlanStep> steps = makeSteps(20);
+
+    SECTION("Upload cut short")
+    {
+        {
+            FieldPlanJournal journal(path);
+            REQUIRE(journal.addChunk(3, 0, 20, steps.data(), 16));
+        }
+        FieldPlanJournal journal(path);
+        REQUIRE(journal.getState() == FIELD_PLAN_STATE::EMPTY);
+        REQUIRE(journal.getReceived() == 0);
+    }
+
+    SECTION("Step overwritten")
+    {
+        {
+            FieldPlanJournal journal(path);
+            REQUIRE(journal.addChunk(3, 0, 4, steps.data(), 4));
+        }
+        {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(offsetof(FieldPlanJournalData, steps) + sizeof(FieldPlanStep) + 4);
+            const float x = 12.5;
+            file.write(reinterpret_cast<const char*>(&x), sizeof(x));
+        }
+        FieldPlanJournal journal(path);
+        REQUIRE(journal.getState() == FIELD_PLAN_STATE::EMPTY);
+    }
+    std::remove(path.c_str());
+}
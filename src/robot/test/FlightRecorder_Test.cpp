@@ -0,0 +1,143 @@
+#include <Catch/catch.hpp>
+
+#include "FlightRecorder.h"
+#include "StatusUpdater.h"
+#include "test-utils.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    std::string cleanDir(const std::string& dir)
+    {
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        return dir;
+    }
+
+    std::vector<FlightRecord> readRecords(const std::string& path, FlightRecorderHeader* header)
+    {
+        std::vector<FlightRecord> records;
+        REQUIRE(readFlightRecords(path, header, &records));
+        return records;
+    }
+}
+
+TEST_CASE("Flight recorder wraps around", "[FlightRecorder]")
+{
+    const std::string dir = cleanDir("/tmp/flight_recorder_test_wrap");
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+
+    // Rounded up to 16
+    REQUIRE(FlightRecorder::open(dir + "/ring", 10, 4, ""));
+    for (int i = 0; i < 40; i++)
+    {
+        FlightRecorder::record(FLIGHT_RECORD::CONTROL, 1, 2, i, {1.0f * i, 2.0f, 3.0f});
+        mock_clock->advance_ms(25);
+    }
+
+    // Readable straight from the live ring, like after a crash
+    FlightRecorderHeader header;
+    std::vector<FlightRecord> records = readRecords(dir + "/ring", &header);
+    REQUIRE(header.capacity == 16);
+    REQUIRE(header.head == 40);
+    REQUIRE(records.size() == 16);
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        REQUIRE(records[i].type == static_cast<uint8_t>(FLIGHT_RECORD::CONTROL));
+        REQUIRE(records[i].aux == 24 + i);
+        REQUIRE(records[i].v[0] == Approx(24 + i));
+        REQUIRE(records[i].v[2] == Approx(3.0f));
+        // Values that weren't given are zeroed
+        REQUIRE(records[i].v[3] == 0);
+    }
+    REQUIRE(records.back().stamp - records.front().stamp == Approx(15 * 0.025));
+
+    // A record cut short is left out
+    FlightRecorder::close();
+    {
+        std::fstream file(dir + "/ring", std::ios::binary | std::ios::in | std::ios::out);
+        const uint64_t torn = 0;
+        file.seekp(sizeof(FlightRecorderHeader) + (39 % 16) * sizeof(FlightRecord));
+        file.write(reinterpret_cast<const char*>(&torn), sizeof(torn));
+    }
+    records = readRecords(dir + "/ring", &header);
+    REQUIRE(records.size() == 15);
+    REQUIRE(records.back().aux == 38);
+}
+
+TEST_CASE("Flight recorder freezes and dumps on error", "[FlightRecorder]")
+{
+    const std::string dir = cleanDir("/tmp/flight_recorder_test_freeze");
+    get_mock_clock_and_reset();
+    REQUIRE(FlightRecorder::open(dir + "/ring", 64, 3, ""));
+
+    for (int i = 0; i < 10; i++)
+    {
+        FlightRecorder::record(FLIGHT_RECORD::LOOP, 0, 0, i, {});
+    }
+    StatusUpdater s;
+    s.setErrorStatus();
+    REQUIRE(FlightRecorder::getFreezeReason() == FLIGHT_FREEZE::ERROR);
+    // Already frozen, the first reason is the one kept
+    FlightRecorder::freeze(FLIGHT_FREEZE::ESTOP);
+    REQUIRE(FlightRecorder::getFreezeReason() == FLIGHT_FREEZE::ERROR);
+
+    // Waits for the records after the fault
+    FlightRecorder::record(FLIGHT_RECORD::LOOP, 0, 0, 100, {});
+    REQUIRE(FlightRecorder::dumpIfFrozen(dir) == "");
+    for (int i = 0; i < 10; i++)
+    {
+        FlightRecorder::record(FLIGHT_RECORD::LOOP, 0, 0, 101 + i, {});
+    }
+    std::string dump = FlightRecorder::dumpIfFrozen(dir);
+    REQUIRE(dump != "");
+    REQUIRE(FlightRecorder::getFreezeReason() == FLIGHT_FREEZE::NONE);
+    REQUIRE(FlightRecorder::waitForDump());
+
+    // 10 before, the freeze event and 3 after
+    FlightRecorderHeader header;
+    std::vector<FlightRecord> records = readRecords(dump, &header);
+    REQUIRE(header.freeze_reason == static_cast<uint32_t>(FLIGHT_FREEZE::ERROR));
+    REQUIRE(header.freeze_index == 10);
+    REQUIRE(records.size() == 14);
+    REQUIRE(records[10].type == static_cast<uint8_t>(FLIGHT_RECORD::EVENT));
+    REQUIRE(records[10].aux16 == static_cast<uint16_t>(FLIGHT_EVENT::FREEZE));
+    REQUIRE(records[10].aux == static_cast<uint32_t>(FLIGHT_FREEZE::ERROR));
+    REQUIRE(records.back().aux == 102);
+
+    // Recording again, and the error only freezes once until it is cleared
+    FlightRecorder::record(FLIGHT_RECORD::LOOP, 0, 0, 200, {});
+    s.setErrorStatus();
+    REQUIRE(FlightRecorder::getFreezeReason() == FLIGHT_FREEZE::NONE);
+    s.clearErrorStatus();
+    s.setErrorStatus();
+    REQUIRE(FlightRecorder::getFreezeReason() == FLIGHT_FREEZE::ERROR);
+    s.clearErrorStatus();
+    FlightRecorder::close();
+}
+
+TEST_CASE("Flight recorder keeps the previous run", "[FlightRecorder]")
+{
+    const std::string dir = cleanDir("/tmp/flight_recorder_test_previous");
+    get_mock_clock_and_reset();
+    REQUIRE(FlightRecorder::open(dir + "/ring", 16, 0, dir + "/previous.bin"));
+    REQUIRE_FALSE(std::filesystem::exists(dir + "/previous.bin"));
+    FlightRecorder::record(FLIGHT_RECORD::POSITION, 1, 0, 0, {1.0f, 2.0f, 3.0f});
+    // No close, as if the run had crashed
+    REQUIRE(FlightRecorder::open(dir + "/ring", 16, 0, dir + "/previous.bin"));
+
+    FlightRecorderHeader header;
+    std::vector<FlightRecord> records = readRecords(dir + "/previous.bin", &header);
+    REQUIRE(records.size() == 1);
+    REQUIRE(records[0].v[1] == Approx(2.0f));
+    REQUIRE(readRecords(dir + "/ring", &header).empty());
+    FlightRecorder::close();
+
+    // Nothing records or freezes when it is off
+    FlightRecorder::record(FLIGHT_RECORD::POSITION, 1, 0, 0, {});
+    FlightRecorder::freeze(FLIGHT_FREEZE::ESTOP);
+    REQUIRE(FlightRecorder::getFreezeReason() == FLIGHT_FREEZE::NONE);
+    REQUIRE(FlightRecorder::dumpIfFrozen(dir) == "");
+}
@@ -0,0 +1,183 @@
+#include <Catch/catch.hpp>
+
+#include "camera_tracker/FramePairer.h"
+#include "test-utils.h"
+
+namespace
+{
+    CameraPipelineOutput detectionAt(int ms, float u = 0)
+    {
+        CameraPipelineOutput output;
+        output.ok = true;
+        output.timestamp = ClockTimePoint(std::chrono::milliseconds(ms));
+        output.uv = {u, 0};
+        return output;
+    }
+}
+
+TEST_CASE("Pairs frames within skew window", "[FramePairer]")
+{
+    FramePairer pairer(4, 20);
+    CameraPipelineOutput side, rear;
+    REQUIRE_FALSE(pairer.getPair(side, rear));
+
+    pairer.addSide(detectionAt(100, 1));
+    pairer.addRear(detectionAt(110, 2));
+    REQUIRE(pairer.getPair(side, rear));
+    CHECK(side.uv[0] == 1);
+    CHECK(rear.uv[0] == 2);
+    CHECK(pairer.getLastSkewMs() == 10);
+
+    // Consumed pairs are not returned again
+    REQUIRE_FALSE(pairer.getPair(side, rear));
+    CHECK(pairer.getRejectedPairs() == 0);
+}
+
+TEST_CASE("Rejects frames too far apart", "[FramePairer]")
+{
+    FramePairer pairer(4, 20);
+    CameraPipelineOutput side, rear;
+    pairer.addSide(detectionAt(100));
+    pairer.addRear(detectionAt(200));
+    REQUIRE_FALSE(pairer.getPair(side, rear));
+    CHECK(pairer.getRejectedPairs() == 1);
+
+    // No new data, so not counted again
+    REQUIRE_FALSE(pairer.getPair(side, rear));
+    CHECK(pairer.getRejectedPairs() == 1);
+
+    // A newer side frame pairs with the buffered rear frame
+    pairer.addSide(detectionAt(195, 3));
+    REQUIRE(pairer.getPair(side, rear));
+    CHECK(side.uv[0] == 3);
+    CHECK(rear.timestamp == ClockTimePoint(std::chrono::milliseconds(200)));
+}
+
+TEST_CASE("Prefers freshest pair", "[FramePairer]")
+{
+    FramePairer pairer(4, 20);
+    CameraPipelineOutput side, rear;
+    pairer.addSide(detectionAt(100, 1));
+    pairer.addRear(detectionAt(102, 1));
+    pairer.addSide(detectionAt(133, 2));
+    pairer.addRear(detectionAt(140, 2));
+    REQUIRE(pairer.getPair(side, rear));
+    CHECK(side.uv[0] == 2);
+    CHECK(rear.uv[0] == 2);
+    // Older detections were consumed with the pair
+    REQUIRE_FALSE(pairer.getPair(side, rear));
+}
+
+TEST_CASE("Ignores failed and repeated detections", "[FramePairer]")
+{
+    FramePairer pairer(4, 20);
+    CameraPipelineOutput side, rear;
+    CameraPipelineOutput failed = detectionAt(100);
+    failed.ok = false;
+    pairer.addSide(failed);
+    pairer.addRear(detectionAt(100));
+    REQUIRE_FALSE(pairer.getPair(side, rear));
+
+    pairer.addSide(detectionAt(105, 1));
+    pairer.addSide(detectionAt(105, 2));
+    REQUIRE(pairer.getPair(side, rear));
+    CHECK(side.uv[0] == 1);
+}
+
+TEST_CASE("Groups any subset of cameras", "[FramePairer]")
+{
+    FramePairer pairer(4, 20, 4);
+    CameraPipelineOutput outputs[MAX_CAMERAS];
+    bool used[MAX_CAMERAS];
+
+    // Only camera 0 has data
+    pairer.add(0, detectionAt(100, 1));
+    REQUIRE_FALSE(pairer.getGroup(outputs, used, 2));
+
+    // Cameras 2 and 3 show up, 3 is too late for the window
+    pairer.add(2, detectionAt(110, 2));
+    pairer.add(3, detectionAt(150, 3));
+    REQUIRE(pairer.getGroup(outputs, used, 2));
+    CHECK(used[0]);
+    CHECK_FALSE(used[1]);
+    CHECK(used[2]);
+    CHECK_FALSE(used[3]);
+    CHECK(outputs[0].uv[0] == 1);
+    CHECK(outputs[2].uv[0] == 2);
+    CHECK(pairer.getLastSkewMs() == 10);
+    REQUIRE_FALSE(pairer.getGroup(outputs, used, 2));
+}
+
+TEST_CASE("Prefers groups with more cameras", "[FramePairer]")
+{
+    FramePairer pairer(4, 20, 3);
+    CameraPipelineOutput outputs[MAX_CAMERAS];
+    bool used[MAX_CAMERAS];
+
+    // All three at around 100, then only two at around 115
+    pairer.add(0, detectionAt(100, 1));
+    pairer.add(1, detectionAt(104, 1));
+    pairer.add(2, detectionAt(108, 1));
+    pairer.add(0, detectionAt(115, 2));
+    pairer.add(1, detectionAt(118, 2));
+    REQUIRE(pairer.getGroup(outputs, used, 2));
+    CHECK(used[0]);
+    CHECK(used[1]);
+    CHECK(used[2]);
+    // Newest frames in the window are picked
+    CHECK(outputs[0].uv[0] == 2);
+    CHECK(outputs[1].uv[0] == 2);
+    CHECK(outputs[2].uv[0] == 1);
+
+    // But not once the bigger group is more than a skew window older
+    pairer.add(2, detectionAt(120, 3));
+    pairer.add(0, detectionAt(160, 4));
+    pairer.add(1, detectionAt(162, 4));
+    REQUIRE(pairer.getGroup(outputs, used, 2));
+    CHECK(used[0]);
+    CHECK(used[1]);
+    CHECK_FALSE(used[2]);
+    CHECK(outputs[0].uv[0] == 4);
+}
+
+TEST_CASE("Uses a pattern detection alone once no partner can turn up", "[FramePairer]")
+{
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    mock_clock->set(ClockTimePoint(std::chrono::milliseconds(100)));
+    FramePairer pairer(4, 20, 2, 50);
+    CameraPipelineOutput outputs[MAX_CAMERAS];
+    bool used[MAX_CAMERAS];
+
+    // A single marker never makes a pose alone
+    pairer.add(0, detectionAt(100, 1));
+    mock_clock->advance_ms(100);
+    REQUIRE_FALSE(pairer.getGroup(outputs, used, 2));
+
+    // Two pattern points do after the wait, without counting as a rejected pair while waiting
+    CameraPipelineOutput pattern = detectionAt(200, 2);
+    pattern.num_points = 2;
+    pairer.add(1, pattern);
+    const uint32_t rejected = pairer.getRejectedPairs();
+    REQUIRE_FALSE(pairer.getGroup(outputs, used, 2));
+    CHECK(pairer.getRejectedPairs() == rejected);
+    mock_clock->advance_ms(50);
+    REQUIRE(pairer.getGroup(outputs, used, 2));
+    CHECK_FALSE(used[0]);
+    CHECK(used[1]);
+    CHECK(outputs[1].uv[0] == 2);
+
+    // A partner within the window still makes the pair
+    pattern.timestamp = ClockTimePoint(std::chrono::milliseconds(260));
+    pairer.add(1, pattern);
+    pairer.add(0, detectionAt(265, 3));
+    REQUIRE(pairer.getGroup(outputs, used, 2));
+    CHECK(used[0]);
+    CHECK(used[1]);
+    CHECK(outputs[0].uv[0] == 3);
+
+    // Without a wait configured it never does
+    FramePairer pairs_only(4, 20, 2);
+    pairs_only.add(1, pattern);
+    mock_clock->advance_ms(1000);
+    REQUIRE_FALSE(pairs_only.getGroup(outputs, used, 2));
+}
@@ -0,0 +1,207 @@
+#include <Catch/catch.hpp>
+#include <chrono>
+
+#include "camera_tracker/FusedUndistortThreshold.h"
+#include "test-utils.h"
+
+namespace
+{
+    // Horizontal gradient so thresholding splits the image into two halves
+    cv::Mat makeGradientImage(int rows, int cols)
+    {
+        cv::Mat img(rows, cols, CV_8UC1);
+        for (int y = 0; y < rows; y++)
+        {
+            for (int x = 0; x < cols; x++)
+            {
+                img.ptr<uchar>(y)[x] = static_cast<uchar>((x * 255) / (cols - 1));
+            }
+        }
+        return img;
+    }
+
+    // Float maps that sample the source at (x + dx, y + dy)
+    void makeShiftMaps(int rows, int cols, float dx, float dy, cv::Mat& map_x, cv::Mat& map_y)
+    {
+        map_x.create(rows, cols, CV_32FC1);
+        map_y.create(rows, cols, CV_32FC1);
+        for (int y = 0; y < rows; y++)
+        {
+            for (int x = 0; x < cols; x++)
+            {
+                map_x.ptr<float>(y)[x] = x + dx;
+                map_y.ptr<float>(y)[x] = y + dy;
+            }
+        }
+    }
+
+    uchar expectedPixel(int val, int threshold)
+    {
+        return val > threshold ? 0 : 255;
+    }
+
+    int countMismatches(const cv::Mat& a, const cv::Mat& b)
+    {
+        int count = 0;
+        for (int y = 0; y < a.rows; y++)
+        {
+            for (int x = 0; x < a.cols; x++)
+            {
+                if (a.ptr<uchar>(y)[x] != b.ptr<uchar>(y)[x]) count++;
+            }
+        }
+        return count;
+    }
+}
+
+TEST_CASE("Fused kernel identity map", "[FusedUndistortThreshold]")
+{
+    const int rows = 20;
+    const int cols = 37;   // Not a multiple of the vector width so the scalar tail runs too
+    const int threshold = 100;
+    cv::Mat src = makeGradientImage(rows, cols);
+    cv::Mat map_x, map_y;
+    makeShiftMaps(rows, cols, 0, 0, map_x, map_y);
+
+    FusedUndistortThreshold kernel;
+    kernel.initFromMaps(map_x, map_y);
+    REQUIRE(kernel.size() == cv::Size(cols, rows));
+
+    cv::Mat dst;
+    kernel.apply(src, dst, threshold, cv::Rect(0, 0, cols, rows));
+    REQUIRE(dst.rows == rows);
+    REQUIRE(dst.cols == cols);
+    for (int y = 0; y < rows; y++)
+    {
+        for (int x = 0; x < cols; x++)
+        {
+            CHECK(dst.ptr<uchar>(y)[x] == expectedPixel(src.ptr<uchar>(y)[x], threshold));
+        }
+    }
+}
+
+TEST_CASE("Fused kernel interpolates", "[FusedUndistortThreshold]")
+{
+    const int rows = 10;
+    const int cols = 40;
+    cv::Mat src = makeGradientImage(rows, cols);
+    cv::Mat map_x, map_y;
+    makeShiftMaps(rows, cols, 0.5, 0, map_x, map_y);
+
+    FusedUndistortThreshold kernel;
+    kernel.initFromMaps(map_x, map_y);
+
+    // Every threshold in the gradient range must split exactly where the half pixel average crosses it
+    for (int threshold = 0; threshold < 255; threshold += 17)
+    {
+        cv::Mat dst;
+        kernel.apply(src, dst, threshold, cv::Rect(0, 0, cols, rows));
+        for (int x = 0; x < cols - 1; x++)
+        {
+            int avg = (src.ptr<uchar>(0)[x] + src.ptr<uchar>(0)[x+1] + 1) / 2;
+            CHECK(dst.ptr<uchar>(3)[x] == expectedPixel(avg, threshold));
+        }
+        // Last column samples outside the image, which reads as 0 like BORDER_CONSTANT
+        CHECK(dst.ptr<uchar>(3)[cols - 1] == 255);
+    }
+}
+
+TEST_CASE("Fused kernel outside source", "[FusedUndistortThreshold]")
+{
+    const int rows = 10;
+    const int cols = 16;
+    cv::Mat src = makeGradientImage(rows, cols);
+    cv::Mat map_x, map_y;
+    makeShiftMaps(rows, cols, -100, 0, map_x, map_y);
+
+    FusedUndistortThreshold kernel;
+    kernel.initFromMaps(map_x, map_y);
+    cv::Mat dst;
+    kernel.apply(src, dst, 0, cv::Rect(0, 0, cols, rows));
+    for (int y = 0; y < rows; y++)
+    {
+        for (int x = 0; x < cols; x++)
+        {
+            CHECK(dst.ptr<uchar>(y)[x] == 255);
+        }
+    }
+}
+
+TEST_CASE("Fused kernel roi", "[FusedUndistortThreshold]")
+{
+    const int rows = 30;
+    const int cols = 50;
+    const int threshold = 120;
+    cv::Mat src = makeGradientImage(rows, cols);
+    cv::Mat map_x, map_y;
+    makeShiftMaps(rows, cols, 0.25, 0.75, map_x, map_y);
+
+    FusedUndistortThreshold kernel;
+    kernel.initFromMaps(map_x, map_y);
+    cv::Mat full;
+    kernel.apply(src, full, threshold, cv::Rect(0, 0, cols, rows));
+
+    cv::Rect roi(13, 5, 21, 11);
+    cv::Mat dst;
+    kernel.apply(src, dst, threshold, roi);
+    REQUIRE(dst.rows == roi.height);
+    REQUIRE(dst.cols == roi.width);
+    for (int y = 0; y < roi.height; y++)
+    {
+        for (int x = 0; x < roi.width; x++)
+        {
+            CHECK(dst.ptr<uchar>(y)[x] == full.ptr<uchar>(y + roi.y)[x + roi.x]);
+        }
+    }
+}
+
+TEST_CASE("Fused kernel benchmark", "[Camera][.][benchmark]")
+{
+    std::vector<std::string> test_images = {
+        "20210712175430_side_img_raw.jpg",
+        "20210712175436_rear_img_raw.jpg",
+        "20210712175519_side_img_raw.jpg",
+    };
+    const int iterations = 50;
+    const int threshold = cfg.lookup("vision_tracker.detection.threshold");
+
+    for (const auto& name : test_images)
+    {
+        std::string image_path = "/home/pi/DominoRobot/src/robot/test/testdata/new_images/" + name;
+        cv::Mat img = cv::imread(image_path, cv::IMREAD_GRAYSCALE);
+        REQUIRE_FALSE(img.empty());
+
+        // Representative wide angle intrinsics, the timing doesn't depend on the exact calibration
+        cv::Mat K = (cv::Mat_<double>(3,3) << img.cols, 0, img.cols / 2.0, 0, img.cols, img.rows / 2.0, 0, 0, 1);
+        cv::Mat D = (cv::Mat_<double>(1,5) << -0.3, 0.1, 0, 0, 0);
+        cv::Rect full_frame(0, 0, img.cols, img.rows);
+
+        cv::Mat map_1, map_2;
+        cv::initUndistortRectifyMap(K, D, cv::Mat(), K, img.size(), CV_16SC2, map_1, map_2);
+        cv::Mat undistorted, opencv_thresh;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            cv::remap(img, undistorted, map_1, map_2, cv::INTER_LINEAR);
+            cv::threshold(undistorted, opencv_thresh, threshold, 255, cv::THRESH_BINARY_INV);
+        }
+        auto opencv_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        FusedUndistortThreshold kernel;
+        kernel.init(K, D, img.size());
+        cv::Mat fused_thresh;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            kernel.apply(img, fused_thresh, threshold, full_frame);
+        }
+        auto fused_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        // Rounding of the interpolation differs slightly, so only pixels right at the threshold may disagree
+        int mismatches = countMismatches(opencv_thresh, fused_thresh);
+        CHECK(mismatches < img.rows * img.cols / 1000);
+
+        WARN(name << " undistort + threshold per frame: opencv " << static_cast<float>(opencv_us) / iterations
+             << " us, fused " << static_cast<float>(fused_us) / iterations << " us, " << mismatches << " pixels differ");
+    }
+}
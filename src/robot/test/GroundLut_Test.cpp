@@ -0,0 +1,64 @@
+#include <Catch/catch.hpp>
+
+#include "camera_tracker/GroundLut.h"
+#include "test-utils.h"
+
+namespace
+{
+    // Camera 0.5 m up looking straight down, with enough barrel distortion that using the raw pixel
+    // directly would be centimeters off at the edges
+    void makeCamera(cv::Mat& K, cv::Mat& D, Eigen::Matrix3f& ground_from_pixel)
+    {
+        K = (cv::Mat_<double>(3,3) << 300, 0, 160, 0, 300, 120, 0, 0, 1);
+        D = (cv::Mat_<double>(1,5) << -0.3, 0.1, 0, 0, 0);
+        Eigen::Matrix3f Ke;
+        Ke << 300, 0, 160, 0, 300, 120, 0, 0, 1;
+        Eigen::Matrix3f ground_to_camera;
+        ground_to_camera << 1, 0, 0.1,
+                            0, -1, -0.2,
+                            0, 0, 0.5;
+        ground_from_pixel = (Ke * ground_to_camera).inverse();
+    }
+
+    Eigen::Vector2f expectedGround(const cv::Mat& K, const cv::Mat& D, const Eigen::Matrix3f& ground_from_pixel, cv::Point2f pt)
+    {
+        std::vector<cv::Point2f> distorted = {pt};
+        std::vector<cv::Point2f> undistorted;
+        cv::undistortPoints(distorted, undistorted, K, D, cv::noArray(), K);
+        const Eigen::Vector3f ground = ground_from_pixel * Eigen::Vector3f(undistorted[0].x, undistorted[0].y, 1);
+        return {ground[0] / ground[2], ground[1] / ground[2]};
+    }
+}
+
+TEST_CASE("Ground lookup matches undistorting and projecting", "[GroundLut][Camera]")
+{
+    cv::Mat K;
+    cv::Mat D;
+    Eigen::Matrix3f ground_from_pixel;
+    makeCamera(K, D, ground_from_pixel);
+    GroundLut lut;
+    REQUIRE_FALSE(lut.ready());
+    lut.init(K, D, ground_from_pixel, cv::Size(320, 240));
+    REQUIRE(lut.ready());
+    REQUIRE(lut.size() == cv::Size(320, 240));
+
+    // Pixel centers are exact, subpixel points are interpolated to well under a millimeter
+    const std::vector<cv::Point2f> points = {{160, 120}, {0, 0}, {319, 239}, {40, 200}, {12.25, 7.5}, {290.6, 33.3}, {160.5, 120.5}};
+    for (const cv::Point2f& pt : points)
+    {
+        const Eigen::Vector2f expected = expectedGround(K, D, ground_from_pixel, pt);
+        const Eigen::Vector2f looked_up = lut.lookup(pt);
+        CHECK(looked_up[0] == Approx(expected[0]).margin(2e-4));
+        CHECK(looked_up[1] == Approx(expected[1]).margin(2e-4));
+    }
+
+    // The image center sees the point under the camera
+    CHECK(lut.lookup({160, 120})[0] == Approx(-0.1).margin(1e-4));
+    CHECK(lut.lookup({160, 120})[1] == Approx(-0.2).margin(1e-4));
+
+    // Outside the image clamps to the edge
+    const Eigen::Vector2f corner = lut.lookup({0, 0});
+    const Eigen::Vector2f outside = lut.lookup({-5, -3});
+    CHECK(outside[0] == Approx(corner[0]));
+    CHECK(outside[1] == Approx(corner[1]));
+}
@@ -0,0 +1,103 @@
+#include <Catch/catch.hpp>
+
+#include "InputRecorder.h"
+#include "test-utils.h"
+
+#include <vector>
+
+namespace
+{
+    std::vector<InputRecord> readAll(const std::string& path)
+    {
+        std::vector<InputRecord> records;
+        InputLogReader reader;
+        REQUIRE(reader.open(path));
+        InputRecord record;
+        while(reader.next(&record)) records.push_back(record);
+        return records;
+    }
+}
+
+TEST_CASE("Input recorder round trip", "[InputRecorder]")
+{
+    const std::string path = "/tmp/input_recorder_round_trip.bin";
+    const ClockTimePoint t0 = ClockFactory::getFactoryInstance()->get_clock()->now();
+
+    InputRecorder::recordSocket("not recorded yet");
+    REQUIRE(InputRecorder::start(path));
+    REQUIRE(InputRecorder::isEnabled());
+    InputRecorder::recordLoop(t0);
+    InputRecorder::recordSocket("<{'type':'move'}>");
+    InputRecorder::recordSerial(INPUT_RECORD::SERIAL_LIFT, "done:pos");
+    InputRecorder::recordSerial(INPUT_RECORD::SERIAL_BASE, "");
+    InputRecorder::recordOdometry({{0.25, -0.5, 0.125}, 123456, 42});
+    MarvelmindReading reading = {1.5, 2.5, 0.5, t0 - std::chrono::milliseconds(80), 9000, 7, true, 0.01, 0.02};
+    InputRecorder::recordMarvelmind(reading);
+    InputRecorder::recordCamera({{0.1, 0.2, 0.3}, true, t0, true});
+    InputRecorder::recordLoop(t0 + std::chrono::milliseconds(5));
+    InputRecorder::stop();
+    REQUIRE_FALSE(InputRecorder::isEnabled());
+    REQUIRE(InputRecorder::getStats().entries == 7);
+    REQUIRE(InputRecorder::getStats().dropped == 0);
+
+    std::vector<InputRecord> records = readAll(path);
+    REQUIRE(records.size() == 7);
+    REQUIRE(records[0].type == INPUT_RECORD::LOOP);
+    REQUIRE(records[0].loopTime() == t0);
+    REQUIRE(records[1].type == INPUT_RECORD::SOCKET);
+    REQUIRE(records[1].payload == "<{'type':'move'}>");
+    REQUIRE(records[2].type == INPUT_RECORD::SERIAL_LIFT);
+    REQUIRE(records[2].payload == "done:pos");
+
+    REQUIRE(records[3].type == INPUT_RECORD::SERIAL_ODOMETRY);
+    SerialOdometry odom = records[3].odometry();
+    REQUIRE(odom.vel.vx == Approx(0.25).margin(0.001));
+    REQUIRE(odom.vel.vy == Approx(-0.5).margin(0.001));
+    REQUIRE(odom.timestamp_us == 123456);
+    REQUIRE(odom.seq == 42);
+
+    REQUIRE(records[4].type == INPUT_RECORD::MARVELMIND);
+    MarvelmindReading replayed = records[4].marvelmind();
+    REQUIRE(replayed.x == reading.x);
+    REQUIRE(replayed.a == reading.a);
+    REQUIRE(replayed.time == reading.time);
+    REQUIRE(replayed.hedge_timestamp == 9000);
+    REQUIRE(replayed.dual);
+    REQUIRE(replayed.angle_cov == reading.angle_cov);
+
+    REQUIRE(records[5].type == INPUT_RECORD::CAMERA);
+    CameraTrackerOutput camera = records[5].camera();
+    REQUIRE(camera.ok);
+    REQUIRE(camera.pose.y == Approx(0.2));
+    REQUIRE(camera.timestamp == t0);
+
+    REQUIRE(records[6].loopTime() == t0 + std::chrono::milliseconds(5));
+}
+
+TEST_CASE("Input recorder only records new camera outputs", "[InputRecorder]")
+{
+    const std::string path = "/tmp/input_recorder_camera.bin";
+    const ClockTimePoint t0 = ClockFactory::getFactoryInstance()->get_clock()->now();
+
+    REQUIRE(InputRecorder::start(path));
+    InputRecorder::recordCamera({{0.1, 0.2, 0.3}, true, t0, true});
+    InputRecorder::recordCamera({{0.1, 0.2, 0.3}, true, t0, true});
+    InputRecorder::recordCamera({{0.1, 0.2, 0.3}, false, t0, true});
+    InputRecorder::recordCamera({{0.4, 0.2, 0.3}, true, t0 + std::chrono::milliseconds(33), true});
+    InputRecorder::stop();
+
+    std::vector<InputRecord> records = readAll(path);
+    REQUIRE(records.size() == 3);
+    REQUIRE(records[1].camera().ok == false);
+    REQUIRE(records[2].camera().pose.x == Approx(0.4));
+}
+
+TEST_CASE("Input log reader rejects other files", "[InputRecorder]")
+{
+    InputLogReader reader;
+    REQUIRE_FALSE(reader.open("/tmp/input_recorder_missing.bin"));
+    FILE* file = fopen("/tmp/input_recorder_bad.bin", "wb");
+    fputs("DRTELEM not an input log", file);
+    fclose(file);
+    REQUIRE_FALSE(reader.open("/tmp/input_recorder_bad.bin"));
+}
@@ -0,0 +1,108 @@
+#include <Catch/catch.hpp>
+#include <chrono>
+
+#include "KalmanFilter.h"
+#include "test-utils.h"
+
+namespace
+{
+    KalmanFilter makeDynamicFilter()
+    {
+        Eigen::MatrixXf I = Eigen::MatrixXf::Identity(3,3);
+        return KalmanFilter(I, I, I, 0.01 * I, 0.1 * I);
+    }
+
+    KalmanFilter3 makeFixedFilter()
+    {
+        Eigen::Matrix3f I = Eigen::Matrix3f::Identity();
+        return KalmanFilter3(I, I, I, 0.01 * I, 0.1 * I);
+    }
+}
+
+TEST_CASE("Fixed and dynamic filters agree", "[KalmanFilter]")
+{
+    KalmanFilter dynamic_kf = makeDynamicFilter();
+    KalmanFilter3 fixed_kf = makeFixedFilter();
+
+    for (int i = 0; i < 20; i++)
+    {
+        Eigen::Vector3f u = {0.01f * i, -0.02f, 0.005f};
+        dynamic_kf.predict(u);
+        fixed_kf.predict(u);
+        if (i % 3 == 0)
+        {
+            Eigen::Vector3f y = {0.1f * i, -0.3f, 0.02f * i};
+            dynamic_kf.update(y);
+            fixed_kf.update(y);
+        }
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK(fixed_kf.state()[i] == Approx(dynamic_kf.state()[i]));
+        for (int j = 0; j < 3; j++)
+        {
+            CHECK(fixed_kf.covariance()(i,j) == Approx(dynamic_kf.covariance()(i,j)));
+        }
+    }
+}
+
+TEST_CASE("Filter converges to measurement", "[KalmanFilter]")
+{
+    KalmanFilter3 kf = makeFixedFilter();
+    Eigen::Vector3f y = {1.0, 2.0, 0.5};
+    for (int i = 0; i < 100; i++)
+    {
+        kf.predict(Eigen::Vector3f::Zero());
+        kf.update(y);
+    }
+    CHECK(kf.state()[0] == Approx(1.0).margin(1e-3));
+    CHECK(kf.state()[1] == Approx(2.0).margin(1e-3));
+    CHECK(kf.state()[2] == Approx(0.5).margin(1e-3));
+}
+
+TEST_CASE("Per step process covariance", "[KalmanFilter]")
+{
+    KalmanFilter3 kf = makeFixedFilter();
+    const Eigen::Matrix3f P0 = kf.covariance();
+    kf.predict(Eigen::Vector3f::Zero(), 0.5 * Eigen::Matrix3f::Identity());
+    CHECK(kf.covariance()(0,0) == Approx(P0(0,0) + 0.5));
+    CHECK(kf.processCovariance()(0,0) == Approx(0.01));
+
+    // The next plain predict goes back to the filter's own Q
+    const Eigen::Matrix3f P1 = kf.covariance();
+    kf.predict(Eigen::Vector3f::Zero());
+    CHECK(kf.covariance()(0,0) == Approx(P1(0,0) + 0.01));
+}
+
+TEST_CASE("Kalman filter benchmark", "[.][benchmark]")
+{
+    const int iterations = 100000;
+    Eigen::Vector3f u = {0.001, 0.002, 0.0001};
+    Eigen::Vector3f y = {0.5, 0.1, 0.0};
+    float sink = 0;
+
+    KalmanFilter dynamic_kf = makeDynamicFilter();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        dynamic_kf.predict(u);
+        dynamic_kf.update(y);
+        sink += dynamic_kf.state()[0];
+    }
+    auto dynamic_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    KalmanFilter3 fixed_kf = makeFixedFilter();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        fixed_kf.predict(u);
+        fixed_kf.update(y);
+        sink += fixed_kf.state()[0];
+    }
+    auto fixed_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(sink != 0);
+    WARN("Kalman predict + update per call: dynamic " << 1000.0f * dynamic_us / iterations
+         << " ns, fixed " << 1000.0f * fixed_us / iterations << " ns");
+}
@@ -1,3 +1,169 @@
+#include <Catch/catch.hpp>
+
+#include "Localization.h"
+#include "test-utils.h"
+
+namespace
+{
+    // Drives a quarter turn at 1 m/s in ten reports, which ends on a circle of radius 2 / pi
+    Point driveQuarterTurn(const std::string& integration)
+    {
+        SafeConfigModifier<std::string> integration_modifier("localization.odometry.integration", integration);
+        get_mock_clock_and_reset();
+        Localization L;
+        for (int i = 0; i < 10; i++)
+        {
+            L.updateVelocityReading({1, 0, M_PI / 2}, 0.1);
+        }
+        return L.getPosition();
+    }
+}
+
+TEST_CASE("Odometry integration modes", "[Localization]")
+{
+    const float end = 2 / M_PI;
+    Point exact = driveQuarterTurn("exact");
+    CHECK(exact.x == Approx(end));
+    CHECK(exact.y == Approx(end));
+    CHECK(exact.a == Approx(M_PI / 2));
+
+    // Stepping along the start heading of each report cuts inside the arc, the midpoint heading is much closer
+    Point euler = driveQuarterTurn("euler");
+    Point midpoint = driveQuarterTurn("midpoint");
+    const float euler_err = std::hypot(euler.x - end, euler.y - end);
+    const float midpoint_err = std::hypot(midpoint.x - end, midpoint.y - end);
+    CHECK(euler_err > 0.05);
+    CHECK(midpoint_err < 0.005);
+    CHECK(midpoint.a == Approx(M_PI / 2));
+}
+
+TEST_CASE("Odometry process noise grows with time and distance", "[Localization]")
+{
+    SafeConfigModifier<bool> noise_modifier("localization.odometry.scale_noise", true);
+    get_mock_clock_and_reset();
+    const float trans_per_s = cfg.lookup("localization.odometry.trans_noise_per_s");
+    const float trans_per_m = cfg.lookup("localization.odometry.trans_noise_per_m");
+    const float angle_per_rad = cfg.lookup("localization.odometry.angle_noise_per_rad");
+
+    Localization standing;
+    const Eigen::Vector3f start = standing.getCovarianceDiagonal();
+    standing.updateVelocityReading({0, 0, 0}, 0.5);
+    // The starting covariance is large next to one step, so only a few digits of the difference survive
+    CHECK(standing.getCovarianceDiagonal()[0] - start[0] == Approx(0.5 * trans_per_s).epsilon(0.01));
+
+    // One long report adds as much as the same motion in short ones
+    Localization one_report;
+    one_report.updateVelocityReading({0.4, 0, 0.2}, 0.5);
+    Localization many_reports;
+    for (int i = 0; i < 50; i++)
+    {
+        many_reports.updateVelocityReading({0.4, 0, 0.2}, 0.01);
+    }
+    const Eigen::Vector3f one = one_report.getCovarianceDiagonal() - start;
+    CHECK(one[0] == Approx(0.5 * trans_per_s + 0.2 * trans_per_m).epsilon(0.01));
+    CHECK(one[0] == Approx((many_reports.getCovarianceDiagonal() - start)[0]).epsilon(0.01));
+    CHECK(one[2] - (standing.getCovarianceDiagonal() - start)[2] == Approx(0.1 * angle_per_rad).epsilon(0.01));
+}
+
+TEST_CASE("Position readings are gated", "[Localization]")
+{
+    SafeConfigModifier<bool> gating_modifier("localization.gating.enabled", true);
+    SafeConfigModifier<float> mm_x_modifier("localization.mm_x_offset", 0.0);
+    SafeConfigModifier<float> mm_y_modifier("localization.mm_y_offset", 0.0);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    Localization L;
+
+    // Far from the starting estimate, but there is nothing to check the first reading against
+    for (int i = 0; i < 50; i++)
+    {
+        mock_clock->advance_ms(100);
+        L.updatePositionReading({3, 2, 0.5});
+    }
+    REQUIRE(L.getPosition().x == Approx(3).margin(0.01));
+    CHECK(L.getLocalizationMetrics().rejected_readings == 0);
+    CHECK(L.getLocalizationMetrics().last_nis < 1);
+
+    // A multipath jump is dropped without touching the estimate
+    L.updatePositionReading({4.5, 2, 0.5});
+    CHECK(L.getLocalizationMetrics().rejected_readings == 1);
+    CHECK(L.getLocalizationMetrics().consecutive_rejections == 1);
+    CHECK(L.getLocalizationMetrics().last_nis > 11.34);
+    CHECK(L.getPosition().x == Approx(3).margin(0.01));
+    L.updatePositionReading({3, 2, 0.5});
+    CHECK(L.getLocalizationMetrics().consecutive_rejections == 0);
+
+    // One that keeps being reported is taken over after reacquire_after readings
+    const int reacquire_after = cfg.lookup("localization.gating.reacquire_after");
+    for (int i = 0; i < reacquire_after - 1; i++)
+    {
+        L.updatePositionReading({1, 1, 0.5});
+        CHECK(L.getPosition().x == Approx(3).margin(0.01));
+    }
+    L.updatePositionReading({1, 1, 0.5});
+    CHECK(L.getLocalizationMetrics().reacquisitions == 1);
+    CHECK(L.getLocalizationMetrics().rejected_readings == static_cast<uint32_t>(reacquire_after + 1));
+    // Reset to the reference variance, so the reading now outweighs the old estimate
+    CHECK(L.getPosition().x == Approx(1).margin(0.2));
+    CHECK(L.getPosition().y == Approx(1).margin(0.2));
+}
+
+TEST_CASE("Position readings across +/- pi", "[Localization]")
+{
+    SafeConfigModifier<bool> gating_modifier("localization.gating.enabled", true);
+    SafeConfigModifier<float> mm_x_modifier("localization.mm_x_offset", 0.0);
+    SafeConfigModifier<float> mm_y_modifier("localization.mm_y_offset", 0.0);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    Localization L;
+
+    for (int i = 0; i < 50; i++)
+    {
+        mock_clock->advance_ms(100);
+        L.updatePositionReading({0, 0, 3.1});
+    }
+    REQUIRE(L.getPosition().a == Approx(3.1).margin(0.01));
+    L.updatePositionReading({0, 0, -3.1});
+    CHECK(L.getLocalizationMetrics().rejected_readings == 0);
+    CHECK(std::fabs(L.getPosition().a) > 3.05);
+}
+
+TEST_CASE("Odometry predicts the camera frame", "[Localization]")
+{
+    SafeConfigModifier<bool> delay_modifier("vision_tracker.kf.delay_compensation", true);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    Localization L;
+    REQUIRE_FALSE(L.hasCameraFix());
+
+    // Ranges only come in once a camera pose started the frame
+    const float max_range = cfg.lookup("distance_sensor.fusion.max_range");
+    SafeConfigModifier<bool> fusion_modifier("distance_sensor.fusion.enabled", true);
+    L.resetCameraFrame();
+    REQUIRE_FALSE(L.updateRangeReading({0.5f * max_range, mock_clock->now(), true}));
+
+    REQUIRE(L.updateCameraReading({0.5, 0.1, 0}, mock_clock->now()));
+    REQUIRE(L.hasCameraFix());
+    CHECK(L.getCameraPose().x == Approx(0.5).margin(0.01));
+
+    // The same odometry moves the field and camera frames
+    for (int i = 0; i < 50; i++)
+    {
+        mock_clock->advance_ms(10);
+        L.updateVelocityReading({0.2, 0, 0}, 0.01);
+    }
+    CHECK(L.getPosition().x == Approx(0.1).margin(0.001));
+    CHECK(L.getCameraPose().x == Approx(0.6).margin(0.01));
+    CHECK(L.getCameraPose().y == Approx(0.1).margin(0.01));
+
+    // A pose captured 0.2 s back is applied there, with the odometry since replayed on top
+    REQUIRE(L.updateCameraReading({0.58, 0.1, 0}, mock_clock->now() - std::chrono::milliseconds(200)));
+    CHECK(L.getCameraReplayCount() == 20);
+    CHECK(L.getCameraPose().x > 0.6);
+    CHECK(L.getCameraPose().x < 0.62);
+    CHECK(L.getPosition().x == Approx(0.1).margin(0.001));
+
+    L.resetCameraFrame();
+    CHECK_FALSE(L.hasCameraFix());
+}
+
 // #include <Catch/catch.hpp>
 
 // #include <random>
@@ -279,4 +445,4 @@
 //         REQUIRE(position.a == Approx(update_a).margin(0.0005));
 //     }
 
-// }
\ No newline at end of file
+// }
@@ -0,0 +1,70 @@
+#include <Catch/catch.hpp>
+
+#include "LoopScheduler.h"
+#include "test-utils.h"
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+TEST_CASE("Loop scheduler deadline", "[LoopScheduler]")
+{
+    SafeConfigModifier<bool> config_modifier("motion.rate_always_ready", false);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    ClockTimePoint start = mock_clock->now();
+
+    LoopScheduler scheduler;
+    REQUIRE(scheduler.getNextDeadline() == start + std::chrono::milliseconds(5));
+
+    RateController slow(100);
+    RateController fast(1000);
+    scheduler.addTask("slow", &slow);
+    REQUIRE(scheduler.getNextDeadline() == start + std::chrono::milliseconds(5));
+    scheduler.addTask("fast", &fast);
+    REQUIRE(scheduler.getNextDeadline() == start + std::chrono::milliseconds(1));
+
+    // Deadline follows the rate controller once it fires
+    mock_clock->advance_us(1000);
+    REQUIRE(fast.ready());
+    REQUIRE(scheduler.getNextDeadline() == start + std::chrono::milliseconds(2));
+}
+
+TEST_CASE("Loop scheduler overruns", "[LoopScheduler]")
+{
+    SafeConfigModifier<bool> config_modifier("motion.rate_always_ready", false);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+
+    LoopScheduler scheduler;
+    RateController rate(100);
+    scheduler.addTask("module", &rate);
+
+    mock_clock->advance_ms(10);
+    REQUIRE(rate.ready());
+    REQUIRE(scheduler.getOverruns("module") == 0);
+
+    mock_clock->advance_ms(25);
+    REQUIRE(rate.ready());
+    REQUIRE(scheduler.getOverruns("module") == 1);
+    REQUIRE(scheduler.getOverruns("other") == 0);
+}
+
+TEST_CASE("Loop scheduler wake fd", "[LoopScheduler]")
+{
+    get_mock_clock_and_reset();
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    REQUIRE(fd >= 0);
+
+    // The deadline is far enough out that only the descriptor can end the sleep in time
+    SafeConfigModifier<int> config_modifier("main_loop.max_sleep_ms", 10000);
+    LoopScheduler long_scheduler;
+    long_scheduler.addWakeFd(fd);
+    long_scheduler.addWakeFd(-1);
+    uint64_t one = 1;
+    REQUIRE(write(fd, &one, sizeof(one)) == sizeof(one));
+    auto start = std::chrono::steady_clock::now();
+    long_scheduler.sleepUntilNextDeadline();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+
+    // Woken descriptors are drained
+    uint64_t count;
+    CHECK(read(fd, &count, sizeof(count)) < 0);
+    close(fd);
+}
@@ -0,0 +1,147 @@
+#include <Catch/catch.hpp>
+
+#include "MarvelmindWrapper.h"
+#include "test-utils.h"
+
+namespace
+{
+    ClockTimePoint timeAt(int ms)
+    {
+        return ClockTimePoint(std::chrono::milliseconds(ms));
+    }
+
+    int msOf(ClockTimePoint time)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    }
+
+    PositionValue makePosition(uint32_t timestamp, int32_t x_mm, int32_t y_mm, double angle_deg, uint8_t address = MARVELMIND_DEVICE_ID0)
+    {
+        PositionValue data = {};
+        data.address = address;
+        data.timestamp = timestamp;
+        data.x = x_mm;
+        data.y = y_mm;
+        data.angle = angle_deg;
+        data.ready = true;
+        return data;
+    }
+}
+
+TEST_CASE("Clock mapper uses the fastest reading", "[Marvelmind]")
+{
+    MarvelmindClockMapper mapper(10, 0, 500);
+
+    // Readings sent every 100 ms of hedge time, delivered 40, 25 and 60 ms later
+    CHECK(msOf(mapper.map(1000, timeAt(5040))) == 5030);
+    CHECK(msOf(mapper.map(1100, timeAt(5125))) == 5115);
+    CHECK(msOf(mapper.map(1200, timeAt(5260))) == 5215);
+}
+
+TEST_CASE("Clock mapper handles wrap and jumps", "[Marvelmind]")
+{
+    MarvelmindClockMapper mapper(0, 0, 500);
+
+    SECTION("Timestamp wrap")
+    {
+        const uint32_t before_wrap = 0xFFFFFFFF - 49;
+        CHECK(msOf(mapper.map(before_wrap, timeAt(5000))) == 5000);
+        CHECK(msOf(mapper.map(before_wrap + 100, timeAt(5100))) == 5100);
+    }
+    SECTION("Hedge restart")
+    {
+        CHECK(msOf(mapper.map(100000, timeAt(5000))) == 5000);
+        CHECK(msOf(mapper.map(50, timeAt(5100))) == 5100);
+        CHECK(msOf(mapper.map(150, timeAt(5220))) == 5200);
+    }
+}
+
+TEST_CASE("Clock mapper tracks a slow hedge clock", "[Marvelmind]")
+{
+    MarvelmindClockMapper mapper(0, 1000, 500);
+
+    // Hedge clock loses 1 ms/s, the estimate creeps up so the error stays small
+    ClockTimePoint last;
+    for (int i = 0; i <= 100; i++)
+    {
+        last = mapper.map(1000 + i * 999, timeAt(5000 + i * 1000));
+    }
+    CHECK(abs(msOf(last) - 105000) <= 1);
+}
+
+TEST_CASE("Marvelmind readings are published once", "[Marvelmind]")
+{
+    MarvelmindWrapper wrapper(false);
+    MarvelmindReading reading;
+    REQUIRE_FALSE(wrapper.getLatest(&reading));
+
+    wrapper.ingest(makePosition(1000, 1500, -250, 90.0), timeAt(5000));
+    REQUIRE(wrapper.getLatest(&reading));
+    CHECK(reading.x == Approx(1.5));
+    CHECK(reading.y == Approx(-0.25));
+    CHECK(reading.a == Approx(M_PI / 2));
+    CHECK(reading.hedge_timestamp == 1000);
+    CHECK(msOf(reading.time) == 5000 - int(cfg.lookup("localization.mm_latency_ms")));
+    REQUIRE_FALSE(wrapper.getLatest(&reading));
+
+    // The library repeats the last position until a new one arrives
+    wrapper.ingest(makePosition(1000, 1500, -250, 90.0), timeAt(5010));
+    REQUIRE_FALSE(wrapper.getLatest(&reading));
+
+    PositionValue not_ready = makePosition(1100, 1600, -250, 90.0);
+    not_ready.ready = false;
+    wrapper.ingest(not_ready, timeAt(5100));
+    REQUIRE_FALSE(wrapper.getLatest(&reading));
+
+    wrapper.ingest(makePosition(1100, 1600, -250, 270.0), timeAt(5100));
+    wrapper.ingest(makePosition(1200, 1700, -250, 270.0), timeAt(5200));
+    REQUIRE(wrapper.getLatest(&reading));
+    CHECK(reading.x == Approx(1.7));
+    CHECK(reading.a == Approx(-M_PI / 2));
+    CHECK(reading.seq == 3);
+}
+
+TEST_CASE("Dual hedge readings are combined", "[Marvelmind]")
+{
+    SafeConfigModifier<bool> dual_modifier("localization.mm_dual.enabled", true);
+    MarvelmindWrapper wrapper(false);
+    REQUIRE(wrapper.isDual());
+    MarvelmindReading reading;
+    const float hedge_cov = cfg.lookup("localization.mm_dual.hedge_trans_cov");
+    const int latency_ms = int(cfg.lookup("localization.mm_latency_ms"));
+
+    // Hedge 1 is mounted to the left of hedge 0, the reported angle of each hedge is ignored
+    wrapper.ingest(makePosition(1000, 1250, 0, 45.0, MARVELMIND_DEVICE_ID0), timeAt(5000));
+    REQUIRE_FALSE(wrapper.getLatest(&reading));
+    wrapper.ingest(makePosition(1000, 750, 0, 45.0, MARVELMIND_DEVICE_ID1), timeAt(5020));
+    REQUIRE(wrapper.getLatest(&reading));
+    CHECK(reading.dual);
+    CHECK(reading.x == Approx(1.0));
+    CHECK(reading.y == Approx(0.0).margin(1e-6));
+    CHECK(reading.a == Approx(M_PI / 2));
+    CHECK(msOf(reading.time) == 5010 - latency_ms);
+    CHECK(reading.trans_cov == Approx(hedge_cov / 2));
+    CHECK(reading.angle_cov == Approx(2 * hedge_cov / 0.25));
+
+    SECTION("Readings too far apart in time wait for a newer one")
+    {
+        wrapper.ingest(makePosition(1100, 1250, 100, 0.0, MARVELMIND_DEVICE_ID0), timeAt(5100));
+        wrapper.ingest(makePosition(1300, 750, 100, 0.0, MARVELMIND_DEVICE_ID1), timeAt(5300));
+        REQUIRE_FALSE(wrapper.getLatest(&reading));
+        wrapper.ingest(makePosition(1300, 1250, 100, 0.0, MARVELMIND_DEVICE_ID0), timeAt(5310));
+        REQUIRE(wrapper.getLatest(&reading));
+        CHECK(reading.y == Approx(0.1));
+    }
+    SECTION("Bad baseline is dropped")
+    {
+        wrapper.ingest(makePosition(1100, 1500, 0, 0.0, MARVELMIND_DEVICE_ID0), timeAt(5100));
+        wrapper.ingest(makePosition(1100, 750, 0, 0.0, MARVELMIND_DEVICE_ID1), timeAt(5100));
+        REQUIRE_FALSE(wrapper.getLatest(&reading));
+    }
+    SECTION("Unknown devices are ignored")
+    {
+        wrapper.ingest(makePosition(1100, 1250, 0, 0.0, 9), timeAt(5100));
+        wrapper.ingest(makePosition(1100, 750, 0, 0.0, MARVELMIND_DEVICE_ID1), timeAt(5100));
+        REQUIRE_FALSE(wrapper.getLatest(&reading));
+    }
+}
@@ -0,0 +1,80 @@
+#include <Catch/catch.hpp>
+
+#include "sockets/MessageFramer.h"
+
+#include <vector>
+
+namespace
+{
+    std::vector<MessageFramer::Frame> allFrames(MessageFramer& framer)
+    {
+        std::vector<MessageFramer::Frame> frames;
+        MessageFramer::Frame frame;
+        while(framer.next(&frame)) frames.push_back(frame);
+        return frames;
+    }
+
+    std::string binaryFrame(const std::string& body)
+    {
+        return std::string(1, BINARY_START_CHAR) + static_cast<char>(body.size() & 0xFF) +
+            static_cast<char>((body.size() >> 8) & 0xFF) + body;
+    }
+}
+
+TEST_CASE("Framer splits a burst", "[MessageFramer]")
+{
+    MessageFramer framer;
+    framer.append("junk<{'type':'check'}>" + binaryFrame("\x81") + "<{'type':'p'}>");
+    std::vector<MessageFramer::Frame> frames = allFrames(framer);
+    REQUIRE(frames.size() == 3);
+    REQUIRE_FALSE(frames[0].binary);
+    REQUIRE(frames[0].body == "{'type':'check'}");
+    REQUIRE(frames[1].binary);
+    REQUIRE(frames[1].body == "\x81");
+    REQUIRE(frames[2].body == "{'type':'p'}");
+    REQUIRE(framer.pendingBytes() == 0);
+}
+
+TEST_CASE("Framer joins frames split across reads", "[MessageFramer]")
+{
+    MessageFramer framer;
+    MessageFramer::Frame frame;
+    const std::string binary = binaryFrame(std::string("\x01\0\xA5<", 4));
+
+    framer.append("<{'type':");
+    REQUIRE_FALSE(framer.next(&frame));
+    framer.append("'move'}>" + binary.substr(0, 2));
+    REQUIRE(framer.next(&frame));
+    REQUIRE(frame.body == "{'type':'move'}");
+    REQUIRE_FALSE(framer.next(&frame));
+    REQUIRE(framer.pendingBytes() == 2);
+
+    // Start chars inside a binary body are just data
+    framer.append(binary.substr(2));
+    REQUIRE(framer.next(&frame));
+    REQUIRE(frame.binary);
+    REQUIRE(frame.body == std::string("\x01\0\xA5<", 4));
+}
+
+TEST_CASE("Framer drops bad frames", "[MessageFramer]")
+{
+    MessageFramer framer;
+    // A restarted text frame keeps only the second start
+    framer.append("<{'type':<{'type':'check'}>");
+    std::vector<MessageFramer::Frame> frames = allFrames(framer);
+    REQUIRE(frames.size() == 1);
+    REQUIRE(frames[0].body == "{'type':'check'}");
+
+    // Zero length binary frame
+    framer.append(std::string("\xA5\0\0", 3) + "<{}>");
+    frames = allFrames(framer);
+    REQUIRE(frames.size() == 1);
+    REQUIRE(frames[0].body == "{}");
+    REQUIRE(framer.getDroppedFrames() == 1);
+
+    // Text that never ends doesn't grow the buffer forever
+    framer.append("<" + std::string(MAX_TEXT_FRAME_SIZE, 'x'));
+    REQUIRE(allFrames(framer).empty());
+    REQUIRE(framer.getDroppedFrames() == 2);
+    REQUIRE(framer.pendingBytes() == 0);
+}
@@ -0,0 +1,51 @@
+#include <Catch/catch.hpp>
+
+#include "camera_tracker/OclUndistortThreshold.h"
+#include "test-utils.h"
+
+TEST_CASE("OpenCL kernel matches CPU remap and threshold", "[OclUndistortThreshold]")
+{
+    const int rows = 30;
+    const int cols = 50;
+    const int threshold = 120;
+    cv::Mat src(rows, cols, CV_8UC1);
+    cv::Mat map_x(rows, cols, CV_32FC1);
+    cv::Mat map_y(rows, cols, CV_32FC1);
+    for (int y = 0; y < rows; y++)
+    {
+        for (int x = 0; x < cols; x++)
+        {
+            src.ptr<uchar>(y)[x] = static_cast<uchar>((x * 255) / (cols - 1));
+            map_x.ptr<float>(y)[x] = x + 0.25f;
+            map_y.ptr<float>(y)[x] = y + 0.75f;
+        }
+    }
+    cv::Mat map_1, map_2;
+    cv::convertMaps(map_x, map_y, map_1, map_2, CV_16SC2);
+
+    OclUndistortThreshold kernel;
+    bool have_device = kernel.init(map_1, map_2);
+    CHECK(kernel.ready() == have_device);
+    // Nothing else to check on machines without a device, the pipeline stays on the CPU there
+    if(!have_device) return;
+
+    cv::Rect roi(13, 5, 21, 11);
+    cv::Mat expected_undistorted, expected;
+    cv::remap(src, expected_undistorted, map_1(roi), map_2(roi), cv::INTER_LINEAR);
+    cv::threshold(expected_undistorted, expected, threshold, 255, cv::THRESH_BINARY_INV);
+
+    cv::Mat dst;
+    kernel.apply(src, dst, threshold, roi);
+    REQUIRE(dst.rows == roi.height);
+    REQUIRE(dst.cols == roi.width);
+    int mismatches = 0;
+    for (int y = 0; y < roi.height; y++)
+    {
+        for (int x = 0; x < roi.width; x++)
+        {
+            if(dst.ptr<uchar>(y)[x] != expected.ptr<uchar>(y)[x]) mismatches++;
+        }
+    }
+    // Device interpolation can round differently right at the threshold
+    CHECK(mismatches <= 2);
+}
@@ -0,0 +1,73 @@
+#include <Catch/catch.hpp>
+
+#include "RealtimeMemory.h"
+#include "TrayController.h"
+#include "test-utils.h"
+
+#include <thread>
+#include <vector>
+
+TEST_CASE("Allocations are counted per thread", "[RealtimeMemory]")
+{
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    // Kept around so the compiler can't leave the allocations out
+    static std::vector<std::vector<int>> kept;
+    kept.clear();
+    kept.reserve(2);
+    AllocationCounter counter(1.0);
+
+    kept.emplace_back(16, 1);
+    kept.emplace_back(16, 2);
+    counter.markLoop();
+    REQUIRE(counter.total() == 2);
+
+    // Another thread's allocations don't count here
+    const uint64_t before = RealtimeMemory::threadAllocations();
+    uint64_t other = 0;
+    std::thread t([&other]()
+    {
+        kept.emplace_back(16, 3);
+        other = RealtimeMemory::threadAllocations();
+    });
+    t.join();
+    REQUIRE(other >= 1);
+    // Starting the thread allocates its state here, the vector and growing kept happened over there
+    const uint64_t thread_cost = RealtimeMemory::threadAllocations() - before;
+    REQUIRE(thread_cost == 1);
+    counter.markLoop();
+    REQUIRE(counter.total() == 3);
+
+    // The max only comes out once a window is over
+    REQUIRE(counter.windowMax() == 0);
+    mock_clock->advance_ms(1001);
+    counter.markLoop();
+    REQUIRE(counter.windowMax() == 2);
+    mock_clock->advance_ms(1001);
+    counter.markLoop();
+    REQUIRE(counter.windowMax() == 0);
+
+    RealtimeMemory::prefaultStack(64 * 1024);
+    counter.markLoop();
+    REQUIRE(counter.total() == 3);
+}
+
+TEST_CASE("Waiting tray steps don't allocate", "[RealtimeMemory]")
+{
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    TrayController t;
+    t.setTrayInitialized(true);
+    REQUIRE(t.place());
+    mock_clock->advance_ms(1);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift().rfind("pos:", 0) == 0);
+
+    AllocationCounter counter;
+    for (int i = 0; i < 10; i++)
+    {
+        mock_clock->advance_ms(1);
+        t.update();
+    }
+    counter.markLoop();
+    REQUIRE(counter.total() == 0);
+}
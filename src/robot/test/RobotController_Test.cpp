@@ -111,6 +111,296 @@ TEST_CASE("Simple coarse motion", "[RobotController]")
     }
 }
 
+TEST_CASE("Trajectory time remaining", "[RobotController]")
+{
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+    REQUIRE(s.getStatus().traj_time_remaining == 0);
+
+    r.moveToPosition(0.5, 0, 0);
+    r.update();
+    const float at_start = s.getStatus().traj_time_remaining;
+    REQUIRE(at_start > 0);
+
+    mock_clock->advance_ms(200);
+    mock_serial->purge_data();
+    r.update();
+    REQUIRE(s.getStatus().traj_time_remaining == Approx(at_start - 0.2).margin(0.02));
+
+    mock_clock->advance_ms(static_cast<int>(at_start * 1000) + 1000);
+    r.update();
+    REQUIRE(s.getStatus().traj_time_remaining == 0);
+}
+
+TEST_CASE("Settle time", "[RobotController]")
+{
+    SafeConfigModifier<float> dwell_modifier("motion.settle.dwell.coarse", 0.5);
+    SafeConfigModifier<float> confident_dwell_modifier("motion.settle.confident_dwell.coarse", 0.2);
+    reset_mock_clock();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    // Odometry has no uncertainty, so once the speed stops climbing the confident dwell applies
+    int num_loops = moveToPositionHelper(r, 0.5, 0, 0, 100000);
+    CHECK(num_loops != 100000);
+    REQUIRE(s.getStatus().settle_time == Approx(0.2).margin(0.005));
+    REQUIRE(s.getStatus().pos_x == Approx(0.5).margin(0.0005));
+}
+
+TEST_CASE("Asynchronous planning", "[RobotController]")
+{
+    SafeConfigModifier<bool> async_modifier("motion.async_planning.enabled", true);
+    SafeConfigModifier<float> dwell_modifier("motion.settle.dwell.coarse", 0.5);
+    SafeConfigModifier<float> confident_dwell_modifier("motion.settle.confident_dwell.coarse", 0.2);
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);
+    reset_mock_clock();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    SECTION("Move starts once planned")
+    {
+        // The helper requires the motors on straight away, to hold position while planning
+        int num_loops = moveToPositionHelper(r, 0.5, 0, 0, 100000);
+        CHECK(num_loops != 100000);
+        // The move starts on whichever cycle sees the plan, so it settles a little differently to "Settle time"
+        CHECK(s.getStatus().pos_x == Approx(0.5).margin(0.001));
+        CHECK(s.getStatus().pos_y == Approx(0).margin(0.001));
+        CHECK(s.getStatus().plan_time_ms > 0);
+        CHECK(s.getStatus().plan_wait_ms >= 0);
+        CHECK(s.getStatus().trajectory_cache_stats.misses == 1);
+    }
+    SECTION("Estop drops the pending plan")
+    {
+        r.moveToPosition(0.5, 0, 0);
+        REQUIRE(r.isTrajectoryRunning());
+        r.estop();
+        REQUIRE_FALSE(r.isTrajectoryRunning());
+
+        // Give the planner time to finish, the plan must not start a move
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        mock_serial->purge_data();
+        r.update();
+        CHECK_FALSE(r.isTrajectoryRunning());
+        CHECK(s.getStatus().pos_x == 0);
+    }
+    SECTION("New move during a move starts from where the robot is")
+    {
+        MockClockWrapper* mock_clock = get_mock_clock();
+        r.moveToPosition(0.5, 0, 0);
+        for (int i = 0; i < 100000 && s.getStatus().pos_x < 0.2; i++)
+        {
+            // Real time for the planner thread until the first move starts
+            if(s.getStatus().traj_time_remaining == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            r.update();
+            mock_serial->mock_send("base:" + mock_serial->mock_rcv_base());
+            mock_clock->advance_ms(1);
+        }
+        REQUIRE(s.getStatus().pos_x >= 0.2);
+        REQUIRE(r.isTrajectoryRunning());
+
+        // Planned straight away rather than while the first trajectory keeps going
+        int num_loops = moveToPositionHelper(r, 0.5, 0.2, 0, 100000);
+        CHECK(num_loops != 100000);
+        CHECK(s.getStatus().plan_wait_ms == 0);
+        CHECK(s.getStatus().pos_x == Approx(0.5).margin(0.001));
+        CHECK(s.getStatus().pos_y == Approx(0.2).margin(0.001));
+    }
+}
+
+TEST_CASE("Binary serial coarse motion", "[RobotController]")
+{
+    SafeConfigModifier<bool> binary_config_modifier("motion.binary_serial", true);
+    SafeConfigModifier<float> pos_kp_config_modifier("motion.translation.gains.kp", 0.0);
+    SafeConfigModifier<float> pos_ki_config_modifier("motion.translation.gains.ki", 0.0);
+    SafeConfigModifier<float> pos_kd_config_modifier("motion.translation.gains.kd", 0.0);
+    SafeConfigModifier<float> ang_kp_config_modifier("motion.rotation.gains.kp", 0.0);
+    SafeConfigModifier<float> ang_ki_config_modifier("motion.rotation.gains.ki", 0.0);
+    SafeConfigModifier<float> ang_kd_config_modifier("motion.rotation.gains.kd", 0.0);
+    SafeConfigModifier<float> limit_config_modifier("motion.limit_max_fraction", 0.8);
+
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    mock_serial->purge_data();
+    r.moveToPosition(0.5, 0.2, 0.3);
+    REQUIRE(mock_serial->mock_rcv_base() == "Power:ON");
+
+    int count = 0;
+    int num_velocities = 0;
+    uint32_t driver_time_us = 0;
+    uint16_t driver_seq = 0;
+    while(r.isTrajectoryRunning() && count++ < 100000)
+    {
+        r.update();
+        // Velocities only go out as binary frames, report back the quantized command stamped with the driver clock
+        std::string text = mock_serial->mock_rcv_base();
+        REQUIRE((text.empty() || text == "Power:OFF"));
+        SerialVelocity vel;
+        while(mock_serial->mock_rcv_base_velocity(&vel))
+        {
+            mock_serial->mock_send_base_odometry({vel, driver_time_us, driver_seq++});
+            num_velocities++;
+        }
+        mock_clock->advance_ms(1);
+        driver_time_us += 1000;
+    }
+
+    CHECK(num_velocities > 0);
+    StatusUpdater::Status status = s.getStatus();
+    REQUIRE(status.pos_x == Approx(0.5).margin(0.001));
+    REQUIRE(status.pos_y == Approx(0.2).margin(0.001));
+    REQUIRE(status.pos_a == Approx(0.3).margin(0.001));
+}
+
+namespace
+{
+    SCurveParameters toSCurve(const SerialTrajectoryAxis& axis)
+    {
+        SCurveParameters params;
+        params.v_lim = axis.v_lim;
+        params.a_lim = axis.a_lim;
+        params.j_lim = axis.j_lim;
+        for (int i = 0; i < 8; i++)
+        {
+            params.switch_points[i] = {axis.switch_points[i][0], axis.switch_points[i][1], axis.switch_points[i][2], axis.switch_points[i][3]};
+        }
+        return params;
+    }
+}
+
+TEST_CASE("Motor driver trajectory following", "[RobotController]")
+{
+    SafeConfigModifier<bool> binary_config_modifier("motion.binary_serial", true);
+    SafeConfigModifier<bool> driver_config_modifier("motion.driver_trajectory.enabled", true);
+    SafeConfigModifier<float> limit_config_modifier("motion.limit_max_fraction", 0.8);
+
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    mock_serial->purge_data();
+    r.moveToPosition(0.5, 0.2, 0.3);
+    REQUIRE(mock_serial->mock_rcv_base() == "Power:ON");
+
+    // Stand in for the driver: follow the uploaded s-curves plus the latest correction
+    SerialTrajectoryAxis trans = {};
+    SerialTrajectoryAxis rot = {};
+    SerialTrajectoryCorrection correction = {};
+    bool started = false;
+    float start_heading = 0;
+    float driver_time = 0;
+    uint16_t driver_seq = 0;
+    int num_corrections = 0;
+    int count = 0;
+    while(r.isTrajectoryRunning() && count++ < 100000)
+    {
+        r.update();
+        SERIAL_BINARY_CHANNEL channel;
+        std::string payload;
+        while(mock_serial->mock_rcv_frame(&channel, &payload))
+        {
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(payload.data());
+            if(channel == SERIAL_BINARY_CHANNEL::TRAJECTORY_AXIS)
+            {
+                REQUIRE(payload.size() == SERIAL_TRAJECTORY_AXIS_PAYLOAD_SIZE);
+                SerialTrajectoryAxis axis = decodeTrajectoryAxisPayload(data);
+                if(axis.axis == SERIAL_TRAJECTORY_AXIS::TRANSLATION) trans = axis;
+                else rot = axis;
+            }
+            else if(channel == SERIAL_BINARY_CHANNEL::TRAJECTORY_START)
+            {
+                REQUIRE(payload.size() == SERIAL_TRAJECTORY_START_PAYLOAD_SIZE);
+                getFloat(data + 2, &start_heading);
+                started = true;
+            }
+            else if(channel == SERIAL_BINARY_CHANNEL::TRAJECTORY_CORRECTION)
+            {
+                REQUIRE(payload.size() == SERIAL_TRAJECTORY_CORRECTION_PAYLOAD_SIZE);
+                correction = decodeTrajectoryCorrectionPayload(data);
+                REQUIRE(correction.traj_id == trans.traj_id);
+                num_corrections++;
+            }
+        }
+        // Nothing is streamed while the driver follows the trajectory, the zero velocity at the end ends it
+        SerialVelocity vel;
+        if(!r.isTrajectoryRunning())
+        {
+            REQUIRE(mock_serial->mock_rcv_base_velocity(&vel));
+            REQUIRE(vel.vx == 0);
+            break;
+        }
+        REQUIRE_FALSE(mock_serial->mock_rcv_base_velocity(&vel));
+        REQUIRE(started);
+
+        Kinematics1D t = lookup_1D(driver_time, toSCurve(trans));
+        Kinematics1D a = lookup_1D(driver_time, toSCurve(rot));
+        float vx = trans.direction[0] * t.v + correction.vel.vx;
+        float vy = trans.direction[1] * t.v + correction.vel.vy;
+        float va = rot.direction[0] * a.v + correction.vel.va;
+        float heading = start_heading + rot.direction[0] * a.p + correction.heading_error;
+        SerialVelocity local = {cos(heading) * vx + sin(heading) * vy, -sin(heading) * vx + cos(heading) * vy, va};
+        mock_serial->mock_send_base_odometry({local, static_cast<uint32_t>(driver_time * 1000000), driver_seq++});
+
+        mock_clock->advance_ms(1);
+        driver_time += 0.001;
+    }
+
+    REQUIRE(trans.traj_id == rot.traj_id);
+    CHECK(num_corrections > 0);
+    CHECK(num_corrections < count / 50);
+    StatusUpdater::Status status = s.getStatus();
+    REQUIRE(status.pos_x == Approx(0.5).margin(0.001));
+    REQUIRE(status.pos_y == Approx(0.2).margin(0.001));
+    REQUIRE(status.pos_a == Approx(0.3).margin(0.001));
+}
+
+TEST_CASE("Odometry uses motor driver time", "[RobotController]")
+{
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+    mock_serial->purge_data();
+
+    // First report has nothing to difference against
+    mock_serial->mock_send("base:0.1,0,0,1000000,1");
+    mock_clock->advance_ms(10);
+    r.update();
+    float x = s.getStatus().pos_x;
+    REQUIRE(x == Approx(0.001).margin(0.0001));
+
+    // Pi side delays don't change the integrated distance
+    mock_clock->advance_ms(200);
+    mock_serial->mock_send("base:0.1,0,0,1025000,2");
+    r.update();
+    REQUIRE(s.getStatus().pos_x - x == Approx(0.0025).margin(0.0001));
+    x = s.getStatus().pos_x;
+
+    // Several reports in one loop are each integrated over their own interval
+    mock_serial->mock_send("base:0.1,0,0,1050000,3");
+    mock_serial->mock_send("base:0.2,0,0,1075000,4");
+    r.update();
+    REQUIRE(s.getStatus().pos_x - x == Approx(0.0075).margin(0.0001));
+    x = s.getStatus().pos_x;
+
+    // A lost report is covered by the next one
+    mock_serial->mock_send("base:0.1,0,0,1125000,6");
+    r.update();
+    REQUIRE(s.getStatus().pos_x - x == Approx(0.005).margin(0.0001));
+    x = s.getStatus().pos_x;
+
+    // Driver restarted, fall back to the pi clock
+    mock_clock->advance_ms(10);
+    mock_serial->mock_send("base:0.1,0,0,100,0");
+    r.update();
+    REQUIRE(s.getStatus().pos_x - x == Approx(0.001).margin(0.0001));
+}
+
 void fakeMotionHelper(float x, float y, float a, int max_loops, StatusUpdater& s)
 {
     MockClockWrapper* mock_clock = get_mock_clock_and_reset();
@@ -201,4 +491,260 @@ TEST_CASE("Validate fake_perfect_motion option", "[RobotController]")
 //         std::string cmd_vel = mock_serial->mock_rcv_base();
 //         mock_serial->mock_send(cmd_vel);
 //     };
-// }
\ No newline at end of file
+// }
+TEST_CASE("Update goal mid move", "[RobotController]")
+{
+    SafeConfigModifier<bool> config_modifier("motion.fake_perfect_motion", true);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    mock_serial->purge_data();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    // Nothing to retarget yet
+    r.updateGoal(1, 1, 0);
+    CHECK_FALSE(r.isTrajectoryRunning());
+
+    r.moveToPosition(1, 0, 0);
+    for (int i = 0; i < 800; i++)
+    {
+        r.update();
+        mock_clock->advance_us(1000);
+    }
+    REQUIRE(r.isTrajectoryRunning());
+    float vx_before = s.getStatus().vel_x;
+    REQUIRE(vx_before > 0.1);
+
+    r.updateGoal(0.5, 0.4, 0.2);
+    REQUIRE(r.isTrajectoryRunning());
+    r.update();
+    mock_clock->advance_us(1000);
+    CHECK(s.getStatus().vel_x == Approx(vx_before).margin(0.01));
+
+    int count = 0;
+    while(r.isTrajectoryRunning() && count < 100000)
+    {
+        count++;
+        r.update();
+        mock_clock->advance_us(1000);
+    }
+    CHECK(count < 100000);
+    StatusUpdater::Status status = s.getStatus();
+    CHECK(status.pos_x == Approx(0.5).margin(0.0005));
+    CHECK(status.pos_y == Approx(0.4).margin(0.0005));
+    CHECK(status.pos_a == Approx(0.2).margin(0.0005));
+    CHECK_FALSE(status.error_status);
+}
+
+TEST_CASE("Planned stop fast", "[RobotController]")
+{
+    SafeConfigModifier<bool> config_modifier("motion.fake_perfect_motion", true);
+    SafeConfigModifier<bool> planned_modifier("motion.stop_fast.planned", true);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    mock_serial->purge_data();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    r.moveToPosition(3, 0, 0);
+    for (int i = 0; i < 1000; i++)
+    {
+        r.update();
+        mock_clock->advance_us(1000);
+    }
+    StatusUpdater::Status status = s.getStatus();
+    const float stop_start = status.pos_x;
+    const float predicted = RobotControllerModeStopFast::predictStopDistance({status.vel_x, status.vel_y, status.vel_a});
+    REQUIRE(predicted > 0.01);
+
+    r.stopFast();
+    REQUIRE(r.isTrajectoryRunning());
+    r.update();
+    mock_clock->advance_us(1000);
+    CHECK(s.getStatus().traj_time_remaining > 0);
+    int count = 0;
+    while(r.isTrajectoryRunning() && count < 100000)
+    {
+        count++;
+        r.update();
+        mock_clock->advance_us(1000);
+    }
+    CHECK(count < 100000);
+    status = s.getStatus();
+    CHECK(status.pos_x - stop_start == Approx(predicted).margin(0.01));
+    CHECK(status.pos_x < 3);
+    CHECK_FALSE(status.error_status);
+}
+
+TEST_CASE("Path motion", "[RobotController]")
+{
+    SafeConfigModifier<bool> config_modifier("motion.fake_perfect_motion", true);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    mock_serial->purge_data();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    r.moveAlongPath({{0.3, 0, 0}, {0.6, 0.2, 0.3}, {0.6, 0.5, 0.3}});
+    REQUIRE(r.isTrajectoryRunning());
+
+    int count = 0;
+    while(r.isTrajectoryRunning() && count < 100000)
+    {
+        count++;
+        r.update();
+        mock_clock->advance_us(1000);
+    }
+    CHECK(count < 100000);
+    StatusUpdater::Status status = s.getStatus();
+    CHECK(status.pos_x == Approx(0.6).margin(0.0005));
+    CHECK(status.pos_y == Approx(0.5).margin(0.0005));
+    CHECK(status.pos_a == Approx(0.3).margin(0.0005));
+    // First and last legs are the same move
+    CHECK(status.trajectory_cache_stats.hits == 1);
+    CHECK(status.trajectory_cache_stats.misses == 2);
+    CHECK_FALSE(status.error_status);
+}
+
+TEST_CASE("Driver loop time", "[RobotController]")
+{
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+    mock_serial->purge_data();
+
+    // Only the latest report shows up in the status
+    mock_serial->mock_send_driver_stats({900, 45, 22000, 0});
+    mock_serial->mock_send_driver_stats({1200, 52, 19000, 2});
+    for (int i = 0; i < 20; i++)
+    {
+        r.update();
+        mock_clock->advance_ms(1);
+    }
+
+    StatusUpdater::Status status = s.getStatus();
+    REQUIRE(status.driver_loop_mean_us == 52);
+    REQUIRE(status.driver_loop_max_us == 1200);
+    SerialDriverStats stats;
+    REQUIRE_FALSE(mock_serial->rcv_driver_stats(&stats));
+}
+
+TEST_CASE("Odometry streaming", "[RobotController]")
+{
+    SafeConfigModifier<bool> binary_config_modifier("motion.binary_serial", true);
+    SafeConfigModifier<bool> stream_config_modifier("motion.odometry_stream.enabled", true);
+    SafeConfigModifier<float> limit_config_modifier("motion.limit_max_fraction", 0.8);
+
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    mock_serial->purge_data();
+    r.moveToPosition(0.5, 0.2, 0.3);
+    REQUIRE(mock_serial->mock_rcv_base() == "Power:ON");
+    SERIAL_BINARY_CHANNEL channel;
+    std::string payload;
+    REQUIRE(mock_serial->mock_rcv_frame(&channel, &payload));
+    REQUIRE(channel == SERIAL_BINARY_CHANNEL::STREAM_CONFIG);
+    REQUIRE(payload.size() == SERIAL_STREAM_CONFIG_PAYLOAD_SIZE);
+    SerialStreamConfig config = decodeStreamConfigPayload(reinterpret_cast<const uint8_t*>(payload.data()));
+    REQUIRE(config.period_us == 10000);
+    REQUIRE(config.command_timeout_ms == 300);
+
+    // Stand in for the driver: hold the latest command and report it every 10 ms whether or not a new one came
+    SerialVelocity driver_vel = {0, 0, 0};
+    uint32_t driver_time_us = 0;
+    uint16_t driver_seq = 0;
+    int num_commands = 0;
+    auto run_ms = [&](int ms)
+    {
+        for (int i = 0; i < ms; i++)
+        {
+            r.update();
+            SerialVelocity vel;
+            while(mock_serial->mock_rcv_base_velocity(&vel))
+            {
+                driver_vel = vel;
+                num_commands++;
+            }
+            mock_clock->advance_ms(1);
+            driver_time_us += 1000;
+            if(driver_time_us % 10000 == 0)
+            {
+                mock_serial->mock_send_base_odometry({driver_vel, driver_time_us, driver_seq++});
+            }
+        }
+    };
+
+    int count = 0;
+    while(r.isTrajectoryRunning() && count++ < 100000)
+    {
+        run_ms(1);
+    }
+    StatusUpdater::Status status = s.getStatus();
+    REQUIRE(status.pos_x == Approx(0.5).margin(0.002));
+    REQUIRE(status.pos_y == Approx(0.2).margin(0.002));
+    REQUIRE(status.pos_a == Approx(0.3).margin(0.002));
+
+    // Standing still only the keepalive goes out, at 10 Hz
+    run_ms(20);
+    num_commands = 0;
+    run_ms(1000);
+    CHECK(num_commands >= 9);
+    CHECK(num_commands <= 11);
+    REQUIRE(driver_vel.vx == 0);
+}
+
+TEST_CASE("Odometry stream slower than 16 Hz", "[RobotController]")
+{
+    SafeConfigModifier<bool> binary_config_modifier("motion.binary_serial", true);
+    SafeConfigModifier<bool> stream_config_modifier("motion.odometry_stream.enabled", true);
+    SafeConfigModifier<int> frequency_config_modifier("motion.odometry_stream.frequency", 5);
+
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    get_mock_clock_and_reset();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    mock_serial->purge_data();
+    r.moveToPosition(0.5, 0.2, 0.3);
+    REQUIRE(mock_serial->mock_rcv_base() == "Power:ON");
+    SERIAL_BINARY_CHANNEL channel;
+    std::string payload;
+    REQUIRE(mock_serial->mock_rcv_frame(&channel, &payload));
+    REQUIRE(channel == SERIAL_BINARY_CHANNEL::STREAM_CONFIG);
+    SerialStreamConfig config = decodeStreamConfigPayload(reinterpret_cast<const uint8_t*>(payload.data()));
+    REQUIRE(config.period_us == 200000);
+    REQUIRE(config.command_timeout_ms == 300);
+}
+
+TEST_CASE("Fine move with the approach MPC", "[RobotController]")
+{
+    SafeConfigModifier<bool> mpc_modifier("motion.approach_mpc.enabled", true);
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    StatusUpdater s;
+    RobotController r = RobotController(s);
+
+    mock_serial->purge_data();
+    r.moveToPositionFine(0.1, 0.05, 0.1);
+    REQUIRE(mock_serial->mock_rcv_base() == "Power:ON");
+    int count = 0;
+    while(r.isTrajectoryRunning() && count < 100000)
+    {
+        count++;
+        r.update();
+        // Report back the exact velocity commanded
+        mock_serial->mock_send("base:" + mock_serial->mock_rcv_base());
+        mock_clock->advance_ms(1);
+    }
+    CHECK(count < 100000);
+    StatusUpdater::Status status = s.getStatus();
+    // Within the fine goal tolerance
+    CHECK(status.pos_x == Approx(0.1).margin(0.01));
+    CHECK(status.pos_y == Approx(0.05).margin(0.01));
+    CHECK(status.pos_a == Approx(0.1).margin(0.02));
+    CHECK_FALSE(status.error_status);
+}
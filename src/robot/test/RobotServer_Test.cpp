@@ -4,6 +4,12 @@
 #include "StatusUpdater.h"
 #include "test-utils.h"
 #include "sockets/MockSocketMultiThreadWrapper.h"
+#include "sockets/MockUdpChannel.h"
+#include "sockets/MockMonitorServer.h"
+#include "sockets/SocketMultiThreadWrapperFactory.h"
+
+#include <cstring>
+#include <ArduinoJson/ArduinoJson.h>
 
 
 void testSimpleCommand(RobotServer& r, std::string msg, std::string expected_resp, COMMAND expected_command)
@@ -85,6 +91,64 @@ TEST_CASE("Move const vel", "[RobotServer]")
     REQUIRE(data.t == 4);
 }
 
+TEST_CASE("Move path", "[RobotServer]")
+{
+    std::string msg = "<{'type':'move_path','data':{'points':[[1,2,3],[4,5,6]]}}>";
+    std::string expected_response = "<{\"type\":\"ack\",\"data\":\"move_path\"}>";
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    testSimpleCommand(r, msg, expected_response, COMMAND::MOVE_PATH);
+
+    const std::vector<RobotServer::PositionData>& data = r.getPathData();
+    REQUIRE(data.size() == 2);
+    REQUIRE(data[0].x == 1);
+    REQUIRE(data[0].y == 2);
+    REQUIRE(data[0].a == 3);
+    REQUIRE(data[1].x == 4);
+    REQUIRE(data[1].y == 5);
+    REQUIRE(data[1].a == 6);
+
+    // A full path fits in the parse buffer
+    std::string points;
+    for (int i = 0; i < MAX_PATH_WAYPOINTS; i++) points += std::string(i ? "," : "") + "[10.125,-20.125,3.125]";
+    msg = "<{'type':'move_path','queue':true,'seq':4294967295,'data':{'points':[" + points + "]}}>";
+    testSimpleCommand(r, msg, expected_response, COMMAND::MOVE_PATH);
+    REQUIRE(r.getPathData().size() == MAX_PATH_WAYPOINTS);
+    REQUIRE(r.getPathData()[MAX_PATH_WAYPOINTS - 1].y == -20.125);
+
+    msg = "<{'type':'move_path','data':{'points':[]}}>";
+    expected_response = "<{\"type\":\"ack\",\"data\":\"bad_path\"}>";
+    testSimpleCommand(r, msg, expected_response, COMMAND::NONE);
+}
+
+TEST_CASE("Queued command", "[RobotServer]")
+{
+    std::string msg = "<{'type':'move_path','queue':true,'seq':7,'data':{'points':[[1,2,3],[4,5,6]]}}>";
+    std::string expected_response = "<{\"type\":\"ack\",\"data\":\"move_path\"}>";
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    testSimpleCommand(r, msg, expected_response, COMMAND::MOVE_PATH);
+    REQUIRE(r.isQueueRequested());
+
+    RobotServer::CommandData data = r.getCommandData(COMMAND::MOVE_PATH);
+    REQUIRE(data.cmd == COMMAND::MOVE_PATH);
+    REQUIRE(data.seq == 7);
+    REQUIRE(data.num_path_points == 2);
+    REQUIRE(data.path[1].x == 4);
+    REQUIRE(data.path[1].a == 6);
+
+    // Later commands don't inherit the flag or sequence id
+    msg = "<{'type':'move','data':{'x':1,'y':2,'a':3}}>";
+    expected_response = "<{\"type\":\"ack\",\"data\":\"move\"}>";
+    testSimpleCommand(r, msg, expected_response, COMMAND::MOVE);
+    REQUIRE_FALSE(r.isQueueRequested());
+    data = r.getCommandData(COMMAND::MOVE);
+    REQUIRE(data.seq == 0);
+    REQUIRE(data.move.y == 2);
+}
+
 TEST_CASE("Place", "[RobotServer]")
 {
     std::string msg = "<{'type':'place'}>";
@@ -96,6 +160,40 @@ TEST_CASE("Place", "[RobotServer]")
     testSimpleCommand(r, msg, expected_response, expected_command);
 }
 
+TEST_CASE("Field plan upload", "[RobotServer]")
+{
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    std::string msg = "<{'type':'field_plan_upload','data':{'id':5,'first':2,'total':4,'steps':[3,1.5,-0.5,0.25,6,0,0,0]}}>";
+    std::string expected_response = "<{\"type\":\"ack\",\"data\":\"field_plan_upload\"}>";
+    testSimpleCommand(r, msg, expected_response, COMMAND::FIELD_PLAN_UPLOAD);
+
+    const RobotServer::FieldPlanChunk& chunk = r.getFieldPlanChunk();
+    REQUIRE(chunk.id == 5);
+    REQUIRE(chunk.first == 2);
+    REQUIRE(chunk.total == 4);
+    REQUIRE(chunk.num_steps == 2);
+    REQUIRE(chunk.steps[0].cmd == static_cast<uint8_t>(COMMAND::MOVE_FINE));
+    REQUIRE(chunk.steps[0].x == 1.5);
+    REQUIRE(chunk.steps[0].y == -0.5);
+    REQUIRE(chunk.steps[0].a == 0.25);
+    REQUIRE(chunk.steps[1].cmd == static_cast<uint8_t>(COMMAND::PLACE_TRAY));
+
+    // A full chunk fits in the parse buffer
+    std::string steps;
+    for (int i = 0; i < FIELD_PLAN_CHUNK_STEPS; i++) steps += std::string(i ? "," : "") + "1,10.125,-20.125,3.125";
+    msg = "<{'type':'field_plan_upload','data':{'id':5,'first':0,'total':16,'steps':[" + steps + "]}}>";
+    testSimpleCommand(r, msg, expected_response, COMMAND::FIELD_PLAN_UPLOAD);
+    REQUIRE(r.getFieldPlanChunk().num_steps == FIELD_PLAN_CHUNK_STEPS);
+    REQUIRE(r.getFieldPlanChunk().steps[FIELD_PLAN_CHUNK_STEPS - 1].a == 3.125);
+
+    // Relative moves, partial steps and steps past the end of the plan
+    expected_response = "<{\"type\":\"ack\",\"data\":\"bad_plan\"}>";
+    testSimpleCommand(r, "<{'type':'field_plan_upload','data':{'id':5,'first':0,'total':1,'steps':[2,1,0,0]}}>", expected_response, COMMAND::NONE);
+    testSimpleCommand(r, "<{'type':'field_plan_upload','data':{'id':5,'first':0,'total':1,'steps':[1,1,0]}}>", expected_response, COMMAND::NONE);
+    testSimpleCommand(r, "<{'type':'field_plan_upload','data':{'id':5,'first':1,'total':1,'steps':[1,1,0,0]}}>", expected_response, COMMAND::NONE);
+}
+
 TEST_CASE("Load", "[RobotServer]")
 {
     std::string msg = "<{'type':'load'}>";
@@ -119,6 +217,17 @@ TEST_CASE("Init tray", "[RobotServer]")
     testSimpleCommand(r, msg, expected_response, expected_command);
 }
 
+TEST_CASE("Dump trace", "[RobotServer]")
+{
+    std::string msg = "<{'type':'dump_trace'}>";
+    std::string expected_response = "<{\"type\":\"ack\",\"data\":\"dump_trace\"}>";
+    COMMAND expected_command = COMMAND::DUMP_TRACE;
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    testSimpleCommand(r, msg, expected_response, expected_command);
+}
+
 TEST_CASE("Send position", "[RobotServer]")
 {
     std::string msg = "<{'type':'p','data':{'x':1,'y':2,'a':3}}>";
@@ -133,6 +242,151 @@ TEST_CASE("Send position", "[RobotServer]")
     REQUIRE(data.x == 1);
     REQUIRE(data.y == 2);
     REQUIRE(data.a == 3);
+    ClockTimePoint time;
+    REQUIRE_FALSE(r.getPositionTime(&time));
+}
+
+TEST_CASE("Send position with time", "[RobotServer]")
+{
+    std::string msg = "<{'type':'p','data':{'x':1,'y':2,'a':3,'t':1234.5}}>";
+    std::string expected_response = "<{\"type\":\"ack\",\"data\":\"p\"}>";
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    testSimpleCommand(r, msg, expected_response, COMMAND::POSITION);
+
+    ClockTimePoint time;
+    REQUIRE(r.getPositionTime(&time));
+    CHECK(clockToSeconds(time) == Approx(1234.5));
+}
+
+TEST_CASE("Time sync", "[RobotServer]")
+{
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+
+    mock_socket->sendMockData("<{'type':'time_sync','data':{'t0':42.25}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+
+    std::string resp = mock_socket->getMockData();
+    REQUIRE(resp.size() > 2);
+    StaticJsonDocument<128> doc;
+    REQUIRE_FALSE(deserializeJson(doc, resp.substr(1, resp.size() - 2)));
+    CHECK(doc["type"].as<std::string>() == "time_sync");
+    CHECK(doc["data"]["t0"].as<double>() == Approx(42.25));
+    CHECK(doc["data"]["t1"].as<double>() == Approx(clockToSeconds(mock_clock->now())));
+    CHECK(doc["data"]["t2"].as<double>() >= doc["data"]["t1"].as<double>());
+}
+
+TEST_CASE("Ping", "[RobotServer]")
+{
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+
+    mock_socket->sendMockData("<{'type':'ping','data':{'t':12.5}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    REQUIRE(mock_socket->getMockData() == "<{\"type\":\"pong\",\"data\":{\"t\":12.5}}>");
+
+    // Master reports the round trip it measured with the next ping
+    mock_socket->sendMockData("<{'type':'ping','data':{'t':13.5,'rtt':4.25}}>");
+    mock_socket->sendMockData("<{'type':'status'}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    REQUIRE(mock_socket->getMockData() == "<{\"type\":\"pong\",\"data\":{\"t\":13.5}}>");
+    REQUIRE_THAT(mock_socket->getMockData(), Catch::Matchers::Contains("\"socket_ping_rtt_ms\":4.25"));
+}
+
+TEST_CASE("Plan", "[RobotServer]")
+{
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    auto plan = [&](const std::string& msg, JsonDocument& doc)
+    {
+        mock_socket->sendMockData(msg);
+        REQUIRE(r.oneLoop() == COMMAND::NONE);
+        std::string resp = mock_socket->getMockData();
+        REQUIRE(resp.size() > 2);
+        REQUIRE_FALSE(deserializeJson(doc, resp.substr(1, resp.size() - 2)));
+        REQUIRE(doc["type"].as<std::string>() == "plan");
+    };
+
+    StaticJsonDocument<512> doc;
+    plan("<{'type':'plan','data':{'move':'move','x':1,'y':0,'a':0}}>", doc);
+    REQUIRE(doc["data"]["ok"].as<bool>());
+    const float duration = doc["data"]["duration"].as<float>();
+    REQUIRE(duration > 0);
+    REQUIRE(doc["data"]["trans_switch"].size() == 8);
+    REQUIRE(doc["data"]["trans_switch"][7].as<float>() == Approx(duration));
+    // The test config accelerates far harder than the real wheels can
+    REQUIRE_FALSE(doc["data"]["wheels"]["ok"].as<bool>());
+    REQUIRE(doc["data"]["wheels"]["max_acc"].as<float>() > 0.388);
+
+    // Samples run from the start to the end of the move
+    DynamicJsonDocument sampled(8192);
+    plan("<{'type':'plan','data':{'move':'move','x':1,'y':0,'a':0,'start':[0,0,0],'samples':20}}>", sampled);
+    JsonArray samples = sampled["data"]["samples"].as<JsonArray>();
+    REQUIRE(samples.size() == 20);
+    REQUIRE(samples[0][0].as<float>() == 0);
+    REQUIRE(samples[0][1].as<float>() == Approx(0));
+    REQUIRE(samples[19][0].as<float>() == Approx(duration));
+    REQUIRE(samples[19][1].as<float>() == Approx(1));
+    REQUIRE(samples[10][1].as<float>() > samples[9][1].as<float>());
+
+    // Relative moves are planned from the given start the same as the absolute move they become
+    StaticJsonDocument<512> rel;
+    plan("<{'type':'plan','data':{'move':'move_rel','x':1,'y':0,'a':0,'start':[2,3,1.5708]}}>", rel);
+    REQUIRE(rel["data"]["ok"].as<bool>());
+    REQUIRE(rel["data"]["duration"].as<float>() == Approx(duration));
+
+    StaticJsonDocument<512> fine;
+    plan("<{'type':'plan','data':{'move':'move_fine','x':1,'y':0,'a':0}}>", fine);
+    REQUIRE(fine["data"]["ok"].as<bool>());
+    REQUIRE(fine["data"]["duration"].as<float>() > 0);
+
+    StaticJsonDocument<512> path;
+    plan("<{'type':'plan','data':{'move':'move_path','points':[[1,0,0],[1,1,0]]}}>", path);
+    REQUIRE(path["data"]["ok"].as<bool>());
+    REQUIRE(path["data"]["duration"].as<float>() > duration);
+    REQUIRE_FALSE(path["data"].containsKey("trans_switch"));
+
+    StaticJsonDocument<512> vision;
+    plan("<{'type':'plan','data':{'move':'move_vision','x':1,'y':0,'a':0}}>", vision);
+    REQUIRE_FALSE(vision["data"]["ok"].as<bool>());
+    REQUIRE(vision["data"]["error"].as<std::string>() == "unsupported");
+    REQUIRE(mock_socket->getMockData() == "");
+}
+
+TEST_CASE("Set and get param", "[RobotServer]")
+{
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    SafeConfigModifier<float> kp_modifier("motion.rotation.gains.kp", 2.0);
+    SafeConfigModifier<bool> planned_modifier("motion.stop_fast.planned", false);
+
+    mock_socket->sendMockData("<{'type':'set_param','data':{'name':'motion.rotation.gains.kp','value':2.5}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    REQUIRE(mock_socket->getMockData() == "<{\"type\":\"param\",\"data\":{\"name\":\"motion.rotation.gains.kp\",\"value\":2.5,\"pending\":true,\"ok\":true}}>");
+
+    mock_socket->sendMockData("<{'type':'set_param','data':{'name':'motion.stop_fast.planned','value':true}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    REQUIRE_THAT(mock_socket->getMockData(), Catch::Matchers::Contains("\"value\":1,\"pending\":true,\"ok\":true"));
+
+    mock_socket->sendMockData("<{'type':'set_param','data':{'name':'motion.rotation.gains.kp','value':'high'}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    REQUIRE_THAT(mock_socket->getMockData(), Catch::Matchers::Contains("\"ok\":false,\"error\":\"bad_value\""));
+
+    mock_socket->sendMockData("<{'type':'get_param','data':{'name':'udp.enabled'}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    REQUIRE(mock_socket->getMockData() == "<{\"type\":\"param\",\"data\":{\"name\":\"udp.enabled\",\"ok\":false,\"error\":\"not_tunable\"}}>");
+
+    ConfigSnapshot::applyPendingParams();
+    mock_socket->sendMockData("<{'type':'get_param','data':{'name':'motion.rotation.gains.kp'}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    REQUIRE_THAT(mock_socket->getMockData(), Catch::Matchers::Contains("\"value\":2.5,\"pending\":false"));
 }
 
 TEST_CASE("Estop", "[RobotServer]")
@@ -156,4 +410,458 @@ TEST_CASE("Load complete", "[RobotServer]")
     StatusUpdater s;
     RobotServer r = RobotServer(s);
     testSimpleCommand(r, msg, expected_response, expected_command);
-}
\ No newline at end of file
+}
+
+std::string makeBinaryFrame(uint8_t id, const std::string& payload)
+{
+    size_t body_len = payload.size() + 1;
+    std::string frame;
+    frame += BINARY_START_CHAR;
+    frame += static_cast<char>(body_len & 0xFF);
+    frame += static_cast<char>((body_len >> 8) & 0xFF);
+    frame += static_cast<char>(id);
+    frame += payload;
+    return frame;
+}
+
+std::string packFloats(std::vector<float> data)
+{
+    return std::string(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+}
+
+TEST_CASE("Binary move", "[RobotServer]")
+{
+    uint8_t id = static_cast<uint8_t>(COMMAND::MOVE);
+    std::string msg = makeBinaryFrame(id, packFloats({1,2,3}));
+    std::string expected_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ACK), std::string(1, id));
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    testSimpleCommand(r, msg, expected_response, COMMAND::MOVE);
+
+    RobotServer::PositionData data = r.getMoveData();
+    REQUIRE(data.x == 1);
+    REQUIRE(data.y == 2);
+    REQUIRE(data.a == 3);
+}
+
+TEST_CASE("Binary position with time", "[RobotServer]")
+{
+    uint8_t id = static_cast<uint8_t>(COMMAND::POSITION);
+    double t = 1234.5;
+    std::string payload = packFloats({1,2,3}) + std::string(reinterpret_cast<const char*>(&t), sizeof(t));
+    std::string msg = makeBinaryFrame(id, payload);
+    std::string expected_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ACK), std::string(1, id));
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    testSimpleCommand(r, msg, expected_response, COMMAND::POSITION);
+
+    RobotServer::PositionData data = r.getPositionData();
+    REQUIRE(data.x == 1);
+    REQUIRE(data.a == 3);
+    ClockTimePoint time;
+    REQUIRE(r.getPositionTime(&time));
+    CHECK(clockToSeconds(time) == Approx(1234.5));
+}
+
+TEST_CASE("Binary ping", "[RobotServer]")
+{
+    double t = 99.125;
+    float rtt = 3.5;
+    std::string stamp(reinterpret_cast<const char*>(&t), sizeof(t));
+    std::string expected_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::PONG), stamp);
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    testSimpleCommand(r, makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::PING), stamp), expected_response, COMMAND::NONE);
+    testSimpleCommand(r, makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::PING), stamp + std::string(reinterpret_cast<const char*>(&rtt), sizeof(rtt))),
+                      expected_response, COMMAND::NONE);
+    testSimpleCommand(r, makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::PING), "abc"),
+                      makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ERR), std::string(1, static_cast<char>(BINARY_ERR::BAD_PAYLOAD))), COMMAND::NONE);
+}
+
+TEST_CASE("Binary move const vel", "[RobotServer]")
+{
+    uint8_t id = static_cast<uint8_t>(COMMAND::MOVE_CONST_VEL);
+    // Payload contains the JSON framing characters to make sure they are not treated specially
+    std::string msg = makeBinaryFrame(id, packFloats({1,2,3,4}) + "<>");
+    std::string expected_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ERR), 
+                                                    std::string(1, static_cast<char>(BINARY_ERR::BAD_PAYLOAD)));
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    testSimpleCommand(r, msg, expected_response, COMMAND::NONE);
+
+    msg = makeBinaryFrame(id, packFloats({1,2,3,4}));
+    expected_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ACK), std::string(1, id));
+    testSimpleCommand(r, msg, expected_response, COMMAND::MOVE_CONST_VEL);
+
+    RobotServer::VelocityData data = r.getVelocityData();
+    REQUIRE(data.vx == 1);
+    REQUIRE(data.vy == 2);
+    REQUIRE(data.va == 3);
+    REQUIRE(data.t == 4);
+}
+
+TEST_CASE("Binary move path", "[RobotServer]")
+{
+    uint8_t id = static_cast<uint8_t>(COMMAND::MOVE_PATH);
+    std::string bad_payload_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ERR), 
+                                                       std::string(1, static_cast<char>(BINARY_ERR::BAD_PAYLOAD)));
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    // Not a whole number of points
+    testSimpleCommand(r, makeBinaryFrame(id, packFloats({1,2,3,4})), bad_payload_response, COMMAND::NONE);
+
+    std::string msg = makeBinaryFrame(id, packFloats({1,2,3,4,5,6,7,8,9}));
+    std::string expected_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ACK), std::string(1, id));
+    testSimpleCommand(r, msg, expected_response, COMMAND::MOVE_PATH);
+
+    const std::vector<RobotServer::PositionData>& data = r.getPathData();
+    REQUIRE(data.size() == 3);
+    REQUIRE(data[2].x == 7);
+    REQUIRE(data[2].y == 8);
+    REQUIRE(data[2].a == 9);
+}
+
+TEST_CASE("Binary field plan upload", "[RobotServer]")
+{
+    uint8_t id = static_cast<uint8_t>(COMMAND::FIELD_PLAN_UPLOAD);
+    const uint32_t plan_id = 9;
+    const uint16_t first = 1;
+    const uint16_t total = 3;
+    std::string header = std::string(reinterpret_cast<const char*>(&plan_id), sizeof(plan_id)) +
+                         std::string(reinterpret_cast<const char*>(&first), sizeof(first)) +
+                         std::string(reinterpret_cast<const char*>(&total), sizeof(total));
+    std::string payload = header + std::string(1, static_cast<char>(COMMAND::MOVE_WITH_VISION)) + packFloats({1,2,3}) +
+                          std::string(1, static_cast<char>(COMMAND::LOAD_TRAY)) + packFloats({0,0,0});
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    std::string expected_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ACK), std::string(1, id));
+    testSimpleCommand(r, makeBinaryFrame(id, payload), expected_response, COMMAND::FIELD_PLAN_UPLOAD);
+    const RobotServer::FieldPlanChunk& chunk = r.getFieldPlanChunk();
+    REQUIRE(chunk.id == 9);
+    REQUIRE(chunk.first == 1);
+    REQUIRE(chunk.total == 3);
+    REQUIRE(chunk.num_steps == 2);
+    REQUIRE(chunk.steps[0].cmd == static_cast<uint8_t>(COMMAND::MOVE_WITH_VISION));
+    REQUIRE(chunk.steps[0].y == 2);
+    REQUIRE(chunk.steps[1].cmd == static_cast<uint8_t>(COMMAND::LOAD_TRAY));
+
+    std::string bad_payload_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ERR),
+                                                       std::string(1, static_cast<char>(BINARY_ERR::BAD_PAYLOAD)));
+    testSimpleCommand(r, makeBinaryFrame(id, header), bad_payload_response, COMMAND::NONE);
+    testSimpleCommand(r, makeBinaryFrame(id, payload.substr(0, payload.size() - 1)), bad_payload_response, COMMAND::NONE);
+}
+
+TEST_CASE("Binary queued command", "[RobotServer]")
+{
+    uint8_t id = static_cast<uint8_t>(COMMAND::MOVE_REL);
+    uint32_t seq = 42;
+    std::string seq_bytes(reinterpret_cast<const char*>(&seq), sizeof(seq));
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    std::string bad_payload_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ERR), 
+                                                       std::string(1, static_cast<char>(BINARY_ERR::BAD_PAYLOAD)));
+    testSimpleCommand(r, makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::QUEUE), seq_bytes), bad_payload_response, COMMAND::NONE);
+
+    // The wrapped command is acked with its own id
+    std::string msg = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::QUEUE), seq_bytes + std::string(1, id) + packFloats({1,2,3}));
+    std::string expected_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ACK), std::string(1, id));
+    testSimpleCommand(r, msg, expected_response, COMMAND::MOVE_REL);
+    REQUIRE(r.isQueueRequested());
+    RobotServer::CommandData data = r.getCommandData(COMMAND::MOVE_REL);
+    REQUIRE(data.seq == 42);
+    REQUIRE(data.move.x == 1);
+    REQUIRE(data.move.a == 3);
+
+    testSimpleCommand(r, makeBinaryFrame(id, packFloats({1,2,3})), expected_response, COMMAND::MOVE_REL);
+    REQUIRE_FALSE(r.isQueueRequested());
+}
+
+TEST_CASE("Binary unknown id", "[RobotServer]")
+{
+    std::string msg = makeBinaryFrame(0x7F, "");
+    std::string expected_response = makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::ERR), 
+                                                    std::string(1, static_cast<char>(BINARY_ERR::UNKNOWN_ID)));
+
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    testSimpleCommand(r, msg, expected_response, COMMAND::NONE);
+}
+
+TEST_CASE("Binary status", "[RobotServer]")
+{
+    StatusUpdater s;
+    s.updatePosition(1,2,3);
+    s.updateInProgress(true);
+    RobotServer r = RobotServer(s);
+
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    mock_socket->sendMockData(makeBinaryFrame(static_cast<uint8_t>(BINARY_MSG::STATUS_REQ), ""));
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+
+    std::string resp = mock_socket->getMockData();
+    REQUIRE(resp.size() == 4 + sizeof(BinaryStatus));
+    REQUIRE(resp[0] == BINARY_START_CHAR);
+    REQUIRE(static_cast<uint8_t>(resp[3]) == static_cast<uint8_t>(BINARY_MSG::STATUS));
+
+    BinaryStatus status;
+    std::memcpy(&status, resp.data() + 4, sizeof(BinaryStatus));
+    REQUIRE(status.version == BINARY_STATUS_VERSION);
+    REQUIRE(status.pos_x == 1);
+    REQUIRE(status.pos_y == 2);
+    REQUIRE(status.pos_a == 3);
+    REQUIRE(status.flags & STATUS_FLAG_IN_PROGRESS);
+    REQUIRE_FALSE(status.flags & STATUS_FLAG_ERROR);
+}
+
+TEST_CASE("Status subscribe", "[RobotServer]")
+{
+    SafeConfigModifier<bool> config_modifier("motion.rate_always_ready", true);
+    StatusUpdater s;
+    s.updatePosition(1,2,3);
+    RobotServer r = RobotServer(s);
+
+    std::string msg = "<{'type':'status_subscribe','data':{'rate':10,'mask':1}}>";
+    std::string expected_response = "<{\"type\":\"ack\",\"data\":\"status_subscribe\"}>";
+    testSimpleCommand(r, msg, expected_response, COMMAND::NONE);
+
+    // First push goes out on the same loop as the subscribe ack
+    MockSocketMultiThreadWrapper* mock_socket = get_mock_socket();
+    std::string resp = mock_socket->getMockData();
+    REQUIRE_THAT(resp, Catch::Matchers::Contains("\"type\":\"status_delta\""));
+    REQUIRE_THAT(resp, Catch::Matchers::Contains("\"pos_x\":1"));
+    REQUIRE_THAT(resp, !Catch::Matchers::Contains("vel_x"));
+
+    // No changes means nothing is pushed
+    r.oneLoop();
+    REQUIRE(mock_socket->getMockData() == "");
+
+    s.updatePosition(4,2,3);
+    r.oneLoop();
+    resp = mock_socket->getMockData();
+    REQUIRE_THAT(resp, Catch::Matchers::Contains("\"pos_x\":4"));
+    REQUIRE_THAT(resp, !Catch::Matchers::Contains("pos_y"));
+
+    // Unsubscribe
+    msg = "<{'type':'status_subscribe','data':{'rate':0}}>";
+    expected_response = "<{\"type\":\"ack\",\"data\":\"status_subscribe\"}>";
+    testSimpleCommand(r, msg, expected_response, COMMAND::NONE);
+    s.updatePosition(5,2,3);
+    r.oneLoop();
+    REQUIRE(mock_socket->getMockData() == "");
+}
+
+std::string makeUdpDatagram(uint32_t seq, uint8_t id, const std::string& payload)
+{
+    return std::string(reinterpret_cast<const char*>(&seq), sizeof(seq)) + static_cast<char>(id) + payload;
+}
+
+MockUdpChannel* build_and_get_mock_udp()
+{
+    MockUdpChannel* udp = dynamic_cast<MockUdpChannel*>(SocketMultiThreadWrapperFactory::getFactoryInstance()->get_udp_channel());
+    udp->purge_data();
+    return udp;
+}
+
+TEST_CASE("UDP position", "[RobotServer]")
+{
+    SafeConfigModifier<bool> config_modifier("udp.enabled", true);
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    MockUdpChannel* udp = build_and_get_mock_udp();
+    const uint8_t id = static_cast<uint8_t>(COMMAND::POSITION);
+
+    // Only the newest of a burst is used and nothing is acked
+    udp->mock_add_datagram(makeUdpDatagram(1, id, packFloats({1,2,3})));
+    udp->mock_add_datagram(makeUdpDatagram(2, id, packFloats({4,5,6})));
+    REQUIRE(r.oneLoop() == COMMAND::POSITION);
+    REQUIRE(r.getPositionData().x == 4);
+    REQUIRE(mock_socket->getMockData() == "");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+
+    // Reordered datagrams are dropped
+    udp->mock_add_datagram(makeUdpDatagram(2, id, packFloats({7,8,9})));
+    udp->mock_add_datagram(makeUdpDatagram(1, id, packFloats({7,8,9})));
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+
+    double t = 1234.5;
+    std::string payload = packFloats({7,8,9}) + std::string(reinterpret_cast<const char*>(&t), sizeof(t));
+    udp->mock_add_datagram(makeUdpDatagram(3, id, payload));
+    REQUIRE(r.oneLoop() == COMMAND::POSITION);
+    REQUIRE(r.getPositionData().a == 9);
+    ClockTimePoint time;
+    REQUIRE(r.getPositionTime(&time));
+    CHECK(clockToSeconds(time) == Approx(1234.5));
+
+    // A TCP command that loop goes first and the position waits for the next one
+    udp->mock_add_datagram(makeUdpDatagram(4, id, packFloats({1,1,1})));
+    mock_socket->sendMockData("<{'type':'place'}>");
+    REQUIRE(r.oneLoop() == COMMAND::PLACE_TRAY);
+    REQUIRE(r.oneLoop() == COMMAND::POSITION);
+    REQUIRE(r.getPositionData().y == 1);
+
+    // Sequence wraps around
+    udp->mock_add_datagram(makeUdpDatagram(0x7FFFFFFF, id, packFloats({2,2,2})));
+    udp->mock_add_datagram(makeUdpDatagram(0xF0000000, id, packFloats({2,2,2})));
+    udp->mock_add_datagram(makeUdpDatagram(0xFFFFFFFF, id, packFloats({2,2,2})));
+    udp->mock_add_datagram(makeUdpDatagram(1, id, packFloats({3,3,3})));
+    udp->mock_add_datagram(makeUdpDatagram(0xFFFFFFFE, id, packFloats({4,4,4})));
+    REQUIRE(r.oneLoop() == COMMAND::POSITION);
+    REQUIRE(r.getPositionData().x == 3);
+}
+
+TEST_CASE("UDP status stream", "[RobotServer]")
+{
+    SafeConfigModifier<bool> udp_modifier("udp.enabled", true);
+    SafeConfigModifier<bool> rate_modifier("motion.rate_always_ready", true);
+    StatusUpdater s;
+    s.updatePosition(1,2,3);
+    RobotServer r = RobotServer(s);
+    build_and_get_mock_socket();
+    MockUdpChannel* udp = build_and_get_mock_udp();
+
+    // Nothing is streamed until a peer checks in
+    r.oneLoop();
+    REQUIRE(udp->mock_get_sent() == "");
+
+    udp->mock_add_datagram(makeUdpDatagram(1, static_cast<uint8_t>(BINARY_MSG::CHECK), ""));
+    r.oneLoop();
+    r.oneLoop();
+    for(uint32_t expected_seq = 1; expected_seq <= 2; expected_seq++)
+    {
+        std::string datagram = udp->mock_get_sent();
+        REQUIRE(datagram.size() == UDP_SEQ_SIZE + 1 + sizeof(BinaryStatus));
+        uint32_t seq;
+        std::memcpy(&seq, datagram.data(), sizeof(seq));
+        REQUIRE(seq == expected_seq);
+        REQUIRE(static_cast<uint8_t>(datagram[UDP_SEQ_SIZE]) == static_cast<uint8_t>(BINARY_MSG::STATUS));
+        BinaryStatus status;
+        std::memcpy(&status, datagram.data() + UDP_SEQ_SIZE + 1, sizeof(BinaryStatus));
+        REQUIRE(status.pos_y == 2);
+    }
+    REQUIRE(udp->mock_get_sent() == "");
+}
+
+TEST_CASE("Burst of messages in one loop", "[RobotServer]")
+{
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+
+    // Positions collapse to the newest one, everything up to the next command is handled in the same loop
+    mock_socket->sendMockData("<{'type':'p','data':{'x':1,'y':2,'a':3}}><{'type':'check'}>"
+                              "<{'type':'p','data':{'x':4,'y':5,'a':6}}><{'type':'move','data':{'x':7,'y':8,'a':9}}>"
+                              "<{'type':'estop'}>");
+    REQUIRE(r.oneLoop() == COMMAND::MOVE);
+    // All four acks went out in one write
+    REQUIRE(mock_socket->mock_get_send_count() == 1);
+    for(std::string ack : {"p", "check", "p", "move"})
+    {
+        REQUIRE(mock_socket->getMockData() == "<{\"type\":\"ack\",\"data\":\"" + ack + "\"}>");
+    }
+    REQUIRE(mock_socket->getMockData() == "");
+    REQUIRE(r.getMoveData().x == 7);
+
+    REQUIRE(r.oneLoop() == COMMAND::ESTOP);
+    REQUIRE(r.oneLoop() == COMMAND::POSITION);
+    REQUIRE(r.getPositionData().x == 4);
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+}
+
+TEST_CASE("Frame too big to send doesn't drop the rest", "[RobotServer]")
+{
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    mock_socket->mock_set_send_limit(256);
+
+    mock_socket->sendMockData("<{'type':'status'}><{'type':'check'}>");
+    r.oneLoop();
+    // The status doesn't fit, the ack after it still goes out on its own
+    REQUIRE(mock_socket->getMockData() == "<{\"type\":\"ack\",\"data\":\"check\"}>");
+    REQUIRE(mock_socket->getMockData() == "");
+}
+
+TEST_CASE("Monitor status stream", "[RobotServer]")
+{
+    SafeConfigModifier<bool> monitor_modifier("monitor.enabled", true);
+    SafeConfigModifier<bool> rate_modifier("motion.rate_always_ready", true);
+    StatusUpdater s;
+    s.updatePosition(1,2,3);
+    RobotServer r = RobotServer(s);
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    MockMonitorServer* monitor = dynamic_cast<MockMonitorServer*>(SocketMultiThreadWrapperFactory::getFactoryInstance()->get_monitor_server());
+    monitor->purge_data();
+
+    // Nothing is serialized without anyone to send it to
+    r.oneLoop();
+    REQUIRE(monitor->mock_get_published() == "");
+
+    monitor->mock_set_has_clients(true);
+    r.oneLoop();
+    std::string frame = monitor->mock_get_published();
+    REQUIRE(frame.front() == START_CHAR);
+    REQUIRE(frame.back() == END_CHAR);
+    REQUIRE_THAT(frame, Catch::Matchers::Contains("\"pos_x\":1"));
+    // The master link sees none of it
+    REQUIRE(mock_socket->getMockData() == "");
+    monitor->purge_data();
+}
+
+TEST_CASE("Session resume after reconnect", "[RobotServer]")
+{
+    StatusUpdater s;
+    RobotServer r = RobotServer(s);
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    StaticJsonDocument<512> doc;
+
+    mock_socket->sendMockData("<{'type':'session','data':{'id':0}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    deserializeJson(doc, mock_socket->getMockData().substr(1));
+    REQUIRE(doc["type"].as<std::string>() == "session");
+    REQUIRE_FALSE(doc["data"]["resumed"].as<bool>());
+    REQUIRE(doc["data"]["tx"].as<uint32_t>() == 0);
+    const uint32_t id = doc["data"]["id"].as<uint32_t>();
+    REQUIRE(id != 0);
+
+    // Frames 0 to 2, master only gets as far as the move ack
+    mock_socket->sendMockData("<{'type':'move','data':{'x':1,'y':2,'a':3}}>");
+    REQUIRE(r.oneLoop() == COMMAND::MOVE);
+    mock_socket->sendMockData("<{'type':'status'}><{'type':'check'}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+
+    // Half a message from the old client is dropped along with its unread replies
+    mock_socket->sendMockData("<{'type':'estop'");
+    mock_socket->mock_reconnect();
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    REQUIRE(mock_socket->mock_get_accepted_id() == 1);
+    REQUIRE(mock_socket->getMockData() == "");
+
+    // The status is stale by now so only the check ack is sent again
+    mock_socket->sendMockData("<{'type':'session','data':{'id':" + std::to_string(id) + ",'rx':1}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    deserializeJson(doc, mock_socket->getMockData().substr(1));
+    REQUIRE(doc["data"]["id"].as<uint32_t>() == id);
+    REQUIRE(doc["data"]["resumed"].as<bool>());
+    REQUIRE(doc["data"]["tx"].as<uint32_t>() == 3);
+    REQUIRE(doc["data"]["replayed"].as<int>() == 1);
+    REQUIRE(doc["data"].containsKey("cmd_seq"));
+    REQUIRE(mock_socket->getMockData() == "<{\"type\":\"ack\",\"data\":\"check\"}>");
+    REQUIRE(mock_socket->getMockData() == "");
+
+    // A session that can't be resumed starts over
+    mock_socket->sendMockData("<{'type':'session','data':{'id':" + std::to_string(id) + ",'rx':100}}>");
+    REQUIRE(r.oneLoop() == COMMAND::NONE);
+    deserializeJson(doc, mock_socket->getMockData().substr(1));
+    REQUIRE_FALSE(doc["data"]["resumed"].as<bool>());
+    REQUIRE(doc["data"]["tx"].as<uint32_t>() == 0);
+    REQUIRE(doc["data"]["id"].as<uint32_t>() != id);
+    mock_socket->purge_data();
+}
@@ -1,9 +1,15 @@
 #include <Catch/catch.hpp>
 
 #include "robot.h"
+#include "ConfigSnapshot.h"
+#include "camera_tracker/CameraTrackerFactory.h"
+#include "camera_tracker/CameraTrackerMock.h"
 
 #include "test-utils.h"
 
+#include <cstdio>
+#include <unistd.h>
+
 TEST_CASE("Robot move", "[Robot]")
 {
     std::string msg = "<{'type':'move','data':{'x':0.5,'y':0.4,'a':0.3}}>";
@@ -32,4 +38,461 @@ TEST_CASE("Robot move", "[Robot]")
     REQUIRE(status.pos_y == Approx(0.4).margin(0.0005));
     REQUIRE(status.pos_a == Approx(0.3).margin(0.0005));
 
-}
\ No newline at end of file
+}
+
+namespace
+{
+    void sendQueuedMoveRel(Robot& r, MockSocketMultiThreadWrapper* mock_socket, MockClockWrapper* mock_clock, int seq)
+    {
+        std::string msg = "<{'type':'move_rel','queue':true,'seq':" + std::to_string(seq) + ",'data':{'x':0.1,'y':0.0,'a':0.0}}>";
+        mock_socket->sendMockData(msg);
+        mock_clock->advance_ms(1);
+        r.runOnce();
+    }
+}
+
+TEST_CASE("Robot command queue", "[Robot]")
+{
+    SafeConfigModifier<bool> config_modifier("motion.fake_perfect_motion", true);
+    
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    Robot r = Robot();
+
+    sendQueuedMoveRel(r, mock_socket, mock_clock, 1);
+    REQUIRE(r.getCurrentCommand() == COMMAND::MOVE_REL);
+    REQUIRE(r.getStatus().cmd_seq == 1);
+    REQUIRE(r.getStatus().cmd_queue_depth == 0);
+
+    sendQueuedMoveRel(r, mock_socket, mock_clock, 2);
+    sendQueuedMoveRel(r, mock_socket, mock_clock, 3);
+    REQUIRE(r.getStatus().cmd_seq == 1);
+    REQUIRE(r.getStatus().cmd_queue_depth == 2);
+
+    // Each command starts the same cycle the one before it finishes, so in_progress never drops in between
+    uint32_t last_done_seq = 0;
+    for (int i = 0; i < 20000; i++) 
+    {
+        r.runOnce();
+        mock_clock->advance_ms(1);
+        StatusUpdater::Status status = r.getStatus();
+        if(status.cmd_done_seq != last_done_seq)
+        {
+            REQUIRE(status.cmd_done_seq == last_done_seq + 1);
+            last_done_seq = status.cmd_done_seq;
+            if(last_done_seq < 3)
+            {
+                REQUIRE(status.in_progress == true);
+                REQUIRE(status.cmd_seq == last_done_seq + 1);
+            }
+        }
+        if(status.in_progress == false) {break;}
+    }
+
+    StatusUpdater::Status status = r.getStatus();
+    REQUIRE(status.in_progress == false);
+    REQUIRE(status.cmd_done_seq == 3);
+    REQUIRE(status.cmd_seq == 0);
+    REQUIRE(status.cmd_queue_depth == 0);
+    REQUIRE(status.pos_x == Approx(0.3).margin(0.0015));
+}
+
+TEST_CASE("Robot estop flushes command queue", "[Robot]")
+{
+    SafeConfigModifier<bool> config_modifier("motion.fake_perfect_motion", true);
+    
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    Robot r = Robot();
+
+    sendQueuedMoveRel(r, mock_socket, mock_clock, 1);
+    sendQueuedMoveRel(r, mock_socket, mock_clock, 2);
+    sendQueuedMoveRel(r, mock_socket, mock_clock, 3);
+    REQUIRE(r.getStatus().cmd_queue_depth == 2);
+
+    mock_socket->sendMockData("<{'type':'estop'}>");
+    mock_clock->advance_ms(1);
+    r.runOnce();
+    REQUIRE(r.getStatus().cmd_queue_depth == 0);
+
+    for (int i = 0; i < 10000; i++) 
+    {
+        r.runOnce();
+        mock_clock->advance_ms(1);
+        if(r.getStatus().in_progress == false) {break;}
+    }
+
+    StatusUpdater::Status status = r.getStatus();
+    REQUIRE(status.in_progress == false);
+    REQUIRE(status.cmd_done_seq == 1);
+    REQUIRE(status.cmd_queue_depth == 0);
+    REQUIRE(status.pos_x < 0.1);
+}
+
+TEST_CASE("Robot overlaps tray and motion", "[Robot]")
+{
+    SafeConfigModifier<bool> motion_modifier("motion.fake_perfect_motion", true);
+    SafeConfigModifier<bool> tray_modifier("tray.fake_tray_motions", true);
+    
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    Robot r = Robot();
+
+    mock_socket->sendMockData("<{'type':'place','queue':true,'seq':1}>");
+    mock_clock->advance_ms(1);
+    r.runOnce();
+    REQUIRE(r.getCurrentCommand() == COMMAND::PLACE_TRAY);
+    sendQueuedMoveRel(r, mock_socket, mock_clock, 2);
+
+    // Backing away is allowed once the latch has opened, the place finishes while the base moves
+    bool overlapped = false;
+    for (int i = 0; i < 20000; i++) 
+    {
+        r.runOnce();
+        mock_clock->advance_ms(1);
+        StatusUpdater::Status status = r.getStatus();
+        if(r.getCurrentCommand() == COMMAND::MOVE_REL && status.tray_in_progress)
+        {
+            overlapped = true;
+            REQUIRE(status.in_progress == true);
+            REQUIRE(status.tray_done_seq == 0);
+        }
+        if(status.in_progress == false) {break;}
+    }
+
+    StatusUpdater::Status status = r.getStatus();
+    REQUIRE(overlapped);
+    REQUIRE(status.in_progress == false);
+    REQUIRE(status.tray_in_progress == false);
+    REQUIRE(status.tray_done_seq == 1);
+    REQUIRE(status.pos_x == Approx(0.1).margin(0.0005));
+}
+
+TEST_CASE("Robot waits for tray before unsafe motion", "[Robot]")
+{
+    SafeConfigModifier<bool> motion_modifier("motion.fake_perfect_motion", true);
+    SafeConfigModifier<bool> tray_modifier("tray.fake_tray_motions", true);
+    
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    Robot r = Robot();
+
+    mock_socket->sendMockData("<{'type':'place','queue':true,'seq':1}>");
+    mock_clock->advance_ms(1);
+    r.runOnce();
+    mock_socket->sendMockData("<{'type':'move_fine','queue':true,'seq':2,'data':{'x':0.1,'y':0.0,'a':0.0}}>");
+    mock_clock->advance_ms(1);
+    r.runOnce();
+
+    for (int i = 0; i < 20000; i++) 
+    {
+        r.runOnce();
+        mock_clock->advance_ms(1);
+        StatusUpdater::Status status = r.getStatus();
+        if(r.getCurrentCommand() == COMMAND::MOVE_FINE)
+        {
+            REQUIRE(status.tray_in_progress == false);
+            REQUIRE(status.tray_done_seq == 1);
+        }
+        if(status.in_progress == false) {break;}
+    }
+    REQUIRE(r.getStatus().cmd_done_seq == 2);
+}
+
+TEST_CASE("Robot applies tuned params between moves", "[Robot]")
+{
+    SafeConfigModifier<bool> config_modifier("motion.fake_perfect_motion", true);
+    const float old_max_vel = ConfigSnapshot::current()->translation.coarse.max_vel;
+    SafeConfigModifier<float> vel_modifier("motion.translation.max_vel.coarse", old_max_vel);
+
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    Robot r = Robot();
+
+    mock_socket->sendMockData("<{'type':'move','data':{'x':0.5,'y':0,'a':0}}>");
+    mock_clock->advance_ms(1);
+    r.runOnce();
+    REQUIRE(r.getCurrentCommand() == COMMAND::MOVE);
+    REQUIRE(mock_socket->getMockData() == "<{\"type\":\"ack\",\"data\":\"move\"}>");
+
+    mock_socket->sendMockData("<{'type':'set_param','data':{'name':'motion.translation.max_vel.coarse','value':0.05}}>");
+    mock_clock->advance_ms(1);
+    r.runOnce();
+    REQUIRE_THAT(mock_socket->getMockData(), Catch::Matchers::Contains("\"pending\":true"));
+
+    // The running move keeps the limits it started with
+    for (int i = 0; i < 10000 && r.getCurrentCommand() == COMMAND::MOVE; i++)
+    {
+        REQUIRE(ConfigSnapshot::current()->translation.coarse.max_vel == Approx(old_max_vel));
+        r.runOnce();
+        mock_clock->advance_ms(1);
+    }
+    REQUIRE(r.getCurrentCommand() == COMMAND::NONE);
+    r.runOnce();
+    REQUIRE(ConfigSnapshot::current()->translation.coarse.max_vel == Approx(0.05));
+    REQUIRE_FALSE(ConfigSnapshot::hasPendingParams());
+}
+
+TEST_CASE("Robot camera stop compensates latency", "[Robot]")
+{
+    SafeConfigModifier<bool> motion_modifier("motion.fake_perfect_motion", true);
+    SafeConfigModifier<bool> planned_modifier("motion.stop_fast.planned", true);
+    SafeConfigModifier<float> travel_modifier("motion.stop_fast.camera_stop_travel", 0.6);
+    
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    CameraTrackerMock* camera = dynamic_cast<CameraTrackerMock*>(CameraTrackerFactory::getFactoryInstance()->get_camera_tracker());
+    REQUIRE(camera);
+    Robot r = Robot();
+
+    mock_socket->sendMockData("<{'type':'move_fine_stop_vision','data':{'x':2.0,'y':0.0,'a':0.0}}>");
+    mock_clock->advance_ms(1);
+    r.runOnce();
+    REQUIRE(r.getCurrentCommand() == COMMAND::MOVE_FINE_STOP_VISION);
+    REQUIRE(camera->getCameraProfile() == CAMERA_PROFILE::VISION);
+    REQUIRE(camera->getCameraDemand(CAMERA_CONSUMER::STOP_TRIGGER));
+    REQUIRE_FALSE(camera->getCameraDemand(CAMERA_CONSUMER::VISION_MOVE));
+
+    // Frames every 30 ms that only arrive 70 ms after they were captured, the markers are in view past x = 0.5 where the robot is at full speed
+    const int period_ms = 30;
+    const int latency_ms = 70;
+    std::vector<std::pair<ClockTimePoint, float>> captures;
+    float seen_x = -1;
+    for (int i = 0; i < 20000; i++) 
+    {
+        const ClockTimePoint now = mock_clock->now();
+        if(i % period_ms == 0) captures.push_back({now, r.getStatus().pos_x});
+        if(!captures.empty() && captures.front().first <= now - std::chrono::milliseconds(latency_ms))
+        {
+            const bool in_view = captures.front().second >= 0.5;
+            if(in_view && seen_x < 0) seen_x = captures.front().second;
+            camera->mock_set_output({{0, 0, 0}, in_view, captures.front().first, in_view});
+            captures.erase(captures.begin());
+        }
+        r.runOnce();
+        mock_clock->advance_ms(1);
+        if(r.getStatus().in_progress == false) {break;}
+    }
+    camera->mock_set_output({{0, 0, 0}, false, mock_clock->now(), false});
+
+    // Without the compensation it would stop a latency worth of travel further on
+    StatusUpdater::Status status = r.getStatus();
+    REQUIRE(status.in_progress == false);
+    REQUIRE(camera->getCameraProfile() == CAMERA_PROFILE::IDLE);
+    REQUIRE_FALSE(camera->getCameraDemand(CAMERA_CONSUMER::STOP_TRIGGER));
+    REQUIRE(seen_x > 0);
+    REQUIRE(status.pos_x < 1.9);
+    REQUIRE(status.pos_x == Approx(seen_x + 0.6).margin(0.003));
+    REQUIRE(status.camera_stop_error == Approx(status.pos_x - seen_x - 0.6).margin(0.001));
+    REQUIRE(std::abs(status.camera_stop_error) < 0.003);
+}
+
+namespace
+{
+    void sendAndRun(Robot& r, MockSocketMultiThreadWrapper* mock_socket, MockClockWrapper* mock_clock, const std::string& msg)
+    {
+        mock_socket->sendMockData(msg);
+        mock_clock->advance_ms(1);
+        r.runOnce();
+    }
+
+    // Move out, place, move fine back in, as one plan
+    void uploadFieldPlan(Robot& r, MockSocketMultiThreadWrapper* mock_socket, MockClockWrapper* mock_clock)
+    {
+        sendAndRun(r, mock_socket, mock_clock, "<{'type':'field_plan_upload','data':{'id':11,'first':0,'total':3,'steps':[1,0.3,0.2,0]}}>");
+        sendAndRun(r, mock_socket, mock_clock, "<{'type':'field_plan_upload','data':{'id':11,'first':1,'total':3,'steps':[6,0,0,0,3,0.3,0.1,0]}}>");
+    }
+
+    // Runs until the plan leaves RUNNING, returns how many loops that took
+    int runFieldPlan(Robot& r, MockClockWrapper* mock_clock, int max_loops)
+    {
+        for (int i = 0; i < max_loops; i++)
+        {
+            r.runOnce();
+            mock_clock->advance_ms(1);
+            if(r.getStatus().field_plan_state != static_cast<int>(FIELD_PLAN_STATE::RUNNING)) return i;
+        }
+        return max_loops;
+    }
+}
+
+TEST_CASE("Robot runs a field plan", "[Robot]")
+{
+    SafeConfigModifier<bool> motion_modifier("motion.fake_perfect_motion", true);
+    SafeConfigModifier<bool> tray_modifier("tray.fake_tray_motions", true);
+
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    Robot r = Robot();
+
+    uploadFieldPlan(r, mock_socket, mock_clock);
+    StatusUpdater::Status status = r.getStatus();
+    REQUIRE(status.field_plan_id == 11);
+    REQUIRE(status.field_plan_state == static_cast<int>(FIELD_PLAN_STATE::READY));
+    REQUIRE(status.field_plan_steps == 3);
+    REQUIRE(r.getCurrentCommand() == COMMAND::NONE);
+
+    sendAndRun(r, mock_socket, mock_clock, "<{'type':'field_plan_run'}>");
+    REQUIRE(r.getCurrentCommand() == COMMAND::MOVE);
+    REQUIRE(r.getStatus().in_progress);
+
+    // Master can't start its own moves while the plan has the robot
+    sendAndRun(r, mock_socket, mock_clock, "<{'type':'move_rel','data':{'x':1,'y':0,'a':0}}>");
+    REQUIRE(r.getCurrentCommand() == COMMAND::MOVE);
+
+    int last_step = 0;
+    for (int i = 0; i < 30000; i++)
+    {
+        r.runOnce();
+        mock_clock->advance_ms(1);
+        status = r.getStatus();
+        REQUIRE(status.field_plan_step >= last_step);
+        REQUIRE(status.field_plan_step <= last_step + 1);
+        last_step = status.field_plan_step;
+        if(status.field_plan_state != static_cast<int>(FIELD_PLAN_STATE::RUNNING)) break;
+    }
+    REQUIRE(status.field_plan_state == static_cast<int>(FIELD_PLAN_STATE::DONE));
+    REQUIRE(status.field_plan_step == 3);
+    REQUIRE(status.in_progress == false);
+    REQUIRE(status.pos_x == Approx(0.3).margin(0.0005));
+    REQUIRE(status.pos_y == Approx(0.1).margin(0.0005));
+}
+
+TEST_CASE("Robot repeats a field plan step cut short", "[Robot]")
+{
+    SafeConfigModifier<bool> motion_modifier("motion.fake_perfect_motion", true);
+    SafeConfigModifier<bool> tray_modifier("tray.fake_tray_motions", true);
+    const std::string journal_path = "/tmp/robot_field_plan_test_" + std::to_string(getpid()) + ".journal";
+    std::remove(journal_path.c_str());
+    SafeConfigModifier<std::string> journal_modifier("field_plan.journal_path", journal_path);
+
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+
+    SECTION("Estop")
+    {
+        Robot r = Robot();
+        uploadFieldPlan(r, mock_socket, mock_clock);
+        sendAndRun(r, mock_socket, mock_clock, "<{'type':'field_plan_run'}>");
+        for (int i = 0; i < 200; i++)
+        {
+            r.runOnce();
+            mock_clock->advance_ms(1);
+        }
+        sendAndRun(r, mock_socket, mock_clock, "<{'type':'estop'}>");
+        runFieldPlan(r, mock_clock, 5000);
+        REQUIRE(r.getStatus().field_plan_state == static_cast<int>(FIELD_PLAN_STATE::PAUSED));
+        REQUIRE(r.getStatus().field_plan_step == 0);
+        REQUIRE(r.getStatus().pos_x < 0.3);
+
+        // The move runs again from wherever the robot stopped
+        sendAndRun(r, mock_socket, mock_clock, "<{'type':'field_plan_run'}>");
+        REQUIRE(r.getCurrentCommand() == COMMAND::MOVE);
+        runFieldPlan(r, mock_clock, 30000);
+        REQUIRE(r.getStatus().field_plan_state == static_cast<int>(FIELD_PLAN_STATE::DONE));
+    }
+
+    SECTION("Restart")
+    {
+        {
+            Robot r = Robot();
+            uploadFieldPlan(r, mock_socket, mock_clock);
+            sendAndRun(r, mock_socket, mock_clock, "<{'type':'field_plan_run'}>");
+            // Through the first move and part way into the place
+            for (int i = 0; i < 30000 && r.getStatus().field_plan_step < 1; i++)
+            {
+                r.runOnce();
+                mock_clock->advance_ms(1);
+            }
+            REQUIRE(r.getCurrentCommand() == COMMAND::PLACE_TRAY);
+        }
+
+        Robot r = Robot();
+        r.runOnce();
+        StatusUpdater::Status status = r.getStatus();
+        REQUIRE(status.field_plan_id == 11);
+        REQUIRE(status.field_plan_state == static_cast<int>(FIELD_PLAN_STATE::PAUSED));
+        REQUIRE(status.field_plan_step == 1);
+        REQUIRE(r.getCurrentCommand() == COMMAND::NONE);
+
+        sendAndRun(r, mock_socket, mock_clock, "<{'type':'field_plan_run'}>");
+        REQUIRE(r.getCurrentCommand() == COMMAND::PLACE_TRAY);
+        runFieldPlan(r, mock_clock, 30000);
+        REQUIRE(r.getStatus().field_plan_state == static_cast<int>(FIELD_PLAN_STATE::DONE));
+        REQUIRE(r.getStatus().field_plan_step == 3);
+    }
+    std::remove(journal_path.c_str());
+}
+
+TEST_CASE("Robot finishes an aborted field plan step on its own", "[Robot]")
+{
+    SafeConfigModifier<bool> motion_modifier("motion.fake_perfect_motion", true);
+    SafeConfigModifier<bool> tray_modifier("tray.fake_tray_motions", true);
+
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    Robot r = Robot();
+
+    sendAndRun(r, mock_socket, mock_clock, "<{'type':'move_rel','queue':true,'seq':7,'data':{'x':0.1,'y':0.0,'a':0.0}}>");
+    for (int i = 0; i < 30000 && r.getCurrentCommand() != COMMAND::NONE; i++)
+    {
+        r.runOnce();
+        mock_clock->advance_ms(1);
+    }
+    REQUIRE(r.getStatus().cmd_done_seq == 7);
+
+    uploadFieldPlan(r, mock_socket, mock_clock);
+    sendAndRun(r, mock_socket, mock_clock, "<{'type':'field_plan_run'}>");
+    REQUIRE(r.getCurrentCommand() == COMMAND::MOVE);
+    sendAndRun(r, mock_socket, mock_clock, "<{'type':'field_plan_abort'}>");
+    REQUIRE(r.getStatus().field_plan_state == static_cast<int>(FIELD_PLAN_STATE::EMPTY));
+
+    // The move carries on, and finishing it reports nothing to master's sequence ids
+    REQUIRE(r.getCurrentCommand() == COMMAND::MOVE);
+    for (int i = 0; i < 30000 && r.getCurrentCommand() != COMMAND::NONE; i++)
+    {
+        r.runOnce();
+        mock_clock->advance_ms(1);
+    }
+    REQUIRE(r.getCurrentCommand() == COMMAND::NONE);
+    REQUIRE(r.getStatus().cmd_done_seq == 7);
+    REQUIRE(r.getStatus().field_plan_state == static_cast<int>(FIELD_PLAN_STATE::EMPTY));
+}
+
+TEST_CASE("Robot active wait for localization", "[Robot]")
+{
+    SafeConfigModifier<bool> config_modifier_1("motion.fake_perfect_motion", true);
+    SafeConfigModifier<bool> config_modifier_2("localization.active_wait.enabled", true);
+    SafeConfigModifier<float> config_modifier_3("localization.active_wait.passive_s", 0.0);
+    SafeConfigModifier<float> config_modifier_4("localization.max_wait_time", 1.0);
+    // Never reached, so it runs until the timeout
+    SafeConfigModifier<float> config_modifier_5("localization.confidence_for_wait", 1.1);
+
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSocketMultiThreadWrapper* mock_socket = build_and_get_mock_socket();
+    Robot r = Robot();
+
+    mock_socket->sendMockData("<{'type':'wait_for_loc'}>");
+    mock_clock->advance_ms(1);
+    r.runOnce();
+    REQUIRE(r.getCurrentCommand() == COMMAND::WAIT_FOR_LOCALIZATION);
+
+    float max_turn = 0;
+    for (int i = 0; i < 30000; i++) 
+    {
+        r.runOnce();
+        mock_clock->advance_ms(1);
+        max_turn = std::max(max_turn, std::abs(r.getStatus().pos_a));
+        if(r.getStatus().in_progress == false) {break;}
+    }
+
+    // Turned for heading, and still came back after the timeout
+    StatusUpdater::Status status = r.getStatus();
+    REQUIRE(status.in_progress == false);
+    REQUIRE(max_turn > 0.1);
+    REQUIRE(status.pos_x == Approx(0).margin(0.0005));
+    REQUIRE(status.pos_y == Approx(0).margin(0.0005));
+    REQUIRE(status.pos_a == Approx(0).margin(0.0005));
+    REQUIRE(status.localize_wait_s == -1);
+    REQUIRE(status.localize_wait_active);
+}
@@ -0,0 +1,90 @@
+#include <Catch/catch.hpp>
+
+#include <random>
+
+#include "Se2.h"
+#include "test-utils.h"
+
+namespace
+{
+    // The looping wrap this replaces
+    double referenceWrap(double a)
+    {
+        while (std::abs(a) > M_PI)
+        {
+            a += a > M_PI ? -2 * M_PI : 2 * M_PI;
+        }
+        return a;
+    }
+}
+
+TEST_CASE("Wrap angle matches the loop", "[Se2]")
+{
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> dist(-200, 200);
+    for (int i = 0; i < 1000; i++)
+    {
+        float a = dist(gen);
+        float wrapped = wrapAngle(a);
+        REQUIRE(std::abs(wrapped) <= M_PI + 1e-5);
+        CHECK(std::abs(angle_diff(wrapped, referenceWrap(a))) < 1e-4);
+    }
+    CHECK(std::abs(wrapAngle(M_PI)) == Approx(M_PI));
+    CHECK(std::abs(wrapAngle(-M_PI)) == Approx(M_PI));
+    CHECK(wrapAngle(1e6) == Approx(referenceWrap(1e6f)).margin(1e-4));
+}
+
+TEST_CASE("Rotation frame conversions", "[Se2]")
+{
+    Rotation2D rotation(M_PI / 2);
+    CHECK(rotation.c == Approx(0).margin(1e-6));
+    CHECK(rotation.s == Approx(1));
+
+    Velocity global = rotation.toGlobal(Velocity(1, 0, 0.5));
+    CHECK(global.vx == Approx(0).margin(1e-6));
+    CHECK(global.vy == Approx(1));
+    CHECK(global.va == Approx(0.5));
+
+    Rotation2D arbitrary(2.3f);
+    Velocity local = arbitrary.toLocal(arbitrary.toGlobal(Velocity(0.3, -0.7, 0.1)));
+    CHECK(local.vx == Approx(0.3));
+    CHECK(local.vy == Approx(-0.7));
+    CHECK(local.va == Approx(0.1));
+}
+
+TEST_CASE("Compose pose", "[Se2]")
+{
+    Point origin(1, 2, M_PI / 2);
+    Point goal = composePose(origin, Rotation2D(origin.a), Point(1, 0, M_PI));
+    CHECK(goal.x == Approx(1).margin(1e-6));
+    CHECK(goal.y == Approx(3));
+    CHECK(goal.a == Approx(-M_PI / 2));
+}
+
+TEST_CASE("Integrate local velocity follows the arc", "[Se2]")
+{
+    // A quarter turn at 1 m/s ends up on a circle of radius 2 / pi
+    float dx, dy;
+    integrateLocalVelocity(Rotation2D(0), {1, 0, M_PI / 2}, 1, &dx, &dy);
+    CHECK(dx == Approx(2 / M_PI));
+    CHECK(dy == Approx(2 / M_PI));
+
+    // Same answer from many small steps
+    float x = 0, y = 0, a = M_PI / 4;
+    for (int i = 0; i < 1000; i++)
+    {
+        float step_x, step_y;
+        integrateLocalVelocity(Rotation2D(a), {0.5, -0.2, 1.5}, 0.002, &step_x, &step_y);
+        x += step_x;
+        y += step_y;
+        a += 1.5 * 0.002;
+    }
+    integrateLocalVelocity(Rotation2D(M_PI / 4), {0.5, -0.2, 1.5}, 2, &dx, &dy);
+    CHECK(dx == Approx(x).margin(1e-4));
+    CHECK(dy == Approx(y).margin(1e-4));
+
+    // Without turning it is a straight line
+    integrateLocalVelocity(Rotation2D(M_PI / 2), {1, 0.5, 0}, 2, &dx, &dy);
+    CHECK(dx == Approx(-1));
+    CHECK(dy == Approx(2));
+}
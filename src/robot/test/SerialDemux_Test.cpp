@@ -0,0 +1,128 @@
+#include <Catch/catch.hpp>
+
+#include "serial/SerialDemux.h"
+
+namespace
+{
+    void consumeString(SerialDemux& demux, const std::string& data)
+    {
+        demux.consume(data.data(), data.size());
+    }
+}
+
+TEST_CASE("Demux channels", "[SerialDemux]")
+{
+    SerialDemux demux;
+    consumeString(demux, "<base:1,2,3><lift:none><dist:0.5><DEBUG hello><lift:done:pos>");
+
+    REQUIRE(demux.pop(SERIAL_CHANNEL::BASE) == "1,2,3");
+    REQUIRE(demux.pop(SERIAL_CHANNEL::BASE) == "");
+    REQUIRE(demux.pop(SERIAL_CHANNEL::LIFT) == "none");
+    REQUIRE(demux.pop(SERIAL_CHANNEL::LIFT) == "done:pos");
+    REQUIRE(demux.pop(SERIAL_CHANNEL::LIFT) == "");
+    REQUIRE(demux.pop(SERIAL_CHANNEL::DISTANCE) == "0.5");
+    REQUIRE(demux.getDroppedMessages() == 0);
+}
+
+TEST_CASE("Demux split reads", "[SerialDemux]")
+{
+    SerialDemux demux;
+    const std::string data = "garbage<base:0.1,0.2,0.3>junk<lift:open>";
+    // Feed one byte at a time to make sure framing survives any read boundary
+    for (char c : data)
+    {
+        demux.consume(&c, 1);
+    }
+    REQUIRE(demux.pop(SERIAL_CHANNEL::BASE) == "0.1,0.2,0.3");
+    REQUIRE(demux.pop(SERIAL_CHANNEL::LIFT) == "open");
+
+    // A start char restarts a partial message
+    consumeString(demux, "<base:trunc");
+    consumeString(demux, "<base:4,5,6>");
+    REQUIRE(demux.pop(SERIAL_CHANNEL::BASE) == "4,5,6");
+    REQUIRE(demux.pop(SERIAL_CHANNEL::BASE) == "");
+}
+
+TEST_CASE("Demux drops", "[SerialDemux]")
+{
+    SerialDemux demux;
+    consumeString(demux, "<lift:" + std::string(SERIAL_MAX_MSG_SIZE, 'x') + "><lift:close>");
+    REQUIRE(demux.getDroppedMessages() == 1);
+    REQUIRE(demux.pop(SERIAL_CHANNEL::LIFT) == "close");
+
+    for (int i = 0; i < SERIAL_CHANNEL_QUEUE_SIZE + 3; i++)
+    {
+        consumeString(demux, "<dist:" + std::to_string(i) + ">");
+    }
+    REQUIRE(demux.getDroppedMessages() == 4);
+    REQUIRE(demux.pop(SERIAL_CHANNEL::DISTANCE) == "0");
+}
+
+TEST_CASE("Demux binary odometry", "[SerialDemux]")
+{
+    SerialOdometry sent = {{0.1234f, -0.5f, 0.0421f}, 4000000123u, 65535};
+    uint8_t payload[SERIAL_ODOMETRY_PAYLOAD_SIZE];
+    encodeOdometryPayload(sent, payload);
+    uint8_t frame[SERIAL_BINARY_OVERHEAD + SERIAL_ODOMETRY_PAYLOAD_SIZE];
+    size_t frame_size = encodeSerialFrame(SERIAL_BINARY_CHANNEL::BASE_ODOMETRY, payload, SERIAL_ODOMETRY_PAYLOAD_SIZE, frame);
+    REQUIRE(frame_size == sizeof(frame));
+    const std::string binary(reinterpret_cast<const char*>(frame), frame_size);
+
+    // Binary and text frames interleave freely
+    SerialDemux demux;
+    consumeString(demux, "<lift:none>" + binary + "<lift:pos>");
+    SerialOdometry odom;
+    REQUIRE(demux.popBaseOdometry(&odom));
+    REQUIRE(odom.vel.vx == Approx(0.1234f).margin(0.00005));
+    REQUIRE(odom.vel.vy == Approx(-0.5f).margin(0.00005));
+    REQUIRE(odom.vel.va == Approx(0.0421f).margin(0.00005));
+    REQUIRE(odom.timestamp_us == 4000000123u);
+    REQUIRE(odom.seq == 65535);
+    REQUIRE_FALSE(demux.popBaseOdometry(&odom));
+    REQUIRE(demux.pop(SERIAL_CHANNEL::LIFT) == "none");
+    REQUIRE(demux.pop(SERIAL_CHANNEL::LIFT) == "pos");
+
+    // Split across reads
+    for (char c : binary)
+    {
+        demux.consume(&c, 1);
+    }
+    REQUIRE(demux.popBaseOdometry(&odom));
+
+    // Corrupt payload fails the CRC, the next good frame still gets through
+    std::string corrupt = binary;
+    corrupt[4] ^= 0x01;
+    consumeString(demux, corrupt + binary);
+    REQUIRE(demux.getBadFrames() == 1);
+    REQUIRE(demux.popBaseOdometry(&odom));
+    REQUIRE_FALSE(demux.popBaseOdometry(&odom));
+
+    // Velocity commands only go to the driver, one showing up here is unexpected
+    uint8_t cmd_frame[SERIAL_BINARY_OVERHEAD + SERIAL_VELOCITY_PAYLOAD_SIZE];
+    encodeVelocityPayload(sent.vel, payload);
+    frame_size = encodeSerialFrame(SERIAL_BINARY_CHANNEL::BASE_VELOCITY, payload, SERIAL_VELOCITY_PAYLOAD_SIZE, cmd_frame);
+    demux.consume(reinterpret_cast<const char*>(cmd_frame), frame_size);
+    REQUIRE(demux.getBadFrames() == 2);
+    REQUIRE_FALSE(demux.popBaseOdometry(&odom));
+
+    // Driver loop time reports have their own queue
+    const SerialDriverStats sent_stats = {70000, 48, 20833, 3};
+    uint8_t stats_payload[SERIAL_DRIVER_STATS_PAYLOAD_SIZE];
+    encodeDriverStatsPayload(sent_stats, stats_payload);
+    uint8_t stats_frame[SERIAL_BINARY_OVERHEAD + SERIAL_DRIVER_STATS_PAYLOAD_SIZE];
+    frame_size = encodeSerialFrame(SERIAL_BINARY_CHANNEL::DRIVER_STATS, stats_payload, SERIAL_DRIVER_STATS_PAYLOAD_SIZE, stats_frame);
+    demux.consume(reinterpret_cast<const char*>(stats_frame), frame_size);
+    SerialDriverStats stats;
+    REQUIRE(demux.popDriverStats(&stats));
+    REQUIRE(stats.loop_max_us == 70000);
+    REQUIRE(stats.loop_mean_us == 48);
+    REQUIRE(stats.loop_count == 20833);
+    REQUIRE(stats.rx_dropped == 3);
+    REQUIRE_FALSE(demux.popDriverStats(&stats));
+    REQUIRE_FALSE(demux.popBaseOdometry(&odom));
+    REQUIRE(demux.getBadFrames() == 2);
+
+    // Out of range velocities saturate instead of wrapping
+    REQUIRE(velocityToFixed(10.0f) == INT16_MAX);
+    REQUIRE(velocityToFixed(-10.0f) == INT16_MIN);
+}
@@ -0,0 +1,97 @@
+#include <Catch/catch.hpp>
+
+#include "serial/SerialTxScheduler.h"
+
+namespace
+{
+    const std::chrono::milliseconds NO_WAIT(0);
+
+    void pushMessage(SerialTxScheduler& s, const std::string& msg)
+    {
+        s.push(SerialTxScheduler::classifyMessage(msg), msg, SerialTxScheduler::flushMask(msg));
+    }
+
+    std::string popMessage(SerialTxScheduler& s)
+    {
+        std::string msg;
+        return s.pop(&msg, NO_WAIT) ? msg : "";
+    }
+}
+
+TEST_CASE("TX classes", "[SerialTxScheduler]")
+{
+    REQUIRE(SerialTxScheduler::classifyMessage("base:Power:ON") == SERIAL_TX_CLASS::SAFETY);
+    REQUIRE(SerialTxScheduler::classifyMessage("lift:stop") == SERIAL_TX_CLASS::SAFETY);
+    REQUIRE(SerialTxScheduler::classifyMessage("base:0.1000,0.0000,0.0000") == SERIAL_TX_CLASS::BASE);
+    REQUIRE(SerialTxScheduler::classifyMessage("lift:pos:100") == SERIAL_TX_CLASS::LIFT);
+    REQUIRE(SerialTxScheduler::classifyMessage("lift:status_req") == SERIAL_TX_CLASS::POLL);
+
+    uint8_t axis[SERIAL_TRAJECTORY_AXIS_PAYLOAD_SIZE] = {};
+    axis[2] = static_cast<uint8_t>(SERIAL_TRAJECTORY_AXIS::LIFTER);
+    REQUIRE(SerialTxScheduler::classifyFrame(SERIAL_BINARY_CHANNEL::TRAJECTORY_AXIS, axis, sizeof(axis)) == SERIAL_TX_CLASS::LIFT);
+    axis[2] = static_cast<uint8_t>(SERIAL_TRAJECTORY_AXIS::ROTATION);
+    REQUIRE(SerialTxScheduler::classifyFrame(SERIAL_BINARY_CHANNEL::TRAJECTORY_AXIS, axis, sizeof(axis)) == SERIAL_TX_CLASS::BASE);
+    REQUIRE(SerialTxScheduler::classifyFrame(SERIAL_BINARY_CHANNEL::BASE_VELOCITY, axis, SERIAL_VELOCITY_PAYLOAD_SIZE) == SERIAL_TX_CLASS::BASE);
+    REQUIRE(SerialTxScheduler::classifyFrame(SERIAL_BINARY_CHANNEL::STREAM_CONFIG, axis, SERIAL_STREAM_CONFIG_PAYLOAD_SIZE) == SERIAL_TX_CLASS::SAFETY);
+}
+
+TEST_CASE("TX priority order", "[SerialTxScheduler]")
+{
+    SerialTxScheduler s;
+    pushMessage(s, "lift:status_req");
+    pushMessage(s, "lift:pos:100");
+    pushMessage(s, "lift:open");
+    pushMessage(s, "base:1,0,0");
+    pushMessage(s, "base:Power:ON");
+    pushMessage(s, "base:2,0,0");
+    REQUIRE(s.size() == 6);
+
+    // Highest class first, in order within a class
+    REQUIRE(popMessage(s) == "base:Power:ON");
+    REQUIRE(popMessage(s) == "base:1,0,0");
+    REQUIRE(popMessage(s) == "base:2,0,0");
+    REQUIRE(popMessage(s) == "lift:pos:100");
+    REQUIRE(popMessage(s) == "lift:open");
+    REQUIRE(popMessage(s) == "lift:status_req");
+    REQUIRE(popMessage(s) == "");
+
+    REQUIRE(s.getStats(SERIAL_TX_CLASS::BASE).sent == 2);
+    REQUIRE(s.getStats(SERIAL_TX_CLASS::POLL).sent == 1);
+    REQUIRE(s.getStats(SERIAL_TX_CLASS::BASE).latency_max_us >= s.getStats(SERIAL_TX_CLASS::BASE).latency_mean_us);
+}
+
+TEST_CASE("TX coalesces polls", "[SerialTxScheduler]")
+{
+    SerialTxScheduler s;
+    pushMessage(s, "lift:status_req");
+    pushMessage(s, "lift:status_req");
+    pushMessage(s, "lift:status_req");
+    REQUIRE(s.size() == 1);
+    REQUIRE(s.getStats(SERIAL_TX_CLASS::POLL).coalesced == 2);
+
+    // Once the poll has gone out the next one is queued again
+    REQUIRE(popMessage(s) == "lift:status_req");
+    pushMessage(s, "lift:status_req");
+    REQUIRE(s.size() == 1);
+}
+
+TEST_CASE("TX stop flushes the device", "[SerialTxScheduler]")
+{
+    SerialTxScheduler s;
+    pushMessage(s, "base:1,0,0");
+    pushMessage(s, "lift:pos:100");
+    pushMessage(s, "lift:status_req");
+    pushMessage(s, "lift:stop");
+
+    // Waiting lifter traffic is dropped, the base isn't touched
+    REQUIRE(popMessage(s) == "lift:stop");
+    REQUIRE(popMessage(s) == "base:1,0,0");
+    REQUIRE(popMessage(s) == "");
+    REQUIRE(s.getStats(SERIAL_TX_CLASS::LIFT).flushed == 1);
+    REQUIRE(s.getStats(SERIAL_TX_CLASS::POLL).flushed == 1);
+
+    pushMessage(s, "base:1,0,0");
+    pushMessage(s, "base:Power:OFF");
+    REQUIRE(popMessage(s) == "base:Power:OFF");
+    REQUIRE(popMessage(s) == "");
+}
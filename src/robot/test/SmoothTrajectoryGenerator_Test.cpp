@@ -1,7 +1,9 @@
 #include <Catch/catch.hpp>
+#include <chrono>
 
 #include "SmoothTrajectoryGenerator.h"
 #include "constants.h"
+#include "test-utils.h"
 
 // This stuff is needed to correctly print a custom type in Catch for debug
 namespace Catch {
@@ -185,6 +187,359 @@ TEST_CASE("SmoothTrajectoryGenerator class", "[trajectory]")
             REQUIRE(fabs(output.position.a) < 1.01);
         }
     }
+
+    SECTION("Acceleration")
+    {
+        SmoothTrajectoryGenerator stg;
+        REQUIRE(stg.generatePointToPointTrajectory({0,0,0}, {1,0.5,1}, LIMITS_MODE::COARSE));
+
+        // Matches the slope of the velocity
+        const float dt = 0.001;
+        for (float t = 0.05; t < stg.getDuration(); t += 0.1)
+        {
+            PVTPoint before = stg.lookup(t - dt);
+            PVTPoint after = stg.lookup(t + dt);
+            PVTPoint output = stg.lookup(t);
+            CHECK(output.acceleration.vx == Approx((after.velocity.vx - before.velocity.vx) / (2 * dt)).margin(0.01));
+            CHECK(output.acceleration.vy == Approx((after.velocity.vy - before.velocity.vy) / (2 * dt)).margin(0.01));
+            CHECK(output.acceleration.va == Approx((after.velocity.va - before.velocity.va) / (2 * dt)).margin(0.01));
+        }
+        CHECK(stg.lookup(60).acceleration.nearZero());
+    }
+}
+
+namespace
+{
+    // Largest translational speed and acceleration seen along the current trajectory, acceleration by finite differences
+    void sampleTrajectoryLimits(SmoothTrajectoryGenerator& stg, float end_time, float* max_vel, float* max_acc)
+    {
+        const float dt = 0.005;
+        *max_vel = 0;
+        *max_acc = 0;
+        PVTPoint prev = stg.lookup(0);
+        for (float t = dt; t < end_time; t += dt)
+        {
+            PVTPoint cur = stg.lookup(t);
+            Eigen::Vector2f vel = {cur.velocity.vx, cur.velocity.vy};
+            Eigen::Vector2f acc = {(cur.velocity.vx - prev.velocity.vx) / dt, (cur.velocity.vy - prev.velocity.vy) / dt};
+            *max_vel = std::max(*max_vel, vel.norm());
+            *max_acc = std::max(*max_acc, acc.norm());
+            prev = cur;
+        }
+    }
+
+    // First time the trajectory is within tol of p
+    float timeAtPoint(SmoothTrajectoryGenerator& stg, Point p, float end_time, float tol)
+    {
+        for (float t = 0; t < end_time; t += 0.005)
+        {
+            PVTPoint cur = stg.lookup(t);
+            if (Eigen::Vector2f(cur.position.x - p.x, cur.position.y - p.y).norm() < tol) return t;
+        }
+        return -1;
+    }
+}
+
+TEST_CASE("Path trajectory", "[trajectory]")
+{
+    SmoothTrajectoryGenerator stg;
+    const float max_vel = cfg.lookup("motion.translation.max_vel.coarse");
+    const float max_acc = cfg.lookup("motion.translation.max_acc.coarse");
+    Point start = {0, 0, 0};
+
+    SECTION("Single waypoint matches point to point")
+    {
+        Point goal = {1, 0.5, 0.3};
+        REQUIRE(stg.generatePointToPointTrajectory(start, goal, LIMITS_MODE::COARSE));
+        PVTPoint p2p_end = stg.lookup(5);
+        REQUIRE(stg.generatePathTrajectory(start, {goal}, LIMITS_MODE::COARSE));
+        PVTPoint path_end = stg.lookup(5);
+        CHECK(path_end.position.x == Approx(p2p_end.position.x));
+        CHECK(path_end.position.y == Approx(p2p_end.position.y));
+        CHECK(path_end.position.a == Approx(p2p_end.position.a));
+        CHECK(stg.lookup(0.5).velocity.vx > 0);
+    }
+
+    SECTION("Straight line waypoints don't stop")
+    {
+        Point mid = {1, 0, 0};
+        Point goal = {2, 0, 0};
+        REQUIRE(stg.generatePointToPointTrajectory(start, mid, LIMITS_MODE::COARSE));
+        float leg_time = 0;
+        while (!stg.lookup(leg_time).velocity.nearZero() || leg_time < 0.1) leg_time += 0.01;
+
+        REQUIRE(stg.generatePathTrajectory(start, {mid, goal}, LIMITS_MODE::COARSE));
+        float t_mid = timeAtPoint(stg, mid, 60, 0.01);
+        REQUIRE(t_mid > 0);
+        CHECK(stg.lookup(t_mid).velocity.vx > 0.5 * max_vel);
+
+        // Faster than two rest to rest moves, and ends on target
+        float path_time = 0.1;
+        while (!stg.lookup(path_time).velocity.nearZero()) path_time += 0.01;
+        CHECK(path_time < 2 * leg_time - 0.1);
+        PVTPoint end = stg.lookup(60);
+        CHECK(end.position.x == Approx(2).margin(1e-4));
+        CHECK(end.position.y == Approx(0).margin(1e-4));
+
+        float sampled_vel, sampled_acc;
+        sampleTrajectoryLimits(stg, path_time + 1, &sampled_vel, &sampled_acc);
+        CHECK(sampled_vel <= max_vel * 1.01);
+        CHECK(sampled_acc <= max_acc * 1.05);
+    }
+
+    SECTION("Corner stays within limits")
+    {
+        std::vector<Point> waypoints = {{1, 0, 0}, {1, 1, 1.5}, {0, 1, 0}};
+        REQUIRE(stg.generatePathTrajectory(start, waypoints, LIMITS_MODE::COARSE));
+        PVTPoint end = stg.lookup(60);
+        CHECK(end.position.x == Approx(0).margin(1e-4));
+        CHECK(end.position.y == Approx(1).margin(1e-4));
+        CHECK(end.position.a == Approx(0).margin(1e-4));
+        CHECK(end.velocity.nearZero());
+
+        float sampled_vel, sampled_acc;
+        sampleTrajectoryLimits(stg, 30, &sampled_vel, &sampled_acc);
+        CHECK(sampled_vel <= max_vel * 1.01);
+        CHECK(sampled_acc <= max_acc * 1.05);
+    }
+
+    SECTION("Reversal turns around near the waypoint")
+    {
+        Point out = {1, 0, 0};
+        REQUIRE(stg.generatePathTrajectory(start, {out, start}, LIMITS_MODE::COARSE));
+        float sampled_vel, sampled_acc;
+        sampleTrajectoryLimits(stg, 30, &sampled_vel, &sampled_acc);
+        CHECK(sampled_acc <= max_acc * 1.05);
+        // Blending only overlaps the very end of each leg here, so the turn is close to the waypoint
+        CHECK(timeAtPoint(stg, out, 30, 0.01) > 0);
+        PVTPoint end = stg.lookup(60);
+        CHECK(end.position.x == Approx(0).margin(1e-4));
+    }
+
+    SECTION("Bad waypoint lists")
+    {
+        CHECK_FALSE(stg.generatePathTrajectory(start, {}, LIMITS_MODE::COARSE));
+        std::vector<Point> too_many(MAX_PATH_WAYPOINTS + 1, Point(1, 1, 0));
+        CHECK_FALSE(stg.generatePathTrajectory(start, too_many, LIMITS_MODE::COARSE));
+    }
+}
+
+TEST_CASE("Retarget trajectory", "[trajectory]")
+{
+    SmoothTrajectoryGenerator stg;
+    const float max_vel = cfg.lookup("motion.translation.max_vel.coarse");
+    const float max_acc = cfg.lookup("motion.translation.max_acc.coarse");
+    Point start = {0, 0, 0};
+
+    SECTION("Splice is continuous and ends on the new goal")
+    {
+        REQUIRE(stg.generatePointToPointTrajectory(start, {2, 0, 0}, LIMITS_MODE::COARSE));
+        const float t_switch = 1.0;
+        PVTPoint before = stg.lookup(t_switch);
+        REQUIRE(before.velocity.vx > 0.1);
+
+        REQUIRE(stg.retarget(t_switch, {1.5, 1, 0.5}, LIMITS_MODE::COARSE));
+        REQUIRE(stg.isPathTrajectory());
+        PVTPoint after = stg.lookup(t_switch);
+        CHECK(after.position.x == Approx(before.position.x).margin(1e-4));
+        CHECK(after.position.y == Approx(before.position.y).margin(1e-4));
+        CHECK(after.velocity.vx == Approx(before.velocity.vx).margin(1e-4));
+        CHECK(after.velocity.vy == Approx(before.velocity.vy).margin(1e-4));
+
+        // Never comes to a stop between the switch and the end
+        const float end_time = stg.getDuration();
+        for (float t = t_switch; t < end_time - 0.05; t += 0.01) REQUIRE_FALSE(stg.lookup(t).velocity.nearZero());
+
+        PVTPoint end = stg.lookup(end_time + 1);
+        CHECK(end.position.x == Approx(1.5).margin(1e-4));
+        CHECK(end.position.y == Approx(1).margin(1e-4));
+        CHECK(end.position.a == Approx(0.5).margin(1e-4));
+        CHECK(end.velocity.nearZero());
+
+        float sampled_vel, sampled_acc;
+        sampleTrajectoryLimits(stg, end_time + 1, &sampled_vel, &sampled_acc);
+        CHECK(sampled_vel <= max_vel * 1.01);
+        CHECK(sampled_acc <= max_acc * 1.05);
+    }
+
+    SECTION("Repeated retargets fold finished legs")
+    {
+        REQUIRE(stg.generatePointToPointTrajectory(start, {1, 0, 0}, LIMITS_MODE::COARSE));
+        float t = 0.5;
+        for (int i = 0; i < 3 * MAX_PATH_WAYPOINTS; i++)
+        {
+            REQUIRE(stg.retarget(t, {1, 0.1f * (i % 5), 0}, LIMITS_MODE::COARSE));
+            t = stg.getDuration() + 0.1;
+        }
+        PVTPoint end = stg.lookup(stg.getDuration() + 1);
+        CHECK(end.position.x == Approx(1).margin(1e-4));
+        CHECK(end.position.y == Approx(0.1f * ((3 * MAX_PATH_WAYPOINTS - 1) % 5)).margin(1e-4));
+    }
+
+    SECTION("Retarget after the end starts from rest")
+    {
+        REQUIRE(stg.generatePointToPointTrajectory(start, {0.5, 0, 0}, LIMITS_MODE::COARSE));
+        const float t_switch = stg.getDuration() + 2;
+        REQUIRE(stg.retarget(t_switch, {0, 0, 0}, LIMITS_MODE::COARSE));
+        CHECK(stg.lookup(t_switch).position.x == Approx(0.5).margin(1e-4));
+        CHECK(stg.lookup(t_switch).velocity.nearZero());
+        CHECK(stg.lookup(stg.getDuration()).position.x == Approx(0).margin(1e-4));
+    }
+}
+
+TEST_CASE("Batch lookup", "[trajectory]")
+{
+    SmoothTrajectoryGenerator stg;
+    std::vector<float> times;
+    for (float t = -0.5; t < 12; t += 0.013) times.push_back(t);
+    // Out of order times still work, just with a longer region search
+    times.push_back(3.3);
+    times.push_back(0.2);
+
+    auto checkMatchesLookup = [&]()
+    {
+        TrajectorySamples samples;
+        stg.lookupBatch(times.data(), times.size(), &samples);
+        REQUIRE(samples.size() == times.size());
+        for (size_t i = 0; i < times.size(); i++)
+        {
+            PVTPoint p = stg.lookup(times[i]);
+            REQUIRE(samples.x[i] == Approx(p.position.x).margin(1e-4));
+            REQUIRE(samples.y[i] == Approx(p.position.y).margin(1e-4));
+            REQUIRE(samples.a[i] == Approx(p.position.a).margin(1e-4));
+            REQUIRE(samples.vx[i] == Approx(p.velocity.vx).margin(1e-4));
+            REQUIRE(samples.vy[i] == Approx(p.velocity.vy).margin(1e-4));
+            REQUIRE(samples.va[i] == Approx(p.velocity.va).margin(1e-4));
+        }
+
+        // Acceleration matches the change in velocity
+        const float dt = 0.001;
+        for (float t = 0.1; t < 10; t += 0.37)
+        {
+            float pair[2] = {t, t + dt};
+            TrajectorySamples s;
+            stg.lookupBatch(pair, 2, &s);
+            REQUIRE(s.ax[0] == Approx((s.vx[1] - s.vx[0]) / dt).margin(0.01));
+            REQUIRE(s.ay[0] == Approx((s.vy[1] - s.vy[0]) / dt).margin(0.01));
+            REQUIRE(s.aa[0] == Approx((s.va[1] - s.va[0]) / dt).margin(0.01));
+        }
+    };
+
+    SECTION("Point to point")
+    {
+        REQUIRE(stg.generatePointToPointTrajectory({0.5, -1, 3}, {2, 0.7, -2.8}, LIMITS_MODE::COARSE));
+        checkMatchesLookup();
+    }
+
+    SECTION("Path")
+    {
+        REQUIRE(stg.generatePathTrajectory({0, 0, 0}, {{1, 0, 0}, {1, 1, 1.5}, {0, 1, 0}}, LIMITS_MODE::COARSE));
+        checkMatchesLookup();
+    }
+}
+
+TEST_CASE("Wheel limits", "[trajectory]")
+{
+    SmoothTrajectoryGenerator stg;
+    WheelLimits limits = {false, 0.4, 10, 10};
+    const float half_sq3 = std::sqrt(3.0f) / 2;
+
+    SECTION("Translation along x drives the front wheels")
+    {
+        REQUIRE(stg.generatePointToPointTrajectory({0, 0, 0}, {1, 0, 0}, LIMITS_MODE::COARSE));
+        WheelFeasibility wheels = stg.checkWheelFeasibility(limits, 0.005);
+        CHECK(wheels.ok);
+        CHECK(wheels.max_vel == Approx(half_sq3 * stg.getTrajectory().trans_params.v_lim).epsilon(0.01));
+        CHECK(wheels.max_acc == Approx(half_sq3 * stg.getTrajectory().trans_params.a_lim).epsilon(0.01));
+
+        // Facing the other way round only changes the signs
+        REQUIRE(stg.generatePointToPointTrajectory({0, 0, 1.5708}, {0, 1, 1.5708}, LIMITS_MODE::COARSE));
+        CHECK(stg.checkWheelFeasibility(limits, 0.005).max_vel == Approx(wheels.max_vel).epsilon(0.01));
+    }
+
+    SECTION("Rotation drives every wheel at the base radius")
+    {
+        REQUIRE(stg.generatePointToPointTrajectory({0, 0, 0}, {0, 0, 2}, LIMITS_MODE::COARSE));
+        WheelFeasibility wheels = stg.checkWheelFeasibility(limits, 0.005);
+        CHECK(wheels.max_vel == Approx(limits.base_radius * stg.getTrajectory().rot_params.v_lim).epsilon(0.01));
+    }
+
+    SECTION("Over the limit")
+    {
+        REQUIRE(stg.generatePointToPointTrajectory({0, 0, 0}, {3, 0, 0}, LIMITS_MODE::COARSE));
+        limits.max_vel = 0.5 * half_sq3 * stg.getTrajectory().trans_params.v_lim;
+        WheelFeasibility wheels = stg.checkWheelFeasibility(limits, 0.005);
+        CHECK_FALSE(wheels.ok);
+        // Worst at the middle of the cruise, where the wheels are fastest
+        PVTPoint worst = stg.lookup(wheels.worst_time);
+        CHECK(worst.velocity.vx == Approx(stg.getTrajectory().trans_params.v_lim).epsilon(0.01));
+    }
+}
+
+TEST_CASE("Stop trajectory", "[trajectory]")
+{
+    const DynamicLimits trans_limits = {1.0, 0.5, 2.0};
+    const DynamicLimits rot_limits = {1.0, 1.0, 4.0};
+
+    SECTION("Reaches the deceleration limit")
+    {
+        SCurveParameters params;
+        generateStopSCurve(0.5, trans_limits, &params);
+        CHECK(params.a_lim == Approx(0.5));
+        CHECK(params.switch_points[7].v == Approx(0).margin(1e-5));
+        CHECK(params.switch_points[7].a == Approx(0).margin(1e-5));
+        // Ramp, hold and ramp, the hold makes up the rest of the speed
+        CHECK(params.switch_points[7].t == Approx(0.5 / 0.5 + 0.5 / 2.0));
+        CHECK(params.switch_points[7].p == Approx(0.5 * params.switch_points[7].t / 2));
+    }
+
+    SECTION("Too slow to reach the limit")
+    {
+        SCurveParameters params;
+        generateStopSCurve(0.05, trans_limits, &params);
+        CHECK(params.a_lim == Approx(std::sqrt(0.05 * 2.0)));
+        CHECK(params.switch_points[7].t == Approx(2 * std::sqrt(0.05 / 2.0)));
+        CHECK(params.switch_points[7].v == Approx(0).margin(1e-5));
+    }
+
+    SECTION("Axes stop together along the direction of travel")
+    {
+        SmoothTrajectoryGenerator stg;
+        const Point start = {1, 2, 3};
+        const Velocity vel = {0.3, -0.4, -0.2};
+        REQUIRE(stg.generateStopTrajectory(start, vel, trans_limits, rot_limits));
+        const Trajectory& traj = stg.getTrajectory();
+        CHECK(traj.trans_params.switch_points[7].t == Approx(traj.rot_params.switch_points[7].t));
+        CHECK(traj.rot_params.a_lim <= rot_limits.max_acc);
+        CHECK(traj.rot_params.j_lim <= rot_limits.max_jerk);
+
+        PVTPoint p0 = stg.lookup(0);
+        CHECK(p0.velocity.vx == Approx(vel.vx));
+        CHECK(p0.velocity.vy == Approx(vel.vy));
+        CHECK(p0.velocity.va == Approx(vel.va));
+
+        // Straight along the initial velocity, and as far as predicted
+        PVTPoint end = stg.lookup(stg.getDuration());
+        CHECK(end.velocity.nearZero());
+        const float dist = traj.trans_params.switch_points[7].p;
+        CHECK(end.position.x == Approx(start.x + 0.6 * dist));
+        CHECK(end.position.y == Approx(start.y - 0.8 * dist));
+        CHECK(end.position.a < start.a);
+
+        // The deceleration ramps in instead of jumping
+        float t[2] = {0, 0.01};
+        TrajectorySamples samples;
+        stg.lookupBatch(t, 2, &samples);
+        CHECK(Eigen::Vector2f(samples.ax[1], samples.ay[1]).norm() <= trans_limits.max_jerk * 0.01 * 1.01);
+    }
+
+    SECTION("Already stopped")
+    {
+        SmoothTrajectoryGenerator stg;
+        REQUIRE(stg.generateStopTrajectory({0, 0, 0}, {0, 0, 0}, trans_limits, rot_limits));
+        CHECK(stg.getDuration() == 0);
+        CHECK(stg.lookup(0.1).velocity.nearZero());
+    }
 }
 
 TEST_CASE("BuildMotionPlanningProblem", "[trajectory]")
@@ -258,6 +613,80 @@ TEST_CASE("generateTrajectory", "[trajectory]")
     CHECK(traj.rot_direction == -1);
 }
 
+TEST_CASE("Coupled trajectory", "[trajectory]")
+{
+    SafeConfigModifier<bool> coupled_modifier("trajectory_generation.coupled.enabled", true);
+    const float radius = cfg.lookup("trajectory_generation.coupled.base_radius");
+    const float wheel_vel = cfg.lookup("trajectory_generation.coupled.wheel_max_vel");
+    const float wheel_acc = cfg.lookup("trajectory_generation.coupled.wheel_max_acc");
+    SolverParameters solver = {25, 0.8, 0.8, 0.1, SOLVER_MODE::ANALYTIC};
+
+    SECTION("Only coarse moves")
+    {
+        MotionPlanningProblem mpp = buildMotionPlanningProblem({0,0,0}, {1,0,0}, LIMITS_MODE::COARSE, solver);
+        REQUIRE(mpp.wheelLimits.enabled);
+        REQUIRE(mpp.translationalLimits.max_vel == Approx(wheel_vel));
+        REQUIRE(mpp.rotationalLimits.max_vel == Approx(wheel_vel / radius));
+        REQUIRE_FALSE(buildMotionPlanningProblem({0,0,0}, {1,0,0}, LIMITS_MODE::FINE, solver).wheelLimits.enabled);
+    }
+
+    SECTION("Axes share the wheel limits")
+    {
+        Point target = {1.5, -0.5, 1.2};
+        Trajectory traj = generateTrajectory(buildMotionPlanningProblem({0,0,0}, target, LIMITS_MODE::COARSE, solver));
+        REQUIRE(traj.complete);
+        REQUIRE(traj.trans_params.switch_points[7].t == Approx(traj.rot_params.switch_points[7].t));
+        REQUIRE(traj.trans_params.switch_points[7].p == Approx(sqrt(1.5*1.5 + 0.5*0.5)));
+        REQUIRE(traj.rot_params.switch_points[7].p == Approx(1.2));
+        REQUIRE(traj.rot_direction == 1);
+
+        float max_wheel_vel = 0;
+        float max_wheel_acc = 0;
+        const float duration = trajectoryDuration(traj);
+        for (float t = 0; t <= duration; t += 0.01)
+        {
+            Kinematics1D trans = lookup_1D(t, traj.trans_params);
+            Kinematics1D rot = lookup_1D(t, traj.rot_params);
+            max_wheel_vel = std::max(max_wheel_vel, fabsf(trans.v) + radius * fabsf(rot.v));
+            max_wheel_acc = std::max(max_wheel_acc, fabsf(trans.a) + radius * fabsf(rot.a));
+        }
+        CHECK(max_wheel_vel <= wheel_vel * 1.001);
+        CHECK(max_wheel_acc <= wheel_acc * 1.001);
+        // Whichever limit binds is used all the way up to it
+        CHECK((max_wheel_vel > wheel_vel * 0.99 || max_wheel_acc > wheel_acc * 0.99));
+    }
+
+    SECTION("Faster than separate limits when the wheels allow it")
+    {
+        SafeConfigModifier<float> acc_modifier("trajectory_generation.coupled.wheel_max_acc", 3.0);
+        Trajectory coupled = generateTrajectory(buildMotionPlanningProblem({0,0,0}, {5,0,0.5}, LIMITS_MODE::COARSE, solver));
+        REQUIRE(coupled.complete);
+        MotionPlanningProblem separate_mpp = buildMotionPlanningProblem({0,0,0}, {5,0,0.5}, LIMITS_MODE::COARSE, solver);
+        separate_mpp.wheelLimits.enabled = false;
+        separate_mpp.translationalLimits.max_vel = cfg.lookup("motion.translation.max_vel.coarse");
+        separate_mpp.rotationalLimits.max_vel = cfg.lookup("motion.rotation.max_vel.coarse");
+        Trajectory separate = generateTrajectory(separate_mpp);
+        REQUIRE(separate.complete);
+        CHECK(trajectoryDuration(coupled) < trajectoryDuration(separate));
+    }
+
+    SECTION("Pure rotation")
+    {
+        Trajectory traj = generateTrajectory(buildMotionPlanningProblem({1,1,0}, {1,1,-0.5}, LIMITS_MODE::COARSE, solver));
+        REQUIRE(traj.complete);
+        REQUIRE(traj.trans_params.switch_points[7].p == 0);
+        REQUIRE(traj.rot_params.switch_points[7].p == Approx(0.5));
+        REQUIRE(traj.rot_direction == -1);
+    }
+
+    SECTION("No motion")
+    {
+        Trajectory traj = generateTrajectory(buildMotionPlanningProblem({1,1,0}, {1,1,0}, LIMITS_MODE::COARSE, solver));
+        REQUIRE(traj.complete);
+        REQUIRE(trajectoryDuration(traj) == 0);
+    }
+}
+
 TEST_CASE("generateSCurve", "[trajectory]")
 {
     float dist = 10;
@@ -374,6 +803,92 @@ TEST_CASE("generateSCurve", "[trajectory]")
     }
 }
 
+TEST_CASE("generateSCurve analytic", "[trajectory]")
+{
+    SolverParameters solver = {25, 0.8, 0.8, 0.1, SOLVER_MODE::ANALYTIC};
+
+    SECTION("Matches iterative when limits are reached")
+    {
+        float dist = 10;
+        DynamicLimits limits = {1, 2, 8};
+        SCurveParameters params;
+        bool ok = generateSCurve(dist, limits, solver, &params);
+        REQUIRE(ok == true);
+        REQUIRE(params.v_lim == 1.0);
+        REQUIRE(params.a_lim == 2.0);
+        REQUIRE(params.j_lim == 8.0);
+        float dt_v = 9.25; // Expected values
+        float dt_a = 0.25;
+        float dt_j = 0.25;
+        CHECK(params.switch_points[1].t == Approx(dt_j));
+        CHECK(params.switch_points[2].t == Approx(dt_j + dt_a));
+        CHECK(params.switch_points[3].t == Approx(2*dt_j + dt_a));
+        CHECK(params.switch_points[4].t == Approx(2*dt_j + dt_a + dt_v));
+        CHECK(params.switch_points[7].t == Approx(4*dt_j + 2*dt_a + dt_v));
+        CHECK(params.switch_points[7].p == Approx(dist));
+    }
+
+    SECTION("Velocity limit not reached")
+    {
+        // a_max reached after 1s at 1 m/s, but 2 m/s is too fast for 3m
+        float dist = 3;
+        DynamicLimits limits = {2, 1, 1};
+        SCurveParameters params;
+        bool ok = generateSCurve(dist, limits, solver, &params);
+        REQUIRE(ok == true);
+        CHECK(params.v_lim < 2);
+        CHECK(params.a_lim == 1);
+        CHECK(params.j_lim == 1);
+        CHECK(params.switch_points[4].t == Approx(params.switch_points[3].t));
+        CHECK(params.switch_points[3].v == Approx(params.v_lim));
+        CHECK(params.switch_points[7].p == Approx(dist));
+    }
+
+    SECTION("Acceleration limit not reached")
+    {
+        float dist = 0.01;
+        DynamicLimits limits = {1, 2, 1};
+        SCurveParameters params;
+        bool ok = generateSCurve(dist, limits, solver, &params);
+        REQUIRE(ok == true);
+        CHECK(params.a_lim < 2);
+        CHECK(params.switch_points[2].t == Approx(params.switch_points[1].t));
+        CHECK(params.switch_points[4].t == Approx(params.switch_points[3].t));
+        CHECK(params.switch_points[7].p == Approx(dist));
+    }
+
+    SECTION("Sweep of distances")
+    {
+        // Every move must end at rest at the right distance, within limits and no slower than the iterative solver
+        DynamicLimits limits = {0.5, 0.3, 1.5};
+        SolverParameters iterative = {30, 0.8, 0.8, 0.1, SOLVER_MODE::ITERATIVE};
+        for (float dist = 0.001; dist < 20; dist *= 1.3)
+        {
+            SCurveParameters params;
+            REQUIRE(generateSCurve(dist, limits, solver, &params) == true);
+            CHECK(params.switch_points[7].p == Approx(dist).epsilon(1e-4));
+            CHECK(params.switch_points[7].v == Approx(0).margin(1e-4));
+            CHECK(params.switch_points[7].a == Approx(0).margin(1e-4));
+            CHECK(params.v_lim <= limits.max_vel);
+            CHECK(params.a_lim <= limits.max_acc);
+            CHECK(params.j_lim <= limits.max_jerk);
+
+            SCurveParameters iterative_params;
+            if (generateSCurve(dist, limits, iterative, &iterative_params))
+            {
+                CHECK(params.switch_points[7].t <= iterative_params.switch_points[7].t + 1e-4);
+            }
+        }
+    }
+
+    SECTION("Invalid limits")
+    {
+        DynamicLimits limits = {1, 0, 1};
+        SCurveParameters params;
+        CHECK(generateSCurve(1.0, limits, solver, &params) == false);
+    }
+}
+
 TEST_CASE("populateSwitchTimeParameters", "[trajectory]")
 {
     SCurveParameters params;
@@ -448,71 +963,86 @@ TEST_CASE("lookup_1D", "[trajectory]")
     {
         int region = 1;
         float time = static_cast<float>(region-1) + 0.5;
-        std::vector<float> test_vec = lookup_1D(time, params);
+        Kinematics1D test_vec = lookup_1D(time, params);
         float expected_v = 1.625;
         float expected_p = 1.645;
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[0] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 2 - Const Positive Acc")
     {
         int region = 2;
         float time = static_cast<float>(region-1) + 0.5;
-        std::vector<float> test_vec = lookup_1D(time, params);
+        Kinematics1D test_vec = lookup_1D(time, params);
         float expected_v = 1.5;
         float expected_p = 1.625;
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[0] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 3 - Const Negative Jerk")
     {
         int region = 3;
         float time = static_cast<float>(region-1) + 0.5;
-        std::vector<float> test_vec = lookup_1D(time, params);
+        Kinematics1D test_vec = lookup_1D(time, params);
         float expected_v = 1.375;
         float expected_p = 1.604;
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[0] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 4 - Const Vel")
     {
         int region = 4;
         float time = static_cast<float>(region-1) + 0.5;
-        std::vector<float> test_vec = lookup_1D(time, params);
+        Kinematics1D test_vec = lookup_1D(time, params);
         float expected_v = 1.0;
         float expected_p = 1.5;
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[0] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 5 - Const Negative Jerk")
     {
         int region = 5;
         float time = static_cast<float>(region-1) + 0.5;
-        std::vector<float> test_vec = lookup_1D(time, params);
+        Kinematics1D test_vec = lookup_1D(time, params);
         float expected_v = 1.375;
         float expected_p = 1.604;
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[0] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 6 - Const Negative Acc")
     {
         int region = 6;
         float time = static_cast<float>(region-1) + 0.5;
-        std::vector<float> test_vec = lookup_1D(time, params);
+        Kinematics1D test_vec = lookup_1D(time, params);
         float expected_v = 1.5;
         float expected_p = 1.625;
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[0] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 7 - Const Positive Jerk")
     {
         int region = 7;
         float time = static_cast<float>(region-1) + 0.5;
-        std::vector<float> test_vec = lookup_1D(time, params);
+        Kinematics1D test_vec = lookup_1D(time, params);
         float expected_v = 1.625;
         float expected_p = 1.645;
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[0] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
+    }
+    SECTION("Region hint")
+    {
+        // Any starting hint, moving forward or backward, must give the same result as a full search
+        std::vector<float> times = {0.2, 0.7, 2.5, 2.6, 6.9, 1.1, 4.0, 3.0, 7.5, 0.5};
+        int hint = 5;
+        for (float time : times)
+        {
+            Kinematics1D expected = lookup_1D(time, params);
+            Kinematics1D hinted = lookup_1D(time, params, &hint);
+            CHECK(hinted.p == expected.p);
+            CHECK(hinted.v == expected.v);
+            CHECK(hinted.a == expected.a);
+            if (time < 7) CHECK(hint == static_cast<int>(std::ceil(time)));
+        }
     }
 }
 
@@ -536,85 +1066,85 @@ TEST_CASE("computeKinematicsBasedOnRegion", "[trajectory]")
     {
         int region = 1;
         float dt = 0.5;
-        std::vector<float> test_vec = computeKinematicsBasedOnRegion(params, region, dt);
+        Kinematics1D test_vec = computeKinematicsBasedOnRegion(params, region, dt);
         float expected_a = 1.5;
         float expected_v = 1.625;
         float expected_p = 1.645;
-        REQUIRE(test_vec[0] == Approx(expected_a).margin(0.001));
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[2] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.a == Approx(expected_a).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 2 - Const Positive Acc")
     {
         int region = 2;
         float dt = 0.5;
-        std::vector<float> test_vec = computeKinematicsBasedOnRegion(params, region, dt);
+        Kinematics1D test_vec = computeKinematicsBasedOnRegion(params, region, dt);
         float expected_a = 1.0;
         float expected_v = 1.5;
         float expected_p = 1.625;
-        REQUIRE(test_vec[0] == Approx(expected_a).margin(0.001));
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[2] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.a == Approx(expected_a).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 3 - Const Negative Jerk")
     {
         int region = 3;
         float dt = 0.5;
-        std::vector<float> test_vec = computeKinematicsBasedOnRegion(params, region, dt);
+        Kinematics1D test_vec = computeKinematicsBasedOnRegion(params, region, dt);
         float expected_a = 0.5;
         float expected_v = 1.375;
         float expected_p = 1.604;
-        REQUIRE(test_vec[0] == Approx(expected_a).margin(0.001));
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[2] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.a == Approx(expected_a).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 4 - Const Vel")
     {
         int region = 4;
         float dt = 0.5;
-        std::vector<float> test_vec = computeKinematicsBasedOnRegion(params, region, dt);
+        Kinematics1D test_vec = computeKinematicsBasedOnRegion(params, region, dt);
         float expected_a = 0;
         float expected_v = 1.0;
         float expected_p = 1.5;
-        REQUIRE(test_vec[0] == Approx(expected_a).margin(0.001));
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[2] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.a == Approx(expected_a).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 5 - Const Negative Jerk")
     {
         int region = 5;
         float dt = 0.5;
-        std::vector<float> test_vec = computeKinematicsBasedOnRegion(params, region, dt);
+        Kinematics1D test_vec = computeKinematicsBasedOnRegion(params, region, dt);
         float expected_a = 0.5;
         float expected_v = 1.375;
         float expected_p = 1.604;
-        REQUIRE(test_vec[0] == Approx(expected_a).margin(0.001));
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[2] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.a == Approx(expected_a).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 6 - Const Negative Acc")
     {
         int region = 6;
         float dt = 0.5;
-        std::vector<float> test_vec = computeKinematicsBasedOnRegion(params, region, dt);
+        Kinematics1D test_vec = computeKinematicsBasedOnRegion(params, region, dt);
         float expected_a = -1.0;
         float expected_v = 1.5;
         float expected_p = 1.625;
-        REQUIRE(test_vec[0] == Approx(expected_a).margin(0.001));
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[2] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.a == Approx(expected_a).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
     SECTION("Region 7 - Const Positive Jerk")
     {
         int region = 7;
         float dt = 0.5;
-        std::vector<float> test_vec = computeKinematicsBasedOnRegion(params, region, dt);
+        Kinematics1D test_vec = computeKinematicsBasedOnRegion(params, region, dt);
         float expected_a = 1.5;
         float expected_v = 1.625;
         float expected_p = 1.645;
-        REQUIRE(test_vec[0] == Approx(expected_a).margin(0.001));
-        REQUIRE(test_vec[1] == Approx(expected_v).margin(0.001));
-        REQUIRE(test_vec[2] == Approx(expected_p).margin(0.001));
+        REQUIRE(test_vec.a == Approx(expected_a).margin(0.001));
+        REQUIRE(test_vec.v == Approx(expected_v).margin(0.001));
+        REQUIRE(test_vec.p == Approx(expected_p).margin(0.001));
     }
 }
 
@@ -680,3 +1210,52 @@ TEST_CASE("synchronizeParameters", "[trajectory]")
         }
     }
 }
+
+TEST_CASE("Trajectory lookup benchmark", "[.][benchmark]")
+{
+    SmoothTrajectoryGenerator stg;
+    Point p1 = {0,0,0};
+    Point p2 = {3,2,1};
+    REQUIRE(stg.generatePointToPointTrajectory(p1, p2, LIMITS_MODE::COARSE));
+
+    // Sweep the whole trajectory like the controller does, at a fine enough step to be timing dominated
+    const int iterations = 200000;
+    const float end_time = 20;
+    float sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        PVTPoint output = stg.lookup(end_time * i / iterations);
+        sink += output.position.x;
+    }
+    auto lookup_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(sink != 0);
+    WARN("Trajectory lookup per call: " << 1000.0f * lookup_us / iterations << " ns");
+}
+
+TEST_CASE("SCurve solver benchmark", "[.][benchmark]")
+{
+    DynamicLimits limits = {0.5, 0.3, 1.5};
+    const int iterations = 1000;
+    float sink = 0;
+
+    for (SOLVER_MODE mode : {SOLVER_MODE::ITERATIVE, SOLVER_MODE::ANALYTIC})
+    {
+        SolverParameters solver = {30, 0.8, 0.8, 0.1, mode};
+        int failures = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            // Spread of short to long moves, short ones are where the iterative solver loops the most
+            float dist = 0.01 + 5.0 * i / iterations;
+            SCurveParameters params;
+            if (!generateSCurve(dist, limits, solver, &params)) failures++;
+            sink += params.switch_points[7].t;
+        }
+        auto solve_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        WARN((mode == SOLVER_MODE::ANALYTIC ? "Analytic" : "Iterative") << " solver per call: "
+             << static_cast<float>(solve_us) / iterations << " us, " << failures << " failures");
+    }
+    CHECK(sink != 0);
+}
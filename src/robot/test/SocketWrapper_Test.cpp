@@ -4,26 +4,42 @@
 #include "sockets/ClientSocket.h"
 #include "sockets/SocketException.h"
 #include "sockets/SocketMultiThreadWrapper.h"
+#include "sockets/MonitorServer.h"
+#include "sockets/SpscByteRingBuffer.h"
+#include "StatusUpdater.h"
 
 
 
+// The socket thread holds the port for the rest of the run, so every test shares one wrapper
+SocketMultiThreadWrapper& SharedSocket()
+{
+    static SocketMultiThreadWrapper s;
+    return s;
+}
+
 void SimpleSocketSend(std::string data_to_send)
 {
+    SocketMultiThreadWrapper& s = SharedSocket();
+    const uint32_t old_id = s.getConnectionId();
     usleep(1000);
     
     ClientSocket test_socket ( "localhost", 8123 );
 
+    // Stands in for RobotServer, which lets the socket thread read from a new client once it has dropped the old one
+    for(int i = 0; i < 1000 && s.getConnectionId() == old_id; i++) usleep(100);
+    s.acceptConnection(s.getConnectionId());
+
     //Send message
     test_socket << data_to_send;
 
     // Brief wait to ensure thread processed the sent message
-    usleep(1000);
+    for(int i = 0; i < 1000 && !s.dataAvailableToRead(); i++) usleep(100);
 }
 
 TEST_CASE("Socket send test", "[socket]") 
 {
     
-    SocketMultiThreadWrapper s;
+    SocketMultiThreadWrapper& s = SharedSocket();
     std::string test_msg = "This is a test";
     for(int i = 0; i < 10; i++)
     {
@@ -34,6 +50,77 @@ TEST_CASE("Socket send test", "[socket]")
     }   
 }
 
+TEST_CASE("Full status fits the send buffer", "[socket]")
+{
+    SocketMultiThreadWrapper& s = SharedSocket();
+    StatusUpdater status;
+    const std::string frame = "<" + status.getStatusJsonString() + ">";
+    REQUIRE(frame.size() <= MAX_SEND_FRAME_SIZE);
+
+    // Nothing drains it without a client, and a couple of status frames waiting is normal
+    const uint32_t drops = s.getBufferStats().send_drops;
+    s.sendData(frame);
+    s.sendData(frame);
+    REQUIRE(s.getBufferStats().send_drops == drops);
+}
+
+TEST_CASE("SpscByteRingBuffer", "[socket]")
+{
+    SpscByteRingBuffer<8> buf;
+    char out[8];
+    REQUIRE(buf.empty());
+    REQUIRE(buf.capacity() == 8);
+
+    SECTION("Simple read write")
+    {
+        REQUIRE(buf.write("abc", 3));
+        REQUIRE(buf.size() == 3);
+        REQUIRE(buf.read(out, 8) == 3);
+        REQUIRE(std::string(out, 3) == "abc");
+        REQUIRE(buf.empty());
+    }
+    SECTION("Overflow drops whole message")
+    {
+        REQUIRE(buf.write("abcdef", 6));
+        REQUIRE_FALSE(buf.write("ghi", 3));
+        REQUIRE(buf.size() == 6);
+        REQUIRE(buf.write("gh", 2));
+        REQUIRE(buf.size() == 8);
+        REQUIRE(buf.read(out, 8) == 8);
+        REQUIRE(std::string(out, 8) == "abcdefgh");
+    }
+    SECTION("Wrap around")
+    {
+        REQUIRE(buf.write("abcdef", 6));
+        REQUIRE(buf.read(out, 4) == 4);
+        REQUIRE(buf.write("ghijk", 5));
+        REQUIRE(buf.size() == 7);
+        REQUIRE(buf.read(out, 8) == 7);
+        REQUIRE(std::string(out, 7) == "efghijk");
+    }
+    SECTION("Peek and partial consume")
+    {
+        const char* first;
+        const char* second;
+        size_t first_len;
+        size_t second_len;
+        REQUIRE(buf.write("abcdef", 6));
+        REQUIRE(buf.read(out, 4) == 4);
+        REQUIRE(buf.write("ghijk", 5));
+        // Wrapped data comes back as two segments
+        REQUIRE(buf.peek(&first, &first_len, &second, &second_len) == 7);
+        REQUIRE(std::string(first, first_len) + std::string(second, second_len) == "efghijk");
+        REQUIRE(second_len > 0);
+        buf.consume(3);
+        REQUIRE(buf.size() == 4);
+        REQUIRE(buf.peek(&first, &first_len, &second, &second_len) == 4);
+        REQUIRE(std::string(first, first_len) + std::string(second, second_len) == "hijk");
+        buf.consume(4);
+        REQUIRE(buf.empty());
+        REQUIRE(buf.peek(&first, &first_len, &second, &second_len) == 0);
+    }
+}
+
 // TEST_CASE("Socket recv test", "[socket]") 
 // {
     
@@ -51,4 +138,26 @@ TEST_CASE("Socket send test", "[socket]")
 //         test_socket >> data;
 //         REQUIRE(data == test_msg);
 //     }   
-// }
\ No newline at end of file
+// }
+TEST_CASE("Monitor clients share the status stream", "[socket]")
+{
+    MonitorServer monitor(8126, 2);
+    REQUIRE_FALSE(monitor.hasClients());
+    ClientSocket client_1("localhost", 8126);
+    ClientSocket client_2("localhost", 8126);
+    for(int i = 0; i < 100 && !monitor.hasClients(); i++) usleep(1000);
+    usleep(10000);
+    REQUIRE(monitor.hasClients());
+
+    // Only max_clients are kept, the one over the limit is closed straight away
+    ClientSocket client_3("localhost", 8126);
+    usleep(10000);
+    std::string data;
+    REQUIRE_THROWS(client_3 >> data);
+
+    monitor.publish("<{\"type\":\"status\"}>");
+    client_1 >> data;
+    REQUIRE(data == "<{\"type\":\"status\"}>");
+    client_2 >> data;
+    REQUIRE(data == "<{\"type\":\"status\"}>");
+}
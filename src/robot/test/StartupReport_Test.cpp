@@ -0,0 +1,23 @@
+#include <Catch/catch.hpp>
+
+#include "StartupReport.h"
+#include "test-utils.h"
+#include <thread>
+
+TEST_CASE("Startup report phases", "[StartupReport]")
+{
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    StartupReport startup;
+
+    startup.time("first", [&]() { mock_clock->advance_ms(20); });
+    std::thread other([&]() { startup.time("second", []() {}); });
+    other.join();
+
+    std::vector<StartupReport::Phase> phases = startup.getPhases();
+    REQUIRE(phases.size() == 2);
+    CHECK(phases[0].name == "first");
+    CHECK(phases[0].ms == Approx(20));
+    CHECK(phases[1].name == "second");
+    CHECK(phases[1].ms == Approx(0));
+    CHECK(startup.getTotalMs() == Approx(20));
+}
@@ -2,6 +2,10 @@
 
 #include "StatusUpdater.h"
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 using Catch::Matchers::StartsWith;
 using Catch::Matchers::EndsWith;
 using Catch::Matchers::Contains;
@@ -76,3 +80,160 @@ TEST_CASE("JSON", "[StatusUpdater]")
     REQUIRE_THAT(json_string, Contains("\"position_loop_ms\":8"));
     REQUIRE_THAT(json_string, EndsWith("}"));
 }
+
+TEST_CASE("Socket stats JSON", "[StatusUpdater]")
+{
+    StatusUpdater s;
+    SocketBufferStats stats;
+    stats.read_fill = 10;
+    stats.send_fill = 20;
+    stats.capacity = 2048;
+    stats.read_drops = 1;
+    stats.send_drops = 2;
+    stats.tcp_rtt_ms = 1.5;
+    stats.ping_rtt_ms = 6.25;
+    s.updateSocketBufferStats(stats);
+
+    std::string json_string = s.getStatusJsonString();
+
+    REQUIRE_THAT(json_string, Contains("\"socket_rx_fill\":10"));
+    REQUIRE_THAT(json_string, Contains("\"socket_tx_fill\":20"));
+    REQUIRE_THAT(json_string, Contains("\"socket_capacity\":2048"));
+    REQUIRE_THAT(json_string, Contains("\"socket_rx_drops\":1"));
+    REQUIRE_THAT(json_string, Contains("\"socket_tx_drops\":2"));
+    REQUIRE_THAT(json_string, Contains("\"socket_tcp_rtt_ms\":1.5"));
+    REQUIRE_THAT(json_string, Contains("\"socket_ping_rtt_ms\":6.25"));
+}
+
+TEST_CASE("Status delta JSON", "[StatusUpdater]")
+{
+    StatusUpdater s;
+    s.updatePosition(1,2,3);
+    s.updateVelocity(4,5,6);
+
+    // First delta has every field in the mask
+    std::string json_string = s.getStatusDeltaJsonString(STATUS_GROUP_POSE | STATUS_GROUP_VELOCITY);
+    REQUIRE_THAT(json_string, StartsWith("{\"type\":\"status_delta\""));
+    REQUIRE_THAT(json_string, Contains("\"pos_x\":1"));
+    REQUIRE_THAT(json_string, Contains("\"vel_a\":6"));
+    REQUIRE_THAT(json_string, !Contains("controller_loop_ms"));
+
+    // Nothing changed
+    REQUIRE(s.getStatusDeltaJsonString(STATUS_GROUP_POSE | STATUS_GROUP_VELOCITY) == "");
+
+    // Only changed fields are sent
+    s.updatePosition(1,7,3);
+    json_string = s.getStatusDeltaJsonString(STATUS_GROUP_POSE | STATUS_GROUP_VELOCITY);
+    REQUIRE_THAT(json_string, Contains("\"pos_y\":7"));
+    REQUIRE_THAT(json_string, !Contains("pos_x"));
+    REQUIRE_THAT(json_string, !Contains("vel_x"));
+
+    // Changes outside the mask are ignored
+    s.updateControlLoopTime(5);
+    REQUIRE(s.getStatusDeltaJsonString(STATUS_GROUP_POSE) == "");
+
+    s.resetStatusDelta();
+    json_string = s.getStatusDeltaJsonString(STATUS_GROUP_POSE);
+    REQUIRE_THAT(json_string, Contains("\"pos_x\":1"));
+}
+
+TEST_CASE("Cached JSON", "[StatusUpdater]")
+{
+    StatusUpdater s;
+    s.updatePosition(1,2,3);
+    std::string first = s.getStatusJsonString();
+    std::string second = s.getStatusJsonString();
+
+    // Only the counter changes between calls with no updates
+    REQUIRE_THAT(first, Contains("\"counter\":0}}"));
+    REQUIRE_THAT(second, Contains("\"counter\":1}}"));
+    REQUIRE(first.substr(0, first.find("\"counter\"")) == second.substr(0, second.find("\"counter\"")));
+
+    // Updates are picked up
+    s.updatePosition(4,5,6);
+    s.setErrorStatus();
+    std::string third = s.getStatusJsonString();
+    REQUIRE_THAT(third, Contains("\"pos_x\":4"));
+    REQUIRE_THAT(third, Contains("\"error_status\":true"));
+    REQUIRE_THAT(third, Contains("\"vel_x\":0"));
+}
+
+TEST_CASE("Concurrent producers", "[StatusUpdater]")
+{
+    StatusUpdater s;
+    std::atomic<bool> done(false);
+
+    // Each producer writes its own section from its own thread while the server serializes
+    std::thread controller([&]()
+    {
+        for (int i = 1; i <= 20000; i++)
+        {
+            s.updatePosition(i, i, i);
+        }
+    });
+    std::thread server([&]()
+    {
+        while (!done)
+        {
+            SocketBufferStats stats;
+            stats.read_fill = 3;
+            stats.send_fill = 3;
+            s.updateSocketBufferStats(stats);
+            s.setErrorStatus();
+        }
+    });
+
+    float last_x = 0;
+    for (int i = 0; i < 2000; i++)
+    {
+        Point p = s.getPosition();
+        REQUIRE(p.x == p.y);
+        REQUIRE(p.x == p.a);
+        REQUIRE(p.x >= last_x);
+        last_x = p.x;
+        s.getStatusJsonString();
+    }
+    controller.join();
+    done = true;
+    server.join();
+
+    StatusUpdater::Status status = s.getStatus();
+    REQUIRE(status.pos_x == 20000);
+    REQUIRE(status.socket_stats.read_fill == 3);
+    REQUIRE(status.error_status);
+    REQUIRE_THAT(s.getStatusJsonString(), Contains("\"pos_x\":20000"));
+}
+
+TEST_CASE("Status serialization benchmark", "[.][benchmark]")
+{
+    const int iterations = 10000;
+    StatusUpdater s;
+    StatusUpdater::Status status;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        status.pos_x = i;
+        std::string msg = status.toJsonString();
+    }
+    auto uncached_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        std::string msg = s.getStatusJsonString();
+    }
+    auto cached_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        s.updatePosition(i, 0, 0);
+        std::string msg = s.getStatusJsonString();
+    }
+    auto pose_dirty_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    WARN("Status JSON per call: uncached " << static_cast<float>(uncached_us) / iterations
+         << " us, cached " << static_cast<float>(cached_us) / iterations
+         << " us, pose changed " << static_cast<float>(pose_dirty_us) / iterations << " us");
+}
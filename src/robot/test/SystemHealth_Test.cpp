@@ -0,0 +1,144 @@
+#include <Catch/catch.hpp>
+
+#include "SystemHealth.h"
+#include "test-utils.h"
+
+#include <cstdio>
+
+namespace
+{
+    void writeFile(const std::string& path, const std::string& contents)
+    {
+        FILE* file = fopen(path.c_str(), "w");
+        REQUIRE(file);
+        fputs(contents.c_str(), file);
+        fclose(file);
+    }
+
+    SystemHealthStats atTemp(float temp_c)
+    {
+        SystemHealthStats health;
+        health.soc_temp_c = temp_c;
+        return health;
+    }
+}
+
+TEST_CASE("System health parsers", "[SystemHealth]")
+{
+    const std::string proc_stat =
+        "cpu  400 0 200 1600 100 0 0 0 0 0\n"
+        "cpu0 100 0 50 400 50 0 0 0 0 0\n"
+        "cpu1 300 0 150 1200 50 10 5 0 0 0\n"
+        "intr 12345\n";
+    CpuTicks cores[SYSTEM_HEALTH_MAX_CORES];
+    REQUIRE(parseCoreTicks(proc_stat, cores, SYSTEM_HEALTH_MAX_CORES) == 2);
+    CHECK(cores[0].busy == 150);
+    CHECK(cores[0].total == 600);
+    CHECK(cores[1].busy == 465);
+    CHECK(cores[1].total == 1715);
+    CHECK(parseCoreTicks(proc_stat, cores, 1) == 1);
+
+    uint64_t ticks = 0;
+    REQUIRE(parseStatCpuTicks("1234 (robot (main)) S 1 1234 1234 0 -1 4194560 100 0 0 0 250 75 0 0 20 0 8 0", &ticks));
+    CHECK(ticks == 325);
+    CHECK_FALSE(parseStatCpuTicks("1234 (short) S 1", &ticks));
+
+    CHECK(parseThrottled("50005\n") == 0x50005);
+    CHECK(parseThrottled("0x4") == THROTTLE_THROTTLED);
+    CHECK(parseThrottled("0") == 0);
+}
+
+TEST_CASE("System health monitor samples temperature and cpu use", "[SystemHealth]")
+{
+    writeFile("/tmp/system_health_temp", "76543\n");
+    writeFile("/tmp/system_health_throttled", "20002\n");
+    SafeConfigModifier<std::string> config_modifier_1("system_health.temp_path", "/tmp/system_health_temp");
+    SafeConfigModifier<std::string> config_modifier_2("system_health.throttle_path", "/tmp/system_health_throttled");
+
+    SystemHealthMonitor::registerThread(SYSTEM_THREAD::MAIN);
+    SystemHealthMonitor monitor;
+    SystemHealthStats first = monitor.sample();
+    CHECK(first.soc_temp_c == Approx(76.543));
+    CHECK(first.throttle_flags == (THROTTLE_FREQ_CAPPED | (THROTTLE_FREQ_CAPPED << 16)));
+    CHECK(first.process_cpu == 0);
+
+    // Burn some cpu on this thread so there is something to measure
+    volatile double sink = 0;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100))
+    {
+        for (int i = 0; i < 1000; i++) sink = sink + i;
+    }
+    SystemHealthStats second = monitor.sample();
+    REQUIRE(second.num_cores > 0);
+    for (int i = 0; i < second.num_cores; i++)
+    {
+        CHECK(second.core_usage[i] >= 0);
+        CHECK(second.core_usage[i] <= 1);
+    }
+    CHECK(second.process_cpu > 0.3);
+    CHECK(second.main_thread_cpu > 0.3);
+    CHECK(second.main_thread_cpu <= second.process_cpu + 0.2);
+    CHECK(second.control_thread_cpu == 0);
+}
+
+TEST_CASE("Vision degrade policy", "[SystemHealth]")
+{
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    SafeConfigModifier<bool> config_modifier("system_health.degrade.enabled", true);
+    VisionDegradePolicy policy;
+    ControlThreadStats control;
+
+    REQUIRE(policy.update(atTemp(60), control, 0) == VISION_DEGRADE::NONE);
+
+    SECTION("Temperature")
+    {
+        REQUIRE(policy.update(atTemp(76), control, 0) == VISION_DEGRADE::REDUCED_RATE);
+        mock_clock->advance_sec(2);
+        REQUIRE(policy.update(atTemp(76), control, 0) == VISION_DEGRADE::REDUCED_RATE);
+        // Still warm with the rate reduced, so shed more
+        mock_clock->advance_sec(1.5);
+        REQUIRE(policy.update(atTemp(76), control, 0) == VISION_DEGRADE::MINIMAL);
+
+        // Inside the hysteresis the escalated level holds
+        mock_clock->advance_sec(11);
+        REQUIRE(policy.update(atTemp(73), control, 0) == VISION_DEGRADE::MINIMAL);
+
+        // Once cool it steps back down a level per recover_time
+        REQUIRE(policy.update(atTemp(60), control, 0) == VISION_DEGRADE::MINIMAL);
+        mock_clock->advance_sec(11);
+        REQUIRE(policy.update(atTemp(60), control, 0) == VISION_DEGRADE::REDUCED_RATE);
+        mock_clock->advance_sec(5);
+        REQUIRE(policy.update(atTemp(60), control, 0) == VISION_DEGRADE::REDUCED_RATE);
+        mock_clock->advance_sec(6);
+        REQUIRE(policy.update(atTemp(60), control, 0) == VISION_DEGRADE::NONE);
+
+        REQUIRE(policy.update(atTemp(81), control, 0) == VISION_DEGRADE::MINIMAL);
+    }
+
+    SECTION("Throttling and late loops")
+    {
+        SystemHealthStats throttled = atTemp(60);
+        throttled.throttle_flags = THROTTLE_FREQ_CAPPED << 16;
+        REQUIRE(policy.update(throttled, control, 0) == VISION_DEGRADE::NONE);
+        throttled.throttle_flags |= THROTTLE_THROTTLED;
+        REQUIRE(policy.update(throttled, control, 0) == VISION_DEGRADE::REDUCED_RATE);
+        mock_clock->advance_sec(11);
+        REQUIRE(policy.update(atTemp(60), control, 0) == VISION_DEGRADE::NONE);
+
+        REQUIRE(policy.update(atTemp(60), control, 3) == VISION_DEGRADE::REDUCED_RATE);
+        mock_clock->advance_sec(11);
+        REQUIRE(policy.update(atTemp(60), control, 3) == VISION_DEGRADE::NONE);
+
+        control.active = true;
+        control.jitter_max_us = 800;
+        REQUIRE(policy.update(atTemp(60), control, 3) == VISION_DEGRADE::REDUCED_RATE);
+    }
+
+    SECTION("Disabled")
+    {
+        SafeConfigModifier<bool> disabled("system_health.degrade.enabled", false);
+        VisionDegradePolicy off;
+        REQUIRE(off.update(atTemp(90), control, 5) == VISION_DEGRADE::NONE);
+    }
+}
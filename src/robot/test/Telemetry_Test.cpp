@@ -0,0 +1,148 @@
+#include <Catch/catch.hpp>
+
+#include "Telemetry.h"
+#include "RobotController.h"
+#include "StatusUpdater.h"
+#include "test-utils.h"
+
+#include <filesystem>
+
+namespace
+{
+    std::string cleanDir(const std::string& dir)
+    {
+        std::filesystem::remove_all(dir);
+        return dir;
+    }
+
+    TelemetryRecord makeRecord(int i)
+    {
+        TelemetryRecord record;
+        record.move_id = 3;
+        record.mode = 2;
+        record.time = 0.025f * i;
+        for (int j = 0; j < 3; j++)
+        {
+            record.pos[j] = i + 0.1f * j;
+            record.target_pos[j] = i + 0.2f * j;
+            record.vel[j] = -i - 0.1f * j;
+            record.target_vel[j] = -i - 0.2f * j;
+            record.control_vel[j] = 2.0f * i + j;
+        }
+        return record;
+    }
+}
+
+TEST_CASE("Telemetry round trip", "[Telemetry]")
+{
+    const std::string dir = cleanDir("/tmp/telemetry_test_round_trip");
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+
+    TelemetryWriter writer(dir, 100);
+    for (int i = 0; i < 10; i++)
+    {
+        TelemetryRecord record = makeRecord(i);
+        if (i == 4) record.cam_uv[1] = 240.5f;
+        REQUIRE(writer.append(record));
+        mock_clock->advance_ms(25);
+    }
+    REQUIRE(writer.chunkPaths().size() == 1);
+
+    // Chunk is still open, everything appended so far must already be readable
+    TelemetryReader reader;
+    REQUIRE(reader.open(writer.chunkPaths()[0]));
+    REQUIRE(reader.size() == 10);
+
+    std::vector<double> time = reader.column("time");
+    std::vector<double> pos_a = reader.column("pos_a");
+    std::vector<double> control_vel_y = reader.column("control_vel_y");
+    std::vector<double> move_id = reader.column("move_id");
+    std::vector<double> stamp = reader.column("stamp");
+    std::vector<double> cam_side_v = reader.column("cam_side_v");
+    REQUIRE(time.size() == 10);
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK(time[i] == Approx(0.025 * i));
+        CHECK(pos_a[i] == Approx(i + 0.2));
+        CHECK(control_vel_y[i] == Approx(2.0 * i + 1));
+        CHECK(move_id[i] == 3);
+        if (i > 0) CHECK(stamp[i] - stamp[i-1] == Approx(0.025));
+        CHECK(std::isnan(cam_side_v[i]) == (i != 4));
+    }
+    CHECK(cam_side_v[4] == Approx(240.5));
+    CHECK(reader.column("not_a_column").empty());
+    CHECK(reader.hasColumn("kf_cov_x"));
+}
+
+TEST_CASE("Telemetry rolls over to new chunks", "[Telemetry]")
+{
+    const std::string dir = cleanDir("/tmp/telemetry_test_rollover");
+    std::vector<std::string> paths;
+    {
+        TelemetryWriter writer(dir, 16);
+        for (int i = 0; i < 40; i++) REQUIRE(writer.append(makeRecord(i)));
+        CHECK(writer.recordsWritten() == 40);
+        paths = writer.chunkPaths();
+    }
+    REQUIRE(paths.size() == 3);
+
+    std::vector<double> pos_x;
+    for (const std::string& path : paths)
+    {
+        TelemetryReader reader;
+        REQUIRE(reader.open(path));
+        std::vector<double> chunk = reader.column("pos_x");
+        pos_x.insert(pos_x.end(), chunk.begin(), chunk.end());
+    }
+    REQUIRE(pos_x.size() == 40);
+    for (int i = 0; i < 40; i++) CHECK(pos_x[i] == Approx(i));
+
+    TelemetryReader reader;
+    CHECK_FALSE(reader.open(dir + "/missing.bin"));
+}
+
+TEST_CASE("Telemetry records controller cycles", "[Telemetry]")
+{
+    const std::string dir = cleanDir("/tmp/telemetry_test_controller");
+    SafeConfigModifier<bool> enabled_modifier("telemetry.enabled", true);
+    SafeConfigModifier<std::string> dir_modifier("telemetry.dir", dir);
+    SafeConfigModifier<bool> csv_modifier("logging.motion_csv", false);
+    SafeConfigModifier<bool> fake_modifier("motion.fake_perfect_motion", true);
+
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);
+    mock_serial->purge_data();
+    StatusUpdater s;
+    RobotController r(s);
+
+    for (int move = 0; move < 2; move++)
+    {
+        r.moveToPositionRelative(0.1 * (move + 1), 0, 0);
+        int count = 0;
+        while (r.isTrajectoryRunning() && count < 10000)
+        {
+            r.update();
+            mock_clock->advance_ms(5);
+            count++;
+        }
+        REQUIRE_FALSE(r.isTrajectoryRunning());
+    }
+
+    std::vector<std::string> chunks;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) chunks.push_back(entry.path());
+    REQUIRE(chunks.size() == 1);
+
+    TelemetryReader reader;
+    REQUIRE(reader.open(chunks[0]));
+    REQUIRE(reader.size() > 10);
+    std::vector<double> move_id = reader.column("move_id");
+    std::vector<double> target_pos_x = reader.column("target_pos_x");
+    std::vector<double> kf_cov_x = reader.column("kf_cov_x");
+    CHECK(move_id.front() == 1);
+    CHECK(move_id.back() == 2);
+    for (size_t i = 0; i < reader.size(); i++)
+    {
+        CHECK_FALSE(std::isnan(kf_cov_x[i]));
+        if (move_id[i] == 1) CHECK(target_pos_x[i] <= Approx(0.1));
+    }
+}
@@ -0,0 +1,124 @@
+#include <Catch/catch.hpp>
+
+#include "Trace.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    // Records a synthetic event of the given duration
+    void recordUs(TRACE_POINT point, uint64_t us)
+    {
+        uint64_t start = Tracer::nowNs();
+        Tracer::record(point, start, start + us * 1000);
+    }
+
+    std::string readFile(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::stringstream ss;
+        ss << file.rdbuf();
+        return ss.str();
+    }
+
+    int countOccurrences(const std::string& s, const std::string& sub)
+    {
+        int count = 0;
+        for (size_t pos = s.find(sub); pos != std::string::npos; pos = s.find(sub, pos + 1)) count++;
+        return count;
+    }
+}
+
+TEST_CASE("Trace percentiles", "[Trace]")
+{
+    Tracer::clear();
+    const int p = static_cast<int>(TRACE_POINT::CONTROLLER);
+
+    // 98 fast events, then 2 slow ones so p99 lands in the slow group
+    for (int i = 0; i < 98; i++) recordUs(TRACE_POINT::CONTROLLER, 100);
+    recordUs(TRACE_POINT::CONTROLLER, 5000);
+    recordUs(TRACE_POINT::CONTROLLER, 8000);
+
+    TraceStats stats = Tracer::getStats(false);
+    REQUIRE(stats.count[p] == 100);
+    CHECK(stats.p50_us[p] >= 100);
+    CHECK(stats.p50_us[p] <= 125);
+    CHECK(stats.p99_us[p] >= 5000);
+    CHECK(stats.p99_us[p] <= 6250);
+    CHECK(stats.max_us[p] == 8000);
+    CHECK(stats.count[static_cast<int>(TRACE_POINT::SERVER)] == 0);
+
+    // Reset clears the window
+    Tracer::getStats(true);
+    stats = Tracer::getStats(false);
+    CHECK(stats.count[p] == 0);
+    CHECK(stats.max_us[p] == 0);
+    CHECK(stats.p50_us[p] == 0);
+}
+
+TEST_CASE("Trace percentiles capped by max", "[Trace]")
+{
+    Tracer::clear();
+    const int p = static_cast<int>(TRACE_POINT::TRAY);
+    for (uint64_t us : {0, 1, 7, 33, 1000})
+    {
+        Tracer::clear();
+        recordUs(TRACE_POINT::TRAY, us);
+        TraceStats stats = Tracer::getStats(false);
+        CHECK(stats.p50_us[p] == us);
+        CHECK(stats.p99_us[p] == us);
+        CHECK(stats.max_us[p] == us);
+    }
+}
+
+TEST_CASE("Trace scope only records when enabled", "[Trace]")
+{
+    Tracer::clear();
+    const int p = static_cast<int>(TRACE_POINT::SERVER);
+
+    Tracer::setEnabled(false);
+    {
+        TRACE_SCOPE(TRACE_POINT::SERVER);
+    }
+    CHECK(Tracer::getStats(false).count[p] == 0);
+
+    Tracer::setEnabled(true);
+    {
+        TRACE_SCOPE(TRACE_POINT::SERVER);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    Tracer::setEnabled(false);
+    TraceStats stats = Tracer::getStats(false);
+    CHECK(stats.count[p] == 1);
+    CHECK(stats.max_us[p] >= 2000);
+}
+
+TEST_CASE("Trace chrome dump", "[Trace]")
+{
+    Tracer::clear();
+    const std::string path = "/tmp/domino_trace_test.json";
+
+    recordUs(TRACE_POINT::SERIAL_SEND, 10);
+    recordUs(TRACE_POINT::CAMERA_DETECT, 20);
+    std::thread other([]() { recordUs(TRACE_POINT::CAMERA_CAPTURE, 30); });
+    other.join();
+
+    REQUIRE(Tracer::dumpChromeTrace(path));
+    std::string trace = readFile(path);
+    CHECK(trace.find("\"traceEvents\":[") != std::string::npos);
+    CHECK(countOccurrences(trace, "\"ph\":\"X\"") == 3);
+    CHECK(countOccurrences(trace, "\"name\":\"serial_send\"") == 1);
+    CHECK(countOccurrences(trace, "\"name\":\"cam_detect\"") == 1);
+    CHECK(countOccurrences(trace, "\"name\":\"cam_capture\"") == 1);
+    CHECK(trace.find("\"dur\":20.000") != std::string::npos);
+
+    // Only the most recent events are kept per thread
+    Tracer::clear();
+    for (int i = 0; i < TRACE_BUFFER_SIZE + 10; i++) recordUs(TRACE_POINT::SERIAL_RECV, 1);
+    REQUIRE(Tracer::dumpChromeTrace(path));
+    CHECK(countOccurrences(readFile(path), "\"ph\":\"X\"") == TRACE_BUFFER_SIZE);
+
+    CHECK_FALSE(Tracer::dumpChromeTrace("/nonexistent_dir/trace.json"));
+}
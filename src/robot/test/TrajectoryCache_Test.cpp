@@ -0,0 +1,106 @@
+#include <Catch/catch.hpp>
+
+#include "TrajectoryCache.h"
+#include "test-utils.h"
+
+namespace
+{
+    MotionPlanningProblem makeProblem(Point start, Point target)
+    {
+        SolverParameters solver = {30, 0.8, 0.8, 0.1, SOLVER_MODE::ANALYTIC};
+        return buildMotionPlanningProblem(start, target, LIMITS_MODE::COARSE, solver);
+    }
+
+    Point endPoint(const Trajectory& traj)
+    {
+        Point p = traj.initialPoint;
+        p.x += traj.trans_params.switch_points[7].p * traj.trans_direction(0);
+        p.y += traj.trans_params.switch_points[7].p * traj.trans_direction(1);
+        p.a = wrap_angle(p.a + traj.rot_params.switch_points[7].p * traj.rot_direction);
+        return p;
+    }
+}
+
+TEST_CASE("Repeated relative moves hit the cache", "[TrajectoryCache]")
+{
+    TrajectoryCache cache;
+
+    // Same backoff move from different places on the field
+    Trajectory first = cache.getTrajectory(makeProblem({1, 2, 0}, {1.3, 2, 0.5}), LIMITS_MODE::COARSE);
+    Trajectory second = cache.getTrajectory(makeProblem({4, -1, 0.2}, {4, -0.7, 0.7}), LIMITS_MODE::COARSE);
+    REQUIRE(first.complete);
+    REQUIRE(second.complete);
+    CHECK(cache.getStats().hits == 1);
+    CHECK(cache.getStats().misses == 1);
+    CHECK(cache.getStats().hitRate() == Approx(0.5));
+
+    Point end = endPoint(second);
+    CHECK(end.x == Approx(4).margin(1e-4));
+    CHECK(end.y == Approx(-0.7).margin(1e-4));
+    CHECK(end.a == Approx(0.7).margin(1e-4));
+    CHECK(second.trans_params.switch_points[7].t == Approx(first.trans_params.switch_points[7].t));
+
+    // A different limits mode is a separate entry
+    cache.getTrajectory(makeProblem({1, 2, 0}, {1.3, 2, 0.5}), LIMITS_MODE::FINE);
+    CHECK(cache.getStats().misses == 2);
+}
+
+TEST_CASE("Cached moves land exactly on target", "[TrajectoryCache]")
+{
+    TrajectoryCache cache;
+    MotionPlanningProblem seed = makeProblem({0, 0, 0}, {0.5004, 0, 0.2});
+    cache.getTrajectory(seed, LIMITS_MODE::COARSE);
+
+    // Slightly shorter move in the same bucket is scaled down from the cached solution
+    MotionPlanningProblem problem = makeProblem({0, 0, 0}, {0.5001, 0, 0.2});
+    Trajectory traj = cache.getTrajectory(problem, LIMITS_MODE::COARSE);
+    REQUIRE(cache.getStats().hits == 1);
+    REQUIRE(traj.complete);
+    CHECK(endPoint(traj).x == Approx(0.5001).margin(1e-5));
+    CHECK(traj.trans_params.v_lim <= problem.translationalLimits.max_vel);
+    CHECK(traj.trans_params.a_lim <= problem.translationalLimits.max_acc);
+    CHECK(traj.trans_params.j_lim <= problem.translationalLimits.max_jerk);
+
+    // And matches solving from scratch to within the bucket resolution
+    Trajectory exact = generateTrajectory(problem);
+    REQUIRE(exact.complete);
+    CHECK(traj.trans_params.switch_points[7].t == Approx(exact.trans_params.switch_points[7].t).epsilon(0.01));
+}
+
+TEST_CASE("Pure rotation uses zero translation", "[TrajectoryCache]")
+{
+    TrajectoryCache cache;
+    Trajectory traj = cache.getTrajectory(makeProblem({1, 1, 0}, {1, 1, -1.0}), LIMITS_MODE::COARSE);
+    REQUIRE(traj.complete);
+    Point end = endPoint(traj);
+    CHECK(end.x == Approx(1));
+    CHECK(end.y == Approx(1));
+    CHECK(end.a == Approx(-1.0).margin(1e-4));
+}
+
+TEST_CASE("Cache evicts least recently used", "[TrajectoryCache]")
+{
+    SafeConfigModifier<int> size_modifier("trajectory_generation.cache.size", 2);
+    TrajectoryCache cache;
+    cache.getTrajectory(makeProblem({0, 0, 0}, {0.1, 0, 0}), LIMITS_MODE::COARSE);
+    cache.getTrajectory(makeProblem({0, 0, 0}, {0.2, 0, 0}), LIMITS_MODE::COARSE);
+    cache.getTrajectory(makeProblem({0, 0, 0}, {0.1, 0, 0}), LIMITS_MODE::COARSE);
+    cache.getTrajectory(makeProblem({0, 0, 0}, {0.3, 0, 0}), LIMITS_MODE::COARSE);   // Evicts 0.2
+    CHECK(cache.getStats().hits == 1);
+    cache.getTrajectory(makeProblem({0, 0, 0}, {0.1, 0, 0}), LIMITS_MODE::COARSE);
+    CHECK(cache.getStats().hits == 2);
+    cache.getTrajectory(makeProblem({0, 0, 0}, {0.2, 0, 0}), LIMITS_MODE::COARSE);
+    CHECK(cache.getStats().hits == 2);
+    CHECK(cache.getStats().misses == 4);
+}
+
+TEST_CASE("Disabled cache always solves", "[TrajectoryCache]")
+{
+    SafeConfigModifier<bool> enabled_modifier("trajectory_generation.cache.enabled", false);
+    TrajectoryCache cache;
+    cache.getTrajectory(makeProblem({0, 0, 0}, {0.1, 0, 0}), LIMITS_MODE::COARSE);
+    Trajectory traj = cache.getTrajectory(makeProblem({0, 0, 0}, {0.1, 0, 0}), LIMITS_MODE::COARSE);
+    CHECK(traj.complete);
+    CHECK(cache.getStats().hits == 0);
+    CHECK(cache.getStats().misses == 0);
+}
@@ -0,0 +1,54 @@
+#include <Catch/catch.hpp>
+
+#include "TrajectoryPlanner.h"
+#include "test-utils.h"
+
+namespace
+{
+    MotionPlanningProblem makeProblem(Point start, Point target)
+    {
+        SolverParameters solver = {30, 0.8, 0.8, 0.1, SOLVER_MODE::ANALYTIC};
+        return buildMotionPlanningProblem(start, target, LIMITS_MODE::COARSE, solver);
+    }
+}
+
+TEST_CASE("Planner solves submitted moves in order", "[TrajectoryPlanner]")
+{
+    TrajectoryPlanner planner;
+    std::future<PlannedTrajectory> first = planner.submit(makeProblem({1, 2, 0}, {1.3, 2, 0.5}), LIMITS_MODE::COARSE);
+    std::future<PlannedTrajectory> second = planner.submit(makeProblem({4, -1, 0.2}, {4, -0.7, 0.7}), LIMITS_MODE::COARSE);
+
+    const PlannedTrajectory first_plan = first.get();
+    const PlannedTrajectory second_plan = second.get();
+    REQUIRE(first_plan.trajectory.complete);
+    REQUIRE(second_plan.trajectory.complete);
+    CHECK(second_plan.trajectory.initialPoint.x == Approx(4));
+    CHECK(first_plan.plan_ms >= 0);
+    CHECK(second_plan.wait_ms >= 0);
+
+    // The same relative move is found in the planner's cache the second time
+    CHECK(first_plan.cache_stats.misses == 1);
+    CHECK(second_plan.cache_stats.hits == 1);
+}
+
+TEST_CASE("Planner can be destroyed with plans nobody waits for", "[TrajectoryPlanner]")
+{
+    std::future<PlannedTrajectory> kept;
+    {
+        TrajectoryPlanner planner;
+        planner.submit(makeProblem({0, 0, 0}, {2, 1, 1}), LIMITS_MODE::COARSE);
+        kept = planner.submit(makeProblem({0, 0, 0}, {0.5, 0, 0}), LIMITS_MODE::COARSE);
+    }
+    // Either solved before the worker stopped, or abandoned with it
+    REQUIRE(kept.valid());
+    bool complete = true;
+    try
+    {
+        complete = kept.get().trajectory.complete;
+    }
+    catch(const std::future_error& e)
+    {
+        CHECK(e.code() == std::future_errc::broken_promise);
+    }
+    CHECK(complete);
+}
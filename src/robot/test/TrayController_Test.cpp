@@ -13,25 +13,65 @@ TEST_CASE("Send and waiting", "[TrayController]")
     REQUIRE(mock_serial->mock_rcv_lift() == "");
     REQUIRE(t.isActionRunning() == true);
 
-    // Expect to receive close command once and then start status requests
+    // Expect to receive close command once and no status requests while waiting for the done message
     mock_clock->advance_ms(1);
     t.update();
     REQUIRE(mock_serial->mock_rcv_lift() == "close");
-    
-    // Expect to receive status request command while lifter reports closing
+    mock_serial->mock_send("lift:close");
     for (int i = 0; i < 5; i ++)
     {
         mock_clock->advance_ms(1);
-        mock_serial->mock_send("lift:close");
         t.update();
-        REQUIRE(mock_serial->mock_rcv_lift() == "status_req");
+        REQUIRE(mock_serial->mock_rcv_lift() == "");
     }
 
-    // Expect to receive none response once lifter reports no action
-    mock_clock->advance_ms(1000);
+    // A done message for a different step doesn't finish this one
+    mock_serial->mock_send("lift:done:pos");
+    mock_clock->advance_ms(1);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift() == "");
+
+    // Next step starts as soon as the done message arrives
+    mock_serial->mock_send("lift:done:close");
+    mock_clock->advance_ms(1);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift() == "home");
+}
+
+TEST_CASE("Status polling fallback", "[TrayController]")
+{
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    TrayController t;
+    int timeout_ms = cfg.lookup("tray.done_timeout_ms");
+    int poll_ms = cfg.lookup("tray.status_poll_ms");
+
+    t.initialize();
+    mock_clock->advance_ms(1);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift() == "close");
+
+    // A none reply before any status request is the reply to the command, not completion
     mock_serial->mock_send("lift:none");
+    mock_clock->advance_ms(1);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift() == "");
+
+    // Once the done message is overdue, status is polled at a limited rate
+    mock_clock->advance_ms(timeout_ms);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift() == "status_req");
+    mock_serial->mock_send("lift:close");
+    mock_clock->advance_ms(1);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift() == "");
+    mock_clock->advance_ms(poll_ms);
     t.update();
     REQUIRE(mock_serial->mock_rcv_lift() == "status_req");
+
+    mock_serial->mock_send("lift:none");
+    mock_clock->advance_ms(1);
+    t.update();
     REQUIRE(mock_serial->mock_rcv_lift() == "home");
 }
 
@@ -153,6 +193,46 @@ TEST_CASE("Load tray", "[TrayController]")
     REQUIRE(t.isActionRunning() == false);
 }
 
+TEST_CASE("Place tray overlap", "[TrayController]")
+{
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    TrayController t;
+    t.setTrayInitialized(true);
+    REQUIRE(t.canOverlapWith(COMMAND::MOVE_REL) == false);
+
+    t.place();
+    // Move to place position and open latch need the base stopped
+    for (int step = 0; step < 2; step++)
+    {
+        REQUIRE(t.canOverlapWith(COMMAND::MOVE_REL) == false);
+        mock_clock->advance_ms(1500);
+        t.update();
+        mock_serial->mock_send("lift:none");
+    }
+    mock_clock->advance_ms(1500);
+    t.update();
+
+    // Tiles are released, so backing away is fine but other motion isn't
+    REQUIRE(t.canOverlapWith(COMMAND::MOVE_REL) == true);
+    REQUIRE(t.canOverlapWith(COMMAND::MOVE_REL_SLOW) == true);
+    REQUIRE(t.canOverlapWith(COMMAND::MOVE_FINE) == false);
+    REQUIRE(t.canOverlapWith(COMMAND::PLACE_TRAY) == false);
+
+    SafeConfigModifier<bool> config_modifier("tray.overlap_motion", false);
+    TrayController t2;
+    t2.setTrayInitialized(true);
+    t2.place();
+    for (int step = 0; step < 3; step++)
+    {
+        mock_clock->advance_ms(1500);
+        t2.update();
+        mock_serial->mock_send("lift:none");
+    }
+    REQUIRE(t2.isActionRunning() == true);
+    REQUIRE(t2.canOverlapWith(COMMAND::MOVE_REL) == false);
+}
+
 TEST_CASE("Errors when tray not initialized", "[TrayController]")
 {
     TrayController t;
@@ -160,4 +240,80 @@ TEST_CASE("Errors when tray not initialized", "[TrayController]")
 
     REQUIRE(t.place() == false);
     REQUIRE(t.load() == false);
-}
\ No newline at end of file
+}
+TEST_CASE("Lifter profiles", "[TrayController]")
+{
+    SafeConfigModifier<bool> scurve_modifier("tray.scurve.enabled", true);
+    MockSerialComms* mock_serial = build_and_get_mock_serial(CLEARCORE_USB);;
+    MockClockWrapper* mock_clock = get_mock_clock_and_reset();
+    TrayController t;
+    int steps_per_rev = cfg.lookup("tray.steps_per_rev");
+    float default_revs = cfg.lookup("tray.default_pos_revs");
+    float place_revs = cfg.lookup("tray.place_pos_revs");
+    int default_steps = steps_per_rev * default_revs;
+    int place_steps = steps_per_rev * place_revs;
+
+    auto step = [&](const std::string& done)
+    {
+        mock_serial->mock_send("lift:done:" + done);
+        mock_clock->advance_ms(1);
+        t.update();
+    };
+    auto rcv_profile = [&]()
+    {
+        SERIAL_BINARY_CHANNEL channel;
+        std::string payload;
+        REQUIRE(mock_serial->mock_rcv_frame(&channel, &payload));
+        REQUIRE(channel == SERIAL_BINARY_CHANNEL::TRAJECTORY_AXIS);
+        REQUIRE(payload.size() == SERIAL_TRAJECTORY_AXIS_PAYLOAD_SIZE);
+        SerialTrajectoryAxis axis = decodeTrajectoryAxisPayload(reinterpret_cast<const uint8_t*>(payload.data()));
+        REQUIRE(axis.axis == SERIAL_TRAJECTORY_AXIS::LIFTER);
+        REQUIRE_FALSE(mock_serial->mock_rcv_frame(&channel, &payload));
+        return axis;
+    };
+
+    // Homing makes the position known, so the move after it is already profiled
+    t.initialize();
+    mock_clock->advance_ms(1);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift() == "close");
+    step("close");
+    REQUIRE(mock_serial->mock_rcv_lift() == "home");
+    step("home");
+    REQUIRE(mock_serial->mock_rcv_lift() == "scurve:" + std::to_string(default_steps));
+    SerialTrajectoryAxis axis = rcv_profile();
+    REQUIRE(axis.direction[0] == sgn(default_revs));
+    REQUIRE(axis.switch_points[7][1] == Approx(std::abs(default_steps)).margin(1));
+    REQUIRE(axis.switch_points[7][2] == Approx(0).margin(1));
+    REQUIRE(axis.v_lim <= steps_per_rev * static_cast<float>(cfg.lookup("tray.scurve.max_vel")) + 1);
+    step("pos");
+    REQUIRE(t.isActionRunning() == false);
+
+    // Profiles between two known positions go in the direction of the move
+    REQUIRE(t.place());
+    mock_clock->advance_ms(1);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift() == "scurve:" + std::to_string(place_steps));
+    axis = rcv_profile();
+    REQUIRE(axis.direction[0] == sgn(place_steps - default_steps));
+    REQUIRE(axis.switch_points[7][1] == Approx(std::abs(place_steps - default_steps)).margin(1));
+    step("pos");
+    REQUIRE(mock_serial->mock_rcv_lift() == "open");
+    step("open");
+    REQUIRE(mock_serial->mock_rcv_lift() == "scurve:" + std::to_string(default_steps));
+    rcv_profile();
+    step("pos");
+    REQUIRE(mock_serial->mock_rcv_lift() == "close");
+
+    // After an estop the position isn't trusted until the next homing
+    t.estop();
+    mock_serial->mock_rcv_lift();
+    t.setTrayInitialized(true);
+    REQUIRE(t.place());
+    mock_clock->advance_ms(1);
+    t.update();
+    REQUIRE(mock_serial->mock_rcv_lift() == "pos:" + std::to_string(place_steps));
+    SERIAL_BINARY_CHANNEL channel;
+    std::string payload;
+    REQUIRE_FALSE(mock_serial->mock_rcv_frame(&channel, &payload));
+}
@@ -1,6 +1,7 @@
 #define CATCH_CONFIG_RUNNER
 #include <Catch/catch.hpp>
 #include "constants.h"
+#include "ConfigSnapshot.h"
 #include "serial/SerialCommsFactory.h"
 #include "sockets/SocketMultiThreadWrapperFactory.h"
 #include "camera_tracker/CameraTrackerFactory.h"
@@ -33,6 +34,7 @@ void configure_logger()
 int main( int argc, char* argv[] ) 
 {
     cfg.readFile(TEST_CONSTANTS_FILE);
+    ConfigSnapshot::reload();
     configure_logger();
     SerialCommsFactory::getFactoryInstance()->set_mode(SERIAL_FACTORY_MODE::MOCK);
     SocketMultiThreadWrapperFactory::getFactoryInstance()->set_mode(SOCKET_FACTORY_MODE::MOCK);
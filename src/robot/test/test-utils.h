@@ -4,16 +4,22 @@
 #include "serial/MockSerialComms.h"
 #include "serial/SerialCommsFactory.h"
 #include "constants.h"
+#include "ConfigSnapshot.h"
 #include "sockets/SocketMultiThreadWrapperFactory.h"
 #include "sockets/MockSocketMultiThreadWrapper.h"
 #include "utils.h"
 #include <variant>
 
-inline MockSocketMultiThreadWrapper* build_and_get_mock_socket() 
+inline MockSocketMultiThreadWrapper* get_mock_socket() 
 {
     SocketMultiThreadWrapperBase* base_socket = SocketMultiThreadWrapperFactory::getFactoryInstance()->get_socket();
     // Slightly dangerous....
-    MockSocketMultiThreadWrapper* mock_socket = dynamic_cast<MockSocketMultiThreadWrapper*>(base_socket);
+    return dynamic_cast<MockSocketMultiThreadWrapper*>(base_socket);
+}
+
+inline MockSocketMultiThreadWrapper* build_and_get_mock_socket() 
+{
+    MockSocketMultiThreadWrapper* mock_socket = get_mock_socket();
     mock_socket->purge_data();
     return mock_socket;
 }
@@ -57,10 +63,12 @@ class SafeConfigModifier
        old_val_(static_cast<T>(cur_val_))
     {
         cur_val_ = value;
+        ConfigSnapshot::reload();
     }
     ~SafeConfigModifier()
     {
         cur_val_ = old_val_;
+        ConfigSnapshot::reload();
     }
 
   private:
@@ -1,5 +1,7 @@
 #include <Catch/catch.hpp>
 #include <unistd.h>
+#include <algorithm>
+#include <random>
 
 #include "utils.h"
 #include "test-utils.h"
@@ -297,7 +299,19 @@ TEST_CASE("CircularBuffer", "[utils]")
         REQUIRE(buf.get_contents() == std::vector<int>{});
 
     }
-    
+    SECTION("CheckAt")
+    {
+        CircularBuffer<int> buf(3);
+        buf.insert(1);
+        buf.insert(2);
+        REQUIRE(buf.size() == 2);
+        REQUIRE(buf.at(0) == 1);
+        buf.insert(3);
+        buf.insert(4);
+        REQUIRE(buf.size() == 3);
+        REQUIRE(buf.at(0) == 2);
+        REQUIRE(buf.at(2) == 4);
+    }
 }
 
 
@@ -378,8 +392,127 @@ TEST_CASE("PositionController", "[utils]")
         REQUIRE(actual_pos == Approx(target_pos).margin(0.001));
     }
 
+    SECTION("Acceleration feedforward through a lagging drive")
+    {
+        // First order lag from command to velocity, ka matched to it leaves no error while the target accelerates
+        const float tau = 0.05;
+        const float dt = 0.001;
+        float final_error[2];
+        for (int use_ka = 0; use_ka < 2; use_ka++)
+        {
+            PositionController::Gains gains {1,0,0};
+            gains.ka = use_ka ? tau : 0;
+            PositionController controller(gains);
+            float actual_pos = 0.0;
+            float actual_vel = 0.0;
+            for (int i = 0; i < 1000; i++) 
+            {
+                const float t = (i + 1) * dt;
+                const float cmd = controller.compute(0.5 * t * t, actual_pos, t, actual_vel, dt, 1.0);
+                actual_vel += (cmd - actual_vel) * dt / tau;
+                actual_pos += actual_vel * dt;
+            }
+            final_error[use_ka] = 0.5 - actual_pos;
+        }
+        REQUIRE(final_error[0] > 0.02);
+        REQUIRE(fabs(final_error[1]) < 0.005);
+    }
+
+    SECTION("Integral clamp")
+    {
+        PositionController::Gains gains {0,2,0};
+        gains.max_integral = 0.1;
+        PositionController controller(gains);
+        for (int i = 0; i < 100; i++) 
+        {
+            REQUIRE(controller.compute(1.0, 0.0, 0.0, 0.0, 0.1) <= 0.1f + 1e-6);
+        }
+        REQUIRE(controller.compute(1.0, 0.0, 0.0, 0.0, 0.1) == Approx(0.1));
+        // Unwinds as soon as the error changes sign instead of after paying back the whole sum
+        REQUIRE(controller.compute(0.0, 1.0, 0.0, 0.0, 0.1) == Approx(-0.1).margin(1e-5));
+    }
+
+    SECTION("Gain schedule")
+    {
+        REQUIRE(PositionController::phase(0.0, 0.0) == PositionController::Phase::SETTLE);
+        REQUIRE(PositionController::phase(0.0, 1.0) == PositionController::Phase::ACCEL);
+        REQUIRE(PositionController::phase(-0.5, -1.0) == PositionController::Phase::ACCEL);
+        REQUIRE(PositionController::phase(0.5, 0.0) == PositionController::Phase::CRUISE);
+        REQUIRE(PositionController::phase(0.5, -1.0) == PositionController::Phase::DECEL);
+
+        PositionController::Gains gains {1,0,0};
+        gains.scale_accel = 2;
+        gains.scale_cruise = 3;
+        gains.scale_decel = 4;
+        gains.scale_settle = 5;
+        PositionController controller(gains);
+        REQUIRE(controller.compute(0.1, 0.0, 0.0, 0.0, 0.1, 1.0) == Approx(0.2));
+        REQUIRE(controller.compute(0.1, 0.0, 1.0, 0.0, 0.1) == Approx(1.3));
+        REQUIRE(controller.compute(0.1, 0.0, 1.0, 0.0, 0.1, -1.0) == Approx(1.4));
+        REQUIRE(controller.compute(0.1, 0.0, 0.0, 0.0, 0.1) == Approx(0.5));
+    }
+
+}
+
+
+TEST_CASE("WindowedStats matches the window contents", "[utils]")
+{
+    WindowedStats<float, 16> stats(10, 0, 100);
+    CircularBuffer<float> window(10);
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> dist(0, 100);
+
+    REQUIRE(stats.count() == 0);
+    REQUIRE(stats.mean() == 0);
+    for (int i = 0; i < 200; i++)
+    {
+        float value = dist(gen);
+        stats.add(value);
+        window.insert(value);
+
+        std::vector<float> contents = window.get_contents();
+        float mean = vectorMean(contents);
+        float stddev = vectorStddev(contents, mean);
+        REQUIRE(stats.count() == contents.size());
+        CHECK(stats.mean() == Approx(mean).epsilon(1e-4));
+        CHECK(stats.stddev() == Approx(stddev).epsilon(1e-3).margin(1e-3));
+        CHECK(stats.min() == *std::min_element(contents.begin(), contents.end()));
+        CHECK(stats.max() == *std::max_element(contents.begin(), contents.end()));
+        CHECK(stats.zScore(50) == Approx(zScore(mean, stddev, 50)).epsilon(1e-3).margin(1e-3));
+        CHECK(stats.latest() == value);
+    }
+    REQUIRE(stats.full());
+
+    stats.clear();
+    REQUIRE(stats.count() == 0);
+    stats.add(5);
+    CHECK(stats.min() == 5);
+    CHECK(stats.max() == 5);
+    CHECK(stats.stddev() == 0);
 }
 
+TEST_CASE("WindowedStats quantiles", "[utils]")
+{
+    SECTION("Histogram")
+    {
+        WindowedStats<int, 128, 100> stats(100, 0, 100);
+        for (int i = 0; i < 300; i++)
+        {
+            stats.add(i % 100);
+        }
+        CHECK(stats.quantile(0.5) == Approx(50).margin(1));
+        CHECK(stats.quantile(0.9) == Approx(90).margin(1));
+        CHECK(stats.quantile(0) == 0);
+        CHECK(stats.quantile(1) == 99);
+    }
+    SECTION("No histogram range")
+    {
+        WindowedStats<int, 8> stats;
+        stats.add(10);
+        stats.add(20);
+        CHECK(stats.quantile(0.5) == Approx(15));
+    }
+}
 
 TEST_CASE("VectorMath", "[utils]")
 {
@@ -519,4 +652,59 @@ TEST_CASE("LatchedBool", "[utils]")
         mock_clock->advance_sec(0.6);
         CHECK(lb.update(false) == true);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("SettleDetector", "[utils]")
+{
+    const TrajectoryTolerances tol = {0.01, 0.02, 0.01, 0.02};
+    SettleDetector settle;
+    settle.start({0.8, 0.1, 2.0});
+
+    SECTION("Uncertain estimate waits out the dwell")
+    {
+        const SettleDetector::Sample sample = {true, 0.004, 0.0, 0.001, 0.0, 0.004, 0.0};
+        CHECK_FALSE(settle.update(sample, tol, 1.0));
+        CHECK(settle.inTolerance());
+        CHECK_FALSE(settle.update(sample, tol, 1.5));
+        CHECK(settle.settleTime() < 0);
+        CHECK(settle.update(sample, tol, 1.81));
+        CHECK(settle.settleTime() == Approx(0.81));
+    }
+    SECTION("Confident estimate settles early")
+    {
+        const SettleDetector::Sample sample = {true, 0.004, 0.0, 0.001, 0.0, 0.001, 0.001};
+        CHECK_FALSE(settle.update(sample, tol, 1.0));
+        CHECK_FALSE(settle.update(sample, tol, 1.05));
+        CHECK(settle.update(sample, tol, 1.11));
+        CHECK(settle.settleTime() == Approx(0.11));
+    }
+    SECTION("Speeding up isn't confident")
+    {
+        SettleDetector::Sample sample = {true, 0.004, 0.0, 0.006, 0.0, 0.0, 0.0};
+        settle.update(sample, tol, 1.0);
+        for (float t = 1.02; t < 1.5; t += 0.02)
+        {
+            sample.trans_vel += 0.0001;
+            CHECK_FALSE(settle.update(sample, tol, t));
+        }
+        sample.trans_vel -= 0.0001;
+        CHECK_FALSE(settle.update(sample, tol, 1.5));
+        CHECK(settle.update(sample, tol, 1.61));
+        CHECK(settle.settleTime() == Approx(0.61));
+    }
+    SECTION("Moving target or leaving the tolerance starts over")
+    {
+        const SettleDetector::Sample sample = {true, 0.004, 0.0, 0.001, 0.0, 0.001, 0.001};
+        SettleDetector::Sample outside = sample;
+        outside.trans_err = 0.02;
+        SettleDetector::Sample moving = sample;
+        moving.target_stopped = false;
+        CHECK_FALSE(settle.update(sample, tol, 1.0));
+        CHECK_FALSE(settle.update(outside, tol, 1.05));
+        CHECK_FALSE(settle.inTolerance());
+        CHECK_FALSE(settle.update(sample, tol, 1.1));
+        CHECK_FALSE(settle.update(moving, tol, 1.15));
+        CHECK_FALSE(settle.update(sample, tol, 1.2));
+        CHECK(settle.update(sample, tol, 1.31));
+        CHECK(settle.settleTime() == Approx(0.11));
+    }
+}
@@ -1,10 +1,20 @@
 #include "SerialComms.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 
 SerialComms::SerialComms(HardwareSerial& serial)
 : serial_(serial),
   recvInProgress_(false),
+  overflowed_(false),
   recvIdx_(0),
-  buffer_("")
+  droppedMessages_(0),
+  binaryState_(BINARY_IDLE),
+  binaryChannel_(0),
+  binaryLen_(0),
+  binaryIdx_(0),
+  binaryCrc_(0),
+  binaryReady_(false)
 {
 }
 
@@ -12,45 +22,148 @@ SerialComms::~SerialComms()
 {
 }
 
-String SerialComms::rcv()
+const char* SerialComms::rcv()
 {
-    bool newData = false;
-    String new_msg;
-    while (serial_.available() > 0 && newData == false) 
+    while (serial_.available() > 0 && binaryReady_ == false) 
     {
         char rc = serial_.read();
-        if (recvInProgress_ == true) 
+        if (consumeBinary(static_cast<uint8_t>(rc)))
         {
-            if (rc == START_CHAR)
-            {
-              buffer_ = "";
-            }
-            else if (rc != END_CHAR) 
+            // Text never contains the binary start byte, so a text message in progress was cut off
+            recvInProgress_ = false;
+        }
+        else if (rc == START_CHAR)
+        {
+            recvInProgress_ = true;
+            overflowed_ = false;
+            recvIdx_ = 0;
+        }
+        else if (recvInProgress_ == false)
+        {
+            continue;
+        }
+        else if (rc != END_CHAR) 
+        {
+            if (recvIdx_ < TEXT_MAX_LEN)
             {
-                buffer_ += rc;
+                buffer_[recvIdx_++] = rc;
             }
-            else 
+            else
             {
-                recvInProgress_ = false;
-                newData = true;
-                new_msg = buffer_;
-                buffer_ = "";
+                overflowed_ = true;
             }
         }
-        else if (rc == START_CHAR) 
+        else 
         {
-            recvInProgress_ = true;
+            recvInProgress_ = false;
+            if (overflowed_)
+            {
+                droppedMessages_++;
+                continue;
+            }
+            buffer_[recvIdx_] = '\0';
+            return buffer_;
         }
     }
-    return new_msg;
+    return "";
 }
 
-void SerialComms::send(String msg)
+void SerialComms::send(const char* msg)
 {
-    if (msg.length() > 0)
+    if (msg[0] != '\0')
     {
       serial_.print(START_CHAR);
       serial_.print(msg);
       serial_.print(END_CHAR);
     }
 }
+
+void SerialComms::sendf(const char* fmt, ...)
+{
+    char msg[TEXT_MAX_LEN + 1];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    send(msg);
+}
+
+uint16_t serialCrc16(const uint8_t* data, int len, uint16_t crc)
+{
+    for (int i = 0; i < len; i++)
+    {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+bool SerialComms::consumeBinary(uint8_t byte)
+{
+    switch (binaryState_)
+    {
+        case BINARY_IDLE:
+            if (byte != BINARY_START_CHAR) return false;
+            binaryState_ = BINARY_CHANNEL;
+            break;
+        case BINARY_CHANNEL:
+            binaryChannel_ = byte;
+            binaryState_ = BINARY_LENGTH;
+            break;
+        case BINARY_LENGTH:
+            if (byte > BINARY_MAX_PAYLOAD)
+            {
+                binaryState_ = BINARY_IDLE;
+                break;
+            }
+            binaryLen_ = byte;
+            binaryIdx_ = 0;
+            binaryState_ = binaryLen_ > 0 ? BINARY_PAYLOAD : BINARY_CRC_LOW;
+            break;
+        case BINARY_PAYLOAD:
+            binaryPayload_[binaryIdx_++] = byte;
+            if (binaryIdx_ == binaryLen_) binaryState_ = BINARY_CRC_LOW;
+            break;
+        case BINARY_CRC_LOW:
+            binaryCrc_ = byte;
+            binaryState_ = BINARY_CRC_HIGH;
+            break;
+        case BINARY_CRC_HIGH:
+        {
+            binaryCrc_ |= static_cast<uint16_t>(byte) << 8;
+            binaryState_ = BINARY_IDLE;
+            const uint8_t header[2] = {binaryChannel_, binaryLen_};
+            uint16_t crc = serialCrc16(header, 2);
+            crc = serialCrc16(binaryPayload_, binaryLen_, crc);
+            binaryReady_ = (crc == binaryCrc_);
+            break;
+        }
+    }
+    return true;
+}
+
+bool SerialComms::rcvBinary(uint8_t* channel, uint8_t* payload, uint8_t* len)
+{
+    if (!binaryReady_) return false;
+    *channel = binaryChannel_;
+    *len = binaryLen_;
+    memcpy(payload, binaryPayload_, binaryLen_);
+    binaryReady_ = false;
+    return true;
+}
+
+void SerialComms::sendBinary(uint8_t channel, const uint8_t* payload, uint8_t len)
+{
+    uint8_t frame[BINARY_MAX_PAYLOAD + 5];
+    frame[0] = BINARY_START_CHAR;
+    frame[1] = channel;
+    frame[2] = len;
+    memcpy(frame + 3, payload, len);
+    uint16_t crc = serialCrc16(frame + 1, 2 + len);
+    frame[3 + len] = crc & 0xFF;
+    frame[4 + len] = crc >> 8;
+    serial_.write(frame, len + 5);
+}
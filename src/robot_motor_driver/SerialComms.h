@@ -5,6 +5,28 @@
 
 #define START_CHAR '<'
 #define END_CHAR '>'
+// Longest text message in either direction, without the start and end chars. Longer incoming ones are dropped.
+#define TEXT_MAX_LEN 96
+
+// Binary frames, must match src/robot/src/serial/SerialBinaryProtocol.h
+//   BINARY_START_CHAR, channel, payload length, payload, CRC-16/CCITT of channel + length + payload (little endian)
+#define BINARY_START_CHAR 0xA5
+#define BINARY_MAX_PAYLOAD 160
+#define BINARY_CHANNEL_BASE_VELOCITY 1   // Commanded velocity from the pi
+#define BINARY_CHANNEL_BASE_ODOMETRY 2   // Measured velocity, timestamp and report counter back to the pi
+#define BINARY_CHANNEL_TRAJECTORY_AXIS 3         // One s-curve of a trajectory to follow
+#define BINARY_CHANNEL_TRAJECTORY_START 4        // Start following the uploaded trajectory
+#define BINARY_CHANNEL_TRAJECTORY_CORRECTION 5   // Feedback velocity and heading error from the pi
+#define BINARY_CHANNEL_DRIVER_STATS 6            // Loop time and receive stats back to the pi
+#define BINARY_CHANNEL_STREAM_CONFIG 7           // Odometry stream period and command timeout from the pi
+#define BINARY_VELOCITY_SCALE 10000.0   // int16 velocities in 0.1 mm/s and 0.1 mrad/s
+#define BINARY_VELOCITY_PAYLOAD_SIZE 6
+#define BINARY_ODOMETRY_PAYLOAD_SIZE 12  // Velocities, then uint32 micros() and uint16 seq
+#define BINARY_TRAJECTORY_AXIS_PAYLOAD_SIZE 151        // uint16 id, uint8 axis, float32 direction[2], v, a, j limits, switch points[8][t,p,v,a]
+#define BINARY_TRAJECTORY_START_PAYLOAD_SIZE 6         // uint16 id, float32 initial heading
+#define BINARY_TRAJECTORY_CORRECTION_PAYLOAD_SIZE 12   // uint16 id, int16 global velocity correction, float32 heading error
+#define BINARY_DRIVER_STATS_PAYLOAD_SIZE 12             // uint32 max and mean loop period in us, uint16 loop count, uint16 dropped messages
+#define BINARY_STREAM_CONFIG_PAYLOAD_SIZE 6              // uint32 report period in us (0 for off), uint16 command timeout in ms
 
 class SerialComms
 {
@@ -15,18 +37,58 @@ class SerialComms
 
     virtual ~SerialComms();
 
-    void send(String msg);
+    // Nothing is sent for an empty msg
+    void send(const char* msg);
+
+    // printf style send, formatted on the stack and cut off at TEXT_MAX_LEN
+    void sendf(const char* fmt, ...);
+
+    // Returns the next text message, or an empty string if none is complete yet. Reads whatever the core has
+    // buffered from the port interrupt without waiting, and parses binary frames on the way, stopping once one
+    // is ready for rcvBinary. The message is only valid until the next call.
+    const char* rcv();
+
+    // Text messages dropped because they didn't fit in TEXT_MAX_LEN
+    uint16_t getDroppedMessages() const { return droppedMessages_; }
+
+    // Returns true once for each binary frame with a valid CRC that rcv() has read
+    bool rcvBinary(uint8_t* channel, uint8_t* payload, uint8_t* len);
 
-    String rcv();
+    void sendBinary(uint8_t channel, const uint8_t* payload, uint8_t len);
 
   protected:
 
+    enum BinaryState
+    {
+        BINARY_IDLE,
+        BINARY_CHANNEL,
+        BINARY_LENGTH,
+        BINARY_PAYLOAD,
+        BINARY_CRC_LOW,
+        BINARY_CRC_HIGH,
+    };
+
+    // Returns true if the byte was part of a binary frame
+    bool consumeBinary(uint8_t byte);
+
     HardwareSerial& serial_;
 
     bool recvInProgress_;
+    bool overflowed_;
     int recvIdx_;
-    String buffer_;
+    char buffer_[TEXT_MAX_LEN + 1];
+    uint16_t droppedMessages_;
+
+    BinaryState binaryState_;
+    uint8_t binaryChannel_;
+    uint8_t binaryLen_;
+    uint8_t binaryIdx_;
+    uint16_t binaryCrc_;
+    uint8_t binaryPayload_[BINARY_MAX_PAYLOAD];
+    bool binaryReady_;
 
 };
 
-#endif
\ No newline at end of file
+uint16_t serialCrc16(const uint8_t* data, int len, uint16_t crc = 0xFFFF);
+
+#endif
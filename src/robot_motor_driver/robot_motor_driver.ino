@@ -1,6 +1,8 @@
 #include "ClearCore.h"
 #include "SerialComms.h"
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 // From https://teknic-inc.github.io/ClearCore-library/ArduinoRef.html
 // Serial = USB
@@ -8,6 +10,7 @@
 
 #define PRINT_DEBUG false
 #define USE_FAKE_MOTOR false
+#define SERIAL_BAUD 460800   // Must match serial.baud in the robot constants.cfg
 
 // Globals
 SerialComms comm(Serial);
@@ -23,7 +26,7 @@ SerialComms comm(Serial);
 #define STEPS_PER_REV 800
 #define MOTOR_MAX_VEL_STEPS_PER_SECOND 10000
 #define MOTOR_MAX_ACC_STEPS_PER_SECOND_SQUARED 2600
-#define MAX_BASE_MSG_TIMEOUT 200
+#define MAX_BASE_MSG_TIMEOUT 200   // ms, default until the pi sets its own with a stream config
 const float sq3 = sqrt(3.0);
 const float rOver3 = WHEEL_RADIUS / 3.0;
 const float radsPerSecondToStepsPerSecond = STEPS_PER_REV / (2 * PI);
@@ -57,6 +60,13 @@ float MOTOR_REAR_CENTER_FAKE = 0;
 
 #define LIFTER_HOMING_VEL 3 // revs/sec
 
+// Jerk limited moves planned on the pi. The step generator limits are raised to these while one runs so
+// only the profile shapes the motion, profiles asking for more run as a normal move instead.
+#define LIFTER_PROFILE_MAX_VEL 12  // revs/sec
+#define LIFTER_PROFILE_MAX_ACC 40  // rev/sec^2
+#define LIFTER_PROFILE_KP 5.0      // 1/sec, position error fed back on top of the profile velocity
+#define LIFTER_PROFILE_START_TOLERANCE LIFTER_STEPS_PER_REV  // Steps the profile end may miss the target by
+
 #define SAFETY_MAX_POS 70*LIFTER_STEPS_PER_REV  // Revs, Sanity check on desired position to make sure it isn't larger than this
 #define SAFETY_MIN_POS 0 // Revs, Sanity check on desired position to make sure it isn't less than this
 
@@ -77,6 +87,7 @@ enum MODE
     HOMING,
     LATCH_OPEN,
     LATCH_CLOSE,
+    PROFILE_POS,
 };
 
 struct Command
@@ -88,6 +99,7 @@ struct Command
     bool latch_open;
     bool latch_close;
     bool status_req;
+    bool profile;
 };
 
 struct CartVelocity
@@ -96,11 +108,9 @@ struct CartVelocity
     float vy;
     float va;
 
-    String toString() const
+    void debugPrint(const char* label) const
     {
-        char s[100];
-        sprintf(s, "[vx: %.4f, vy: %.4f, va: %.4f]", vx, vy, va);
-        return static_cast<String>(s);
+        comm.sendf("DEBUG %s [vx: %.4f, vy: %.4f, va: %.4f]", label, vx, vy, va);
     }
 };
 
@@ -110,16 +120,14 @@ struct MotorVelocity
     float v1;
     float v2;
 
-    String toString() const
+    void debugPrint(const char* label) const
     {
-        char s[100];
-        sprintf(s, "[v0: %.4f, v1: %.4f, v2: %.4f]", v0, v1, v2);
-        return static_cast<String>(s);
+        comm.sendf("DEBUG %s [v0: %.4f, v1: %.4f, v2: %.4f]", label, v0, v1, v2);
     }
 
     bool nonzero() const
     {
-      return v0 != 0 && v1 != 0 && v2 != 0;
+      return v0 != 0 || v1 != 0 || v2 != 0;
     }
 };
 
@@ -151,6 +159,11 @@ void lifter_setup()
     LIFTER_MOTOR.EnableRequest(false);
 }
 
+// Lifter profiles are uploaded like base trajectories and share their code further down
+bool startLifterProfile(long target);
+bool updateLifterProfile();
+void endLifterProfile();
+
 bool checkForLifterButtonFallingEdge(bool button_state) 
 {
     if (button_state != prev_button_state &&
@@ -171,66 +184,69 @@ bool checkForLifterButtonFallingEdge(bool button_state)
 // "home", "stop", or an integer representing position to move to
 // "open" or "close" controls the latch servo
 // "status_req" will request a status of the mode
-// Note that this assumes the message has already been validated
-Command decodeLifterMsg(String msg_in)
+// "scurve:<pos>" follows the lifter profile uploaded before it to pos, or does a normal move if there is none
+// Automatic modes send "lift:done:<pos|home|open|close>" on their own as soon as they finish
+// Takes the message with the "lift:" identifier already stripped
+Command decodeLifterMsg(const char* msg)
 {
-    // Strip identifier
-    String msg = msg_in.substring(5);
-    Command c = {0, false, false, false, false, false, false};
+    Command c = {0, false, false, false, false, false, false, false};
 
 #if PRINT_DEBUG
-    comm.send("DEBUG Incoming lifter message: " + msg);
+    comm.sendf("DEBUG Incoming lifter message: %s", msg);
 #endif
 
-    if(msg == "home")
+    if(strcmp(msg, "home") == 0)
     {
         c.home = true;
         c.valid = true;
     }
-    else if(msg == "stop")
+    else if(strcmp(msg, "stop") == 0)
     {
         c.stop = true;
         c.valid = true;
     }
-    else if (msg == "open")
+    else if (strcmp(msg, "open") == 0)
     {
         c.latch_open = true;
         c.valid = true;
     }
-    else if (msg == "close")
+    else if (strcmp(msg, "close") == 0)
     { 
         c.latch_close = true;
         c.valid = true;
     }
-    else if (msg == "status_req")
+    else if (strcmp(msg, "status_req") == 0)
     {
       c.valid = true;
       c.status_req = true;
     }
-    else if (msg.startsWith("pos:"))
+    else if (strncmp(msg, "pos:", 4) == 0)
     {
-        String pos_msg = msg.substring(4);
-        c.abs_pos = pos_msg.toInt();
-        c.valid = true;
+        char* end;
+        c.abs_pos = strtol(msg + 4, &end, 10);
+        c.valid = end != msg + 4 && *end == '\0';
+    }
+    else if (strncmp(msg, "scurve:", 7) == 0)
+    {
+        char* end;
+        c.abs_pos = strtol(msg + 7, &end, 10);
+        c.valid = end != msg + 7 && *end == '\0';
+        c.profile = true;
     }
 
     return c;
 }
 
-void lifter_update(String msg)
+void lifter_update(const char* msg)
 {
     // Verify if incoming message is for lifter
-    Command inputCommand = {0, false, false, false, false, false};
-    bool valid_msg = false;
-    if(msg.length() > 0 && msg.startsWith("lift:")) 
-    { 
-        valid_msg = true; 
-    }
+    Command inputCommand = {0, false, false, false, false, false, false, false};
+    bool valid_msg = strncmp(msg, "lift:", 5) == 0;
 
     // Parse command if it was valid
     if(valid_msg) 
     {
-        inputCommand = decodeLifterMsg(msg);
+        inputCommand = decodeLifterMsg(msg + 5);
     }
     
     // Read inputs for manual mode
@@ -253,6 +269,10 @@ void lifter_update(String msg)
     // If we got a stop command, make sure to handle it immediately
     if (inputCommand.valid && inputCommand.stop)
     {
+        if (activeMode == MODE::PROFILE_POS)
+        {
+            endLifterProfile();
+        }
         activeMode = MODE::NONE;
 //        LIFTER_MOTOR.EnableRequest(false);
     }
@@ -298,9 +318,16 @@ void lifter_update(String msg)
         else if (inputCommand.valid && inputCommand.status_req)
         {
           #if PRINT_DEBUG
-            comm.send("DEBUG Lifter position: " + String(LIFTER_MOTOR.PositionRefCommanded()));
+            comm.sendf("DEBUG Lifter position: %ld", static_cast<long>(LIFTER_MOTOR.PositionRefCommanded()));
           #endif
         }
+        else if(inputCommand.valid && inputCommand.profile &&
+                inputCommand.abs_pos <= SAFETY_MAX_POS && inputCommand.abs_pos >= SAFETY_MIN_POS &&
+                startLifterProfile(inputCommand.abs_pos))
+        {
+            activeMode = MODE::PROFILE_POS;
+            LIFTER_MOTOR.EnableRequest(true);
+        }
         else if(inputCommand.valid)
         {
             if(inputCommand.abs_pos <= SAFETY_MAX_POS && inputCommand.abs_pos >= SAFETY_MIN_POS)
@@ -315,7 +342,7 @@ void lifter_update(String msg)
 
 
     // Handle continous updates for each mode
-    String status_str = "lift:none";
+    const char* status_str = "lift:none";
     if(activeMode == MODE::MANUAL_VEL)
     {
         status_str = "lift:manual";
@@ -330,6 +357,16 @@ void lifter_update(String msg)
         if(LIFTER_MOTOR.StepsComplete())
         {
             activeMode = MODE::NONE;
+            comm.send("lift:done:pos");
+        }
+    }
+    else if(activeMode == MODE::PROFILE_POS)
+    {
+        status_str = "lift:pos";
+        if(updateLifterProfile())
+        {
+            activeMode = MODE::NONE;
+            comm.send("lift:done:pos");
         }
     }
     else if(activeMode == MODE::HOMING)
@@ -339,6 +376,7 @@ void lifter_update(String msg)
             LIFTER_MOTOR.MoveStopAbrupt();
             LIFTER_MOTOR.PositionRefSet(0);
             activeMode = MODE::NONE;
+            comm.send("lift:done:home");
         }
         status_str = "lift:homing";
     }
@@ -348,6 +386,7 @@ void lifter_update(String msg)
         if(millis() - prevLatchMillis > LATCH_ACTIVE_MS)
         {
             activeMode = MODE::NONE;
+            comm.send("lift:done:close");
         }
     }
     else if (activeMode == MODE::LATCH_OPEN)
@@ -356,6 +395,7 @@ void lifter_update(String msg)
         if(millis() - prevLatchMillis > LATCH_ACTIVE_MS)
         {
             activeMode = MODE::NONE;
+            comm.send("lift:done:open");
         }
     }
     else if (activeMode == MODE::NONE)
@@ -380,40 +420,73 @@ void lifter_update(String msg)
 // --------------------------------------------------
 
 unsigned long last_base_msg_millis = millis();
-
-CartVelocity decodeBaseMsg(String msg)
+unsigned long base_msg_timeout_ms = MAX_BASE_MSG_TIMEOUT;
+// Set once the wheels were told to stop after a command timeout, they are disabled when they reach zero
+bool timeout_stopping = false;
+
+// Odometry streaming. Once the pi sets a period the measured velocity goes out at that rate however often
+// commands arrive, and velocity commands are no longer answered with a report of their own.
+unsigned long stream_period_us = 0;
+unsigned long last_report_micros = 0;
+
+// Trajectory following. The pi uploads both s-curves of a point to point move and starts it, after which
+// they are evaluated here every loop instead of waiting for a velocity from the pi. The pi only sends
+// corrections from its position controller. Any velocity command or Power:OFF ends the trajectory.
+// Lifter profiles come the same way as a third axis, a lift:scurve message starts them.
+#define TRAJ_AXIS_TRANSLATION 0
+#define TRAJ_AXIS_ROTATION 1
+#define TRAJ_AXIS_LIFTER 2
+#define TRAJ_REPORT_PERIOD_US 10000
+struct TrajectoryAxis
+{
+    uint16_t id;
+    bool loaded;
+    float dir[2];
+    float v_lim;
+    float a_lim;
+    float j_lim;
+    float switch_points[8][4];   // t, p, v, a
+};
+TrajectoryAxis traj_axes[3];
+bool traj_active = false;
+uint16_t traj_id = 0;
+float traj_start_heading = 0;
+unsigned long traj_start_micros = 0;
+CartVelocity traj_correction;
+float traj_heading_error = 0;
+long lift_profile_start_pos = 0;
+long lift_profile_target = 0;
+unsigned long lift_profile_start_micros = 0;
+bool lift_profile_finishing = false;
+
+// Parses "vx,vy,va" where it lies in the receive buffer. Returns false unless it is exactly three numbers.
+bool decodeBaseMsg(const char* msg, CartVelocity* cv)
 {
 #if PRINT_DEBUG
-    comm.send("DEBUG Incoming base message: " + msg);
+    comm.sendf("DEBUG Incoming base message: %s", msg);
 #endif
     float vals[3];
-    int prev_idx = 0;
-    int j = 0;
-    for(int i = 0; i < msg.length(); i++)
+    const char* field = msg;
+    for(int i = 0; i < 3; i++)
     {
-      if(msg[i] == ',')
-      {
-        vals[j] = msg.substring(prev_idx, i).toFloat();
-        j++;
-        prev_idx = i+1;
-      }
-
-      if (i == msg.length()-1)
-      {
-        vals[j] = msg.substring(prev_idx).toFloat();
-      }
+        char* end;
+        vals[i] = strtof(field, &end);
+        if(end == field || *end != (i < 2 ? ',' : '\0'))
+        {
+            return false;
+        }
+        field = end + 1;
     }
 
-    CartVelocity cv;
-    cv.vx = vals[0];
-    cv.vy = vals[1];
-    cv.va = vals[2];
+    cv->vx = vals[0];
+    cv->vy = vals[1];
+    cv->va = vals[2];
     
 #if PRINT_DEBUG
-    comm.send("DEBUG Decoded message: " + cv.toString());
+    cv->debugPrint("Decoded message:");
 #endif
 
-    return cv;
+    return true;
 }
 
 // https://www.wolframalpha.com/input/?i=%5B%5B-cosd%2830%29%2C+sind%2830%29%2C+d%5D%2C%5Bcosd%2830%29%2C+sind%2830%29%2C+d%5D%2C%5B0%2C-1%2Cd%5D%5D
@@ -424,7 +497,7 @@ MotorVelocity doIK(CartVelocity cmd)
     motors.v1 = -1/WHEEL_RADIUS * (     sq3 / 2 * cmd.vx  + 0.5 * cmd.vy + WHEEL_DIST_FROM_CENTER * cmd.va) * BELT_RATIO;
     motors.v2 = -1/WHEEL_RADIUS * (                       - 1   * cmd.vy + WHEEL_DIST_FROM_CENTER * cmd.va) * BELT_RATIO;
 #if PRINT_DEBUG
-    comm.send("DEBUG After IK: " + motors.toString());
+    motors.debugPrint("After IK:");
 #endif
     return motors;
 }
@@ -432,7 +505,7 @@ MotorVelocity doIK(CartVelocity cmd)
 void SendCommandsToMotors(MotorVelocity motors)
 {
 #if PRINT_DEBUG
-    comm.send("DEBUG Send to motor: " + String(motors.v0 * radsPerSecondToStepsPerSecond));
+    comm.sendf("DEBUG Send to motor: %.1f", motors.v0 * radsPerSecondToStepsPerSecond);
 #endif
 
 #if USE_FAKE_MOTOR
@@ -461,7 +534,7 @@ MotorVelocity ReadMotorSpeeds()
 #endif
 
 #if PRINT_DEBUG
-    comm.send("DEBUG Motor measured: " + measured.toString());
+    measured.debugPrint("Motor measured:");
 #endif
 
     return measured;
@@ -480,24 +553,75 @@ CartVelocity doFK(MotorVelocity motor_measured)
     robot_measured.vy = -rOver3 * ( wheel_speed.v0 + wheel_speed.v1 - 2.0 * wheel_speed.v2); 
     robot_measured.va = -rOver3 / WHEEL_DIST_FROM_CENTER * (wheel_speed.v0 + wheel_speed.v1 + wheel_speed.v2);
 #if PRINT_DEBUG
-    comm.send("DEBUG After FK: " + robot_measured.toString());
+    robot_measured.debugPrint("After FK:");
 #endif
     return robot_measured;
 
 }
 
-void ReportRobotVelocity(CartVelocity robot_v_measured)
+// Every velocity report carries the time the motor speeds were read and a counter, so the pi can
+// integrate odometry with this clock instead of its own and spot lost reports
+struct OdometryReport
+{
+    CartVelocity vel;
+    uint32_t timestamp_us;
+    uint16_t seq;
+};
+uint16_t odometry_seq = 0;
+
+void ReportRobotVelocity(OdometryReport report)
 {
-    char msg[32];
-    sprintf(msg, "base:%.3f,%.3f,%.3f",robot_v_measured.vx, robot_v_measured.vy, robot_v_measured.va);
-    comm.send(msg);
+    comm.sendf("base:%.3f,%.3f,%.3f,%lu,%u", report.vel.vx, report.vel.vy, report.vel.va, 
+        static_cast<unsigned long>(report.timestamp_us), static_cast<unsigned int>(report.seq));
+}
+
+int16_t velocityToFixed(float v)
+{
+    float scaled = round(v * BINARY_VELOCITY_SCALE);
+    if (scaled > 32767) scaled = 32767;
+    if (scaled < -32768) scaled = -32768;
+    return static_cast<int16_t>(scaled);
+}
+
+CartVelocity decodeBinaryVelocity(const uint8_t* payload)
+{
+    float vals[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int16_t v = static_cast<int16_t>(payload[2*i] | (payload[2*i + 1] << 8));
+        vals[i] = v / BINARY_VELOCITY_SCALE;
+    }
+    CartVelocity cv;
+    cv.vx = vals[0];
+    cv.vy = vals[1];
+    cv.va = vals[2];
+    return cv;
+}
+
+void ReportRobotVelocityBinary(OdometryReport report)
+{
+    const int16_t vals[3] = {velocityToFixed(report.vel.vx), velocityToFixed(report.vel.vy), velocityToFixed(report.vel.va)};
+    uint8_t payload[BINARY_ODOMETRY_PAYLOAD_SIZE];
+    for (int i = 0; i < 3; i++)
+    {
+        uint16_t u = static_cast<uint16_t>(vals[i]);
+        payload[2*i] = u & 0xFF;
+        payload[2*i + 1] = u >> 8;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        payload[BINARY_VELOCITY_PAYLOAD_SIZE + i] = (report.timestamp_us >> (8*i)) & 0xFF;
+    }
+    payload[BINARY_VELOCITY_PAYLOAD_SIZE + 4] = report.seq & 0xFF;
+    payload[BINARY_VELOCITY_PAYLOAD_SIZE + 5] = report.seq >> 8;
+    comm.sendBinary(BINARY_CHANNEL_BASE_ODOMETRY, payload, BINARY_ODOMETRY_PAYLOAD_SIZE);
 }
 
 
 // Checks for any motor on/off requests before trying to parse for commanded speeds
-bool handlePowerRequests(String msg)
+bool handlePowerRequests(const char* msg)
 {
-    if(msg == "Power:ON")
+    if(strcmp(msg, "Power:ON") == 0)
     {
         MOTOR_FRONT_RIGHT.EnableRequest(true);
         MOTOR_REAR_CENTER.EnableRequest(true);
@@ -507,8 +631,9 @@ bool handlePowerRequests(String msg)
 #endif
         return true;
     }
-    else if (msg == "Power:OFF")
+    else if (strcmp(msg, "Power:OFF") == 0)
     {
+        traj_active = false;
         MOTOR_FRONT_RIGHT.EnableRequest(false);
         MOTOR_REAR_CENTER.EnableRequest(false);
         MOTOR_FRONT_LEFT.EnableRequest(false);
@@ -533,40 +658,369 @@ void base_setup()
     MOTOR_FRONT_LEFT.AccelMax(MOTOR_MAX_ACC_STEPS_PER_SECOND_SQUARED);
 }
 
-bool isValidBaseMessage(String msg)
+bool isValidBaseMessage(const char* msg)
 {
-    bool result = false;
-    if(msg.length() > 0 && msg.startsWith("base:")) 
-    { 
-        result = true; 
+    return strncmp(msg, "base:", 5) == 0;
+}
+
+
+// Robot velocity from the motor speeds right now
+OdometryReport measureVelocity()
+{
+    MotorVelocity motor_v_measured = ReadMotorSpeeds();
+    OdometryReport report;
+    report.timestamp_us = micros();
+    report.seq = odometry_seq++;
+    report.vel = doFK(motor_v_measured);
+    return report;
+}
+
+// Commands the motors and returns the measured robot velocity
+OdometryReport runVelocityCommand(CartVelocity cmd_v)
+{
+    MotorVelocity motor_v = doIK(cmd_v);
+    SendCommandsToMotors(motor_v);
+    return measureVelocity();
+}
+
+// Any command from the pi that should keep the base moving
+void baseCommandReceived()
+{
+    last_base_msg_millis = millis();
+    timeout_stopping = false;
+}
+
+const uint8_t* readUint16(const uint8_t* in, uint16_t* v)
+{
+    *v = in[0] | (in[1] << 8);
+    return in + 2;
+}
+
+const uint8_t* readUint32(const uint8_t* in, uint32_t* v)
+{
+    *v = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        *v |= static_cast<uint32_t>(in[i]) << (8*i);
+    }
+    return in + 4;
+}
+
+const uint8_t* readFloat(const uint8_t* in, float* v)
+{
+    uint32_t u = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        u |= static_cast<uint32_t>(in[i]) << (8*i);
     }
-    return result;
+    memcpy(v, &u, sizeof(u));
+    return in + 4;
 }
 
+void decodeTrajectoryAxis(const uint8_t* payload)
+{
+    uint16_t id;
+    payload = readUint16(payload, &id);
+    uint8_t axis = *payload++;
+    if (axis > TRAJ_AXIS_LIFTER) { return; }
+    TrajectoryAxis& traj = traj_axes[axis];
+    traj.id = id;
+    payload = readFloat(payload, &traj.dir[0]);
+    payload = readFloat(payload, &traj.dir[1]);
+    payload = readFloat(payload, &traj.v_lim);
+    payload = readFloat(payload, &traj.a_lim);
+    payload = readFloat(payload, &traj.j_lim);
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            payload = readFloat(payload, &traj.switch_points[i][j]);
+        }
+    }
+    traj.loaded = true;
+}
 
-void base_update(String msg)
+void startTrajectory(const uint8_t* payload)
+{
+    uint16_t id;
+    payload = readUint16(payload, &id);
+    readFloat(payload, &traj_start_heading);
+    if (!traj_axes[0].loaded || !traj_axes[1].loaded || traj_axes[0].id != id || traj_axes[1].id != id) { return; }
+    traj_id = id;
+    traj_active = true;
+    traj_start_micros = micros();
+    last_report_micros = traj_start_micros;
+    traj_correction = {0,0,0};
+    traj_heading_error = 0;
+}
+
+void decodeStreamConfig(const uint8_t* payload)
+{
+    uint32_t period_us;
+    uint16_t timeout_ms;
+    payload = readUint32(payload, &period_us);
+    readUint16(payload, &timeout_ms);
+    stream_period_us = period_us;
+    base_msg_timeout_ms = timeout_ms > 0 ? timeout_ms : MAX_BASE_MSG_TIMEOUT;
+    last_report_micros = micros();
+}
+
+void decodeTrajectoryCorrection(const uint8_t* payload)
+{
+    uint16_t id;
+    payload = readUint16(payload, &id);
+    if (id != traj_id) { return; }
+    traj_correction = decodeBinaryVelocity(payload);
+    readFloat(payload + BINARY_VELOCITY_PAYLOAD_SIZE, &traj_heading_error);
+}
+
+// Same region math as computeKinematicsBasedOnRegion on the pi, only position and velocity are needed
+void evaluateTrajectoryAxis(const TrajectoryAxis& traj, float t, float* p, float* v)
+{
+    const float (*sp)[4] = traj.switch_points;
+    if (t <= sp[0][0]) { *p = sp[0][1]; *v = sp[0][2]; return; }
+    if (t > sp[7][0])  { *p = sp[7][1]; *v = sp[7][2]; return; }
+    int i = 1;
+    while (i < 7 && t > sp[i][0]) i++;
+
+    float j = 0;
+    float a = sp[i-1][3];
+    if (i == 1 || i == 7)      { j = traj.j_lim; }
+    else if (i == 3 || i == 5) { j = -traj.j_lim; }
+    else if (i == 2)           { a = traj.a_lim; }
+    else if (i == 6)           { a = -traj.a_lim; }
+    else                       { a = 0; }
+
+    float dt = t - sp[i-1][0];
+    *v = (i == 4) ? traj.v_lim : sp[i-1][2] + sp[i-1][3] * dt + 0.5 * j * dt * dt;
+    *p = sp[i-1][1] + sp[i-1][2] * dt + 0.5 * sp[i-1][3] * dt * dt + j * dt * dt * dt / 6.0;
+}
+
+bool startLifterProfile(long target)
+{
+    TrajectoryAxis& traj = traj_axes[TRAJ_AXIS_LIFTER];
+    if (!traj.loaded) { return false; }
+    // Each upload is only run once
+    traj.loaded = false;
+
+    const long start = LIFTER_MOTOR.PositionRefCommanded();
+    const float end = start + traj.dir[0] * traj.switch_points[7][1];
+    if (fabs(end - target) > LIFTER_PROFILE_START_TOLERANCE ||
+        traj.v_lim > LIFTER_PROFILE_MAX_VEL * LIFTER_STEPS_PER_REV ||
+        traj.a_lim > LIFTER_PROFILE_MAX_ACC * LIFTER_STEPS_PER_REV)
+    {
+#if PRINT_DEBUG
+        comm.sendf("DEBUG Lifter profile from %ld doesn't fit, moving normally", start);
+#endif
+        return false;
+    }
+
+    lift_profile_start_pos = start;
+    lift_profile_target = target;
+    lift_profile_start_micros = micros();
+    lift_profile_finishing = false;
+    LIFTER_MOTOR.VelMax(LIFTER_PROFILE_MAX_VEL*LIFTER_STEPS_PER_REV);
+    LIFTER_MOTOR.AccelMax(LIFTER_PROFILE_MAX_ACC*LIFTER_STEPS_PER_REV);
+    return true;
+}
+
+// Returns true once the lifter has stopped at the target
+bool updateLifterProfile()
+{
+    const TrajectoryAxis& traj = traj_axes[TRAJ_AXIS_LIFTER];
+    if (!lift_profile_finishing)
+    {
+        float t = (micros() - lift_profile_start_micros) / 1000000.0;
+        if (t <= traj.switch_points[7][0])
+        {
+            float p, v;
+            evaluateTrajectoryAxis(traj, t, &p, &v);
+            float err = lift_profile_start_pos + traj.dir[0] * p - LIFTER_MOTOR.PositionRefCommanded();
+            LIFTER_MOTOR.MoveVelocity(traj.dir[0] * v + LIFTER_PROFILE_KP * err);
+            return false;
+        }
+        // At the end of the profile only a few steps are left, a normal move lands exactly on the target
+        LIFTER_MOTOR.Move(lift_profile_target, StepGenerator::MOVE_TARGET_ABSOLUTE);
+        lift_profile_finishing = true;
+        return false;
+    }
+    if (!LIFTER_MOTOR.StepsComplete()) { return false; }
+    endLifterProfile();
+    return true;
+}
+
+void endLifterProfile()
+{
+    LIFTER_MOTOR.VelMax(LIFTER_MAX_VEL*LIFTER_STEPS_PER_REV);
+    LIFTER_MOTOR.AccelMax(LIFTER_MAX_ACC*LIFTER_STEPS_PER_REV);
+}
+
+void trajectory_update()
+{
+    if (!traj_active) { return; }
+
+    float t = (micros() - traj_start_micros) / 1000000.0;
+    float trans_p, trans_v, rot_p, rot_v;
+    evaluateTrajectoryAxis(traj_axes[TRAJ_AXIS_TRANSLATION], t, &trans_p, &trans_v);
+    evaluateTrajectoryAxis(traj_axes[TRAJ_AXIS_ROTATION], t, &rot_p, &rot_v);
+
+    // Global velocity from the trajectory plus the pi's feedback, rotated into the robot frame
+    const TrajectoryAxis& trans = traj_axes[TRAJ_AXIS_TRANSLATION];
+    const TrajectoryAxis& rot = traj_axes[TRAJ_AXIS_ROTATION];
+    float vx = trans.dir[0] * trans_v + traj_correction.vx;
+    float vy = trans.dir[1] * trans_v + traj_correction.vy;
+    float heading = traj_start_heading + rot.dir[0] * rot_p + traj_heading_error;
+    CartVelocity local_v;
+    local_v.vx =  cos(heading) * vx + sin(heading) * vy;
+    local_v.vy = -sin(heading) * vx + cos(heading) * vy;
+    local_v.va = rot.dir[0] * rot_v + traj_correction.va;
+
+    OdometryReport report = runVelocityCommand(local_v);
+    const unsigned long period_us = stream_period_us > 0 ? stream_period_us : TRAJ_REPORT_PERIOD_US;
+    if (report.timestamp_us - last_report_micros >= period_us)
+    {
+        last_report_micros = report.timestamp_us;
+        ReportRobotVelocityBinary(report);
+    }
+}
+
+// While streaming and not following a trajectory, reports whatever the wheels are doing once a period
+void stream_update()
+{
+    if (stream_period_us == 0 || traj_active) { return; }
+    if (micros() - last_report_micros < stream_period_us) { return; }
+    OdometryReport report = measureVelocity();
+    last_report_micros = report.timestamp_us;
+    ReportRobotVelocityBinary(report);
+}
+
+// Velocity commands can arrive as text or as binary frames, the reply uses the same format as the command
+void base_update(const char* msg)
 {    
+    // Without commands the wheels ramp down at AccelMax like any other speed change, cutting the enable
+    // mid move would stop them dead. They are only disabled once the step generators reach zero.
     MotorVelocity cur_motor_v = ReadMotorSpeeds();
-    if(millis() - last_base_msg_millis > MAX_BASE_MSG_TIMEOUT && cur_motor_v.nonzero()) 
+    if(millis() - last_base_msg_millis > base_msg_timeout_ms && (cur_motor_v.nonzero() || traj_active) && !timeout_stopping) 
     {
+      traj_active = false;
       SendCommandsToMotors({0,0,0});
+      timeout_stopping = true;
+    }
+    else if(timeout_stopping && !cur_motor_v.nonzero())
+    {
       handlePowerRequests("Power:OFF");
+      timeout_stopping = false;
     }
+
+    uint8_t channel = 0;
+    uint8_t len = 0;
+    uint8_t payload[BINARY_MAX_PAYLOAD];
+    if(comm.rcvBinary(&channel, payload, &len))
+    {
+        if(channel == BINARY_CHANNEL_BASE_VELOCITY && len == BINARY_VELOCITY_PAYLOAD_SIZE)
+        {
+            traj_active = false;
+            baseCommandReceived();
+            OdometryReport report = runVelocityCommand(decodeBinaryVelocity(payload));
+            if(stream_period_us == 0)
+            {
+                ReportRobotVelocityBinary(report);
+            }
+        }
+        else if(channel == BINARY_CHANNEL_TRAJECTORY_AXIS && len == BINARY_TRAJECTORY_AXIS_PAYLOAD_SIZE)
+        {
+            decodeTrajectoryAxis(payload);
+        }
+        else if(channel == BINARY_CHANNEL_TRAJECTORY_START && len == BINARY_TRAJECTORY_START_PAYLOAD_SIZE)
+        {
+            startTrajectory(payload);
+            baseCommandReceived();
+        }
+        else if(channel == BINARY_CHANNEL_TRAJECTORY_CORRECTION && len == BINARY_TRAJECTORY_CORRECTION_PAYLOAD_SIZE)
+        {
+            decodeTrajectoryCorrection(payload);
+            baseCommandReceived();
+        }
+        else if(channel == BINARY_CHANNEL_STREAM_CONFIG && len == BINARY_STREAM_CONFIG_PAYLOAD_SIZE)
+        {
+            decodeStreamConfig(payload);
+        }
+    }
+    trajectory_update();
+    stream_update();
     
     if(!isValidBaseMessage(msg)) { return; }
-    last_base_msg_millis = millis();
+    baseCommandReceived();
 
     // Strip base identifier
-    String new_msg = msg.substring(5);
+    const char* new_msg = msg + 5;
     
-    if(!handlePowerRequests(new_msg))
+    if(handlePowerRequests(new_msg)) { return; }
+
+    CartVelocity cmd_v;
+    if(decodeBaseMsg(new_msg, &cmd_v))
+    {
+        traj_active = false;
+        ReportRobotVelocity(runVelocityCommand(cmd_v));
+    }
+#if PRINT_DEBUG
+    else
     {
-        CartVelocity cmd_v = decodeBaseMsg(new_msg);
-        MotorVelocity motor_v = doIK(cmd_v);
-        SendCommandsToMotors(motor_v);
-        MotorVelocity motor_v_measured = ReadMotorSpeeds();
-        CartVelocity robot_v_measured = doFK(motor_v_measured);
-        ReportRobotVelocity(robot_v_measured);
+        comm.sendf("DEBUG Malformed base message: %s", new_msg);
+    }
+#endif
+}
+
+
+// --------------------------------------------------
+//                Loop timing
+// --------------------------------------------------
+
+// Time between loop() starts, so it includes everything the core does in between. Reported to the pi as
+// max and mean over each period, which bounds how late a velocity command can be picked up.
+#define LOOP_STATS_PERIOD_US 1000000
+unsigned long loop_prev_micros = 0;
+unsigned long loop_window_start_micros = 0;
+uint32_t loop_max_us = 0;
+uint32_t loop_count = 0;
+
+void putUint32(uint32_t v, uint8_t* out)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = (v >> (8*i)) & 0xFF;
+    }
+}
+
+void ReportLoopStats(uint32_t max_us, uint32_t mean_us, uint32_t count)
+{
+    const uint16_t count16 = count > 0xFFFF ? 0xFFFF : count;
+    const uint16_t dropped = comm.getDroppedMessages();
+    uint8_t payload[BINARY_DRIVER_STATS_PAYLOAD_SIZE];
+    putUint32(max_us, payload);
+    putUint32(mean_us, payload + 4);
+    payload[8] = count16 & 0xFF;
+    payload[9] = count16 >> 8;
+    payload[10] = dropped & 0xFF;
+    payload[11] = dropped >> 8;
+    comm.sendBinary(BINARY_CHANNEL_DRIVER_STATS, payload, BINARY_DRIVER_STATS_PAYLOAD_SIZE);
+}
+
+void loop_stats_update()
+{
+    const unsigned long now = micros();
+    const uint32_t period = now - loop_prev_micros;
+    loop_prev_micros = now;
+    if (period > loop_max_us) loop_max_us = period;
+    loop_count++;
+
+    const uint32_t window = now - loop_window_start_micros;
+    if (window >= LOOP_STATS_PERIOD_US)
+    {
+        ReportLoopStats(loop_max_us, window / loop_count, loop_count);
+        loop_window_start_micros = now;
+        loop_max_us = 0;
+        loop_count = 0;
     }
 }
 
@@ -577,7 +1031,7 @@ void base_update(String msg)
 
 void setup()
 {
-    Serial.begin(115200);
+    Serial.begin(SERIAL_BAUD);
 
     // Sets the input clocking rate.
     MotorMgr.MotorInputClocking(MotorManager::CLOCK_RATE_LOW);
@@ -586,11 +1040,15 @@ void setup()
 
     base_setup();
     lifter_setup();
+
+    loop_prev_micros = micros();
+    loop_window_start_micros = loop_prev_micros;
 }
 
 void loop()
 {
-    String msg = comm.rcv();
+    loop_stats_update();
+    const char* msg = comm.rcv();
     base_update(msg);
     lifter_update(msg);
 }